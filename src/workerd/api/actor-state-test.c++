@@ -79,6 +79,73 @@ KJ_TEST("we support deserializing up to v15") {
   }
 }
 
+KJ_TEST("simple values are serialized exactly as v8 serializes them") {
+  jsg::test::Evaluator<ActorStateContext, ActorStateIsolate> e(v8System);
+  ActorStateIsolate &actorStateIsolate = e.getIsolate();
+  ActorStateIsolate::Lock isolateLock(actorStateIsolate);
+  auto* isolate = isolateLock.v8Isolate;
+  v8::HandleScope handleScope(isolate);
+  auto v8Context = isolateLock.newContext<ActorStateContext>().getHandle(isolate);
+  v8::Context::Scope contextScope(v8Context);
+
+  kj::Vector<v8::Local<v8::Value>> values;
+  values.add(v8::Undefined(isolate));
+  values.add(v8::Null(isolate));
+  values.add(v8::True(isolate));
+  values.add(v8::False(isolate));
+  values.add(v8::Integer::New(isolate, 0));
+  values.add(v8::Integer::New(isolate, 1));
+  values.add(v8::Integer::New(isolate, -1));
+  values.add(v8::Integer::New(isolate, 123456));
+  values.add(v8::Number::New(isolate, 1.5));
+  values.add(v8::Number::New(isolate, -0.0));
+  values.add(v8::Number::New(isolate, 1e300));
+  values.add(jsg::v8Str(isolate, ""_kj));
+  values.add(jsg::v8Str(isolate, "session-1234"_kj));
+  values.add(jsg::v8StrFromLatin1(isolate, "caf\xe9"_kjb));
+  values.add(jsg::v8Str(isolate, "snow \xe2\x98\x83 man"_kj));
+  values.add(jsg::v8Str(isolate, "\xe2\x98\x83"_kj));
+  // Long enough that the length takes two bytes, so that V8 inserts padding.
+  kj::Vector<char> snowmen;
+  for (auto i = 0; i < 100; i++) snowmen.addAll("\xe2\x98\x83"_kj);
+  values.add(jsg::v8Str(isolate, snowmen.asPtr().asConst()));
+  auto buffer = v8::ArrayBuffer::New(isolate, 3);
+  memcpy(buffer->Data(), "abc", 3);
+  values.add(buffer);
+  values.add(v8::ArrayBuffer::New(isolate, 0));
+
+  for (auto value: values) {
+    auto simple = KJ_ASSERT_NONNULL(jsg::trySerializeSimpleValue(isolate, value));
+
+    jsg::Serializer serializer(isolate, jsg::Serializer::Options { .version = 15 });
+    serializer.write(value);
+    auto expected = serializer.release();
+    KJ_EXPECT(simple.asPtr() == expected.data.asPtr(), simple, expected.data);
+
+    auto roundTripped = deserializeV8Value("some-key"_kj, simple, isolate);
+    if (value->IsArrayBuffer()) {
+      KJ_ASSERT(roundTripped->IsArrayBuffer());
+      auto original = value.As<v8::ArrayBuffer>();
+      auto copy = roundTripped.As<v8::ArrayBuffer>();
+      KJ_EXPECT(kj::arrayPtr(static_cast<kj::byte*>(copy->Data()), copy->ByteLength()) ==
+                kj::arrayPtr(static_cast<kj::byte*>(original->Data()), original->ByteLength()));
+    } else {
+      KJ_EXPECT(roundTripped->SameValue(value));
+    }
+  }
+
+  // Anything else is left to the real serializer.
+  KJ_EXPECT(jsg::trySerializeSimpleValue(isolate, v8::Object::New(isolate)) == nullptr);
+  KJ_EXPECT(jsg::tryDeserializeSimpleValue(isolate, serializeV8Value(
+      v8::Object::New(isolate), isolate)) == nullptr);
+
+  // Trailing bytes, or a truncated value, aren't a simple value either.
+  auto trailing = kj::decodeHex("FF0F5454"_kj.asArray());
+  KJ_EXPECT(jsg::tryDeserializeSimpleValue(isolate, trailing) == nullptr);
+  auto truncated = kj::decodeHex("FF0F2205616263"_kj.asArray());
+  KJ_EXPECT(jsg::tryDeserializeSimpleValue(isolate, truncated) == nullptr);
+}
+
 // This is hacky, but we want to compare the old deserialization logic that's been in prod from when
 // actors went live through March 2022 to the new version of the deserialization logic and make sure
 // it works the same.
@@ -41,6 +41,17 @@ v8::Local<v8::Value> deserializeMaybeV8Value(
   }
 }
 
+template <typename T>
+kj::Promise<T> traceStorageRead(IoContext& context, kj::Promise<T> promise) {
+  // Gives a read that has to go to storage a span of its own, if the request is traced. Reads
+  // answered from the cache complete synchronously, so they don't get one.
+  auto span = context.makeTraceSpan("durable_object_storage_read");
+  if (span.isObserved()) {
+    return promise.attach(kj::mv(span));
+  }
+  return kj::mv(promise);
+}
+
 template <typename T, typename Options, typename Func>
 auto transformCacheResult(
     v8::Isolate* isolate, kj::OneOf<T, kj::Promise<T>> input, const Options& options, Func&& func)
@@ -51,6 +62,7 @@ auto transformCacheResult(
     }
     KJ_CASE_ONEOF(promise, kj::Promise<T>) {
       auto& context = IoContext::current();
+      promise = traceStorageRead(context, kj::mv(promise));
       if (options.allowConcurrency.orDefault(false)) {
         return context.awaitIo(kj::mv(promise),
             [func = kj::fwd<Func>(func), isolate](T&& value) mutable {
@@ -77,6 +89,7 @@ auto transformCacheResultWithCacheStatus(
     }
     KJ_CASE_ONEOF(promise, kj::Promise<T>) {
       auto& context = IoContext::current();
+      promise = traceStorageRead(context, kj::mv(promise));
       if (options.allowConcurrency.orDefault(false)) {
         return context.awaitIo(kj::mv(promise),
             [func = kj::fwd<Func>(func), isolate](T&& value) mutable {
@@ -718,7 +731,37 @@ jsg::Promise<jsg::Value> DurableObjectState::blockConcurrencyWhile(jsg::Lock& js
   return IoContext::current().blockConcurrencyWhile(js, kj::mv(callback));
 }
 
+void DurableObjectState::acceptWebSocket(jsg::Lock& js, jsg::Ref<WebSocket> ws,
+    jsg::Optional<kj::Array<kj::String>> tags) {
+  auto tagArray = kj::mv(tags).orDefault(nullptr);
+  JSG_REQUIRE(tagArray.size() <= HibernationManager::MAX_TAGS_PER_SOCKET, RangeError,
+      "A WebSocket can have at most ", HibernationManager::MAX_TAGS_PER_SOCKET, " tags.");
+  for (auto& tag: tagArray) {
+    JSG_REQUIRE(tag.size() <= HibernationManager::MAX_TAG_LENGTH, RangeError,
+        "A WebSocket tag can be at most ", HibernationManager::MAX_TAG_LENGTH, " characters.");
+  }
+
+  auto& manager = JSG_REQUIRE_NONNULL(
+      IoContext::current().getActorOrThrow().getOrCreateHibernationManager(), Error,
+      "This Durable Object does not support hibernatable WebSockets.");
+
+  ws->acceptHibernatable(js, manager, kj::mv(tagArray));
+}
+
+kj::Array<jsg::Ref<WebSocket>> DurableObjectState::getWebSockets(
+    jsg::Lock& js, jsg::Optional<kj::String> tag) {
+  KJ_IF_MAYBE(manager, IoContext::current().getActorOrThrow().getHibernationManager()) {
+    return manager->getWebSockets(js, tag.map([](kj::String& t) -> kj::StringPtr { return t; }));
+  }
+  return nullptr;
+}
+
 kj::Array<kj::byte> serializeV8Value(v8::Local<v8::Value> value, v8::Isolate* isolate) {
+  // Counters, flags and strings are the bulk of what's stored, and don't need a full serializer.
+  KJ_IF_MAYBE(simple, jsg::trySerializeSimpleValue(isolate, value)) {
+    return kj::mv(*simple);
+  }
+
   jsg::Serializer serializer(isolate, jsg::Serializer::Options {
     .version = 15,
     .omitHeader = false,
@@ -764,6 +807,10 @@ v8::Local<v8::Value> deserializeV8Value(
 
   KJ_ASSERT(buf.size() > 0, "unexpectedly empty value buffer", key);
 
+  KJ_IF_MAYBE(simple, jsg::tryDeserializeSimpleValue(isolate, buf)) {
+    return *simple;
+  }
+
   jsg::Deserializer::Options options {};
   if (buf[0] != 0xFF) {
     // When Durable Objects was first released, it did not properly write headers when serializing
@@ -14,6 +14,7 @@
 #include <v8.h>
 #include <workerd/io/promise-wrapper.h>
 #include "util.h"
+#include "web-socket.h"
 #include <workerd/io/actor-cache.h>
 
 namespace workerd::api {
@@ -345,11 +346,23 @@ public:
   jsg::Promise<jsg::Value> blockConcurrencyWhile(jsg::Lock& js,
       jsg::Function<jsg::Promise<jsg::Value>()> callback);
 
+  void acceptWebSocket(jsg::Lock& js, jsg::Ref<WebSocket> ws,
+      jsg::Optional<kj::Array<kj::String>> tags);
+  // Accepts `ws` on behalf of the actor such that the actor can be hibernated while the socket
+  // is connected. Events on the socket are delivered to the `webSocketMessage()`,
+  // `webSocketClose()`, and `webSocketError()` methods of the actor's class.
+
+  kj::Array<jsg::Ref<WebSocket>> getWebSockets(jsg::Lock& js, jsg::Optional<kj::String> tag);
+  // Gets the connected WebSockets accepted with acceptWebSocket(), optionally only those that were
+  // given `tag`.
+
   JSG_RESOURCE_TYPE(DurableObjectState) {
     JSG_METHOD(waitUntil);
     JSG_READONLY_INSTANCE_PROPERTY(id, getId);
     JSG_READONLY_INSTANCE_PROPERTY(storage, getStorage);
     JSG_METHOD(blockConcurrencyWhile);
+    JSG_METHOD(acceptWebSocket);
+    JSG_METHOD(getWebSockets);
 
     JSG_TS_ROOT();
     JSG_TS_OVERRIDE({
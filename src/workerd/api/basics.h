@@ -135,9 +135,9 @@ public:
       JSG_INSTANCE_PROPERTY(cancelBubble, getCancelBubble, setCancelBubble);
     }
 
-    JSG_METHOD(stopImmediatePropagation);
-    JSG_METHOD(preventDefault);
-    JSG_METHOD(stopPropagation);
+    JSG_FAST_METHOD(stopImmediatePropagation);
+    JSG_FAST_METHOD(preventDefault);
+    JSG_FAST_METHOD(stopPropagation);
     JSG_METHOD(composedPath);
 
     JSG_STATIC_CONSTANT(NONE);
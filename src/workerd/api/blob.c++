@@ -7,54 +7,125 @@
 
 namespace workerd::api {
 
-static kj::Array<byte> concat(jsg::Optional<Blob::Bits> maybeBits) {
-  // Concatenate an array of segments (parameter to Blob constructor).
-  //
-  // TODO(perf): Make it so that a Blob can keep references to the input data rather than copy it.
-  //   Note that we can't keep references to ArrayBuffers since they are mutable, but we can
-  //   reference other Blobs in the input.
+namespace {
 
-  auto bits = kj::mv(maybeBits).orDefault(nullptr);
+const jsg::ExternalMemoryTracker::Counter& getMemoryCounter() {
+  // Blobs are only ever created by JavaScript APIs, with the isolate locked.
+  return jsg::Lock::from(v8::Isolate::GetCurrent()).getExternalMemory().getCounter("Blob");
+}
 
-  size_t size = 0;
-  for (auto& part: bits) {
-    KJ_SWITCH_ONEOF(part) {
-      KJ_CASE_ONEOF(bytes, kj::Array<const byte>) {
-        size += bytes.size();
-      }
-      KJ_CASE_ONEOF(text, kj::String) {
-        size += text.size();
-      }
-      KJ_CASE_ONEOF(blob, jsg::Ref<Blob>) {
-        size += blob->getData().size();
-      }
+}  // namespace
+
+Blob::Blob(kj::Array<byte> data, kj::String type)
+    : size(data.size()), type(kj::mv(type)), memory(getMemoryCounter(), data.size()) {
+  if (size > 0) {
+    segments = kj::arr<kj::ArrayPtr<const byte>>(data);
+    owners = kj::arr<Owner>(kj::mv(data));
+  }
+}
+
+Blob::Blob(Segments content, kj::String type)
+    : owners(kj::mv(content.owners)), segments(kj::mv(content.segments)),
+      size(content.size), type(kj::mv(type)), memory(getMemoryCounter(), ownedBytes()) {}
+
+size_t Blob::ownedBytes() {
+  size_t result = 0;
+  for (auto& owner: owners) {
+    KJ_SWITCH_ONEOF(owner) {
+      KJ_CASE_ONEOF(bytes, kj::Array<byte>) { result += bytes.size(); }
+      KJ_CASE_ONEOF(text, kj::String) { result += text.size(); }
+      KJ_CASE_ONEOF(blob, jsg::Ref<Blob>) {}
     }
   }
+  return result;
+}
 
-  if (size == 0) return nullptr;
+kj::ArrayPtr<const byte> Blob::getData() {
+  if (segments.size() == 0) {
+    return nullptr;
+  } else if (segments.size() == 1) {
+    return segments[0];
+  }
 
+  KJ_IF_MAYBE(f, flattened) {
+    return *f;
+  }
   auto result = kj::heapArray<byte>(size);
-  byte* ptr = result.begin();
+  copyTo(result);
+  memory.set(memory.get() + size);
+  return flattened.emplace(kj::mv(result));
+}
+
+void Blob::copyTo(kj::ArrayPtr<byte> out) {
+  KJ_ASSERT(out.size() == size);
+  byte* ptr = out.begin();
+  for (auto segment: segments) {
+    memcpy(ptr, segment.begin(), segment.size());
+    ptr += segment.size();
+  }
+}
+
+static constexpr size_t MIN_REFERENCED_SEGMENT_SIZE = 4096;
+// Parts smaller than this are copied together into one buffer rather than referenced, so that
+// Blobs built from many small pieces don't end up with as many segments.
+
+Blob::Segments Blob::concat(jsg::Optional<Bits> maybeBits) {
+  // Concatenate an array of segments (parameter to Blob constructor).
+  //
+  // We can't keep references to ArrayBuffers since they are mutable, so those are always copied.
+  // Strings were already copied out of the isolate when unwrapped, and Blobs are immutable, so
+  // larger ones of those are referenced instead.
+
+  auto bits = kj::mv(maybeBits).orDefault(nullptr);
+
+  kj::Vector<Owner> owners;
+  kj::Vector<kj::ArrayPtr<const byte>> segments;
+  kj::Vector<byte> buffer;
+  size_t size = 0;
+
+  auto flushBuffer = [&]() {
+    if (buffer.size() > 0) {
+      auto bytes = buffer.releaseAsArray();
+      segments.add(bytes);
+      owners.add(kj::mv(bytes));
+    }
+  };
+  auto addSegment = [&](kj::ArrayPtr<const byte> segment) {
+    size += segment.size();
+    if (segment.size() < MIN_REFERENCED_SEGMENT_SIZE) {
+      buffer.addAll(segment);
+      return false;
+    }
+    flushBuffer();
+    segments.add(segment);
+    return true;
+  };
 
   for (auto& part: bits) {
     KJ_SWITCH_ONEOF(part) {
       KJ_CASE_ONEOF(bytes, kj::Array<const byte>) {
-        memcpy(ptr, bytes.begin(), bytes.size());
-        ptr += bytes.size();
+        size += bytes.size();
+        buffer.addAll(bytes);
       }
       KJ_CASE_ONEOF(text, kj::String) {
-        memcpy(ptr, text.begin(), text.size());
-        ptr += text.size();
+        if (addSegment(text.asBytes())) {
+          owners.add(kj::mv(text));
+        }
       }
       KJ_CASE_ONEOF(blob, jsg::Ref<Blob>) {
-        memcpy(ptr, blob->getData().begin(), blob->getData().size());
-        ptr += blob->getData().size();
+        bool referenced = false;
+        for (auto segment: blob->segments) {
+          referenced = addSegment(segment) || referenced;
+        }
+        if (referenced) {
+          owners.add(kj::mv(blob));
+        }
       }
     }
   }
+  flushBuffer();
 
-  KJ_ASSERT(ptr == result.end());
-  return result;
+  return { owners.releaseAsArray(), segments.releaseAsArray(), size };
 }
 
 static kj::String normalizeType(kj::String type) {
@@ -87,70 +158,110 @@ jsg::Ref<Blob> Blob::constructor(jsg::Optional<Bits> bits, jsg::Optional<Options
 jsg::Ref<Blob> Blob::slice(jsg::Optional<int> maybeStart, jsg::Optional<int> maybeEnd,
                             jsg::Optional<kj::String> type) {
   int start = maybeStart.orDefault(0);
-  int end = maybeEnd.orDefault(data.size());
+  int end = maybeEnd.orDefault(size);
 
   if (start < 0) {
     // Negative value interpreted as offset from end.
-    start += data.size();
+    start += size;
   }
   // Clamp start to range.
   if (start < 0) {
     start = 0;
-  } else if (start > data.size()) {
-    start = data.size();
+  } else if (start > size) {
+    start = size;
   }
 
   if (end < 0) {
     // Negative value interpreted as offset from end.
-    end += data.size();
+    end += size;
   }
   // Clamp end to range.
   if (end < start) {
     end = start;
-  } else if (end > data.size()) {
-    end = data.size();
+  } else if (end > size) {
+    end = size;
   }
 
-  return jsg::alloc<Blob>(JSG_THIS, data.slice(start, end),
-      normalizeType(kj::mv(type).orDefault(nullptr)));
+  // The slice references the segments of this Blob that it overlaps.
+  kj::Vector<kj::ArrayPtr<const byte>> sliceSegments;
+  size_t offset = 0;
+  for (auto segment: segments) {
+    size_t segmentStart = offset;
+    offset += segment.size();
+    if (offset <= size_t(start)) continue;
+    if (segmentStart >= size_t(end)) break;
+
+    size_t from = kj::max(segmentStart, size_t(start)) - segmentStart;
+    size_t to = kj::min(offset, size_t(end)) - segmentStart;
+    sliceSegments.add(segment.slice(from, to));
+  }
+
+  Segments result {
+    .owners = kj::arr<Owner>(JSG_THIS),
+    .segments = sliceSegments.releaseAsArray(),
+    .size = size_t(end - start),
+  };
+  return jsg::alloc<Blob>(kj::mv(result), normalizeType(kj::mv(type).orDefault(nullptr)));
 }
 
 jsg::Promise<kj::Array<kj::byte>> Blob::arrayBuffer(v8::Isolate* isolate) {
   // TODO(perf): Find a way to avoid the copy.
-  return jsg::resolvedPromise(isolate, kj::heapArray<byte>(data));
+  auto result = kj::heapArray<byte>(size);
+  copyTo(result);
+  return jsg::resolvedPromise(isolate, kj::mv(result));
 }
 jsg::Promise<kj::String> Blob::text(v8::Isolate* isolate) {
-  return jsg::resolvedPromise(isolate, kj::str(data.asChars()));
+  auto result = kj::heapString(size);
+  copyTo(result.asArray().asBytes());
+  return jsg::resolvedPromise(isolate, kj::mv(result));
 }
 
 class Blob::BlobInputStream final: public ReadableStreamSource {
+  // Streams a Blob's segments as they are, without flattening them.
+
 public:
   BlobInputStream(jsg::Ref<Blob> blob)
-      : unread(blob->data),
+      : unread(blob->segments),
+        unreadSize(blob->size),
         blob(kj::mv(blob)) {}
 
   kj::Promise<size_t> tryRead(void* buffer, size_t minBytes, size_t maxBytes) override {
-    size_t amount = kj::min(maxBytes, unread.size());
-    memcpy(buffer, unread.begin(), amount);
-    unread = unread.slice(amount, unread.size());
+    byte* out = reinterpret_cast<byte*>(buffer);
+    size_t amount = 0;
+    while (amount < maxBytes && unread.size() > 0) {
+      auto segment = unread[0].slice(offset, unread[0].size());
+      size_t n = kj::min(maxBytes - amount, segment.size());
+      memcpy(out + amount, segment.begin(), n);
+      amount += n;
+      offset += n;
+      if (offset == unread[0].size()) {
+        unread = unread.slice(1, unread.size());
+        offset = 0;
+      }
+    }
+    unreadSize -= amount;
     return amount;
   }
 
   kj::Maybe<uint64_t> tryGetLength(StreamEncoding encoding) override {
     if (encoding == StreamEncoding::IDENTITY) {
-      return unread.size();
+      return unreadSize;
     } else {
       return nullptr;
     }
   }
 
   kj::Promise<DeferredProxy<void>> pumpTo(WritableStreamSink& output, bool end) override {
-    if (unread.size() == 0) {
+    if (unreadSize == 0) {
       return addNoopDeferredProxy(kj::READY_NOW);
     }
 
-    auto promise = output.write(unread.begin(), unread.size());
+    auto pieces = kj::heapArray<kj::ArrayPtr<const byte>>(unread);
+    pieces[0] = pieces[0].slice(offset, pieces[0].size());
+    auto promise = output.write(pieces).attach(kj::mv(pieces));
     unread = nullptr;
+    offset = 0;
+    unreadSize = 0;
 
     if (end) {
       promise = promise.then([&output]() { return output.end(); });
@@ -162,7 +273,10 @@ public:
   }
 
 private:
-  kj::ArrayPtr<const byte> unread;
+  kj::ArrayPtr<const kj::ArrayPtr<const byte>> unread;
+  size_t offset = 0;
+  // How much of `unread[0]` has been read already.
+  size_t unreadSize;
   jsg::Ref<Blob> blob;
 };
 
@@ -11,13 +11,37 @@
 namespace workerd::api {
 
 class Blob: public jsg::Object {
+  // A Blob's content is a rope: a list of segments pointing into immutable buffers that the Blob
+  // keeps alive. Blobs passed to the constructor, and the parent of a slice, are referenced rather
+  // than copied. The content is only flattened into one buffer when a caller needs a contiguous
+  // view of it.
+
 public:
-  Blob(kj::Array<byte> data, kj::String type)
-      : ownData(kj::mv(data)), data(ownData.get<kj::Array<byte>>()), type(kj::mv(type)) {}
-  Blob(jsg::Ref<Blob> parent, kj::ArrayPtr<const byte> data, kj::String type)
-      : ownData(kj::mv(parent)), data(data), type(kj::mv(type)) {}
+  using Owner = kj::OneOf<kj::Array<byte>, kj::String, jsg::Ref<Blob>>;
+  // Something that keeps segments' memory alive. A Blob referencing another Blob's segments owns
+  // a reference to that Blob.
+
+  struct Segments {
+    kj::Array<Owner> owners;
+    kj::Array<kj::ArrayPtr<const byte>> segments;
+    size_t size;
+  };
+
+  Blob(kj::Array<byte> data, kj::String type);
+  Blob(Segments content, kj::String type);
+
+  kj::ArrayPtr<const byte> getData() KJ_LIFETIMEBOUND;
+  // Get the content as one contiguous buffer. If the Blob has more than one segment, this copies
+  // them into a new buffer the first time it's called. That buffer is kept for the rest of the
+  // Blob's life, since callers (such as a Body made from the Blob) hold on to the returned view,
+  // and it is counted as external memory. Prefer getSegments() or copyTo() when a contiguous
+  // view isn't needed.
+
+  kj::ArrayPtr<const kj::ArrayPtr<const byte>> getSegments() KJ_LIFETIMEBOUND { return segments; }
+  // Get the content as the list of segments it's made of, without flattening it.
 
-  inline kj::ArrayPtr<const byte> getData() const KJ_LIFETIMEBOUND { return data; }
+  void copyTo(kj::ArrayPtr<byte> out);
+  // Copy the content into `out`, which must be exactly the Blob's size.
 
   // ---------------------------------------------------------------------------
   // JS API
@@ -33,7 +57,7 @@ public:
 
   static jsg::Ref<Blob> constructor(jsg::Optional<Bits> bits, jsg::Optional<Options> options);
 
-  int getSize() { return data.size(); }
+  int getSize() { return size; }
   kj::StringPtr getType() { return type; }
 
   jsg::Ref<Blob> slice(jsg::Optional<int> start, jsg::Optional<int> end,
@@ -58,14 +82,32 @@ public:
     JSG_METHOD(stream);
   }
 
+protected:
+  static Segments concat(jsg::Optional<Bits> maybeBits);
+  // Build the content of a Blob from the parameter to the constructor.
+
 private:
-  kj::OneOf<kj::Array<byte>, jsg::Ref<Blob>> ownData;
-  kj::ArrayPtr<const byte> data;
+  kj::Array<Owner> owners;
+  kj::Array<kj::ArrayPtr<const byte>> segments;
+  size_t size;
   kj::String type;
 
+  kj::Maybe<kj::Array<byte>> flattened;
+  // Filled in by getData() if there's more than one segment, and never released, because the
+  // view getData() returned is valid for as long as the Blob is. The segments stay around too,
+  // since slices of this Blob point into them.
+
+  jsg::ExternalMemoryAdjustment memory;
+  // Counts the buffers this Blob owns, and `flattened`, as memory held for the isolate. Segments
+  // of other Blobs are counted by those Blobs.
+
+  size_t ownedBytes();
+
   void visitForGc(jsg::GcVisitor& visitor) {
-    KJ_IF_MAYBE(b, ownData.tryGet<jsg::Ref<Blob>>()) {
-      visitor.visit(*b);
+    for (auto& owner: owners) {
+      KJ_IF_MAYBE(b, owner.tryGet<jsg::Ref<Blob>>()) {
+        visitor.visit(*b);
+      }
     }
   }
 
@@ -77,6 +119,9 @@ public:
   File(kj::Array<byte> data, kj::String name, kj::String type, double lastModified)
       : Blob(kj::mv(data), kj::mv(type)),
         name(kj::mv(name)), lastModified(lastModified) {}
+  File(Segments content, kj::String name, kj::String type, double lastModified)
+      : Blob(kj::mv(content), kj::mv(type)),
+        name(kj::mv(name)), lastModified(lastModified) {}
 
   struct Options {
     jsg::Optional<kj::String> type;
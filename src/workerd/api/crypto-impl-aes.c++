@@ -381,8 +381,9 @@ private:
         cipherCtx.get(), plainText.begin() + plainSize);
     KJ_ASSERT(plainSize <= plainText.size());
 
-    // TODO(perf): Avoid this copy, see comment in the encrypt implementation functions.
-    return kj::heapArray(plainText.begin(), plainSize);
+    // The padding means we allocated up to a block more than we needed. Hand back a slice rather
+    // than copying into a buffer of the exact size.
+    return plainText.slice(0, plainSize).attach(kj::mv(plainText));
   }
 };
 
@@ -10,6 +10,7 @@
 #include <workerd/jsg/jsg.h>
 #include <workerd/jsg/setup.h>
 #include <workerd/jsg/jsg-test.h>
+#include <kj/thread.h>
 #include <array>
 
 namespace workerd::api {
@@ -47,6 +48,30 @@ KJ_TEST("RSA-PSS generateKey infinite loop") {
       kj::arr(kj::str("sign"), kj::str("verify"))));
 }
 
+KJ_TEST("RSA-PSS generateKey on another thread") {
+  // SubtleCrypto runs expensive RSA key generation on a thread pool, so the prepared function must
+  // not depend on the thread that prepared it.
+  SubtleCrypto::GenerateKeyAlgorithm algorithm;
+  algorithm.name = kj::str("RSA-PSS");
+  algorithm.hash = kj::str("SHA-256");
+  algorithm.modulusLength = 1024;
+  algorithm.publicExponent = kj::arr<kj::byte>(0x01, 0x00, 0x01);
+  auto generate = CryptoKey::Impl::prepareGenerateRsa("RSA-PSS", kj::mv(algorithm), false,
+      kj::arr(kj::str("sign"), kj::str("verify")));
+
+  kj::Maybe<CryptoKey::Impl::GeneratedKeyPair> result;
+  {
+    kj::Thread thread([&]() { result = generate(); });
+  }
+
+  auto& keys = KJ_ASSERT_NONNULL(result);
+  KJ_EXPECT(keys.publicKey->getType() == "public");
+  KJ_EXPECT(keys.publicKey->getUsages() == CryptoKeyUsageSet::verify());
+  KJ_EXPECT(keys.privateKey->getType() == "private");
+  KJ_EXPECT(keys.privateKey->getUsages() == CryptoKeyUsageSet::sign());
+  KJ_EXPECT(!keys.privateKey->isExtractable());
+}
+
 KJ_TEST("EDDSA ED25519 generateKey") {
   jsg::test::Evaluator<CryptoContext, CryptoIsolate> e(v8System);
   CryptoIsolate &cryptoIsolate = e.getIsolate();
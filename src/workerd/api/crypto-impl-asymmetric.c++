@@ -593,32 +593,33 @@ private:
   }
 };
 
-CryptoKeyPair generateRsaPair(kj::StringPtr normalizedName, kj::Own<EVP_PKEY> privateEvpPKey,
-    kj::Own<EVP_PKEY> publicEvpPKey, CryptoKey::RsaKeyAlgorithm&& keyAlgorithm,
-    bool privateKeyExtractable, CryptoKeyUsageSet usages) {
+CryptoKey::Impl::GeneratedKeyPair generateRsaPair(kj::StringPtr normalizedName,
+    kj::Own<EVP_PKEY> privateEvpPKey, kj::Own<EVP_PKEY> publicEvpPKey,
+    CryptoKey::RsaKeyAlgorithm&& keyAlgorithm, bool privateKeyExtractable,
+    CryptoKeyUsageSet usages) {
   auto privateKeyAlgorithm = keyAlgorithm.clone();
 
   CryptoKeyUsageSet publicKeyUsages = usages & CryptoKeyUsageSet::publicKeyMask();
   CryptoKeyUsageSet privateKeyUsages = usages & CryptoKeyUsageSet::privateKeyMask();
 
   if (normalizedName == "RSASSA-PKCS1-v1_5") {
-    return CryptoKeyPair {
-      .publicKey =  jsg::alloc<CryptoKey>(kj::heap<RsassaPkcs1V15Key>(kj::mv(publicEvpPKey),
-          kj::mv(keyAlgorithm), "public"_kj, true, publicKeyUsages)),
-      .privateKey = jsg::alloc<CryptoKey>(kj::heap<RsassaPkcs1V15Key>(kj::mv(privateEvpPKey),
-          kj::mv(privateKeyAlgorithm), "private"_kj, privateKeyExtractable, privateKeyUsages))};
+    return {
+      .publicKey =  kj::heap<RsassaPkcs1V15Key>(kj::mv(publicEvpPKey),
+          kj::mv(keyAlgorithm), "public"_kj, true, publicKeyUsages),
+      .privateKey = kj::heap<RsassaPkcs1V15Key>(kj::mv(privateEvpPKey),
+          kj::mv(privateKeyAlgorithm), "private"_kj, privateKeyExtractable, privateKeyUsages)};
   } else if (normalizedName == "RSA-PSS") {
-    return CryptoKeyPair {
-      .publicKey =  jsg::alloc<CryptoKey>(kj::heap<RsaPssKey>(kj::mv(publicEvpPKey),
-          kj::mv(keyAlgorithm), "public"_kj, true, publicKeyUsages)),
-      .privateKey = jsg::alloc<CryptoKey>(kj::heap<RsaPssKey>(kj::mv(privateEvpPKey),
-          kj::mv(privateKeyAlgorithm), "private"_kj, privateKeyExtractable, privateKeyUsages))};
+    return {
+      .publicKey =  kj::heap<RsaPssKey>(kj::mv(publicEvpPKey),
+          kj::mv(keyAlgorithm), "public"_kj, true, publicKeyUsages),
+      .privateKey = kj::heap<RsaPssKey>(kj::mv(privateEvpPKey),
+          kj::mv(privateKeyAlgorithm), "private"_kj, privateKeyExtractable, privateKeyUsages)};
   } else if (normalizedName == "RSA-OAEP") {
-    return CryptoKeyPair {
-      .publicKey =  jsg::alloc<CryptoKey>(kj::heap<RsaOaepKey>(kj::mv(publicEvpPKey),
-          kj::mv(keyAlgorithm), "public"_kj, true, publicKeyUsages)),
-      .privateKey = jsg::alloc<CryptoKey>(kj::heap<RsaOaepKey>(kj::mv(privateEvpPKey),
-          kj::mv(privateKeyAlgorithm), "private"_kj, privateKeyExtractable, privateKeyUsages))};
+    return {
+      .publicKey =  kj::heap<RsaOaepKey>(kj::mv(publicEvpPKey),
+          kj::mv(keyAlgorithm), "public"_kj, true, publicKeyUsages),
+      .privateKey = kj::heap<RsaOaepKey>(kj::mv(privateEvpPKey),
+          kj::mv(privateKeyAlgorithm), "private"_kj, privateKeyExtractable, privateKeyUsages)};
   } else {
     JSG_FAIL_REQUIRE(DOMNotSupportedError, "Unimplemented RSA generation \"", normalizedName,
         "\".");
@@ -675,19 +676,30 @@ kj::OneOf<jsg::Ref<CryptoKey>, CryptoKeyPair> CryptoKey::Impl::generateRsa(
     kj::StringPtr normalizedName,
     SubtleCrypto::GenerateKeyAlgorithm&& algorithm, bool extractable,
     kj::ArrayPtr<const kj::String> keyUsages) {
+  auto keys = prepareGenerateRsa(normalizedName, kj::mv(algorithm), extractable, keyUsages)();
+  return CryptoKeyPair {
+    .publicKey = jsg::alloc<CryptoKey>(kj::mv(keys.publicKey)),
+    .privateKey = jsg::alloc<CryptoKey>(kj::mv(keys.privateKey))};
+}
+
+kj::Function<CryptoKey::Impl::GeneratedKeyPair()> CryptoKey::Impl::prepareGenerateRsa(
+    kj::StringPtr normalizedName,
+    SubtleCrypto::GenerateKeyAlgorithm&& algorithm, bool extractable,
+    kj::ArrayPtr<const kj::String> keyUsages) {
 
   KJ_ASSERT(normalizedName == "RSASSA-PKCS1-v1_5" || normalizedName == "RSA-PSS" ||
       normalizedName == "RSA-OAEP", "generateRsa called on non-RSA cryptoKey", normalizedName);
 
-  auto publicExponent = JSG_REQUIRE_NONNULL(kj::mv(algorithm.publicExponent), TypeError,
-        "Missing field \"publicExponent\" in \"algorithm\".");
+  // Copied, since the caller's buffer belongs to JavaScript.
+  auto publicExponent = kj::heapArray(JSG_REQUIRE_NONNULL(algorithm.publicExponent, TypeError,
+        "Missing field \"publicExponent\" in \"algorithm\".").asPtr());
   kj::StringPtr hash = api::getAlgorithmName(JSG_REQUIRE_NONNULL(algorithm.hash, TypeError,
         "Missing field \"hash\" in \"algorithm\"."));
   int modulusLength = JSG_REQUIRE_NONNULL(algorithm.modulusLength, TypeError,
       "Missing field \"modulusLength\" in \"algorithm\".");
   JSG_REQUIRE(modulusLength > 0, DOMOperationError, "modulusLength must be greater than zero "
       "(requested ", modulusLength, ").");
-  auto [normalizedHashName, hashEvpMd] = lookupDigestAlgorithm(hash);
+  kj::StringPtr normalizedHashName = lookupDigestAlgorithm(hash).first;
 
   CryptoKeyUsageSet validUsages = (normalizedName == "RSA-OAEP") ?
       (CryptoKeyUsageSet::encrypt() | CryptoKeyUsageSet::decrypt() |
@@ -698,27 +710,31 @@ kj::OneOf<jsg::Ref<CryptoKey>, CryptoKeyPair> CryptoKey::Impl::generateRsa(
 
   validateRsaParams(modulusLength, publicExponent.asPtr());
 
-  auto bnExponent = OSSLCALL_OWN(BIGNUM, BN_bin2bn(publicExponent.begin(),
-      publicExponent.size(), nullptr), InternalDOMOperationError, "Error setting up RSA keygen.");
-
-  auto rsaPrivateKey = OSSL_NEW(RSA);
-  OSSLCALL(RSA_generate_key_ex(rsaPrivateKey, modulusLength, bnExponent.get(), 0));
-  auto privateEvpPKey = OSSL_NEW(EVP_PKEY);
-  OSSLCALL(EVP_PKEY_set1_RSA(privateEvpPKey.get(), rsaPrivateKey.get()));
-  kj::Own<RSA> rsaPublicKey = OSSLCALL_OWN(RSA, RSAPublicKey_dup(rsaPrivateKey.get()),
-      InternalDOMOperationError, "Error finalizing RSA keygen", internalDescribeOpensslErrors());
-  auto publicEvpPKey = OSSL_NEW(EVP_PKEY);
-  OSSLCALL(EVP_PKEY_set1_RSA(publicEvpPKey.get(), rsaPublicKey));
+  return [normalizedName, publicExponent = kj::mv(publicExponent), modulusLength,
+          normalizedHashName, extractable, usages]() mutable {
+    auto bnExponent = OSSLCALL_OWN(BIGNUM, BN_bin2bn(publicExponent.begin(),
+        publicExponent.size(), nullptr), InternalDOMOperationError,
+        "Error setting up RSA keygen.");
+
+    auto rsaPrivateKey = OSSL_NEW(RSA);
+    OSSLCALL(RSA_generate_key_ex(rsaPrivateKey, modulusLength, bnExponent.get(), 0));
+    auto privateEvpPKey = OSSL_NEW(EVP_PKEY);
+    OSSLCALL(EVP_PKEY_set1_RSA(privateEvpPKey.get(), rsaPrivateKey.get()));
+    kj::Own<RSA> rsaPublicKey = OSSLCALL_OWN(RSA, RSAPublicKey_dup(rsaPrivateKey.get()),
+        InternalDOMOperationError, "Error finalizing RSA keygen", internalDescribeOpensslErrors());
+    auto publicEvpPKey = OSSL_NEW(EVP_PKEY);
+    OSSLCALL(EVP_PKEY_set1_RSA(publicEvpPKey.get(), rsaPublicKey));
+
+    auto keyAlgorithm = CryptoKey::RsaKeyAlgorithm {
+      .name = normalizedName,
+      .modulusLength = static_cast<uint16_t>(modulusLength),
+      .publicExponent = kj::mv(publicExponent),
+      .hash = KeyAlgorithm { normalizedHashName }
+    };
 
-  auto keyAlgorithm = CryptoKey::RsaKeyAlgorithm {
-    .name = normalizedName,
-    .modulusLength = static_cast<uint16_t>(modulusLength),
-    .publicExponent = kj::mv(publicExponent),
-    .hash = KeyAlgorithm { normalizedHashName }
+    return generateRsaPair(normalizedName, kj::mv(privateEvpPKey), kj::mv(publicEvpPKey),
+        kj::mv(keyAlgorithm), extractable, usages);
   };
-
-  return generateRsaPair(normalizedName, kj::mv(privateEvpPKey), kj::mv(publicEvpPKey),
-      kj::mv(keyAlgorithm), extractable, usages);
 }
 
 kj::Own<EVP_PKEY> importRsaFromJwk(SubtleCrypto::JsonWebKey&& keyDataJwk) {
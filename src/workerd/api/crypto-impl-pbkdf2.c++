@@ -42,6 +42,8 @@ private:
     //   iteration count a user can select -- this is an intentional non-conformity. Another approach
     //   might be to fork OpenSSL's PKCS5_PBKDF2_HMAC() function and insert a check for
     //   v8::Isolate::IsExecutionTerminating() in the loop, but for now a hard cap seems wisest.
+    //   (High iteration counts run on SubtleCrypto's thread pool, but the cap still bounds how
+    //   long a single derivation can tie up one of its threads.)
     JSG_REQUIRE(iterations <= 100000, DOMNotSupportedError,
         "PBKDF2 iteration counts above 100000 are not supported (requested ", iterations, ").");
 
@@ -10,6 +10,7 @@
 #include <openssl/ec.h>
 #include <openssl/rsa.h>
 #include <openssl/crypto.h>
+#include <workerd/util/base64.h>
 
 namespace workerd::api {
 namespace {
@@ -181,9 +182,11 @@ std::pair<kj::StringPtr, const EVP_MD*> lookupDigestAlgorithm(kj::StringPtr algo
 }
 
 kj::EncodingResult<kj::Array<kj::byte>> decodeBase64Url(kj::String text) {
-  // TODO(cleanup): Make a non-mutating version of this and put in kj-encoding. Or add a
-  //   "bool urlEncoded = false" parameter to kj::decodeBase64()?
+  KJ_IF_MAYBE(decoded, base64Decode(text.asArray(), true)) {
+    return kj::EncodingResult<kj::Array<kj::byte>>(kj::mv(*decoded), false);
+  }
 
+  // Invalid input still decodes to whatever kj::decodeBase64() makes of it, as it always has.
   std::replace(text.begin(), text.end(), '-', '+');
   std::replace(text.begin(), text.end(), '_', '/');
   return kj::decodeBase64(text);
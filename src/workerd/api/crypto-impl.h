@@ -60,13 +60,10 @@ std::pair<kj::StringPtr, const EVP_MD*> lookupDigestAlgorithm(kj::StringPtr algo
 // Throws if the given algorithm isn't supported.
 
 kj::EncodingResult<kj::Array<kj::byte>> decodeBase64Url(kj::String text);
-// kj::decodeBase64 doesn't know how to parse URL-encoded variants.
+// Decodes base64url, as found in JWKs, also accepting the standard alphabet.
 // https://en.wikipedia.org/wiki/Base64#URL_applications
-// Due to this, the input string is modified prior to passing to kj::decodeBase64. The mutation
-// isn't actually required & it's possible that a non-mutating variant could be written. That's more
-// complex to implement outside of kj::decodeBase64 though and the mutating variant is easier to
-// implement as a wrapper. Could be sufficient to just add a "urlEncoded" boolean so that
-// kj::decodeBase64 can do this in-situ for both cases.
+// Valid input goes through workerd::base64Decode(); anything else is reported with `hadErrors`
+// and decoded as leniently as kj::decodeBase64() does, so callers see the same result as before.
 
 template <typename T>
 T interpretAlgorithmParam(kj::OneOf<kj::String, T>&& param) {
@@ -125,6 +122,21 @@ public:
   static GenerateFunc generateEcdh;
   static GenerateFunc generateEddsa;
 
+  struct GeneratedKeyPair {
+    kj::Own<Impl> publicKey;
+    kj::Own<Impl> privateKey;
+  };
+
+  using PrepareGenerateFunc = kj::Function<GeneratedKeyPair()>(
+      kj::StringPtr normalizedName,
+      SubtleCrypto::GenerateKeyAlgorithm&& algorithm, bool extractable,
+      kj::ArrayPtr<const kj::String> keyUsages);
+  // Checks the parameters as the corresponding GenerateFunc would, and returns a function that does
+  // the expensive part of generating the keys. The function owns everything it needs and doesn't
+  // touch any JavaScript objects, so it can be run on another thread.
+
+  static PrepareGenerateFunc prepareGenerateRsa;
+
   Impl(bool extractable, CryptoKeyUsageSet usages) : extractable(extractable), usages(usages) {}
 
   bool isExtractable() const { return extractable; }
@@ -209,6 +221,10 @@ struct CryptoAlgorithm {
   //   template metaprogramming cannot recognize it as const). Maybe we can fix this in KJ, by
   //   making `RemoveConstOrDisable` recognize function references are inherenly const.
 
+  CryptoKey::Impl::PrepareGenerateFunc* prepareGenerateFunc = nullptr;
+  // If not nullptr, generateKey() uses this instead of `generateFunc` when generation is expensive
+  // enough to be worth running on the crypto thread pool.
+
   inline bool operator==(const CryptoAlgorithm& other) const {
     return strcasecmp(name.cStr(), other.name.cStr()) == 0;
   }
@@ -10,6 +10,7 @@
 #include <workerd/jsg/jsg.h>
 #include "util.h"
 #include <workerd/io/io-context.h>
+#include <workerd/util/thread-pool.h>
 #include <workerd/util/uuid.h>
 #include <map>
 #include <set>
@@ -17,6 +18,7 @@
 #include <limits>
 #include <typeinfo>
 #include <strings.h>
+#include <thread>
 
 namespace workerd::api {
 
@@ -83,16 +85,17 @@ namespace {
 // Note that SubtleCrypto.digest() is special. It is not a key-based operation and we only support
 // one hash family, SHA, so its implementation is non-virtual.
 //
-// NOTE(perf): The SubtleCrypto interface is asynchronous, but all of our implementations perform
-//   the crypto synchronously before returning. In theory, we could be performing bulk crypto in a
-//   separate thread, maybe improving performance. However, it's unclear what real use case would
-//   benefit from this. It's also unclear that we would want a single request to be able to use
-//   multiple cores -- certainly it would greatly complicate our implementation of request CPU
-//   limits. So, we probably shouldn't implement true asynchronous crypto.
+// NOTE(perf): The SubtleCrypto interface is asynchronous, but most of our implementations perform
+//   the crypto synchronously before returning. Performing the crypto synchronously has a
+//   performance benefit: we can safely avoid copying input BufferSources -- most of our functions
+//   can take kj::ArrayPtr<const kj::byte>s, rather than kj::Array<kj::byte>s.
 //
-//   Additionally, performing the crypto synchronously actually has a performance benefit: we can
-//   safely avoid copying input BufferSources -- most of our functions can take
-//   kj::ArrayPtr<const kj::byte>s, rather than kj::Array<kj::byte>s.
+//   The exceptions are operations that would hold up the isolate for a long time: digests and
+//   signatures over large inputs, PBKDF2 with high iteration counts, and RSA key generation. When
+//   running in a request, these copy their inputs and run on a small thread pool instead, so that
+//   other requests on the isolate can make progress meanwhile. Time spent on the pool isn't
+//   counted against the request's CPU limit, but it's bounded, since PBKDF2 iteration counts and
+//   RSA modulus lengths are capped.
 
 // =======================================================================================
 // OpenSSL shims
@@ -104,7 +107,7 @@ std::unique_ptr<EVP_MD_CTX, void(*)(EVP_MD_CTX*)> makeDigestContext() {
 // =======================================================================================
 // Registered algorithms
 
-static kj::Maybe<const CryptoAlgorithm&> lookupAlgorithm(kj::StringPtr name) {
+static kj::Maybe<const CryptoAlgorithm&> lookupBuiltinAlgorithm(kj::StringPtr name) {
   static const std::set<CryptoAlgorithm> ALGORITHMS = {
     {"AES-CTR"_kj,           &CryptoKey::Impl::importAes, &CryptoKey::Impl::generateAes},
     {"AES-CBC"_kj,           &CryptoKey::Impl::importAes, &CryptoKey::Impl::generateAes},
@@ -113,9 +116,12 @@ static kj::Maybe<const CryptoAlgorithm&> lookupAlgorithm(kj::StringPtr name) {
     {"HMAC"_kj,              &CryptoKey::Impl::importHmac, &CryptoKey::Impl::generateHmac},
     {"PBKDF2"_kj,            &CryptoKey::Impl::importPbkdf2},
     {"HKDF"_kj,              &CryptoKey::Impl::importHkdf},
-    {"RSASSA-PKCS1-v1_5"_kj, &CryptoKey::Impl::importRsa, &CryptoKey::Impl::generateRsa},
-    {"RSA-PSS"_kj,           &CryptoKey::Impl::importRsa, &CryptoKey::Impl::generateRsa},
-    {"RSA-OAEP"_kj,          &CryptoKey::Impl::importRsa, &CryptoKey::Impl::generateRsa},
+    {"RSASSA-PKCS1-v1_5"_kj, &CryptoKey::Impl::importRsa, &CryptoKey::Impl::generateRsa,
+                             &CryptoKey::Impl::prepareGenerateRsa},
+    {"RSA-PSS"_kj,           &CryptoKey::Impl::importRsa, &CryptoKey::Impl::generateRsa,
+                             &CryptoKey::Impl::prepareGenerateRsa},
+    {"RSA-OAEP"_kj,          &CryptoKey::Impl::importRsa, &CryptoKey::Impl::generateRsa,
+                             &CryptoKey::Impl::prepareGenerateRsa},
     {"ECDSA"_kj,             &CryptoKey::Impl::importEcdsa, &CryptoKey::Impl::generateEcdsa},
     {"ECDH"_kj,              &CryptoKey::Impl::importEcdh, &CryptoKey::Impl::generateEcdh},
     {"NODE-ED25519"_kj,      &CryptoKey::Impl::importEddsa, &CryptoKey::Impl::generateEddsa},
@@ -124,11 +130,19 @@ static kj::Maybe<const CryptoAlgorithm&> lookupAlgorithm(kj::StringPtr name) {
 
   auto iter = ALGORITHMS.find(CryptoAlgorithm {name});
   if (iter == ALGORITHMS.end()) {
+    return nullptr;
+  } else {
+    return *iter;
+  }
+}
+
+static kj::Maybe<const CryptoAlgorithm&> lookupAlgorithm(kj::StringPtr name) {
+  KJ_IF_MAYBE(algorithm, lookupBuiltinAlgorithm(name)) {
+    return *algorithm;
+  } else {
     // No such built-in algorithm, so fall back to checking if the ApiIsolate has a custom
     // algorithm registered.
     return Worker::ApiIsolate::current().getCryptoAlgorithm(name);
-  } else {
-    return *iter;
   }
 }
 
@@ -265,13 +279,98 @@ template <typename T, typename = kj::EnableIf<kj::isSameType<
   });
 }
 
+// =======================================================================================
+// Off-thread operations
+
+constexpr size_t OFF_THREAD_MIN_DATA_SIZE = 64 * 1024;
+// Digests, signatures, and verifications over at least this much data run on the crypto thread
+// pool. Smaller inputs, like the typical HMAC over a token, aren't worth the round trip.
+
+constexpr int OFF_THREAD_MIN_PBKDF2_ITERATIONS = 10000;
+constexpr int OFF_THREAD_MIN_RSA_MODULUS_LENGTH = 2048;
+// PBKDF2 derivations and RSA key generations at least this expensive run on the pool, too.
+
+ThreadPool& getCryptoThreadPool() {
+  static ThreadPool pool(kj::max(1u, kj::min(std::thread::hardware_concurrency(), 4u)));
+  return pool;
+}
+
+template <typename Func>
+kj::Promise<kj::_::ReturnType<Func, void>> runOffThread(
+    const char* operation, kj::StringPtr algorithm, Func&& func) {
+  // Runs `func` on the crypto thread pool, checking for unhandled OpenSSL errors there the same way
+  // webCryptoOperationBegin() does on the isolate's thread. `func` is destroyed on the pool, so it
+  // must own everything it touches, and none of it may belong to JavaScript.
+  return getCryptoThreadPool().run(
+      [operation, algorithm = kj::str(algorithm), func = kj::fwd<Func>(func)]() mutable {
+    auto checkErrorsOnFinish = webCryptoOperationBegin(operation, algorithm);
+    return func();
+  });
+}
+
+bool shouldRunOffThread(const CryptoKey& key, size_t dataSize) {
+  // Custom algorithms' key implementations may not be safe to use from another thread, so only
+  // built-in ones qualify.
+  return dataSize >= OFF_THREAD_MIN_DATA_SIZE && IoContext::hasCurrent() &&
+      lookupBuiltinAlgorithm(key.getAlgorithmName()) != nullptr;
+}
+
+bool shouldDeriveOffThread(const SubtleCrypto::DeriveKeyAlgorithm& algorithm) {
+  return strcasecmp(algorithm.name.cStr(), "PBKDF2") == 0 &&
+      algorithm.iterations.orDefault(0) >= OFF_THREAD_MIN_PBKDF2_ITERATIONS &&
+      IoContext::hasCurrent();
+}
+
+SubtleCrypto::DeriveKeyAlgorithm copyForOffThread(SubtleCrypto::DeriveKeyAlgorithm&& algorithm) {
+  // The buffers in `algorithm` belong to JavaScript, so they're copied. `$public` is only used by
+  // ECDH, which never runs off-thread, so it's left behind.
+  auto copy = [](kj::Maybe<kj::Array<kj::byte>>& bytes) {
+    return bytes.map([](kj::Array<kj::byte>& b) { return kj::heapArray(b.asPtr()); });
+  };
+  return {
+    .name = kj::mv(algorithm.name),
+    .salt = copy(algorithm.salt),
+    .iterations = algorithm.iterations,
+    .hash = kj::mv(algorithm.hash),
+    .info = copy(algorithm.info),
+  };
+}
+
+kj::Array<kj::byte> computeDigest(const EVP_MD* type, kj::ArrayPtr<const kj::byte> data) {
+  auto digestCtx = makeDigestContext();
+  KJ_ASSERT(digestCtx != nullptr);
+
+  OSSLCALL(EVP_DigestInit_ex(digestCtx.get(), type, nullptr));
+  OSSLCALL(EVP_DigestUpdate(digestCtx.get(), data.begin(), data.size()));
+  auto messageDigest = kj::heapArray<kj::byte>(EVP_MD_CTX_size(digestCtx.get()));
+  uint messageDigestSize = 0;
+  OSSLCALL(EVP_DigestFinal_ex(digestCtx.get(), messageDigest.begin(), &messageDigestSize));
+
+  KJ_ASSERT(messageDigestSize == messageDigest.size());
+  return kj::mv(messageDigest);
+}
+
 }  // namespace
 
 // =======================================================================================
 // CryptoKey / SubtleCrypto implementations
 
-CryptoKey::CryptoKey(kj::Own<Impl> impl): impl(kj::mv(impl)) {}
+class CryptoKey::ImplOwner final: public kj::AtomicRefcounted {
+public:
+  explicit ImplOwner(kj::Own<Impl> impl): impl(kj::mv(impl)) {}
+
+private:
+  kj::Own<Impl> impl;
+};
+
+CryptoKey::CryptoKey(kj::Own<Impl> impl)
+    : impl(impl.get(), kj::NullDisposer::instance),
+      implOwner(kj::atomicRefcounted<ImplOwner>(kj::mv(impl))) {}
 CryptoKey::~CryptoKey() noexcept(false) {}
+kj::Own<const CryptoKey::Impl> CryptoKey::addImplRef() const {
+  return kj::Own<const Impl>(impl.get(), kj::NullDisposer::instance)
+      .attach(kj::atomicAddRef(*implOwner));
+}
 kj::StringPtr CryptoKey::getAlgorithmName() const { return impl->getAlgorithmName(); }
 CryptoKey::AlgorithmVariant CryptoKey::getAlgorithm() const { return impl->getAlgorithm(); }
 kj::StringPtr CryptoKey::getType() const { return impl->getType(); }
@@ -320,9 +419,16 @@ jsg::Promise<kj::Array<kj::byte>> SubtleCrypto::sign(
 
   auto checkErrorsOnFinish = webCryptoOperationBegin(__func__, algorithm);
 
-  return js.evalNow([&] {
+  return js.evalNow([&]() -> jsg::Promise<kj::Array<kj::byte>> {
     validateOperation(key, algorithm.name, CryptoKeyUsageSet::sign());
-    return key.impl->sign(kj::mv(algorithm), data);
+    if (shouldRunOffThread(key, data.size())) {
+      return IoContext::current().awaitIo(js, runOffThread("sign", key.getAlgorithmName(),
+          [impl = key.addImplRef(), algorithm = kj::mv(algorithm),
+           data = kj::heapArray(data.asPtr())]() mutable {
+        return impl->sign(kj::mv(algorithm), data);
+      }));
+    }
+    return js.resolvedPromise(key.impl->sign(kj::mv(algorithm), data));
   });
 }
 
@@ -336,9 +442,17 @@ jsg::Promise<bool> SubtleCrypto::verify(
 
   auto checkErrorsOnFinish = webCryptoOperationBegin(__func__, algorithm);
 
-  return js.evalNow([&] {
+  return js.evalNow([&]() -> jsg::Promise<bool> {
     validateOperation(key, algorithm.name, CryptoKeyUsageSet::verify());
-    return key.impl->verify(kj::mv(algorithm), signature, data);
+    if (shouldRunOffThread(key, data.size())) {
+      return IoContext::current().awaitIo(js, runOffThread("verify", key.getAlgorithmName(),
+          [impl = key.addImplRef(), algorithm = kj::mv(algorithm),
+           signature = kj::heapArray(signature.asPtr()),
+           data = kj::heapArray(data.asPtr())]() mutable {
+        return impl->verify(kj::mv(algorithm), signature, data);
+      }));
+    }
+    return js.resolvedPromise(key.impl->verify(kj::mv(algorithm), signature, data));
   });
 }
 
@@ -350,20 +464,16 @@ jsg::Promise<kj::Array<kj::byte>> SubtleCrypto::digest(
 
   auto checkErrorsOnFinish = webCryptoOperationBegin(__func__, algorithm);
 
-  return js.evalNow([&] {
+  return js.evalNow([&]() -> jsg::Promise<kj::Array<kj::byte>> {
     auto type = lookupDigestAlgorithm(algorithm.name).second;
 
-    auto digestCtx = makeDigestContext();
-    KJ_ASSERT(digestCtx != nullptr);
-
-    OSSLCALL(EVP_DigestInit_ex(digestCtx.get(), type, nullptr));
-    OSSLCALL(EVP_DigestUpdate(digestCtx.get(), data.begin(), data.size()));
-    auto messageDigest = kj::heapArray<kj::byte>(EVP_MD_CTX_size(digestCtx.get()));
-    uint messageDigestSize = 0;
-    OSSLCALL(EVP_DigestFinal_ex(digestCtx.get(), messageDigest.begin(), &messageDigestSize));
-
-    KJ_ASSERT(messageDigestSize == messageDigest.size());
-    return kj::mv(messageDigest);
+    if (data.size() >= OFF_THREAD_MIN_DATA_SIZE && IoContext::hasCurrent()) {
+      return IoContext::current().awaitIo(js, runOffThread("digest", algorithm.name,
+          [type, data = kj::heapArray(data.asPtr())]() {
+        return computeDigest(type, data);
+      }));
+    }
+    return js.resolvedPromise(computeDigest(type, data));
   });
 }
 
@@ -376,11 +486,28 @@ jsg::Promise<kj::OneOf<jsg::Ref<CryptoKey>, CryptoKeyPair>> SubtleCrypto::genera
 
   auto checkErrorsOnFinish = webCryptoOperationBegin(__func__, algorithm);
 
-  return js.evalNow([&] {
+  using Result = kj::OneOf<jsg::Ref<CryptoKey>, CryptoKeyPair>;
+
+  return js.evalNow([&]() -> jsg::Promise<Result> {
     CryptoAlgorithm algoImpl = lookupAlgorithm(algorithm.name).orDefault({});
     JSG_REQUIRE(algoImpl.generateFunc != nullptr, DOMNotSupportedError,
         "Unrecognized key generation algorithm \"", algorithm.name, "\" requested.");
 
+    if (algoImpl.prepareGenerateFunc != nullptr && IoContext::hasCurrent() &&
+        algorithm.modulusLength.orDefault(0) >= OFF_THREAD_MIN_RSA_MODULUS_LENGTH) {
+      auto generate = algoImpl.prepareGenerateFunc(algoImpl.name, kj::mv(algorithm), extractable,
+                                                   keyUsages);
+      return IoContext::current().awaitIo(js,
+          runOffThread("generateKey", algoImpl.name, kj::mv(generate)),
+          [](jsg::Lock& js, CryptoKey::Impl::GeneratedKeyPair keys) -> Result {
+        JSG_REQUIRE(keys.privateKey->getUsages().size() != 0, DOMSyntaxError,
+          "Attempt to generate asymmetric keys with no valid private key usages.");
+        return CryptoKeyPair {
+          .publicKey = jsg::alloc<CryptoKey>(kj::mv(keys.publicKey)),
+          .privateKey = jsg::alloc<CryptoKey>(kj::mv(keys.privateKey))};
+      });
+    }
+
     auto cryptoKeyOrPair = algoImpl.generateFunc(algoImpl.name, kj::mv(algorithm), extractable,
                                                  keyUsages);
     KJ_SWITCH_ONEOF(cryptoKeyOrPair) {
@@ -396,7 +523,7 @@ jsg::Promise<kj::OneOf<jsg::Ref<CryptoKey>, CryptoKeyPair>> SubtleCrypto::genera
           "Attempt to generate asymmetric keys with no valid private key usages.");
       }
     }
-    return cryptoKeyOrPair;
+    return js.resolvedPromise(kj::mv(cryptoKeyOrPair));
   });
 }
 
@@ -412,18 +539,29 @@ jsg::Promise<jsg::Ref<CryptoKey>> SubtleCrypto::deriveKey(
 
   auto checkErrorsOnFinish = webCryptoOperationBegin(__func__, algorithm);
 
-  return js.evalNow([&] {
+  return js.evalNow([&]() -> jsg::Promise<jsg::Ref<CryptoKey>> {
     validateOperation(baseKey, algorithm.name, CryptoKeyUsageSet::deriveKey());
 
     auto length = getKeyLength(derivedKeyAlgorithm);
 
+    if (shouldDeriveOffThread(algorithm)) {
+      auto& context = IoContext::current();
+      return context.awaitIo(js, runOffThread("deriveKey", baseKey.getAlgorithmName(),
+          [impl = baseKey.addImplRef(), algorithm = copyForOffThread(kj::mv(algorithm)),
+           length]() mutable {
+        return impl->deriveBits(kj::mv(algorithm), length);
+      }), [derivedKeyAlgorithm = kj::mv(derivedKeyAlgorithm), extractable,
+           keyUsages = kj::mv(keyUsages)](jsg::Lock& js, kj::Array<kj::byte> secret) mutable {
+        return jsg::alloc<CryptoKey>(importKeyImpl(
+            "raw", kj::mv(secret), kj::mv(derivedKeyAlgorithm), extractable, keyUsages));
+      });
+    }
+
     auto secret = baseKey.impl->deriveBits(kj::mv(algorithm), length);
 
-    // TODO(perf): For conformance, importKey() makes a copy of `secret`. In this case we really
-    //   don't need to, but rather we ought to call the appropriate CryptoKey::Impl::import*()
-    //   function directly.
-    return importKeySync(
-        js, "raw", kj::mv(secret), kj::mv(derivedKeyAlgorithm), extractable, kj::mv(keyUsages));
+    // For conformance, importKeySync() copies the key data, but nothing else can see `secret`.
+    return js.resolvedPromise(jsg::alloc<CryptoKey>(importKeyImpl(
+        "raw", kj::mv(secret), kj::mv(derivedKeyAlgorithm), extractable, keyUsages)));
   });
 }
 
@@ -442,9 +580,17 @@ jsg::Promise<kj::Array<kj::byte>> SubtleCrypto::deriveBits(
     return uint32_t(l);
   });
 
-  return js.evalNow([&] {
+  return js.evalNow([&]() -> jsg::Promise<kj::Array<kj::byte>> {
     validateOperation(baseKey, algorithm.name, CryptoKeyUsageSet::deriveBits());
-    return baseKey.impl->deriveBits(kj::mv(algorithm), length);
+    if (shouldDeriveOffThread(algorithm)) {
+      auto& context = IoContext::current();
+      return context.awaitIo(js, runOffThread("deriveBits", baseKey.getAlgorithmName(),
+          [impl = baseKey.addImplRef(), algorithm = copyForOffThread(kj::mv(algorithm)),
+           length]() mutable {
+        return impl->deriveBits(kj::mv(algorithm), length);
+      }));
+    }
+    return js.resolvedPromise(baseKey.impl->deriveBits(kj::mv(algorithm), length));
   });
 }
 
@@ -537,8 +683,9 @@ jsg::Promise<jsg::Ref<CryptoKey>> SubtleCrypto::unwrapKey(jsg::Lock& js, kj::Str
       importData = kj::mv(bytes);
     }
 
-    auto imported = importKeySync(js, format, kj::mv(importData), kj::mv(normalizedUnwrapAlgorithm),
-        extractable, keyUsages.asPtr());
+    // `bytes` is our own buffer, so there's no need for importKeySync() to copy it.
+    auto imported = jsg::alloc<CryptoKey>(importKeyImpl(format, kj::mv(importData),
+        kj::mv(normalizedUnwrapAlgorithm), extractable, keyUsages.asPtr()));
 
     if (imported->getType() == "secret" || imported->getType() == "private") {
       JSG_REQUIRE(imported->getUsageSet().size() != 0, DOMSyntaxError,
@@ -573,13 +720,26 @@ jsg::Ref<CryptoKey> SubtleCrypto::importKeySync(
     ImportKeyAlgorithm algorithm,
     bool extractable,
     kj::ArrayPtr<const kj::String> keyUsages) {
+  KJ_IF_MAYBE(key, keyData.tryGet<kj::Array<kj::byte>>()) {
+    // Make a copy of the key import data, which may be a view of a buffer that the caller can
+    // still modify.
+    keyData = kj::heapArray(key->asPtr());
+  }
+
+  return jsg::alloc<CryptoKey>(
+      importKeyImpl(format, kj::mv(keyData), kj::mv(algorithm), extractable, keyUsages));
+}
+
+kj::Own<CryptoKey::Impl> SubtleCrypto::importKeyImpl(
+    kj::StringPtr format,
+    ImportKeyData keyData,
+    ImportKeyAlgorithm algorithm,
+    bool extractable,
+    kj::ArrayPtr<const kj::String> keyUsages) {
   if (format == "raw" || format == "pkcs8" || format == "spki") {
-    auto& key = JSG_REQUIRE_NONNULL(keyData.tryGet<kj::Array<kj::byte>>(), TypeError,
+    JSG_REQUIRE(keyData.is<kj::Array<kj::byte>>(), TypeError,
         "Import data provided for \"raw\", \"pkcs8\", or \"spki\" import formats must be a buffer "
         "source.");
-
-    // Make a copy of the key import data.
-    keyData = kj::heapArray(key.asPtr());
   } else if (format == "jwk") {
     JSG_REQUIRE(keyData.is<JsonWebKey>(), TypeError,
         "Import data provided for \"jwk\" import format must be a JsonWebKey.");
@@ -603,17 +763,16 @@ jsg::Ref<CryptoKey> SubtleCrypto::importKeySync(
   //   implementation functions don't necessarily know the name of the algorithm whose key they're
   //   importing (importKeyAesImpl handles AES-CTR, -CBC, and -GCM, for instance), so they should
   //   rely on this value to set the imported CryptoKey's name.
-  auto cryptoKey = jsg::alloc<CryptoKey>(
-      algoImpl.importFunc(algoImpl.name, format, kj::mv(keyData),
-                          kj::mv(algorithm), extractable, keyUsages));
+  auto impl = algoImpl.importFunc(algoImpl.name, format, kj::mv(keyData),
+                                  kj::mv(algorithm), extractable, keyUsages);
 
-  if (cryptoKey->getUsageSet().size() == 0) {
-    auto type = cryptoKey->getType();
+  if (impl->getUsages().size() == 0) {
+    auto type = impl->getType();
     JSG_REQUIRE(type != "secret" && type != "private", DOMSyntaxError,
         "Secret/private CryptoKeys must have at least one usage.");
   }
 
-  return cryptoKey;
+  return impl;
 }
 
 jsg::Promise<SubtleCrypto::ExportKeyData> SubtleCrypto::exportKey(
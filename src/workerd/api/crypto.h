@@ -222,7 +222,17 @@ public:
   // Treat as private -- needs to be public for jsg::alloc<T>()...
 
 private:
+  class ImplOwner;
+
   kj::Own<Impl> impl;
+  // Points into `implOwner`.
+
+  kj::Own<const ImplOwner> implOwner;
+  // Owns the implementation on behalf of this key and of any operations on it that SubtleCrypto
+  // is running on its thread pool, which may outlive the key.
+
+  kj::Own<const Impl> addImplRef() const;
+  // Returns a reference to the implementation that may be used, and dropped, on any thread.
 
   friend class SubtleCrypto;
   friend class EllipticKey;
@@ -495,6 +505,16 @@ public:
       kj::ArrayPtr<const kj::String> keyUsages);
   // NOT VISIBLE TO JS: like importKey() but return the key, not a promise.
 
+  static kj::Own<CryptoKey::Impl> importKeyImpl(
+      kj::StringPtr format,
+      ImportKeyData keyData,
+      ImportKeyAlgorithm algorithm,
+      bool extractable,
+      kj::ArrayPtr<const kj::String> keyUsages);
+  // NOT VISIBLE TO JS: like importKeySync() but takes ownership of `keyData` instead of copying
+  // it, and returns the key implementation rather than a CryptoKey. The implementation is
+  // immutable, so it may be shared between CryptoKeys, even in different isolates.
+
   jsg::Promise<ExportKeyData> exportKey(
       jsg::Lock& js,
       kj::String format,
@@ -318,8 +318,6 @@ kj::Maybe<v8::Local<v8::String>> IcuDecoder::decode(
     KJ_UNREACHABLE;
   };
 
-  const auto isUsAscii = [](const auto& b) { return b <= 0x7f; };
-
   KJ_DEFER({ if (flush) reset(); });
 
   // Evaluate fast-path options. These provide shortcuts for common cases with the caveat
@@ -327,18 +325,6 @@ kj::Maybe<v8::Local<v8::String>> IcuDecoder::decode(
   // conversions are being handled by v8 directly rather than by the ICU converter).
   if (buffer.size() > 0 && ucnv_toUCountPending(inner.get(), &status) == 0) {
     KJ_ASSERT(U_SUCCESS(status));
-    if (encoding == Encoding::Utf8 && std::all_of(buffer.begin(), buffer.end(), isUsAscii)) {
-      // This is a fast-path option for UTF-8 that can be taken when there
-      // are no buffered inputs and the non-empty input buffer contains only
-      // codepoints <= 0x7f. This path is safe because with ASCII range codepoints
-      // we know we won't accidentally split a multi-byte encoding. We also don't
-      // have to worry about the BOM here since the BOM bytes are > 0x7f.
-      // Note also that in this case we'll interpret as Latin1 since UTF-8 bytes
-      // within this range are identical to Latin1 and v8 allocates these more
-      // efficiently.
-      return jsg::v8StrFromLatin1(isolate, buffer);
-    }
-
     if (encoding == Encoding::Utf16le && buffer.size() % sizeof(char16_t) == 0) {
       // This is a fast-path option for UTF-16le that can be taken when:
       // there are no buffered inputs, the non-empty input buffer length is an
@@ -394,6 +380,38 @@ kj::Maybe<v8::Local<v8::String>> IcuDecoder::decode(
   return jsg::v8Str(isolate, result.slice(omitInitialBom ? 1 : 0, length));
 }
 
+kj::Maybe<v8::Local<v8::String>> Utf8Decoder::decode(
+    v8::Isolate* isolate,
+    kj::ArrayPtr<const kj::byte> buffer,
+    bool flush) {
+  KJ_DEFER({ if (flush) reset(); });
+
+  if (inner.isIdle() && isAscii(buffer)) {
+    // With no sequence carried over, ASCII bytes are their own code points, and identical to
+    // Latin1, which v8 stores more compactly. The BOM isn't ASCII, so there's no BOM to strip,
+    // and none can follow once we've produced text.
+    if (buffer.size() > 0) bomSeen = true;
+    return jsg::v8StrFromLatin1(isolate, buffer);
+  }
+
+  auto limit = Utf8ToUtf16::maxOutputSize(buffer.size());
+  KJ_STACK_ARRAY(char16_t, result, limit, 512, 4096);
+  auto length = KJ_UNWRAP_OR_RETURN(inner.decode(buffer, result, flush), nullptr);
+
+  auto omitInitialBom = false;
+  if (length > 0 && !ignoreBom && !bomSeen) {
+    omitInitialBom = result[0] == 0xfeff;
+    bomSeen = true;
+  }
+
+  return jsg::v8Str(isolate, result.slice(omitInitialBom ? 1 : 0, length));
+}
+
+void Utf8Decoder::reset() {
+  bomSeen = false;
+  inner.reset();
+}
+
 kj::Maybe<v8::Local<v8::String>> AsciiDecoder::decode(
     v8::Isolate* isolate,
     kj::ArrayPtr<const kj::byte> buffer,
@@ -409,6 +427,7 @@ void IcuDecoder::reset() {
 Decoder& TextDecoder::getImpl() {
   KJ_SWITCH_ONEOF(decoder) {
     KJ_CASE_ONEOF(dec, AsciiDecoder) { return dec; }
+    KJ_CASE_ONEOF(dec, Utf8Decoder) { return dec; }
     KJ_CASE_ONEOF(dec, IcuDecoder) { return dec; }
   }
   KJ_UNREACHABLE;
@@ -438,6 +457,10 @@ TextDecoder::constructor(jsg::Optional<kj::String> maybeLabel,
     return jsg::alloc<TextDecoder>(AsciiDecoder(), options);
   }
 
+  if (encoding == Encoding::Utf8) {
+    return jsg::alloc<TextDecoder>(Utf8Decoder(options.fatal, options.ignoreBOM), options);
+  }
+
   return jsg::alloc<TextDecoder>(
       JSG_REQUIRE_NONNULL(IcuDecoder::create(encoding, options.fatal, options.ignoreBOM),
                            RangeError,
@@ -469,6 +492,9 @@ kj::Maybe<v8::Local<v8::String>> TextDecoder::decodePtr(
     KJ_CASE_ONEOF(dec, AsciiDecoder) {
       return dec.decode(isolate, buffer, flush);
     }
+    KJ_CASE_ONEOF(dec, Utf8Decoder) {
+      return dec.decode(isolate, buffer, flush);
+    }
     KJ_CASE_ONEOF(dec, IcuDecoder) {
       return dec.decode(isolate, buffer, flush);
     }
@@ -486,6 +512,21 @@ jsg::Ref<TextEncoder> TextEncoder::constructor() {
 v8::Local<v8::Uint8Array> TextEncoder::encode(jsg::Optional<v8::Local<v8::String>> input,
     v8::Isolate* isolate) {
   auto str = input.orDefault(v8::String::Empty(isolate));
+
+  if (str->IsOneByte()) {
+    // The string is stored as Latin1, and is most likely ASCII, in which case its UTF-8 encoding
+    // is a straight copy. Try that before paying for Utf8Length()'s pass over the string.
+    auto maybeBuffer = v8::ArrayBuffer::MaybeNew(isolate, str->Length());
+    JSG_ASSERT(!maybeBuffer.IsEmpty(), RangeError,
+               "Cannot allocate space for TextEncoder.encode");
+    auto buffer = maybeBuffer.ToLocalChecked();
+    auto bytes = kj::arrayPtr(static_cast<kj::byte*>(buffer->Data()), buffer->ByteLength());
+    str->WriteOneByte(isolate, bytes.begin(), 0, bytes.size(), v8::String::NO_NULL_TERMINATION);
+    if (isAscii(bytes)) {
+      return v8::Uint8Array::New(buffer, 0, buffer->ByteLength());
+    }
+  }
+
   auto maybeBuffer = v8::ArrayBuffer::MaybeNew(isolate, str->Utf8Length(isolate));
   JSG_ASSERT(!maybeBuffer.IsEmpty(), RangeError, "Cannot allocate space for TextEncoder.encode");
   auto buffer = maybeBuffer.ToLocalChecked();
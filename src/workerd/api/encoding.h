@@ -6,6 +6,7 @@
 
 #include <workerd/jsg/jsg.h>
 #include <workerd/io/compatibility-date.capnp.h>
+#include <workerd/util/utf8.h>
 #include <unicode/ucnv.h>
 
 namespace workerd::api {
@@ -91,6 +92,31 @@ public:
       bool flush = false) override;
 };
 
+class Utf8Decoder: public Decoder {
+  // Decoder implementation for UTF-8, the overwhelmingly common case, that avoids ICU. Input that
+  // is entirely ASCII becomes a one-byte V8 string without being widened.
+public:
+  Utf8Decoder(bool fatal, bool ignoreBom): inner(fatal), ignoreBom(ignoreBom) {}
+  Utf8Decoder(Utf8Decoder&&) = default;
+  Utf8Decoder& operator=(Utf8Decoder&&) = default;
+  KJ_DISALLOW_COPY(Utf8Decoder);
+
+  Encoding getEncoding() override { return Encoding::Utf8; }
+
+  kj::Maybe<v8::Local<v8::String>> decode(
+      v8::Isolate* isolate,
+      kj::ArrayPtr<const kj::byte> buffer,
+      bool flush = false) override;
+
+  void reset() override;
+
+private:
+  Utf8ToUtf16 inner;
+
+  bool ignoreBom;
+  bool bomSeen = false;
+};
+
 class IcuDecoder: public Decoder {
   // Decoder implementation that uses ICU's built-in conversion APIs.
   // ICU's decoder is fairly comprehensive, covering the full range
@@ -128,7 +154,7 @@ class TextDecoder: public jsg::Object {
   // Implements the TextDecoder interface as prescribed by:
   // https://encoding.spec.whatwg.org/#interface-textdecoder
 public:
-  using DecoderImpl = kj::OneOf<AsciiDecoder, IcuDecoder>;
+  using DecoderImpl = kj::OneOf<AsciiDecoder, Utf8Decoder, IcuDecoder>;
 
   struct ConstructorOptions {
     bool fatal = false;
@@ -0,0 +1,78 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "form-data.h"
+#include <kj/test.h>
+
+namespace workerd::api {
+namespace {
+
+constexpr kj::StringPtr BODY =
+    "preamble\r\n"
+    "--abc123\r\n"
+    "Content-Disposition: form-data; name=\"field\"\r\n"
+    "\r\n"
+    "value\r\n"
+    "--abc123\n"
+    "Content-Disposition: form-data; name=\"upload\"; filename=\"a.txt\"\n"
+    "Content-Type: text/plain\n"
+    "\n"
+    "line one\r\n--abc12 is not a boundary\r\n"
+    "--abc123\r\n"
+    "Content-Disposition: form-data; name=\"empty\"\r\n"
+    "\r\n"
+    "\r\n"
+    "--abc123--\r\n"
+    "epilogue"_kj;
+
+void expectParts(kj::ArrayPtr<const MultipartParser::Part> parts) {
+  KJ_ASSERT(parts.size() == 3);
+
+  KJ_EXPECT(parts[0].name == "field");
+  KJ_EXPECT(parts[0].filename == nullptr);
+  KJ_EXPECT(parts[0].data.asChars() == "value"_kj);
+
+  KJ_EXPECT(parts[1].name == "upload");
+  KJ_EXPECT(KJ_ASSERT_NONNULL(parts[1].filename) == "a.txt");
+  KJ_EXPECT(parts[1].type == "text/plain");
+  KJ_EXPECT(parts[1].data.asChars() == "line one\r\n--abc12 is not a boundary"_kj);
+
+  KJ_EXPECT(parts[2].name == "empty");
+  KJ_EXPECT(parts[2].type == "");
+  KJ_EXPECT(parts[2].data.size() == 0);
+}
+
+KJ_TEST("MultipartParser parses a whole body") {
+  MultipartParser parser("abc123"_kj);
+  parser.feed(BODY.asBytes());
+  expectParts(parser.finish());
+}
+
+KJ_TEST("MultipartParser parses a body in pieces") {
+  // Every split point, with delimiters and headers straddling chunks.
+  for (size_t chunkSize: {1, 2, 3, 7, 16}) {
+    MultipartParser parser("abc123"_kj);
+    auto bytes = BODY.asBytes();
+    while (bytes.size() > 0) {
+      auto n = kj::min(chunkSize, bytes.size());
+      parser.feed(bytes.slice(0, n));
+      bytes = bytes.slice(n, bytes.size());
+    }
+    expectParts(parser.finish());
+  }
+}
+
+KJ_TEST("MultipartParser rejects truncated bodies") {
+  auto truncated = BODY.slice(0, BODY.size() - 20);
+  MultipartParser parser("abc123"_kj);
+  parser.feed(truncated.asBytes());
+  KJ_EXPECT_THROW_MESSAGE("No subsequent boundary string", parser.finish());
+
+  MultipartParser noBoundary("xyz"_kj);
+  noBoundary.feed(BODY.asBytes());
+  KJ_EXPECT_THROW_MESSAGE("No initial boundary string", noBoundary.finish());
+}
+
+}  // namespace
+}  // namespace workerd::api
@@ -8,7 +8,7 @@
 #include <kj/encoding.h>
 #include <algorithm>
 #include <functional>
-#include <regex>
+#include <string.h>
 #include <strings.h>
 #include <kj/parse/char.h>
 #include <kj/compat/http.h>
@@ -17,20 +17,26 @@ namespace workerd::api {
 
 namespace {
 
-kj::ArrayPtr<const char> splitAtSubString(
-    kj::ArrayPtr<const char>& text, kj::StringPtr subString) {
-  // Like split() in kj/compat/url.c++, but splits at a substring rather than a character.
-
-  // TODO(perf): Use a Boyer-Moore search?
-  auto iter = std::search(text.begin(), text.end(), subString.begin(), subString.end());
-  auto result = kj::arrayPtr(text.begin(), iter - text.begin());
-  text = text.slice(kj::min(text.size(), result.end() - text.begin() + subString.size()),
-                    text.size());
-  return result;
+kj::Maybe<size_t> findSubString(kj::ArrayPtr<const kj::byte> text, kj::StringPtr subString) {
+  // Returns the offset of the first occurrence of `subString` in `text`. memchr() is vectorized,
+  // so we use it to skip from one candidate first character to the next.
+
+  KJ_DASSERT(subString.size() > 0);
+  const kj::byte* pos = text.begin();
+  while (size_t(text.end() - pos) >= subString.size()) {
+    auto found = reinterpret_cast<const kj::byte*>(
+        memchr(pos, subString[0], text.end() - pos - subString.size() + 1));
+    if (found == nullptr) break;
+    if (memcmp(found + 1, subString.begin() + 1, subString.size() - 1) == 0) {
+      return size_t(found - text.begin());
+    }
+    pos = found + 1;
+  }
+  return nullptr;
 }
 
-bool startsWith(kj::ArrayPtr<const char> bytes, kj::StringPtr prefix) {
-  return bytes.size() >= prefix.size() && bytes.slice(0, prefix.size()) == prefix;
+bool startsWith(kj::ArrayPtr<const kj::byte> bytes, kj::StringPtr prefix) {
+  return bytes.size() >= prefix.size() && bytes.slice(0, prefix.size()) == prefix.asBytes();
 }
 
 struct FormDataHeaderTable {
@@ -65,114 +71,6 @@ constexpr auto contentDisposition =
     p::sequence(p::discardWhitespace, httpIdentifier,
                 p::discardWhitespace, p::many(contentDispositionParam));
 
-void parseFormData(kj::Vector<FormData::Entry>& data, kj::ArrayPtr<const char> boundary,
-                   kj::ArrayPtr<const char> body, bool convertFilesToStrings) {
-  // multipart/form-data messages are delimited by <CRLF>--<boundary>. We want to be able to handle
-  // omitted carriage returns, though, so our delimiter only matches against a preceding line feed.
-  const auto delimiter = kj::str("\n--", boundary);
-
-  // We want to slice off the delimiter's preceding newline for the initial search, because the very
-  // first instance does not require one. In every subsequent multipart message, the preceding
-  // newline is required.
-  auto message = splitAtSubString(body, delimiter.slice(1));
-
-  JSG_REQUIRE(body.size() > 0, TypeError,
-      "No initial boundary string (or you have a truncated message).");
-
-  const auto done = [](kj::ArrayPtr<const char>& body) {
-    // Consume any (CR)LF characters that trailed the boundary and indicate continuation, or consume
-    // the terminal "--" characters and indicate termination, or throw an error.
-    if (startsWith(body, "\n")) {
-      body = body.slice(1, body.size());
-    } else if (startsWith(body, "\r\n")) {
-      body = body.slice(2, body.size());
-    } else if (startsWith(body, "--")) {
-      // We're done!
-      return true;
-    } else {
-      JSG_FAIL_REQUIRE(TypeError, "Boundary string was not succeeded by CRLF, LF, or '--'.");
-    }
-    return false;
-  };
-
-  constexpr auto staticRegexFlags = std::regex_constants::ECMAScript
-                                  | std::regex_constants::optimize;
-
-  static const auto headerTerminationRegex = std::regex("\r?\n\r?\n", staticRegexFlags);
-
-  std::cmatch match;
-
-  auto& formDataHeaderTable = getFormDataHeaderTable();
-
-  while (!done(body)) {
-    JSG_REQUIRE(std::regex_search(body.begin(), body.end(), match, headerTerminationRegex),
-                 TypeError, "No multipart message header termination found.");
-
-    // TODO(cleanup): Use kj-http to parse multipart headers. Right now that API isn't public, so
-    //   I'm just using a regex. For reference, multipart/form-data supports the following three
-    //   headers (https://tools.ietf.org/html/rfc7578#section-4.8):
-    //
-    //   Content-Disposition        (required)
-    //   Content-Type               (optional, recommended for files)
-    //   Content-Transfer-Encoding  (for 7-bit encoding, deprecated in HTTP contexts)
-    //
-    // TODO(soon): Read the Content-Type to support files.
-
-    auto headersText = kj::str(body.slice(0, match[0].second - body.begin()));
-    body = body.slice(match[0].second - body.begin(), body.size());
-
-    kj::HttpHeaders headers(*formDataHeaderTable.table);
-    JSG_REQUIRE(headers.tryParse(headersText), TypeError, "FormData part had invalid headers.");
-
-    kj::StringPtr disposition = JSG_REQUIRE_NONNULL(
-        headers.get(formDataHeaderTable.contentDispositionId),
-        TypeError, "No valid Content-Disposition header found in FormData part.");
-
-    kj::Maybe<kj::String> maybeName;
-    kj::Maybe<kj::String> filename;
-    {
-      p::IteratorInput<char, const char*> input(disposition.begin(), disposition.end());
-      auto result = JSG_REQUIRE_NONNULL(contentDisposition(input),
-          TypeError, "Invalid Content-Disposition header found in FormData part.");
-      JSG_REQUIRE(kj::get<0>(result) == "form-data"_kj.asArray(), TypeError,
-          "Content-Disposition header for FormData part must have the value \"form-data\", "
-          "possibly followed by parameters. Got: \"", kj::get<0>(result), "\"");
-
-      for (auto& param: kj::get<1>(result)) {
-        if (kj::get<0>(param) == "name"_kj.asArray()) {
-          maybeName = kj::str(kj::get<1>(param));
-        } else if (kj::get<0>(param) == "filename"_kj.asArray()) {
-          filename = kj::str(kj::get<1>(param));
-        }
-      }
-    }
-
-    kj::String name = JSG_REQUIRE_NONNULL(kj::mv(maybeName),
-        TypeError, "Content-Disposition header in FormData part is missing a name.");
-
-    kj::Maybe<kj::StringPtr> type = headers.get(kj::HttpHeaderId::CONTENT_TYPE);
-
-    message = splitAtSubString(body, delimiter);
-    JSG_REQUIRE(body.size() > 0, TypeError,
-        "No subsequent boundary string after multipart message.");
-
-    if (message.size() > 0) {
-      // If we skipped a CR, we must avoid including it in the message data.
-      message = message.slice(0, message.size() - uint(message.back() == '\r'));
-    }
-
-    if (filename == nullptr || convertFilesToStrings) {
-      data.add(FormData::Entry { kj::mv(name), kj::str(message) });
-    } else {
-      data.add(FormData::Entry {
-        kj::mv(name),
-        jsg::alloc<File>(kj::heapArray(message.asBytes()), KJ_ASSERT_NONNULL(kj::mv(filename)),
-                          kj::str(type.orDefault(nullptr)), dateNow())
-      });
-    }
-  }
-}
-
 kj::OneOf<jsg::Ref<File>, kj::String>
 blobToFile(kj::StringPtr name, kj::OneOf<jsg::Ref<File>, jsg::Ref<Blob>, kj::String> value,
            jsg::Optional<kj::String> filename) {
@@ -183,8 +81,9 @@ blobToFile(kj::StringPtr name, kj::OneOf<jsg::Ref<File>, jsg::Ref<Blob>, kj::Str
     } else {
       fn = kj::str(name);
     }
-    return jsg::alloc<File>(kj::heapArray(blob->getData()), kj::mv(fn),
-                             kj::str(blob->getType()), dateNow());
+    auto data = kj::heapArray<kj::byte>(blob->getSize());
+    blob->copyTo(data);
+    return jsg::alloc<File>(kj::mv(data), kj::mv(fn), kj::str(blob->getType()), dateNow());
   };
 
   KJ_SWITCH_ONEOF(value) {
@@ -206,39 +105,220 @@ blobToFile(kj::StringPtr name, kj::OneOf<jsg::Ref<File>, jsg::Ref<Blob>, kj::Str
   KJ_UNREACHABLE;
 }
 
-void addEscapingQuotes(kj::Vector<char>& builder, kj::StringPtr value) {
-  // Add the chars from `value` into `builder` escaping the characters '"' and '\n' using %
-  // encoding, exactly as Chrome does for Content-Disposition values.
+template <typename Func>
+void addEscapingQuotes(Func& add, kj::StringPtr value) {
+  // Pass the chars from `value` to `add` escaping the characters '"' and '\n' using %
+  // encoding, exactly as Chrome does for Content-Disposition values. Runs of chars that need no
+  // escaping are passed in one piece.
 
   // Chrome throws "Failed to fetch" if the name ends with a backslash. Otherwise it worries that
   // the backslash may be interpreted as escaping the final quote.
   JSG_REQUIRE(!value.endsWith("\\"), TypeError, "Name or filename can't end with backslash");
 
-  for (char c: value) {
-    switch (c) {
+  auto chars = value.asArray();
+  size_t start = 0;
+  for (auto i: kj::indices(chars)) {
+    kj::StringPtr escaped;
+    switch (chars[i]) {
       case '\"':
         // Firefox supposedly escapes this as '\"', but Chrome chooses to use percent escapes,
         // probably for fear of a buggy receiver who interprets the '"' as being the end of the
         // string. There is no standard.
-        builder.addAll("%22"_kj);
+        escaped = "%22"_kj;
         break;
       case '\n':
-        builder.addAll("%0A"_kj);
+        escaped = "%0A"_kj;
         break;
       case '\\':
         // Chrome doesn't escape '\', but this awkwardly means that the '\' will be evaluated as
         // an escape sequence on the other end. That seems like a bug. Let's not copy bugs.
-        builder.addAll("\\\\"_kj);
+        escaped = "\\\\"_kj;
         break;
       default:
-        builder.add(c);
-        break;
+        continue;
     }
+    add(chars.slice(start, i));
+    add(escaped.asArray());
+    start = i + 1;
   }
+  add(chars.slice(start, chars.size()));
 }
 
 }  // namespace
 
+// =======================================================================================
+// MultipartParser implementation
+
+MultipartParser::MultipartParser(kj::ArrayPtr<const char> boundary)
+    // multipart/form-data messages are delimited by <CRLF>--<boundary>. We want to be able to
+    // handle omitted carriage returns, though, so our delimiter only matches against a preceding
+    // line feed.
+    : delimiter(kj::str("\n--", boundary)) {}
+
+void MultipartParser::feed(kj::ArrayPtr<const kj::byte> chunk) {
+  if (carry.empty()) {
+    auto consumed = parse(chunk, false);
+    carry.addAll(chunk.slice(consumed, chunk.size()));
+  } else {
+    carry.addAll(chunk);
+    auto input = carry.releaseAsArray();
+    auto consumed = parse(input, false);
+    carry.addAll(input.slice(consumed, input.size()));
+  }
+}
+
+kj::Array<MultipartParser::Part> MultipartParser::finish() {
+  auto input = carry.releaseAsArray();
+  parse(input, true);
+  KJ_ASSERT(state == State::DONE);
+  return parts.releaseAsArray();
+}
+
+size_t MultipartParser::parse(kj::ArrayPtr<const kj::byte> input, bool eof) {
+  size_t pos = 0;
+  for (;;) {
+    auto rest = input.slice(pos, input.size());
+    switch (state) {
+      case State::PREAMBLE: {
+        // The very first boundary doesn't need a preceding newline.
+        auto initialDelimiter = delimiter.slice(1);
+        KJ_IF_MAYBE(found, findSubString(rest, initialDelimiter)) {
+          pos += *found + initialDelimiter.size();
+          state = State::AFTER_BOUNDARY;
+          continue;
+        }
+        JSG_REQUIRE(!eof, TypeError,
+            "No initial boundary string (or you have a truncated message).");
+
+        // Anything before the initial boundary is ignored, but hold on to what could be the start
+        // of it.
+        return input.size() - kj::min(rest.size(), initialDelimiter.size() - 1);
+      }
+
+      case State::AFTER_BOUNDARY:
+        // Consume any (CR)LF characters that trailed the boundary and indicate continuation, or
+        // the terminal "--" characters that indicate termination.
+        if (startsWith(rest, "\n")) {
+          pos += 1;
+          state = State::HEADERS;
+        } else if (startsWith(rest, "\r\n")) {
+          pos += 2;
+          state = State::HEADERS;
+        } else if (startsWith(rest, "--")) {
+          // We're done!
+          state = State::DONE;
+        } else {
+          JSG_REQUIRE(!eof && rest.size() < 2 && (rest.size() == 0 || rest[0] == '\r' ||
+                                                  rest[0] == '-'),
+              TypeError, "Boundary string was not succeeded by CRLF, LF, or '--'.");
+          return pos;
+        }
+        continue;
+
+      case State::HEADERS: {
+        // The headers end at the first blank line, allowing for omitted carriage returns.
+        kj::Maybe<size_t> headersEnd;
+        const kj::byte* lf = rest.begin();
+        while ((lf = reinterpret_cast<const kj::byte*>(memchr(lf, '\n', rest.end() - lf)))
+               != nullptr) {
+          const kj::byte* next = lf + 1;
+          if (next < rest.end() && *next == '\r') ++next;
+          if (next == rest.end()) break;  // need more input to tell
+          if (*next == '\n') {
+            headersEnd = next + 1 - rest.begin();
+            break;
+          }
+          ++lf;
+        }
+
+        KJ_IF_MAYBE(end, headersEnd) {
+          startPart(rest.slice(0, *end));
+          pos += *end;
+          state = State::BODY;
+          continue;
+        }
+        JSG_REQUIRE(!eof, TypeError, "No multipart message header termination found.");
+        return pos;
+      }
+
+      case State::BODY: {
+        KJ_IF_MAYBE(found, findSubString(rest, delimiter)) {
+          auto message = rest.slice(0, *found);
+          if (message.size() > 0 && message.back() == '\r') {
+            // If we skipped a CR, we must avoid including it in the message data.
+            message = message.slice(0, message.size() - 1);
+          }
+          content.addAll(message);
+          parts.back().data = content.releaseAsArray();
+          pos += *found + delimiter.size();
+          state = State::AFTER_BOUNDARY;
+          continue;
+        }
+        JSG_REQUIRE(!eof, TypeError, "No subsequent boundary string after multipart message.");
+
+        // Hold on to what could be the start of the delimiter, along with the CR that may precede
+        // it, and take the rest as content.
+        auto complete = rest.size() - kj::min(rest.size(), delimiter.size());
+        content.addAll(rest.slice(0, complete));
+        return pos + complete;
+      }
+
+      case State::DONE:
+        // Anything after the final boundary is ignored.
+        return input.size();
+    }
+    KJ_UNREACHABLE;
+  }
+}
+
+void MultipartParser::startPart(kj::ArrayPtr<const kj::byte> headersText) {
+  // TODO(cleanup): Use kj-http to parse multipart headers. Right now that API isn't public, so
+  //   we parse them as though they were a full HTTP header block. For reference,
+  //   multipart/form-data supports the following three headers
+  //   (https://tools.ietf.org/html/rfc7578#section-4.8):
+  //
+  //   Content-Disposition        (required)
+  //   Content-Type               (optional, recommended for files)
+  //   Content-Transfer-Encoding  (for 7-bit encoding, deprecated in HTTP contexts)
+
+  auto& formDataHeaderTable = getFormDataHeaderTable();
+
+  auto text = kj::str(headersText.asChars());
+  kj::HttpHeaders headers(*formDataHeaderTable.table);
+  JSG_REQUIRE(headers.tryParse(text), TypeError, "FormData part had invalid headers.");
+
+  kj::StringPtr disposition = JSG_REQUIRE_NONNULL(
+      headers.get(formDataHeaderTable.contentDispositionId),
+      TypeError, "No valid Content-Disposition header found in FormData part.");
+
+  kj::Maybe<kj::String> maybeName;
+  kj::Maybe<kj::String> filename;
+  {
+    p::IteratorInput<char, const char*> input(disposition.begin(), disposition.end());
+    auto result = JSG_REQUIRE_NONNULL(contentDisposition(input),
+        TypeError, "Invalid Content-Disposition header found in FormData part.");
+    JSG_REQUIRE(kj::get<0>(result) == "form-data"_kj.asArray(), TypeError,
+        "Content-Disposition header for FormData part must have the value \"form-data\", "
+        "possibly followed by parameters. Got: \"", kj::get<0>(result), "\"");
+
+    for (auto& param: kj::get<1>(result)) {
+      if (kj::get<0>(param) == "name"_kj.asArray()) {
+        maybeName = kj::str(kj::get<1>(param));
+      } else if (kj::get<0>(param) == "filename"_kj.asArray()) {
+        filename = kj::str(kj::get<1>(param));
+      }
+    }
+  }
+
+  kj::String name = JSG_REQUIRE_NONNULL(kj::mv(maybeName),
+      TypeError, "Content-Disposition header in FormData part is missing a name.");
+
+  parts.add(Part {
+    kj::mv(name), kj::mv(filename),
+    kj::str(headers.get(kj::HttpHeaderId::CONTENT_TYPE).orDefault(nullptr)), nullptr
+  });
+}
+
 // =======================================================================================
 // FormData implementation
 
@@ -247,41 +327,59 @@ kj::Array<kj::byte> FormData::serialize(kj::ArrayPtr<const char> boundary) {
   JSG_REQUIRE(boundary.size() > 0 && boundary.size() <= 70, TypeError,
       "Length of multipart/form-data boundary string must be in the range [1, 70].");
 
-  // TODO(perf): We should be able to trivially calculate the length of the serialized form data
-  //   beforehand. I tried, but apparently my math REALLY sucks and I hate memory overruns, so ...
-  auto builder = kj::Vector<char>{};
+  // The form is generated twice: once to measure it, and again to copy it into an array of
+  // exactly that size. Building it up in a Vector instead would mean growing and finally
+  // shrinking a copy of every file in the form.
+  size_t total = 0;
+  auto measure = [&](kj::ArrayPtr<const char> piece) { total += piece.size(); };
+  generate(boundary, measure);
+
+  auto result = kj::heapArray<kj::byte>(total);
+  size_t pos = 0;
+  auto copy = [&](kj::ArrayPtr<const char> piece) {
+    KJ_ASSERT(piece.size() <= total - pos, "FormData changed while serializing");
+    memcpy(result.begin() + pos, piece.begin(), piece.size());
+    pos += piece.size();
+  };
+  generate(boundary, copy);
+  KJ_ASSERT(pos == total, "FormData changed while serializing");
+
+  return result;
+}
 
+template <typename Func>
+void FormData::generate(kj::ArrayPtr<const char> boundary, Func& add) {
   for (auto& kv: data) {
-    builder.addAll("--"_kj);
-    builder.addAll(boundary);
-    builder.addAll("\r\n"_kj);
-    builder.addAll("Content-Disposition: form-data; name=\""_kj);
-    addEscapingQuotes(builder, kv.name);
+    add("--"_kj);
+    add(boundary);
+    add("\r\n"_kj);
+    add("Content-Disposition: form-data; name=\""_kj);
+    addEscapingQuotes(add, kv.name);
     KJ_SWITCH_ONEOF(kv.value) {
       KJ_CASE_ONEOF(text, kj::String) {
-        builder.addAll("\"\r\n\r\n"_kj);
-        builder.addAll(text);
+        add("\"\r\n\r\n"_kj);
+        add(text.asArray());
       }
       KJ_CASE_ONEOF(file, jsg::Ref<File>) {
-        builder.addAll("\"; filename=\""_kj);
-        addEscapingQuotes(builder, file->getName());
-        builder.addAll("\"\r\nContent-Type: "_kj);
+        add("\"; filename=\""_kj);
+        addEscapingQuotes(add, file->getName());
+        add("\"\r\nContent-Type: "_kj);
         auto type = file->getType();
         if (type == nullptr) {
           type = "application/octet-stream"_kj;
         }
-        builder.addAll(type);
-        builder.addAll("\r\n\r\n"_kj);
-        builder.addAll(file->getData().asChars());
+        add(type.asArray());
+        add("\r\n\r\n"_kj);
+        for (auto segment: file->getSegments()) {
+          add(segment.asChars());
+        }
       }
     }
-    builder.addAll("\r\n"_kj);
+    add("\r\n"_kj);
   }
-  builder.addAll("--"_kj);
-  builder.addAll(boundary);
-  builder.addAll("--"_kj);
-
-  return builder.releaseAsArray().releaseAsBytes();
+  add("--"_kj);
+  add(boundary);
+  add("--"_kj);
 }
 
 FormData::EntryType FormData::clone(v8::Isolate* isolate, FormData::EntryType& value) {
@@ -298,12 +396,10 @@ FormData::EntryType FormData::clone(v8::Isolate* isolate, FormData::EntryType& v
 
 void FormData::parse(kj::ArrayPtr<const char> rawText, kj::StringPtr contentType,
                      bool convertFilesToStrings) {
-  if (contentType.startsWith("multipart/form-data")) {
-    auto boundary = JSG_REQUIRE_NONNULL(readContentTypeParameter(contentType, "boundary"),
-        TypeError, "No boundary string in Content-Type header. The multipart/form-data MIME "
-        "type requires a boundary parameter, e.g. 'Content-Type: multipart/form-data; "
-        "boundary=\"abcd\"'. See RFC 7578, section 4.");
-    parseFormData(data, boundary, rawText, convertFilesToStrings);
+  KJ_IF_MAYBE(boundary, getMultipartBoundary(contentType)) {
+    MultipartParser parser(*boundary);
+    parser.feed(rawText.asBytes());
+    addParts(parser.finish(), convertFilesToStrings);
   } else if (contentType.startsWith("application/x-www-form-urlencoded")) {
     // Let's read the charset so we can barf if the body isn't UTF-8.
     //
@@ -327,6 +423,31 @@ void FormData::parse(kj::ArrayPtr<const char> rawText, kj::StringPtr contentType
   }
 }
 
+void FormData::addParts(kj::Array<MultipartParser::Part> parts, bool convertFilesToStrings) {
+  data.reserve(data.size() + parts.size());
+  for (auto& part: parts) {
+    KJ_IF_MAYBE(filename, part.filename) {
+      if (!convertFilesToStrings) {
+        data.add(Entry {
+          kj::mv(part.name),
+          jsg::alloc<File>(kj::mv(part.data), kj::mv(*filename), kj::mv(part.type), dateNow())
+        });
+        continue;
+      }
+    }
+    data.add(Entry { kj::mv(part.name), kj::str(part.data.asChars()) });
+  }
+}
+
+kj::Maybe<kj::String> FormData::getMultipartBoundary(kj::StringPtr contentType) {
+  if (!contentType.startsWith("multipart/form-data")) return nullptr;
+
+  return kj::str(JSG_REQUIRE_NONNULL(readContentTypeParameter(contentType, "boundary"),
+      TypeError, "No boundary string in Content-Type header. The multipart/form-data MIME "
+      "type requires a boundary parameter, e.g. 'Content-Type: multipart/form-data; "
+      "boundary=\"abcd\"'. See RFC 7578, section 4."));
+}
+
 jsg::Ref<FormData> FormData::constructor() {
   return jsg::alloc<FormData>();
 }
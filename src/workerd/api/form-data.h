@@ -15,6 +15,51 @@ namespace url {
 class URLSearchParams;
 }  // namespace url
 
+class MultipartParser {
+  // Incrementally parses a multipart/form-data body (RFC 7578) as it arrives, so that the body
+  // never has to be held in full: each part's content is copied straight out of the chunk it
+  // arrived in, and only a partial delimiter or header block is carried over between chunks.
+  //
+  // Doesn't touch JavaScript, so it can run as a WritableStreamSink is written to.
+
+public:
+  struct Part {
+    kj::String name;
+    kj::Maybe<kj::String> filename;
+    kj::String type;  // empty if the part had no Content-Type
+    kj::Array<kj::byte> data;
+  };
+
+  explicit MultipartParser(kj::ArrayPtr<const char> boundary);
+  KJ_DISALLOW_COPY_AND_MOVE(MultipartParser);
+
+  void feed(kj::ArrayPtr<const kj::byte> chunk);
+  // Parses the next chunk of the body. Throws a TypeError if the body is malformed.
+
+  kj::Array<Part> finish();
+  // Signals the end of the body, returning the parts parsed. Throws a TypeError if the body was
+  // truncated.
+
+private:
+  enum class State { PREAMBLE, AFTER_BOUNDARY, HEADERS, BODY, DONE };
+
+  State state = State::PREAMBLE;
+  kj::String delimiter;
+  // "\n--<boundary>". The initial boundary doesn't need the preceding newline.
+
+  kj::Vector<kj::byte> carry;
+  // Input left unconsumed by the last feed(), to be parsed along with the next chunk.
+
+  kj::Vector<Part> parts;
+  kj::Vector<kj::byte> content;
+  // Content of the last part in `parts`, while in the BODY state.
+
+  size_t parse(kj::ArrayPtr<const kj::byte> input, bool eof);
+  // Consumes what it can of `input`, returning the number of bytes consumed.
+
+  void startPart(kj::ArrayPtr<const kj::byte> headersText);
+};
+
 class FormData: public jsg::Object {
   // Implements the FormData interface as prescribed by:
   // https://xhr.spec.whatwg.org/#interface-formdata
@@ -52,6 +97,13 @@ public:
     kj::OneOf<jsg::Ref<File>, kj::String> value;
   };
 
+  void addParts(kj::Array<MultipartParser::Part> parts, bool convertFilesToStrings);
+  // Stores the results of parsing a multipart/form-data body with MultipartParser.
+
+  static kj::Maybe<kj::String> getMultipartBoundary(kj::StringPtr contentType);
+  // Returns the boundary parameter if `contentType` is multipart/form-data, or null if it's
+  // something else. Throws a TypeError if the boundary is missing.
+
   kj::ArrayPtr<const Entry> getData() { return data; }
 
   // JS API
@@ -145,6 +197,10 @@ public:
 private:
   kj::Vector<Entry> data;
 
+  template <typename Func>
+  void generate(kj::ArrayPtr<const char> boundary, Func& add);
+  // Passes the pieces of the serialized form to `add`, in order. (Used by serialize().)
+
   static EntryType clone(v8::Isolate* isolate, EntryType& value);
 
   template <typename Type>
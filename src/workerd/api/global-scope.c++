@@ -14,6 +14,7 @@
 #include <workerd/util/sentry.h>
 #include <workerd/util/sentry.h>
 #include <workerd/util/own-util.h>
+#include <workerd/util/base64.h>
 
 namespace workerd::api {
 
@@ -122,17 +123,11 @@ kj::Promise<DeferredProxy<void>> ServiceWorkerGlobalScope::request(
   auto& ioContext = IoContext::current();
   auto isolate = lock.getIsolate();
 
-  kj::Maybe<jsg::V8Ref<v8::Object>> cf;
-
-  KJ_IF_MAYBE(c, cfBlobJson) {
-    auto jsonString = jsg::v8Str(isolate, *c);
-
-    auto handle = jsg::check(v8::JSON::Parse(isolate->GetCurrentContext(), jsonString));
-    // For the inbound request, we make the `cf` blob immutable.
-    jsg::recursivelyFreeze(isolate->GetCurrentContext(), handle);
-    KJ_ASSERT(handle->IsObject());
-    cf = jsg::V8Ref(isolate, handle.As<v8::Object>());
-  }
+  // For the inbound request, we make the `cf` blob immutable. It's only parsed if the script
+  // actually reads `request.cf`.
+  auto cf = cfBlobJson.map([](kj::StringPtr json) {
+    return Request::CfBlobJson { kj::str(json), true };
+  });
 
   auto jsHeaders = jsg::alloc<Headers>(headers, Headers::Guard::REQUEST);
   // We do not automatically decode gzipped request bodies because the fetch() standard doesn't
@@ -171,7 +166,7 @@ kj::Promise<DeferredProxy<void>> ServiceWorkerGlobalScope::request(
       method, url, Request::Redirect::MANUAL, kj::mv(jsHeaders),
       jsg::alloc<Fetcher>(IoContext::NEXT_CLIENT_CHANNEL,
                            Fetcher::RequiresHostAndProtocol::YES),
-      nullptr /** AbortSignal **/, kj::mv(cf), kj::mv(body));
+      nullptr /** AbortSignal **/, nullptr /** cf **/, kj::mv(body), kj::mv(cf));
   // I set the redirect mode to manual here, so that by default scripts that just pass requests
   // through to a fetch() call will behave the same as scripts which don't call .respondWith(): if
   // the request results in a redirect, the visitor will see that redirect.
@@ -451,31 +446,27 @@ kj::String ServiceWorkerGlobalScope::btoa(v8::Local<v8::Value> data, v8::Isolate
 
   // We could implement btoa() by accepting a kj::String, but then we'd have to check that it
   // doesn't have any multibyte code points. Easier to perform that test using v8::String's
-  // ContainsOnlyOneByte() function.
-  JSG_REQUIRE(str->ContainsOnlyOneByte(), DOMInvalidCharacterError,
+  // ContainsOnlyOneByte() function. IsOneByte() only looks at the string's representation, so it
+  // is much cheaper, but can report false negatives, in which case we still need the full scan.
+  JSG_REQUIRE(str->IsOneByte() || str->ContainsOnlyOneByte(), DOMInvalidCharacterError,
       "btoa() can only operate on characters in the Latin1 (ISO/IEC 8859-1) range.");
 
-  // TODO(perf): v8::String sometimes holds a char pointer rather than a uint16_t pointer, which is
-  //   why v8::String::IsOneByte() is both faster than ContainsOnlyOneByte() and prone to false
-  //   negatives. Conceivably we could take advantage of this fact to completely avoid the later
-  //   WriteOneByte() call in some cases!
   auto buf = kj::heapArray<kj::byte>(str->Length());
   str->WriteOneByte(isolate, buf.begin(), 0, buf.size());
 
-  return kj::encodeBase64(buf);
+  return base64Encode(buf);
 }
 v8::Local<v8::String> ServiceWorkerGlobalScope::atob(kj::String data, v8::Isolate* isolate) {
-  auto decoded = kj::decodeBase64(data.asArray());
-
-  JSG_REQUIRE(!decoded.hadErrors, DOMInvalidCharacterError,
+  auto maybeDecoded = base64Decode(data.asArray());
+  auto& decoded = JSG_REQUIRE_NONNULL(maybeDecoded, DOMInvalidCharacterError,
       "atob() called with invalid base64-encoded data. (Only whitespace, '+', '/', alphanumeric "
       "ASCII, and up to two terminal '=' signs when the input data length is divisible by 4 are "
       "allowed.)");
 
   // Similar to btoa() taking a v8::Value, we return a v8::String directly, as this allows us to
-  // construct a string from the non-nul-terminated array returned from decodeBase64(). This avoids
+  // construct a string from the non-nul-terminated array returned from base64Decode(). This avoids
   // making a copy purely to append a nul byte.
-  return jsg::v8StrFromLatin1(isolate, decoded.asBytes());
+  return jsg::v8StrFromLatin1(isolate, decoded);
 }
 
 void ServiceWorkerGlobalScope::queueMicrotask(v8::Local<v8::Function> task, v8::Isolate* isolate) {
@@ -573,7 +564,7 @@ jsg::Promise<jsg::Ref<Response>> ServiceWorkerGlobalScope::fetch(
 jsg::Ref<Socket> ServiceWorkerGlobalScope::connect(
     jsg::Lock& js, kj::String address, jsg::Optional<SocketOptions> options,
     CompatibilityFlags::Reader featureFlags) {
-  return connectImpl(js, nullptr, kj::mv(address), featureFlags);
+  return connectImpl(js, nullptr, kj::mv(address), kj::mv(options), featureFlags);
 }
 
 }  // namespace workerd::api
@@ -137,10 +137,24 @@ struct ExportedHandler {
   // Alarms are only exported on DOs, which receive env bindings from the constructor
   jsg::LenientOptional<jsg::Function<AlarmHandler>> alarm;
 
+  typedef kj::Promise<void> WebSocketMessageHandler(
+      jsg::Ref<WebSocket> ws, kj::OneOf<kj::String, kj::Array<byte>> message);
+  jsg::LenientOptional<jsg::Function<WebSocketMessageHandler>> webSocketMessage;
+
+  typedef kj::Promise<void> WebSocketCloseHandler(
+      jsg::Ref<WebSocket> ws, int code, kj::String reason, bool wasClean);
+  jsg::LenientOptional<jsg::Function<WebSocketCloseHandler>> webSocketClose;
+
+  typedef kj::Promise<void> WebSocketErrorHandler(jsg::Ref<WebSocket> ws, jsg::Value error);
+  jsg::LenientOptional<jsg::Function<WebSocketErrorHandler>> webSocketError;
+  // Like alarms, these are only exported on DOs. They receive events from WebSockets accepted
+  // with `state.acceptWebSocket()`.
+
   jsg::SelfRef self;
   // Self-ref potentially allows extracting other custom handlers from the object.
 
-  JSG_STRUCT(fetch, trace, scheduled, alarm, self);
+  JSG_STRUCT(fetch, trace, scheduled, alarm, webSocketMessage, webSocketClose, webSocketError,
+             self);
 
   JSG_STRUCT_TS_ROOT();
   // ExportedHandler isn't included in the global scope, but we still want to
@@ -157,6 +171,9 @@ struct ExportedHandler {
     trace?: ExportedHandlerTraceHandler<Env>;
     scheduled?: ExportedHandlerScheduledHandler<Env>;
     alarm: never;
+    webSocketMessage: never;
+    webSocketClose: never;
+    webSocketError: never;
     queue?: ExportedHandlerQueueHandler<Env, QueueMessage>;
   });
   // Make `env` parameter generic
@@ -0,0 +1,101 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "hibernatable-web-socket.h"
+#include <workerd/api/global-scope.h>
+#include <workerd/io/worker.h>
+
+namespace workerd::api {
+
+namespace {
+kj::Promise<void> deliverToHandler(Worker::Lock& lock, ExportedHandler& handler,
+    jsg::Ref<WebSocket> ws, HibernatableWebSocketCustomEventImpl::Payload& payload) {
+  using Close = HibernatableWebSocketCustomEventImpl::Close;
+
+  KJ_SWITCH_ONEOF(payload) {
+    KJ_CASE_ONEOF(text, kj::String) {
+      KJ_IF_MAYBE(f, handler.webSocketMessage) {
+        return (*f)(lock, kj::mv(ws), kj::mv(text));
+      }
+    }
+    KJ_CASE_ONEOF(data, kj::Array<kj::byte>) {
+      KJ_IF_MAYBE(f, handler.webSocketMessage) {
+        return (*f)(lock, kj::mv(ws), kj::mv(data));
+      }
+    }
+    KJ_CASE_ONEOF(close, Close) {
+      ws->hibernatableCloseReceived();
+      KJ_IF_MAYBE(f, handler.webSocketClose) {
+        return (*f)(lock, kj::mv(ws), close.code, kj::mv(close.reason), close.wasClean);
+      }
+      return kj::READY_NOW;
+    }
+    KJ_CASE_ONEOF(error, kj::Exception) {
+      ws->hibernatableCloseReceived();
+      KJ_IF_MAYBE(f, handler.webSocketError) {
+        jsg::Lock& js = lock;
+        return (*f)(lock, kj::mv(ws), js.exceptionToJs(kj::cp(error)));
+      }
+      return kj::READY_NOW;
+    }
+  }
+
+  // Only messages end up here. Closes and errors are fine to ignore, but silently dropping a
+  // message is surprising.
+  lock.logWarningOnce(
+      "Received a message on a hibernatable WebSocket but we lack a handler, "
+      "did you remember to define a webSocketMessage() method?");
+  JSG_FAIL_REQUIRE(Error, "Durable Object does not define a webSocketMessage() method.");
+}
+}  // namespace
+
+auto HibernatableWebSocketCustomEventImpl::run(
+    kj::Own<IoContext::IncomingRequest> incomingRequest,
+    kj::Maybe<kj::StringPtr> entrypointName) -> kj::Promise<Result> {
+  // Mark the request as delivered because we're about to run some JS.
+  incomingRequest->delivered();
+
+  auto& context = incomingRequest->getContext();
+  auto& metrics = incomingRequest->getMetrics();
+  bool closing = !payload.is<kj::String>() && !payload.is<kj::Array<kj::byte>>();
+
+  auto outcome = EventOutcome::OK;
+  try {
+    co_await context.run([&](Worker::Lock& lock) -> kj::Promise<void> {
+      auto ws = manager.getWebSocket(lock, *socket);
+      if (closing) {
+        // Nothing more will arrive on this socket, so the manager can let go of it. The wrapper
+        // keeps the native socket alive for as long as the application is still sending on it.
+        manager.dropSocket(lock, *socket);
+      }
+
+      auto& handler = KJ_REQUIRE_NONNULL(
+          lock.getExportedHandler(entrypointName, context.getActor()),
+          "Hibernatable WebSocket events require a Durable Object class.");
+      return deliverToHandler(lock, handler, kj::mv(ws), payload);
+    });
+  } catch (kj::Exception e) {
+    metrics.reportFailure(e);
+    context.logUncaughtExceptionAsync(UncaughtExceptionSource::REQUEST_HANDLER, kj::mv(e));
+    outcome = EventOutcome::EXCEPTION;
+  }
+
+  co_await incomingRequest->drain();
+
+  co_return Result {
+    .outcome = outcome,
+  };
+}
+
+auto HibernatableWebSocketCustomEventImpl::sendRpc(
+    capnp::HttpOverCapnpFactory& httpOverCapnpFactory,
+    capnp::ByteStreamFactory& byteStreamFactory,
+    kj::TaskSet& waitUntilTasks,
+    workerd::rpc::EventDispatcher::Client dispatcher) -> kj::Promise<Result> {
+  // Hibernatable sockets are owned by the process hosting the actor, so their events are always
+  // delivered locally.
+  KJ_UNIMPLEMENTED("hibernatable WebSocket events cannot be forwarded over RPC");
+}
+
+}  // namespace workerd::api
@@ -0,0 +1,50 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#pragma once
+
+#include <workerd/io/hibernation-manager.h>
+#include <workerd/io/io-context.h>
+
+namespace workerd::api {
+
+class HibernatableWebSocketCustomEventImpl final: public WorkerInterface::CustomEvent {
+  // Delivers one event from a socket held by a HibernationManager to the actor's
+  // `webSocketMessage()`, `webSocketClose()`, or `webSocketError()` handler.
+
+public:
+  struct Close {
+    uint16_t code;
+    kj::String reason;
+    bool wasClean;
+  };
+  using Payload = kj::OneOf<kj::String, kj::Array<kj::byte>, Close, kj::Exception>;
+
+  HibernatableWebSocketCustomEventImpl(
+      HibernationManager& manager, kj::Own<HibernationManager::Socket> socket, Payload payload)
+    : manager(manager), socket(kj::mv(socket)), payload(kj::mv(payload)) {}
+
+  static constexpr uint16_t EVENT_TYPE = 8;
+
+  kj::Promise<Result> run(
+      kj::Own<IoContext::IncomingRequest> incomingRequest,
+      kj::Maybe<kj::StringPtr> entrypointName) override;
+
+  kj::Promise<Result> sendRpc(
+      capnp::HttpOverCapnpFactory& httpOverCapnpFactory,
+      capnp::ByteStreamFactory& byteStreamFactory,
+      kj::TaskSet& waitUntilTasks,
+      rpc::EventDispatcher::Client dispatcher) override;
+
+  uint16_t getType() override {
+    return EVENT_TYPE;
+  }
+
+private:
+  HibernationManager& manager;
+  kj::Own<HibernationManager::Socket> socket;
+  Payload payload;
+};
+
+}  // namespace workerd::api
@@ -85,6 +85,17 @@ private:
   kj::ArrayPtr<const char> chars;
 };
 
+v8::Local<v8::String> v8StrFromLol(v8::Isolate* isolate, kj::ArrayPtr<const char> chars) {
+  // Make a JavaScript string straight from a UTF-8 string slice owned by lol-html. Markup is
+  // overwhelmingly ASCII, which V8 can take as a one-byte string without decoding it.
+  for (char c: chars) {
+    if (static_cast<kj::byte>(c) >= 0x80) {
+      return jsg::v8Str(isolate, chars);
+    }
+  }
+  return jsg::v8StrFromLatin1(isolate, chars.asBytes());
+}
+
 // =======================================================================================
 // Error checking for lol-html
 
@@ -168,6 +179,88 @@ namespace {
 // Rewriter
 using ElementCallbackFunction = HTMLRewriter::ElementCallbackFunction;
 
+struct NativeElementRules: public kj::Refcounted {
+  // The declarative rules from an HTMLRewriter::ElementRules, applied to each matching element
+  // directly from the lol-html callback.
+
+  struct Attribute {
+    kj::String name;
+    kj::String value;
+  };
+
+  kj::Array<Attribute> setAttribute;
+  kj::Array<kj::String> removeAttribute;
+  kj::Maybe<kj::String> before;
+  kj::Maybe<kj::String> after;
+  kj::Maybe<kj::String> prepend;
+  kj::Maybe<kj::String> append;
+  kj::Maybe<kj::String> setInnerContent;
+  kj::Maybe<kj::String> replaceWith;
+  bool remove = false;
+  bool removeAndKeepContent = false;
+  bool html = false;
+
+  static kj::Maybe<kj::Own<NativeElementRules>> from(HTMLRewriter::ElementRules& source) {
+    // Returns null if `source` has no rules.
+    if (source.setAttribute == nullptr && source.removeAttribute == nullptr &&
+        source.before == nullptr && source.after == nullptr &&
+        source.prepend == nullptr && source.append == nullptr &&
+        source.setInnerContent == nullptr && source.replaceWith == nullptr &&
+        !source.remove.orDefault(false) && !source.removeAndKeepContent.orDefault(false)) {
+      return nullptr;
+    }
+
+    auto rules = kj::refcounted<NativeElementRules>();
+    KJ_IF_MAYBE(attributes, source.setAttribute) {
+      rules->setAttribute = KJ_MAP(field, attributes->fields) {
+        return Attribute { kj::mv(field.name), kj::mv(field.value) };
+      };
+    }
+    KJ_IF_MAYBE(names, source.removeAttribute) {
+      rules->removeAttribute = kj::mv(*names);
+    }
+    rules->before = kj::mv(source.before);
+    rules->after = kj::mv(source.after);
+    rules->prepend = kj::mv(source.prepend);
+    rules->append = kj::mv(source.append);
+    rules->setInnerContent = kj::mv(source.setInnerContent);
+    rules->replaceWith = kj::mv(source.replaceWith);
+    rules->remove = source.remove.orDefault(false);
+    rules->removeAndKeepContent = source.removeAndKeepContent.orDefault(false);
+    rules->html = source.html.orDefault(false);
+    return kj::mv(rules);
+  }
+
+  void apply(lol_html_element_t& element) const {
+    for (auto& attribute: setAttribute) {
+      check(lol_html_element_set_attribute(&element,
+          attribute.name.cStr(), attribute.name.size(),
+          attribute.value.cStr(), attribute.value.size()));
+    }
+    for (auto& name: removeAttribute) {
+      check(lol_html_element_remove_attribute(&element, name.cStr(), name.size()));
+    }
+
+    auto rewriteContent = [&](auto* function, const kj::Maybe<kj::String>& content) {
+      KJ_IF_MAYBE(c, content) {
+        check(function(&element, c->cStr(), c->size(), html));
+      }
+    };
+    rewriteContent(lol_html_element_before, before);
+    rewriteContent(lol_html_element_after, after);
+    rewriteContent(lol_html_element_prepend, prepend);
+    rewriteContent(lol_html_element_append, append);
+    rewriteContent(lol_html_element_set_inner_content, setInnerContent);
+    rewriteContent(lol_html_element_replace, replaceWith);
+
+    if (remove) {
+      lol_html_element_remove(&element);
+    } else if (removeAndKeepContent) {
+      lol_html_element_remove_and_keep_content(&element);
+    }
+  }
+};
+
 struct UnregisteredElementHandlers {
   kj::Own<lol_html_Selector> selector;
 
@@ -176,6 +269,9 @@ struct UnregisteredElementHandlers {
   jsg::Optional<ElementCallbackFunction> text;
   // The actual handler functions. We store them as jsg::Values for compatibility with GcVisitor.
 
+  kj::Maybe<kj::Own<NativeElementRules>> rules;
+  uint textChunkLimit;
+
   void visitForGc(jsg::GcVisitor& visitor) {
     visitor.visit(element, comments, text);
   }
@@ -190,11 +286,25 @@ struct UnregisteredDocumentHandlers {
 
   // The `this` object used to call the handler functions.
 
+  uint textChunkLimit;
+
   void visitForGc(jsg::GcVisitor& visitor) {
     visitor.visit(doctype, comments, text, end);
   }
 };
 
+constexpr uint MAX_TEXT_CHUNK_LIMIT = 1024 * 1024;
+// Coalesced text is buffered outside of lol-html's memory limit, so we need a limit of our own.
+
+uint validateTextChunkLimit(jsg::Optional<uint32_t> textChunkLimit) {
+  KJ_IF_MAYBE(limit, textChunkLimit) {
+    JSG_REQUIRE(*limit > 0 && *limit <= MAX_TEXT_CHUNK_LIMIT, RangeError,
+        "textChunkLimit must be between 1 and ", MAX_TEXT_CHUNK_LIMIT, " bytes.");
+    return *limit;
+  }
+  return 0;
+}
+
 using UnregisteredElementOrDocumentHandlers =
     kj::OneOf<UnregisteredElementHandlers, UnregisteredDocumentHandlers>;
 
@@ -204,12 +314,17 @@ class Rewriter final: public WritableStreamSink {
   // Wrapper around an actual rewriter (streaming parser).
 
 public:
+  class BuilderCache;
+  struct Builder;
+
   explicit Rewriter(
       jsg::Lock& js,
+      BuilderCache& cache,
       kj::ArrayPtr<UnregisteredElementOrDocumentHandlers> unregisteredHandlers,
       kj::ArrayPtr<const char> encoding,
       kj::Own<WritableStreamSink> inner,
       CompatibilityFlags::Reader featureFlags);
+  ~Rewriter() noexcept(false);
   KJ_DISALLOW_COPY_AND_MOVE(Rewriter);
 
   // WritableStreamSink implementation. The input body pumpTo() operation calls these.
@@ -227,8 +342,10 @@ private:
   // stored exception, abort the wrapped WritableStreamSink with it, then return the exception.
   // Otherwise, just return.
 
-  static kj::Own<lol_html_HtmlRewriter> buildRewriter(jsg::Lock& js,
-      kj::ArrayPtr<UnregisteredElementOrDocumentHandlers> unregisteredHandlers,
+  static kj::Own<Builder> buildBuilder(
+      kj::ArrayPtr<UnregisteredElementOrDocumentHandlers> unregisteredHandlers, uint generation);
+
+  static kj::Own<lol_html_HtmlRewriter> buildRewriter(Builder& builder,
       kj::ArrayPtr<const char> encoding, Rewriter& rewriterWrapper,
       CompatibilityFlags::Reader featureFlags);
 
@@ -253,22 +370,41 @@ private:
   friend class ::workerd::api::HTMLRewriter;
 
   struct RegisteredHandler {
-    Rewriter& rewriter;
-    // A back-reference to the rewriter which owns this particular registered handler.
+    Rewriter* rewriter = nullptr;
+    // A back-reference to the rewriter currently using this particular registered handler. Handlers
+    // registered on a cached Builder are passed from one Rewriter to the next.
+
+    kj::Maybe<ElementCallbackFunction&> source;
+    // For handlers registered on a Builder, the HTMLRewriter's copy of the callback, from which
+    // `callback` is filled in each time the Builder is checked out.
+
+    kj::Maybe<ElementCallbackFunction> callback;
+
+    uint textChunkLimit = 0;
+    // For text handlers, the `textChunkLimit` option, or zero if chunks aren't to be coalesced.
+
+    kj::Vector<char> pendingText;
+    // Chunks of the current text node which were held back so the handler gets them all at once.
 
-    ElementCallbackFunction callback;
+    jsg::ExternalMemoryAdjustment pendingTextMemory;
+    // Counts `pendingText` against the Rewriter's memory counter.
   };
 
-  kj::Vector<kj::Own<RegisteredHandler>> registeredHandlers;
-  // TODO(perf): Don't store Owns. We need to pass stable pointers as the userdata parameter to
-  //   lol_html_rewriter_builder_add_*_content_handlers(), but don't have a really easy way to
-  //   know precisely how many handlers we're going to register beforehand, so we need a vector. But
-  //   vectors can grow, moving their objects around, invalidating pointers into their storage.
+  struct RegisteredRules {
+    Rewriter* rewriter = nullptr;
+    kj::Own<NativeElementRules> rules;
+  };
+
+  kj::Own<BuilderCache> builderCache;
+  kj::Own<Builder> builder;
+  // The builder our `rewriter` was built from, which we have to ourselves until we're destroyed.
 
   kj::Vector<kj::Own<RegisteredHandler>> registeredEndTagHandlers;
-  // This is separate from `registeredHandlers` so we can delete them more eagerly when EndTags are
-  // destroyed, and not have to look through all other handlers.
-  // TODO(perf) Don't store Owns, same as `registeredHandlers` above.
+  // End tag handlers are registered on elements as we go rather than on the builder, so they're
+  // ours alone and we can delete them eagerly when EndTags are destroyed.
+  // TODO(perf): Don't store Owns. We need to pass stable pointers as the userdata parameter to
+  //   lol_html_element_on_end_tag(), but vectors can grow, moving their objects around,
+  //   invalidating pointers into their storage.
 
   template <typename T, typename CType = typename T::CType>
   static lol_html_rewriter_directive_t thunk(CType* content, void* userdata);
@@ -277,13 +413,25 @@ private:
   template <typename T, typename CType = typename T::CType>
   kj::Promise<void> thunkPromise( CType* content, RegisteredHandler& registration);
 
+  static lol_html_rewriter_directive_t applyRules(lol_html_element_t* element, void* userdata);
+  lol_html_rewriter_directive_t applyRulesImpl(
+      lol_html_element_t& element, RegisteredRules& registration);
+
+  static bool holdBackTextChunk(lol_html_text_chunk_t& chunk, RegisteredHandler& registration);
+  // If the handler coalesces text, and this chunk neither ends its text node nor fills the limit,
+  // removes it from the output and adds it to `pendingText`, returning true.
+
+  static void finishCoalescedText(lol_html_text_chunk_t& chunk, RegisteredHandler& registration);
+  // Called after the handler has seen the chunk which followed the held back ones, to put them
+  // back in the output, unless the handler removed or replaced the text.
+
   void removeEndTagHandler(RegisteredHandler& registration);
   // Eagerly free this handler. Should only be called if we're confident the handler will never be
   // used again.
 
   kj::Own<lol_html_HtmlRewriter> rewriter;
-  // Must be constructed AFTER the registered handler vector, since the function which constructs
-  // this (buildRewriter()) modifies that vector.
+  // Must be constructed AFTER `builder`, since the function which constructs this
+  // (buildRewriter()) points the builder's handlers at us.
 
   kj::Own<WritableStreamSink> inner;
 
@@ -293,6 +441,10 @@ private:
 
   IoContext& ioContext;
 
+  const jsg::ExternalMemoryTracker::Counter& memoryCounter;
+  // Counts output waiting to be written to `inner`, and held back text, as memory held for the
+  // isolate. lol-html's own buffers are bounded by its memory settings and aren't counted.
+
   kj::Maybe<kj::WaitScope&> maybeWaitScope;
 
   bool canceled = false;
@@ -313,39 +465,138 @@ private:
   }
 };
 
-kj::Own<lol_html_HtmlRewriter> Rewriter::buildRewriter(
-    jsg::Lock& js, kj::ArrayPtr<UnregisteredElementOrDocumentHandlers> unregisteredHandlers,
-    kj::ArrayPtr<const char> encoding, Rewriter& rewriter,
-    CompatibilityFlags::Reader featureFlags) {
-  auto builder = LOL_HTML_OWN(rewriter_builder, lol_html_rewriter_builder_new());
+struct Rewriter::Builder {
+  // A lol-html rewriter builder with all of an HTMLRewriter's handlers registered on it.
+  //
+  // lol-html rewriters are inextricably linked to the builders which created them: two rewriters
+  // built from the same builder require synchronization to access safely, and a rewriter's
+  // callbacks must not use its builder, lest the process deadlock. Meanwhile our callbacks can
+  // suspend in the middle of a write to wait for JavaScript, letting other rewriters run. So a
+  // Builder is only ever in use by one Rewriter at a time; after that it goes back to its
+  // HTMLRewriter's BuilderCache so that the next transform() doesn't have to build another one.
+
+  kj::Own<lol_html_HtmlRewriterBuilder> builder;
+
+  kj::Vector<kj::Own<RegisteredHandler>> registeredHandlers;
+  kj::Vector<kj::Own<RegisteredRules>> registeredRules;
+  // TODO(perf): Don't store Owns. We need to pass stable pointers as the userdata parameter to
+  //   lol_html_rewriter_builder_add_*_content_handlers(), but don't have a really easy way to
+  //   know precisely how many handlers we're going to register beforehand, so we need a vector. But
+  //   vectors can grow, moving their objects around, invalidating pointers into their storage.
+
+  uint generation;
+  // The BuilderCache generation whose handlers this was built from.
+};
+
+class Rewriter::BuilderCache final: public kj::Refcounted {
+  // The idle Builders of one HTMLRewriter. Refcounted, since Rewriters, which check Builders back
+  // in when destroyed, can outlive their HTMLRewriter.
+
+public:
+  kj::Own<Builder> checkOut(jsg::Lock& js,
+      kj::ArrayPtr<UnregisteredElementOrDocumentHandlers> unregisteredHandlers) {
+    kj::Own<Builder> result;
+    if (idle.empty()) {
+      result = buildBuilder(unregisteredHandlers, generation);
+    } else {
+      result = kj::mv(idle.back());
+      idle.removeLast();
+    }
+
+    // Idle Builders don't hold on to the callbacks, so as not to keep them alive for as long as the
+    // HTMLRewriter is, outside of what the GC can see.
+    for (auto& handler: result->registeredHandlers) {
+      handler->callback = KJ_ASSERT_NONNULL(handler->source).addRef(js);
+    }
+    return kj::mv(result);
+  }
+
+  void checkIn(kj::Own<Builder> builder) {
+    for (auto& handler: builder->registeredHandlers) {
+      handler->rewriter = nullptr;
+      handler->callback = nullptr;
+      handler->pendingText.clear();
+      handler->pendingTextMemory = jsg::ExternalMemoryAdjustment();
+    }
+    for (auto& rules: builder->registeredRules) {
+      rules->rewriter = nullptr;
+    }
+    if (builder->generation == generation && idle.size() < MAX_IDLE) {
+      idle.add(kj::mv(builder));
+    }
+  }
+
+  void invalidate() {
+    // Called when handlers are added to the HTMLRewriter. The `source` references in existing
+    // Builders may be dangling now, and in any case their handlers are out of date.
+    ++generation;
+    idle.clear();
+  }
+
+private:
+  static constexpr size_t MAX_IDLE = 4;
+  // Enough for a few transforms of the same HTMLRewriter to run at once without building more.
+
+  kj::Vector<kj::Own<Builder>> idle;
+  uint generation = 0;
+};
+
+kj::Own<Rewriter::Builder> Rewriter::buildBuilder(
+    kj::ArrayPtr<UnregisteredElementOrDocumentHandlers> unregisteredHandlers, uint generation) {
+  auto result = kj::heap<Builder>();
+  result->builder = LOL_HTML_OWN(rewriter_builder, lol_html_rewriter_builder_new());
+  result->generation = generation;
+  auto& builder = result->builder;
 
   auto registerCallback = [&](ElementCallbackFunction& callback) {
-        auto registeredHandler = RegisteredHandler{rewriter, callback.addRef(js) };
-        return rewriter.registeredHandlers.add(kj::heap(kj::mv(registeredHandler))).get();
+    auto registeredHandler = RegisteredHandler { .source = callback };
+    return result->registeredHandlers.add(kj::heap(kj::mv(registeredHandler))).get();
   };
 
   for (auto& handlers: unregisteredHandlers) {
     KJ_SWITCH_ONEOF(handlers) {
       KJ_CASE_ONEOF(elementHandlers, UnregisteredElementHandlers) {
+        KJ_IF_MAYBE(rules, elementHandlers.rules) {
+          // Registered separately, and first, so that the rules are applied before the element
+          // handler runs.
+          auto& registeredRules = result->registeredRules.add(
+              kj::heap(RegisteredRules { .rules = kj::addRef(**rules) }));
+          check(lol_html_rewriter_builder_add_element_content_handlers(
+              builder,
+              elementHandlers.selector,
+              &Rewriter::applyRules, registeredRules.get(),
+              nullptr, nullptr,
+              nullptr, nullptr));
+        }
+
         auto element = elementHandlers.element.map(registerCallback);
         auto comments = elementHandlers.comments.map(registerCallback);
         auto text = elementHandlers.text.map(registerCallback);
+        KJ_IF_MAYBE(t, text) {
+          (*t)->textChunkLimit = elementHandlers.textChunkLimit;
+        }
 
-        check(lol_html_rewriter_builder_add_element_content_handlers(
-            builder,
-            elementHandlers.selector,
-            element == nullptr ? nullptr : &Rewriter::thunk<Element>,
-            element.orDefault(nullptr),
-            comments == nullptr ? nullptr : &Rewriter::thunk<Comment>,
-            comments.orDefault(nullptr),
-            text == nullptr ? nullptr : &Rewriter::thunk<Text>,
-            text.orDefault(nullptr)));
+        if (elementHandlers.rules == nullptr ||
+            element != nullptr || comments != nullptr || text != nullptr) {
+          check(lol_html_rewriter_builder_add_element_content_handlers(
+              builder,
+              elementHandlers.selector,
+              element == nullptr ? nullptr : &Rewriter::thunk<Element>,
+              element.orDefault(nullptr),
+              comments == nullptr ? nullptr : &Rewriter::thunk<Comment>,
+              comments.orDefault(nullptr),
+              text == nullptr ? nullptr : &Rewriter::thunk<Text>,
+              text.orDefault(nullptr)));
+        }
       }
       KJ_CASE_ONEOF(documentHandlers, UnregisteredDocumentHandlers) {
         auto doctype = documentHandlers.doctype.map(registerCallback);
         auto comments = documentHandlers.comments.map(registerCallback);
         auto text = documentHandlers.text.map(registerCallback);
         auto end = documentHandlers.end.map(registerCallback);
+        KJ_IF_MAYBE(t, text) {
+          (*t)->textChunkLimit = documentHandlers.textChunkLimit;
+        }
 
         // Adding document content handlers cannot fail, so no need for check().
         lol_html_rewriter_builder_add_document_content_handlers(
@@ -362,6 +613,19 @@ kj::Own<lol_html_HtmlRewriter> Rewriter::buildRewriter(
     }
   }
 
+  return kj::mv(result);
+}
+
+kj::Own<lol_html_HtmlRewriter> Rewriter::buildRewriter(Builder& builder,
+    kj::ArrayPtr<const char> encoding, Rewriter& rewriter,
+    CompatibilityFlags::Reader featureFlags) {
+  for (auto& handler: builder.registeredHandlers) {
+    handler->rewriter = &rewriter;
+  }
+  for (auto& rules: builder.registeredRules) {
+    rules->rewriter = &rewriter;
+  }
+
   // `strict` mode will bail out from tokenization process in cases when
   // there is no way to determine correct parsing context. Recommended
   // setting for safety reasons.
@@ -376,23 +640,35 @@ kj::Own<lol_html_HtmlRewriter> Rewriter::buildRewriter(
 
   if (featureFlags.getEsiIncludeIsVoidTag()) {
     return LOL_HTML_OWN(rewriter, unstable_lol_html_rewriter_build_with_esi_tags(
-        builder, encoding.begin(), encoding.size(), memorySettings, &Rewriter::output, &rewriter, isStrict));
+        builder.builder, encoding.begin(), encoding.size(), memorySettings, &Rewriter::output,
+        &rewriter, isStrict));
 
   } else {
     return LOL_HTML_OWN(rewriter, lol_html_rewriter_build(
-        builder, encoding.begin(), encoding.size(), memorySettings, &Rewriter::output, &rewriter, isStrict));
+        builder.builder, encoding.begin(), encoding.size(), memorySettings, &Rewriter::output,
+        &rewriter, isStrict));
   }
 }
 
 Rewriter::Rewriter(
     jsg::Lock& js,
+    BuilderCache& cache,
     kj::ArrayPtr<UnregisteredElementOrDocumentHandlers> unregisteredHandlers,
     kj::ArrayPtr<const char> encoding,
     kj::Own<WritableStreamSink> inner,
     CompatibilityFlags::Reader featureFlags)
-    : rewriter(buildRewriter(js, unregisteredHandlers, encoding, *this, featureFlags)),
+    : builderCache(kj::addRef(cache)),
+      builder(cache.checkOut(js, unregisteredHandlers)),
+      rewriter(buildRewriter(*builder, encoding, *this, featureFlags)),
       inner(kj::mv(inner)),
-      ioContext(IoContext::current()) {}
+      ioContext(IoContext::current()),
+      memoryCounter(js.getExternalMemory().getCounter("HTMLRewriter")) {}
+
+Rewriter::~Rewriter() noexcept(false) {
+  // The lol-html rewriter must go before the builder it was built from can be reused.
+  rewriter = nullptr;
+  builderCache->checkIn(kj::mv(builder));
+}
 
 // The stack size floor enforced by kj. We could go lower,
 // but it'd always be increased to this anyway.
@@ -490,7 +766,7 @@ kj::Promise<void> Rewriter::finishWrite() {
 template <typename T, typename CType>
 lol_html_rewriter_directive_t Rewriter::thunk(CType* content, void* userdata) {
   auto& registration = *reinterpret_cast<RegisteredHandler*>(userdata);
-  return registration.rewriter.thunkImpl<T>(content, registration);
+  return registration.rewriter->thunkImpl<T>(content, registration);
 }
 
 template <typename T, typename CType>
@@ -502,6 +778,12 @@ lol_html_rewriter_directive_t Rewriter::thunkImpl(
     return LOL_HTML_STOP;
   }
 
+  if constexpr (kj::isSameType<T, Text>()) {
+    if (holdBackTextChunk(*content, registeredHandler)) {
+      return LOL_HTML_CONTINUE;
+    }
+  }
+
   try {
     KJ_IF_MAYBE(exception, kj::runCatchingExceptions([&] {
       // V8 has a thread local pointer that points to where the stack limit is on this thread which
@@ -511,6 +793,10 @@ lol_html_rewriter_directive_t Rewriter::thunkImpl(
       // to keep V8 from getting confused.
       auto promise = kj::evalLater([&] () { return thunkPromise<T>(content, registeredHandler); });
       promise.wait(KJ_ASSERT_NONNULL(maybeWaitScope));
+
+      if constexpr (kj::isSameType<T, Text>()) {
+        finishCoalescedText(*content, registeredHandler);
+      }
     })) {
       // Exception in handler. We need to abort the streaming parser, but can't do so just yet: we
       // need to unwind the stack because we're probably still inside a cool_thing_rewriter_write().
@@ -531,6 +817,63 @@ lol_html_rewriter_directive_t Rewriter::thunkImpl(
   return LOL_HTML_CONTINUE;
 }
 
+lol_html_rewriter_directive_t Rewriter::applyRules(lol_html_element_t* element, void* userdata) {
+  auto& registration = *reinterpret_cast<RegisteredRules*>(userdata);
+  return registration.rewriter->applyRulesImpl(*element, registration);
+}
+
+lol_html_rewriter_directive_t Rewriter::applyRulesImpl(
+    lol_html_element_t& element, RegisteredRules& registration) {
+  // Unlike thunkImpl(), there's no need to leave the fiber or enter the isolate here.
+  if (isPoisoned()) {
+    KJ_LOG(ERROR, "poisoned rewriter should not be able to call handlers");
+    return LOL_HTML_STOP;
+  }
+
+  KJ_IF_MAYBE(exception, kj::runCatchingExceptions([&] {
+    registration.rules->apply(element);
+  })) {
+    // As in thunkImpl(), we can't throw across the Rust/C++ boundary.
+    maybePoison(kj::mv(*exception));
+    return LOL_HTML_STOP;
+  }
+  return LOL_HTML_CONTINUE;
+}
+
+bool Rewriter::holdBackTextChunk(
+    lol_html_text_chunk_t& chunk, RegisteredHandler& registration) {
+  if (registration.textChunkLimit == 0 || lol_html_text_chunk_is_last_in_text_node(&chunk)) {
+    return false;
+  }
+
+  auto content = lol_html_text_chunk_content_get(&chunk);
+  auto& pending = registration.pendingText;
+  if (pending.size() + content.len >= registration.textChunkLimit) {
+    return false;
+  }
+
+  pending.addAll(content.data, content.data + content.len);
+  lol_html_text_chunk_remove(&chunk);
+  if (pending.size() == content.len) {
+    registration.pendingTextMemory =
+        jsg::ExternalMemoryAdjustment(registration.rewriter->memoryCounter);
+  }
+  registration.pendingTextMemory.set(pending.size());
+  return true;
+}
+
+void Rewriter::finishCoalescedText(
+    lol_html_text_chunk_t& chunk, RegisteredHandler& registration) {
+  auto& pending = registration.pendingText;
+  if (pending.size() > 0 && !lol_html_text_chunk_is_removed(&chunk)) {
+    // Chunk content is raw markup, so it goes back as HTML. It goes after anything the handler
+    // inserted before the chunk, which was meant to come before the whole text.
+    check(lol_html_text_chunk_before(&chunk, pending.begin(), pending.size(), true));
+  }
+  pending.clear();
+  registration.pendingTextMemory = jsg::ExternalMemoryAdjustment();
+}
+
 void Rewriter::removeEndTagHandler(RegisteredHandler& handler) {
   auto size = registeredEndTagHandlers.size();
   for (auto counter = size; counter != 0; --counter) {
@@ -551,8 +894,11 @@ kj::Promise<void> Rewriter::thunkPromise( CType* content, RegisteredHandler& reg
   return ioContext.run(
       [this,content,&registeredHandler](Worker::Lock& lock) -> kj::Promise<void> {
     auto jsContent = jsg::alloc<T>(*content, *this);
+    if constexpr (kj::isSameType<T, Text>()) {
+      jsContent->coalescedPrefix = registeredHandler.pendingText.asPtr();
+    }
     auto scope = HTMLRewriter::TokenScope(jsContent);
-    auto value = registeredHandler.callback(lock, kj::mv(jsContent));
+    auto value = KJ_ASSERT_NONNULL(registeredHandler.callback)(lock, kj::mv(jsContent));
 
     if constexpr (kj::isSameType<T, EndTag>()) {
       // TODO(someday): We can't unconditionally pop the top of `registeredEndTagHandlers`,
@@ -568,7 +914,10 @@ kj::Promise<void> Rewriter::thunkPromise( CType* content, RegisteredHandler& reg
 }
 
 void Rewriter::onEndTag(lol_html_element_t *element, ElementCallbackFunction&& callback) {
-  auto registeredHandler = Rewriter::RegisteredHandler { *this, kj::mv(callback) };
+  auto registeredHandler = Rewriter::RegisteredHandler {
+    .rewriter = this,
+    .callback = kj::mv(callback),
+  };
   // NOTE: this gets freed in `thunkPromise` above.
   // TODO(someday): this uses more memory than necessary for implied end tags, which lol-html
   // doesn't actually call `thunk` on.  LOL HTML drops the handler after it finishes transforming
@@ -594,12 +943,15 @@ void Rewriter::outputImpl(const char* buffer, size_t size) {
   }
 
   auto bufferCopy = kj::heapArray(buffer, size);
+  jsg::ExternalMemoryAdjustment memory(memoryCounter, size);
   KJ_IF_MAYBE(wp, writePromise) {
-    *wp = wp->then([this, bufferCopy = kj::mv(bufferCopy)]() mutable {
-      return inner->write(bufferCopy.begin(), bufferCopy.size()).attach(kj::mv(bufferCopy));
+    *wp = wp->then([this, bufferCopy = kj::mv(bufferCopy), memory = kj::mv(memory)]() mutable {
+      return inner->write(bufferCopy.begin(), bufferCopy.size())
+          .attach(kj::mv(bufferCopy), kj::mv(memory));
     });
   } else {
-    writePromise = inner->write(bufferCopy.begin(), bufferCopy.size()).attach(kj::mv(bufferCopy));
+    writePromise = inner->write(bufferCopy.begin(), bufferCopy.size())
+        .attach(kj::mv(bufferCopy), kj::mv(memory));
   }
 }
 
@@ -639,15 +991,13 @@ jsg::Ref<Element::AttributesIterator> Element::getAttributes() {
   return kj::mv(jsIter);
 }
 
-kj::Maybe<kj::String> Element::getAttribute(kj::String name) {
+kj::Maybe<v8::Local<v8::String>> Element::getAttribute(v8::Isolate* isolate, kj::String name) {
   // NOTE: lol_html_element_get_attribute() returns NULL for both nonexistent attributes and for
   //   errors, so we can't use check() here.
   LolString attr(lol_html_element_get_attribute(
       &checkToken(impl).element, name.cStr(), name.size()));
-    // TODO(perf): We could construct a v8::String directly here, saving a copy.
-  kj::Maybe kjAttr = attr.asKjString();
-  if (kjAttr != nullptr) {
-    return kj::mv(kjAttr);
+  if (attr.asChars().begin() != nullptr) {
+    return v8StrFromLol(isolate, attr.asChars());
   }
 
   KJ_IF_MAYBE(exception, tryGetLastError()) {
@@ -868,9 +1218,13 @@ void Comment::htmlContentScopeEnd() {
 
 Text::Text(CType& text, Rewriter&): impl(text) {}
 
-kj::String Text::getText() {
+v8::Local<v8::String> Text::getText(v8::Isolate* isolate) {
   auto content = lol_html_text_chunk_content_get(&checkToken(impl));
-  return kj::heapString(content.data, content.len);
+  auto text = v8StrFromLol(isolate, kj::arrayPtr(content.data, content.len));
+  if (coalescedPrefix.size() > 0) {
+    text = v8::String::Concat(isolate, v8StrFromLol(isolate, coalescedPrefix), text);
+  }
+  return text;
 }
 
 bool Text::getLastInTextNode() {
@@ -921,6 +1275,7 @@ jsg::Ref<Text> Text::remove() {
 
 void Text::htmlContentScopeEnd() {
   impl = nullptr;
+  coalescedPrefix = nullptr;
 }
 
 // =======================================================================================
@@ -972,15 +1327,10 @@ void DocumentEnd::htmlContentScopeEnd() {
 struct HTMLRewriter::Impl {
   kj::Vector<UnregisteredElementOrDocumentHandlers> unregisteredHandlers;
   // The list of handlers added to this builder.
-  //
-  // TODO(perf): It'd be nice to eagerly register handlers on the native builder object. However,
-  //   currently lol-html rewriters are inextricably linked to the builders which created them,
-  //   and this has concurrency and reentrancy ramifications: two rewriters built from the same
-  //   builder require synchronization to access safely, and their callbacks must not use the
-  //   builder which created them, lest the process deadlock.
-  //
-  //   In the meantime, we keep this list of handlers around and "replay" their registration, in
-  //   order, on the builder object that we create inside of .transform().
+
+  kj::Own<Rewriter::BuilderCache> builders = kj::refcounted<Rewriter::BuilderCache>();
+  // Native builders with the above handlers registered, ready for transform() to build rewriters
+  // from. See Rewriter::Builder for why each is only used by one rewriter at a time.
 };
 
 HTMLRewriter::HTMLRewriter(): impl(kj::heap<Impl>()) {}
@@ -990,27 +1340,56 @@ jsg::Ref<HTMLRewriter> HTMLRewriter::constructor() {
   return jsg::alloc<HTMLRewriter>();
 }
 
-jsg::Ref<HTMLRewriter> HTMLRewriter::on(kj::String stringSelector, ElementContentHandlers&& handlers) {
+jsg::Ref<HTMLRewriter> HTMLRewriter::on(
+    kj::String stringSelector, ElementContentHandlers&& handlers) {
+  return onWithOptions(kj::mv(stringSelector), kj::mv(handlers), nullptr);
+}
+
+jsg::Ref<HTMLRewriter> HTMLRewriter::onWithOptions(
+    kj::String stringSelector, ElementContentHandlers&& handlers,
+    jsg::Optional<ElementOptions> options) {
   kj::Own<lol_html_Selector> selector =
       LOL_HTML_OWN(selector, lol_html_selector_parse(stringSelector.cStr(),
                                                          stringSelector.size()));
 
+  kj::Maybe<kj::Own<NativeElementRules>> rules;
+  uint textChunkLimit = 0;
+  KJ_IF_MAYBE(o, options) {
+    KJ_IF_MAYBE(r, o->rules) {
+      rules = NativeElementRules::from(*r);
+    }
+    textChunkLimit = validateTextChunkLimit(o->textChunkLimit);
+  }
+  impl->builders->invalidate();
   impl->unregisteredHandlers.add(UnregisteredElementHandlers {
     kj::mv(selector),
     kj::mv(handlers.element),
     kj::mv(handlers.comments),
-    kj::mv(handlers.text)
+    kj::mv(handlers.text),
+    kj::mv(rules),
+    textChunkLimit
   });
 
   return JSG_THIS;
 }
 
 jsg::Ref<HTMLRewriter> HTMLRewriter::onDocument(DocumentContentHandlers&& handlers) {
+  return onDocumentWithOptions(kj::mv(handlers), nullptr);
+}
+
+jsg::Ref<HTMLRewriter> HTMLRewriter::onDocumentWithOptions(
+    DocumentContentHandlers&& handlers, jsg::Optional<DocumentOptions> options) {
+  uint textChunkLimit = 0;
+  KJ_IF_MAYBE(o, options) {
+    textChunkLimit = validateTextChunkLimit(o->textChunkLimit);
+  }
+  impl->builders->invalidate();
   impl->unregisteredHandlers.add(UnregisteredDocumentHandlers {
     kj::mv(handlers.doctype),
     kj::mv(handlers.comments),
     kj::mv(handlers.text),
-    kj::mv(handlers.end)
+    kj::mv(handlers.end),
+    textChunkLimit
   });
 
   return JSG_THIS;
@@ -1046,7 +1425,7 @@ jsg::Ref<Response> HTMLRewriter::transform(
   }
 
   auto rewriter = kj::heap<Rewriter>(
-      js, impl->unregisteredHandlers, encoding, kj::mv(outputSink), featureFlags);
+      js, *impl->builders, impl->unregisteredHandlers, encoding, kj::mv(outputSink), featureFlags);
 
   // NOTE: Avoid throwing any exceptions after initiating the pump below. This makes
   //   the input response object disturbed (response.bodyUsed === true), which should only happen
@@ -86,6 +86,60 @@ public:
     // Specify parameter types for callback functions
   };
 
+  struct ElementRules {
+    // Declarative rules, applied to every matching element natively, without calling into
+    // JavaScript, so they're much cheaper than an `element` handler that does the same thing.
+    // They're applied in the order listed, before the `element` handler (if any) is called. The
+    // content strings are escaped as text unless `html` is true, like the Element methods of the
+    // same names.
+
+    jsg::Optional<jsg::Dict<kj::String>> setAttribute;
+    jsg::Optional<kj::Array<kj::String>> removeAttribute;
+    jsg::Optional<kj::String> before;
+    jsg::Optional<kj::String> after;
+    jsg::Optional<kj::String> prepend;
+    jsg::Optional<kj::String> append;
+    jsg::Optional<kj::String> setInnerContent;
+    jsg::Optional<kj::String> replaceWith;
+    jsg::Optional<bool> remove;
+    jsg::Optional<bool> removeAndKeepContent;
+    jsg::Optional<bool> html;
+
+    JSG_STRUCT(setAttribute, removeAttribute, before, after, prepend, append, setInnerContent,
+               replaceWith, remove, removeAndKeepContent, html);
+
+    JSG_STRUCT_TS_OVERRIDE(HTMLRewriterElementRules);
+  };
+
+  struct ElementOptions {
+    // The optional third argument of on(). These live apart from the handlers, since the handlers
+    // are often class instances, whose other properties and methods mustn't be mistaken for
+    // options.
+
+    jsg::Optional<ElementRules> rules;
+
+    jsg::Optional<uint32_t> textChunkLimit;
+    // If set, adjacent chunks of a text node are coalesced before the `text` handler is called, so
+    // that it's called once per text node rather than once per chunk, as long as the text node is
+    // no larger than this many bytes. Larger text nodes are delivered in pieces of about this
+    // size. The handler's mutations apply to the whole coalesced text.
+
+    JSG_STRUCT(rules, textChunkLimit);
+
+    JSG_STRUCT_TS_OVERRIDE(HTMLRewriterElementOptions);
+  };
+
+  struct DocumentOptions {
+    // The optional second argument of onDocument().
+
+    jsg::Optional<uint32_t> textChunkLimit;
+    // See ElementOptions::textChunkLimit.
+
+    JSG_STRUCT(textChunkLimit);
+
+    JSG_STRUCT_TS_OVERRIDE(HTMLRewriterDocumentOptions);
+  };
+
   jsg::Ref<HTMLRewriter> on(kj::String selector, ElementContentHandlers&& handlers);
   jsg::Ref<HTMLRewriter> onDocument(DocumentContentHandlers&& handlers);
 
@@ -93,6 +147,13 @@ public:
   // ElementContentHandlers or DocumentContentHandlers struct, respectively. We take it as a
   // v8::Object so that we can use it as the `this` argument for the function calls.
 
+  jsg::Ref<HTMLRewriter> onWithOptions(kj::String selector, ElementContentHandlers&& handlers,
+                                       jsg::Optional<ElementOptions> options);
+  jsg::Ref<HTMLRewriter> onDocumentWithOptions(DocumentContentHandlers&& handlers,
+                                               jsg::Optional<DocumentOptions> options);
+  // on() and onDocument() as exposed with the `html_rewriter_options` compatibility flag, which
+  // adds their `options` argument.
+
   jsg::Ref<Response> transform(jsg::Lock& js, jsg::Ref<Response> response,
       CompatibilityFlags::Reader featureFlags);
   // Create a new Response object that is identical to the input response except that its body is
@@ -103,9 +164,14 @@ public:
   // Pre-condition: the input response body is not disturbed.
   // Post-condition: the input response body is disturbed.
 
-  JSG_RESOURCE_TYPE(HTMLRewriter) {
-    JSG_METHOD(on);
-    JSG_METHOD(onDocument);
+  JSG_RESOURCE_TYPE(HTMLRewriter, CompatibilityFlags::Reader flags) {
+    if (flags.getHtmlRewriterOptions()) {
+      JSG_METHOD_NAMED(on, onWithOptions);
+      JSG_METHOD_NAMED(onDocument, onDocumentWithOptions);
+    } else {
+      JSG_METHOD(on);
+      JSG_METHOD(onDocument);
+    }
     JSG_METHOD(transform);
   }
 
@@ -173,7 +239,7 @@ public:
 
   kj::StringPtr getNamespaceURI();
 
-  kj::Maybe<kj::String> getAttribute(kj::String name);
+  kj::Maybe<v8::Local<v8::String>> getAttribute(v8::Isolate* isolate, kj::String name);
   bool hasAttribute(kj::String name);
   jsg::Ref<Element> setAttribute(kj::String name, kj::String value);
   jsg::Ref<Element> removeAttribute(kj::String name);
@@ -354,7 +420,7 @@ public:
 
   explicit Text(CType& text, Rewriter&);
 
-  kj::String getText();
+  v8::Local<v8::String> getText(v8::Isolate* isolate);
 
   bool getLastInTextNode();
 
@@ -387,7 +453,13 @@ public:
 private:
   kj::Maybe<CType&> impl;
 
+  kj::ArrayPtr<const char> coalescedPrefix;
+  // Text from earlier chunks of the same text node, held by the Rewriter when the handler has a
+  // `textChunkLimit`. Only valid while `impl` is.
+
   void htmlContentScopeEnd() override;
+
+  friend class Rewriter;
 };
 
 class Doctype final: public HTMLRewriter::Token {
@@ -443,6 +515,9 @@ private:
   api::HTMLRewriter,                            \
   api::HTMLRewriter::ElementContentHandlers,    \
   api::HTMLRewriter::DocumentContentHandlers,   \
+  api::HTMLRewriter::ElementRules,              \
+  api::HTMLRewriter::ElementOptions,            \
+  api::HTMLRewriter::DocumentOptions,           \
   api::Doctype,                                 \
   api::Element,                                 \
   api::EndTag,                                  \
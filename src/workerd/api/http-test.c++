@@ -0,0 +1,156 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "http.h"
+#include <workerd/jsg/jsg-test.h>
+
+namespace workerd::api {
+namespace {
+
+jsg::V8System v8System;
+
+struct HeadersContext: public jsg::Object {
+  jsg::Ref<Headers> fromHttpHeaders() {
+    // Duplicates out of order and in different cases, as they might come off the wire.
+    kj::HttpHeaderTable table;
+    kj::HttpHeaders headers(table);
+    headers.add("X-Beta", "1");
+    headers.add("Accept", "text/html");
+    headers.add("x-beta", "2");
+    headers.add("Set-Cookie", "a=1");
+    headers.add("X-Alpha", "3");
+    headers.add("set-cookie", "b=2");
+    return jsg::alloc<Headers>(headers, Headers::Guard::NONE);
+  }
+
+  kj::String serialize(jsg::Ref<Headers> headers) {
+    // Lists the fields we'd send, in order, with the names we'd send them with.
+    kj::HttpHeaderTable table;
+    kj::HttpHeaders out(table);
+    headers->shallowCopyTo(out);
+    kj::Vector<kj::String> fields;
+    out.forEach([&](kj::StringPtr name, kj::StringPtr value) {
+      fields.add(kj::str(name, ": ", value));
+    });
+    return kj::strArray(fields, "|");
+  }
+
+  JSG_RESOURCE_TYPE(HeadersContext) {
+    JSG_NESTED_TYPE(Headers);
+    JSG_METHOD(fromHttpHeaders);
+    JSG_METHOD(serialize);
+  }
+};
+JSG_DECLARE_ISOLATE_TYPE(
+  HeadersIsolate,
+  HeadersContext,
+  api::Headers,
+  api::Headers::EntryIterator,
+  api::Headers::EntryIterator::Next,
+  api::Headers::KeyIterator,
+  api::Headers::KeyIterator::Next,
+  api::Headers::ValueIterator,
+  api::Headers::ValueIterator::Next);
+
+using HeadersEvaluator = jsg::test::Evaluator<HeadersContext, HeadersIsolate,
+    CompatibilityFlags::Reader>;
+
+KJ_TEST("Headers names are case-insensitive") {
+  HeadersEvaluator e(v8System);
+
+  // Well-known names and others.
+  e.expectEval(
+      "const h = new Headers({'Content-Type': 'text/plain', 'X-Custom-Thing': 'a'});\n"
+      "h.append('x-CUSTOM-thing', 'b');\n"
+      "[h.get('content-type'), h.get('CONTENT-TYPE'), h.has('Content-type'),\n"
+      " h.get('X-Custom-Thing'), h.has('x-custom-thing'), h.get('x-custom')].join('|')",
+      "string", "text/plain|text/plain|true|a, b|true|");
+
+  e.expectEval(
+      "const h = new Headers({'Content-Type': 'text/plain', 'X-Custom-Thing': 'a'});\n"
+      "h.delete('CONTENT-type');\n"
+      "h.delete('x-custom-THING');\n"
+      "h.delete('not-there');\n"
+      "[h.has('content-type'), h.has('x-custom-thing'), [...h].length].join('|')",
+      "string", "false|false|0");
+
+  // Keys come out lower-cased and sorted, whatever order they went in.
+  e.expectEval(
+      "const h = new Headers([['X-Zed', '1'], ['accept', '2'], ['X-Alpha', '3'], ['Vary', '4']]);\n"
+      "[...h.keys()].join(',')",
+      "string", "accept,vary,x-alpha,x-zed");
+}
+
+KJ_TEST("Headers keep the first casing seen of each name") {
+  HeadersEvaluator e(v8System);
+
+  e.expectEval(
+      "const h = new Headers();\n"
+      "h.append('X-Foo', '1');\n"
+      "h.append('x-foo', '2');\n"
+      "h.set('X-BAR', '3');\n"
+      "h.set('x-bar', '4');\n"
+      "h.append('Content-Type', 'text/plain');\n"
+      "serialize(h)",
+      "string", "Content-Type: text/plain|X-BAR: 4|X-Foo: 1|X-Foo: 2");
+}
+
+KJ_TEST("Headers getAll() returns each Set-Cookie") {
+  HeadersEvaluator e(v8System);
+
+  e.expectEval(
+      "const h = new Headers();\n"
+      "h.append('Set-Cookie', 'a=1');\n"
+      "h.append('set-cookie', 'b=2, c=3');\n"
+      "const all = h.getAll('SET-COOKIE');\n"
+      "[all.length, all.join('|'), h.get('set-cookie')].join(' ')",
+      "string", "2 a=1|b=2, c=3 a=1, b=2, c=3");
+
+  e.expectEval(
+      "try { new Headers().getAll('x-foo'); 'no error' } catch (e) { e.name }",
+      "string", "TypeError");
+}
+
+KJ_TEST("Headers clones and iterators keep their snapshot") {
+  HeadersEvaluator e(v8System);
+
+  // A copy doesn't see changes to the original, nor the original to the copy.
+  e.expectEval(
+      "const h = new Headers({'a': '1', 'b': '2'});\n"
+      "const copy = new Headers(h);\n"
+      "h.set('a', 'changed');\n"
+      "h.append('c', '3');\n"
+      "copy.delete('b');\n"
+      "[[...h].join(';'), [...copy].join(';')].join(' / ')",
+      "string", "a,changed;b,2;c,3 / a,1");
+
+  // An iterator lists the headers as they were when it was created.
+  e.expectEval(
+      "const h = new Headers({'a': '1', 'b': '2', 'c': '3'});\n"
+      "const it = h.entries();\n"
+      "const first = it.next().value.join('=');\n"
+      "h.delete('b');\n"
+      "h.set('c', 'changed');\n"
+      "h.append('d', '4');\n"
+      "const rest = [];\n"
+      "for (let r = it.next(); !r.done; r = it.next()) rest.push(r.value.join('='));\n"
+      "[first, rest.join(','), [...h.keys()].join(',')].join(' ')",
+      "string", "a=1 b=2,c=3 a,c,d");
+}
+
+KJ_TEST("Headers from kj::HttpHeaders merge duplicates in order") {
+  HeadersEvaluator e(v8System);
+
+  e.expectEval(
+      "const h = fromHttpHeaders();\n"
+      "[[...h].map(e => e.join('=')).join(','), h.getAll('set-cookie').join(';')].join(' ')",
+      "string", "accept=text/html,set-cookie=a=1, b=2,x-alpha=3,x-beta=1, 2 a=1;b=2");
+
+  e.expectEval(
+      "serialize(fromHttpHeaders())",
+      "string", "Accept: text/html|Set-Cookie: a=1|Set-Cookie: b=2|X-Alpha: 3|X-Beta: 1|X-Beta: 2");
+}
+
+}  // namespace
+}  // namespace workerd::api
@@ -12,6 +12,7 @@
 #include <workerd/util/http-util.h>
 #include <workerd/jsg/ser.h>
 #include <workerd/io/io-context.h>
+#include <algorithm>
 #include <set>
 
 namespace workerd::api {
@@ -106,33 +107,112 @@ void requireValidHeaderValue(kj::StringPtr value) {
 
 }  // namespace
 
+namespace {
+
+constexpr kj::StringPtr WELL_KNOWN_HEADER_KEYS[] = {
+  // Lower-cased names of headers common enough that we don't allocate a separate key for them.
+  // Includes the names registered in ThreadContext::HeaderIdBundle. Must stay sorted.
+  "accept"_kj, "accept-encoding"_kj, "accept-language"_kj, "accept-ranges"_kj,
+  "access-control-allow-origin"_kj, "age"_kj, "authorization"_kj, "cache-control"_kj,
+  "cf-cache-namespace"_kj, "cf-cache-status"_kj, "cf-connecting-ip"_kj, "cf-kv-metadata"_kj,
+  "cf-r2-error"_kj, "cf-r2-metadata-size"_kj, "cf-r2-request"_kj, "cf-ray"_kj,
+  "connection"_kj, "content-disposition"_kj, "content-encoding"_kj, "content-language"_kj,
+  "content-length"_kj, "content-range"_kj, "content-type"_kj, "cookie"_kj, "date"_kj,
+  "etag"_kj, "expires"_kj, "host"_kj, "if-match"_kj, "if-modified-since"_kj,
+  "if-none-match"_kj, "if-range"_kj, "if-unmodified-since"_kj, "keep-alive"_kj,
+  "last-modified"_kj, "location"_kj, "origin"_kj, "range"_kj, "referer"_kj,
+  "sec-websocket-accept"_kj, "sec-websocket-extensions"_kj, "sec-websocket-key"_kj,
+  "sec-websocket-protocol"_kj, "sec-websocket-version"_kj, "server"_kj, "set-cookie"_kj,
+  "te"_kj, "trailer"_kj, "transfer-encoding"_kj, "upgrade"_kj, "user-agent"_kj, "vary"_kj,
+  "via"_kj, "x-forwarded-for"_kj, "x-forwarded-proto"_kj, "x-real-ip"_kj,
+};
+
+int compareHeaderKey(kj::StringPtr key, kj::StringPtr name) {
+  // Compares the lower-cased `key` with `name` in any case, ordered as if `name` were lower-cased
+  // too. This lets us look up headers without allocating a lower-cased copy of the name.
+
+  auto lower = [](char c) -> kj::byte { return 'A' <= c && c <= 'Z' ? c - 'A' + 'a' : c; };
+  size_t n = kj::min(key.size(), name.size());
+  for (size_t i = 0; i < n; i++) {
+    kj::byte a = key[i];
+    kj::byte b = lower(name[i]);
+    if (a != b) return a < b ? -1 : 1;
+  }
+  return key.size() < name.size() ? -1 : key.size() > name.size() ? 1 : 0;
+}
+
+kj::Maybe<kj::StringPtr> findWellKnownHeaderKey(kj::StringPtr name) {
+  auto iter = std::lower_bound(kj::begin(WELL_KNOWN_HEADER_KEYS), kj::end(WELL_KNOWN_HEADER_KEYS),
+      name, [](kj::StringPtr key, kj::StringPtr name) { return compareHeaderKey(key, name) < 0; });
+  if (iter != kj::end(WELL_KNOWN_HEADER_KEYS) && compareHeaderKey(*iter, name) == 0) {
+    return *iter;
+  }
+  return nullptr;
+}
+
+template <typename Headers>
+auto lowerBoundHeader(Headers& headers, kj::StringPtr name) {
+  return std::lower_bound(headers.begin(), headers.end(), name,
+      [](const auto& header, kj::StringPtr name) {
+    return compareHeaderKey(header.key, name) < 0;
+  });
+}
+
+}  // namespace
+
+Headers::Header::Header(jsg::ByteString nameParam, jsg::ByteString value)
+    : name(kj::mv(nameParam)), values(1) {
+  KJ_IF_MAYBE(wellKnown, findWellKnownHeaderKey(name)) {
+    key = *wellKnown;
+  } else {
+    key = ownedKey.emplace(toLower(kj::str(name)));
+  }
+  values.add(kj::mv(value));
+}
+
+Headers::Header Headers::Header::clone() const {
+  Header result(jsg::ByteString(kj::str(name)), jsg::ByteString(kj::str(values[0])));
+  for (auto& value: values.slice(1, values.size())) {
+    result.values.add(jsg::ByteString(kj::str(value)));
+  }
+  return result;
+}
+
+Headers::Headers(): guard(Guard::NONE), list(kj::refcounted<HeaderList>()) {}
+
 Headers::Headers(jsg::Dict<jsg::ByteString, jsg::ByteString> dict)
-    : guard(Guard::NONE) {
+    : Headers() {
   for (auto& field: dict.fields) {
     append(kj::mv(field.name), kj::mv(field.value));
   }
 }
 
 Headers::Headers(const Headers& other)
-    : guard(Guard::NONE) {
-  for (auto& header: other.headers) {
-    Header copy {
-      jsg::ByteString(kj::str(header.second.key)),
-      jsg::ByteString(kj::str(header.second.name)),
-      KJ_MAP(value, header.second.values) { return jsg::ByteString(kj::str(value)); },
-    };
-    kj::StringPtr keyRef = copy.key;
-    KJ_ASSERT(headers.insert(std::make_pair(keyRef, kj::mv(copy))).second);
-  }
-}
+    : guard(Guard::NONE),
+      // Sharing is safe even though `other` is const, since neither side modifies a shared list.
+      list(kj::addRef(const_cast<HeaderList&>(*other.list))) {}
 
 Headers::Headers(const kj::HttpHeaders& other, Guard guard)
-    : guard(Guard::NONE) {
-  other.forEach([this](auto name, auto value) {
-    append(jsg::ByteString(kj::str(name)), jsg::ByteString(kj::str(value)));
+    : guard(guard), list(kj::refcounted<HeaderList>()) {
+  // Collect every field and then sort, rather than inserting one at a time. Since the sort is
+  // stable, duplicates stay in the order they were received and we can merge them in one pass.
+  std::vector<Header> fields;
+  other.forEach([&](kj::StringPtr name, kj::StringPtr value) {
+    fields.emplace_back(jsg::ByteString(kj::str(name)), jsg::ByteString(kj::str(value)));
+  });
+  std::stable_sort(fields.begin(), fields.end(), [](const Header& a, const Header& b) {
+    return a.key < b.key;
   });
 
-  this->guard = guard;
+  auto& headers = list->headers;
+  headers.reserve(fields.size());
+  for (auto& field: fields) {
+    if (!headers.empty() && headers.back().key == field.key) {
+      headers.back().values.add(kj::mv(field.values[0]));
+    } else {
+      headers.push_back(kj::mv(field));
+    }
+  }
 }
 
 jsg::Ref<Headers> Headers::clone() const {
@@ -141,13 +221,30 @@ jsg::Ref<Headers> Headers::clone() const {
   return kj::mv(result);
 }
 
-void Headers::shallowCopyTo(kj::HttpHeaders& out) {
-  // Fill in the given HttpHeaders with these headers. Note that strings are inserted by
-  // reference, so the output must be consumed immediately.
+Headers::HeaderList& Headers::mutableList() {
+  if (list->isShared()) {
+    auto copy = kj::refcounted<HeaderList>();
+    copy->headers.reserve(list->headers.size());
+    for (auto& header: list->headers) {
+      copy->headers.push_back(header.clone());
+    }
+    list = kj::mv(copy);
+  }
+  return *list;
+}
 
-  for (auto& entry: headers) {
-    for (auto& value: entry.second.values) {
-      out.add(entry.second.name, value);
+kj::Maybe<Headers::Header&> Headers::find(kj::StringPtr name) {
+  auto iter = lowerBoundHeader(list->headers, name);
+  if (iter != list->headers.end() && compareHeaderKey(iter->key, name) == 0) {
+    return *iter;
+  }
+  return nullptr;
+}
+
+void Headers::shallowCopyTo(kj::HttpHeaders& out) {
+  for (auto& header: list->headers) {
+    for (auto& value: header.values) {
+      out.add(header.name, value);
     }
   }
 }
@@ -158,18 +255,16 @@ bool Headers::hasLowerCase(kj::StringPtr name) {
     KJ_DREQUIRE(!('A' <= c && c <= 'Z'));
   }
 #endif
-  return headers.find(name) != headers.end();
+  return find(name) != nullptr;
 }
 
 kj::Array<Headers::DisplayedHeader> Headers::getDisplayedHeaders() {
-  auto headersCopy = KJ_MAP(mapEntry, headers) {
-    const auto& header = mapEntry.second;
+  return KJ_MAP(header, list->headers) {
     return DisplayedHeader {
       jsg::ByteString(kj::str(header.key)),
       jsg::ByteString(kj::strArray(header.values, ", "))
     };
   };
-  return headersCopy;
 }
 
 jsg::Ref<Headers> Headers::constructor(jsg::Lock& js, jsg::Optional<Initializer> init) {
@@ -219,12 +314,9 @@ jsg::Ref<Headers> Headers::constructor(jsg::Lock& js, jsg::Optional<Initializer>
 
 kj::Maybe<jsg::ByteString> Headers::get(jsg::ByteString name) {
   requireValidHeaderName(name);
-  auto iter = headers.find(toLower(kj::mv(name)));
-  if (iter == headers.end()) {
-    return nullptr;
-  } else {
-    return jsg::ByteString(kj::strArray(iter->second.values, ", "));
-  }
+  return find(name).map([](Header& header) {
+    return jsg::ByteString(kj::strArray(header.values, ", "));
+  });
 }
 
 kj::ArrayPtr<jsg::ByteString> Headers::getAll(jsg::ByteString name) {
@@ -234,90 +326,101 @@ kj::ArrayPtr<jsg::ByteString> Headers::getAll(jsg::ByteString name) {
     JSG_FAIL_REQUIRE(TypeError, "getAll() can only be used with the header name \"Set-Cookie\".");
   }
 
-  auto iter = headers.find(toLower(kj::mv(name)));
-  if (iter == headers.end()) {
-    return nullptr;
+  KJ_IF_MAYBE(header, find(name)) {
+    return header->values.asPtr();
   } else {
-    return iter->second.values.asPtr();
+    return nullptr;
   }
 }
 
 bool Headers::has(jsg::ByteString name) {
   requireValidHeaderName(name);
-  return headers.find(toLower(kj::mv(name))) != headers.end();
+  return find(name) != nullptr;
 }
 
 void Headers::set(jsg::ByteString name, jsg::ByteString value) {
   checkGuard();
   requireValidHeaderName(name);
-  auto key = toLower(name);
   value = normalizeHeaderValue(kj::mv(value));
   requireValidHeaderValue(value);
-  auto [iter, emplaced] = headers.try_emplace(key, kj::mv(key), kj::mv(name), kj::mv(value));
-  if (!emplaced) {
+
+  auto& headers = mutableList().headers;
+  auto iter = lowerBoundHeader(headers, name);
+  if (iter != headers.end() && compareHeaderKey(iter->key, name) == 0) {
     // Overwrite existing value(s).
-    iter->second.values.clear();
-    iter->second.values.add(kj::mv(value));
+    iter->values.clear();
+    iter->values.add(kj::mv(value));
+  } else {
+    headers.emplace(iter, kj::mv(name), kj::mv(value));
   }
 }
 
 void Headers::append(jsg::ByteString name, jsg::ByteString value) {
   checkGuard();
   requireValidHeaderName(name);
-  auto key = toLower(name);
   value = normalizeHeaderValue(kj::mv(value));
   requireValidHeaderValue(value);
-  auto [iter, emplaced] = headers.try_emplace(key, kj::mv(key), kj::mv(name), kj::mv(value));
-  if (!emplaced) {
-    iter->second.values.add(kj::mv(value));
+
+  auto& headers = mutableList().headers;
+  auto iter = lowerBoundHeader(headers, name);
+  if (iter != headers.end() && compareHeaderKey(iter->key, name) == 0) {
+    iter->values.add(kj::mv(value));
+  } else {
+    headers.emplace(iter, kj::mv(name), kj::mv(value));
   }
 }
 
 void Headers::delete_(jsg::ByteString name) {
   checkGuard();
   requireValidHeaderName(name);
-  headers.erase(toLower(kj::mv(name)));
+  if (find(name) == nullptr) return;
+
+  auto& headers = mutableList().headers;
+  headers.erase(lowerBoundHeader(headers, name));
 }
 
 // There are a couple implementation details of the Headers iterators worth calling out.
 //
-// 1. Each iterator gets its own copy of the keys and/or values of the headers. While nauseating
-//    from a performance perspective, this solves both the iterator -> iterable lifetime dependence
-//    and the iterator invalidation issue: i.e., it's impossible for a user to unsafely modify the
-//    Headers data structure while iterating over it, because they are simply two separate data
-//    structures. By empirical testing, this seems to be how Chrome implements Headers iteration.
-//
-//    Other alternatives bring their own pitfalls. We could store a Ref of the parent Headers
-//    object, solving the lifetime issue. To solve the iterator invalidation issue, we could store a
-//    copy of the currently-iterated-over key and use std::upper_bound() to find the next entry
-//    every time we want to increment the iterator (making the increment operation O(lg n) rather
-//    than O(1)); or we could make each Header entry in the map store a set of back-pointers to all
-//    live iterators pointing to it, with delete_() incrementing all iterators in the set whenever
-//    it deletes a header entry. Neither hack appealed to me.
-//
-// 2. Notice that the next() member function of the iterator classes moves the string(s) they
-//    contain, rather than making a copy of them as in the FormData iterators. This is safe to do
-//    because, unlike FormData, these iterators have their own copies of the strings, and since they
-//    are forward-only iterators, we know we won't need the strings again.
+// 1. Each iterator holds a reference to the header list as it was when the iterator was created.
+//    The list is copy-on-write: if the Headers object is modified while an iterator is live, the
+//    Headers object makes its own copy first. This solves both the iterator -> iterable lifetime
+//    dependence and the iterator invalidation issue: i.e., it's impossible for a user to unsafely
+//    modify the list while iterating over it. By empirical testing, iterating over a snapshot
+//    seems to be how Chrome implements Headers iteration, too.
 //
-// TODO(perf): On point 1, perhaps we could avoid most copies by using a copy-on-write strategy
-//   applied to the header map elements? We'd still copy the whole data structure to avoid iterator
-//   invalidation, but the elements would be cheaper to copy.
+// 2. The strings returned by next() are built on demand, so an iterator that is abandoned early
+//    (e.g. a `for...of` loop that breaks once it finds what it wants) doesn't pay for the rest.
 
 jsg::Ref<Headers::EntryIterator> Headers::entries(jsg::Lock&) {
-  return jsg::alloc<EntryIterator>(IteratorState<DisplayedHeader> { getDisplayedHeaders() });
+  return jsg::alloc<EntryIterator>(IteratorState { kj::addRef(*list) });
 }
 jsg::Ref<Headers::KeyIterator> Headers::keys(jsg::Lock&) {
-  auto keysCopy = KJ_MAP(mapEntry, headers) {
-    return jsg::ByteString(kj::str(mapEntry.second.key));
-  };
-  return jsg::alloc<KeyIterator>(IteratorState<jsg::ByteString> { kj::mv(keysCopy) });
+  return jsg::alloc<KeyIterator>(IteratorState { kj::addRef(*list) });
 }
 jsg::Ref<Headers::ValueIterator> Headers::values(jsg::Lock&) {
-  auto valuesCopy = KJ_MAP(mapEntry, headers) {
-    return jsg::ByteString(kj::strArray(mapEntry.second.values, ", "));
-  };
-  return jsg::alloc<ValueIterator>(IteratorState<jsg::ByteString> { kj::mv(valuesCopy) });
+  return jsg::alloc<ValueIterator>(IteratorState { kj::addRef(*list) });
+}
+
+kj::Maybe<Headers::EntryIteratorType> Headers::entryIteratorNext(
+    jsg::Lock& js, IteratorState& state) {
+  if (state.index >= state.list->headers.size()) return nullptr;
+  auto& header = state.list->headers[state.index++];
+  return kj::arr(jsg::ByteString(kj::str(header.key)),
+                 jsg::ByteString(kj::strArray(header.values, ", ")));
+}
+
+kj::Maybe<Headers::KeyIteratorType> Headers::keyIteratorNext(
+    jsg::Lock& js, IteratorState& state) {
+  if (state.index >= state.list->headers.size()) return nullptr;
+  auto& header = state.list->headers[state.index++];
+  return jsg::ByteString(kj::str(header.key));
+}
+
+kj::Maybe<Headers::ValueIteratorType> Headers::valueIteratorNext(
+    jsg::Lock& js, IteratorState& state) {
+  if (state.index >= state.list->headers.size()) return nullptr;
+  auto& header = state.list->headers[state.index++];
+  return jsg::ByteString(kj::strArray(header.values, ", "));
 }
 
 void Headers::forEach(
@@ -394,6 +497,53 @@ private:
   kj::OneOf<kj::Own<Body::RefcountedBytes>, jsg::Ref<Blob>> ownBytes;
 };
 
+class MultipartSink final: public WritableStreamSink, public kj::Refcounted {
+  // Parses a multipart/form-data body as it's pumped in, so that Body::formData() doesn't have to
+  // buffer the whole body before parsing it.
+
+public:
+  MultipartSink(kj::ArrayPtr<const char> boundary, uint64_t limit)
+      : parser(boundary), limit(limit) {}
+
+  kj::Promise<void> write(const void* buffer, size_t size) override {
+    return kj::evalNow([&]() {
+      feed(kj::arrayPtr(reinterpret_cast<const byte*>(buffer), size));
+    });
+  }
+
+  kj::Promise<void> write(kj::ArrayPtr<const kj::ArrayPtr<const byte>> pieces) override {
+    return kj::evalNow([&]() {
+      for (auto piece: pieces) {
+        feed(piece);
+      }
+    });
+  }
+
+  kj::Promise<void> end() override {
+    return kj::evalNow([&]() {
+      parts = parser.finish();
+    });
+  }
+
+  void abort(kj::Exception reason) override {}
+
+  kj::Array<MultipartParser::Part> takeParts() {
+    return kj::mv(KJ_ASSERT_NONNULL(parts, "body was not ended"));
+  }
+
+private:
+  MultipartParser parser;
+  uint64_t limit;
+  uint64_t received = 0;
+  kj::Maybe<kj::Array<MultipartParser::Part>> parts;
+
+  void feed(kj::ArrayPtr<const byte> bytes) {
+    received += bytes.size();
+    JSG_REQUIRE(received < limit, TypeError, "Memory limit exceeded before EOF.");
+    parser.feed(bytes);
+  }
+};
+
 }  // namespace
 
 kj::String makeRandomBoundaryCharacters() {
@@ -616,8 +766,24 @@ jsg::Promise<jsg::Ref<FormData>> Body::formData(
     KJ_IF_MAYBE(i, impl) {
       KJ_ASSERT(!i->stream->isDisturbed());
       auto& context = IoContext::current();
-      return i->stream->getController().readAllText(js,
-          context.getLimitEnforcer().getBufferingLimit()).then(js,
+      auto limit = context.getLimitEnforcer().getBufferingLimit();
+
+      KJ_IF_MAYBE(boundary, FormData::getMultipartBoundary(contentType)) {
+        // Parse multipart bodies as they arrive, so that an upload is never held in memory both
+        // as a body and as the parts parsed from it.
+        auto sink = kj::refcounted<MultipartSink>(*boundary, limit);
+        auto pump = i->stream->pumpTo(js, kj::addRef(*sink), true);
+        auto parsed = context.waitForDeferredProxy(kj::mv(pump))
+            .then([sink = kj::mv(sink)]() mutable { return sink->takeParts(); });
+        return context.awaitIo(js, kj::mv(parsed)).then(js,
+            [formData = kj::mv(formData), featureFlags]
+            (auto& js, kj::Array<MultipartParser::Part> parts) mutable {
+          formData->addParts(kj::mv(parts), !featureFlags.getFormDataParserSupportsFiles());
+          return kj::mv(formData);
+        });
+      }
+
+      return i->stream->getController().readAllText(js, limit).then(js,
           [contentType = kj::mv(contentType), formData = kj::mv(formData), featureFlags]
           (auto& js, kj::String rawText) mutable {
         formData->parse(kj::mv(rawText), contentType,
@@ -687,6 +853,7 @@ jsg::Ref<Request> Request::constructor(
   kj::Maybe<jsg::Ref<Fetcher>> fetcher;
   kj::Maybe<jsg::Ref<AbortSignal>> signal;
   kj::Maybe<jsg::V8Ref<v8::Object>> cf;
+  kj::Maybe<CfBlobJson> cfBlobJson;
   kj::Maybe<Body::ExtractedBody> body;
   Redirect redirect = Redirect::FOLLOW;
 
@@ -724,9 +891,7 @@ jsg::Ref<Request> Request::constructor(
       url = kj::str(oldRequest->getUrl());
       method = oldRequest->method;
       headers = jsg::alloc<Headers>(*oldRequest->headers);
-      KJ_IF_MAYBE(oldCf, oldRequest->getCf(js)) {
-        cf = js.v8Ref(*oldCf).deepClone(js);
-      }
+      oldRequest->cloneCfTo(js, cf, cfBlobJson);
       if (!ignoreInputBody) {
         JSG_REQUIRE(!oldRequest->getBodyUsed(),
             TypeError, "Cannot reconstruct a Request with a used body.");
@@ -792,6 +957,7 @@ jsg::Ref<Request> Request::constructor(
 
         KJ_IF_MAYBE(c, initDict.cf) {
           cf = c->deepClone(js);
+          cfBlobJson = nullptr;
         }
 
         KJ_IF_MAYBE(b, kj::mv(initDict.body).orDefault(nullptr)) {
@@ -824,9 +990,7 @@ jsg::Ref<Request> Request::constructor(
         fetcher = otherRequest->getFetcher();
         signal = otherRequest->getSignal();
         headers = jsg::alloc<Headers>(*otherRequest->headers);
-        KJ_IF_MAYBE(otherCf, otherRequest->cf) {
-          cf = otherCf->deepClone(js);
-        }
+        otherRequest->cloneCfTo(js, cf, cfBlobJson);
         KJ_IF_MAYBE(b, otherRequest->getBody()) {
           // Note that unlike when `input` (Request ctor's 1st parameter) is a Request object, here
           // we're NOT stealing the other request's body, because we're supposed to pretend that the
@@ -844,21 +1008,33 @@ jsg::Ref<Request> Request::constructor(
   // TODO(conform): If `init` has a keepalive flag, pass it to the Body constructor.
   return jsg::alloc<Request>(method, url, redirect,
                  KJ_ASSERT_NONNULL(kj::mv(headers)), kj::mv(fetcher), kj::mv(signal),
-                 kj::mv(cf), kj::mv(body));
+                 kj::mv(cf), kj::mv(body), kj::mv(cfBlobJson));
 }
 
 jsg::Ref<Request> Request::clone(jsg::Lock& js) {
   auto headersClone = headers->clone();
 
-  auto cfClone = cf.map([&](jsg::V8Ref<v8::Object>& obj) {
-    return obj.deepClone(js);
-  });
+  kj::Maybe<jsg::V8Ref<v8::Object>> cfClone;
+  kj::Maybe<CfBlobJson> cfBlobJsonClone;
+  cloneCfTo(js, cfClone, cfBlobJsonClone);
 
   auto bodyClone = Body::clone(js);
 
   return jsg::alloc<Request>(
       method, url, redirect, kj::mv(headersClone), getFetcher(), getSignal(),
-      kj::mv(cfClone), kj::mv(bodyClone));
+      kj::mv(cfClone), kj::mv(bodyClone), kj::mv(cfBlobJsonClone));
+}
+
+void Request::cloneCfTo(jsg::Lock& js, kj::Maybe<jsg::V8Ref<v8::Object>>& cfOut,
+                        kj::Maybe<CfBlobJson>& cfBlobJsonOut) {
+  cfOut = nullptr;
+  cfBlobJsonOut = nullptr;
+  KJ_IF_MAYBE(j, cfBlobJson) {
+    // A deep clone of `cf` is never frozen, so the copy is parsed unfrozen when it's first read.
+    cfBlobJsonOut = CfBlobJson { kj::str(j->json), false };
+  } else KJ_IF_MAYBE(c, cf) {
+    cfOut = c->deepClone(js);
+  }
 }
 
 kj::StringPtr Request::getMethod() {
@@ -889,6 +1065,21 @@ kj::Maybe<jsg::Ref<AbortSignal>> Request::getSignal() {
 }
 
 jsg::Optional<v8::Local<v8::Object>> Request::getCf(jsg::Lock& js) {
+  if (cf == nullptr) {
+    KJ_IF_MAYBE(j, cfBlobJson) {
+      auto context = js.v8Isolate->GetCurrentContext();
+      auto handle = jsg::check(v8::JSON::Parse(context, jsg::v8Str(js.v8Isolate, j->json)));
+      KJ_ASSERT(handle->IsObject());
+      if (j->frozen) {
+        jsg::recursivelyFreeze(context, handle);
+      } else {
+        // Script may modify `cf` from now on, so the JSON no longer necessarily matches it.
+        cfBlobJson = nullptr;
+      }
+      cf = js.v8Ref(handle.As<v8::Object>());
+    }
+  }
+
   return cf.map([&](jsg::V8Ref<v8::Object>& handle) {
     return handle.getHandle(js);
   });
@@ -929,6 +1120,9 @@ void Request::shallowCopyHeadersTo(kj::HttpHeaders& out) {
 }
 
 kj::Maybe<kj::String> Request::serializeCfBlobJson(jsg::Lock& js) {
+  KJ_IF_MAYBE(j, cfBlobJson) {
+    return kj::str(j->json);
+  }
   return cf.map([&](jsg::V8Ref<v8::Object>& obj) {
     return js.serializeJson(obj);
   });
@@ -1790,7 +1984,7 @@ jsg::Promise<jsg::Ref<Response>> fetchImpl(
 jsg::Ref<Socket> Fetcher::connect(
     jsg::Lock& js, kj::String address, jsg::Optional<SocketOptions> options,
     CompatibilityFlags::Reader featureFlags) {
-  return connectImpl(js, JSG_THIS, kj::mv(address), featureFlags);
+  return connectImpl(js, JSG_THIS, kj::mv(address), kj::mv(options), featureFlags);
 }
 
 jsg::Promise<jsg::Ref<Response>> Fetcher::fetch(
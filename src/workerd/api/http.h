@@ -7,7 +7,7 @@
 #include <workerd/jsg/jsg.h>
 #include <workerd/util/abortable.h>
 #include <kj/compat/http.h>
-#include <map>
+#include <vector>
 #include "basics.h"
 #include "streams.h"
 #include "form-data.h"
@@ -24,10 +24,13 @@ private:
   using KeyIteratorType = jsg::ByteString;
   using ValueIteratorType = jsg::ByteString;
 
-  template <typename T>
+  struct HeaderList;
+
   struct IteratorState {
-    kj::Array<T> copy;
-    decltype(copy.begin()) cursor = copy.begin();
+    kj::Own<HeaderList> list;
+    size_t index = 0;
+    // Iterators share the list they were created from. A Headers object that is modified while
+    // an iterator is live copies the list first, so the iterator keeps seeing a snapshot.
   };
 
 public:
@@ -44,9 +47,10 @@ public:
     jsg::ByteString value; // comma-concatenation of all values seen
   };
 
-  Headers(): guard(Guard::NONE) {}
+  Headers();
   explicit Headers(jsg::Dict<jsg::ByteString, jsg::ByteString> dict);
   explicit Headers(const Headers& other);
+  // Shares `other`'s header list, copying it only if either object is later modified.
   explicit Headers(const kj::HttpHeaders& other, Guard guard);
 
   Headers(Headers&&) = delete;
@@ -97,16 +101,16 @@ public:
 
   JSG_ITERATOR(EntryIterator, entries,
                 EntryIteratorType,
-                IteratorState<DisplayedHeader>,
-                iteratorNext<EntryIteratorType>)
+                IteratorState,
+                entryIteratorNext)
   JSG_ITERATOR(KeyIterator, keys,
                 KeyIteratorType,
-                IteratorState<jsg::ByteString>,
-                iteratorNext<KeyIteratorType>)
+                IteratorState,
+                keyIteratorNext)
   JSG_ITERATOR(ValueIterator, values,
                 ValueIteratorType,
-                IteratorState<jsg::ByteString>,
-                iteratorNext<KeyIteratorType>)
+                IteratorState,
+                valueIteratorNext)
 
   // JavaScript API.
 
@@ -140,52 +144,54 @@ public:
 
 private:
   struct Header {
-    jsg::ByteString key;   // lower-cased name
+    kj::StringPtr key;
+    // Lower-cased name. For well-known headers this points at a static string, otherwise at
+    // `ownedKey`.
+    kj::Maybe<kj::String> ownedKey;
+
     jsg::ByteString name;
     kj::Vector<jsg::ByteString> values;
     // We intentionally do not comma-concatenate header values of the same name, as we need to be
     // able to re-serialize them separately. This is particularly important for the Set-Cookie
     // header, which uses a date format that requires a comma. This would normally suggest using a
-    // std::multimap, but we also need to be able to display the values in comma-concatenated form
-    // via Headers.entries()[1] in order to be Fetch-conformant. Storing a vector of strings in a
-    // std::map makes this easier, and also makes it easy to honor the "first header name casing is
+    // multimap, but we also need to be able to display the values in comma-concatenated form
+    // via Headers.entries()[1] in order to be Fetch-conformant. Storing a vector of strings per
+    // name makes this easier, and also makes it easy to honor the "first header name casing is
     // used for all duplicate header names" rule[2] that the Fetch spec mandates.
     //
     // See: 1: https://fetch.spec.whatwg.org/#concept-header-list-sort-and-combine
     //      2: https://fetch.spec.whatwg.org/#concept-header-list-append
 
-    explicit Header(jsg::ByteString key, jsg::ByteString name,
-                    kj::Vector<jsg::ByteString> values)
-        : key(kj::mv(key)), name(kj::mv(name)), values(kj::mv(values)) {}
-    explicit Header(jsg::ByteString key, jsg::ByteString name, jsg::ByteString value)
-        : key(kj::mv(key)), name(kj::mv(name)), values(1) {
-      values.add(kj::mv(value));
-    }
+    explicit Header(jsg::ByteString name, jsg::ByteString value);
+    Header(Header&&) = default;
+    Header& operator=(Header&&) = default;
+
+    Header clone() const;
+  };
+
+  struct HeaderList: public kj::Refcounted {
+    std::vector<Header> headers;
+    // Sorted by `key`. Header lists are small, so a flat vector beats a tree for both lookups and
+    // iteration.
   };
 
   Guard guard;
-  std::map<kj::StringPtr, Header> headers;
+  kj::Own<HeaderList> list;
+  // Shared copy-on-write with clones and iterators. Call mutableList() before modifying it.
 
   void checkGuard() {
     JSG_REQUIRE(guard == Guard::NONE, TypeError, "Can't modify immutable headers.");
   }
 
-  template <typename Type>
-  static kj::Maybe<Type> iteratorNext(jsg::Lock& js, auto& state) {
-    if (state.cursor == state.copy.end()) {
-      return nullptr;
-    }
-    auto& ret = *state.cursor++;
-    if constexpr (kj::isSameType<Type, EntryIteratorType>()) {
-      return kj::arr(kj::mv(ret.key), kj::mv(ret.value));
-    } else if constexpr (kj::isSameType<Type, KeyIteratorType>()) {
-      return kj::mv(ret);
-    } else if constexpr (kj::isSameType<Type, ValueIteratorType>()) {
-      return kj::mv(ret);
-    } else {
-      KJ_UNREACHABLE;
-    }
-  }
+  HeaderList& mutableList();
+  // Returns `list`, first copying it if anyone else shares it.
+
+  kj::Maybe<Header&> find(kj::StringPtr name);
+  // Finds the header named `name`, compared case-insensitively.
+
+  static kj::Maybe<EntryIteratorType> entryIteratorNext(jsg::Lock& js, IteratorState& state);
+  static kj::Maybe<KeyIteratorType> keyIteratorNext(jsg::Lock& js, IteratorState& state);
+  static kj::Maybe<ValueIteratorType> valueIteratorNext(jsg::Lock& js, IteratorState& state);
 };
 
 class Body: public jsg::Object {
@@ -564,13 +570,19 @@ public:
   };
   static kj::Maybe<Redirect> tryParseRedirect(kj::StringPtr redirect);
 
+  struct CfBlobJson {
+    kj::String json;
+    bool frozen;
+    // Whether `cf` should be frozen when it is parsed from `json`, as it is for inbound requests.
+  };
+
   Request(kj::HttpMethod method, kj::StringPtr url, Redirect redirect,
           jsg::Ref<Headers> headers, kj::Maybe<jsg::Ref<Fetcher>> fetcher,
           kj::Maybe<jsg::Ref<AbortSignal>> signal, kj::Maybe<jsg::V8Ref<v8::Object>> cf,
-          kj::Maybe<Body::ExtractedBody> body)
+          kj::Maybe<Body::ExtractedBody> body, kj::Maybe<CfBlobJson> cfBlobJson = nullptr)
     : Body(kj::mv(body), *headers), method(method), url(kj::str(url)),
       redirect(redirect), headers(kj::mv(headers)), fetcher(kj::mv(fetcher)),
-      cf(kj::mv(cf)) {
+      cf(kj::mv(cf)), cfBlobJson(kj::mv(cfBlobJson)) {
     KJ_IF_MAYBE(s, signal) {
       // If the AbortSignal will never abort, assigning it to thisSignal instead ensures
       // that the cancel machinery is not used but the request.signal accessor will still
@@ -717,6 +729,17 @@ private:
   // used explicity, thisSignal will not be.
   kj::Maybe<jsg::V8Ref<v8::Object>> cf;
 
+  kj::Maybe<CfBlobJson> cfBlobJson;
+  // The JSON text `cf` was received as, if any. `cf` is only parsed from it when script first
+  // reads `request.cf`, so a request that is merely passed along to fetch() -- as when proxying
+  // to a service binding -- forwards the text as-is instead of round-tripping it through V8. This
+  // is kept after parsing only if `cf` was frozen, since otherwise script may have modified `cf`.
+
+  void cloneCfTo(jsg::Lock& js, kj::Maybe<jsg::V8Ref<v8::Object>>& cfOut,
+                 kj::Maybe<CfBlobJson>& cfBlobJsonOut);
+  // Copies `cf` for a new Request, passing the JSON along instead of cloning an object where
+  // possible.
+
   void visitForGc(jsg::GcVisitor& visitor) {
     visitor.visit(headers, fetcher, signal, thisSignal, cf);
   }
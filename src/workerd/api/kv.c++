@@ -16,6 +16,8 @@ namespace workerd::api {
 // As documented in Cloudflare's Worker KV limits.
 static constexpr size_t kMaxKeyLength = 512;
 
+static constexpr size_t kMaxBulkGetKeys = 100;
+
 static void checkForErrorStatus(kj::StringPtr method, const kj::HttpClient::Response& response) {
   if (response.statusCode < 200 || response.statusCode >= 300) {
     // Manually construct exception so that we can incorporate method and status into the text
@@ -103,16 +105,211 @@ kj::Own<kj::HttpClient> KvNamespace::getHttpClient(
 }
 
 
+namespace {
+
+struct ParsedGetOptions {
+  kj::Maybe<kj::String> type;
+  kj::Maybe<int> cacheTtl;
+
+  kj::StringPtr getTypeName() const {
+    return type.map([](const kj::String& s) -> kj::StringPtr { return s; }).orDefault("text");
+  }
+};
+
+}  // namespace
+
+static ParsedGetOptions parseGetOptions(
+    jsg::Optional<kj::OneOf<kj::String, KvNamespace::GetOptions>> options) {
+  ParsedGetOptions result;
+  KJ_IF_MAYBE(oneOfOptions, options) {
+    KJ_SWITCH_ONEOF(*oneOfOptions) {
+      KJ_CASE_ONEOF(t, kj::String) {
+        result.type = kj::mv(t);
+      }
+      KJ_CASE_ONEOF(options, KvNamespace::GetOptions) {
+        KJ_IF_MAYBE(t, options.type) {
+          result.type = kj::mv(*t);
+        }
+        KJ_IF_MAYBE(cacheTtl, options.cacheTtl) {
+          result.cacheTtl = *cacheTtl;
+        }
+      }
+    }
+  }
+  return result;
+}
+
 jsg::Promise<KvNamespace::GetResult> KvNamespace::get(
-    jsg::Lock& js, kj::String name, jsg::Optional<kj::OneOf<kj::String, GetOptions>> options) {
-  return js.evalNow([&] {
-    auto resp = getWithMetadata(js, kj::mv(name), kj::mv(options));
-    return resp.then([](KvNamespace::GetWithMetadataResult result) {
-      return kj::mv(result.value);
+    jsg::Lock& js,
+    kj::OneOf<kj::String, kj::Array<kj::String>> name,
+    jsg::Optional<kj::OneOf<kj::String, GetOptions>> options) {
+  return js.evalNow([&]() -> jsg::Promise<GetResult> {
+    KJ_SWITCH_ONEOF(name) {
+      KJ_CASE_ONEOF(key, kj::String) {
+        auto resp = getWithMetadata(js, kj::mv(key), kj::mv(options));
+        return resp.then([](KvNamespace::GetWithMetadataResult result) {
+          return kj::mv(result.value);
+        });
+      }
+      KJ_CASE_ONEOF(keys, kj::Array<kj::String>) {
+        auto parsedOptions = parseGetOptions(kj::mv(options));
+        return getBulk(js, kj::mv(keys), kj::str(parsedOptions.getTypeName()),
+                       parsedOptions.cacheTtl);
+      }
+    }
+    KJ_UNREACHABLE;
+  });
+}
+
+static KvNamespace::GetResult bulkResultToMap(
+    jsg::Lock& js, kj::ArrayPtr<const kj::String> names, kj::StringPtr typeName,
+    jsg::Value response) {
+  auto isolate = js.v8Isolate;
+  auto context = isolate->GetCurrentContext();
+  auto handle = response.getHandle(isolate);
+  JSG_REQUIRE(handle->IsObject(), Error, "KV GET failed: malformed bulk get response.");
+  auto values = handle.As<v8::Object>();
+
+  auto map = v8::Map::New(isolate);
+  for (auto& name: names) {
+    auto key = jsg::v8Str(isolate, name);
+    auto value = jsg::check(values->Get(context, key));
+    if (value->IsString()) {
+      if (typeName == "json") {
+        value = jsg::check(v8::JSON::Parse(context, value.As<v8::String>()));
+      }
+    } else {
+      // Keys the service left out are missing, just like those it reports as null.
+      value = v8::Null(isolate);
+    }
+    jsg::check(map->Set(context, key, value));
+  }
+  return KvNamespace::GetResult(jsg::Value(isolate, map));
+}
+
+jsg::Promise<KvNamespace::GetResult> KvNamespace::getBulk(
+    jsg::Lock& js, kj::Array<kj::String> names, kj::String type, kj::Maybe<int> cacheTtl) {
+  JSG_REQUIRE(names.size() <= kMaxBulkGetKeys, RangeError,
+      "KV GET failed: a bulk get can fetch at most ", kMaxBulkGetKeys, " keys.");
+  for (auto& name: names) {
+    validateKeyName("GET", name);
+  }
+  JSG_REQUIRE(type == "text" || type == "json", TypeError,
+      "Bulk KV gets only support the \"text\" and \"json\" types.");
+
+  if (bulkGetUnsupported) {
+    return getBulkFallback(js, kj::mv(names), kj::mv(type), cacheTtl);
+  }
+
+  auto& context = IoContext::current();
+
+  kj::Url url;
+  url.scheme = kj::str("https");
+  url.host = kj::str("fake-host");
+  url.path.add(kj::str("bulk"));
+  url.path.add(kj::str("get"));
+  url.query.add(kj::Url::QueryParam { kj::str("urlencoded"), kj::str("true") });
+  KJ_IF_MAYBE(t, cacheTtl) {
+    url.query.add(kj::Url::QueryParam { kj::str("cache_ttl"), kj::str(*t) });
+  }
+
+  auto urlStr = url.toString(kj::Url::Context::HTTP_PROXY_REQUEST);
+
+  auto isolate = js.v8Isolate;
+  auto keys = v8::Array::New(isolate, names.size());
+  for (auto i: kj::indices(names)) {
+    jsg::check(keys->Set(isolate->GetCurrentContext(), i, jsg::v8Str(isolate, names[i])));
+  }
+  auto body = js.serializeJson(keys);
+
+  auto headers = kj::HttpHeaders(context.getHeaderTable());
+  auto client = getHttpClient(context, headers, LimitEnforcer::KvOpType::GET, urlStr);
+  headers.set(kj::HttpHeaderId::CONTENT_TYPE, "application/json");
+
+  auto req = client->request(kj::HttpMethod::POST, urlStr, headers, uint64_t(body.size()));
+  // A service that doesn't know about bulk gets may answer without reading the body, so don't
+  // wait for the write before waiting for the response. The write is cancelled if it's still
+  // going when the response arrives.
+  auto writePromise = req.body->write(body.begin(), body.size())
+      .attach(kj::mv(req.body), kj::mv(body))
+      .eagerlyEvaluate(nullptr);
+
+  return context.awaitIo(js, req.response.attach(kj::mv(writePromise)),
+      [self = JSG_THIS, names = kj::mv(names), type = kj::mv(type), cacheTtl, &context,
+       client = kj::mv(client)]
+          (jsg::Lock& js, kj::HttpClient::Response&& response) mutable
+          -> jsg::Promise<KvNamespace::GetResult> {
+    if (response.statusCode == 404 || response.statusCode == 405 ||
+        response.statusCode == 501) {
+      // The service predates bulk gets. Remember that, so later bulk gets on this binding go
+      // straight to single gets.
+      self->bulkGetUnsupported = true;
+      return self->getBulkFallback(js, kj::mv(names), kj::mv(type), cacheTtl);
+    }
+
+    checkForErrorStatus("GET", response);
+
+    auto stream = newSystemStream(
+        response.body.attach(kj::mv(client)), getContentEncoding(context, *response.headers));
+
+    return context.awaitIo(js,
+        stream->readAllText(context.getLimitEnforcer().getBufferingLimit())
+            .attach(kj::mv(stream)),
+        [names = kj::mv(names), type = kj::mv(type)](jsg::Lock& js, kj::String text) {
+      return bulkResultToMap(js, names, type, js.parseJson(text));
     });
   });
 }
 
+jsg::Promise<KvNamespace::GetResult> KvNamespace::getBulkFallback(
+    jsg::Lock& js, kj::Array<kj::String> names, kj::String type, kj::Maybe<int> cacheTtl) {
+  auto isolate = js.v8Isolate;
+  auto map = jsg::Value(isolate, v8::Map::New(isolate));
+
+  // Start every get before waiting on any of them, so they run in parallel. They are then
+  // collected in order, so the Map lists the keys in the order they were asked for.
+  jsg::Promise<void> result = js.resolvedPromise();
+  for (auto& name: names) {
+    GetOptions single;
+    single.type = kj::str(type);
+    KJ_IF_MAYBE(t, cacheTtl) {
+      single.cacheTtl = *t;
+    }
+    auto value = getWithMetadata(
+        js, kj::str(name), kj::OneOf<kj::String, GetOptions>(kj::mv(single)));
+    result = result.then(js, [value = kj::mv(value)](jsg::Lock& js) mutable {
+      return kj::mv(value);
+    }).then(js, [map = map.addRef(js), name = kj::mv(name)]
+        (jsg::Lock& js, GetWithMetadataResult got) mutable {
+      auto isolate = js.v8Isolate;
+      auto context = isolate->GetCurrentContext();
+      v8::Local<v8::Value> value = v8::Null(isolate);
+      KJ_IF_MAYBE(v, got.value) {
+        KJ_SWITCH_ONEOF(*v) {
+          KJ_CASE_ONEOF(text, kj::String) {
+            value = jsg::v8Str(isolate, text);
+          }
+          KJ_CASE_ONEOF(json, jsg::Value) {
+            value = json.getHandle(isolate);
+          }
+          KJ_CASE_ONEOF(stream, jsg::Ref<ReadableStream>) {
+            KJ_UNREACHABLE;
+          }
+          KJ_CASE_ONEOF(bytes, kj::Array<byte>) {
+            KJ_UNREACHABLE;
+          }
+        }
+      }
+      jsg::check(map.getHandle(isolate).As<v8::Map>()->Set(
+          context, jsg::v8Str(isolate, name), value));
+    });
+  }
+
+  return result.then(js, [map = kj::mv(map)](jsg::Lock& js) mutable {
+    return KvNamespace::GetResult(kj::mv(map));
+  });
+}
+
 jsg::Promise<KvNamespace::GetWithMetadataResult> KvNamespace::getWithMetadata(
     jsg::Lock& js, kj::String name, jsg::Optional<kj::OneOf<kj::String, GetOptions>> options) {
   validateKeyName("GET", name);
@@ -125,22 +322,11 @@ jsg::Promise<KvNamespace::GetWithMetadataResult> KvNamespace::getWithMetadata(
   url.path.add(kj::mv(name));
   url.query.add(kj::Url::QueryParam { kj::str("urlencoded"), kj::str("true") });
 
-  kj::Maybe<kj::String> type;
-  KJ_IF_MAYBE(oneOfOptions, options) {
-    KJ_SWITCH_ONEOF(*oneOfOptions) {
-      KJ_CASE_ONEOF(t, kj::String) {
-        type = kj::mv(t);
-      }
-      KJ_CASE_ONEOF(options, GetOptions) {
-        KJ_IF_MAYBE(t, options.type) {
-          type = kj::mv(*t);
-        }
-        KJ_IF_MAYBE(cacheTtl, options.cacheTtl) {
-          url.query.add(kj::Url::QueryParam { kj::str("cache_ttl"), kj::str(*cacheTtl) });
-        }
-      }
-    }
+  auto parsedOptions = parseGetOptions(kj::mv(options));
+  KJ_IF_MAYBE(cacheTtl, parsedOptions.cacheTtl) {
+    url.query.add(kj::Url::QueryParam { kj::str("cache_ttl"), kj::str(*cacheTtl) });
   }
+  auto type = kj::mv(parsedOptions.type);
 
   auto urlStr = url.toString(kj::Url::Context::HTTP_PROXY_REQUEST);
 
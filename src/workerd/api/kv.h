@@ -40,8 +40,10 @@ public:
 
   jsg::Promise<GetResult> get(
       jsg::Lock& js,
-      kj::String name,
+      kj::OneOf<kj::String, kj::Array<kj::String>> name,
       jsg::Optional<kj::OneOf<kj::String, GetOptions>> options);
+  // Given an array of keys, fetches them all in one request and resolves to a Map from each key
+  // to its value, or null if it is missing. Only the "text" and "json" types are supported then.
 
   struct GetWithMetadataResult {
     GetResult value;
@@ -131,6 +133,14 @@ public:
       get<ExpectedValue = unknown>(key: Key, options?: KVNamespaceGetOptions<"json">): Promise<ExpectedValue | null>;
       get(key: Key, options?: KVNamespaceGetOptions<"arrayBuffer">): Promise<string | null>;
       get(key: Key, options?: KVNamespaceGetOptions<"stream">): Promise<string | null>;
+      get(key: Key[], type: "text"): Promise<Map<string, string | null>>;
+      get<ExpectedValue = unknown>(key: Key[], type: "json"):
+          Promise<Map<string, ExpectedValue | null>>;
+      get(key: Key[], options?: Partial<KVNamespaceGetOptions<undefined>>):
+          Promise<Map<string, string | null>>;
+      get(key: Key[], options?: KVNamespaceGetOptions<"text">): Promise<Map<string, string | null>>;
+      get<ExpectedValue = unknown>(key: Key[], options?: KVNamespaceGetOptions<"json">):
+          Promise<Map<string, ExpectedValue | null>>;
 
       list<Metadata = unknown>(options?: KVNamespaceListOptions): Promise<KVNamespaceListResult<Metadata, Key>>;
 
@@ -166,6 +176,15 @@ protected:
 private:
   kj::Array<AdditionalHeader> additionalHeaders;
   uint subrequestChannel;
+
+  bool bulkGetUnsupported = false;
+  // Set once the service has answered a bulk get as if it doesn't know about them, after which
+  // bulk gets are made as parallel single gets.
+
+  jsg::Promise<GetResult> getBulk(
+      jsg::Lock& js, kj::Array<kj::String> names, kj::String type, kj::Maybe<int> cacheTtl);
+  jsg::Promise<GetResult> getBulkFallback(
+      jsg::Lock& js, kj::Array<kj::String> names, kj::String type, kj::Maybe<int> cacheTtl);
 };
 
 #define EW_KV_ISOLATE_TYPES                 \
@@ -372,6 +372,20 @@ R2Bucket::put(jsg::Lock& js, kj::String name, kj::Maybe<R2PutValue> value,
       }
     });
 
+    KJ_IF_MAYBE(o, options) {
+      KJ_IF_MAYBE(m, o->multipart) {
+        KJ_IF_MAYBE(v, value) {
+          KJ_IF_MAYBE(stream, v->tryGet<jsg::Ref<ReadableStream>>()) {
+            auto multipart = kj::mv(*m);
+            auto promise = putMultipart(js, kj::mv(name), stream->addRef(), kj::mv(*o),
+                                        kj::mv(multipart), errorType);
+            cancelReader.cancel();
+            return promise;
+          }
+        }
+      }
+    }
+
     auto& context = IoContext::current();
     auto client = context.getHttpClient(clientIndex, true, nullptr, "r2_put"_kj);
 
@@ -634,6 +648,192 @@ jsg::Ref<R2MultipartUpload> R2Bucket::resumeMultipartUpload(jsg::Lock& js,
     return jsg::alloc<R2MultipartUpload>(kj::mv(key), kj::mv(uploadId), JSG_THIS);
 }
 
+namespace {
+
+constexpr uint64_t MIN_MULTIPART_PART_SIZE = 5ull << 20;
+constexpr uint64_t MAX_MULTIPART_PART_SIZE = 5ull << 30;
+constexpr uint64_t DEFAULT_MULTIPART_PART_SIZE = 10ull << 20;
+constexpr int DEFAULT_MULTIPART_CONCURRENCY = 4;
+constexpr int MAX_MULTIPART_CONCURRENCY = 16;
+constexpr int MAX_MULTIPART_PARTS = 10000;
+
+class MultipartPutSink final: public WritableStreamSink {
+  // Cuts what's written to it into parts of `partSize` bytes and uploads each one with
+  // `R2MultipartUpload::uploadPart()`, with up to `concurrency` uploads in flight. A write that
+  // fills a part waits for a free upload slot before taking more data, so at most
+  // `concurrency + 1` parts are held in memory. `end()` uploads whatever is left as the last part,
+  // waits for all the uploads, and passes the uploaded parts to `fulfiller`.
+public:
+  MultipartPutSink(IoContext& context, jsg::Ref<R2MultipartUpload> upload, size_t partSize,
+                   uint concurrency, const jsg::TypeHandler<jsg::Ref<R2Error>>& errorType,
+                   kj::Own<kj::PromiseFulfiller<kj::Array<R2MultipartUpload::UploadedPart>>>
+                       fulfiller)
+      : context(context), upload(context.addObject(kj::heap(kj::mv(upload)))),
+        errorType(errorType), partSize(partSize),
+        slots(kj::heapArray<kj::Maybe<kj::Promise<void>>>(concurrency)),
+        fulfiller(kj::mv(fulfiller)) {}
+
+  kj::Promise<void> write(const void* buffer, size_t size) override {
+    auto bytes = kj::arrayPtr(reinterpret_cast<const byte*>(buffer), size);
+    while (bytes.size() > 0) {
+      if (current == nullptr) {
+        current = kj::heapArray<byte>(partSize);
+      }
+      size_t n = kj::min(bytes.size(), current.size() - filled);
+      memcpy(current.begin() + filled, bytes.begin(), n);
+      filled += n;
+      bytes = bytes.slice(n, bytes.size());
+
+      if (filled == current.size()) {
+        return startPart().then([this, bytes]() {
+          return write(bytes.begin(), bytes.size());
+        });
+      }
+    }
+    return kj::READY_NOW;
+  }
+
+  kj::Promise<void> write(kj::ArrayPtr<const kj::ArrayPtr<const byte>> pieces) override {
+    if (pieces.size() == 0) {
+      return kj::READY_NOW;
+    }
+    return write(pieces[0].begin(), pieces[0].size()).then([this, pieces]() {
+      return write(pieces.slice(1, pieces.size()));
+    });
+  }
+
+  kj::Promise<void> end() override {
+    kj::Promise<void> promise = kj::READY_NOW;
+    if (filled > 0 || parts.size() == 0) {
+      // An empty stream still needs one (empty) part to complete the upload with.
+      promise = startPart();
+    }
+    return promise.then([this]() {
+      auto uploads = kj::heapArrayBuilder<kj::Promise<void>>(slots.size());
+      for (auto& slot: slots) {
+        KJ_IF_MAYBE(p, slot) {
+          uploads.add(kj::mv(*p));
+        }
+        slot = nullptr;
+      }
+      return kj::joinPromises(uploads.finish());
+    }).then([this]() {
+      fulfiller->fulfill(parts.releaseAsArray());
+    });
+  }
+
+  void abort(kj::Exception reason) override {
+    for (auto& slot: slots) {
+      slot = nullptr;
+    }
+    fulfiller->reject(kj::mv(reason));
+  }
+
+private:
+  IoContext& context;
+  IoOwn<jsg::Ref<R2MultipartUpload>> upload;
+  const jsg::TypeHandler<jsg::Ref<R2Error>>& errorType;
+  size_t partSize;
+
+  kj::Array<byte> current;
+  size_t filled = 0;
+  // The part being filled, allocated by the first write into it.
+
+  kj::Array<kj::Maybe<kj::Promise<void>>> slots;
+  // Part N uploads in slot (N - 1) % concurrency, once the part before it in that slot is done.
+
+  kj::Vector<R2MultipartUpload::UploadedPart> parts;
+  // One entry per part started; the etag is filled in when its upload completes.
+
+  kj::Own<kj::PromiseFulfiller<kj::Array<R2MultipartUpload::UploadedPart>>> fulfiller;
+
+  kj::Promise<void> startPart() {
+    if (parts.size() >= MAX_MULTIPART_PARTS) {
+      // Reported through the promise, so that the stream pumping into this sink sees the error.
+      return JSG_KJ_EXCEPTION(FAILED, RangeError,
+          "Stream is too long to upload in ", MAX_MULTIPART_PARTS, " parts of ", partSize,
+          " bytes.");
+    }
+    int partNumber = parts.size() + 1;
+    parts.add(R2MultipartUpload::UploadedPart { partNumber, kj::String() });
+
+    auto data = filled == partSize
+        ? kj::mv(current) : kj::heapArray<byte>(current.slice(0, filled));
+    current = nullptr;
+    filled = 0;
+
+    auto& slot = slots[(partNumber - 1) % slots.size()];
+    kj::Promise<void> ready = kj::READY_NOW;
+    KJ_IF_MAYBE(p, slot) {
+      ready = kj::mv(*p);
+      slot = nullptr;
+    }
+    return ready.then([this, &slot, partNumber, data = kj::mv(data)]() mutable {
+      slot = uploadPart(partNumber, kj::mv(data)).eagerlyEvaluate(nullptr);
+    });
+  }
+
+  kj::Promise<void> uploadPart(int partNumber, kj::Array<byte> data) {
+    return context.run([this, partNumber, data = kj::mv(data)](jsg::Lock& js) mutable {
+      return context.awaitJs((*upload)->uploadPart(js, partNumber, kj::mv(data), errorType));
+    }).then([this, partNumber](R2MultipartUpload::UploadedPart part) {
+      parts[partNumber - 1].etag = kj::mv(part.etag);
+    });
+  }
+};
+
+}  // namespace
+
+jsg::Promise<kj::Maybe<jsg::Ref<R2Bucket::HeadResult>>> R2Bucket::putMultipart(
+    jsg::Lock& js, kj::String key, jsg::Ref<ReadableStream> stream, PutOptions options,
+    MultipartPutOptions multipart, const jsg::TypeHandler<jsg::Ref<R2Error>>& errorType) {
+  JSG_REQUIRE(options.onlyIf == nullptr, TypeError, "onlyIf can't be used with a multipart put.");
+  JSG_REQUIRE(options.md5 == nullptr && options.sha1 == nullptr && options.sha256 == nullptr &&
+              options.sha384 == nullptr && options.sha512 == nullptr, TypeError,
+      "Checksums can't be used with a multipart put.");
+
+  double partSize = multipart.partSize.orDefault(DEFAULT_MULTIPART_PART_SIZE);
+  JSG_REQUIRE(isWholeNumber(partSize) && partSize >= MIN_MULTIPART_PART_SIZE &&
+              partSize <= MAX_MULTIPART_PART_SIZE, RangeError,
+      "Multipart part size must be a whole number of bytes between ", MIN_MULTIPART_PART_SIZE,
+      " and ", MAX_MULTIPART_PART_SIZE, ", not ", partSize, ".");
+  int concurrency = multipart.concurrency.orDefault(DEFAULT_MULTIPART_CONCURRENCY);
+  JSG_REQUIRE(concurrency >= 1 && concurrency <= MAX_MULTIPART_CONCURRENCY, RangeError,
+      "Multipart concurrency must be between 1 and ", MAX_MULTIPART_CONCURRENCY, ", not ",
+      concurrency, ".");
+
+  MultipartOptions createOptions;
+  createOptions.httpMetadata = kj::mv(options.httpMetadata);
+  createOptions.customMetadata = kj::mv(options.customMetadata);
+
+  return createMultipartUpload(js, kj::mv(key), kj::mv(createOptions), errorType)
+      .then(js, [stream = kj::mv(stream), partSize = size_t(partSize), concurrency, &errorType]
+            (jsg::Lock& js, jsg::Ref<R2MultipartUpload> upload) mutable {
+    auto& context = IoContext::current();
+    auto paf = kj::newPromiseAndFulfiller<kj::Array<R2MultipartUpload::UploadedPart>>();
+    auto sink = kj::heap<MultipartPutSink>(context, upload.addRef(), partSize, concurrency,
+                                           errorType, kj::mv(paf.fulfiller));
+    auto promise = context.waitForDeferredProxy(stream->pumpTo(js, kj::mv(sink), true))
+        .then([parts = kj::mv(paf.promise)]() mutable { return kj::mv(parts); });
+
+    return context.awaitIo(js, kj::mv(promise),
+        [upload = upload.addRef(), &errorType]
+        (jsg::Lock& js, kj::Array<R2MultipartUpload::UploadedPart> parts) mutable {
+      return upload->complete(js, kj::mv(parts), errorType);
+    }).catch_(js, [upload = kj::mv(upload), &errorType](jsg::Lock& js, jsg::Value&& exception)
+        mutable {
+      // Don't leave the parts uploaded so far behind.
+      return upload->abort(js, errorType).then(js,
+          [exception = kj::mv(exception)](jsg::Lock& js) mutable -> jsg::Ref<HeadResult> {
+        js.throwException(kj::mv(exception));
+      });
+    });
+  }).then(js, [](jsg::Lock& js, jsg::Ref<HeadResult> result)
+      -> kj::Maybe<jsg::Ref<HeadResult>> {
+    return kj::mv(result);
+  });
+}
+
 jsg::Promise<void> R2Bucket::delete_(jsg::Lock& js, kj::OneOf<kj::String, kj::Array<kj::String>> keys,
     const jsg::TypeHandler<jsg::Ref<R2Error>>& errorType) {
   return js.evalNow([&] {
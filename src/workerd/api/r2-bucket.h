@@ -139,6 +139,17 @@ public:
     HttpMetadata clone() const;
   };
 
+  struct MultipartPutOptions {
+    jsg::Optional<double> partSize;
+    // Size of every part but the last, in bytes. Defaults to 10 MiB; must be at least 5 MiB.
+    jsg::Optional<int> concurrency;
+    // How many parts may be uploading at once. Defaults to 4. At most `concurrency + 1` parts are
+    // buffered in memory at a time.
+
+    JSG_STRUCT(partSize, concurrency);
+    JSG_STRUCT_TS_OVERRIDE(R2MultipartPutOptions);
+  };
+
   struct PutOptions {
     jsg::Optional<kj::OneOf<Conditional, jsg::Ref<Headers>>> onlyIf;
     jsg::Optional<kj::OneOf<HttpMetadata, jsg::Ref<Headers>>> httpMetadata;
@@ -148,8 +159,14 @@ public:
     jsg::Optional<kj::OneOf<kj::Array<kj::byte>, jsg::NonCoercible<kj::String>>> sha256;
     jsg::Optional<kj::OneOf<kj::Array<kj::byte>, jsg::NonCoercible<kj::String>>> sha384;
     jsg::Optional<kj::OneOf<kj::Array<kj::byte>, jsg::NonCoercible<kj::String>>> sha512;
-
-    JSG_STRUCT(onlyIf, httpMetadata, customMetadata, md5, sha1, sha256, sha384, sha512);
+    jsg::Optional<MultipartPutOptions> multipart;
+    // When set and the value is a ReadableStream, the stream is uploaded as a multipart upload,
+    // a part at a time with several parts in flight, so it need not have a known length. The
+    // upload is completed once the stream ends, or aborted if it fails. Can't be combined with
+    // `onlyIf` or a checksum.
+
+    JSG_STRUCT(onlyIf, httpMetadata, customMetadata, md5, sha1, sha256, sha384, sha512,
+               multipart);
     JSG_STRUCT_TS_OVERRIDE(R2PutOptions);
   };
 
@@ -385,6 +402,11 @@ protected:
   }
 
 private:
+  jsg::Promise<kj::Maybe<jsg::Ref<HeadResult>>> putMultipart(
+      jsg::Lock& js, kj::String key, jsg::Ref<ReadableStream> stream, PutOptions options,
+      MultipartPutOptions multipart, const jsg::TypeHandler<jsg::Ref<R2Error>>& errorType);
+  // Implements `put()` for a stream when `PutOptions::multipart` is set.
+
   FeatureFlags featureFlags;
   uint clientIndex;
   kj::Maybe<kj::String> adminBucket;
@@ -20,6 +20,7 @@ namespace workerd::api::public_beta {
     api::public_beta::R2Bucket::Conditional, \
     api::public_beta::R2Bucket::GetOptions, \
     api::public_beta::R2Bucket::PutOptions, \
+    api::public_beta::R2Bucket::MultipartPutOptions, \
     api::public_beta::R2Bucket::MultipartOptions, \
     api::public_beta::R2Bucket::Checksums, \
     api::public_beta::R2Bucket::StringChecksums, \
@@ -10,7 +10,8 @@ namespace workerd::api {
 
 
 jsg::Ref<Socket> connectImplNoOutputLock(
-    jsg::Lock& js, jsg::Ref<Fetcher> fetcher, kj::String address) {
+    jsg::Lock& js, jsg::Ref<Fetcher> fetcher, kj::String address,
+    jsg::Optional<SocketOptions> options) {
   auto& ioContext = IoContext::current();
 
   auto jsRequest = Request::constructor(js, kj::str(address), nullptr);
@@ -33,8 +34,27 @@ jsg::Ref<Socket> connectImplNoOutputLock(
   //   `parseAddress()` but instead decide for ourselves what format we want to permit here, maybe
   //   as a regex.
 
+  bool useTls = false;
+  bool noDelay = true;
+  bool keepAlive = false;
+  KJ_IF_MAYBE(o, options) {
+    KJ_IF_MAYBE(secureTransport, o->secureTransport) {
+      JSG_REQUIRE(*secureTransport == "off" || *secureTransport == "on", TypeError,
+          "The secureTransport option must be either \"off\" or \"on\".");
+      useTls = *secureTransport == "on";
+    }
+    noDelay = o->noDelay.orDefault(true);
+    keepAlive = o->keepAlive.orDefault(false);
+  }
+
+  kj::Vector<kj::StringPtr> flags(3);
+  if (useTls) flags.add(SOCKET_OPTION_TLS);
+  if (noDelay) flags.add(SOCKET_OPTION_NO_DELAY);
+  if (keepAlive) flags.add(SOCKET_OPTION_KEEP_ALIVE);
+
   // Set up the connection.
   auto headers = kj::heap<kj::HttpHeaders>(ioContext.getHeaderTable());
+  headers->add(SOCKET_OPTIONS_HEADER, kj::strArray(flags, ","));
   auto httpClient = kj::newHttpClient(*client);
   auto request = httpClient->connect(address, *headers);
   // TODO(soon): If `request.status` resolves to have a statusCode < 200 || >= 300, arrange for the
@@ -46,7 +66,7 @@ jsg::Ref<Socket> connectImplNoOutputLock(
 
 jsg::Ref<Socket> connectImpl(
     jsg::Lock& js, kj::Maybe<jsg::Ref<Fetcher>> fetcher, kj::String address,
-    CompatibilityFlags::Reader featureFlags) {
+    jsg::Optional<SocketOptions> options, CompatibilityFlags::Reader featureFlags) {
   // `connect()` should be hidden when the feature flag is off, so we shouldn't even get here.
   KJ_ASSERT(featureFlags.getTcpSocketsSupport());
 
@@ -57,7 +77,7 @@ jsg::Ref<Socket> connectImpl(
     actualFetcher = jsg::alloc<Fetcher>(
         IoContext::NULL_CLIENT_CHANNEL, Fetcher::RequiresHostAndProtocol::YES);
   }
-  return connectImplNoOutputLock(js, kj::mv(actualFetcher), kj::mv(address));
+  return connectImplNoOutputLock(js, kj::mv(actualFetcher), kj::mv(address), kj::mv(options));
 }
 
 InitData initialiseSocket(kj::Promise<kj::Own<kj::AsyncIoStream>> connectionPromise) {
@@ -92,89 +112,69 @@ jsg::Promise<void> Socket::close(jsg::Lock& js) {
 }
 
 PipelinedAsyncIoStream::PipelinedAsyncIoStream(kj::Promise<kj::Own<kj::AsyncIoStream>> inner) :
-    inner(kj::mv(inner)) {};
+    inner(inner.then([this](kj::Own<kj::AsyncIoStream> stream) {
+      completedInner = kj::mv(stream);
+    }).fork()) {};
 
 void PipelinedAsyncIoStream::shutdownWrite() {
-  thenOrRunNow<void>([](kj::Own<kj::AsyncIoStream>* stream) {
-    (*stream)->shutdownWrite();
-    return kj::READY_NOW;
-  }).detach([this](kj::Exception&& exception) mutable {
-    error = kj::mv(exception);
-  });
+  runNowOrLater([](kj::AsyncIoStream& stream) { stream.shutdownWrite(); });
 }
 
 void PipelinedAsyncIoStream::abortRead() {
-  thenOrRunNow<void>([](kj::Own<kj::AsyncIoStream>* stream) {
-    (*stream)->abortRead();
-    return kj::READY_NOW;
-  }).detach([this](kj::Exception&& exception) mutable {
-    error = kj::mv(exception);
-  });
+  runNowOrLater([](kj::AsyncIoStream& stream) { stream.abortRead(); });
 }
 
 void PipelinedAsyncIoStream::getsockopt(int level, int option, void* value, uint* length) {
-  thenOrRunNow<void>([=](kj::Own<kj::AsyncIoStream>* stream) {
-    (*stream)->getsockopt(level, option, value, length);
-    return kj::READY_NOW;
-  }).detach([this](kj::Exception&& exception) mutable {
-    error = kj::mv(exception);
+  runNowOrLater([=](kj::AsyncIoStream& stream) {
+    stream.getsockopt(level, option, value, length);
   });
 }
 
 void PipelinedAsyncIoStream::setsockopt(int level, int option, const void* value, uint length) {
-  thenOrRunNow<void>([=](kj::Own<kj::AsyncIoStream>* stream) {
-    (*stream)->setsockopt(level, option, value, length);
-    return kj::READY_NOW;
-  }).detach([this](kj::Exception&& exception) mutable {
-    error = kj::mv(exception);
+  runNowOrLater([=](kj::AsyncIoStream& stream) {
+    stream.setsockopt(level, option, value, length);
   });
 }
 
 void PipelinedAsyncIoStream::getsockname(struct sockaddr* addr, uint* length) {
-  thenOrRunNow<void>([=](kj::Own<kj::AsyncIoStream>* stream) {
-    (*stream)->getsockname(addr, length);
-    return kj::READY_NOW;
-  }).detach([this](kj::Exception&& exception) mutable {
-    error = kj::mv(exception);
+  runNowOrLater([=](kj::AsyncIoStream& stream) {
+    stream.getsockname(addr, length);
   });
 }
 
 void PipelinedAsyncIoStream::getpeername(struct sockaddr* addr, uint* length) {
-  thenOrRunNow<void>([=](kj::Own<kj::AsyncIoStream>* stream) {
-    (*stream)->getpeername(addr, length);
-    return kj::READY_NOW;
-  }).detach([this](kj::Exception&& exception) mutable {
-    error = kj::mv(exception);
+  runNowOrLater([=](kj::AsyncIoStream& stream) {
+    stream.getpeername(addr, length);
   });
 }
 
 kj::Promise<size_t> PipelinedAsyncIoStream::read(void* buffer, size_t minBytes, size_t maxBytes) {
-  return thenOrRunNow<size_t>([=](kj::Own<kj::AsyncIoStream>* stream) {
-    return (*stream)->read(buffer, minBytes, maxBytes);
+  return thenOrRunNow([=](kj::AsyncIoStream& stream) {
+    return stream.read(buffer, minBytes, maxBytes);
   });
 }
 
 kj::Promise<size_t> PipelinedAsyncIoStream::tryRead(void* buffer, size_t minBytes, size_t maxBytes) {
-  return thenOrRunNow<size_t>([=](kj::Own<kj::AsyncIoStream>* stream) {
-    return (*stream)->tryRead(buffer, minBytes, maxBytes);
+  return thenOrRunNow([=](kj::AsyncIoStream& stream) {
+    return stream.tryRead(buffer, minBytes, maxBytes);
   });
 }
 
 kj::Promise<void> PipelinedAsyncIoStream::write(const void* buffer, size_t size) {
-  return thenOrRunNow<void>([=](kj::Own<kj::AsyncIoStream>* stream) {
-    return (*stream)->write(buffer, size);
+  return thenOrRunNow([=](kj::AsyncIoStream& stream) {
+    return stream.write(buffer, size);
   });
 }
 
 kj::Promise<void> PipelinedAsyncIoStream::write(kj::ArrayPtr<const kj::ArrayPtr<const byte>> pieces) {
-  return thenOrRunNow<void>([=](kj::Own<kj::AsyncIoStream>* stream) {
-    return (*stream)->write(pieces);
+  return thenOrRunNow([=](kj::AsyncIoStream& stream) {
+    return stream.write(pieces);
   });
 }
 
 kj::Promise<void> PipelinedAsyncIoStream::whenWriteDisconnected() {
-  return thenOrRunNow<void>([=](kj::Own<kj::AsyncIoStream>* stream) {
-    return (*stream)->whenWriteDisconnected();
+  return thenOrRunNow([](kj::AsyncIoStream& stream) {
+    return stream.whenWriteDisconnected();
   });
 }
 
@@ -12,7 +12,8 @@ namespace workerd::api {
 
 class PipelinedAsyncIoStream final : public kj::AsyncIoStream, public kj::Refcounted {
   // A stream that is backed by a promise for an AsyncIoStream. All operations on this stream
-  // are deferred until the `inner` promise completes.
+  // are deferred until the `inner` promise completes. Once it has, operations are forwarded
+  // directly to the connected stream, without allocating or waiting on any extra promise.
 public:
   explicit PipelinedAsyncIoStream(kj::Promise<kj::Own<kj::AsyncIoStream>> inner);
   void shutdownWrite() override;
@@ -34,20 +35,35 @@ public:
   kj::Promise<void> whenWriteDisconnected() override;
 
 private:
-  template <typename T>
-  kj::Promise<T> thenOrRunNow(std::function<kj::Promise<T> (kj::Own<kj::AsyncIoStream> *)> f) {
-    // Either calls `then` on the `inner` promise with the `f` callback, or calls `f` on an already
-    // stored stream (if the `inner` promise completed).
+  template <typename Func>
+  auto thenOrRunNow(Func&& f) -> decltype(f(kj::instance<kj::AsyncIoStream&>())) {
+    // Either calls `f` on the already connected stream, or arranges for it to be called once the
+    // `inner` promise completes.
     KJ_IF_MAYBE(e, error) {
-      kj::throwRecoverableException(kj::mv(*e));
+      kj::throwRecoverableException(kj::cp(*e));
     }
 
     KJ_IF_MAYBE(s, completedInner) {
-      return f(s);
+      return f(**s);
     } else {
-      return inner.then([this, f](kj::Own<kj::AsyncIoStream> stream) -> kj::Promise<T> {
-        completedInner = kj::mv(stream);
-        return f(&KJ_ASSERT_NONNULL(completedInner));
+      return inner.addBranch().then([this, f = kj::fwd<Func>(f)]() mutable {
+        return f(*KJ_ASSERT_NONNULL(completedInner));
+      });
+    }
+  }
+
+  template <typename Func>
+  void runNowOrLater(Func&& f) {
+    // Like `thenOrRunNow()`, for the synchronous operations: if the connection isn't established
+    // yet, `f` runs once it is, and any error it throws fails all later operations.
+    KJ_IF_MAYBE(s, completedInner) {
+      f(**s);
+    } else {
+      thenOrRunNow([f = kj::fwd<Func>(f)](kj::AsyncIoStream& stream) mutable -> kj::Promise<void> {
+        f(stream);
+        return kj::READY_NOW;
+      }).detach([this](kj::Exception&& exception) mutable {
+        error = kj::mv(exception);
       });
     }
   }
@@ -56,16 +72,38 @@ private:
   // Stored io stream once the `inner` promise completes.
   kj::Maybe<kj::Exception> error;
   // Stored error if any of the operations throw.
-  kj::Promise<kj::Own<kj::AsyncIoStream>> inner;
-  // A promise holding a stream that will be available at some point in the future. Typically once
-  // a connection is established.
+  kj::ForkedPromise<void> inner;
+  // Resolves once the connection is established and `completedInner` has been set. Forked, since
+  // a read and a write are typically both waiting on it.
 };
 
 struct SocketOptions {
-  jsg::Unimplemented tls; // TODO(later): TCP socket options need to be implemented.
-  JSG_STRUCT(tls);
+  jsg::Optional<kj::String> secureTransport;
+  // "off" (the default) for a plain TCP connection, or "on" to negotiate TLS as soon as the
+  // connection is established.
+
+  jsg::Optional<bool> noDelay;
+  // Whether to disable Nagle's algorithm, so that small writes are sent immediately rather than
+  // coalesced. Defaults to true, which suits request/response protocols like those of databases.
+
+  jsg::Optional<bool> keepAlive;
+  // Whether to enable TCP keepalive probes on an otherwise idle connection. Defaults to false.
+
+  JSG_STRUCT(secureTransport, noDelay, keepAlive);
+  JSG_STRUCT_TS_OVERRIDE({
+    secureTransport?: "off" | "on";
+  });
 };
 
+constexpr kj::StringPtr SOCKET_OPTIONS_HEADER = "CF-Socket-Options"_kj;
+// Header through which `connect()` passes `SocketOptions` along with the CONNECT request, as a
+// comma-separated list of the flags below. The network service applies them to the TCP socket it
+// opens. It's internal to the process: services that pass CONNECT requests on to another server
+// remove it first.
+constexpr kj::StringPtr SOCKET_OPTION_TLS = "tls"_kj;
+constexpr kj::StringPtr SOCKET_OPTION_NO_DELAY = "nodelay"_kj;
+constexpr kj::StringPtr SOCKET_OPTION_KEEP_ALIVE = "keepalive"_kj;
+
 struct InitData {
   jsg::Ref<ReadableStream> readable;
   jsg::Ref<WritableStream> writable;
@@ -111,11 +149,12 @@ private:
 };
 
 jsg::Ref<Socket> connectImplNoOutputLock(
-    jsg::Lock& js, jsg::Ref<Fetcher> fetcher, kj::String address);
+    jsg::Lock& js, jsg::Ref<Fetcher> fetcher, kj::String address,
+    jsg::Optional<SocketOptions> options);
 
 jsg::Ref<Socket> connectImpl(
     jsg::Lock& js, kj::Maybe<jsg::Ref<Fetcher>> fetcher, kj::String address,
-    CompatibilityFlags::Reader featureFlags);
+    jsg::Optional<SocketOptions> options, CompatibilityFlags::Reader featureFlags);
 
 #define EW_SOCKETS_ISOLATE_TYPES         \
   api::Socket,                       \
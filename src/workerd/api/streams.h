@@ -42,6 +42,7 @@ namespace workerd::api {
   api::ReadableStream::ReadableStreamAsyncIterator::Next,   \
   api::CompressionStream,                                   \
   api::DecompressionStream,                                 \
+  api::CompressionStreamOptions,                            \
   api::TextEncoderStream,                                   \
   api::TextDecoderStream,                                   \
   api::TextDecoderStream::TextDecoderStreamInit,            \
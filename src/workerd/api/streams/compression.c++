@@ -4,8 +4,10 @@
 
 #include "compression.h"
 #include "internal.h"
+#include <workerd/util/thread-pool.h>
 #include <zlib.h>
 #include <deque>
+#include <thread>
 #include <vector>
 #include <iterator>
 
@@ -25,20 +27,25 @@ public:
     kj::ArrayPtr<const byte> buffer;
   };
 
-  explicit Context(Mode mode, kj::StringPtr format) : mode(mode) {
+  struct Options {
+    int level = Z_DEFAULT_COMPRESSION;
+    int windowBits = MAX_WBITS;
+  };
+
+  explicit Context(Mode mode, kj::StringPtr format, Options options) : mode(mode) {
     int result = Z_OK;
     switch (mode) {
       case Mode::COMPRESS:
         result = deflateInit2(
             &ctx,
-            Z_DEFAULT_COMPRESSION,
+            options.level,
             Z_DEFLATED,
-            getWindowBits(format),
+            getWindowBits(format, options.windowBits),
             8,  // memLevel = 8 is the default
             Z_DEFAULT_STRATEGY);
         break;
       case Mode::DECOMPRESS:
-        result = inflateInit2(&ctx, getWindowBits(format));
+        result = inflateInit2(&ctx, getWindowBits(format, options.windowBits));
         break;
       default:
         KJ_UNREACHABLE;
@@ -94,15 +101,14 @@ public:
   }
 
 private:
-  static int getWindowBits(kj::StringPtr format) {
-    // We use a windowBits value of 15 combined with the magic value
-    // for the compression format type. For gzip, the magic value is
-    // 16, so the value returned is 15 + 16. For deflate, the magic
-    // value is 15.
+  static int getWindowBits(kj::StringPtr format, int windowBits) {
+    // zlib picks the wrapper around the deflate data based on the windowBits value: as is for
+    // the zlib wrapper ("deflate"), plus 16 for the gzip wrapper, and negated for no wrapper at
+    // all ("deflate-raw").
     static constexpr auto GZIP = 16;
-    static constexpr auto DEFLATE = 15;
-    if (format == "gzip") return DEFLATE + GZIP;
-    else if (format == "deflate") return DEFLATE;
+    if (format == "gzip") return windowBits + GZIP;
+    else if (format == "deflate") return windowBits;
+    else if (format == "deflate-raw") return -windowBits;
     KJ_UNREACHABLE;
   }
 
@@ -111,14 +117,23 @@ private:
   kj::byte buffer[4096];
 };
 
+constexpr size_t OFF_THREAD_MIN_WRITE_SIZE = 64 * 1024;
+// Writes at least this big are (de)compressed on the thread pool, so that the isolate isn't held
+// up while it happens. Smaller writes aren't worth the round trip.
+
+ThreadPool& getCompressionThreadPool() {
+  static ThreadPool pool(kj::max(1u, kj::min(std::thread::hardware_concurrency(), 4u)));
+  return pool;
+}
+
 template <Context::Mode mode>
 class CompressionStreamImpl: public kj::Refcounted,
                              public ReadableStreamSource,
                              public WritableStreamSink {
   // Uncompressed data goes in. Compressed data comes out.
 public:
-  explicit CompressionStreamImpl(kj::String format)
-      : context(mode, format) {}
+  explicit CompressionStreamImpl(kj::String format, Context::Options options)
+      : context(kj::heap<Context>(mode, format, options)) {}
 
   // WritableStreamSink implementation ---------------------------------------------------
 
@@ -131,7 +146,10 @@ public:
         return kj::cp(exception);
       }
       KJ_CASE_ONEOF(open, Open) {
-        context.setInput(buffer, size);
+        if (size >= OFF_THREAD_MIN_WRITE_SIZE) {
+          return writeOffThread(kj::arrayPtr(reinterpret_cast<const kj::byte*>(buffer), size));
+        }
+        getContext().setInput(buffer, size);
         return writeInternal(Z_NO_FLUSH);
       }
     }
@@ -157,6 +175,9 @@ public:
   }
 
   kj::Promise<void> end() override {
+    KJ_IF_MAYBE(exception, state.template tryGet<kj::Exception>()) {
+      return kj::cp(*exception);
+    }
     state = Ended();
     return writeInternal(Z_FINISH);
   }
@@ -257,7 +278,7 @@ private:
     KJ_ASSERT(flush == Z_FINISH || state.template is<Open>());
     Context::Result result;
     KJ_IF_MAYBE(exception, kj::runCatchingExceptions([this, flush, &result]() {
-      result = context.pumpOnce(flush);
+      result = getContext().pumpOnce(flush);
     })) {
       cancelInternal(kj::cp(*exception));
       return kj::mv(*exception);
@@ -276,6 +297,51 @@ private:
     return writeInternal(flush);
   }
 
+  struct OffThreadResult {
+    kj::Own<Context> context;
+    kj::Vector<kj::byte> output;
+  };
+
+  kj::Promise<void> writeOffThread(kj::ArrayPtr<const kj::byte> buffer) {
+    // Hands the context over to the thread pool to consume all of `buffer`, and takes it back
+    // along with the output once that's done. The input is copied, since if the write is
+    // canceled the caller's buffer may go away while the pool is still working on it.
+    getContext();  // Throws if a previous write was canceled.
+    auto input = kj::heapArray(buffer);
+    auto promise = getCompressionThreadPool().run(
+        [context = kj::mv(this->context), input = kj::mv(input)]() mutable {
+      OffThreadResult result { .context = kj::mv(context) };
+      result.context->setInput(input.begin(), input.size());
+      for (;;) {
+        auto pumped = result.context->pumpOnce(Z_NO_FLUSH);
+        result.output.addAll(pumped.buffer);
+        if (pumped.buffer.size() == 0 && !pumped.success) break;
+      }
+      return kj::mv(result);
+    });
+
+    return promise.then([this](OffThreadResult result) -> kj::Promise<void> {
+      context = kj::mv(result.context);
+      KJ_IF_MAYBE(exception, state.template tryGet<kj::Exception>()) {
+        // We were aborted or canceled in the meantime, so the output isn't wanted anymore.
+        return kj::cp(*exception);
+      }
+      std::copy(result.output.begin(), result.output.end(), std::back_inserter(output));
+      return maybeFulfillRead();
+    }, [this](kj::Exception&& exception) -> kj::Promise<void> {
+      cancelInternal(kj::cp(exception));
+      return kj::mv(exception);
+    });
+  }
+
+  Context& getContext() {
+    // The context is missing only while an off-thread write has it, and for good if that write
+    // was canceled before the context came back.
+    JSG_REQUIRE(context.get() != nullptr, Error,
+        "The compression stream can't be used after a write to it was canceled.");
+    return *context;
+  }
+
   kj::Promise<void> maybeFulfillRead() {
     // Fulfill as many pending reads as we can from the output buffer.
     auto remaining = output.size();
@@ -350,22 +416,46 @@ private:
   struct Open {};
 
   kj::OneOf<Open, Ended, kj::Exception> state = Open();
-  Context context;
+  kj::Own<Context> context;
 
   kj::Canceler canceler;
   std::vector<kj::byte> output;
   std::deque<PendingRead> pendingReads;
 };
+
+void requireValidFormat(kj::StringPtr format) {
+  JSG_REQUIRE(format == "deflate" || format == "deflate-raw" || format == "gzip", TypeError,
+               "The compression format must be either 'deflate', 'deflate-raw' or 'gzip'.");
+}
+
+Context::Options getContextOptions(jsg::Optional<CompressionStreamOptions>& maybeOptions) {
+  Context::Options result;
+  KJ_IF_MAYBE(options, maybeOptions) {
+    KJ_IF_MAYBE(level, options->level) {
+      JSG_REQUIRE(*level >= 0 && *level <= 9, RangeError,
+                   "The compression level must be between 0 and 9.");
+      result.level = *level;
+    }
+    KJ_IF_MAYBE(windowBits, options->windowBits) {
+      JSG_REQUIRE(*windowBits >= 9 && *windowBits <= MAX_WBITS, RangeError,
+                   "The compression windowBits must be between 9 and 15.");
+      result.windowBits = *windowBits;
+    }
+  }
+  return result;
+}
+
 }  // namespace
 
 jsg::Ref<CompressionStream> CompressionStream::constructor(
     jsg::Lock& js,
-    kj::String format) {
-  JSG_REQUIRE(format == "deflate" || format == "gzip", TypeError,
-               "The compression format must be either 'deflate' or 'gzip'.");
+    kj::String format,
+    jsg::Optional<CompressionStreamOptions> options) {
+  requireValidFormat(format);
+  auto contextOptions = getContextOptions(options);
 
-  auto readableSide =
-      kj::refcounted<CompressionStreamImpl<Context::Mode::COMPRESS>>(kj::mv(format));
+  auto readableSide = kj::refcounted<CompressionStreamImpl<Context::Mode::COMPRESS>>(
+      kj::mv(format), contextOptions);
   auto writableSide = kj::addRef(*readableSide);
 
   auto& ioContext = IoContext::current();
@@ -377,11 +467,17 @@ jsg::Ref<CompressionStream> CompressionStream::constructor(
 
 jsg::Ref<DecompressionStream> DecompressionStream::constructor(
     jsg::Lock& js,
-    kj::String format) {
-  JSG_REQUIRE(format == "deflate" || format == "gzip", TypeError,
-               "The compression format must be either 'deflate' or 'gzip'.");
-  auto readableSide =
-      kj::refcounted<CompressionStreamImpl<Context::Mode::DECOMPRESS>>(kj::mv(format));
+    kj::String format,
+    jsg::Optional<CompressionStreamOptions> options) {
+  requireValidFormat(format);
+  KJ_IF_MAYBE(o, options) {
+    JSG_REQUIRE(o->level == nullptr, TypeError,
+                 "DecompressionStream does not accept a compression level.");
+  }
+  auto contextOptions = getContextOptions(options);
+
+  auto readableSide = kj::refcounted<CompressionStreamImpl<Context::Mode::DECOMPRESS>>(
+      kj::mv(format), contextOptions);
   auto writableSide = kj::addRef(*readableSide);
 
   auto& ioContext = IoContext::current();
@@ -9,17 +9,33 @@
 
 namespace workerd::api {
 
+struct CompressionStreamOptions {
+  // Non-standard tuning for CompressionStream and DecompressionStream.
+
+  jsg::Optional<int> level;
+  // Compression level, from 0 (no compression) to 9 (smallest output, but slowest). Defaults to
+  // zlib's default of 6. DecompressionStream does not accept this.
+
+  jsg::Optional<int> windowBits;
+  // Base-2 logarithm of the size of the window of past data that compression may refer back to,
+  // from 9 to 15. Smaller windows take less memory but compress worse. Defaults to 15. When
+  // decompressing, this must be at least the value that the data was compressed with.
+
+  JSG_STRUCT(level, windowBits);
+};
+
 class CompressionStream: public TransformStream {
 public:
   using TransformStream::TransformStream;
 
-  static jsg::Ref<CompressionStream> constructor(jsg::Lock& js, kj::String format);
+  static jsg::Ref<CompressionStream> constructor(
+      jsg::Lock& js, kj::String format, jsg::Optional<CompressionStreamOptions> options);
 
   JSG_RESOURCE_TYPE(CompressionStream) {
     JSG_INHERIT(TransformStream);
 
     JSG_TS_OVERRIDE(extends TransformStream<ArrayBuffer | ArrayBufferView, Uint8Array> {
-      constructor(format: "gzip" | "deflate");
+      constructor(format: "gzip" | "deflate" | "deflate-raw", options?: CompressionStreamOptions);
     });
   }
 };
@@ -28,13 +44,14 @@ class DecompressionStream: public TransformStream {
 public:
   using TransformStream::TransformStream;
 
-  static jsg::Ref<DecompressionStream> constructor(jsg::Lock& js, kj::String format);
+  static jsg::Ref<DecompressionStream> constructor(
+      jsg::Lock& js, kj::String format, jsg::Optional<CompressionStreamOptions> options);
 
   JSG_RESOURCE_TYPE(DecompressionStream) {
     JSG_INHERIT(TransformStream);
 
     JSG_TS_OVERRIDE(extends TransformStream<ArrayBuffer | ArrayBufferView, Uint8Array> {
-      constructor(format: "gzip" | "deflate");
+      constructor(format: "gzip" | "deflate" | "deflate-raw", options?: CompressionStreamOptions);
     });
   }
 };
@@ -0,0 +1,245 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "internal.h"
+#include <kj/test.h>
+
+namespace workerd::api {
+namespace {
+
+KJ_TEST("IdentityTransformStreamImpl reads wait for minBytes across writes") {
+  kj::EventLoop loop;
+  kj::WaitScope ws(loop);
+  auto stream = kj::refcounted<IdentityTransformStreamImpl>();
+  char buffer[16];
+
+  // Writes made while the read waits are copied in until it has enough.
+  auto read = stream->tryRead(buffer, 8, sizeof(buffer));
+  stream->write("abc", 3).wait(ws);
+  KJ_EXPECT(!read.poll(ws));
+  stream->write("defgh", 5).wait(ws);
+  KJ_EXPECT(read.wait(ws) == 8);
+  KJ_EXPECT(kj::heapString(buffer, 8) == "abcdefgh");
+
+  // A write the read doesn't have room for waits for the next read.
+  read = stream->tryRead(buffer, 4, 6);
+  stream->write("ab", 2).wait(ws);
+  auto write = stream->write("cdefghij", 8);
+  KJ_EXPECT(read.wait(ws) == 6);
+  KJ_EXPECT(kj::heapString(buffer, 6) == "abcdef");
+  KJ_EXPECT(!write.poll(ws));
+  KJ_EXPECT(stream->tryRead(buffer, 1, sizeof(buffer)).wait(ws) == 4);
+  KJ_EXPECT(kj::heapString(buffer, 4) == "ghij");
+  write.wait(ws);
+
+  // A write already waiting when the read starts counts towards it.
+  write = stream->write("abc", 3);
+  read = stream->tryRead(buffer, 5, sizeof(buffer));
+  write.wait(ws);
+  KJ_EXPECT(!read.poll(ws));
+  stream->write("de", 2).wait(ws);
+  KJ_EXPECT(read.wait(ws) == 5);
+  KJ_EXPECT(kj::heapString(buffer, 5) == "abcde");
+}
+
+KJ_TEST("IdentityTransformStreamImpl reads come up short at the end of the stream") {
+  kj::EventLoop loop;
+  kj::WaitScope ws(loop);
+  auto stream = kj::refcounted<IdentityTransformStreamImpl>();
+  char buffer[16];
+
+  auto read = stream->tryRead(buffer, 8, sizeof(buffer));
+  stream->write("abc", 3).wait(ws);
+  stream->end().wait(ws);
+  KJ_EXPECT(read.wait(ws) == 3);
+  KJ_EXPECT(kj::heapString(buffer, 3) == "abc");
+  KJ_EXPECT(stream->tryRead(buffer, 8, sizeof(buffer)).wait(ws) == 0);
+}
+
+KJ_TEST("FixedLengthStream reads fail when the stream ends early") {
+  kj::EventLoop loop;
+  kj::WaitScope ws(loop);
+  char buffer[16];
+
+  {
+    auto stream = kj::refcounted<IdentityTransformStreamImpl>(uint64_t(5));
+    auto read = stream->tryRead(buffer, 4, sizeof(buffer));
+    stream->write("ab", 2).wait(ws);
+    stream->end().wait(ws);
+    KJ_EXPECT_THROW_MESSAGE("did not see all expected bytes", read.wait(ws));
+  }
+
+  {
+    // Ending after exactly the expected length is fine, even short of minBytes.
+    auto stream = kj::refcounted<IdentityTransformStreamImpl>(uint64_t(2));
+    auto read = stream->tryRead(buffer, 4, sizeof(buffer));
+    stream->write("ab", 2).wait(ws);
+    stream->end().wait(ws);
+    KJ_EXPECT(read.wait(ws) == 2);
+  }
+}
+
+KJ_TEST("readAllBytes() doesn't trust a stream's length for its first allocation") {
+  kj::EventLoop loop;
+  kj::WaitScope ws(loop);
+
+  struct LyingSource final: public ReadableStreamSource {
+    // Claims `length` bytes, then ends after a few. Records how big a buffer the first read got.
+    uint64_t length;
+    kj::Maybe<size_t> firstRead;
+
+    explicit LyingSource(uint64_t length): length(length) {}
+
+    kj::Promise<size_t> tryRead(void* buffer, size_t minBytes, size_t maxBytes) override {
+      if (firstRead != nullptr) return size_t(0);
+      firstRead = maxBytes;
+      memcpy(buffer, "abc", 3);
+      return size_t(3);
+    }
+    kj::Maybe<uint64_t> tryGetLength(StreamEncoding encoding) override {
+      return length;
+    }
+  };
+
+  constexpr size_t MAX_PART_SIZE = 1024 * 1024;
+  // Matches AllReader's cap on the first part.
+
+  auto firstRead = [&](uint64_t length) {
+    LyingSource source(length);
+    auto bytes = source.readAllBytes(kj::maxValue).wait(ws);
+    KJ_EXPECT(kj::heapString(bytes.asChars()) == "abc");
+    return KJ_ASSERT_NONNULL(source.firstRead);
+  };
+
+  // Below the cap, the first part holds the whole stream plus one byte.
+  KJ_EXPECT(firstRead(MAX_PART_SIZE - 1) == MAX_PART_SIZE);
+
+  // Where that extra byte would go over, the part is held to the cap instead.
+  KJ_EXPECT(firstRead(MAX_PART_SIZE) == MAX_PART_SIZE);
+  KJ_EXPECT(firstRead(uint64_t(1) << 40) == MAX_PART_SIZE);
+}
+
+struct TestSink final: public WritableStreamSink {
+  // Records what is written to it. While `blocked`, writes wait for `unblock()`.
+
+  kj::Vector<kj::ArrayPtr<const kj::byte>> writes;
+  bool blocked = false;
+  kj::Maybe<kj::Own<kj::PromiseFulfiller<void>>> pending;
+  bool ended = false;
+
+  kj::Promise<void> write(const void* buffer, size_t size) override {
+    writes.add(kj::arrayPtr(reinterpret_cast<const kj::byte*>(buffer), size));
+    if (!blocked) return kj::READY_NOW;
+    auto paf = kj::newPromiseAndFulfiller<void>();
+    pending = kj::mv(paf.fulfiller);
+    return kj::mv(paf.promise);
+  }
+  kj::Promise<void> write(kj::ArrayPtr<const kj::ArrayPtr<const kj::byte>> pieces) override {
+    KJ_UNIMPLEMENTED("not used");
+  }
+  kj::Promise<void> end() override {
+    ended = true;
+    return kj::READY_NOW;
+  }
+  void abort(kj::Exception reason) override {}
+
+  kj::PromiseFulfiller<void>& getPending() {
+    return *KJ_ASSERT_NONNULL(pending);
+  }
+};
+
+kj::Promise<void> pump(IdentityTransformStreamImpl& stream, TestSink& sink) {
+  return stream.pumpTo(sink, true).then([](DeferredProxy<void> proxy) {
+    return kj::mv(proxy.proxyTask);
+  });
+}
+
+KJ_TEST("IdentityTransformStreamImpl pumps writes straight to the sink") {
+  kj::EventLoop loop;
+  kj::WaitScope ws(loop);
+  auto stream = kj::refcounted<IdentityTransformStreamImpl>();
+  TestSink sink;
+  sink.blocked = true;
+
+  auto pumpPromise = pump(*stream, sink);
+  KJ_EXPECT(!pumpPromise.poll(ws));
+
+  // The sink writes from the writer's own buffer, and the write waits for it.
+  const char text[] = "abc";
+  auto write = stream->write(text, 3);
+  KJ_EXPECT(!write.poll(ws));
+  KJ_ASSERT(sink.writes.size() == 1);
+  KJ_EXPECT(sink.writes[0].begin() == reinterpret_cast<const kj::byte*>(text));
+  KJ_EXPECT(sink.writes[0].size() == 3);
+  sink.getPending().fulfill();
+  write.wait(ws);
+
+  sink.blocked = false;
+  stream->write("defg", 4).wait(ws);
+  KJ_ASSERT(sink.writes.size() == 2);
+  KJ_EXPECT(kj::heapString(sink.writes[1].asChars()) == "defg");
+
+  stream->end().wait(ws);
+  pumpPromise.wait(ws);
+  KJ_EXPECT(sink.ended);
+}
+
+KJ_TEST("FixedLengthStream pumps fail on the wrong length") {
+  kj::EventLoop loop;
+  kj::WaitScope ws(loop);
+
+  {
+    auto stream = kj::refcounted<IdentityTransformStreamImpl>(uint64_t(3));
+    TestSink sink;
+    auto pumpPromise = pump(*stream, sink);
+    KJ_EXPECT_THROW_MESSAGE("too many bytes", stream->write("abcd", 4).wait(ws));
+    KJ_EXPECT_THROW_MESSAGE("too many bytes", pumpPromise.wait(ws));
+    KJ_EXPECT(sink.writes.size() == 0);
+  }
+
+  {
+    auto stream = kj::refcounted<IdentityTransformStreamImpl>(uint64_t(5));
+    TestSink sink;
+    auto pumpPromise = pump(*stream, sink);
+    stream->write("ab", 2).wait(ws);
+    stream->end().wait(ws);
+    KJ_EXPECT_THROW_MESSAGE("did not see all expected bytes", pumpPromise.wait(ws));
+    KJ_EXPECT(!sink.ended);
+  }
+}
+
+KJ_TEST("IdentityTransformStreamImpl pump failures reach the writer") {
+  kj::EventLoop loop;
+  kj::WaitScope ws(loop);
+
+  {
+    // Canceling the pump mid-write fails the write.
+    auto stream = kj::refcounted<IdentityTransformStreamImpl>();
+    TestSink sink;
+    sink.blocked = true;
+    auto pumpPromise = pump(*stream, sink);
+    auto write = stream->write("abc", 3);
+    KJ_EXPECT(!write.poll(ws));
+    pumpPromise = nullptr;
+    KJ_EXPECT_THROW_MESSAGE("reader canceled", write.wait(ws));
+    KJ_EXPECT_THROW_MESSAGE("reader canceled", stream->write("def", 3).wait(ws));
+  }
+
+  {
+    // The sink failing fails the write with the sink's error.
+    auto stream = kj::refcounted<IdentityTransformStreamImpl>();
+    TestSink sink;
+    sink.blocked = true;
+    auto pumpPromise = pump(*stream, sink);
+    auto write = stream->write("abc", 3);
+    KJ_EXPECT(!write.poll(ws));
+    sink.getPending().reject(KJ_EXCEPTION(FAILED, "sink broke"));
+    KJ_EXPECT_THROW_MESSAGE("sink broke", write.wait(ws));
+    KJ_EXPECT_THROW_MESSAGE("sink broke", pumpPromise.wait(ws));
+    KJ_EXPECT_THROW_MESSAGE("sink broke", stream->write("def", 3).wait(ws));
+  }
+}
+
+}  // namespace
+}  // namespace workerd::api
@@ -60,67 +60,124 @@ kj::Promise<void> pumpTo(ReadableStreamSource& input, WritableStreamSink& output
 
 class AllReader {
   // Modified from AllReader in kj/async-io.c++.
-
-  using PartList = kj::Array<kj::ArrayPtr<byte>>;
+  //
+  // Reads into as few buffers as it can, each read filling whatever is left of the current one.
+  // If the stream knows its length, the first buffer is exactly big enough (plus one byte, which
+  // leaves room for readAllText()'s NUL terminator and lets the read that detects EOF share the
+  // same buffer), up to MAX_PART_SIZE: the length is only what the peer claims, so we don't
+  // allocate more than that before seeing the bytes. Otherwise buffers grow geometrically. If
+  // everything fits in one buffer, it is returned without being copied.
+
+  struct Part {
+    kj::Array<byte> buffer;
+    size_t filled = 0;
+  };
 
 public:
-  explicit AllReader(ReadableStreamSource& input, uint64_t limit)
+  explicit AllReader(ReadableStreamSource& input, uint64_t limit,
+                     kj::Maybe<const jsg::ExternalMemoryTracker::Counter&> memoryCounter)
       : input(input), limit(limit) {
+    KJ_IF_MAYBE(counter, memoryCounter) {
+      memory.emplace(*counter);
+    }
     JSG_REQUIRE(limit > 0, TypeError, "Memory limit exceeded before EOF.");
     KJ_IF_MAYBE(length, input.tryGetLength(StreamEncoding::IDENTITY)) {
       // Oh hey, we might be able to bail early.
       JSG_REQUIRE(*length < limit, TypeError, "Memory limit would be exceeded before EOF.");
+      expectedLength = *length;
     }
   }
 
   kj::Promise<kj::Array<byte>> readAllBytes() {
-    return loop().then([this](PartList&& partPtrs) {
+    return loop().then([this]() {
+      if (parts.size() == 1) {
+        auto& part = parts[0];
+        return part.buffer.slice(0, part.filled).attach(kj::mv(part.buffer));
+      }
+
       auto out = kj::heapArray<byte>(runningTotal);
-      copyInto(out, kj::mv(partPtrs));
+      copyInto(out);
       return kj::mv(out);
     });
   }
 
   kj::Promise<kj::String> readAllText() {
-    return loop().then([this](PartList&& partPtrs) {
+    return loop().then([this]() {
+      if (parts.size() == 1 && parts[0].filled < parts[0].buffer.size()) {
+        auto& part = parts[0];
+        part.buffer[part.filled] = '\0';
+        return kj::String(part.buffer.slice(0, part.filled + 1)
+            .attach(kj::mv(part.buffer)).releaseAsChars());
+      }
+
       auto out = kj::heapArray<char>(runningTotal + 1);
-      copyInto(out.slice(0, out.size() - 1).asBytes(), kj::mv(partPtrs));
+      copyInto(out.slice(0, out.size() - 1).asBytes());
       out.back() = '\0';
       return kj::String(kj::mv(out));
     });
   }
 
 private:
+  static constexpr size_t MIN_PART_SIZE = 4096;
+  static constexpr size_t MAX_PART_SIZE = 1024 * 1024;
+
   ReadableStreamSource& input;
   uint64_t limit;
-  kj::Vector<kj::Array<kj::byte>> parts;
+  kj::Maybe<uint64_t> expectedLength;
+  kj::Vector<Part> parts;
   uint64_t runningTotal = 0;
+  kj::Maybe<jsg::ExternalMemoryAdjustment> memory;
+  // Counts the buffers in `parts`, if the caller gave a counter.
 
-  kj::Promise<PartList> loop() {
-    auto bytes = kj::heapArray<kj::byte>(4096);
+  kj::Promise<void> loop() {
+    if (parts.empty() || parts.back().filled == parts.back().buffer.size()) {
+      auto& part = parts.add(Part { kj::heapArray<byte>(nextPartSize()) });
+      KJ_IF_MAYBE(m, memory) m->set(m->get() + part.buffer.size());
+    }
 
-    return input.tryRead(bytes.begin(), 1, bytes.size())
-        .then([this, bytes = kj::mv(bytes)](size_t amount) mutable
-        -> kj::Promise<PartList> {
+    auto& part = parts.back();
+    auto dest = part.buffer.slice(part.filled, part.buffer.size());
+    return input.tryRead(dest.begin(), 1, dest.size())
+        .then([this](size_t amount) -> kj::Promise<void> {
       if (amount == 0) {
-        return KJ_MAP(p, parts) { return p.asPtr(); };
+        if (parts.back().filled == 0) {
+          KJ_IF_MAYBE(m, memory) m->set(m->get() - parts.back().buffer.size());
+          parts.removeLast();
+        }
+        return kj::READY_NOW;
       }
 
       runningTotal += amount;
       if (runningTotal >= limit) {
         return JSG_KJ_EXCEPTION(FAILED, TypeError, "Memory limit exceeded before EOF.");
       }
-      parts.add(bytes.slice(0, amount).attach(kj::mv(bytes)));
+      parts.back().filled += amount;
       return loop();
     });
   }
 
-  void copyInto(kj::ArrayPtr<byte> out, PartList in) {
+  size_t nextPartSize() {
+    uint64_t size;
+    if (parts.empty()) {
+      size = expectedLength.map([](uint64_t length) {
+        return kj::min(length + 1, uint64_t(MAX_PART_SIZE));
+      }).orDefault(MIN_PART_SIZE);
+    } else {
+      // The stream turned out longer than expected (or its length wasn't known). Doubling the
+      // total each time keeps the number of reads logarithmic in the stream's length.
+      size = kj::max(kj::min(runningTotal, MAX_PART_SIZE), MIN_PART_SIZE);
+    }
+
+    // There's no point reading beyond the limit, since reaching it is an error anyway.
+    return kj::min(size, limit - runningTotal);
+  }
+
+  void copyInto(kj::ArrayPtr<byte> out) {
     size_t pos = 0;
-    for (auto& part: in) {
-      KJ_ASSERT(part.size() <= out.size() - pos);
-      memcpy(out.begin() + pos, part.begin(), part.size());
-      pos += part.size();
+    for (auto& part: parts) {
+      KJ_ASSERT(part.filled <= out.size() - pos);
+      memcpy(out.begin() + pos, part.buffer.begin(), part.filled);
+      pos += part.filled;
     }
   }
 };
@@ -343,13 +400,15 @@ kj::Maybe<uint64_t> ReadableStreamSource::tryGetLength(StreamEncoding encoding)
   return nullptr;
 }
 
-kj::Promise<kj::Array<byte>> ReadableStreamSource::readAllBytes(uint64_t limit) {
-  auto allReader = kj::heap<AllReader>(*this, limit);
+kj::Promise<kj::Array<byte>> ReadableStreamSource::readAllBytes(uint64_t limit,
+    kj::Maybe<const jsg::ExternalMemoryTracker::Counter&> memoryCounter) {
+  auto allReader = kj::heap<AllReader>(*this, limit, memoryCounter);
   return allReader->readAllBytes().attach(kj::mv(allReader));
 }
 
-kj::Promise<kj::String> ReadableStreamSource::readAllText(uint64_t limit) {
-  auto allReader = kj::heap<AllReader>(*this, limit);
+kj::Promise<kj::String> ReadableStreamSource::readAllText(uint64_t limit,
+    kj::Maybe<const jsg::ExternalMemoryTracker::Counter&> memoryCounter) {
+  auto allReader = kj::heap<AllReader>(*this, limit, memoryCounter);
   return allReader->readAllText().attach(kj::mv(allReader));
 }
 
@@ -590,7 +649,8 @@ ReadableStreamController::Tee ReadableStreamInternalController::tee(jsg::Lock& j
         return makeTee(kj::mv(tee->branches[0]), kj::mv(tee->branches[1]));
       }
 
-      auto tee = kj::newTee(kj::heap<TeeAdapter>(kj::mv(readable)), bufferLimit);
+      auto tee = newBackpressureTee(kj::heap<TeeAdapter>(kj::mv(readable)), bufferLimit,
+          ioContext.getLimitEnforcer().getTeeBackpressureThreshold());
 
       return makeTee(
           kj::heap<TeeBranch>(newTeeErrorAdapter(kj::mv(tee.branches[0]))),
@@ -1652,7 +1712,8 @@ jsg::Promise<kj::Array<byte>> ReadableStreamInternalController::readAllBytes(
     KJ_CASE_ONEOF(readable, Readable) {
       auto source = KJ_ASSERT_NONNULL(removeSource(js));
       auto& context = IoContext::current();
-      return context.awaitIoLegacy(source->readAllBytes(limit).attach(kj::mv(source)));
+      auto& counter = js.getExternalMemory().getCounter("StreamBuffers");
+      return context.awaitIoLegacy(source->readAllBytes(limit, counter).attach(kj::mv(source)));
     }
   }
   KJ_UNREACHABLE;
@@ -1675,7 +1736,8 @@ jsg::Promise<kj::String> ReadableStreamInternalController::readAllText(
     KJ_CASE_ONEOF(readable, Readable) {
       auto source = KJ_ASSERT_NONNULL(removeSource(js));
       auto& context = IoContext::current();
-      return context.awaitIoLegacy(source->readAllText(limit).attach(kj::mv(source)));
+      auto& counter = js.getExternalMemory().getCounter("StreamBuffers");
+      return context.awaitIoLegacy(source->readAllText(limit, counter).attach(kj::mv(source)));
     }
   }
   KJ_UNREACHABLE;
@@ -1694,38 +1756,22 @@ kj::Promise<size_t> IdentityTransformStreamImpl::tryRead(
     void* buffer,
     size_t minBytes,
     size_t maxBytes) {
-  size_t total = 0;
-  while (total < minBytes) {
-    // TODO(perf): tryReadInternal was written assuming minBytes would always be 1 but we've now
-    // introduced an API for user to specify a larger minBytes. For now, this is implemented as a
-    // naiive loop dispatching to the 1 byte version but would be better to bake it deeper into
-    // the implementation where it can be more efficient.
-    auto amount = co_await tryReadInternal(buffer, maxBytes);
-    KJ_ASSERT(amount <= maxBytes);
-    if (amount == 0) {
-      // EOF.
-      break;
-    }
-
-    total += amount;
-    buffer = reinterpret_cast<char*>(buffer) + amount;
-    maxBytes -= amount;
+  minBytes = kj::min(minBytes, maxBytes);
+  if (minBytes == 0) {
+    return size_t(0);
   }
 
-  co_return total;
-}
-
-kj::Promise<size_t> IdentityTransformStreamImpl::tryReadInternal(void* buffer, size_t maxBytes) {
-  auto promise = readHelper(kj::arrayPtr(static_cast<kj::byte*>(buffer), maxBytes));
+  auto promise = readHelper(kj::arrayPtr(static_cast<kj::byte*>(buffer), maxBytes), minBytes);
 
   KJ_IF_MAYBE(l, limit) {
-    promise = promise.then([this, &l = *l](size_t amount) -> kj::Promise<size_t> {
+    promise = promise.then([this, &l = *l, minBytes](size_t amount) -> kj::Promise<size_t> {
       if (amount > l) {
         auto exception = JSG_KJ_EXCEPTION(FAILED, TypeError,
             "Attempt to write too many bytes through a FixedLengthStream.");
         cancel(exception);
         return kj::mv(exception);
-      } else if (amount == 0 && l != 0) {
+      } else if (amount < minBytes && amount < l) {
+        // A short read means the stream was closed.
         auto exception = JSG_KJ_EXCEPTION(FAILED, TypeError,
             "FixedLengthStream did not see all expected bytes before close().");
         cancel(exception);
@@ -1752,7 +1798,85 @@ kj::Promise<DeferredProxy<void>> IdentityTransformStreamImpl::pumpTo(
   JSG_REQUIRE(kj::dynamicDowncastIfAvailable<IdentityTransformStreamImpl>(output) == nullptr,
       TypeError, "Inter-TransformStream ReadableStream.pipeTo() is not implemented.");
 
-  return ReadableStreamSource::pumpTo(output, end);
+  KJ_IF_MAYBE(p, output.tryPumpFrom(*this, end)) {
+    return kj::mv(*p);
+  }
+
+  // The writes come from JavaScript, so the pump needs the IoContext to stay live anyway.
+  return addNoopDeferredProxy(pumpLoop(output, end));
+}
+
+kj::Promise<void> IdentityTransformStreamImpl::pumpLoop(WritableStreamSink& output, bool end) {
+  for (;;) {
+    if (state.is<Idle>()) {
+      auto paf = kj::newPromiseAndFulfiller<void>();
+      state = PumpRequest { kj::mv(paf.fulfiller) };
+      co_await paf.promise;
+    } else KJ_IF_MAYBE(request, state.tryGet<WriteRequest>()) {
+      auto bytes = request->bytes;
+      KJ_IF_MAYBE(l, limit) {
+        if (bytes.size() > *l) {
+          auto exception = JSG_KJ_EXCEPTION(FAILED, TypeError,
+              "Attempt to write too many bytes through a FixedLengthStream.");
+          cancel(exception);
+          kj::throwFatalException(kj::mv(exception));
+        }
+        *l -= bytes.size();
+      }
+
+      // The writer's buffer stays valid until we fulfill its request, so the sink can write
+      // straight from it.
+      bool finishedWriting = false;
+      KJ_DEFER(if (!finishedWriting) pumpCanceled());
+      kj::Maybe<kj::Exception> error;
+      try {
+        co_await output.write(bytes.begin(), bytes.size());
+      } catch (...) {
+        error = kj::getCaughtExceptionAsKj();
+      }
+      finishedWriting = true;
+
+      KJ_IF_MAYBE(e, error) {
+        // The sink failed, so the writer fails with the sink's error.
+        cancel(kj::cp(*e));
+        kj::throwFatalException(kj::mv(*e));
+      }
+
+      // (If the stream was canceled meanwhile, the writer has already been rejected.)
+      KJ_IF_MAYBE(finished, state.tryGet<WriteRequest>()) {
+        finished->fulfiller->fulfill();
+        state = Idle();
+      }
+    } else if (state.is<StreamStates::Closed>()) {
+      KJ_IF_MAYBE(l, limit) {
+        if (*l != 0) {
+          auto exception = JSG_KJ_EXCEPTION(FAILED, TypeError,
+              "FixedLengthStream did not see all expected bytes before close().");
+          cancel(exception);
+          kj::throwFatalException(kj::mv(exception));
+        }
+      }
+      break;
+    } else KJ_IF_MAYBE(exception, state.tryGet<kj::Exception>()) {
+      kj::throwFatalException(kj::cp(*exception));
+    } else {
+      KJ_FAIL_ASSERT("read operation already in flight");
+    }
+  }
+
+  if (end) {
+    co_await output.end();
+  }
+}
+
+void IdentityTransformStreamImpl::pumpCanceled() {
+  // As in writeHelper() when a read was canceled, the writer finds out through an error. We can't
+  // tell how much of its buffer the sink took, so the stream can't carry on.
+  KJ_IF_MAYBE(request, state.tryGet<WriteRequest>()) {
+    auto exception = KJ_EXCEPTION(DISCONNECTED, "reader canceled");
+    request->fulfiller->reject(kj::cp(exception));
+    state = kj::mv(exception);
+  }
 }
 
 kj::Maybe<uint64_t> IdentityTransformStreamImpl::tryGetLength(StreamEncoding encoding) {
@@ -1769,11 +1893,15 @@ void IdentityTransformStreamImpl::cancel(kj::Exception reason) {
       // This is fine.
     }
     KJ_CASE_ONEOF(request, ReadRequest) {
-      request.fulfiller->fulfill(size_t(0));
+      // Whatever the read has already received is still delivered.
+      request.fulfiller->fulfill(size_t(request.filled));
     }
     KJ_CASE_ONEOF(request, WriteRequest) {
       request.fulfiller->reject(kj::cp(reason));
     }
+    KJ_CASE_ONEOF(request, PumpRequest) {
+      request.fulfiller->reject(kj::cp(reason));
+    }
     KJ_CASE_ONEOF(exception, kj::Exception) {
       // Already errored.
       return;
@@ -1821,6 +1949,9 @@ void IdentityTransformStreamImpl::abort(kj::Exception reason) {
     KJ_CASE_ONEOF(request, WriteRequest) {
       KJ_FAIL_ASSERT("abort() is supposed to wait for any pending write() to finish");
     }
+    KJ_CASE_ONEOF(request, PumpRequest) {
+      request.fulfiller->reject(kj::cp(reason));
+    }
     KJ_CASE_ONEOF(exception, kj::Exception) {
       // Already errored.
       return;
@@ -1835,18 +1966,22 @@ void IdentityTransformStreamImpl::abort(kj::Exception reason) {
   // TODO(conform): Proactively put ReadableStream into Errored state.
 }
 
-kj::Promise<size_t> IdentityTransformStreamImpl::readHelper(kj::ArrayPtr<kj::byte> bytes) {
+kj::Promise<size_t> IdentityTransformStreamImpl::readHelper(
+    kj::ArrayPtr<kj::byte> bytes, size_t minBytes) {
   KJ_SWITCH_ONEOF(state) {
     KJ_CASE_ONEOF(idle, Idle) {
       // No outstanding write request, switch to ReadRequest state.
 
       auto paf = kj::newPromiseAndFulfiller<size_t>();
-      state = ReadRequest { bytes, kj::mv(paf.fulfiller) };
+      state = ReadRequest { bytes, minBytes, 0, kj::mv(paf.fulfiller) };
       return kj::mv(paf.promise);
     }
     KJ_CASE_ONEOF(request, ReadRequest) {
       KJ_FAIL_ASSERT("read operation already in flight");
     }
+    KJ_CASE_ONEOF(request, PumpRequest) {
+      KJ_FAIL_ASSERT("read operation already in flight");
+    }
     KJ_CASE_ONEOF(request, WriteRequest) {
       if (bytes.size() >= request.bytes.size()) {
         // The write buffer will entirely fit into our read buffer; fulfill both requests.
@@ -1854,13 +1989,21 @@ kj::Promise<size_t> IdentityTransformStreamImpl::readHelper(kj::ArrayPtr<kj::byt
         auto result = request.bytes.size();
         request.fulfiller->fulfill();
 
+        if (result < minBytes) {
+          // Not enough yet; wait for the next writes to fill in the rest.
+          auto paf = kj::newPromiseAndFulfiller<size_t>();
+          state = ReadRequest { bytes, minBytes, result, kj::mv(paf.fulfiller) };
+          return kj::mv(paf.promise);
+        }
+
         // Switch to idle state.
         state = Idle();
 
         return result;
       }
 
-      // The write buffer won't quite fit into our read buffer; fulfill only the read request.
+      // The write buffer won't quite fit into our read buffer, which is therefore full; fulfill
+      // only the read request.
       memcpy(bytes.begin(), request.bytes.begin(), bytes.size());
       request.bytes = request.bytes.slice(bytes.size(), request.bytes.size());
       return bytes.size();
@@ -1905,31 +2048,57 @@ kj::Promise<void> IdentityTransformStreamImpl::writeHelper(kj::ArrayPtr<const kj
       }
 
       if (bytes.size() == 0) {
-        // This is a close operation.
-        request.fulfiller->fulfill(size_t(0));
+        // This is a close operation. The read gets whatever it has, short of its minimum.
+        request.fulfiller->fulfill(size_t(request.filled));
         state = StreamStates::Closed();
         return kj::READY_NOW;
       }
 
-      KJ_ASSERT(request.bytes.size() > 0);
-
-      if (request.bytes.size() >= bytes.size()) {
-        // Our write buffer will entirely fit into the read buffer; fulfill both requests.
-        memcpy(request.bytes.begin(), bytes.begin(), bytes.size());
-        request.fulfiller->fulfill(bytes.size());
-        state = Idle();
+      auto space = request.bytes.slice(request.filled, request.bytes.size());
+      KJ_ASSERT(space.size() > 0);
+
+      if (space.size() >= bytes.size()) {
+        // Our write buffer will entirely fit into the read buffer; fulfill the write, and the
+        // read too if it now has enough.
+        memcpy(space.begin(), bytes.begin(), bytes.size());
+        request.filled += bytes.size();
+        if (request.filled >= request.minBytes) {
+          request.fulfiller->fulfill(size_t(request.filled));
+          state = Idle();
+        }
         return kj::READY_NOW;
       }
 
       // Our write buffer won't quite fit into the read buffer; fulfill only the read request.
-      memcpy(request.bytes.begin(), bytes.begin(), request.bytes.size());
-      bytes = bytes.slice(request.bytes.size(), bytes.size());
+      memcpy(space.begin(), bytes.begin(), space.size());
+      bytes = bytes.slice(space.size(), bytes.size());
       request.fulfiller->fulfill(request.bytes.size());
 
       auto paf = kj::newPromiseAndFulfiller<void>();
       state = WriteRequest { bytes, kj::mv(paf.fulfiller) };
       return kj::mv(paf.promise);
     }
+    KJ_CASE_ONEOF(request, PumpRequest) {
+      if (!request.fulfiller->isWaiting()) {
+        // The pump was canceled; treat it like a canceled read, above.
+        state = KJ_EXCEPTION(DISCONNECTED, "reader canceled");
+        return writeHelper(bytes);
+      }
+
+      auto pumpFulfiller = kj::mv(request.fulfiller);
+      kj::Promise<void> result = kj::READY_NOW;
+      if (bytes.size() == 0) {
+        // This is a close operation.
+        state = StreamStates::Closed();
+      } else {
+        // pumpLoop() will write out our buffer and then fulfill us.
+        auto paf = kj::newPromiseAndFulfiller<void>();
+        state = WriteRequest { bytes, kj::mv(paf.fulfiller) };
+        result = kj::mv(paf.promise);
+      }
+      pumpFulfiller->fulfill();
+      return result;
+    }
     KJ_CASE_ONEOF(request, WriteRequest) {
       KJ_FAIL_ASSERT("write operation already in flight");
     }
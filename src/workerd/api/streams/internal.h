@@ -45,8 +45,12 @@ public:
 
   virtual kj::Maybe<uint64_t> tryGetLength(StreamEncoding encoding);
 
-  kj::Promise<kj::Array<byte>> readAllBytes(uint64_t limit);
-  kj::Promise<kj::String> readAllText(uint64_t limit);
+  kj::Promise<kj::Array<byte>> readAllBytes(uint64_t limit,
+      kj::Maybe<const jsg::ExternalMemoryTracker::Counter&> memoryCounter = nullptr);
+  kj::Promise<kj::String> readAllText(uint64_t limit,
+      kj::Maybe<const jsg::ExternalMemoryTracker::Counter&> memoryCounter = nullptr);
+  // Buffers the whole stream. If `memoryCounter` is given, the buffers are counted there until
+  // the result is returned.
 
   virtual void cancel(kj::Exception reason);
   // Hook to inform this ReadableStreamSource that the ReadableStream has been canceled. This only
@@ -338,12 +342,14 @@ class IdentityTransformStreamImpl: public kj::Refcounted,
                                    public ReadableStreamSource,
                                    public WritableStreamSink {
   // An implementation of ReadableStreamSource and WritableStreamSink which communicates read and
-  // write requests via a OneOf.
+  // write requests via a OneOf, in the manner of kj::newOneWayPipe().
+  //
+  // A read copies straight from the pending write's buffer into the reader's. pumpTo() does
+  // better: it hands each pending write's buffer straight to the output sink, and the write
+  // completes when the sink's write does.
   //
   // This class is also used as the implementation of FixedLengthStream, in which case `limit` is
   // non-nullptr.
-  //
-  // TODO(soon): Reimplement this in terms of kj::OneWayPipe, so we can optimize pumpTo().
 
 public:
   explicit IdentityTransformStreamImpl(kj::Maybe<uint64_t> limit = nullptr)
@@ -362,8 +368,8 @@ public:
   // ReadableStreamSource implementation -------------------------------------------------
 
   kj::Promise<size_t> tryRead(void* buffer, size_t minBytes, size_t maxBytes) override;
-
-  kj::Promise<size_t> tryReadInternal(void* buffer, size_t maxBytes);
+  // Waits for as many writes as it takes to get `minBytes`, copying each into `buffer` as it
+  // comes, so the read completes once however the writer splits up its data.
 
   kj::Promise<DeferredProxy<void>> pumpTo(WritableStreamSink& output, bool end) override;
 
@@ -382,10 +388,15 @@ public:
   void abort(kj::Exception reason) override;
 
 private:
-  kj::Promise<size_t> readHelper(kj::ArrayPtr<kj::byte> bytes);
+  kj::Promise<size_t> readHelper(kj::ArrayPtr<kj::byte> bytes, size_t minBytes);
 
   kj::Promise<void> writeHelper(kj::ArrayPtr<const kj::byte> bytes);
 
+  kj::Promise<void> pumpLoop(WritableStreamSink& output, bool end);
+
+  void pumpCanceled();
+  // Called if a pump is canceled while writing out a pending write's buffer.
+
   kj::Maybe<uint64_t> limit;
 
   struct ReadRequest {
@@ -393,6 +404,11 @@ private:
     // WARNING: `bytes` may be invalid if fulfiller->isWaiting() returns false! (This indicates the
     //   read was canceled.)
 
+    size_t minBytes;
+    size_t filled;
+    // The read completes once writes have filled in `minBytes` of `bytes`. `filled` bytes have
+    // been so far.
+
     kj::Own<kj::PromiseFulfiller<size_t>> fulfiller;
   };
 
@@ -401,9 +417,16 @@ private:
     kj::Own<kj::PromiseFulfiller<void>> fulfiller;
   };
 
+  struct PumpRequest {
+    // pumpTo() is waiting for the next write. The fulfiller is fulfilled once there is a
+    // WriteRequest (or the stream is closed) for it to pick up.
+    kj::Own<kj::PromiseFulfiller<void>> fulfiller;
+  };
+
   struct Idle {};
 
-  kj::OneOf<Idle, ReadRequest, WriteRequest, kj::Exception, StreamStates::Closed> state = Idle();
+  kj::OneOf<Idle, ReadRequest, WriteRequest, PumpRequest, kj::Exception, StreamStates::Closed>
+      state = Idle();
 };
 
 }  // namespace workerd::api
@@ -0,0 +1,167 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+// Microbenchmarks for ValueQueue and ByteQueue.
+//
+// Run with `bazel run -c opt //src/workerd/api:queue-bench`. Results are written to stdout as
+// JSON lines; see util/benchmark.h.
+
+#include "queue.h"
+#include <workerd/jsg/jsg.h>
+#include <workerd/jsg/setup.h>
+#include <workerd/util/benchmark.h>
+
+namespace workerd::api {
+namespace {
+
+struct BenchContext: public jsg::Object {
+  JSG_RESOURCE_TYPE(BenchContext) {}
+};
+JSG_DECLARE_ISOLATE_TYPE(BenchIsolate, BenchContext);
+
+struct Preamble {
+  BenchIsolate isolate;
+  BenchIsolate::Lock lock;
+  v8::HandleScope scope;
+  v8::Local<v8::Context> context;
+  v8::Context::Scope contextScope;
+  Preamble(jsg::V8System& system)
+    : isolate(system),
+      lock(isolate),
+      scope(lock.v8Isolate),
+      context(lock.newContext<BenchContext>().getHandle(lock.v8Isolate)),
+      contextScope(context) {}
+
+  jsg::Lock& getJs() { return jsg::Lock::from(lock.v8Isolate); }
+};
+
+constexpr size_t READ_SIZE = 64 * 1024;
+constexpr uint MICROTASK_BATCH = 1000;
+// Reads are issued in batches of this many before running microtasks, as a stream being read in
+// a loop by JavaScript would be.
+
+void benchmarkValueQueue(jsg::V8System& system) {
+  Preamble preamble(system);
+  auto& js = preamble.getJs();
+
+  constexpr uint ENTRIES = 100'000;
+  ValueQueue queue(ENTRIES);
+  ValueQueue::Consumer consumer(queue);
+
+  auto pushTime = timeBenchmark([&]() {
+    for (uint i = 0; i < ENTRIES; i++) {
+      queue.push(js, kj::refcounted<ValueQueue::Entry>(
+          js.v8Ref(v8::True(js.v8Isolate).As<v8::Value>()), 1));
+    }
+  });
+
+  uint received = 0;
+  auto readTime = timeBenchmark([&]() {
+    for (uint i = 0; i < ENTRIES; i++) {
+      auto prp = js.newPromiseAndResolver<ReadResult>();
+      consumer.read(js, ValueQueue::ReadRequest { .resolver = kj::mv(prp.resolver) });
+      prp.promise.then(js, [&](jsg::Lock& js, ReadResult result) { ++received; });
+      if (i % MICROTASK_BATCH == MICROTASK_BATCH - 1) {
+        js.v8Isolate->PerformMicrotaskCheckpoint();
+      }
+    }
+    js.v8Isolate->PerformMicrotaskCheckpoint();
+  });
+
+  KJ_ASSERT(received == ENTRIES);
+  reportBenchmark("value-queue/push", ENTRIES, pushTime);
+  reportBenchmark("value-queue/read", ENTRIES, readTime);
+}
+
+ByteQueue::ReadRequest readInto(jsg::Lock& js, jsg::Promise<ReadResult>::Resolver resolver) {
+  return ByteQueue::ReadRequest {
+    .resolver = kj::mv(resolver),
+    .pullInto {
+      .store = jsg::BackingStore::alloc(js, READ_SIZE),
+    },
+  };
+}
+
+void benchmarkByteQueue(jsg::V8System& system, size_t chunkSize) {
+  // Pushes chunks of `chunkSize` bytes, then drains the queue with reads of up to READ_SIZE
+  // bytes. Small chunks are coalesced into each read, while large ones take a read apiece.
+
+  Preamble preamble(system);
+  auto& js = preamble.getJs();
+
+  uint chunks = kj::min(100'000, (16u << 20) / chunkSize);
+  ByteQueue queue(chunks * chunkSize);
+  ByteQueue::Consumer consumer(queue);
+
+  auto pushTime = timeBenchmark([&]() {
+    for (uint i = 0; i < chunks; i++) {
+      queue.push(js, kj::refcounted<ByteQueue::Entry>(jsg::BackingStore::alloc(js, chunkSize)));
+    }
+  });
+
+  size_t total = 0;
+  uint reads = 0;
+  auto readTime = timeBenchmark([&]() {
+    while (consumer.size() > 0) {
+      auto prp = js.newPromiseAndResolver<ReadResult>();
+      consumer.read(js, readInto(js, kj::mv(prp.resolver)));
+      prp.promise.then(js, [&](jsg::Lock& js, ReadResult result) {
+        total += jsg::BufferSource(js, KJ_ASSERT_NONNULL(result.value).getHandle(js)).size();
+      });
+      ++reads;
+      js.v8Isolate->PerformMicrotaskCheckpoint();
+    }
+  });
+
+  KJ_ASSERT(total == chunks * chunkSize);
+  reportBenchmark("byte-queue/push", chunks, pushTime, {{"chunkSize", double(chunkSize)}});
+  reportBenchmark("byte-queue/read", reads, readTime,
+                  {{"chunkSize", double(chunkSize)}, {"bytes", double(total)}});
+}
+
+void benchmarkByteQueuePendingReads(jsg::V8System& system, size_t chunkSize) {
+  // The steady state of a stream whose reader keeps up with its writer: each push fulfills a read
+  // that is already waiting.
+
+  Preamble preamble(system);
+  auto& js = preamble.getJs();
+
+  constexpr uint CHUNKS = 100'000;
+  ByteQueue queue(chunkSize);
+  ByteQueue::Consumer consumer(queue);
+
+  size_t total = 0;
+  auto elapsed = timeBenchmark([&]() {
+    for (uint i = 0; i < CHUNKS; i++) {
+      auto prp = js.newPromiseAndResolver<ReadResult>();
+      consumer.read(js, readInto(js, kj::mv(prp.resolver)));
+      prp.promise.then(js, [&](jsg::Lock& js, ReadResult result) {
+        total += jsg::BufferSource(js, KJ_ASSERT_NONNULL(result.value).getHandle(js)).size();
+      });
+      queue.push(js, kj::refcounted<ByteQueue::Entry>(jsg::BackingStore::alloc(js, chunkSize)));
+      js.v8Isolate->PerformMicrotaskCheckpoint();
+    }
+  });
+
+  KJ_ASSERT(total == CHUNKS * chunkSize);
+  reportBenchmark("byte-queue/push-to-pending-read", CHUNKS, elapsed,
+                  {{"chunkSize", double(chunkSize)}});
+}
+
+}  // namespace
+}  // namespace workerd::api
+
+int main() {
+  using namespace workerd::api;
+
+  workerd::jsg::V8System system;
+  benchmarkValueQueue(system);
+  for (size_t chunkSize: {16, 1024, 64 * 1024}) {
+    benchmarkByteQueue(system, chunkSize);
+  }
+  for (size_t chunkSize: {16, 4096}) {
+    benchmarkByteQueuePendingReads(system, chunkSize);
+  }
+  return 0;
+}
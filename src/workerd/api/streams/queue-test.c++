@@ -1238,6 +1238,70 @@ KJ_TEST("ByteQueue with multiple default consumers with atLeast (different rate)
   js.v8Isolate->PerformMicrotaskCheckpoint();
 }
 
+KJ_TEST("ByteQueue coalesces small chunks") {
+  Preamble preamble;
+  auto& js = preamble.getJs();
+
+  ByteQueue queue(2);
+  ByteQueue::Consumer consumer(queue);
+
+  // Pushes `count` chunks of `size` bytes each, numbering the bytes sequentially.
+  uint next = 0;
+  const auto push = [&](size_t count, size_t size) {
+    for (size_t i = 0; i < count; i++) {
+      auto store = jsg::BackingStore::alloc(js, size);
+      for (auto& b: store.asArrayPtr()) b = next++;
+      queue.push(js, kj::refcounted<ByteQueue::Entry>(kj::mv(store)));
+    }
+  };
+
+  // Reads up to `size` bytes, expecting them to continue the sequence.
+  uint expected = 0;
+  const auto readAndCheck = [&](size_t size) {
+    auto prp = js.newPromiseAndResolver<ReadResult>();
+    consumer.read(js, ByteQueue::ReadRequest {
+      .resolver = kj::mv(prp.resolver),
+      .pullInto {
+        .store = jsg::BackingStore::alloc(js, size),
+      },
+    });
+    size_t received = 0;
+    prp.promise.then(js, [&](jsg::Lock& js, ReadResult result) {
+      KJ_ASSERT(!result.done);
+      jsg::BufferSource source(js, KJ_ASSERT_NONNULL(result.value).getHandle(js));
+      for (auto b: source.asArrayPtr()) {
+        KJ_ASSERT(b == kj::byte(expected++));
+      }
+      received = source.size();
+    });
+    js.v8Isolate->PerformMicrotaskCheckpoint();
+    return received;
+  };
+
+  // Lots of tiny chunks, and a larger one that isn't coalesced, all come back out in order.
+  push(1000, 3);
+  push(1, 5000);
+  push(10, 7);
+  KJ_ASSERT(consumer.size() == 8070);
+  KJ_ASSERT(queue.size() == 8070);
+
+  size_t total = 0;
+  while (total < 8070) {
+    total += readAndCheck(1500);
+  }
+  KJ_ASSERT(total == 8070);
+  KJ_ASSERT(consumer.size() == 0);
+
+  // A clone shares the data buffered so far, and neither consumer sees the other's state.
+  push(10, 3);
+  auto clone = consumer.clone(js);
+  push(10, 3);
+  KJ_ASSERT(consumer.size() == 60);
+  KJ_ASSERT(clone->size() == 60);
+  KJ_ASSERT(readAndCheck(100) == 60);
+  KJ_ASSERT(clone->size() == 60);
+}
+
 #pragma endregion ByteQueue Tests
 
 }  // namespace
@@ -209,6 +209,14 @@ size_t ValueQueue::getConsumerCount() { return impl.getConsumerCount(); }
 #pragma region ByteQueue::ReadRequest
 
 namespace {
+constexpr size_t MAX_COALESCED_CHUNK_SIZE = 1024;
+// Chunks (or chunk remainders) up to this size that end up buffered in a consumer are copied into
+// a coalescing entry rather than being held on to individually.
+
+constexpr size_t MIN_COALESCING_ENTRY_SIZE = 4096;
+constexpr size_t MAX_COALESCING_ENTRY_SIZE = 64 * 1024;
+// Coalescing entries are sized to the queue's highWaterMark, clamped to this range.
+
 void maybeInvalidateByobRequest(kj::Maybe<ByteQueue::ByobRequest&>& req) {
   KJ_IF_MAYBE(byobRequest, req) {
     byobRequest->invalidate();
@@ -268,11 +276,29 @@ kj::Own<ByteQueue::ByobRequest> ByteQueue::ReadRequest::makeByobReadRequest(
 
 #pragma region ByteQueue::Entry
 
-ByteQueue::Entry::Entry(jsg::BackingStore store) : store(kj::mv(store)) {}
+ByteQueue::Entry::Entry(jsg::BackingStore store)
+    : store(kj::mv(store)), size(this->store.size()) {}
+
+kj::Own<ByteQueue::Entry> ByteQueue::Entry::coalescing(jsg::Lock& js, size_t capacity) {
+  auto entry = kj::refcounted<Entry>(jsg::BackingStore::alloc(js, capacity));
+  entry->size = 0;
+  return kj::mv(entry);
+}
 
-kj::ArrayPtr<kj::byte> ByteQueue::Entry::toArrayPtr() { return store.asArrayPtr(); }
+kj::ArrayPtr<kj::byte> ByteQueue::Entry::toArrayPtr() { return store.asArrayPtr().slice(0, size); }
 
-size_t ByteQueue::Entry::getSize() const { return store.size(); }
+size_t ByteQueue::Entry::getSize() const { return size; }
+
+bool ByteQueue::Entry::tryAppend(kj::ArrayPtr<const kj::byte> data) {
+  KJ_IREQUIRE(!isShared());
+  auto dest = store.asArrayPtr();
+  if (dest.size() - size < data.size()) {
+    return false;
+  }
+  std::copy(data.begin(), data.end(), dest.begin() + size);
+  size += data.size();
+  return true;
+}
 
 #pragma endregion ByteQueue::Entry
 
@@ -511,7 +537,37 @@ void ByteQueue::handlePush(
     QueueImpl& queue,
     kj::Own<Entry> newEntry) {
   const auto bufferData = [&](size_t offset) {
-    state.queueTotalSize += newEntry->getSize() - offset;
+    auto amount = newEntry->getSize() - offset;
+    state.queueTotalSize += amount;
+
+    // Streams that enqueue lots of tiny chunks would otherwise leave us holding an entry per
+    // chunk and walking all of them on every read, so small chunks are copied into a contiguous
+    // coalescing entry at the tail of the buffer instead. We only do this when this consumer is
+    // the only one: with several (tee) consumers the entry is shared, and copying it once per
+    // consumer would cost more than it saves.
+    if (amount <= MAX_COALESCED_CHUNK_SIZE && queue.getConsumerCount() == 1) {
+      auto data = newEntry->toArrayPtr().slice(offset, newEntry->getSize());
+      if (!state.buffer.empty()) {
+        KJ_IF_MAYBE(tail, state.buffer.back().tryGet<QueueEntry>()) {
+          // A cloned consumer shares our entries, so we must not append to them any more.
+          if (!tail->entry->isShared() && tail->entry->tryAppend(data)) {
+            return;
+          }
+        }
+      }
+      auto capacity = kj::min(kj::max(queue.highWaterMark, MIN_COALESCING_ENTRY_SIZE),
+                              MAX_COALESCING_ENTRY_SIZE);
+      if (amount < capacity) {
+        auto entry = Entry::coalescing(js, capacity);
+        KJ_ASSERT(entry->tryAppend(data));
+        state.buffer.emplace_back(QueueEntry {
+          .entry = kj::mv(entry),
+          .offset = 0,
+        });
+        return;
+      }
+    }
+
     state.buffer.emplace_back(QueueEntry {
       .entry = kj::mv(newEntry),
       .offset = offset,
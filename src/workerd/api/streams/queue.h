@@ -798,17 +798,30 @@ public:
   class Entry final: public kj::Refcounted {
     // A byte queue entry consists of a jsg::BackingStore containing a non-zero-length
     // sequence of bytes. The size is determined by the number of bytes in the entry.
+    //
+    // An entry created by coalescing() instead starts out empty, with room for up to
+    // `capacity` bytes, and is filled by tryAppend(). Consumers use these to pack runs of
+    // small chunks into one contiguous buffer rather than holding an entry per chunk.
   public:
     explicit Entry(jsg::BackingStore store);
 
+    static kj::Own<Entry> coalescing(jsg::Lock& js, size_t capacity);
+
     kj::ArrayPtr<kj::byte> toArrayPtr();
 
     size_t getSize() const;
 
+    bool tryAppend(kj::ArrayPtr<const kj::byte> data);
+    // Copies `data` onto the end of the entry if it fits in the remaining capacity, returning
+    // false (and copying nothing) otherwise. Must only be called on an entry that isn't shared,
+    // since other holders would see its contents change.
+
     inline void visitForGc(jsg::GcVisitor& visitor) {}
 
   private:
     jsg::BackingStore store;
+    size_t size;
+    // The number of bytes of `store` in use. Equal to store.size() except for coalescing entries.
   };
 
   struct QueueEntry {
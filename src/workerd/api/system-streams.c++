@@ -93,7 +93,8 @@ kj::Maybe<ReadableStreamSource::Tee> EncodedAsyncInputStream::tryTee(uint64_t li
   // Additionally, we should propagate the fact that this stream is a native stream to the branches
   // of the tee, so that branches which fall behind their siblings (and thus are reading from the
   // tee buffer) still register pending events correctly.
-  auto tee = kj::newTee(kj::mv(inner), limit);
+  auto tee = newBackpressureTee(kj::mv(inner), limit,
+      ioContext.getLimitEnforcer().getTeeBackpressureThreshold());
 
   Tee result;
   result.branches[0] = newSystemStream(newTeeErrorAdapter(kj::mv(tee.branches[0])), encoding);
@@ -114,6 +115,60 @@ void EncodedAsyncInputStream::ensureIdentityEncoding() {
 // =======================================================================================
 // EncodedAsyncOutputStream
 
+class NativePumpAdapter final: public kj::AsyncOutputStream {
+  // Wraps the output of a pump between two native streams. Inputs with their own `pumpTo()`
+  // (such as pipes and tees) pump as they would have anyway, and outputs with their own
+  // `tryPumpFrom()` still get the first chance to take over. Otherwise, KJ's default pump would
+  // copy through a 4KiB buffer; we copy through a much larger one, so that a large body takes a
+  // small fraction of the reads, writes, and event loop turns.
+
+public:
+  explicit NativePumpAdapter(kj::AsyncOutputStream& inner): inner(inner) {}
+
+  kj::Promise<void> write(const void* buffer, size_t size) override {
+    return inner.write(buffer, size);
+  }
+
+  kj::Promise<void> write(kj::ArrayPtr<const kj::ArrayPtr<const byte>> pieces) override {
+    return inner.write(pieces);
+  }
+
+  kj::Promise<void> whenWriteDisconnected() override {
+    return inner.whenWriteDisconnected();
+  }
+
+  kj::Maybe<kj::Promise<uint64_t>> tryPumpFrom(
+      kj::AsyncInputStream& input, uint64_t amount) override {
+    KJ_IF_MAYBE(promise, inner.tryPumpFrom(input, amount)) {
+      return kj::mv(*promise);
+    }
+    return pumpLoop(input, amount);
+  }
+
+private:
+  static constexpr size_t BUFFER_SIZE = 64 * 1024;
+
+  kj::AsyncOutputStream& inner;
+
+  kj::Promise<uint64_t> pumpLoop(kj::AsyncInputStream& input, uint64_t amount) {
+    uint64_t size = kj::min(amount, BUFFER_SIZE);
+    KJ_IF_MAYBE(length, input.tryGetLength()) {
+      // Don't allocate more than a short body needs.
+      size = kj::min(size, kj::max(*length, uint64_t(1)));
+    }
+    auto buffer = kj::heapArray<byte>(size);
+
+    uint64_t total = 0;
+    while (total < amount) {
+      size_t n = co_await input.tryRead(buffer.begin(), 1, kj::min(amount - total, buffer.size()));
+      if (n == 0) break;
+      co_await inner.write(buffer.begin(), n);
+      total += n;
+    }
+    co_return total;
+  }
+};
+
 class EncodedAsyncOutputStream final: public WritableStreamSink {
   // A wrapper around a native `kj::AsyncOutputStream` which knows the underlying encoding of the
   // stream and optimizes pumps from `EncodedAsyncInputStream`.
@@ -186,7 +241,8 @@ kj::Maybe<kj::Promise<DeferredProxy<void>>> EncodedAsyncOutputStream::tryPumpFro
       nativeInput->ensureIdentityEncoding();
     }
 
-    auto promise = nativeInput->inner->pumpTo(getInner()).ignoreResult();
+    auto adapter = kj::heap<NativePumpAdapter>(getInner());
+    auto promise = nativeInput->inner->pumpTo(*adapter).attach(kj::mv(adapter)).ignoreResult();
     if (end) {
       KJ_IF_MAYBE(gz, inner.tryGet<kj::Own<kj::GzipAsyncOutputStream>>()) {
         promise = promise.then([&gz = *gz]() { return gz->end(); });
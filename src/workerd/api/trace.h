@@ -26,13 +26,14 @@ public:
   static jsg::Ref<TraceEvent> constructor(kj::String type) = delete;
   // TODO(soon): constructor?
 
-  // TODO(perf): more efficient to build/return cached array object?  Or iterator?
   kj::Array<jsg::Ref<TraceItem>> getTraces();
 
   JSG_RESOURCE_TYPE(TraceEvent) {
     JSG_INHERIT(ExtendableEvent);
 
-    JSG_READONLY_INSTANCE_PROPERTY(traces, getTraces);
+    JSG_LAZY_READONLY_INSTANCE_PROPERTY(traces, getTraces);
+    // Lazy, so that the array of TraceItems is only converted to JS once, however often the
+    // handler reads it.
   }
 
 private:
@@ -74,14 +75,16 @@ public:
   uint getWallTime();
 
   JSG_RESOURCE_TYPE(TraceItem) {
-    JSG_READONLY_INSTANCE_PROPERTY(event, getEvent);
+    JSG_LAZY_READONLY_INSTANCE_PROPERTY(event, getEvent);
     JSG_READONLY_INSTANCE_PROPERTY(eventTimestamp, getEventTimestamp);
-    JSG_READONLY_INSTANCE_PROPERTY(logs, getLogs);
-    JSG_READONLY_INSTANCE_PROPERTY(exceptions, getExceptions);
+    JSG_LAZY_READONLY_INSTANCE_PROPERTY(logs, getLogs);
+    JSG_LAZY_READONLY_INSTANCE_PROPERTY(exceptions, getExceptions);
     JSG_READONLY_INSTANCE_PROPERTY(scriptName, getScriptName);
     JSG_READONLY_INSTANCE_PROPERTY(dispatchNamespace, getDispatchNamespace);
     JSG_READONLY_INSTANCE_PROPERTY(scriptTags, getScriptTags);
     JSG_READONLY_INSTANCE_PROPERTY(outcome, getOutcome);
+    // `event`, `logs` and `exceptions` allocate new objects each time they're built, so they're
+    // lazy too: a tail worker that looks at them repeatedly doesn't build them repeatedly.
   }
 
 private:
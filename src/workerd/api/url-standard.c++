@@ -167,6 +167,23 @@ struct UrlRecordBuilder {
     password.addAll(record.password);
   }
 
+  explicit UrlRecordBuilder(UrlRecord&& record)
+    : scheme(kj::mv(record.scheme)),
+      username(kj::mv(record.username)),
+      password(kj::mv(record.password)),
+      host(kj::mv(record.host)),
+      port(record.port),
+      path(takePath(record.path)),
+      query(record.query.map([](jsg::UsvString& string) {
+        return jsg::UsvStringBuilder(kj::mv(string));
+      })),
+      fragment(record.fragment.map([](jsg::UsvString& string) {
+        return jsg::UsvStringBuilder(kj::mv(string));
+      })),
+      special(record.special) {}
+  // Takes over the components of `record` without copying them. Components that the parser
+  // doesn't touch are handed back by finish() without copying, too.
+
   static Path copyPath(UrlRecord::Path& base) {
     KJ_SWITCH_ONEOF(base) {
       KJ_CASE_ONEOF(string, jsg::UsvString) {
@@ -184,6 +201,18 @@ struct UrlRecordBuilder {
     KJ_UNREACHABLE;
   }
 
+  static Path takePath(UrlRecord::Path& base) {
+    KJ_SWITCH_ONEOF(base) {
+      KJ_CASE_ONEOF(string, jsg::UsvString) {
+        return jsg::UsvStringBuilder(kj::mv(string));
+      }
+      KJ_CASE_ONEOF(array, kj::Array<jsg::UsvString>) {
+        return kj::Vector<jsg::UsvString>(kj::mv(array));
+      }
+    }
+    KJ_UNREACHABLE;
+  }
+
   UrlRecord::Path finishPath() {
     KJ_SWITCH_ONEOF(path) {
       KJ_CASE_ONEOF(string, jsg::UsvStringBuilder) {
@@ -595,13 +624,18 @@ bool UrlRecord::equivalentTo(UrlRecord& other, GetHrefOption option) {
   return href == other.getHref(option);
 }
 
-kj::Maybe<UrlRecord> URL::parse(
+namespace {
+kj::Maybe<UrlRecord> basicParse(
     jsg::UsvStringPtr input,
     jsg::Optional<UrlRecord&> maybeBase,
-    kj::Maybe<UrlRecord&> maybeRecord,
-    kj::Maybe<ParseState> maybeStateOverride) {
-  static UrlRecord EMPTY_RECORD = UrlRecord {};
-  UrlRecordBuilder record(maybeRecord.orDefault(EMPTY_RECORD));
+    UrlRecordBuilder& record,
+    bool hasRecord,
+    kj::Maybe<URL::ParseState> maybeStateOverride) {
+  // The basic URL parser. `record` starts out holding the components of the given URL record, if
+  // any (`hasRecord`). On success, the parsed record is moved out of `record`; on failure,
+  // `record` is left holding whatever the parser had gotten to, per the spec.
+  using ParseState = URL::ParseState;
+
   ParseState state = maybeStateOverride.orDefault(ParseState::SCHEME_START);
   // Worst case is that buffer will be the size of input, but that's unlikely,
   // and since user input is user controled, let's cap it at something reasonable.
@@ -610,14 +644,14 @@ kj::Maybe<UrlRecord> URL::parse(
   bool insideBrackets = false;
   bool passwordTokenSeen = false;
 
-  const auto trimControlOrSpace = [&maybeRecord](jsg::UsvStringPtr& input) {
+  const auto trimControlOrSpace = [hasRecord](jsg::UsvStringPtr& input) {
     if (input.empty()) return jsg::usv();
     auto start = input.begin();
     auto end = input.end() - 1;
 
     // If the existing URL record is not provided, we trim off leading and
     // trailing whitespace... otherwise we leave it.
-    if (maybeRecord == nullptr) {
+    if (!hasRecord) {
       while (start && isControlOrSpaceCodepoint(*start)) { ++start; }
       while (end && end > start && isControlOrSpaceCodepoint(*end)) { --end; }
 
@@ -1629,6 +1663,30 @@ kj::Maybe<UrlRecord> URL::parse(
 
   KJ_UNREACHABLE;
 }
+}  // namespace
+
+kj::Maybe<UrlRecord> URL::parse(
+    jsg::UsvStringPtr input,
+    jsg::Optional<UrlRecord&> maybeBase,
+    kj::Maybe<UrlRecord&> maybeRecord,
+    kj::Maybe<ParseState> maybeStateOverride) {
+  static UrlRecord EMPTY_RECORD = UrlRecord {};
+  UrlRecordBuilder record(maybeRecord.orDefault(EMPTY_RECORD));
+  return basicParse(input, kj::mv(maybeBase), record, maybeRecord != nullptr, maybeStateOverride);
+}
+
+bool URL::parseComponent(jsg::UsvStringPtr input, ParseState stateOverride) {
+  // Rather than copying every component of the record into the parser and then building a new
+  // record out of the result, move the components in and back out again. Only the component
+  // being parsed is actually rebuilt.
+  UrlRecordBuilder record(kj::mv(inner));
+  KJ_IF_MAYBE(result, basicParse(input, nullptr, record, true, stateOverride)) {
+    inner = kj::mv(*result);
+    return true;
+  }
+  inner = record.finish();
+  return false;
+}
 
 URL::URL(jsg::UsvStringPtr url, jsg::Optional<jsg::UsvStringPtr> base)
     : inner(handleConstructorParse(url, kj::mv(base))) {}
@@ -1654,7 +1712,10 @@ jsg::UsvString URL::getOrigin() {
   KJ_UNREACHABLE
 }
 
-jsg::UsvString URL::getHref() { return inner.getHref(); }
+jsg::UsvString URL::getHref() {
+  syncQuery();
+  return inner.getHref();
+}
 
 void URL::setHref(jsg::UsvString value) {
   inner = JSG_REQUIRE_NONNULL(parse(value), TypeError, "Invalid URL string.");
@@ -1675,9 +1736,7 @@ void URL::setProtocol(jsg::UsvString value) {
   jsg::UsvStringBuilder builder(value.size() + 1);
   builder.addAll(value);
   builder.add(':');
-  KJ_IF_MAYBE(record, parse(builder.finish(), nullptr, inner, ParseState::SCHEME_START)) {
-    inner = kj::mv(*record);
-  }
+  parseComponent(builder.finish(), ParseState::SCHEME_START);
 }
 
 jsg::UsvStringPtr URL::getUsername() {
@@ -1715,9 +1774,7 @@ jsg::UsvString URL::getHost() {
 
 void URL::setHost(jsg::UsvString value) {
   if (inner.path.is<jsg::UsvString>()) return;
-  KJ_IF_MAYBE(record, parse(value, nullptr, inner, ParseState::HOST)) {
-    inner = kj::mv(*record);
-  }
+  parseComponent(value, ParseState::HOST);
 }
 
 jsg::UsvStringPtr URL::getHostname() {
@@ -1729,9 +1786,7 @@ jsg::UsvStringPtr URL::getHostname() {
 
 void URL::setHostname(jsg::UsvString value) {
   if (inner.path.is<jsg::UsvString>()) return;
-  KJ_IF_MAYBE(record, parse(value, nullptr, inner, ParseState::HOSTNAME)) {
-    inner = kj::mv(*record);
-  }
+  parseComponent(value, ParseState::HOSTNAME);
 }
 
 jsg::UsvString URL::getPort() {
@@ -1747,9 +1802,7 @@ void URL::setPort(jsg::UsvString port) {
     inner.port = nullptr;
     return;
   }
-  KJ_IF_MAYBE(record, parse(port, nullptr, inner, ParseState::PORT)) {
-    inner = kj::mv(*record);
-  }
+  parseComponent(port, ParseState::PORT);
 }
 
 jsg::UsvString URL::getPathname() { return inner.getPathname(); }
@@ -1757,12 +1810,11 @@ jsg::UsvString URL::getPathname() { return inner.getPathname(); }
 void URL::setPathname(jsg::UsvString value) {
   if (inner.path.is<jsg::UsvString>()) return;
   inner.path = kj::Array<jsg::UsvString>();
-  KJ_IF_MAYBE(record, parse(value, nullptr, inner, ParseState::PATH_START)) {
-    inner = kj::mv(*record);
-  }
+  parseComponent(value, ParseState::PATH_START);
 }
 
 jsg::UsvString URL::getSearch() {
+  syncQuery();
   KJ_IF_MAYBE(query, inner.query) {
     if (!query->empty()) {
       jsg::UsvStringBuilder builder(query->size() + 1);
@@ -1775,6 +1827,7 @@ jsg::UsvString URL::getSearch() {
 }
 
 void URL::setSearch(jsg::UsvString query) {
+  syncQuery();
   if (query == getCommonStrings().EMPTY_STRING) {
     inner.query = nullptr;
     KJ_IF_MAYBE(searchParams, maybeSearchParams) {
@@ -1784,8 +1837,7 @@ void URL::setSearch(jsg::UsvString query) {
   }
   auto sliced = query.first() == '?' ? query.slice(1) : query.asPtr();
   inner.query = jsg::usv();
-  KJ_IF_MAYBE(record, parse(sliced, nullptr, inner, ParseState::QUERY)) {
-    inner = kj::mv(*record);
+  if (parseComponent(sliced, ParseState::QUERY)) {
     KJ_IF_MAYBE(searchParams, maybeSearchParams) {
       (*searchParams)->reset(toMaybePtr(inner.query));
     }
@@ -1811,9 +1863,7 @@ void URL::setHash(jsg::UsvString hash) {
   }
   auto sliced = hash.first() == '#' ? hash.slice(1) : hash.asPtr();
   inner.fragment = jsg::usv();
-  KJ_IF_MAYBE(record, parse(sliced, nullptr, inner, ParseState::FRAGMENT)) {
-    inner = kj::mv(*record);
-  }
+  parseComponent(sliced, ParseState::FRAGMENT);
 }
 
 bool URL::isSpecialScheme(jsg::UsvStringPtr scheme) {
@@ -1893,6 +1943,14 @@ URLSearchParams::URLSearchParams(kj::Maybe<jsg::UsvString>& maybeQuery, URL& url
 }
 
 void URLSearchParams::update() {
+  if (maybeUrl != nullptr) {
+    changed = true;
+  }
+}
+
+void URLSearchParams::flush() {
+  if (!changed) return;
+  changed = false;
   KJ_IF_MAYBE(url, maybeUrl) {
     auto serialized = toString();
     if (serialized == getCommonStrings().EMPTY_STRING) {
@@ -1904,6 +1962,7 @@ void URLSearchParams::update() {
 }
 
 void URLSearchParams::reset(kj::Maybe<jsg::UsvStringPtr> value) {
+  changed = false;
   KJ_IF_MAYBE(val, value) {
     parse(*val);
   } else {
@@ -1960,42 +2019,21 @@ void URLSearchParams::set(jsg::UsvString name, jsg::UsvString value) {
 }
 
 void URLSearchParams::sort() {
-  // The sort operation here is fairly expensive. The storage for a UsvString is by
-  // codepoint (uint32_t). The URLSearchParams specification, however, requires that
-  // sorting be based on uint16_t code unit order. This means that to perform the
-  // comparison correctly, we need to the the utf16 version of the data. Because
-  // that is not a cheap operation, we don't want to regenerate the utf16 encoding
-  // on every comparison operation. Instead, we memoize the entries in a hash map.
-  // It's still fairly expensive, but much less so.
-  //
-  // Why not simply store the data in utf16 format to begin with? Well, most of the
-  // operations on UsvString operate on the codepoint level. The sort() operation
-  // here is an exception to the rule. We're optimizing for performance everywhere
-  // else and taking a moderate performance hit here.
-  kj::HashMap<const Entry&, kj::Array<const uint16_t>> memo;
-  const auto upsert = [&memo](const Entry& entry) {
-    return memo.findOrCreate(entry, [&entry]() {
-      return decltype(memo)::Entry {
-        .key = entry,
-        .value = entry.name.toUtf16(),
-      };
-    }).asPtr();
+  // The spec sorts by UTF-16 code unit, but UsvString stores codepoints. Codepoint order agrees
+  // with UTF-16 order except that U+10000 and up, which UTF-16 encodes as surrogates in D800..DFFF,
+  // come before U+E000..U+FFFF. So we compare the codepoints directly, moving U+E000..U+FFFF past
+  // the end of the codepoint range, rather than converting every name to UTF-16.
+  const auto key = [](uint32_t c) {
+    return c >= 0xe000 && c <= 0xffff ? c + 0x110000 : c;
   };
-
-  std::stable_sort(list.begin(), list.end(), [&upsert](const Entry& a, const Entry& b) {
-    if (a.name == b.name) return false;
-    if (a.name.empty() && !b.name.empty()) return true;
-
-    auto ptr1 = upsert(a);
-    auto ptr2 = upsert(b);
-
-    return u_strCompare(
-        reinterpret_cast<const UChar*>(ptr1.begin()),
-        ptr1.size(),
-        reinterpret_cast<const UChar*>(ptr2.begin()),
-        ptr2.size(),
-        false
-    ) < 0;
+  std::stable_sort(list.begin(), list.end(), [&key](const Entry& a, const Entry& b) {
+    auto left = a.name.storage();
+    auto right = b.name.storage();
+    auto size = kj::min(left.size(), right.size());
+    for (size_t i = 0; i < size; i++) {
+      if (left[i] != right[i]) return key(left[i]) < key(right[i]);
+    }
+    return left.size() < right.size();
   });
   update();
 }
@@ -170,8 +170,16 @@ private:
 
   kj::Vector<Entry> list;
   kj::Maybe<URL&> maybeUrl;
+  bool changed = false;
+  // Whether `list` has changed since it was last serialized into the URL's query.
 
   void update();
+  // Called after modifying `list`. Serializing it into the URL waits until the URL's query is
+  // next needed, so a series of modifications serializes the result once.
+
+  void flush();
+  // Serializes `list` into the URL's query, if it has changed.
+
   void reset(kj::Maybe<jsg::UsvStringPtr> value = nullptr);
 
   void init(Initializer init);
@@ -286,7 +294,10 @@ public:
     return kj::mv(searchParams);
   }
 
-  UrlRecord& getRecord() KJ_LIFETIMEBOUND { return inner; }
+  UrlRecord& getRecord() KJ_LIFETIMEBOUND {
+    syncQuery();
+    return inner;
+  }
 
   JSG_RESOURCE_TYPE(URL) {
     JSG_READONLY_PROTOTYPE_PROPERTY(origin, getOrigin);
@@ -317,6 +328,18 @@ private:
   UrlRecord inner;
   kj::Maybe<jsg::Ref<URLSearchParams>> maybeSearchParams;
 
+  void syncQuery() {
+    // Brings `inner.query` up to date with any changes made through `searchParams`.
+    KJ_IF_MAYBE(searchParams, maybeSearchParams) {
+      (*searchParams)->flush();
+    }
+  }
+
+  bool parseComponent(jsg::UsvStringPtr input, ParseState stateOverride);
+  // Parses `input` into `inner` with the given state override, as the spec's setters do. Unlike
+  // parse(), this updates the record in place, so components other than the one being set are
+  // not copied. Returns false if the parser failed.
+
   void visitForGc(jsg::GcVisitor& visitor) {
     visitor.visit(maybeSearchParams);
   }
@@ -565,23 +565,39 @@ void URLSearchParams::set(kj::String name, kj::String value) {
   }
 }
 
-void URLSearchParams::sort() {
-  // Sort by UTF-16 code unit, preserving order of equal elements.
+namespace {
+
+bool lessThanInUtf16(kj::ArrayPtr<const char> left, kj::ArrayPtr<const char> right) {
+  // Compares two UTF-8 strings by their UTF-16 code units, without transcoding them.
   //
-  // TODO(perf): This UTF-16 business is sad. The WPT points out the specific example 🌈 < ﬃ,
-  //   because the rainbow is lexicographically less than the ligature in UTF-16 code units. In
-  //   UTF-8 code units, their order is the opposite.
+  // UTF-8 byte order is codepoint order, which agrees with UTF-16 code unit order everywhere but
+  // between U+E000..U+FFFF and U+10000 and up, which UTF-16 encodes as surrogates in D800..DFFF.
+  // The WPT points out the specific example 🌈 < ﬃ:
   //
   //       UTF-8       |   UTF-16
   //   ﬃ   ef ac 83    |  fb03
   //   🌈  f0 9f 8c 88 |  d83c df08
+  //
+  // Strings sharing a prefix first differ either in continuation bytes of characters of the same
+  // length, which sort the same both ways, or in lead bytes. So it's enough to sort the lead
+  // bytes of U+E000..U+FFFF, EE and EF, after those of longer sequences, F0..F4.
+
+  auto key = [](kj::byte b) -> uint { return b == 0xee || b == 0xef ? b + 0x100 : b; };
+  auto size = kj::min(left.size(), right.size());
+  for (size_t i = 0; i < size; i++) {
+    kj::byte l = left[i], r = right[i];
+    if (l != r) return key(l) < key(r);
+  }
+  return left.size() < right.size();
+}
+
+}  // namespace
 
+void URLSearchParams::sort() {
+  // Sort by UTF-16 code unit, preserving order of equal elements.
   std::stable_sort(url->query.begin(), url->query.end(),
       [](const auto& left, const auto& right) {
-        auto leftUtf16 = kj::encodeUtf16(left.name.asArray());
-        auto rightUtf16 = kj::encodeUtf16(right.name.asArray());
-        return std::lexicographical_compare(leftUtf16.begin(), leftUtf16.end(),
-                                            rightUtf16.begin(), rightUtf16.end());
+        return lessThanInUtf16(left.name, right.name);
       });
 }
 
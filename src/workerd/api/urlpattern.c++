@@ -9,6 +9,7 @@
 #include <algorithm>
 
 #include <workerd/io/io-context.h>
+#include <workerd/jsg/setup.h>
 
 namespace workerd::api {
 
@@ -1261,10 +1262,24 @@ URLPatternComponent compileComponent(
       options);
   auto regexAndNameList = generateRegularExpressionAndNameList(js, partList, options);
 
+  // The leading run of unmodified fixed text parts must appear verbatim at the start of any
+  // matching input, so exec() can check for it before running the regex.
+  jsg::UsvStringBuilder literalPrefix;
+  bool isLiteral = true;
+  for (auto& part: partList) {
+    if (part.type != Part::Type::FIXED_TEXT || part.modifier != Part::Modifier::NONE) {
+      isLiteral = false;
+      break;
+    }
+    literalPrefix.addAll(part.value);
+  }
+
   return URLPatternComponent {
     .pattern = generatePatternString(partList, options),
     .regex = kj::mv(regexAndNameList.first),
     .nameList = kj::mv(regexAndNameList.second),
+    .literalPrefix = literalPrefix.finish(),
+    .isLiteral = isLiteral,
   };
 }
 
@@ -1824,12 +1839,157 @@ URLPatternComponents init(
   KJ_UNREACHABLE;
 }
 
+URLPatternComponent cloneComponent(jsg::Lock& js, URLPatternComponent& component) {
+  return URLPatternComponent {
+    .pattern = jsg::usv(component.pattern),
+    .regex = component.regex.addRef(js),
+    .nameList = KJ_MAP(name, component.nameList) { return jsg::usv(name); },
+    .literalPrefix = jsg::usv(component.literalPrefix),
+    .isLiteral = component.isLiteral,
+  };
+}
+
+URLPatternComponents cloneComponents(jsg::Lock& js, URLPatternComponents& components) {
+  return URLPatternComponents {
+    .protocol = cloneComponent(js, components.protocol),
+    .username = cloneComponent(js, components.username),
+    .password = cloneComponent(js, components.password),
+    .hostname = cloneComponent(js, components.hostname),
+    .port = cloneComponent(js, components.port),
+    .pathname = cloneComponent(js, components.pathname),
+    .search = cloneComponent(js, components.search),
+    .hash = cloneComponent(js, components.hash),
+  };
+}
+
+class CompiledPatternCache {
+  // Compiled components of recently constructed URLPatterns, keyed on the constructor
+  // arguments. Code that creates the same `new URLPattern(...)` for every request, as many
+  // routers do, then only pays for tokenizing, parsing and compiling the regexes once.
+  //
+  // There is one cache per isolate. The regexes it holds belong to a particular context, so the
+  // cache is cleared whenever it is used from a different one.
+
+public:
+  static constexpr size_t MAX_ENTRIES = 128;
+
+  static CompiledPatternCache& get(jsg::Lock& js) {
+    auto& cache = jsg::IsolateBase::from(js.v8Isolate)
+        .getIsolateLocal<CompiledPatternCache>(js);
+    auto current = js.v8Isolate->GetCurrentContext();
+    if (cache.context.IsEmpty() || cache.context != current) {
+      cache.entries.clear();
+      cache.context.Reset(js.v8Isolate, current);
+      cache.context.SetWeak();
+    }
+    return cache;
+  }
+
+  kj::Maybe<URLPatternComponents&> find(kj::StringPtr key) {
+    return entries.find(key).map([&](Entry& entry) -> URLPatternComponents& {
+      entry.lastUsed = ++useCounter;
+      return entry.components;
+    });
+  }
+
+  void insert(kj::String key, URLPatternComponents components) {
+    if (entries.size() >= MAX_ENTRIES) {
+      // Evict the least recently used entry. The cache is small enough that a scan is cheaper
+      // than maintaining a separate recency list.
+      auto oldest = entries.begin();
+      for (auto iter = entries.begin(); iter != entries.end(); ++iter) {
+        if (iter->value.lastUsed < oldest->value.lastUsed) oldest = iter;
+      }
+      entries.erase(*oldest);
+    }
+    entries.insert(kj::mv(key), Entry { kj::mv(components), ++useCounter });
+  }
+
+private:
+  struct Entry {
+    URLPatternComponents components;
+    uint64_t lastUsed;
+  };
+
+  v8::Global<v8::Context> context;
+  kj::HashMap<kj::String, Entry> entries;
+  uint64_t useCounter = 0;
+};
+
+kj::String compiledPatternCacheKey(
+    URLPattern::URLPatternInput& input,
+    jsg::Optional<jsg::UsvString>& baseURL) {
+  // Length-prefixes each part so that different inputs can never produce the same key.
+  kj::Vector<kj::String> parts;
+  auto add = [&](kj::Maybe<jsg::UsvString>& maybeValue) {
+    KJ_IF_MAYBE(value, maybeValue) {
+      auto str = value->toStr();
+      parts.add(kj::str(str.size(), ':', str));
+    } else {
+      parts.add(kj::str('-'));
+    }
+  };
+
+  KJ_SWITCH_ONEOF(input) {
+    KJ_CASE_ONEOF(string, jsg::UsvString) {
+      parts.add(kj::str('S'));
+      auto str = string.toStr();
+      parts.add(kj::str(str.size(), ':', str));
+      add(baseURL);
+    }
+    KJ_CASE_ONEOF(init, URLPattern::URLPatternInit) {
+      parts.add(kj::str('I'));
+      add(init.protocol);
+      add(init.username);
+      add(init.password);
+      add(init.hostname);
+      add(init.port);
+      add(init.pathname);
+      add(init.search);
+      add(init.hash);
+      add(init.baseURL);
+      add(baseURL);
+    }
+  }
+  return kj::strArray(parts, "");
+}
+
+URLPatternComponents initCached(
+    jsg::Lock& js,
+    jsg::Optional<URLPattern::URLPatternInput> maybeInput,
+    jsg::Optional<jsg::UsvString> baseURL) {
+  auto input = kj::mv(maybeInput).orDefault(URLPattern::URLPatternInit());
+  auto& cache = CompiledPatternCache::get(js);
+  auto key = compiledPatternCacheKey(input, baseURL);
+  KJ_IF_MAYBE(components, cache.find(key)) {
+    return cloneComponents(js, *components);
+  }
+
+  // Only successfully compiled patterns are cached, so invalid ones keep throwing.
+  auto components = init(js, kj::mv(input), kj::mv(baseURL));
+  cache.insert(kj::mv(key), cloneComponents(js, components));
+  return components;
+}
+
 kj::Maybe<URLPattern::URLPatternComponentResult> execRegex(
     jsg::Lock& js,
     URLPatternComponent& component,
     jsg::UsvStringPtr input) {
   using Groups = jsg::Dict<jsg::UsvString, jsg::UsvString>;
 
+  auto& prefix = component.literalPrefix;
+  if (input.size() < prefix.size() || input.slice(0, prefix.size()) != prefix.asPtr()) {
+    return nullptr;
+  }
+  if (component.isLiteral) {
+    if (input.size() != prefix.size()) return nullptr;
+    // A fixed text pattern has no groups, so there's nothing for the regex to tell us.
+    return URLPattern::URLPatternComponentResult {
+      .input = jsg::usv(input),
+      .groups = Groups {},
+    };
+  }
+
   auto context = js.v8Isolate->GetCurrentContext();
 
   auto execResult =
@@ -1869,7 +2029,7 @@ URLPattern::URLPattern(
     jsg::Lock& js,
     jsg::Optional<URLPatternInput> input,
     jsg::Optional<jsg::UsvString> baseURL)
-    : components(init(js, kj::mv(input), kj::mv(baseURL))) {}
+    : components(initCached(js, kj::mv(input), kj::mv(baseURL))) {}
 
 void URLPattern::visitForGc(jsg::GcVisitor& visitor) {
   visitor.visit(components.protocol.regex,
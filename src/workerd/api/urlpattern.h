@@ -14,6 +14,13 @@ struct URLPatternComponent {
   jsg::UsvString pattern;
   jsg::V8Ref<v8::RegExp> regex;
   kj::Array<jsg::UsvString> nameList;
+
+  jsg::UsvString literalPrefix;
+  // Fixed text that every matching input must start with. Inputs without it are rejected
+  // without running the regex.
+
+  bool isLiteral = false;
+  // True if the pattern is entirely fixed text, i.e. literalPrefix is the only matching input.
 };
 
 struct URLPatternComponents {
@@ -53,5 +53,55 @@ KJ_TEST("redactUrl can detect base64 ids") {
   expectUnredacted("https://domain/IThinkIShallNeverSee0/x"_kj);
 }
 
+KJ_TEST("newBackpressureTee throttles the faster branch") {
+  kj::EventLoop loop;
+  kj::WaitScope waitScope(loop);
+
+  class EndlessStream final: public kj::AsyncInputStream {
+  public:
+    uint64_t totalRead = 0;
+
+    kj::Promise<size_t> tryRead(void* buffer, size_t minBytes, size_t maxBytes) override {
+      memset(buffer, 'x', maxBytes);
+      totalRead += maxBytes;
+      return maxBytes;
+    }
+  };
+
+  auto input = kj::heap<EndlessStream>();
+  auto& inputRef = *input;
+  auto tee = newBackpressureTee(kj::mv(input), kj::maxValue, 100);
+
+  // The fast branch can get as far as the threshold ahead of the slow one, and then waits.
+  kj::byte buffer[40];
+  uint64_t fastRead = 0;
+  kj::Maybe<kj::Promise<size_t>> pending;
+  while (pending == nullptr) {
+    auto promise = tee.branches[0]->tryRead(buffer, 1, sizeof(buffer));
+    if (promise.poll(waitScope)) {
+      fastRead += promise.wait(waitScope);
+    } else {
+      pending = kj::mv(promise);
+    }
+  }
+  KJ_EXPECT(fastRead >= 100);
+  KJ_EXPECT(inputRef.totalRead < 100 + sizeof(buffer), inputRef.totalRead);
+
+  // Once the slow branch catches up a bit, the fast one continues.
+  KJ_EXPECT(tee.branches[1]->tryRead(buffer, 40, 40).wait(waitScope) == 40);
+  auto& promise = KJ_ASSERT_NONNULL(pending);
+  KJ_EXPECT(promise.poll(waitScope));
+  promise.wait(waitScope);
+  pending = nullptr;
+
+  // And once the slow branch is gone, nothing holds the fast one back.
+  tee.branches[1] = nullptr;
+  for (auto i KJ_UNUSED: kj::zeroTo(10)) {
+    auto promise = tee.branches[0]->tryRead(buffer, 1, sizeof(buffer));
+    KJ_EXPECT(promise.poll(waitScope));
+    promise.wait(waitScope);
+  }
+}
+
 }  // namespace
 }  // namespace workerd::api
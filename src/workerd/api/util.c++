@@ -170,6 +170,132 @@ kj::Own<kj::AsyncInputStream> newTeeErrorAdapter(kj::Own<kj::AsyncInputStream> i
   }
 }
 
+namespace {
+
+class BackpressureTeeState final: public kj::Refcounted {
+  // Shared between the input and the branches of a tee made by newBackpressureTee(), keeping
+  // track of how far each of them has got.
+
+public:
+  explicit BackpressureTeeState(size_t threshold): threshold(threshold) {}
+
+  uint64_t getBuffered() const {
+    // Bytes that have been read from the input but not yet by the slowest remaining branch.
+    uint64_t slowest = totalRead;
+    for (auto& branch: consumed) {
+      KJ_IF_MAYBE(c, branch) {
+        slowest = kj::min(slowest, *c);
+      }
+    }
+    return totalRead - slowest;
+  }
+
+  kj::Promise<size_t> readInput(kj::AsyncInputStream& input,
+                                void* buffer, size_t minBytes, size_t maxBytes) {
+    while (getBuffered() >= threshold) {
+      auto paf = kj::newPromiseAndFulfiller<void>();
+      waiter = kj::mv(paf.fulfiller);
+      co_await paf.promise;
+    }
+
+    // Don't read much further past the threshold than we have to.
+    maxBytes = kj::max(minBytes, kj::min(maxBytes, threshold - getBuffered()));
+    auto amount = co_await input.tryRead(buffer, minBytes, maxBytes);
+    totalRead += amount;
+    co_return amount;
+  }
+
+  void branchRead(uint branch, size_t amount) {
+    KJ_IF_MAYBE(c, consumed[branch]) {
+      *c += amount;
+    }
+    maybeWake();
+  }
+
+  void branchDropped(uint branch) {
+    consumed[branch] = nullptr;
+    maybeWake();
+  }
+
+private:
+  size_t threshold;
+  uint64_t totalRead = 0;
+  kj::Maybe<uint64_t> consumed[2] = { uint64_t(0), uint64_t(0) };
+  // Bytes read by each branch, or null once the branch has been dropped.
+
+  kj::Maybe<kj::Own<kj::PromiseFulfiller<void>>> waiter;
+  // Fulfilled when a branch catches up while a read from the input is waiting. The tee only
+  // reads from its input once at a time, so there is at most one.
+
+  void maybeWake() {
+    KJ_IF_MAYBE(w, waiter) {
+      if (getBuffered() < threshold) {
+        (*w)->fulfill();
+        waiter = nullptr;
+      }
+    }
+  }
+};
+
+class BackpressureTeeInput final: public kj::AsyncInputStream {
+public:
+  BackpressureTeeInput(kj::Own<kj::AsyncInputStream> inner, kj::Own<BackpressureTeeState> state)
+      : inner(kj::mv(inner)), state(kj::mv(state)) {}
+
+  kj::Promise<size_t> tryRead(void* buffer, size_t minBytes, size_t maxBytes) override {
+    return state->readInput(*inner, buffer, minBytes, maxBytes);
+  }
+
+  kj::Maybe<uint64_t> tryGetLength() override { return inner->tryGetLength(); }
+
+private:
+  kj::Own<kj::AsyncInputStream> inner;
+  kj::Own<BackpressureTeeState> state;
+};
+
+class BackpressureTeeBranch final: public kj::AsyncInputStream {
+public:
+  BackpressureTeeBranch(kj::Own<kj::AsyncInputStream> inner,
+                        kj::Own<BackpressureTeeState> state, uint index)
+      : inner(kj::mv(inner)), state(kj::mv(state)), index(index) {}
+  ~BackpressureTeeBranch() noexcept(false) {
+    state->branchDropped(index);
+  }
+
+  kj::Promise<size_t> tryRead(void* buffer, size_t minBytes, size_t maxBytes) override {
+    return inner->tryRead(buffer, minBytes, maxBytes).then([this](size_t amount) {
+      state->branchRead(index, amount);
+      return amount;
+    });
+  }
+
+  kj::Maybe<uint64_t> tryGetLength() override { return inner->tryGetLength(); }
+
+private:
+  kj::Own<kj::AsyncInputStream> inner;
+  kj::Own<BackpressureTeeState> state;
+  uint index;
+};
+
+}  // namespace
+
+kj::Tee newBackpressureTee(kj::Own<kj::AsyncInputStream> input, uint64_t limit,
+                           kj::Maybe<size_t> threshold) {
+  KJ_IF_MAYBE(t, threshold) {
+    KJ_REQUIRE(*t > 0, "tee backpressure threshold must be non-zero");
+    auto state = kj::refcounted<BackpressureTeeState>(*t);
+    auto tee = kj::newTee(kj::heap<BackpressureTeeInput>(kj::mv(input), kj::addRef(*state)),
+                          limit);
+    for (uint i = 0; i < 2; i++) {
+      tee.branches[i] = kj::heap<BackpressureTeeBranch>(
+          kj::mv(tee.branches[i]), kj::addRef(*state), i);
+    }
+    return kj::mv(tee);
+  } else {
+    return kj::newTee(kj::mv(input), limit);
+  }
+}
+
 kj::String redactUrl(kj::StringPtr url) {
   kj::Vector<char> redacted(url.size() + 1);
   const char* spanStart = url.begin();
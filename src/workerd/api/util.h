@@ -86,6 +86,16 @@ kj::Own<kj::AsyncInputStream> newTeeErrorAdapter(kj::Own<kj::AsyncInputStream> i
 // Wrap the given stream in an adapter which translates kj::newTee()-specific exceptions into
 // JS-visible exceptions.
 
+kj::Tee newBackpressureTee(kj::Own<kj::AsyncInputStream> input, uint64_t limit,
+                           kj::Maybe<size_t> threshold);
+// Like `kj::newTee(input, limit)`, but once the slower branch has `threshold` bytes buffered that
+// it hasn't read yet, reads from `input` (and so the faster branch) wait for it to catch up,
+// instead of buffering on until `limit` is exceeded. A branch that is dropped no longer holds
+// back the other. With a null `threshold`, this is just `kj::newTee()`.
+//
+// The catch is that a branch which is never read, but kept around, stalls the other one forever
+// once the threshold is reached, rather than failing it when the limit is hit.
+
 kj::String redactUrl(kj::StringPtr url);
 // Redacts potential secret keys from a given URL using a couple heuristics:
 //   - Any run of hex characters of 32 or more digits, ignoring potential "+-_" separators
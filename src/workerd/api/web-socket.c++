@@ -3,6 +3,7 @@
 //     https://opensource.org/licenses/Apache-2.0
 
 #include "web-socket.h"
+#include "actor-state.h"
 #include <workerd/jsg/jsg.h>
 #include <workerd/io/io-context.h>
 #include <workerd/io/worker.h>
@@ -30,6 +31,27 @@ WebSocket::WebSocket(kj::String url, Locality locality)
   farNative = IoContext::current().addObject(kj::mv(nativeObj));
 }
 
+namespace {
+kj::Own<kj::WebSocket> borrowHibernatable(HibernationManager::Socket& socket) {
+  // The native WebSocket belongs to the HibernationManager. Our reference keeps it alive for as
+  // long as we might still send on it, even if the manager stops tracking it in the meantime.
+  return kj::Own<kj::WebSocket>(&socket.getWebSocket(), kj::NullDisposer::instance)
+      .attach(kj::addRef(socket));
+}
+}  // namespace
+
+WebSocket::WebSocket(kj::Own<HibernationManager::Socket> socket)
+    : url(nullptr),
+      farNative(nullptr),
+      outgoingMessages(IoContext::current().addObject(kj::heap<OutgoingMessagesMap>())),
+      locality(LOCAL) {
+  auto& context = IoContext::current();
+  auto nativeObj = kj::heap<Native>();
+  nativeObj->state.init<Accepted>(borrowHibernatable(*socket), *nativeObj, context);
+  farNative = context.addObject(kj::mv(nativeObj));
+  hibernatableSocket = context.addObject(kj::mv(socket));
+}
+
 void WebSocket::initConnection(jsg::Lock& js, kj::Promise<PackedWebSocket> prom) {
 
   auto& canceler = KJ_ASSERT_NONNULL(farNative->state.tryGet<AwaitingConnection>()).canceler;
@@ -258,10 +280,15 @@ kj::Promise<DeferredProxy<void>> WebSocket::couple(kj::Own<kj::WebSocket> other)
 
   auto& context = IoContext::current();
 
+  // If the other end of our WebSocketPair was accepted for hibernation, it's owned by the actor's
+  // HibernationManager rather than this request, so proxy to it as if it were remote.
+  bool terminatedLocally = locality == LOCAL &&
+      !pairState.map([](kj::Own<PairState>& s) { return s->hibernatable; }).orDefault(false);
+
   auto upstream = other->pumpTo(*self);
   auto downstream = self->pumpTo(*other);
 
-  if (locality == LOCAL) {
+  if (terminatedLocally) {
     // We're terminating the WebSocket in this worker, so the upstream promise (which pumps
     // messages from the client to this worker) counts as something the request is waiting for.
     upstream = upstream.attach(context.registerPendingEvent());
@@ -273,7 +300,7 @@ kj::Promise<DeferredProxy<void>> WebSocket::couple(kj::Own<kj::WebSocket> other)
                                           downstream.eagerlyEvaluate(nullptr)))
       .attach(kj::mv(self), kj::mv(other));
 
-  if (locality == LOCAL) {
+  if (terminatedLocally) {
     // Since the WebSocket is terminated locally, we need the IoContext to stay live while
     // it is active.
     return promise.then([]() { return DeferredProxy<void> { kj::READY_NOW }; });
@@ -302,6 +329,66 @@ void WebSocket::accept(jsg::Lock& js) {
   internalAccept(js);
 }
 
+void WebSocket::acceptHibernatable(
+    jsg::Lock& js, HibernationManager& manager, kj::Array<kj::String> tags) {
+  auto& native = *farNative;
+  JSG_REQUIRE(!native.state.is<AwaitingConnection>(), TypeError,
+      "Websockets obtained from the 'new WebSocket()' constructor cannot be accepted for "
+      "hibernation.");
+  JSG_REQUIRE(!native.state.is<Released>(), TypeError,
+      "Can't accept a WebSocket that was already used in a response.");
+  JSG_REQUIRE(!native.state.is<Accepted>(), TypeError,
+      "Can't accept a WebSocket for hibernation after calling accept() on it.");
+
+  auto& context = IoContext::current();
+  auto nativeWs = kj::mv(KJ_ASSERT_NONNULL(native.state.tryGet<AwaitingAcceptanceOrCoupling>()).ws);
+  auto socket = manager.accept(kj::mv(nativeWs), kj::mv(tags), JSG_THIS);
+  native.state.init<Accepted>(borrowHibernatable(*socket), native, context);
+  hibernatableSocket = context.addObject(kj::mv(socket));
+
+  KJ_IF_MAYBE(s, pairState) {
+    s->get()->hibernatable = true;
+  }
+}
+
+void WebSocket::hibernatableCloseReceived() {
+  auto& native = *farNative;
+  native.closedIncoming = true;
+  if ((native.closedOutgoing || native.outgoingAborted) && !native.isPumping &&
+      native.state.is<Accepted>()) {
+    // Native WebSocket no longer needed; release.
+    native.state.init<Released>();
+  }
+}
+
+void WebSocket::serializeAttachment(jsg::Lock& js, v8::Local<v8::Value> attachment) {
+  auto& socket = *JSG_REQUIRE_NONNULL(hibernatableSocket, TypeError,
+      "serializeAttachment() is only available on WebSockets accepted with "
+      "state.acceptWebSocket().");
+
+  if (attachment->IsNullOrUndefined()) {
+    socket.setAttachment(nullptr);
+    return;
+  }
+
+  auto serialized = serializeV8Value(attachment, js.v8Isolate);
+  JSG_REQUIRE(serialized.size() <= HibernationManager::MAX_ATTACHMENT_SIZE, RangeError,
+      "A WebSocket attachment cannot be larger than ", HibernationManager::MAX_ATTACHMENT_SIZE,
+      " bytes once serialized.");
+  socket.setAttachment(kj::mv(serialized));
+}
+
+v8::Local<v8::Value> WebSocket::deserializeAttachment(jsg::Lock& js) {
+  auto& socket = *JSG_REQUIRE_NONNULL(hibernatableSocket, TypeError,
+      "deserializeAttachment() is only available on WebSockets accepted with "
+      "state.acceptWebSocket().");
+
+  KJ_IF_MAYBE(data, socket.getAttachment()) {
+    return deserializeV8Value("attachment"_kj, *data, js.v8Isolate);
+  }
+  return v8::Null(js.v8Isolate);
+}
+
 void WebSocket::internalAccept(jsg::Lock& js) {
   auto& native = *farNative;
   auto nativeWs = kj::mv(KJ_ASSERT_NONNULL(native.state.tryGet<AwaitingAcceptanceOrCoupling>()).ws);
@@ -439,21 +526,83 @@ void WebSocket::send(jsg::Lock& js, kj::OneOf<kj::Array<byte>, kj::String> messa
 
   KJ_SWITCH_ONEOF(message) {
     KJ_CASE_ONEOF(text, kj::String) {
-      outgoingMessages->insert(GatedMessage{
-          IoContext::current().waitForOutputLocksIfNecessary(),
-          kj::mv(text),
-      });
-      break;
+      enqueue(js, kj::mv(text));
     }
     KJ_CASE_ONEOF(data, kj::Array<byte>) {
-      outgoingMessages->insert(GatedMessage{
-          IoContext::current().waitForOutputLocksIfNecessary(),
-          kj::mv(data),
-      });
-      break;
+      enqueue(js, kj::mv(data));
     }
   }
+}
 
+namespace {
+
+class SharedMessage final: public kj::Refcounted {
+  // The content of a broadcast message. Each socket's queue gets a message that refers to this
+  // buffer instead of a copy of it. Nothing writes to the buffer once it's shared.
+public:
+  explicit SharedMessage(kj::OneOf<kj::Array<byte>, kj::String> message) {
+    KJ_SWITCH_ONEOF(message) {
+      KJ_CASE_ONEOF(text, kj::String) {
+        // Includes the NUL terminator, so that it can be shared as a kj::String.
+        content = text.releaseArray();
+      }
+      KJ_CASE_ONEOF(data, kj::Array<byte>) {
+        content = kj::mv(data);
+      }
+    }
+  }
+
+  kj::WebSocket::Message share() {
+    KJ_SWITCH_ONEOF(content) {
+      KJ_CASE_ONEOF(text, kj::Array<char>) {
+        if (text.size() == 0) {
+          return kj::String();
+        }
+        return kj::String(text.asPtr().attach(kj::addRef(*this)));
+      }
+      KJ_CASE_ONEOF(data, kj::Array<byte>) {
+        return data.asPtr().attach(kj::addRef(*this));
+      }
+    }
+    KJ_UNREACHABLE;
+  }
+
+private:
+  kj::OneOf<kj::Array<char>, kj::Array<byte>> content;
+};
+
+}  // namespace
+
+void WebSocket::broadcast(jsg::Lock& js, kj::Array<jsg::Ref<WebSocket>> sockets,
+                          kj::OneOf<kj::Array<byte>, kj::String> message) {
+  // Check every socket before sending on any, so that a bad socket doesn't leave the message
+  // delivered to only some of them.
+  kj::Vector<WebSocket*> targets(sockets.size());
+  for (auto& socket: sockets) {
+    auto& native = *socket->farNative;
+    if (native.closedOutgoing || native.outgoingAborted || native.state.is<Released>()) {
+      continue;
+    }
+    JSG_REQUIRE(native.state.is<Accepted>(), TypeError,
+        "You must call accept() on every WebSocket before broadcasting to it.");
+    targets.add(socket.get());
+  }
+
+  if (targets.size() == 0) {
+    return;
+  }
+
+  auto shared = kj::refcounted<SharedMessage>(kj::mv(message));
+  for (auto target: targets) {
+    target->enqueue(js, shared->share());
+  }
+}
+
+void WebSocket::enqueue(jsg::Lock& js, kj::WebSocket::Message message) {
+  outgoingMessages->insert(GatedMessage{
+      IoContext::current().waitForOutputLocksIfNecessary(),
+      kj::mv(message),
+  });
   ensurePumping(js);
 }
 
@@ -570,6 +719,10 @@ void WebSocket::ensurePumping(jsg::Lock& js) {
     auto promise = kj::evalNow([&]() {
       return accepted.canceler.wrap(pump(context, *outgoingMessages, *accepted.ws));
     });
+    KJ_IF_MAYBE(socket, hibernatableSocket) {
+      // Keep the actor from hibernating while we're sending.
+      promise = promise.attach((*socket)->startSend());
+    }
     // TODO(cleanup): We use awaitIoLegacy() here because we don't want this to count as a pending
     //   event if this is a WebSocketPair with the other end being handled in the same isolate.
     //   In that case, the pump can hang if accept() is never called on the other end. Ideally,
@@ -595,19 +748,6 @@ void WebSocket::ensurePumping(jsg::Lock& js) {
   }
 }
 
-kj::Promise<void> WebSocket::pump(
-    IoContext& context, OutgoingMessagesMap& outgoingMessages, kj::WebSocket& ws) {
-  if (outgoingMessages.size() == 0) {
-    return kj::READY_NOW;
-  } else KJ_IF_MAYBE(promise, outgoingMessages.ordered().begin()->outputLock) {
-    return promise->then([&context, &outgoingMessages, &ws]() mutable {
-      return pumpAfterFrontOutputLock(context, outgoingMessages, ws);
-    });
-  } else {
-    return pumpAfterFrontOutputLock(context, outgoingMessages, ws);
-  }
-}
-
 namespace {
 size_t countBytesFromMessage(const kj::WebSocket::Message& message) {
   // This does not count the extra data of the RPC frame or the savings from any compression.
@@ -633,37 +773,44 @@ size_t countBytesFromMessage(const kj::WebSocket::Message& message) {
 }
 }
 
-kj::Promise<void> WebSocket::pumpAfterFrontOutputLock(
+kj::Promise<void> WebSocket::pump(
     IoContext& context, OutgoingMessagesMap& outgoingMessages, kj::WebSocket& ws) {
-  GatedMessage gatedMessage =
-      outgoingMessages.release(*outgoingMessages.ordered().begin());
-  auto size = countBytesFromMessage(gatedMessage.message);
+  // Messages queued while we send are picked up by the same loop. (kj::WebSocket takes one message
+  // at a time, so each send has to finish before the next.)
+  while (outgoingMessages.size() > 0) {
+    {
+      auto& front = *outgoingMessages.ordered().begin();
+      KJ_IF_MAYBE(lock, front.outputLock) {
+        // Take the promise out first: the table may move its rows while we wait.
+        auto promise = kj::mv(*lock);
+        front.outputLock = nullptr;
+        co_await promise;
+      }
+    }
+
+    GatedMessage gatedMessage =
+        outgoingMessages.release(*outgoingMessages.ordered().begin());
+    auto size = countBytesFromMessage(gatedMessage.message);
 
-  kj::Promise<void> promise = nullptr;
-  {
     KJ_SWITCH_ONEOF(gatedMessage.message) {
       KJ_CASE_ONEOF(text, kj::String) {
-        promise = ws.send(text);
+        co_await ws.send(text);
         break;
       }
       KJ_CASE_ONEOF(data, kj::Array<byte>) {
-        promise = ws.send(data);
+        co_await ws.send(data);
         break;
       }
       KJ_CASE_ONEOF(close, kj::WebSocket::Close) {
-        promise = ws.close(close.code, close.reason);
+        co_await ws.close(close.code, close.reason);
         break;
       }
     }
-  }
 
-  return promise.attach(kj::mv(gatedMessage.message))
-      .then([&context, &outgoingMessages, &ws, size]() {
     KJ_IF_MAYBE(a, context.getActor()) {
       a->getMetrics().sentWebSocketMessage(size);
     }
-    return pump(context, outgoingMessages, ws);
-  });
+  }
 }
 
 kj::Promise<void> WebSocket::readLoop(kj::WebSocket& ws) {
@@ -714,9 +861,12 @@ kj::Promise<void> WebSocket::readLoop(kj::WebSocket& ws) {
 
 jsg::Ref<WebSocketPair> WebSocketPair::constructor() {
   auto pipe = kj::newWebSocketPipe();
-  return jsg::alloc<WebSocketPair>(
-      jsg::alloc<WebSocket>(kj::mv(pipe.ends[0]), WebSocket::LOCAL),
-      jsg::alloc<WebSocket>(kj::mv(pipe.ends[1]), WebSocket::LOCAL));
+  auto first = jsg::alloc<WebSocket>(kj::mv(pipe.ends[0]), WebSocket::LOCAL);
+  auto second = jsg::alloc<WebSocket>(kj::mv(pipe.ends[1]), WebSocket::LOCAL);
+  auto pairState = kj::refcounted<WebSocket::PairState>();
+  first->pairState = kj::addRef(*pairState);
+  second->pairState = kj::mv(pairState);
+  return jsg::alloc<WebSocketPair>(kj::mv(first), kj::mv(second));
 }
 
 void ErrorEvent::visitForGc(jsg::GcVisitor& visitor) {
@@ -9,6 +9,7 @@
 #include <kj/compat/http.h>
 #include "basics.h"
 #include <workerd/io/io-context.h>
+#include <workerd/io/hibernation-manager.h>
 
 namespace workerd::api {
 
@@ -165,6 +166,11 @@ public:
   // WebSocket object to the caller in Javascript immediately. We will defer the connection logic
   // to the `initConnection` method.
 
+  explicit WebSocket(kj::Own<HibernationManager::Socket> socket);
+  // Wraps a socket that an earlier instance of the actor accepted for hibernation. The wrapper
+  // starts out accepted. It sends on the socket directly but never reads from it: the
+  // HibernationManager does that, and delivers what it reads to the actor's handler methods.
+
   void initConnection(jsg::Lock& js, kj::Promise<PackedWebSocket>);
   // We initiate a `new WebSocket()` connection and set up a continuation that handles the
   // response once it's available. This includes assigning the native websocket and dispatching the
@@ -200,7 +206,28 @@ public:
   // We defer the actual logic of accept() and internalAccept() to this method, since they largely
   // share code.
 
+  void acceptHibernatable(
+      jsg::Lock& js, HibernationManager& manager, kj::Array<kj::String> tags);
+  // Implements `state.acceptWebSocket()`: like accept(), except that ownership of the native
+  // WebSocket moves to `manager`, which receives on it instead of this object's read loop. Messages
+  // go to the actor's `webSocketMessage()` method rather than to event listeners.
+
+  void hibernatableCloseReceived();
+  // Called by the HibernationManager's event before delivering `webSocketClose()` or
+  // `webSocketError()`, to record that nothing more will arrive.
+
+  void serializeAttachment(jsg::Lock& js, v8::Local<v8::Value> attachment);
+  v8::Local<v8::Value> deserializeAttachment(jsg::Lock& js);
+  // Stores a value with a hibernatable WebSocket that survives the actor being hibernated.
+
   void send(jsg::Lock& js, kj::OneOf<kj::Array<byte>, kj::String> message);
+  static void broadcast(jsg::Lock& js, kj::Array<jsg::Ref<WebSocket>> sockets,
+                        kj::OneOf<kj::Array<byte>, kj::String> message);
+  // Sends `message` on each of `sockets`, as if send() was called on each. The message is
+  // converted from JavaScript once and every socket's outgoing queue shares the one buffer, so
+  // fan-out to many sockets costs little more than one send() plus the framing per socket.
+  // Sockets that have been closed or disconnected are skipped, rather than throwing as send()
+  // would; every socket must have been accepted.
   void close(jsg::Lock& js, jsg::Optional<int> code, jsg::Optional<kj::String> reason);
   int getReadyState();
 
@@ -221,7 +248,10 @@ public:
     JSG_INHERIT(EventTarget);
     JSG_METHOD(accept);
     JSG_METHOD(send);
+    JSG_STATIC_METHOD(broadcast);
     JSG_METHOD(close);
+    JSG_METHOD(serializeAttachment);
+    JSG_METHOD(deserializeAttachment);
 
     JSG_STATIC_CONSTANT(READY_STATE_CONNECTING);
     JSG_STATIC_CONSTANT(READY_STATE_OPEN);
@@ -326,6 +356,7 @@ private:
   struct GatedMessage {
     kj::Maybe<kj::Promise<void>> outputLock;  // must wait for this before actually sending
     kj::WebSocket::Message message;
+    // The content may be shared with other sockets' queues; see broadcast().
   };
   using OutgoingMessagesMap = kj::Table<GatedMessage, kj::InsertionOrderIndex>;
   IoOwn<OutgoingMessagesMap> outgoingMessages;
@@ -334,6 +365,20 @@ private:
 
   Locality locality;
 
+  kj::Maybe<IoOwn<HibernationManager::Socket>> hibernatableSocket;
+  // Set if this WebSocket was accepted with `state.acceptWebSocket()`.
+
+  struct PairState: public kj::Refcounted {
+    bool hibernatable = false;
+    // Set once either end of the pair is accepted for hibernation. The other end is then proxied
+    // like a remote WebSocket when it's returned in a Response, so that the request which returned
+    // it doesn't keep the actor resident for as long as the client stays connected.
+  };
+  kj::Maybe<kj::Own<PairState>> pairState;
+  // Shared by both ends of a WebSocketPair.
+
+  friend class WebSocketPair;
+
   // Contains a websocket and possibly some data from the WebSocketResponse headers.
   struct PackedWebSocket {
     kj::Own<kj::WebSocket> ws;
@@ -343,16 +388,18 @@ private:
 
   void dispatchOpen(jsg::Lock& js);
 
+  void enqueue(jsg::Lock& js, kj::WebSocket::Message message);
+  // Adds `message` to `outgoingMessages`, gated on the current output locks, and makes sure the
+  // pump is running. The caller must have checked that the socket is accepted and open.
+
   void ensurePumping(jsg::Lock& js);
 
   static kj::Promise<void> pump(
       IoContext& context, OutgoingMessagesMap& outgoingMessages, kj::WebSocket& ws);
-  static kj::Promise<void> pumpAfterFrontOutputLock(
-      IoContext& context, OutgoingMessagesMap& outgoingMessages, kj::WebSocket& ws);
-  // Write messages from `outgoingMessages` into `ws`.
+  // Write messages from `outgoingMessages` into `ws`, until none are left.
   //
-  // These are not necessarily called under isolate lock, but they are called on the given
-  // context's thread. They are declared `static` to prove they don't access the JavaScript
+  // This is not necessarily called under isolate lock, but it is called on the given
+  // context's thread. It is declared `static` to prove it doesn't access the JavaScript
   // object's members in a thread-unsafe way. `outgoingMessages` and `ws` are both `IoOwn`ed
   // objects so are safe to access from the thread without the isolate lock. The whole task is
   // owned by the `IoContext` so it'll be canceled if the `IoContext` is destroyed.
@@ -0,0 +1,333 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+// Microbenchmarks for ActorCache. Storage is a trivial in-memory map served over a local
+// capability, so that the numbers reflect the cache itself plus the cost of the RPCs it makes.
+//
+// Run with `bazel run -c opt //src/workerd/io:actor-cache-bench`. Results are written to stdout as
+// JSON lines; see util/benchmark.h.
+
+#include "actor-cache.h"
+#include "io-gate.h"
+#include <workerd/util/benchmark.h>
+#include <kj/map.h>
+#include <algorithm>
+#include <string.h>
+
+namespace workerd {
+namespace {
+
+struct MemoryStore: public kj::Refcounted {
+  kj::TreeMap<kj::String, kj::Array<kj::byte>> entries;
+};
+
+using StoreEntry = kj::TreeMap<kj::String, kj::Array<kj::byte>>::Entry;
+
+kj::String keyFromData(capnp::Data::Reader data) {
+  return kj::str(data.asChars());
+}
+
+kj::Promise<void> sendValues(rpc::ActorStorage::ListStream::Client stream,
+                             kj::ArrayPtr<const StoreEntry* const> entries) {
+  auto end = [stream]() mutable { return stream.endRequest().send().ignoreResult(); };
+  if (entries.size() == 0) return end();
+
+  auto req = stream.valuesRequest();
+  auto list = req.initList(entries.size());
+  for (auto i: kj::indices(entries)) {
+    list[i].setKey(entries[i]->key.asBytes());
+    list[i].setValue(entries[i]->value);
+  }
+  return req.send().then(kj::mv(end));
+}
+
+template <typename Base>
+class MemoryOperations: public Base {
+  // Implements ActorStorage::Operations for both Stage and Transaction. Transactions apply their
+  // writes immediately, since ActorCache is the only client and never rolls back.
+
+public:
+  explicit MemoryOperations(kj::Own<MemoryStore> store): store(kj::mv(store)) {}
+
+protected:
+  kj::Own<MemoryStore> store;
+
+  kj::Promise<void> get(typename Base::GetContext context) override {
+    KJ_IF_MAYBE(value, store->entries.find(keyFromData(context.getParams().getKey()))) {
+      context.getResults().setValue(*value);
+    }
+    return kj::READY_NOW;
+  }
+
+  kj::Promise<void> getMultiple(typename Base::GetMultipleContext context) override {
+    auto params = context.getParams();
+    kj::Vector<const StoreEntry*> results;
+    for (auto key: params.getKeys()) {
+      KJ_IF_MAYBE(entry, store->entries.findEntry(keyFromData(key))) {
+        results.add(entry);
+      }
+    }
+    return sendValues(params.getStream(), results.asPtr());
+  }
+
+  kj::Promise<void> list(typename Base::ListContext context) override {
+    auto params = context.getParams();
+    auto& entries = store->entries;
+    kj::Maybe<kj::String> end;
+    if (params.hasEnd()) end = keyFromData(params.getEnd());
+    auto prefix = params.hasPrefix() ? keyFromData(params.getPrefix()) : kj::str();
+
+    kj::Vector<const StoreEntry*> results;
+    auto iter = params.hasStart() ? entries.seek(keyFromData(params.getStart())) : entries.begin();
+    for (; iter != entries.end(); ++iter) {
+      KJ_IF_MAYBE(e, end) {
+        if (!(iter->key < *e)) break;
+      }
+      if (iter->key.startsWith(prefix)) results.add(&*iter);
+    }
+
+    if (params.getReverse()) std::reverse(results.begin(), results.end());
+    if (params.getLimit() > 0 && results.size() > uint(params.getLimit())) {
+      results.truncate(params.getLimit());
+    }
+    return sendValues(params.getStream(), results.asPtr());
+  }
+
+  kj::Promise<void> put(typename Base::PutContext context) override {
+    for (auto entry: context.getParams().getEntries()) {
+      store->entries.upsert(keyFromData(entry.getKey()), kj::heapArray<kj::byte>(entry.getValue()),
+          [](auto& existing, auto&& replacement) { existing = kj::mv(replacement); });
+    }
+    return kj::READY_NOW;
+  }
+
+  kj::Promise<void> delete_(typename Base::DeleteContext context) override {
+    int32_t numDeleted = 0;
+    for (auto key: context.getParams().getKeys()) {
+      if (store->entries.erase(keyFromData(key))) ++numDeleted;
+    }
+    context.getResults().setNumDeleted(numDeleted);
+    return kj::READY_NOW;
+  }
+
+  kj::Promise<void> deleteAll(typename Base::DeleteAllContext context) override {
+    context.getResults().setNumDeleted(store->entries.size());
+    store->entries.clear();
+    return kj::READY_NOW;
+  }
+};
+
+class MemoryTransaction final
+    : public MemoryOperations<rpc::ActorStorage::Stage::Transaction::Server> {
+public:
+  using MemoryOperations::MemoryOperations;
+
+protected:
+  kj::Promise<void> commit(CommitContext context) override { return kj::READY_NOW; }
+  kj::Promise<void> rollback(RollbackContext context) override { return kj::READY_NOW; }
+};
+
+class MemoryStage final: public MemoryOperations<rpc::ActorStorage::Stage::Server> {
+public:
+  using MemoryOperations::MemoryOperations;
+
+protected:
+  kj::Promise<void> txn(TxnContext context) override {
+    context.getResults().setTransaction(kj::heap<MemoryTransaction>(kj::addRef(*store)));
+    return kj::READY_NOW;
+  }
+};
+
+class EvictionCounter final: public ActorCache::Hooks {
+public:
+  void entryEvicted() override { ++count; }
+  uint64_t count = 0;
+};
+
+template <typename T>
+T resolve(kj::WaitScope& ws, kj::OneOf<T, kj::Promise<T>> result) {
+  KJ_SWITCH_ONEOF(result) {
+    KJ_CASE_ONEOF(promise, kj::Promise<T>) {
+      return promise.wait(ws);
+    }
+    KJ_CASE_ONEOF(value, T) {
+      return kj::mv(value);
+    }
+  }
+  KJ_UNREACHABLE;
+}
+
+kj::String key(kj::StringPtr prefix, uint i) {
+  // Fixed-width, so that keys sort in numeric order.
+  return kj::str(prefix, 100'000'000 + i);
+}
+
+struct CacheBenchmarkOptions {
+  size_t softLimit = 1u << 30;
+  size_t hardLimit = 2u << 30;
+};
+
+struct CacheBenchmark {
+  kj::EventLoop loop;
+  kj::WaitScope ws;
+  kj::Own<MemoryStore> store = kj::refcounted<MemoryStore>();
+  ActorCache::SharedLru lru;
+  OutputGate gate;
+  EvictionCounter evictions;
+  ActorCache cache;
+
+  explicit CacheBenchmark(CacheBenchmarkOptions options = {})
+      : ws(loop),
+        lru({.softLimit = options.softLimit, .hardLimit = options.hardLimit,
+             .staleTimeout = 1000 * kj::SECONDS, .dirtyKeySoftLimit = kj::maxValue,
+             .maxKeysPerRpc = rpc::ActorStorage::MAX_KEYS}),
+        cache(kj::heap<MemoryStage>(kj::addRef(*store)), lru, gate, evictions) {}
+
+  void populate(kj::StringPtr prefix, uint count, size_t valueSize) {
+    // Writes directly to storage, bypassing the cache.
+    auto value = kj::heapArray<kj::byte>(valueSize);
+    memset(value.begin(), 'x', value.size());
+    for (uint i = 0; i < count; i++) {
+      store->entries.upsert(key(prefix, i), kj::heapArray<kj::byte>(value),
+          [](auto& existing, auto&& replacement) { existing = kj::mv(replacement); });
+    }
+  }
+
+  auto get(kj::String key) {
+    return resolve(ws, cache.get(kj::mv(key), {}));
+  }
+
+  void put(kj::String key, size_t valueSize) {
+    auto value = kj::heapArray<kj::byte>(valueSize);
+    memset(value.begin(), 'y', value.size());
+    KJ_IF_MAYBE(backpressure, cache.put(kj::mv(key), kj::mv(value), {})) {
+      backpressure->wait(ws);
+    }
+  }
+
+  void flush() {
+    KJ_IF_MAYBE(promise, cache.onNoPendingFlush()) {
+      promise->wait(ws);
+    }
+  }
+};
+
+constexpr uint OPS = 100'000;
+constexpr size_t VALUE_SIZE = 100;
+
+void benchmarkGet(double hitRatio) {
+  // Gets of keys which are spread over a small set of cached keys, in the given proportion, and a
+  // large set of keys that are read just once, each of which has to go to storage.
+
+  constexpr uint HOT_KEYS = 1000;
+  CacheBenchmark bench;
+  bench.populate("hot", HOT_KEYS, VALUE_SIZE);
+  bench.populate("cold", OPS, VALUE_SIZE);
+  for (uint i = 0; i < HOT_KEYS; i++) {
+    bench.get(key("hot", i));
+  }
+
+  uint hits = 0;
+  uint misses = 0;
+  auto elapsed = timeBenchmark([&]() {
+    for (uint i = 0; i < OPS; i++) {
+      if (i % 100 < hitRatio * 100) {
+        bench.get(key("hot", hits++ % HOT_KEYS));
+      } else {
+        bench.get(key("cold", misses++));
+      }
+    }
+  });
+  reportBenchmark("actor-cache/get", OPS, elapsed, {{"hitRatio", hitRatio}});
+}
+
+void benchmarkPut() {
+  CacheBenchmark bench;
+  auto elapsed = timeBenchmark([&]() {
+    for (uint i = 0; i < OPS; i++) {
+      bench.put(key("k", i), VALUE_SIZE);
+    }
+  });
+  bench.flush();
+  reportBenchmark("actor-cache/put", OPS, elapsed);
+}
+
+void benchmarkList(bool cached) {
+  // Lists ranges of 100 keys. Uncached lists go through distinct ranges, so each has to go to
+  // storage; cached lists repeat one range that has already been listed once.
+
+  constexpr uint RANGE = 100;
+  constexpr uint LISTS = 1000;
+  CacheBenchmark bench;
+  bench.populate("k", RANGE * LISTS, VALUE_SIZE);
+  if (cached) {
+    resolve(bench.ws, bench.cache.list(key("k", 0), key("k", RANGE), nullptr, {}));
+  }
+
+  auto elapsed = timeBenchmark([&]() {
+    for (uint i = 0; i < LISTS; i++) {
+      uint start = cached ? 0 : i * RANGE;
+      auto results = resolve(bench.ws,
+          bench.cache.list(key("k", start), key("k", start + RANGE), nullptr, {}));
+      KJ_ASSERT(results.size() == RANGE);
+    }
+  });
+  reportBenchmark("actor-cache/list", LISTS, elapsed,
+                  {{"cached", double(cached)}, {"keys", double(RANGE)}});
+}
+
+void benchmarkFlush(uint dirtyKeys) {
+  // Time from starting the event loop with `dirtyKeys` dirty keys until the flush is done.
+
+  CacheBenchmark bench;
+  uint rounds = kj::max(10u, 100'000 / dirtyKeys);
+  kj::Duration elapsed = 0 * kj::NANOSECONDS;
+  uint next = 0;
+  for (uint r = 0; r < rounds; r++) {
+    for (uint i = 0; i < dirtyKeys; i++) {
+      bench.put(key("k", next++ % 100'000), VALUE_SIZE);
+    }
+    elapsed += timeBenchmark([&]() { bench.flush(); });
+  }
+  reportBenchmark("actor-cache/flush", rounds, elapsed, {{"dirtyKeys", double(dirtyKeys)}});
+}
+
+void benchmarkEviction(size_t softLimit) {
+  // Gets of keys that aren't cached, while the cache is kept at `softLimit`, so that every get
+  // evicts an older entry. Compare with a limit large enough that nothing is evicted to see the
+  // cost of eviction.
+
+  constexpr uint KEYS = 20'000;
+  constexpr size_t LARGE_VALUE_SIZE = 1024;
+  CacheBenchmark bench({ .softLimit = softLimit });
+  bench.populate("k", KEYS, LARGE_VALUE_SIZE);
+
+  auto elapsed = timeBenchmark([&]() {
+    for (uint i = 0; i < KEYS; i++) {
+      bench.get(key("k", i));
+    }
+  });
+  reportBenchmark("actor-cache/evict", KEYS, elapsed,
+                  {{"softLimit", double(softLimit)}, {"evicted", double(bench.evictions.count)}});
+}
+
+}  // namespace
+}  // namespace workerd
+
+int main() {
+  using namespace workerd;
+
+  for (double hitRatio: {0.0, 0.5, 0.9, 1.0}) {
+    benchmarkGet(hitRatio);
+  }
+  benchmarkPut();
+  benchmarkList(false);
+  benchmarkList(true);
+  for (uint dirtyKeys: {1, 10, 100, 1000, 10'000}) {
+    benchmarkFlush(dirtyKeys);
+  }
+  benchmarkEviction(1u << 20);
+  benchmarkEviction(1u << 30);
+  return 0;
+}
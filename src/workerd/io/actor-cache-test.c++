@@ -198,6 +198,10 @@ struct ActorCacheTestOptions {
   size_t maxKeysPerRpc = 128;
   bool noCache = false;
   bool neverFlush = false;
+  uint maxFlushesInFlight = 1;
+  size_t maxBytesPerRpc = 16u << 20;
+  uint maxBatchesInFlight = kj::maxValue;
+  uint listReadAhead = 0;
 };
 
 struct ActorCacheTest: public ActorCacheConvenienceWrappers {
@@ -220,9 +224,15 @@ struct ActorCacheTest: public ActorCacheConvenienceWrappers {
                  MockServer::make<rpc::ActorStorage::Stage>())
       : ActorCacheConvenienceWrappers(cache),
         ws(loop), mockStorage(kj::mv(mockPair.mock)),
-        lru({options.softLimit, options.hardLimit,
-             options.staleTimeout, options.dirtyKeySoftLimit, options.maxKeysPerRpc,
-             options.noCache, options.neverFlush}),
+        lru({.softLimit = options.softLimit, .hardLimit = options.hardLimit,
+             .staleTimeout = options.staleTimeout,
+             .dirtyKeySoftLimit = options.dirtyKeySoftLimit,
+             .maxKeysPerRpc = options.maxKeysPerRpc,
+             .maxBytesPerRpc = options.maxBytesPerRpc,
+             .maxBatchesInFlight = options.maxBatchesInFlight,
+             .noCache = options.noCache, .neverFlush = options.neverFlush,
+             .maxFlushesInFlight = options.maxFlushesInFlight,
+             .listReadAhead = options.listReadAhead}),
         cache(kj::mv(mockPair.client), lru, gate),
         gateBrokenPromise(options.monitorOutputGate
             ? eagerlyReportExceptions(gate.onBroken())
@@ -243,6 +253,23 @@ struct ActorCacheTest: public ActorCacheConvenienceWrappers {
   }
 };
 
+KJ_TEST("ActorCache GetResultList from key-value pairs") {
+  kj::Vector<ActorCache::KeyValuePair> pairs;
+  pairs.add(ActorCache::KeyValuePair { kj::str("bar"), kj::heapArray("456"_kj.asBytes()) });
+  pairs.add(ActorCache::KeyValuePair { kj::str("foo"), kj::heapArray("123"_kj.asBytes()) });
+  auto barKey = pairs[0].key.begin();
+
+  ActorCache::GetResultList list(kj::mv(pairs));
+  KJ_ASSERT(list.size() == 2);
+  KJ_ASSERT(stringifyValues(list) == kvs({{"bar", "456"}, {"foo", "123"}}));
+
+  // Rows point at the original keys rather than at copies.
+  KJ_EXPECT(list.begin()->key.begin() == barKey);
+  for (auto row: list) {
+    KJ_EXPECT(row.status == ActorCache::CacheStatus::UNCACHED);
+  }
+}
+
 KJ_TEST("ActorCache single-key basics") {
   ActorCacheTest test;
   auto& ws = test.ws;
@@ -673,6 +700,38 @@ KJ_TEST("ActorCache batching due to maxKeysPerRpc") {
   mockTxn->expectDropped(ws);
 }
 
+KJ_TEST("ActorCache batching due to maxBytesPerRpc, paced by maxBatchesInFlight") {
+  // Each small put takes 32 bytes in the message, so two fit in a batch.
+  ActorCacheTest test({.maxBytesPerRpc = 64, .maxBatchesInFlight = 1});
+  auto& ws = test.ws;
+  auto& mockStorage = test.mockStorage;
+
+  auto big = kj::str(kj::repeat('x', 100));
+  test.put("foo", "123");
+  test.put("bar", "456");
+  test.put("qux", big);
+  test.put("baz", "789");
+
+  auto mockTxn = mockStorage->expectCall("txn", ws).returnMock("transaction");
+  auto firstPut = mockTxn->expectCall("put", ws)
+      .withParams(CAPNP(entries = [(key = "foo", value = "123"),
+                                    (key = "bar", value = "456")]));
+
+  // Nothing else is sent until the first batch returns.
+  mockTxn->expectNoActivity(ws);
+  kj::mv(firstPut).thenReturn(CAPNP());
+
+  // A value too big for the limit gets a batch of its own.
+  mockTxn->expectCall("put", ws)
+      .withParams(kj::str("(entries = [(key = \"qux\", value = \"", big, "\")])"))
+      .thenReturn(CAPNP());
+  mockTxn->expectCall("put", ws)
+      .withParams(CAPNP(entries = [(key = "baz", value = "789")]))
+      .thenReturn(CAPNP());
+  mockTxn->expectCall("commit", ws).thenReturn(CAPNP());
+  mockTxn->expectDropped(ws);
+}
+
 KJ_TEST("ActorCache batching due to max storage RPC words") {
   ActorCacheTest test({.hardLimit = 128 * 1024 * 1024});
   auto& ws = test.ws;
@@ -1250,6 +1309,92 @@ KJ_TEST("ActorCache output gate blocked during flush") {
   gatePromise.wait(ws);
 }
 
+KJ_TEST("ActorCache pipelines flushes") {
+  ActorCacheTest test({.monitorOutputGate = false, .maxFlushesInFlight = 2});
+  auto& ws = test.ws;
+  auto& mockStorage = test.mockStorage;
+
+  test.put("foo", "123");
+
+  auto mockTxn1 = mockStorage->expectCall("txn", ws)
+      .withParams(CAPNP(settings = (sequence = 1)))
+      .returnMock("transaction");
+  mockTxn1->expectCall("put", ws)
+      .withParams(CAPNP(entries = [(key = "foo", value = "123")]))
+      .thenReturn(CAPNP());
+  auto commitCall1 = mockTxn1->expectCall("commit", ws);
+
+  // The second flush goes out without waiting for the first to commit.
+  test.put("bar", "456");
+  test.delete_("baz");
+
+  auto mockTxn2 = mockStorage->expectCall("txn", ws)
+      .withParams(CAPNP(settings = (sequence = 2)))
+      .returnMock("transaction");
+  mockTxn2->expectCall("delete", ws)
+      .withParams(CAPNP(keys = ["baz"]))
+      .thenReturn(CAPNP(numDeleted = 0));
+  mockTxn2->expectCall("put", ws)
+      .withParams(CAPNP(entries = [(key = "bar", value = "456")]))
+      .thenReturn(CAPNP());
+  auto commitCall2 = mockTxn2->expectCall("commit", ws);
+
+  auto gatePromise = test.gate.wait();
+  KJ_ASSERT(!gatePromise.poll(ws));
+
+  kj::mv(commitCall1).thenReturn(CAPNP());
+  mockTxn1->expectDropped(ws);
+  KJ_ASSERT(!gatePromise.poll(ws));
+
+  kj::mv(commitCall2).thenReturn(CAPNP());
+  mockTxn2->expectDropped(ws);
+  gatePromise.wait(ws);
+
+  {
+    auto result = KJ_ASSERT_NONNULL(expectCached(test.get("foo")));
+    KJ_EXPECT(result == "123");
+  }
+  {
+    auto result = KJ_ASSERT_NONNULL(expectCached(test.get("bar")));
+    KJ_EXPECT(result == "456");
+  }
+  KJ_EXPECT(expectCached(test.get("baz")) == nullptr);
+}
+
+KJ_TEST("ActorCache retries a pipelined flush with the same sequence number") {
+  ActorCacheTest test({.maxFlushesInFlight = 2});
+  auto& ws = test.ws;
+  auto& mockStorage = test.mockStorage;
+
+  test.put("foo", "123");
+
+  {
+    auto mockTxn = mockStorage->expectCall("txn", ws)
+        .withParams(CAPNP(settings = (sequence = 1)))
+        .returnMock("transaction");
+    mockTxn->expectCall("put", ws)
+        .withParams(CAPNP(entries = [(key = "foo", value = "123")]))
+        .thenReturn(CAPNP());
+    mockTxn->expectCall("commit", ws)
+        .thenThrow(KJ_EXCEPTION(DISCONNECTED, "oops"));
+    mockTxn->expectDropped(ws);
+  }
+
+  {
+    auto mockTxn = mockStorage->expectCall("txn", ws)
+        .withParams(CAPNP(settings = (sequence = 1)))
+        .returnMock("transaction");
+    mockTxn->expectCall("put", ws)
+        .withParams(CAPNP(entries = [(key = "foo", value = "123")]))
+        .thenReturn(CAPNP());
+    mockTxn->expectCall("commit", ws).thenReturn(CAPNP());
+    mockTxn->expectDropped(ws);
+  }
+
+  auto result = KJ_ASSERT_NONNULL(expectCached(test.get("foo")));
+  KJ_EXPECT(result == "123");
+}
+
 KJ_TEST("ActorCache output gate bypass") {
   ActorCacheTest test({.monitorOutputGate = false});
   auto& ws = test.ws;
@@ -2381,6 +2526,63 @@ KJ_TEST("ActorCache list() delete endpoint") {
   }
 }
 
+KJ_TEST("ActorCache list() reads ahead during sequential scans") {
+  ActorCacheTest test({.listReadAhead = 2});
+  auto& ws = test.ws;
+  auto& mockStorage = test.mockStorage;
+
+  // The first page isn't known to be part of a scan, so nothing extra is fetched.
+  {
+    auto promise = expectUncached(test.list("a", "z", 2));
+
+    mockStorage->expectCall("list", ws)
+        .withParams(CAPNP(start = "a", end = "z", limit = 2), "stream"_kj)
+        .useCallback("stream", [&](MockClient stream) {
+      stream.call("values", CAPNP(list = [(key = "b", value = "1"), (key = "c", value = "2")]))
+          .expectReturns(CAPNP(), ws);
+      stream.call("end", CAPNP()).expectReturns(CAPNP(), ws);
+    }).expectCanceled();
+
+    KJ_ASSERT(promise.wait(ws) == kvs({{"b", "1"}, {"c", "2"}}));
+  }
+
+  // The next page starts where the last one ended, so we ask for two more keys than needed.
+  {
+    auto promise = expectUncached(test.list("c", "z", 2));
+
+    mockStorage->expectCall("list", ws)
+        .withParams(CAPNP(start = "c\0", end = "z", limit = 3), "stream"_kj)
+        .useCallback("stream", [&](MockClient stream) {
+      stream.call("values", CAPNP(list = [(key = "d", value = "3"), (key = "e", value = "4"),
+                                          (key = "f", value = "5")]))
+          .expectReturns(CAPNP(), ws);
+      stream.call("end", CAPNP()).expectReturns(CAPNP(), ws);
+    }).expectCanceled();
+
+    KJ_ASSERT(promise.wait(ws) == kvs({{"c", "2"}, {"d", "3"}}));
+  }
+
+  // The keys read ahead are in cache.
+  KJ_ASSERT(expectCached(test.list("d", "z", 2)) == kvs({{"d", "3"}, {"e", "4"}}));
+  KJ_ASSERT(expectCached(test.list("e", "z", 2)) == kvs({{"e", "4"}, {"f", "5"}}));
+  KJ_ASSERT(expectCached(test.get("ea")) == nullptr);
+
+  // A list() elsewhere in the range doesn't read ahead.
+  {
+    auto promise = expectUncached(test.list("q", "z", 2));
+
+    mockStorage->expectCall("list", ws)
+        .withParams(CAPNP(start = "q", end = "z", limit = 2), "stream"_kj)
+        .useCallback("stream", [&](MockClient stream) {
+      stream.call("values", CAPNP(list = [(key = "r", value = "6")]))
+          .expectReturns(CAPNP(), ws);
+      stream.call("end", CAPNP()).expectReturns(CAPNP(), ws);
+    }).expectCanceled();
+
+    KJ_ASSERT(promise.wait(ws) == kvs({{"r", "6"}}));
+  }
+}
+
 KJ_TEST("ActorCache list() delete endpoint empty range") {
   // Same as last test except the listed range is totally empty.
   ActorCacheTest test;
@@ -3665,6 +3867,142 @@ KJ_TEST("ActorCache LRU purge") {
   expectUncached(test.get("baz"));
 }
 
+KJ_TEST("ActorCache LRU shards evict independently") {
+  kj::EventLoop loop;
+  kj::WaitScope ws(loop);
+
+  // Each shard's share of the soft limit fits two entries but not three; the whole LRU fits three
+  // but not four.
+  ActorCache::SharedLru lru({
+    .softLimit = 4400,
+    .hardLimit = 1024 * 1024,
+    .staleTimeout = 1 * kj::SECONDS,
+    .dirtyKeySoftLimit = 1024,
+    .maxKeysPerRpc = 128,
+    .shardCount = 2,
+  });
+
+  auto pairA = MockServer::make<rpc::ActorStorage::Stage>();
+  auto pairB = MockServer::make<rpc::ActorStorage::Stage>();
+  OutputGate gateA, gateB;
+  ActorCache cacheA(kj::mv(pairA.client), lru, gateA);
+  ActorCache cacheB(kj::mv(pairB.client), lru, gateB);
+  ActorCacheConvenienceWrappers a(cacheA), b(cacheB);
+
+  auto kilobyte = kj::str(kj::repeat('x', 1024));
+  auto load = [&](ActorCacheConvenienceWrappers& cache, MockServer& mock, kj::StringPtr key) {
+    auto promise = expectUncached(cache.get(key));
+    mock.expectCall("get", ws)
+        .withParams(kj::str("(key = \"", key, "\")"))
+        .thenReturn(kj::str("(value = \"", kilobyte, "\")"));
+    KJ_ASSERT(KJ_ASSERT_NONNULL(promise.wait(ws)) == kilobyte);
+  };
+
+  load(a, *pairA.mock, "foo");
+  load(a, *pairA.mock, "bar");
+  load(a, *pairA.mock, "baz");
+
+  // The LRU as a whole is now over the soft limit, but cache B's shard is under its share, so
+  // loading into B evicts nothing -- not even A's least-recently-used entry.
+  load(b, *pairB.mock, "qux");
+  KJ_ASSERT(KJ_ASSERT_NONNULL(expectCached(a.get("foo"))) == kilobyte);
+
+  // Loading more into A makes A's shard evict its own LRU entries until the total is under the
+  // limit again.
+  load(a, *pairA.mock, "corge");
+  expectUncached(a.get("bar"));
+  expectUncached(a.get("baz"));
+  KJ_ASSERT(KJ_ASSERT_NONNULL(expectCached(a.get("foo"))) == kilobyte);
+  KJ_ASSERT(KJ_ASSERT_NONNULL(expectCached(a.get("corge"))) == kilobyte);
+  KJ_ASSERT(KJ_ASSERT_NONNULL(expectCached(b.get("qux"))) == kilobyte);
+}
+
+KJ_TEST("ActorCache LRUs sharing a memory budget") {
+  kj::EventLoop loop;
+  kj::WaitScope ws(loop);
+
+  // Each LRU's soft limit fits one entry but not two; the budget fits three but not four.
+  ActorCacheMemoryBudget budget(4400);
+  ActorCache::SharedLru::Options options {
+    .softLimit = 1500,
+    .hardLimit = 1024 * 1024,
+    .staleTimeout = 1 * kj::SECONDS,
+    .dirtyKeySoftLimit = 1024,
+    .maxKeysPerRpc = 128,
+    .budget = budget,
+  };
+  ActorCache::SharedLru lruA(options);
+  ActorCache::SharedLru lruB(options);
+
+  auto pairA = MockServer::make<rpc::ActorStorage::Stage>();
+  auto pairB = MockServer::make<rpc::ActorStorage::Stage>();
+  OutputGate gateA, gateB;
+  ActorCache cacheA(kj::mv(pairA.client), lruA, gateA);
+  ActorCache cacheB(kj::mv(pairB.client), lruB, gateB);
+  ActorCacheConvenienceWrappers a(cacheA), b(cacheB);
+
+  auto kilobyte = kj::str(kj::repeat('x', 1024));
+  auto load = [&](ActorCacheConvenienceWrappers& cache, MockServer& mock, kj::StringPtr key) {
+    auto promise = expectUncached(cache.get(key));
+    mock.expectCall("get", ws)
+        .withParams(kj::str("(key = \"", key, "\")"))
+        .thenReturn(kj::str("(value = \"", kilobyte, "\")"));
+    KJ_ASSERT(KJ_ASSERT_NONNULL(promise.wait(ws)) == kilobyte);
+  };
+
+  // While the budget has room, A keeps well over its own soft limit.
+  load(a, *pairA.mock, "foo");
+  load(a, *pairA.mock, "bar");
+  load(a, *pairA.mock, "baz");
+  KJ_ASSERT(budget.currentSize() == lruA.currentSize());
+
+  // B is within its soft limit, so it evicts nothing even though the budget is now exceeded.
+  load(b, *pairB.mock, "qux");
+  KJ_ASSERT(budget.isExceeded());
+
+  // A, on the other hand, evicts its LRU entries until the budget has room again.
+  load(a, *pairA.mock, "corge");
+  KJ_ASSERT(!budget.isExceeded());
+  expectUncached(a.get("foo"));
+  expectUncached(a.get("bar"));
+  KJ_ASSERT(KJ_ASSERT_NONNULL(expectCached(a.get("baz"))) == kilobyte);
+  KJ_ASSERT(KJ_ASSERT_NONNULL(expectCached(a.get("corge"))) == kilobyte);
+  KJ_ASSERT(KJ_ASSERT_NONNULL(expectCached(b.get("qux"))) == kilobyte);
+}
+
+KJ_TEST("ActorCache counts its entries as external memory") {
+  kj::EventLoop loop;
+  kj::WaitScope ws(loop);
+
+  auto tracker = kj::atomicRefcounted<jsg::ExternalMemoryTracker>();
+  auto& counter = tracker->getCounter("ActorCache");
+  {
+    ActorCache::SharedLru lru({
+      .softLimit = 1024 * 1024,
+      .hardLimit = 1024 * 1024,
+      .staleTimeout = 1 * kj::SECONDS,
+      .dirtyKeySoftLimit = 1024,
+      .maxKeysPerRpc = 128,
+      .memoryCounter = counter,
+    });
+
+    auto pair = MockServer::make<rpc::ActorStorage::Stage>();
+    OutputGate gate;
+    ActorCache cache(kj::mv(pair.client), lru, gate);
+    ActorCacheConvenienceWrappers a(cache);
+
+    auto promise = expectUncached(a.get("foo"));
+    pair.mock->expectCall("get", ws)
+        .withParams(CAPNP(key = "foo"))
+        .thenReturn(CAPNP(value = "bar"));
+    KJ_ASSERT(KJ_ASSERT_NONNULL(promise.wait(ws)) == "bar");
+
+    KJ_EXPECT(counter.get() > 0);
+    KJ_EXPECT(size_t(counter.get()) == lru.currentSize());
+  }
+  KJ_EXPECT(counter.get() == 0);
+}
+
 KJ_TEST("ActorCache evict on timeout") {
   ActorCacheTest test;
   auto& ws = test.ws;
@@ -3928,6 +4266,53 @@ KJ_TEST("ActorCache timeout entry with known-empty gaps") {
   expectUncached(test.get("fo"));
 }
 
+KJ_TEST("ActorCache timeout of a large entry keeps the known-empty gap before it") {
+  ActorCacheTest test;
+  auto& ws = test.ws;
+  auto& mockStorage = test.mockStorage;
+
+  auto startTime = kj::UNIX_EPOCH;
+  test.cache.evictStale(startTime);
+
+  // Big enough that replacing it with an END_GAP entry frees most of its memory.
+  auto bigValue = kj::heapString(1024);
+  for (char& c: bigValue) c = 'x';
+
+  // Populate cache.
+  {
+    auto promise = expectUncached(test.list("bar", "qux"));
+
+    mockStorage->expectCall("list", ws)
+        .withParams(CAPNP(start = "bar", end = "qux"), "stream"_kj)
+        .useCallback("stream", [&](MockClient stream) {
+      stream.call("values", kj::str(
+          "(list = [(key = \"bar\", value = \"456\"), (key = \"baz\", value = \"789\"), "
+          "(key = \"corge\", value = \"", bigValue, "\"), (key = \"foo\", value = \"123\")])"))
+          .expectReturns(CAPNP(), ws);
+      stream.call("end", CAPNP()).expectReturns(CAPNP(), ws);
+    }).expectCanceled();
+
+    KJ_ASSERT(promise.wait(ws).size() == 4);
+  }
+
+  // Make all entries STALE, then touch all but "corge" and time it out.
+  test.cache.evictStale(startTime + 1 * kj::SECONDS);
+  expectCached(test.get("bar"));
+  expectCached(test.get("baz"));
+  expectCached(test.get("foo"));
+  test.cache.evictStale(startTime + 2 * kj::SECONDS);
+
+  // "corge" itself and the range after it are missing, but the range before it is still known to
+  // be empty.
+  KJ_ASSERT(expectCached(test.list("bar", "corge")) == kvs({{"bar", "456"}, {"baz", "789"}}));
+  KJ_ASSERT(expectCached(test.get("baza")) == nullptr);
+  KJ_ASSERT(KJ_ASSERT_NONNULL(expectCached(test.get("foo"))) == "123");
+
+  expectUncached(test.get("corge"));
+  expectUncached(test.get("corgea"));
+  expectUncached(test.get("fo"));
+}
+
 KJ_TEST("ActorCache purge everything while listing") {
   ActorCacheTest test({.softLimit = 1});  // evict everything immediately
   auto& ws = test.ws;
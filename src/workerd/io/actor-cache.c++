@@ -7,6 +7,7 @@
 #include <algorithm>
 
 #include <kj/debug.h>
+#include <kj/function.h>
 
 #include <workerd/jsg/jsg.h>
 #include <workerd/io/io-gate.h>
@@ -23,14 +24,16 @@ static constexpr size_t MAX_ACTOR_STORAGE_RPC_WORDS = (16u << 20) / sizeof(capnp
 // Note that in practice, the key size limit (options.maxKeysPerRpc) will kick in long before we
 // hit this limit, so this is just a sanity check.
 
+ActorCache::Hooks ActorCache::Hooks::DEFAULT;
+
 ActorCache::ActorCache(rpc::ActorStorage::Stage::Client storage, const SharedLru& lru,
-                       OutputGate& gate)
-    : storage(kj::mv(storage)), lru(lru), gate(gate),
-      currentValues(lru.cleanList.lockExclusive()) {}
+                       OutputGate& gate, Hooks& hooks)
+    : storage(kj::mv(storage)), lru(lru), shard(lru.chooseShard()), gate(gate), hooks(hooks),
+      currentValues(shard.cleanList.lockExclusive()) {}
 
 ActorCache::~ActorCache() noexcept(false) {
   // Need to remove all entries from any lists they might be in.
-  auto lock = lru.cleanList.lockExclusive();
+  auto lock = shard.cleanList.lockExclusive();
   clear(lock);
 }
 
@@ -65,6 +68,13 @@ kj::Own<ActorCache::Entry> ActorCache::makeEntry(
     kj::Badge<ActorCache>(), *this, kj::mv(key), kj::mv(value), state);
 
   lru.size.fetch_add(result->size(), std::memory_order_relaxed);
+  shard.size.fetch_add(result->size(), std::memory_order_relaxed);
+  KJ_IF_MAYBE(budget, lru.options.budget) {
+    budget->size.fetch_add(result->size(), std::memory_order_relaxed);
+  }
+  KJ_IF_MAYBE(counter, lru.options.memoryCounter) {
+    counter->adjust(result->size());
+  }
 
   return result;
 }
@@ -73,50 +83,72 @@ ActorCache::Entry::Entry(kj::Badge<ActorCache>,ActorCache& cache, Key keyParam,
                          kj::Maybe<Value> valueParam, EntryState state)
     : cache(cache), key(kj::mv(keyParam)), value(kj::mv(valueParam)), state(state) {}
 
-ActorCache::Entry::Entry(kj::Badge<GetResultList>, Key keyParam, kj::Maybe<Value> valueParam)
-    : key(kj::mv(keyParam)), value(kj::mv(valueParam)), state(NOT_IN_CACHE) {}
-
 ActorCache::Entry::~Entry() noexcept(false) {
   KJ_IF_MAYBE(c, cache) {
     size_t size = this->size();
 
-    size_t before = c->lru.size.fetch_sub(size, std::memory_order_relaxed);
+    std::atomic<size_t>* budgetSize = nullptr;
+    KJ_IF_MAYBE(budget, c->lru.options.budget) {
+      budgetSize = &budget->size;
+    }
+
+    for (auto counter: {&c->lru.size, &c->shard.size, budgetSize}) {
+      if (counter == nullptr) continue;
+      size_t before = counter->fetch_sub(size, std::memory_order_relaxed);
+
+      if (KJ_UNLIKELY(before < size)) {
+        // underflow -- shouldn't happen, but just in case, let's fix
+        KJ_LOG(ERROR, "SharedLru size tracking inconsistency detected",
+              before, size, kj::getStackTrace());
+        counter->store(0, std::memory_order_relaxed);
+      }
+    }
 
-    if (KJ_UNLIKELY(before < size)) {
-      // underflow -- shouldn't happen, but just in case, let's fix
-      KJ_LOG(ERROR, "SharedLru size tracking inconsistency detected",
-            before, size, kj::getStackTrace());
-      c->lru.size.store(0, std::memory_order_relaxed);
+    KJ_IF_MAYBE(counter, c->lru.options.memoryCounter) {
+      counter->adjust(-int64_t(size));
     }
 
     KJ_REQUIRE(!link.isLinked(), "must remove Entry from lists before destroying", state);
   }
 }
 
-ActorCache::SharedLru::SharedLru(Options options): options(options) {}
+ActorCacheSharedLru::ActorCacheSharedLru(Options options)
+    : options(options),
+      shards(kj::heapArray<ActorCache::LruShard>(kj::max(options.shardCount, 1u))) {}
 
-ActorCache::SharedLru::~SharedLru() noexcept(false) {
-  KJ_REQUIRE(cleanList.getWithoutLock().empty(),
-      "ActorCache::SharedLru destroyed while an ActorCache still exists?");
+ActorCacheSharedLru::~ActorCacheSharedLru() noexcept(false) {
+  for (auto& shard: shards) {
+    KJ_REQUIRE(shard.cleanList.getWithoutLock().empty(),
+        "ActorCache::SharedLru destroyed while an ActorCache still exists?");
+  }
   if (size.load(std::memory_order_relaxed) != 0) {
     KJ_LOG(ERROR, "SharedLru destroyed while cache entries still exist, "
         "this will lead to use-after-free");
   }
 }
 
+ActorCacheMemoryBudget::~ActorCacheMemoryBudget() noexcept(false) {
+  if (size.load(std::memory_order_relaxed) != 0) {
+    KJ_LOG(ERROR, "ActorCacheMemoryBudget destroyed while cache entries still exist, "
+        "this will lead to use-after-free");
+  }
+}
+
 kj::Maybe<kj::Promise<void>> ActorCache::evictStale(kj::Date now) {
   int64_t nowNs = (now - kj::UNIX_EPOCH) / kj::NANOSECONDS;
-  int64_t oldValue = lru.nextStaleCheckNs.load(std::memory_order_relaxed);
+  int64_t oldValue = shard.nextStaleCheckNs.load(std::memory_order_relaxed);
 
   if (nowNs >= oldValue) {
     int64_t newValue = nowNs + lru.options.staleTimeout / kj::NANOSECONDS;
-    if (lru.nextStaleCheckNs.compare_exchange_strong(oldValue, newValue)) {
-      auto lock = lru.cleanList.lockExclusive();
+    if (shard.nextStaleCheckNs.compare_exchange_strong(oldValue, newValue)) {
+      auto lock = shard.cleanList.lockExclusive();
       for (auto& entry: *lock) {
         if (entry.state == STALE) {
           entry.state = NOT_IN_CACHE;
           lock->remove(entry);
-          KJ_ASSERT_NONNULL(entry.cache).evictEntry(lock, entry);
+          auto& cache = KJ_ASSERT_NONNULL(entry.cache);
+          cache.hooks.entryEvicted();
+          cache.evictEntry(lock, entry);
         } else {
           KJ_ASSERT(entry.state == CLEAN);
           entry.state = STALE;
@@ -200,7 +232,7 @@ void ActorCache::requireNotTerminal() {
 }
 
 void ActorCache::evictOrOomIfNeeded(Lock& lock) {
-  if (lru.evictIfNeeded(lock)) {
+  if (lru.evictIfNeeded(shard, lock)) {
     auto exception = KJ_EXCEPTION(OVERLOADED,
         "broken.exceededMemory; jsg.Error: Durable Object's isolate exceeded its memory limit due to overflowing the "
         "storage cache. This could be due to writing too many values to storage without stopping "
@@ -233,24 +265,51 @@ void ActorCache::evictOrOomIfNeeded(Lock& lock) {
   }
 }
 
-bool ActorCache::SharedLru::evictIfNeeded(Lock& lock) const {
+const ActorCache::LruShard& ActorCacheSharedLru::chooseShard() const {
+  return shards[nextShard.fetch_add(1, std::memory_order_relaxed) % shards.size()];
+}
+
+size_t ActorCacheSharedLru::getEvictionLimit() const {
+  KJ_IF_MAYBE(budget, options.budget) {
+    if (!budget->isExceeded()) {
+      return kj::max(options.softLimit, options.hardLimit);
+    }
+  }
+  return options.softLimit;
+}
+
+bool ActorCacheSharedLru::evictIfNeeded(const ActorCache::LruShard& shard,
+                                        ActorCache::Lock& lock) const {
+  // Each shard is only responsible for its share of the limits. With one shard, this is exactly
+  // the global limit.
+  size_t hardShare = options.hardLimit / shards.size();
+
   for (;;) {
+    // (Evicting our own entries can bring the budget back under its limit, so this is rechecked
+    // each time around.)
+    size_t limit = getEvictionLimit();
+    size_t softShare = limit / shards.size();
+
     size_t current = size.load(std::memory_order_relaxed);
-    if (current <= options.softLimit) {
-      // All good.
+    size_t currentInShard = shard.size.load(std::memory_order_relaxed);
+    if (current <= limit || currentInShard <= softShare) {
+      // All good, or we're over the limit but not because of this shard. (The other shards will
+      // evict when they are next touched, or stale eviction will catch them.)
       return false;
     }
 
     // We're over the limit, let's evict stuff.
     if (lock->empty()) {
       // Nothing to evict.
-      return current > options.hardLimit;
+      return current > options.hardLimit && currentInShard > hardShare;
     }
 
-    Entry& entry = lock->front();
-    entry.state = NOT_IN_CACHE;
+    ActorCache::Entry& entry = lock->front();
+    entry.state = ActorCache::NOT_IN_CACHE;
     lock->remove(entry);
-    KJ_ASSERT_NONNULL(entry.cache).evictEntry(lock, entry);
+    auto& cache = KJ_ASSERT_NONNULL(entry.cache);
+    cache.hooks.entryEvicted();
+    cache.evictEntry(lock, entry);
   }
 }
 
@@ -276,24 +335,34 @@ void ActorCache::evictEntry(Lock& lock, Entry& entry) {
 
   KJ_ASSERT(iter != ordered.end() && iter->get() == &entry);
 
-  // If the previous entry has gapIsKnownEmpty, we need to set that false, because when we delete
-  // this entry, the previous entry's "gap" will now extend to the *next* entry. We definitely know
-  // that that the new gap is non-empty because we're evicting an entry inside that very gap.
-  //
-  // TODO(perf): Maybe we should instead replace the evicted entry with an END_GAP entry in this
-  //   case? The problem is, when the app accesses a key in the gap, the LRU time of the previous
-  //   entry gets bumped, but the _next_ entry does not get bumped. Hence these acccesses won't
-  //   prevent the next entry from being evicted, and when it is, the gap effectively gets evicted
-  //   too, leading to a cache miss on a key that had been recently accessed. This is a pretty
-  //   obscure scenario, though, and after one cache miss the key would then be in cache again.
+  // If the previous entry has gapIsKnownEmpty, then the gap before this entry would extend to the
+  // *next* entry once we delete this one, and we know that gap is non-empty because we're evicting
+  // an entry inside it. If this entry had a value, we replace it with an END_GAP entry so that the
+  // previous gap stays known-empty. Otherwise we'd have to clear the previous entry's
+  // gapIsKnownEmpty, and since accesses to keys in a gap only bump the LRU time of the entry
+  // before it, a gap that the app was actively using (e.g. one filled by a list()) would be lost
+  // whenever the entry after it was evicted. Small entries aren't replaced, though: an END_GAP
+  // entry costs about as much memory as they do, so evicting them would hardly free anything.
+  kj::Maybe<Key> endGapKey;
   if (iter != ordered.begin()) {
     auto prev = iter;
     --prev;
-    prev->get()->gapIsKnownEmpty = false;
+    if (prev->get()->gapIsKnownEmpty) {
+      KJ_IF_MAYBE(v, entry.value) {
+        if (v->size() >= sizeof(Entry)) {
+          // Copy the key now, since erasing the entry from the map may destroy it.
+          endGapKey = cloneKey(entry.key);
+        }
+      }
+      if (endGapKey == nullptr) {
+        prev->get()->gapIsKnownEmpty = false;
+      }
+    }
   }
 
   // If this entry has gapIsKnownEmpty and the next entry is END_GAP, we should delete the
-  // END_GAP, because it no longer serves a purpose.
+  // END_GAP, because it no longer serves a purpose. (An END_GAP replacing this entry can't have
+  // gapIsKnownEmpty itself.)
   kj::Maybe<KeyPtr> eraseLater;
   if (iter->get()->gapIsKnownEmpty) {
     auto next = iter;
@@ -309,10 +378,14 @@ void ActorCache::evictEntry(Lock& lock, Entry& entry) {
   KJ_IF_MAYBE(k, eraseLater) {
     map.eraseMatch(*k);
   }
+
+  KJ_IF_MAYBE(k, endGapKey) {
+    map.insert(makeEntry(lock, END_GAP, kj::mv(*k), nullptr));
+  }
 }
 
 void ActorCache::verifyConsistencyForTest() {
-  auto lock = lru.cleanList.lockExclusive();
+  auto lock = shard.cleanList.lockExclusive();
   currentValues.get(lock).verify();  // verify the table's BTreeIndex
   bool prevGapIsKnownEmpty = false;
   kj::Maybe<kj::StringPtr> prevKey = nullptr;
@@ -357,7 +430,7 @@ kj::OneOf<kj::Maybe<ActorCache::Value>, kj::Promise<kj::Maybe<ActorCache::Value>
   options.noCache = options.noCache || lru.options.noCache;
   requireNotTerminal();
 
-  auto lock = lru.cleanList.lockExclusive();
+  auto lock = shard.cleanList.lockExclusive();
   KJ_IF_MAYBE(entry, findInCache(lock, key, options)) {
     return entry->get()->value.map([&](ValuePtr value) {
       return value.attach(kj::mv(*entry));
@@ -375,7 +448,7 @@ kj::OneOf<kj::Maybe<ActorCache::Value>, kj::Promise<kj::Maybe<ActorCache::Value>
       if (response.hasValue()) {
         value = response.getValue();
       }
-      auto lock = lru.cleanList.lockExclusive();
+      auto lock = shard.cleanList.lockExclusive();
       auto entry = addReadResultToCache(lock, kj::mv(key), value, options);
       evictOrOomIfNeeded(lock);
       return entry->value.map([&](ValuePtr value) {
@@ -403,7 +476,7 @@ public:
       return KJ_EXCEPTION(DISCONNECTED, "canceled");
     }
 
-    auto lock = cache.lru.cleanList.lockExclusive();
+    auto lock = cache.shard.cleanList.lockExclusive();
     auto params = context.getParams();
     kj::String prevKey = nullptr;
     for (auto kv: params.getList()) {
@@ -453,7 +526,7 @@ public:
 
     if (nextExpectedKey < keysToFetch.end()) {
       // Some trailing keys weren't seen, better mark them as not present.
-      auto lock = cache.lru.cleanList.lockExclusive();
+      auto lock = cache.shard.cleanList.lockExclusive();
       while (nextExpectedKey < keysToFetch.end()) {
         cache.addReadResultToCache(lock, kj::mv(*nextExpectedKey++), nullptr, options);
       }
@@ -524,7 +597,7 @@ kj::OneOf<ActorCache::GetResultList, kj::Promise<ActorCache::GetResultList>>
   capnp::MessageSize sizeHint { 4, 1 };
 
   {
-    auto lock = lru.cleanList.lockExclusive();
+    auto lock = shard.cleanList.lockExclusive();
     for (auto& key: keys) {
       KJ_IF_MAYBE(entry, findInCache(lock, key, options)) {
         cachedEntries.add(kj::mv(*entry));
@@ -701,7 +774,7 @@ public:
     }
 
     {
-      auto lock = cache.lru.cleanList.lockExclusive();
+      auto lock = cache.shard.cleanList.lockExclusive();
       auto list = context.getParams().getList();
 
       bool insertedAny = false;
@@ -759,7 +832,7 @@ public:
 
     // Mark the rest of the range as empty.
     {
-      auto lock = cache.lru.cleanList.lockExclusive();
+      auto lock = cache.shard.cleanList.lockExclusive();
 
       if (!beginKeyIsKnown) {
         // We received no results at all, so the start of the list is definitely not in storage.
@@ -780,8 +853,10 @@ public:
   }
 
   void fulfill() {
-    fulfiller->fulfill(GetResultList(kj::mv(cachedEntries), kj::mv(fetchedEntries),
-                                     GetResultList::FORWARD, originalLimit));
+    GetResultList results(kj::mv(cachedEntries), kj::mv(fetchedEntries),
+                          GetResultList::FORWARD, originalLimit);
+    cache.noteListPage(results, originalLimit);
+    fulfiller->fulfill(kj::mv(results));
   };
 
   void markBeginAsEmpty(Lock& lock) {
@@ -867,7 +942,7 @@ kj::OneOf<ActorCache::GetResultList, kj::Promise<ActorCache::GetResultList>>
   // negative entries in the range, since each of those negative entries could potentially negate a
   // positive entry read from disk.
 
-  auto lock = lru.cleanList.lockExclusive();
+  auto lock = shard.cleanList.lockExclusive();
   auto& map = currentValues.get(lock);
   auto ordered = map.ordered();
 
@@ -971,11 +1046,15 @@ kj::OneOf<ActorCache::GetResultList, kj::Promise<ActorCache::GetResultList>>
 
   if (storageListStart == nullptr || knownPrefixSize >= limit.orDefault(kj::maxValue)) {
     // We fully satisfied the list operation from cache.
-    return GetResultList(kj::mv(cachedEntries), {}, GetResultList::FORWARD, limit);
+    GetResultList results(kj::mv(cachedEntries), {}, GetResultList::FORWARD, limit);
+    noteListPage(results, limit);
+    return kj::mv(results);
   }
 
   auto adjustedLimit = limit.map([&](uint orig) {
-    return orig + limitAdjustment - knownPrefixSize;
+    // Any keys we read ahead are cached like the rest, but the final result is still truncated to
+    // the original limit.
+    return orig + limitAdjustment - knownPrefixSize + getListReadAhead(beginKey, options);
   });
 
   auto paf = kj::newPromiseAndFulfiller<GetResultList>();
@@ -1049,6 +1128,34 @@ kj::OneOf<ActorCache::GetResultList, kj::Promise<ActorCache::GetResultList>>
   }));
 }
 
+void ActorCache::noteListPage(const GetResultList& results, kj::Maybe<uint> limit) {
+  KJ_IF_MAYBE(l, limit) {
+    if (results.size() > 0 && results.size() == *l) {
+      lastListPageEnd = kj::str(results.end()[-1].key);
+      return;
+    }
+  }
+  lastListPageEnd = nullptr;
+}
+
+uint ActorCache::getListReadAhead(KeyPtr beginKey, const ReadOptions& options) {
+  if (lru.options.listReadAhead == 0 || options.noCache ||
+      lru.currentSize() > lru.options.softLimit / 2) {
+    return 0;
+  }
+
+  KJ_IF_MAYBE(prevEnd, lastListPageEnd) {
+    // Pagination usually passes either the last key seen (skipping it on the way out) or its
+    // successor, which is the same key with a NUL byte appended.
+    if (beginKey == *prevEnd ||
+        (beginKey.size() == prevEnd->size() + 1 && beginKey.startsWith(*prevEnd) &&
+         beginKey[prevEnd->size()] == '\0')) {
+      return lru.options.listReadAhead;
+    }
+  }
+  return 0;
+}
+
 // -----------------------------------------------------------------------------
 
 class ActorCache::ReverseListStreamImpl final: public rpc::ActorStorage::ListStream::Server {
@@ -1069,7 +1176,7 @@ public:
     }
 
     {
-      auto lock = cache.lru.cleanList.lockExclusive();
+      auto lock = cache.shard.cleanList.lockExclusive();
       auto list = context.getParams().getList();
 
       bool insertedAny = false;
@@ -1117,7 +1224,7 @@ public:
 
     // Mark the rest of the range as empty.
     {
-      auto lock = cache.lru.cleanList.lockExclusive();
+      auto lock = cache.shard.cleanList.lockExclusive();
 
       if (fetchedEntries.size() < adjustedLimit.orDefault(kj::maxValue)) {
         // We didn't reach the limit, so the rest of the range must be empty.
@@ -1205,7 +1312,7 @@ kj::OneOf<ActorCache::GetResultList, kj::Promise<ActorCache::GetResultList>>
   // negative entries in the range, since each of those negative entries could potentially negate a
   // positive entry read from disk.
 
-  auto lock = lru.cleanList.lockExclusive();
+  auto lock = shard.cleanList.lockExclusive();
   auto& map = currentValues.get(lock);
   auto ordered = map.ordered();
 
@@ -1655,12 +1762,11 @@ void ActorCache::markGapsEmpty(Lock& lock, KeyPtr beginKey, kj::Maybe<KeyPtr> en
 }
 
 ActorCache::GetResultList::GetResultList(kj::Vector<KeyValuePair> contents)
-    : entries(contents.size()), cacheStatuses(contents.size()) {
-  // TODO(perf): Allocating an `Entry` object for every key/value pair is lame but to avoid it
-  //   we'd have to make the common case worse...
-  for (auto& kv: contents) {
-    entries.add(kj::heap<Entry>(kj::Badge<GetResultList>(), kj::mv(kv.key), kj::mv(kv.value)));
-    cacheStatuses.add(CacheStatus::UNCACHED);
+    : rows(contents.size()), pairs(kj::mv(contents)) {
+  // Moving the vector doesn't move the keys and values themselves, so the rows can point straight
+  // into it.
+  for (auto& kv: pairs) {
+    rows.add(kv.key, kv.value, CacheStatus::UNCACHED);
   }
 }
 
@@ -1678,21 +1784,23 @@ ActorCache::GetResultList::GetResultList(
   // `fetchedEntries` is the set read from storage.
 
   uint limit = maybeLimit.orDefault(kj::maxValue);
-  entries.reserve(kj::min(cachedEntries.size() + fetchedEntries.size(), limit));
+  size_t expectedSize = kj::min(cachedEntries.size() + fetchedEntries.size(), limit);
+  rows.reserve(expectedSize);
+  entries.reserve(expectedSize);
 
   auto cachedIter = cachedEntries.begin();
   auto fetchedIter = fetchedEntries.begin();
 
   auto add = [&](kj::Own<ActorCache::Entry>&& entry, CacheStatus status) {
     // Remove null values.
-    if (entry->value != nullptr) {
+    KJ_IF_MAYBE(value, entry->value) {
+      rows.add(entry->key, *value, status);
       entries.add(kj::mv(entry));
-      cacheStatuses.add(status);
     }
   };
 
   while ((cachedIter != cachedEntries.end() || fetchedIter != fetchedEntries.end()) &&
-        entries.size() < limit) {
+        rows.size() < limit) {
     if (cachedIter == cachedEntries.end()) {
       add(kj::mv(*fetchedIter++), CacheStatus::UNCACHED);
     } else if (fetchedIter == fetchedEntries.end()) {
@@ -1715,15 +1823,15 @@ ActorCache::GetResultList::GetResultList(
 #ifdef KJ_DEBUG
   // Verify sort.
   kj::Maybe<KeyPtr> prev;
-  for (auto& entry: entries) {
+  for (auto& row: rows) {
     KJ_IF_MAYBE(p, prev) {
       if (order == REVERSE) {
-        KJ_ASSERT(entry->key < *p);
+        KJ_ASSERT(row.key < *p);
       } else {
-        KJ_ASSERT(entry->key > *p);
+        KJ_ASSERT(row.key > *p);
       }
     }
-    prev = entry->key;
+    prev = row.key;
   }
 #endif
 }
@@ -1782,7 +1890,7 @@ kj::Maybe<kj::Promise<void>> ActorCache::put(Key key, Value value, WriteOptions
   options.noCache = options.noCache || lru.options.noCache;
   requireNotTerminal();
   {
-    auto lock = lru.cleanList.lockExclusive();
+    auto lock = shard.cleanList.lockExclusive();
     putImpl(lock, kj::mv(key), kj::mv(value), options, nullptr);
     evictOrOomIfNeeded(lock);
   }
@@ -1793,7 +1901,7 @@ kj::Maybe<kj::Promise<void>> ActorCache::put(kj::Array<KeyValuePair> pairs, Writ
   options.noCache = options.noCache || lru.options.noCache;
   requireNotTerminal();
   {
-    auto lock = lru.cleanList.lockExclusive();
+    auto lock = shard.cleanList.lockExclusive();
     for (auto& pair: pairs) {
       putImpl(lock, kj::mv(pair.key), kj::mv(pair.value), options, nullptr);
     }
@@ -1839,7 +1947,7 @@ kj::OneOf<bool, kj::Promise<bool>> ActorCache::delete_(Key key, WriteOptions opt
 
   auto countedDelete = kj::refcounted<CountedDelete>();
   {
-    auto lock = lru.cleanList.lockExclusive();
+    auto lock = shard.cleanList.lockExclusive();
     putImpl(lock, kj::mv(key), nullptr, options, *countedDelete);
     evictOrOomIfNeeded(lock);
   }
@@ -1876,7 +1984,7 @@ kj::OneOf<uint, kj::Promise<uint>> ActorCache::delete_(kj::Array<Key> keys, Writ
 
   auto countedDelete = kj::refcounted<CountedDelete>();
   {
-    auto lock = lru.cleanList.lockExclusive();
+    auto lock = shard.cleanList.lockExclusive();
     for (auto& key: keys) {
       putImpl(lock, kj::mv(key), nullptr, options, *countedDelete);
     }
@@ -1924,7 +2032,7 @@ ActorCache::DeleteAllResults ActorCache::deleteAll(WriteOptions options) {
   kj::Promise<uint> result { (uint)0 };
 
   {
-    auto lock = lru.cleanList.lockExclusive();
+    auto lock = shard.cleanList.lockExclusive();
     auto& map = currentValues.get(lock);
 
     kj::Vector<kj::Own<Entry>> deletedDirty;
@@ -2130,14 +2238,23 @@ void ActorCache::ensureFlushScheduled(const WriteOptions& options) {
 
   if (!flushScheduled) {
     flushScheduled = true;
-    auto flushPromise = lastFlush.addBranch().attach(kj::defer([this]() {
+
+    // If flushes can be pipelined, this one may start as soon as the previous one has been sent.
+    auto previousFlush = lastFlush.addBranch();
+    auto readyToStart = lru.options.maxFlushesInFlight > 1
+        ? lastFlushSent.addBranch() : lastFlush.addBranch();
+    auto sent = kj::newPromiseAndFulfiller<void>();
+    lastFlushSent = sent.promise.fork();
+
+    auto flushPromise = kj::mv(readyToStart).attach(kj::defer([this]() {
       flushScheduled = false;
       flushScheduledWithOutputGate = false;
-    })).then([this]() {
+    })).then([this, previousFlush = kj::mv(previousFlush),
+              sentFulfiller = kj::mv(sent.fulfiller)]() mutable {
       ++flushesEnqueued;
-      return kj::evalNow([this](){
+      return kj::evalNow([&]() {
         // `flushImpl()` can throw, so we need to wrap it in `evalNow()` to observe all pathways.
-        return flushImpl();
+        return startFlush(kj::mv(previousFlush), kj::mv(sentFulfiller));
       }).attach(kj::defer([this](){
         --flushesEnqueued;
       }));
@@ -2163,6 +2280,55 @@ void ActorCache::ensureFlushScheduled(const WriteOptions& options) {
   }
 }
 
+kj::Promise<void> ActorCache::startFlush(kj::Promise<void> previousFlush,
+                                         kj::Own<kj::PromiseFulfiller<void>> sentFulfiller) {
+  if (lru.options.maxFlushesInFlight <= 1) {
+    // We started after `lastFlush` itself, so the previous flush has already completed.
+    sentFulfiller->fulfill();
+    return flushImpl();
+  }
+
+  if (pipelinedFlushesInFlight < lru.options.maxFlushesInFlight && canPipelineFlush()) {
+    KJ_DEFER(sentFulfiller->fulfill());
+    return flushImplPipelined(kj::mv(previousFlush));
+  }
+
+  // Wait for all flushes before this one to complete, and don't let any after it start until it
+  // has completed too.
+  return previousFlush.then([this]() {
+    return flushImpl();
+  }).attach(kj::defer([sentFulfiller = kj::mv(sentFulfiller)]() mutable {
+    sentFulfiller->fulfill();
+  }));
+}
+
+bool ActorCache::canPipelineFlush() {
+  if (requestedDeleteAll != nullptr) return false;
+
+  KJ_SWITCH_ONEOF(currentAlarmTime) {
+    KJ_CASE_ONEOF(knownAlarmTime, ActorCache::KnownAlarmTime) {
+      if (knownAlarmTime.status != KnownAlarmTime::Status::CLEAN) return false;
+    }
+    KJ_CASE_ONEOF(deferredDelete, ActorCache::DeferredAlarmDelete) {
+      if (deferredDelete.status != DeferredAlarmDelete::Status::WAITING) return false;
+    }
+    KJ_CASE_ONEOF(_, UnknownAlarmTime){}
+  }
+
+  for (auto& entry: dirtyList) {
+    if (entry.state != DIRTY) continue;
+    KJ_IF_MAYBE(c, entry.countedDelete) {
+      if (c->get()->resultFulfiller->isWaiting()) {
+        // Counting a delete needs its own delete RPC, issued before any put of the same key;
+        // leave that to flushImpl().
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
 kj::Maybe<kj::Promise<void>> ActorCache::onNoPendingFlush() {
   // This function returns a Maybe<Promise> because a falsy maybe allows the jsg interface to make
   // a resolved jsg::Promise. This is meaningfully different from a ready kj::Promise because it
@@ -2225,10 +2391,47 @@ void ActorCache::shutdown(kj::Maybe<const kj::Exception&> maybeException) {
   }
 }
 
+constexpr uint MAX_FLUSH_RETRIES = 4;
+// How many times a flush is retried after storage disconnects.
+
 constexpr size_t bytesToWordsRoundUp(size_t bytes) {
   return (bytes + sizeof(capnp::word) - 1) / sizeof(capnp::word);
 }
 
+static size_t maxRpcWords(const ActorCacheSharedLruOptions& options) {
+  // Size, in words, at which a flush starts a new batch.
+  return kj::min(MAX_ACTOR_STORAGE_RPC_WORDS, options.maxBytesPerRpc / sizeof(capnp::word));
+}
+
+typedef kj::Function<kj::Promise<void>()> BatchSend;
+
+static kj::Promise<void> sendBatchesInOrder(kj::Array<BatchSend> sends, uint maxInFlight) {
+  // Invokes each of `sends` in order, but only once fewer than `maxInFlight` of the promises
+  // returned by earlier ones are still outstanding. Resolves once all of them have.
+
+  struct State {
+    kj::Array<BatchSend> sends;
+    size_t next = 0;
+  };
+
+  // Each lane sends one batch at a time, taking the next unsent one whenever its last completes.
+  struct Lane {
+    static kj::Promise<void> run(State& state) {
+      if (state.next == state.sends.size()) return kj::READY_NOW;
+      auto promise = state.sends[state.next++]();
+      return promise.then([&state]() { return run(state); });
+    }
+  };
+
+  auto state = kj::heap<State>(State { kj::mv(sends) });
+  auto laneCount = kj::min(size_t(kj::max(maxInFlight, 1u)), state->sends.size());
+  auto lanes = kj::heapArrayBuilder<kj::Promise<void>>(laneCount);
+  for (auto i KJ_UNUSED: kj::zeroTo(laneCount)) {
+    lanes.add(Lane::run(*state));
+  }
+  return kj::joinPromises(lanes.finish()).attach(kj::mv(state));
+}
+
 struct ActorCache::PutBatch {
   size_t count;
   size_t wordCount;
@@ -2276,7 +2479,7 @@ kj::Promise<void> ActorCache::flushImpl(uint retryCount) {
   // Perhaps this would be possible to fix by adding more complex logic. But, it doesn't seem
   // like a big deal to require all flushes to be complete flushes.
 
-  // We don't take a lock on `lru.cleanList` here, because we don't need it. We only access
+  // We don't take a lock on `shard.cleanList` here, because we don't need it. We only access
   // `dirtyList`, which is only ever accessed within the actor's thread, so it's safe. We know
   // that `SharedLru` will only ever mess with CLEAN entries, which we don't look at here.
 
@@ -2297,11 +2500,10 @@ kj::Promise<void> ActorCache::flushImpl(uint retryCount) {
   // muted deletes, we go ahead and construct batches of no more than 128 keys. They all end up
   // being part of the same transaction in the end, though.
   //
-  // TODO(perf): Currently we send all the batches at the same time. If the batches are large,
-  //   it could be worth spacing them out a bit so we don't saturate the connection. However, we
-  //   still need to make sure that the whole transaction represents a consistent snapshot in time,
-  //   so getting this right, without making a copy of everything upfront, could get complicated.
-  //   Punting for now.
+  // Batches are also split by size (options.maxBytesPerRpc), and no more than
+  // `options.maxBatchesInFlight` are sent at once, so that a huge flush doesn't saturate the
+  // connection. The whole transaction still represents a consistent snapshot in time, because we
+  // copy everything into the RPC messages upfront, before sending any of them.
 
   kj::Vector<PutBatch> putBatches;
   // Batches of puts that we've already accumulated.
@@ -2320,6 +2522,9 @@ kj::Promise<void> ActorCache::flushImpl(uint retryCount) {
 
   kj::Vector<CountedBatch> countedDeletes;
 
+  size_t dirtyBytes = 0;
+  size_t maxWords = maxRpcWords(lru.options);
+
   auto deferredFlushIndexCleanup = kj::defer([&countedDeletes]() {
     for (auto& batch: countedDeletes) {
       batch.countedDelete.flushIndex = nullptr;
@@ -2330,6 +2535,7 @@ kj::Promise<void> ActorCache::flushImpl(uint retryCount) {
     // Counts up the number of operations and RPC message sizes we'll need to cover this entry.
 
     auto keySize = bytesToWordsRoundUp(entry.key.size());
+    dirtyBytes += entry.key.size();
 
     KJ_IF_MAYBE(c, entry.countedDelete) {
       if (c->get()->resultFulfiller->isWaiting()) {
@@ -2359,9 +2565,11 @@ kj::Promise<void> ActorCache::flushImpl(uint retryCount) {
     }
 
     KJ_IF_MAYBE(v, entry.value) {
+      dirtyBytes += v->size();
       auto words = keySize + bytesToWordsRoundUp(v->size()) +
           capnp::sizeInWords<rpc::ActorStorage::KeyValue>();
-      if (putCount >= lru.options.maxKeysPerRpc || putWords + words > MAX_ACTOR_STORAGE_RPC_WORDS) {
+      if (putCount >= lru.options.maxKeysPerRpc ||
+          (putCount > 0 && putWords + words > maxWords)) {
         putBatches.add(PutBatch { putCount, putWords });
         putCount = 0;
         putWords = 0;
@@ -2371,7 +2579,7 @@ kj::Promise<void> ActorCache::flushImpl(uint retryCount) {
     } else if (entry.countedDelete == nullptr) {
       ++mutedDeleteCount;
       mutedDeleteWords += keySize + 1;
-      if (mutedDeleteCount >= lru.options.maxKeysPerRpc) {
+      if (mutedDeleteCount >= lru.options.maxKeysPerRpc || mutedDeleteWords >= maxWords) {
         mutedDeleteBatches.add(MutedDeleteBatch { mutedDeleteCount, mutedDeleteWords });
         mutedDeleteCount = 0;
         mutedDeleteWords = 0;
@@ -2431,6 +2639,8 @@ kj::Promise<void> ActorCache::flushImpl(uint retryCount) {
     mutedDeleteWords = 0;
   }
 
+  hooks.storageFlushStarted(dirtyBytes);
+
   // Actually flush out the changes.
   kj::Promise<void> flushProm = nullptr;
   if (putBatches.size() == 1 && mutedDeleteBatches.size() == 0 && countedDeletes.size() == 0 &&
@@ -2486,7 +2696,7 @@ kj::Promise<void> ActorCache::flushImpl(uint retryCount) {
       return flushImplDeleteAll();
     }
 
-    auto lock = lru.cleanList.lockExclusive();
+    auto lock = shard.cleanList.lockExclusive();
 
     KJ_IF_MAYBE(r, requestedDeleteAll) {
       // It would appear that all dirty entries were moved into `requestedDeleteAll` during the
@@ -2511,68 +2721,293 @@ kj::Promise<void> ActorCache::flushImpl(uint retryCount) {
         }
 
         KJ_ASSERT(entry.state == FLUSHING);
+        markFlushed(lock, entry);
+      }
+    }
 
-        // We know all `countedDelete` operations were satisfied so we can remove this if it's
-        // present. Note that if, during the flush, the entry was overwritten, then the new entry
-        // will have inherited the `countedDelete`, and will still be DIRTY at this point. That is
-        // OK, because the `countedDelete`'s fulfiller will have already been fulfilled, and
-        // therefore the next flushImpl() will see that it is obsolete and discard it.
-        entry.countedDelete = nullptr;
+    evictOrOomIfNeeded(lock);
+
+    return kj::READY_NOW;
+  }, [this,retryCount](kj::Exception&& e) -> kj::Promise<void> {
+    if (e.getType() == kj::Exception::Type::DISCONNECTED && retryCount < MAX_FLUSH_RETRIES) {
+      return flushImpl(retryCount + 1);
+    } else {
+      return translateFlushException(kj::mv(e));
+    }
+  });
+}
+
+void ActorCache::markFlushed(Lock& lock, Entry& entry) {
+  // We know all `countedDelete` operations were satisfied so we can remove this if it's
+  // present. Note that if, during the flush, the entry was overwritten, then the new entry
+  // will have inherited the `countedDelete`, and will still be DIRTY at this point. That is
+  // OK, because the `countedDelete`'s fulfiller will have already been fulfilled, and
+  // therefore the next flushImpl() will see that it is obsolete and discard it.
+  entry.countedDelete = nullptr;
 
-        dirtyList.remove(entry);
-        if (entry.noCache) {
+  dirtyList.remove(entry);
+  if (entry.noCache) {
+    entry.state = NOT_IN_CACHE;
+    evictEntry(lock, entry);
+  } else {
+    entry.state = CLEAN;
+
+    if (entry.gapIsKnownEmpty && entry.value == nullptr) {
+      // This is a negative entry, and is followed by a known-empty gap. If the previous entry
+      // also has `gapIsKnownEmpty`, then this entry is entirely redundant.
+      auto& map = KJ_ASSERT_NONNULL(entry.cache).currentValues.get(lock);
+      auto iter = map.seek(entry.key);
+      KJ_ASSERT(iter->get() == &entry);
+
+      if (iter != map.ordered().begin()) {
+        auto& slot = *iter;
+        --iter;
+        if (iter->get()->gapIsKnownEmpty) {
+          // Yep!
           entry.state = NOT_IN_CACHE;
-          evictEntry(lock, entry);
-        } else {
-          entry.state = CLEAN;
-
-          if (entry.gapIsKnownEmpty && entry.value == nullptr) {
-            // This is a negative entry, and is followed by a known-empty gap. If the previous entry
-            // also has `gapIsKnownEmpty`, then this entry is entirely redundant.
-            auto& map = KJ_ASSERT_NONNULL(entry.cache).currentValues.get(lock);
-            auto iter = map.seek(entry.key);
-            KJ_ASSERT(iter->get() == &entry);
-
-            if (iter != map.ordered().begin()) {
-              auto& slot = *iter;
-              --iter;
-              if (iter->get()->gapIsKnownEmpty) {
-                // Yep!
-                entry.state = NOT_IN_CACHE;
-                map.erase(slot);
-                // WARNING: We might have just deleted `entry`.
-                continue;
-              }
-            }
-          }
+          map.erase(slot);
+          // WARNING: We might have just deleted `entry`.
+          return;
+        }
+      }
+    }
+
+    lock->add(entry);
+  }
+}
+
+kj::Exception ActorCache::translateFlushException(kj::Exception&& e) {
+  if (jsg::isTunneledException(e.getDescription()) ||
+      jsg::isDoNotLogException(e.getDescription())) {
+    // Before passing along the exception, give it the proper brokenness reason.
+    // We were overriding any exception that came through here by ioGateBroken (now
+    // outputGateBroken). without checking for previous brokeness reasons we would be unable to
+    // throw exceededConcurrentStorageOps at all.
+    auto msg = jsg::stripRemoteExceptionPrefix(e.getDescription());
+    if (!(msg.startsWith("broken."))) {
+      e.setDescription(kj::str("broken.outputGateBroken; ", msg));
+    }
+    return kj::mv(e);
+  } else {
+    KJ_LOG(ERROR, e);
+    return KJ_EXCEPTION(FAILED, "broken.outputGateBroken; jsg.Error: Internal error in Durable "
+        "Object storage write caused object to be reset.");
+  }
+}
+
+kj::Promise<void> ActorCache::flushImplPipelined(kj::Promise<void> previousFlush) {
+  KJ_IF_MAYBE(e, maybeTerminalException) {
+    kj::throwFatalException(kj::cp(*e));
+  }
+
+  bool anyDirty = false;
+  for (auto& entry: dirtyList) {
+    if (entry.state == DIRTY) {
+      anyDirty = true;
+      break;
+    }
+  }
+  if (!anyDirty) {
+    // Nothing new to write, so we're done as soon as the flushes before us are.
+    return kj::mv(previousFlush);
+  }
+
+  uint16_t generation = ++lastFlushGeneration;
+  uint64_t sequence = nextFlushSequence++;
+  ++pipelinedFlushesInFlight;
+
+  // Send our writes now, but only act on the result once the previous flush has completed, since
+  // each flush marks CLEAN what is then a prefix of `dirtyList`.
+  auto sent = sendPipelinedFlush(generation, sequence, false).eagerlyEvaluate(nullptr);
+  return previousFlush.then(
+      [this, sent = kj::mv(sent), generation, sequence]() mutable {
+    return finishPipelinedFlush(kj::mv(sent), generation, sequence, 0);
+  }).attach(kj::defer([this]() {
+    --pipelinedFlushesInFlight;
+  }));
+}
 
-          lock->add(entry);
+kj::Promise<void> ActorCache::sendPipelinedFlush(
+    uint16_t generation, uint64_t sequence, bool retry) {
+  KJ_IF_MAYBE(e, maybeTerminalException) {
+    kj::throwFatalException(kj::cp(*e));
+  }
+
+  // The first attempt writes everything DIRTY. A retry writes whatever this flush wrote that
+  // hasn't been overwritten since, which by now a deleteAll() may have moved into
+  // `requestedDeleteAll`. The retry's transaction must be committed even if it's empty, since
+  // storage holds later sequence numbers until this one has been.
+  auto forEachEntry = [&](auto&& func) {
+    if (retry) {
+      KJ_IF_MAYBE(r, requestedDeleteAll) {
+        for (auto& entry: r->deletedDirty) {
+          if (entry->state == FLUSHING && entry->flushGeneration == generation) func(*entry);
         }
+        return;
       }
     }
+    for (auto& entry: dirtyList) {
+      if (retry ? entry.state == FLUSHING && entry.flushGeneration == generation
+                : entry.state == DIRTY) {
+        func(entry);
+      }
+    }
+  };
+
+  kj::Vector<PutBatch> putBatches;
+  kj::Vector<MutedDeleteBatch> mutedDeleteBatches;
+  size_t putCount = 0;
+  size_t putWords = 0;
+  size_t mutedDeleteCount = 0;
+  size_t mutedDeleteWords = 0;
+
+  size_t dirtyBytes = 0;
+  size_t maxWords = maxRpcWords(lru.options);
+
+  forEachEntry([&](Entry& entry) {
+    // canPipelineFlush() checked that nobody is waiting on the count of any delete.
+    entry.countedDelete = nullptr;
+
+    auto keySize = bytesToWordsRoundUp(entry.key.size());
+    dirtyBytes += entry.key.size();
+    KJ_IF_MAYBE(v, entry.value) {
+      dirtyBytes += v->size();
+      auto words = keySize + bytesToWordsRoundUp(v->size()) +
+          capnp::sizeInWords<rpc::ActorStorage::KeyValue>();
+      if (putCount >= lru.options.maxKeysPerRpc ||
+          (putCount > 0 && putWords + words > maxWords)) {
+        putBatches.add(PutBatch { putCount, putWords });
+        putCount = 0;
+        putWords = 0;
+      }
+      ++putCount;
+      putWords += words;
+    } else {
+      ++mutedDeleteCount;
+      mutedDeleteWords += keySize + 1;
+      if (mutedDeleteCount >= lru.options.maxKeysPerRpc || mutedDeleteWords >= maxWords) {
+        mutedDeleteBatches.add(MutedDeleteBatch { mutedDeleteCount, mutedDeleteWords });
+        mutedDeleteCount = 0;
+        mutedDeleteWords = 0;
+      }
+    }
+  });
+
+  if (putCount > 0) {
+    putBatches.add(PutBatch { putCount, putWords });
+    putCount = 0;
+  }
+  if (mutedDeleteCount > 0) {
+    mutedDeleteBatches.add(MutedDeleteBatch { mutedDeleteCount, mutedDeleteWords });
+    mutedDeleteCount = 0;
+  }
+
+  hooks.storageFlushStarted(dirtyBytes);
+
+  auto txnReq = storage.txnRequest(capnp::MessageSize { 8, 0 });
+  txnReq.initSettings().setSequence(sequence);
+  auto txnProm = txnReq.send();
+  auto txn = txnProm.getTransaction();
+
+  for (auto& batch: mutedDeleteBatches) {
+    KJ_ASSERT(batch.wordCount < MAX_ACTOR_STORAGE_RPC_WORDS);
+    batch.request = txn.deleteRequest(capnp::MessageSize { 4 + batch.wordCount, 0 });
+    batch.list = batch.request.initKeys(batch.count);
+  }
+  for (auto& batch: putBatches) {
+    KJ_ASSERT(batch.wordCount < MAX_ACTOR_STORAGE_RPC_WORDS);
+    batch.request = txn.putRequest(capnp::MessageSize { 4 + batch.wordCount, 0 });
+    batch.list = batch.request.initEntries(batch.count);
+  }
+
+  auto currentPutBatch = putBatches.begin();
+  auto currentMutedDeleteBatch = mutedDeleteBatches.begin();
+  forEachEntry([&](Entry& entry) {
+    KJ_IF_MAYBE(v, entry.value) {
+      auto kv = currentPutBatch->list[putCount++];
+      kv.setKey(entry.key.asBytes());
+      kv.setValue(*v);
+      if (putCount == currentPutBatch->count) {
+        putCount = 0;
+        ++currentPutBatch;
+      }
+    } else {
+      currentMutedDeleteBatch->list.set(mutedDeleteCount++, entry.key.asBytes());
+      if (mutedDeleteCount == currentMutedDeleteBatch->count) {
+        mutedDeleteCount = 0;
+        ++currentMutedDeleteBatch;
+      }
+    }
+    entry.state = FLUSHING;
+    entry.flushGeneration = generation;
+  });
+
+  // As in flushImplUsingTxn(), we build the RPCs first, then wait for past reads before sending.
+  return oomCanceler.wrap(waitForPastReads().then(
+      [this, txn = kj::mv(txn), txnProm = kj::mv(txnProm),
+       mutedDeleteBatches = kj::mv(mutedDeleteBatches),
+       putBatches = kj::mv(putBatches)]() mutable {
+    auto sends = kj::heapArrayBuilder<BatchSend>(
+        mutedDeleteBatches.size() + putBatches.size() + 1);
+    for (auto& batch: mutedDeleteBatches) {
+      sends.add([this, &batch]() {
+        hooks.storageBatchSent(batch.wordCount * sizeof(capnp::word));
+        return batch.request.send().ignoreResult();
+      });
+    }
+    for (auto& batch: putBatches) {
+      sends.add([this, &batch]() {
+        hooks.storageBatchSent(batch.wordCount * sizeof(capnp::word));
+        return batch.request.send().ignoreResult();
+      });
+    }
+    sends.add([txn = kj::mv(txn)]() mutable {
+      return txn.commitRequest(capnp::MessageSize { 4, 0 }).send().ignoreResult();
+    });
+
+    // See flushImplUsingTxn() for why we wait on `txnProm`.
+    auto promises = kj::heapArrayBuilder<kj::Promise<void>>(2);
+    promises.add(txnProm.ignoreResult());
+    promises.add(sendBatchesInOrder(sends.finish(), lru.options.maxBatchesInFlight));
+    return kj::joinPromises(promises.finish())
+        .attach(kj::mv(mutedDeleteBatches), kj::mv(putBatches));
+  }));
+}
+
+kj::Promise<void> ActorCache::finishPipelinedFlush(
+    kj::Promise<void> sent, uint16_t generation, uint64_t sequence, uint retryCount) {
+  return sent.then([this, generation]() -> kj::Promise<void> {
+    auto lock = shard.cleanList.lockExclusive();
+
+    KJ_IF_MAYBE(r, requestedDeleteAll) {
+      // deleteAll() was called while we were flushing and moved our entries into `deletedDirty`.
+      // They no longer need to be written before the deleteAll(), so drop them.
+      auto dst = r->deletedDirty.begin();
+      for (auto src = r->deletedDirty.begin(); src != r->deletedDirty.end(); ++src) {
+        if (src->get()->state != FLUSHING || src->get()->flushGeneration != generation) {
+          if (dst != src) *dst = kj::mv(*src);
+          ++dst;
+        }
+      }
+      r->deletedDirty.resize(dst - r->deletedDirty.begin());
+    }
+
+    // Flushes before us have completed, so our entries are now a prefix of `dirtyList`.
+    for (auto& entry: dirtyList) {
+      if (entry.state != FLUSHING || entry.flushGeneration != generation) break;
+      markFlushed(lock, entry);
+    }
 
     evictOrOomIfNeeded(lock);
 
     return kj::READY_NOW;
-  }, [this,retryCount](kj::Exception&& e) -> kj::Promise<void> {
-    static const size_t MAX_RETRIES = 4;
-    if (e.getType() == kj::Exception::Type::DISCONNECTED && retryCount < MAX_RETRIES) {
-      return flushImpl(retryCount + 1);
-    } else if (jsg::isTunneledException(e.getDescription()) ||
-               jsg::isDoNotLogException(e.getDescription())) {
-      // Before passing along the exception, give it the proper brokenness reason.
-      // We were overriding any exception that came through here by ioGateBroken (now outputGateBroken).
-      // without checking for previous brokeness reasons we would be unable to throw
-      // exceededConcurrentStorageOps at all.
-      auto msg = jsg::stripRemoteExceptionPrefix(e.getDescription());
-      if (!(msg.startsWith("broken."))) {
-        e.setDescription(kj::str("broken.outputGateBroken; ", msg));
-      }
-      return kj::mv(e);
+  }, [this, generation, sequence, retryCount](kj::Exception&& e) -> kj::Promise<void> {
+    if (e.getType() == kj::Exception::Type::DISCONNECTED && retryCount < MAX_FLUSH_RETRIES) {
+      // Storage ignores the sequence number if the original commit was in fact applied.
+      auto sent = sendPipelinedFlush(generation, sequence, true);
+      return finishPipelinedFlush(kj::mv(sent), generation, sequence, retryCount + 1);
     } else {
-      KJ_LOG(ERROR, e);
-      return KJ_EXCEPTION(FAILED, "broken.outputGateBroken; jsg.Error: Internal error in Durable "
-          "Object storage write caused object to be reset.");
+      return translateFlushException(kj::mv(e));
     }
   });
 }
@@ -2608,7 +3043,9 @@ kj::Promise<void> ActorCache::flushImplUsingSinglePut(kj::Vector<PutBatch> putBa
 
   // See the comment in flushImplUsingTxn for why we need to construct our RPC and then wait on
   // reads before actually sending the write. The same exact logic applies here.
-  return oomCanceler.wrap(waitForPastReads().then([putBatches = kj::mv(putBatches)]() mutable {
+  return oomCanceler.wrap(waitForPastReads().then(
+      [this, putBatches = kj::mv(putBatches)]() mutable {
+    hooks.storageBatchSent(putBatches[0].wordCount * sizeof(capnp::word));
     return putBatches[0].request.send().ignoreResult();
   }));
 }
@@ -2761,39 +3198,50 @@ kj::Promise<void> ActorCache::flushImplUsingTxn(
     // put() on the same key. These two writes may have been coalesced into a single flush.
     // Unfortunately, we can't just skip the delete because we still need to count it. So we issue
     // a delete, followed by a put, in the same transaction.
-    // The constant extra 2 promises are those added outside of the rpc batches, currently one
-    // to work around a bug in capnp::autoreconnect, and one to actually commit the flush txn
-    // A 3rd promise may be added to write the alarm time if necessary.
+    //
+    // The RPCs are sent in this order, but only `maxBatchesInFlight` at a time, so that a huge
+    // flush doesn't hog the storage connection. The commit goes last; E-order on `txn` means it
+    // won't be processed before the writes.
 
-    auto promises = kj::heapArrayBuilder<kj::Promise<void>>(rpcCount + 2 + !maybeAlarmChange.is<CleanAlarm>());
+    kj::Vector<BatchSend> sends(rpcCount + 2);
     for (auto& cd: countedDeletes) {
       KJ_ASSERT(cd.keyCount == cd.list.size());
-      promises.add(cd.request.send()
-          .then([&countedDelete = cd.countedDelete]
-                (capnp::Response<rpc::ActorStorage::Operations::DeleteResults>&& response) mutable {
-        // Note that it's OK to trust the delete count even if the transaction ultimately gets rolled
-        // back, because:
-        // - We know that nothing else could be concurrently modifying our storage in a way that
-        //   makes the count different on a retry.
-        // - If retries fail and the flush never completes at all, the output gate will kick in and
-        //   make it impossible for anyone to observe the bogus result.
-        countedDelete.resultFulfiller->fulfill(
-            countedDelete.countDeleted + response.getNumDeleted());
-      }, [&countedDelete = cd.countedDelete](kj::Exception&& e) {
-        if (e.getType() == kj::Exception::Type::DISCONNECTED) {
-          // This deletion will be retried, so don't touch the fulfiller.
-        } else {
-          countedDelete.resultFulfiller->reject(kj::mv(e));
-        }
-      }).attach(kj::addRef(cd.countedDelete)));
+      sends.add([this, &cd]() {
+        hooks.storageBatchSent(cd.wordCount * sizeof(capnp::word));
+        return cd.request.send()
+            .then([&countedDelete = cd.countedDelete]
+                  (capnp::Response<rpc::ActorStorage::Operations::DeleteResults>&& response)
+                  mutable {
+          // Note that it's OK to trust the delete count even if the transaction ultimately gets
+          // rolled back, because:
+          // - We know that nothing else could be concurrently modifying our storage in a way that
+          //   makes the count different on a retry.
+          // - If retries fail and the flush never completes at all, the output gate will kick in
+          //   and make it impossible for anyone to observe the bogus result.
+          countedDelete.resultFulfiller->fulfill(
+              countedDelete.countDeleted + response.getNumDeleted());
+        }, [&countedDelete = cd.countedDelete](kj::Exception&& e) {
+          if (e.getType() == kj::Exception::Type::DISCONNECTED) {
+            // This deletion will be retried, so don't touch the fulfiller.
+          } else {
+            countedDelete.resultFulfiller->reject(kj::mv(e));
+          }
+        }).attach(kj::addRef(cd.countedDelete));
+      });
     }
 
     for (auto& batch: mutedDeleteBatches) {
-      promises.add(batch.request.send().ignoreResult());
+      sends.add([this, &batch]() {
+        hooks.storageBatchSent(batch.wordCount * sizeof(capnp::word));
+        return batch.request.send().ignoreResult();
+      });
     }
 
     for (auto& batch: putBatches) {
-      promises.add(batch.request.send().ignoreResult());
+      sends.add([this, &batch]() {
+        hooks.storageBatchSent(batch.wordCount * sizeof(capnp::word));
+        return batch.request.send().ignoreResult();
+      });
     }
 
     KJ_SWITCH_ONEOF(maybeAlarmChange) {
@@ -2801,48 +3249,58 @@ kj::Promise<void> ActorCache::flushImplUsingTxn(
         KJ_IF_MAYBE(newTime, dirty.newTime) {
           auto req = txn.setAlarmRequest();
           req.setScheduledTimeMs((*newTime - kj::UNIX_EPOCH) / kj::MILLISECONDS);
-          promises.add(req.send().ignoreResult());
+          sends.add([req = kj::mv(req)]() mutable {
+            return req.send().ignoreResult();
+          });
         } else {
           auto req = txn.deleteAlarmRequest();
           KJ_IF_MAYBE(deferredDelete, currentAlarmTime.tryGet<DeferredAlarmDelete>()) {
             if (deferredDelete->status == DeferredAlarmDelete::Status::FLUSHING) {
               req.setTimeToDeleteMs((deferredDelete->timeToDelete - kj::UNIX_EPOCH) / kj::MILLISECONDS);
-              auto prom = req.send().then([this](auto response) {
-                KJ_IF_MAYBE(deferredDelete, currentAlarmTime.tryGet<DeferredAlarmDelete>()) {
-                  if (deferredDelete->status == DeferredAlarmDelete::Status::FLUSHING) {
-                    // We always update wasDeleted regardless of whether or not it is true
-                    // because this continuation can succeed even if the greater transaction fails,
-                    // and so we want to make sure we end up with the correct value if the first
-                    // attempt succeeds to delete, the txn fails, and the retry fails to delete.
-                    // The early update is OK because we don't actually use the incorrect state until
-                    // the transaction succeeds in the .then() below.
-                    deferredDelete->wasDeleted = response.getDeleted();
+              sends.add([this, req = kj::mv(req)]() mutable {
+                return req.send().then([this](auto response) {
+                  KJ_IF_MAYBE(deferredDelete, currentAlarmTime.tryGet<DeferredAlarmDelete>()) {
+                    if (deferredDelete->status == DeferredAlarmDelete::Status::FLUSHING) {
+                      // We always update wasDeleted regardless of whether or not it is true
+                      // because this continuation can succeed even if the greater transaction
+                      // fails, and so we want to make sure we end up with the correct value if
+                      // the first attempt succeeds to delete, the txn fails, and the retry fails
+                      // to delete. The early update is OK because we don't actually use the
+                      // incorrect state until the transaction succeeds in the .then() below.
+                      deferredDelete->wasDeleted = response.getDeleted();
+                    }
                   }
-                }
+                });
               });
-              promises.add(kj::mv(prom));
             }
             // Not sending a delete request for WAITING or READY is intentional. The WAITING
             // state refers to when the alarm run has started but has not completed successfully,
             // and READY is set when the run completes -- only FLUSHING indicates we actually
             // need to send a request.
           } else {
-            promises.add(req.send().ignoreResult());
+            sends.add([req = kj::mv(req)]() mutable {
+              return req.send().ignoreResult();
+            });
           }
         }
       }
       KJ_CASE_ONEOF(_, CleanAlarm) {}
     }
 
+    sends.add([txn = kj::mv(txn)]() mutable {
+      return txn.commitRequest(capnp::MessageSize { 4, 0 }).send().ignoreResult();
+    });
+
     // We have to wait on the transaction promise so we don't cancel the catch_ branch that triggers
     // our autoReconnect logic on storage failures.
     // TODO(cleanup): We should probably fix ReconnectHook so the catch_ doesn't get canceled
     // if the promise is dropped but the pipeline stays alive.
+    auto promises = kj::heapArrayBuilder<kj::Promise<void>>(2);
     promises.add(txnProm.ignoreResult());
+    promises.add(sendBatchesInOrder(sends.releaseAsArray(), lru.options.maxBatchesInFlight));
 
-    promises.add(txn.commitRequest(capnp::MessageSize { 4, 0 }).send().ignoreResult());
-
-    return kj::joinPromises(promises.finish());
+    return kj::joinPromises(promises.finish())
+        .attach(kj::mv(countedDeletes), kj::mv(mutedDeleteBatches), kj::mv(putBatches));
   }));
 }
 
@@ -2866,7 +3324,7 @@ kj::Promise<void> ActorCache::flushImplDeleteAll(uint retryCount) {
     requestedDeleteAll = nullptr;
 
     {
-      auto lock = lru.cleanList.lockExclusive();
+      auto lock = shard.cleanList.lockExclusive();
       evictOrOomIfNeeded(lock);
     }
 
@@ -2906,7 +3364,7 @@ ActorCache::Transaction::~Transaction() noexcept(false) {
 
 kj::Maybe<kj::Promise<void>> ActorCache::Transaction::commit() {
   {
-    auto lock = cache.lru.cleanList.lockExclusive();
+    auto lock = cache.shard.cleanList.lockExclusive();
     for (auto& change: changes) {
       cache.putImpl(lock, kj::mv(change.entry), change.options, nullptr);
     }
@@ -3059,7 +3517,7 @@ kj::OneOf<ActorCache::GetResultList, kj::Promise<ActorCache::GetResultList>>
 kj::Maybe<kj::Promise<void>> ActorCache::Transaction::put(
     Key key, Value value, WriteOptions options) {
   options.noCache = options.noCache || cache.lru.options.noCache;
-  auto lock = cache.lru.cleanList.lockExclusive();
+  auto lock = cache.shard.cleanList.lockExclusive();
   putImpl(lock, kj::mv(key), kj::mv(value), options);
 
   // Don't apply backpressure because transactions can't be flushed anyway.
@@ -3069,7 +3527,7 @@ kj::Maybe<kj::Promise<void>> ActorCache::Transaction::put(
 kj::Maybe<kj::Promise<void>> ActorCache::Transaction::put(
     kj::Array<KeyValuePair> pairs, WriteOptions options) {
   options.noCache = options.noCache || cache.lru.options.noCache;
-  auto lock = cache.lru.cleanList.lockExclusive();
+  auto lock = cache.shard.cleanList.lockExclusive();
 
   for (auto& pair: pairs) {
     putImpl(lock, kj::mv(pair.key), kj::mv(pair.value), options);
@@ -3095,7 +3553,7 @@ kj::OneOf<bool, kj::Promise<bool>> ActorCache::Transaction::delete_(
   kj::Maybe<KeyPtr> keyToCount;
 
   {
-    auto lock = cache.lru.cleanList.lockExclusive();
+    auto lock = cache.shard.cleanList.lockExclusive();
     keyToCount = putImpl(lock, kj::mv(key), nullptr, options, count);
   }
 
@@ -3125,7 +3583,7 @@ kj::OneOf<uint, kj::Promise<uint>> ActorCache::Transaction::delete_(
   kj::Vector<Key> keysToCount;
 
   {
-    auto lock = cache.lru.cleanList.lockExclusive();
+    auto lock = cache.shard.cleanList.lockExclusive();
     for (auto& key: keys) {
       KJ_IF_MAYBE(keyToCount, putImpl(lock, kj::mv(key), nullptr, options, count)) {
         keysToCount.add(cloneKey(*keyToCount));
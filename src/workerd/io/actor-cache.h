@@ -14,6 +14,7 @@
 #include <kj/mutex.h>
 #include <atomic>
 #include <workerd/util/wait-list.h>
+#include <workerd/jsg/external-memory.h>
 
 namespace workerd {
 
@@ -157,6 +158,9 @@ public:
   // from underlying storage. The promise also applies backpressure if needed, as with put().
 };
 
+class ActorCacheSharedLru;
+class ActorCacheMemoryBudget;
+
 class ActorCache final: public ActorCacheInterface {
   // An in-memory caching layer on top of ActorStorage.Stage RPC interface.
   //
@@ -176,14 +180,38 @@ class ActorCache final: public ActorCacheInterface {
   // size limit can be set based on the per-isolate memory limit.
 
 public:
-  class SharedLru;
+  using SharedLru = ActorCacheSharedLru;
   // Shared LRU for a whole isolate.
 
+  struct LruShard;
+  // One independently-locked part of a SharedLru.
+
   static constexpr auto SHUTDOWN_ERROR_MESSAGE =
       "broken.ignored; jsg.Error: "
       "Durable Object storage is no longer accessible."_kj;
 
-  ActorCache(rpc::ActorStorage::Stage::Client storage, const SharedLru& lru, OutputGate& gate);
+  class Hooks {
+    // Hooks that can be used to observe ActorCache's writes to storage.
+
+  public:
+    virtual void storageFlushStarted(size_t dirtyBytes) {}
+    // A flush is about to write `dirtyBytes` bytes of keys and values.
+
+    virtual void storageBatchSent(size_t bytes) {}
+    // One batch RPC of a flush, of about `bytes` bytes, was sent.
+    //
+    // In practice these are implemented by MetricsCollector::Actor (as histograms), but we don't
+    // want to depend on that class from here.
+
+    virtual void entryEvicted() {}
+    // A clean entry was evicted to make room or because it went stale. Called with the LRU shard
+    // locked, possibly by another cache sharing the LRU, and so possibly on another thread.
+
+    static Hooks DEFAULT;
+  };
+
+  ActorCache(rpc::ActorStorage::Stage::Client storage, const SharedLru& lru, OutputGate& gate,
+             Hooks& hooks = Hooks::DEFAULT);
   ~ActorCache() noexcept(false);
 
   kj::OneOf<kj::Maybe<Value>, kj::Promise<kj::Maybe<Value>>> get(
@@ -351,10 +379,6 @@ private:
     // Use makeEntry() to construct! (The Badge<> is a reminder, though obviously doesn't enforce
     // anything since Entry is already private to ActorCache.)
 
-    Entry(kj::Badge<GetResultList>, Key keyParam, kj::Maybe<Value> valueParam);
-    // Makes an entry not tied to a cache. Used by GetResultList<kj::Vector<KeyValuePair>>
-    // constructor.
-
     ~Entry() noexcept(false);
     KJ_DISALLOW_COPY_AND_MOVE(Entry);
 
@@ -385,6 +409,11 @@ private:
     // The entry still needs to reside in cache while DIRTY/FLUSHING since we need to store it
     // somewhere, and so we might as well serve cache hits based on it in the meantime.
 
+    uint16_t flushGeneration = 0;
+    // In the FLUSHING state, identifies the pipelined flush writing this entry, so that when that
+    // flush completes, it marks only its own entries CLEAN. (Only a handful of flushes can be in
+    // flight at once, so wrapping around is harmless.)
+
     kj::Maybe<kj::Own<CountedDelete>> countedDelete;
     // In the DIRTY or FLUSHING state, if this entry was originally created as the result of a
     // `delete()` call, and as such the caller needs to receive a count of deletions, then this
@@ -449,7 +478,9 @@ private:
 
   rpc::ActorStorage::Stage::Client storage;
   const SharedLru& lru;
+  const LruShard& shard;  // the shard of `lru` which holds this cache's entries
   OutputGate& gate;
+  Hooks& hooks;
 
   kj::List<Entry, &Entry::link> dirtyList;
   // List of entries in DIRTY or FLUSHING state. New dirty entries are added to the end. If any
@@ -459,8 +490,8 @@ private:
       currentValues;
   // Map of current known values for keys. Searchable by key, including ordered iteration.
   //
-  // This map is protected by the same lock as lru.cleanList. ExternalMutexGuarded helps enforce
-  // this.
+  // This map is protected by the same lock as shard.cleanList. ExternalMutexGuarded helps
+  // enforce this.
 
   struct UnknownAlarmTime{};
   struct KnownAlarmTime{
@@ -494,6 +525,11 @@ private:
   kj::Own<ReadCompletionChain> readCompletionChain = kj::refcounted<ReadCompletionChain>();
   // Used to implement waitForPastReads(). See that function to understand how it works...
 
+  kj::Maybe<Key> lastListPageEnd;
+  // If the last forward list() with a limit came back full, the last key it returned. A list()
+  // that starts right after this key is presumably fetching the next page of a sequential scan,
+  // which makes it a candidate for read-ahead (see `ActorCacheSharedLruOptions::listReadAhead`).
+
   bool flushScheduled = false;
   // True if ensureFlushScheduled() has been called but the flush has not started yet.
 
@@ -505,6 +541,13 @@ private:
   size_t flushesEnqueued = 0;
   // The count of the number of flushes that have been queued without yet resolving.
 
+  uint pipelinedFlushesInFlight = 0;
+  // Number of flushes started by flushImplPipelined() that haven't completed yet.
+
+  uint16_t lastFlushGeneration = 0;
+  uint64_t nextFlushSequence = 1;
+  // Generation (see Entry::flushGeneration) and transaction sequence number of pipelined flushes.
+
   struct DeleteAllState {
     kj::Vector<kj::Own<Entry>> deletedDirty;
     // If deleteAll() was called since the last flush, these are all the dirty entries that existed
@@ -519,12 +562,17 @@ private:
 
 
   kj::ForkedPromise<void> lastFlush = kj::Promise<void>(kj::READY_NOW).fork();
-  // Promise for the completion of the previous flush. We can only execute one flushImpl() at a time
-  // because we can't allow out-of-order writes.
+  // Promise for the completion of the previous flush. Flushes complete in the order they were
+  // scheduled, and a flush's failure fails every flush after it.
+
+  kj::ForkedPromise<void> lastFlushSent = kj::Promise<void>(kj::READY_NOW).fork();
+  // Resolves once the previous flush has sent its writes, if it was pipelined, or otherwise once it
+  // has completed. The next flush starts after this.
   //
-  // TODO(perf): If we could rely on e-order on the ActorStorage API, we could pipeline additional
-  //   writes and not have to worry about this. However, at present, ActorStorage has automatic
-  //   reconnect behavior at the supervisor layer which violates e-order.
+  // We can't simply pipeline writes over the ActorStorage API because it has automatic reconnect
+  // behavior at the supervisor layer which violates e-order. Instead, pipelined flushes are
+  // sequenced transactions, which storage applies in order no matter how they arrive, and which it
+  // ignores if retried after already being applied.
 
   kj::Maybe<kj::Exception> maybeTerminalException;
   // Did we hit a problem that makes the ActorCache unusable? If so this is the exception that
@@ -534,7 +582,7 @@ private:
   // Will be canceled if and when `oomException` becomes non-null.
 
   typedef kj::Locked<kj::List<Entry, &Entry::link>> Lock;
-  // Type of a lock on `SharedLru::cleanList`. We use the same lock to protect `currentValues`.
+  // Type of a lock on `LruShard::cleanList`. We use the same lock to protect `currentValues`.
 
   kj::Own<Entry> makeEntry(Lock& lock, EntryState state, Key keyParam, kj::Maybe<Value> valueParam);
 
@@ -565,6 +613,13 @@ private:
   void markGapsEmpty(Lock& lock, KeyPtr begin, kj::Maybe<KeyPtr> end, const ReadOptions& options);
   // Mark all gaps empty between the begin and end key.
 
+  void noteListPage(const GetResultList& results, kj::Maybe<uint> limit);
+  // Called with the results of each forward list() to keep track of `lastListPageEnd`.
+
+  uint getListReadAhead(KeyPtr beginKey, const ReadOptions& options);
+  // How many keys beyond its limit a forward list() starting at `beginKey` should fetch from
+  // storage, so that they're in cache by the time the app asks for them.
+
   void putImpl(Lock& lock, Key key, kj::Maybe<Value> value,
                const WriteOptions& options, kj::Maybe<CountedDelete&> counted);
   void putImpl(Lock& lock, kj::Own<Entry> newEntry,
@@ -595,9 +650,33 @@ private:
   // used for ordering, to make sure a write is not committed too early such that it interferes
   // with a previous read.
 
+  kj::Promise<void> startFlush(kj::Promise<void> previousFlush,
+                               kj::Own<kj::PromiseFulfiller<void>> sentFulfiller);
+  // Starts the next flush once `lastFlushSent` resolves: as a pipelined flush if possible,
+  // otherwise as a flushImpl() after `previousFlush` completes. `sentFulfiller` is fulfilled when
+  // the next flush may start.
+
+  bool canPipelineFlush();
+  // True if everything dirty can be written with a pipelined flush: there's no deleteAll() or
+  // alarm change pending, and no delete waiting to be counted.
+
   kj::Promise<void> flushImpl(uint retryCount = 0);
   kj::Promise<void> flushImplDeleteAll(uint retryCount = 0);
 
+  kj::Promise<void> flushImplPipelined(kj::Promise<void> previousFlush);
+  kj::Promise<void> sendPipelinedFlush(uint16_t generation, uint64_t sequence, bool retry);
+  kj::Promise<void> finishPipelinedFlush(kj::Promise<void> sent, uint16_t generation,
+                                         uint64_t sequence, uint retryCount);
+  // A pipelined flush writes the DIRTY entries in a sequenced transaction without waiting for the
+  // flushes before it, then, once they have all completed, marks its own entries CLEAN. A retry
+  // resends those of its entries that are still FLUSHING under the same sequence number.
+
+  void markFlushed(Lock& lock, Entry& entry);
+  // Moves a FLUSHING entry out of `dirtyList` once its flush has completed.
+
+  static kj::Exception translateFlushException(kj::Exception&& e);
+  // Gives an exception that failed a flush the brokenness reason it breaks the output gate with.
+
   struct PutBatch;
   struct MutedDeleteBatch;
   struct CountedBatch;
@@ -628,51 +707,33 @@ private:
   class ForwardListStreamImpl;
   class ReverseListStreamImpl;
   friend class ActorCacheInterface::GetResultList;
+  friend class ActorCacheSharedLru;
 };
 
 class ActorCacheInterface::GetResultList {
   using Entry = ActorCache::Entry;
 public:
-  class Iterator {
-  public:
-    KeyValuePtrPairWithCache operator*() {
-      KJ_IREQUIRE(ptr->get()->value != nullptr);
-      return { ptr->get()->key, ptr->get()->value.orDefault(nullptr), *statusPtr };
-    }
-    Iterator& operator++() {
-      ++ptr;
-      ++statusPtr;
-      return *this;
-    }
-    Iterator operator++(int) {
-      auto copy = *this;
-      ++ptr;
-      ++statusPtr;
-      return copy;
-    }
-    bool operator==(const Iterator& other) const {
-      return ptr == other.ptr && statusPtr == other.statusPtr;
-    }
-
-  private:
-    const kj::Own<Entry>* ptr;
-    const CacheStatus* statusPtr;
+  using Iterator = const KeyValuePtrPairWithCache*;
 
-    explicit Iterator(const kj::Own<Entry>* ptr, const CacheStatus* statusPtr)
-        : ptr(ptr), statusPtr(statusPtr) {}
-    friend class GetResultList;
-  };
-
-  Iterator begin() const { return Iterator(entries.begin(), cacheStatuses.begin()); }
-  Iterator end() const { return Iterator(entries.end(), cacheStatuses.end()); }
-  size_t size() const { return entries.size(); }
+  Iterator begin() const { return rows.begin(); }
+  Iterator end() const { return rows.end(); }
+  size_t size() const { return rows.size(); }
 
   explicit GetResultList(kj::Vector<KeyValuePair> contents);
-  // Construct a simple GetResultList from key-value pairs.
+  // Construct a simple GetResultList from key-value pairs. The pairs are kept as-is; no per-pair
+  // `Entry` is allocated.
 
 private:
+  kj::Vector<KeyValuePtrPairWithCache> rows;
+  // The results, in order, as one contiguous array. Each row points into either `entries` or
+  // `pairs`, which own the underlying keys and values.
+
   kj::Vector<kj::Own<Entry>> entries;
-  kj::Vector<CacheStatus> cacheStatuses;
+  // Entries that came through the cache. An entry's key and value never change once the entry is
+  // created, so rows can safely point into them.
+
+  kj::Vector<KeyValuePair> pairs;
+  // Key-value pairs that never touched the cache.
 
   enum Order {
     FORWARD,
@@ -721,45 +782,133 @@ struct ActorCacheSharedLruOptions {
   // This should typically be set to ActorStorageClientImpl::MAX_KEYS from
   // supervisor/actor-storage.h.
 
+  size_t maxBytesPerRpc = 16u << 20;
+  // Approximate maximum size of a single RPC message during a flush. Puts and deletes are split
+  // into further calls to stay under this, except that a value larger than this gets a call of its
+  // own. (Storage won't accept more than 16MiB regardless.)
+
+  uint maxBatchesInFlight = kj::maxValue;
+  // Maximum number of a flush's batch RPCs that may be awaiting a response at once. The rest are
+  // sent as earlier ones return. Since they all belong to the same transaction, the flush still
+  // commits atomically; this only keeps a large flush from monopolizing the storage connection.
+
   bool noCache = false;
   // If true, assume `noCache` for all operations.
 
   bool neverFlush = false;
   // If true, don't actually flush anything. This is used in preview sessions, since they keep
   // state strictly in memory.
+
+  uint shardCount = 1;
+  // Number of independently-locked shards to split the LRU into. Each ActorCache is assigned to
+  // one shard and only ever takes that shard's lock, so caches used from different threads don't
+  // contend. Each shard keeps its own LRU list, so eviction order is only approximately global:
+  // a shard evicts its least-recently-used entries when the total size is over `softLimit` and
+  // the shard holds more than its share (`softLimit / shardCount`) of it.
+
+  kj::Maybe<const ActorCacheMemoryBudget&> budget;
+  // Budget shared with other LRUs, typically all of those in the process. This lets busy LRUs
+  // borrow memory that idle ones aren't using: while the budget's total is under its limit, the
+  // LRU only evicts clean values to stay under `hardLimit`. Once the budget is exceeded, every LRU
+  // holding more than its `softLimit` evicts back down to it, so `softLimit` is what the LRU can
+  // count on keeping. The budget must outlive the LRU.
+
+  kj::Maybe<const jsg::ExternalMemoryTracker::Counter&> memoryCounter;
+  // If set, the byte size of every entry is also counted here, so that it's reported as memory
+  // held on behalf of the isolate. Must outlive the LRU.
+
+  uint maxFlushesInFlight = 1;
+  // How many flushes each ActorCache may have in flight at once. Above 1, a flush consisting only
+  // of puts and deletes nobody waits to count is sent as a sequenced transaction (see
+  // `DbSettings.sequence` in actor-storage.capnp) as soon as the previous flush has been sent,
+  // rather than once it has been confirmed. Other flushes still wait for everything before them.
+
+  uint listReadAhead = 0;
+  // When a list() with a limit starts right after where the previous one ended, and has to go to
+  // storage, ask storage for this many keys beyond the limit. The extra keys land in cache as
+  // clean entries, so an app paging through a range gets most pages without a round trip. This is
+  // skipped while the LRU is over half of `softLimit`, so read-ahead doesn't push out entries the
+  // app is actually using. Zero disables read-ahead.
 };
 
-class ActorCache::SharedLru {
-public:
-  using Options = ActorCacheSharedLruOptions;
+class ActorCacheMemoryBudget {
+  // A memory budget shared by several ActorCache::SharedLrus; see
+  // ActorCacheSharedLruOptions::budget. Declared at top level so that it can be forward-declared
+  // elsewhere.
 
-  explicit SharedLru(Options options);
+public:
+  explicit ActorCacheMemoryBudget(size_t limit): limit(limit) {}
+  ~ActorCacheMemoryBudget() noexcept(false);
+  KJ_DISALLOW_COPY_AND_MOVE(ActorCacheMemoryBudget);
 
-  ~SharedLru() noexcept(false);
-  KJ_DISALLOW_COPY_AND_MOVE(SharedLru);
+  size_t getLimit() const { return limit; }
 
   size_t currentSize() const { return size.load(std::memory_order_relaxed); }
-  // Mostly for testing.
+  // Byte size of everything cached by all LRUs using this budget.
+
+  bool isExceeded() const { return currentSize() > limit; }
 
 private:
-  Options options;
+  size_t limit;
+  mutable std::atomic<size_t> size = 0;
+
+  friend class ActorCache;
+};
+
+struct ActorCache::LruShard {
+  // One shard of a SharedLru.
 
   kj::MutexGuarded<kj::List<Entry, &Entry::link>> cleanList;
-  // List of clean values, across all caches, ordered from least-recently-used to
+  // List of clean values, across all caches in this shard, ordered from least-recently-used to
   // most-recently-used. Note that due to the ordering, all STALE entries will appear before all
   // CLEAN entries.
 
   mutable std::atomic<size_t> size = 0;
-  // Total byte size of everything that is cached, including dirty values that are not in `list`.
+  // Byte size of everything cached by caches in this shard.
 
   mutable std::atomic<int64_t> nextStaleCheckNs = 0;
-  // TimePoint when we should next evict stale entries. Represented as an int64_t of nanoseconds
-  // instead of kj::TimePoint to allow for atomic operations.
+  // TimePoint when we should next evict stale entries from this shard. Represented as an int64_t
+  // of nanoseconds instead of kj::TimePoint to allow for atomic operations.
+};
+
+class ActorCacheSharedLru {
+  // ActorCache::SharedLru. Declared at top level so that it can be forward-declared elsewhere.
+
+public:
+  using Options = ActorCacheSharedLruOptions;
+
+  explicit ActorCacheSharedLru(Options options);
+
+  ~ActorCacheSharedLru() noexcept(false);
+  KJ_DISALLOW_COPY_AND_MOVE(ActorCacheSharedLru);
+
+  size_t currentSize() const { return size.load(std::memory_order_relaxed); }
+  // Mostly for testing.
+
+private:
+  Options options;
+
+  kj::Array<ActorCache::LruShard> shards;
+
+  mutable std::atomic<uint> nextShard = 0;
+  // Shards are assigned to new caches round-robin.
+
+  mutable std::atomic<size_t> size = 0;
+  // Total byte size of everything that is cached, including dirty values that are not in any
+  // shard's `cleanList`.
+
+  const ActorCache::LruShard& chooseShard() const;
+  // Pick the shard for a newly-created ActorCache.
+
+  size_t getEvictionLimit() const;
+  // The size above which clean values should be evicted: `softLimit`, or `hardLimit` while the
+  // budget (if any) has room to spare.
 
-  bool evictIfNeeded(Lock& lock) const KJ_WARN_UNUSED_RESULT;
-  // Evict cache entries as needed according to the cache limits. Returns true if the hard limit
-  // is exceeded and nothing can be evicted, in which case the caller should fail out in the
-  // appropriate way for the kind of operation being performed.
+  bool evictIfNeeded(const ActorCache::LruShard& shard, ActorCache::Lock& lock) const
+      KJ_WARN_UNUSED_RESULT;
+  // Evict cache entries from `shard` (which `lock` locks) as needed according to the cache limits.
+  // Returns true if the hard limit is exceeded and nothing can be evicted, in which case the
+  // caller should fail out in the appropriate way for the kind of operation being performed.
 
   friend class ActorCache;
 };
@@ -0,0 +1,158 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "hibernation-manager.h"
+#include <workerd/api/hibernatable-web-socket.h>
+#include <workerd/api/web-socket.h>
+#include <workerd/util/sentry.h>
+#include <kj/vector.h>
+
+namespace workerd {
+
+HibernationManager::Socket::Socket(
+    HibernationManager& manager, kj::Own<kj::WebSocket> ws, kj::Array<kj::String> tags)
+    : manager(manager), ws(kj::mv(ws)), tags(kj::mv(tags)) {}
+
+HibernationManager::Socket::~Socket() noexcept(false) {}
+
+bool HibernationManager::Socket::hasTag(kj::StringPtr tag) {
+  for (auto& t: tags) {
+    if (t == tag) return true;
+  }
+  return false;
+}
+
+kj::Maybe<kj::ArrayPtr<const kj::byte>> HibernationManager::Socket::getAttachment() {
+  return attachment.map([](kj::Array<kj::byte>& a) -> kj::ArrayPtr<const kj::byte> { return a; });
+}
+
+void HibernationManager::Socket::setAttachment(kj::Maybe<kj::Array<kj::byte>> value) {
+  attachment = kj::mv(value);
+}
+
+kj::Own<void> HibernationManager::Socket::startSend() {
+  ++manager.sendsInFlight;
+  return kj::heap(kj::defer([&manager = manager]() { --manager.sendsInFlight; }));
+}
+
+HibernationManager::HibernationManager(StartRequestFunc startRequest)
+    : startRequest(kj::mv(startRequest)), readLoops(*this) {}
+
+HibernationManager::~HibernationManager() noexcept(false) {}
+
+kj::Own<HibernationManager::Socket> HibernationManager::accept(
+    kj::Own<kj::WebSocket> ws, kj::Array<kj::String> tags, jsg::Ref<api::WebSocket> wrapper) {
+  auto socket = kj::refcounted<Socket>(*this, kj::mv(ws), kj::mv(tags));
+  socket->jsWebSocket = kj::mv(wrapper);
+  Socket* key = socket.get();
+  sockets.insert(key, kj::addRef(*socket));
+  readLoops.add(readLoop(kj::addRef(*socket)));
+  return socket;
+}
+
+jsg::Ref<api::WebSocket> HibernationManager::getWebSocket(jsg::Lock& js, Socket& socket) {
+  KJ_IF_MAYBE(ws, socket.jsWebSocket) {
+    return ws->addRef();
+  }
+
+  // The actor has been re-instantiated since this socket was accepted, so the new instance needs
+  // a wrapper of its own.
+  auto ws = jsg::alloc<api::WebSocket>(kj::addRef(socket));
+  socket.jsWebSocket = ws.addRef();
+  return ws;
+}
+
+kj::Array<jsg::Ref<api::WebSocket>> HibernationManager::getWebSockets(
+    jsg::Lock& js, kj::Maybe<kj::StringPtr> tag) {
+  kj::Vector<jsg::Ref<api::WebSocket>> result;
+  for (auto& entry: sockets) {
+    auto& socket = *entry.value;
+    if (socket.closed) continue;
+    KJ_IF_MAYBE(t, tag) {
+      if (!socket.hasTag(*t)) continue;
+    }
+    result.add(getWebSocket(js, socket));
+  }
+  return result.releaseAsArray();
+}
+
+void HibernationManager::dropSocket(jsg::Lock& js, Socket& socket) {
+  socket.jsWebSocket = nullptr;
+  sockets.erase(&socket);
+}
+
+void HibernationManager::dropJsObjects(jsg::Lock& js) {
+  kj::Vector<Socket*> closed;
+  for (auto& entry: sockets) {
+    entry.value->jsWebSocket = nullptr;
+    if (entry.value->closed) closed.add(entry.key);
+  }
+  for (auto socket: closed) {
+    sockets.erase(socket);
+  }
+}
+
+kj::Promise<void> HibernationManager::readLoop(kj::Own<Socket> socket) {
+  using Event = api::HibernatableWebSocketCustomEventImpl;
+
+  for (;;) {
+    kj::Maybe<Event::Payload> payload;
+    try {
+      auto message = co_await socket->ws->receive();
+      KJ_SWITCH_ONEOF(message) {
+        KJ_CASE_ONEOF(text, kj::String) {
+          payload = Event::Payload(kj::mv(text));
+        }
+        KJ_CASE_ONEOF(data, kj::Array<kj::byte>) {
+          payload = Event::Payload(kj::mv(data));
+        }
+        KJ_CASE_ONEOF(close, kj::WebSocket::Close) {
+          payload = Event::Payload(Event::Close { close.code, kj::mv(close.reason), true });
+        }
+      }
+    } catch (...) {
+      auto e = kj::getCaughtExceptionAsKj();
+      if (e.getType() == kj::Exception::Type::DISCONNECTED) {
+        // Report premature disconnect as a close event, like a regular accepted WebSocket does.
+        payload = Event::Payload(Event::Close {
+          1006, kj::str("WebSocket disconnected without sending Close frame."), false });
+      } else {
+        payload = Event::Payload(kj::mv(e));
+      }
+    }
+
+    auto& p = KJ_ASSERT_NONNULL(payload);
+    bool closing = !p.is<kj::String>() && !p.is<kj::Array<kj::byte>>();
+
+    ++deliveriesInFlight;
+    KJ_DEFER(--deliveriesInFlight);
+    try {
+      auto worker = startRequest();
+      co_await worker->customEvent(kj::heap<Event>(*this, kj::addRef(*socket), kj::mv(p)));
+    } catch (...) {
+      // The actor couldn't be started or the event failed outside of the handler. The handler's
+      // own exceptions are logged by the event, so just log this and move on to the next message.
+      auto e = kj::getCaughtExceptionAsKj();
+      LOG_EXCEPTION("hibernatableWebSocketEvent", e);
+    }
+
+    if (closing) {
+      // The event normally drops the socket under the isolate lock. If delivery failed before
+      // that, stop tracking it now if we can, or else once the wrapper is dropped.
+      socket->closed = true;
+      KJ_IF_MAYBE(entry, sockets.findEntry(socket.get())) {
+        if (entry->value->jsWebSocket == nullptr) {
+          sockets.erase(*entry);
+        }
+      }
+      co_return;
+    }
+  }
+}
+
+void HibernationManager::taskFailed(kj::Exception&& exception) {
+  LOG_EXCEPTION("hibernatableWebSocketReadLoop", exception);
+}
+
+}  // namespace workerd
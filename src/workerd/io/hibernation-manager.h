@@ -0,0 +1,117 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#pragma once
+
+#include <workerd/jsg/jsg.h>
+#include <workerd/io/worker-interface.h>
+#include <kj/compat/http.h>
+#include <kj/map.h>
+
+namespace workerd {
+
+namespace api {
+  class WebSocket;
+}
+
+class HibernationManager final: public kj::Refcounted, private kj::TaskSet::ErrorHandler {
+  // Holds the WebSockets that a Durable Object has accepted with `state.acceptWebSocket()`.
+  //
+  // A HibernationManager belongs to an actor ID, not to any one instance of the actor. It owns the
+  // native sockets, their tags, and their serialized attachments, and it keeps receiving on every
+  // socket while no instance of the actor exists. This is what lets the runtime tear down an idle
+  // actor's JavaScript state ("hibernate" it) without disconnecting its clients: each incoming
+  // message, close, or error is delivered as a new event through `startRequest`, which
+  // re-instantiates the actor if needed.
+  //
+  // Events for a single socket are delivered one at a time, in the order they were received.
+  //
+  // The manager may only be used from the thread that created it.
+
+public:
+  using StartRequestFunc = kj::Function<kj::Own<WorkerInterface>()>;
+
+  explicit HibernationManager(StartRequestFunc startRequest);
+  ~HibernationManager() noexcept(false);
+  KJ_DISALLOW_COPY_AND_MOVE(HibernationManager);
+
+  static constexpr size_t MAX_TAGS_PER_SOCKET = 10;
+  static constexpr size_t MAX_TAG_LENGTH = 256;
+  static constexpr size_t MAX_ATTACHMENT_SIZE = 2048;
+
+  class Socket final: public kj::Refcounted {
+    // One accepted WebSocket. Outstanding references (e.g. from a JavaScript wrapper that is
+    // still sending) keep the native socket alive after the manager has stopped tracking it.
+
+  public:
+    Socket(HibernationManager& manager, kj::Own<kj::WebSocket> ws, kj::Array<kj::String> tags);
+    ~Socket() noexcept(false);
+
+    kj::WebSocket& getWebSocket() { return *ws; }
+    kj::ArrayPtr<const kj::String> getTags() { return tags; }
+    bool hasTag(kj::StringPtr tag);
+
+    kj::Maybe<kj::ArrayPtr<const kj::byte>> getAttachment();
+    void setAttachment(kj::Maybe<kj::Array<kj::byte>> value);
+    // Serialized value that survives hibernation, set by `WebSocket.serializeAttachment()`.
+
+    kj::Own<void> startSend();
+    // Marks an outgoing send as in flight until the returned object is dropped. The actor can't
+    // hibernate while sends are in flight, since destroying its IoContext would cancel them.
+
+  private:
+    HibernationManager& manager;
+    kj::Own<kj::WebSocket> ws;
+    kj::Array<kj::String> tags;
+    kj::Maybe<kj::Array<kj::byte>> attachment;
+    bool closed = false;
+
+    kj::Maybe<jsg::Ref<api::WebSocket>> jsWebSocket;
+    // The JavaScript wrapper for the current instance of the actor, if one has been created. This
+    // can only be touched with the isolate lock held.
+
+    friend class HibernationManager;
+  };
+
+  kj::Own<Socket> accept(kj::Own<kj::WebSocket> ws, kj::Array<kj::String> tags,
+                         jsg::Ref<api::WebSocket> wrapper);
+  // Takes ownership of `ws` and starts receiving on it. `wrapper` is the JavaScript object that
+  // the application accepted; it remains the socket's wrapper until the actor hibernates.
+
+  jsg::Ref<api::WebSocket> getWebSocket(jsg::Lock& js, Socket& socket);
+  // Gets the JavaScript wrapper for `socket`, creating one if the actor has been re-instantiated
+  // since the socket was accepted. Must be called within the actor's IoContext.
+
+  kj::Array<jsg::Ref<api::WebSocket>> getWebSockets(
+      jsg::Lock& js, kj::Maybe<kj::StringPtr> tag);
+  // Gets wrappers for all open sockets, optionally only those with the given tag.
+
+  void dropSocket(jsg::Lock& js, Socket& socket);
+  // Stops tracking `socket` after its close or error event has been delivered.
+
+  void dropJsObjects(jsg::Lock& js);
+  // Drops all JavaScript wrappers. Called with the isolate lock held when the actor instance that
+  // created them is destroyed.
+
+  bool hasSockets() { return sockets.size() > 0; }
+
+  bool isIdle() { return sendsInFlight == 0 && deliveriesInFlight == 0; }
+  // True if no sends or event deliveries are in flight, so the actor instance could be destroyed
+  // without losing anything.
+
+private:
+  StartRequestFunc startRequest;
+  kj::HashMap<Socket*, kj::Own<Socket>> sockets;
+  uint sendsInFlight = 0;
+  uint deliveriesInFlight = 0;
+
+  kj::TaskSet readLoops;
+  // Must be declared last so that the loops are canceled before anything they reference.
+
+  kj::Promise<void> readLoop(kj::Own<Socket> socket);
+
+  void taskFailed(kj::Exception&& exception) override;
+};
+
+}  // namespace workerd
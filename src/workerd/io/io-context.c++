@@ -11,7 +11,9 @@
 #include <capnp/message.h>
 #include <workerd/util/sentry.h>
 #include <workerd/util/own-util.h>
+#include <workerd/util/timer-wheel.h>
 #include <map>
+#include <sched.h>
 
 namespace workerd {
 
@@ -29,11 +31,42 @@ void IoContext::DeleteQueue::scheduleDeletion(OwnedObject* object) const {
     kj::AllowAsyncDestructorsScope scope;
     OwnedObjectList::unlink(*object);
   } else {
-    auto lock = crossThreadDeleteQueue.lockExclusive();
-    KJ_IF_MAYBE(state, *lock) {
-      state->queue.add(object);
-    }
+    // (These are sequentially consistent, matching close(): either we see `closed`, or close()
+    // sees us in flight and waits.)
+    pushesInFlight.fetch_add(1);
+    KJ_DEFER(pushesInFlight.fetch_sub(1, std::memory_order_release));
+    if (closed.load()) return;
+
+    auto next = head.load(std::memory_order_relaxed);
+    do {
+      object->nextDeletion = next;
+    } while (!head.compare_exchange_weak(next, object,
+        std::memory_order_release, std::memory_order_relaxed));
+  }
+}
+
+uint IoContext::DeleteQueue::drain() {
+  uint count = 0;
+  auto object = head.exchange(nullptr, std::memory_order_acquire);
+  while (object != nullptr) {
+    // Grab the link before unlinking, which deletes the object.
+    auto next = object->nextDeletion;
+    OwnedObjectList::unlink(*object);
+    object = next;
+    ++count;
+  }
+  return count;
+}
+
+void IoContext::DeleteQueue::close() {
+  closed.store(true);
+  while (pushesInFlight.load() != 0) {
+    // A push is at most a few instructions away from finishing.
+    sched_yield();
   }
+
+  // Anything still queued is deleted along with the rest of the OwnedObjectList.
+  head.store(nullptr, std::memory_order_relaxed);
 }
 
 class IoContext::TimeoutManagerImpl final: public TimeoutManager {
@@ -59,11 +92,10 @@ public:
   }
 
   kj::Maybe<kj::Date> getNextTimeout() const override {
-    if (timeoutTimes.size() == 0) {
-      return nullptr;
-    } else {
-      return timeoutTimes.begin()->key.when;
+    KJ_IF_MAYBE(w, wheel) {
+      return w->nextTick().map([this](uint64_t tick) { return tickToDate(tick); });
     }
+    return nullptr;
   }
 
 private:
@@ -75,40 +107,43 @@ private:
 
   void setTimeoutImpl(IoContext& context, Iterator it);
 
-  struct TimeoutTime {
-    // A pair of a Date and a numeric ID, used as entry in timeoutTimes set, below.
+  using Wheel = TimerWheel<kj::Own<kj::PromiseFulfiller<void>>>;
 
-    kj::Date when;
-    uint tiebreaker;  // Unique number, in case two timeouts target same time.
+  kj::Maybe<Wheel> wheel;
+  // Tracks registered timeouts by the next tick (millisecond) in which the timeout is expected to
+  // fire, relative to `wheelOrigin`. Timeouts due in the same tick fire together, in the order
+  // they were set. The wheel is created when the first timeout is set, since it's fairly large.
+  //
+  // Each fulfiller should be fulfilled when its tick has been reached.
 
-    inline bool operator<(const TimeoutTime& other) const {
-      if (when < other.when) return true;
-      if (when > other.when) return false;
-      return tiebreaker < other.tiebreaker;
-    }
-    inline bool operator==(const TimeoutTime& other) const {
-      return when == other.when && tiebreaker == other.tiebreaker;
-    }
-  };
+  kj::Date wheelOrigin = kj::UNIX_EPOCH;
 
-  kj::TreeMap<TimeoutTime, kj::Own<kj::PromiseFulfiller<void>>> timeoutTimes;
-  uint timeoutTimesTiebreakerCounter = 0;
-  // Tracks registered timeouts sorted by the next time the timeout is expected to fire.
-  //
-  // The associated fulfiller should be fulfilled when the time has been reached AND all previous
-  // timeouts have completed.
+  uint64_t dateToTick(kj::Date date) const {
+    // Rounds up, so that timeouts never fire early.
+    if (date <= wheelOrigin) return 0;
+    return (date - wheelOrigin + 1 * kj::MILLISECONDS - 1 * kj::NANOSECONDS) / kj::MILLISECONDS;
+  }
+  kj::Date tickToDate(uint64_t tick) const {
+    return wheelOrigin + tick * kj::MILLISECONDS;
+  }
 
   uint timeoutsStarted = 0;
   uint timeoutsFinished = 0;
   Map timeouts;
 
   kj::Promise<void> timerTask = nullptr;
-  // Promise that is waiting for the closest timeout, and will fulfill its fulfiller. We only ever
-  // actually wait on the next timeout in `timeoutTasks`, so that we can't fulfill timer callbacks
-  // out-of-order. This task gets replaced each time the lead timeout changes.
-
-  void resetTimerTask(TimerChannel& timerChannel);
-  // Must be called any time timeoutTimes.begin() changes.
+  kj::Maybe<uint64_t> timerTaskTick;
+  // Promise that is waiting for the tick `timerTaskTick`, and will then fire every timeout due by
+  // then. We only ever wait on one tick at a time, so that timer callbacks can't be fulfilled
+  // out-of-order. Canceling the timeout at that tick doesn't reset the task; it just finds
+  // nothing to fire.
+
+  void resetTimerTask(IoContext& context);
+  // Must be called when a timeout earlier than `timerTaskTick` is added, or when `timerTask`
+  // isn't running.
+
+  kj::Promise<void> runTimers(IoContext& context, uint64_t tick);
+  // Waits for `tick`, fires every timeout due by then, then moves on to the next tick, if any.
 };
 
 class IoContext::TimeoutManagerImpl::TimeoutState {
@@ -160,6 +195,7 @@ IoContext::IoContext(ThreadContext& thread,
       limitEnforcer(kj::mv(limitEnforcerParam)),
       threadId(getThreadId()),
       deleteQueue(kj::atomicRefcounted<DeleteQueue>()),
+      deleteQueueCloser(*deleteQueue),
       waitUntilTasks(*this),
       timeoutManager(kj::heap<TimeoutManagerImpl>()) {
   kj::PromiseFulfillerPair<void> paf = kj::newPromiseAndFulfiller<void>();
@@ -470,6 +506,9 @@ kj::Promise<void> IoContext::IncomingRequest::drain() {
     return kj::READY_NOW;
   }
 
+  // Whatever runs from now on is background work that no client is waiting for.
+  lockPriority = AsyncLockPriority::WAIT_UNTIL;
+
   kj::Promise<void> timeoutPromise = nullptr;
   KJ_IF_MAYBE(a, context->actor) {
     // For actors, all promises are canceled on actor shutdown, not on a fixed timeout,
@@ -530,7 +569,7 @@ IoContext::PendingEvent::~PendingEvent() noexcept(false) {
   context.runFinalizersTask = Worker::AsyncLock::whenThreadIdle()
       .then([&context = context]() noexcept {
     // We have nothing left to do and no PendingEvent has been registered. Run finalizers now.
-    return context.worker->takeAsyncLock(context.getMetrics()).then(
+    return context.worker->takeAsyncLock(context.getMetrics(), context.getLockPriority()).then(
         [&context](Worker::AsyncLock asyncLock) {
       context.runFinalizers(asyncLock);
     });
@@ -716,26 +755,35 @@ void IoContext::TimeoutManagerImpl::setTimeoutImpl(IoContext& context, Iterator
 
   promise = promise.attach(context.registerPendingEvent());
 
-  // Add an entry to the timeoutTimes map, to track when the nearest timeout is. Arrange for it
-  // to be removed when the promise completes.
-  TimeoutTime timeoutTimesKey { when, timeoutTimesTiebreakerCounter++ };
-  timeoutTimes.insert(timeoutTimesKey, kj::mv(paf.fulfiller));
-  auto deferredTimeoutTimeRemoval = kj::defer(
-      [this, &context, timeoutTimesKey]() {
-    // If the promise is being destroyed due to IoContext teardown then IoChannelFactory may
-    // no longer be available, but we can just skip starting a new timer in that case as it'd be
-    // canceled anyway.
-    if (context.selfRef->maybeContext != nullptr) {
-      bool isNext = timeoutTimes.begin()->key == timeoutTimesKey;
-      timeoutTimes.erase(timeoutTimesKey);
-      if (isNext) resetTimerTask(context.getIoChannelFactory().getTimer());
+  // Add an entry to the timer wheel, to track when the nearest timeout is. It's removed when the
+  // promise completes, if it hasn't fired by then.
+  Wheel* w;
+  KJ_IF_MAYBE(existing, wheel) {
+    w = existing;
+  } else {
+    wheelOrigin = context.now();
+    w = &wheel.emplace();
+  }
+  auto tick = dateToTick(when);
+  auto timer = kj::heap<Wheel::Timer>(*w, tick, kj::mv(paf.fulfiller));
+  auto deferredTimerTaskReset = kj::defer([this, &context]() {
+    // If the promise is being destroyed due to IoContext teardown then the wheel may no longer
+    // exist, but there's no need to stop the timer in that case as it'd be canceled anyway.
+    if (context.selfRef->maybeContext != nullptr &&
+        KJ_ASSERT_NONNULL(wheel).empty()) {
+      timerTask = nullptr;
+      timerTaskTick = nullptr;
     }
   });
 
-  if (timeoutTimes.begin()->key == timeoutTimesKey) {
-    resetTimerTask(context.getIoChannelFactory().getTimer());
+  KJ_IF_MAYBE(t, timerTaskTick) {
+    if (timer->getTick() < *t) resetTimerTask(context);
+  } else {
+    resetTimerTask(context);
   }
-  promise = promise.attach(kj::mv(deferredTimeoutTimeRemoval));
+  // (The timer must be destroyed first, so that the wheel is empty by the time the deferred
+  // reset runs. Attachments are destroyed in reverse order.)
+  promise = promise.attach(kj::mv(deferredTimerTaskReset), kj::mv(timer));
 
   if (context.actor != nullptr) {
     // Add a wait-until task which resolves when this timer completes. This ensures that
@@ -750,26 +798,37 @@ void IoContext::TimeoutManagerImpl::setTimeoutImpl(IoContext& context, Iterator
   state.maybePromise = promise.eagerlyEvaluate(nullptr);
 }
 
-void IoContext::TimeoutManagerImpl::resetTimerTask(TimerChannel& timerChannel) {
-  if (timeoutTimes.size() == 0) {
-    // Not waiting for any timer, clear the existing timer task.
-    timerTask = nullptr;
-  } else {
+void IoContext::TimeoutManagerImpl::resetTimerTask(IoContext& context) {
+  KJ_IF_MAYBE(tick, KJ_ASSERT_NONNULL(wheel).nextTick()) {
     // Wait for the first timer.
-    auto& entry = *timeoutTimes.begin();
-    timerTask = timerChannel.atTime(entry.key.when)
-        .then([this, key = entry.key]() {
-      auto& newEntry = *timeoutTimes.begin();
-      KJ_ASSERT(newEntry.key == key,
-          "front of timeoutTimes changed without calling resetTimerTask(), we probably missed "
-          "a timeout!");
-      newEntry.value->fulfill();
-    }).eagerlyEvaluate([](kj::Exception&& e) {
+    timerTask = runTimers(context, *tick).eagerlyEvaluate([](kj::Exception&& e) {
       KJ_LOG(ERROR, e);
     });
+  } else {
+    // Not waiting for any timer, clear the existing timer task.
+    timerTask = nullptr;
+    timerTaskTick = nullptr;
   }
 }
 
+kj::Promise<void> IoContext::TimeoutManagerImpl::runTimers(IoContext& context, uint64_t tick) {
+  timerTaskTick = tick;
+  return context.getIoChannelFactory().getTimer().atTime(tickToDate(tick))
+      .then([this, &context, tick]() -> kj::Promise<void> {
+    auto& w = KJ_ASSERT_NONNULL(wheel);
+    w.advanceTo(tick, [](Wheel::Timer& timer) {
+      timer.value->fulfill();
+    });
+
+    // Keep going within the same task, rather than replacing `timerTask` from inside itself.
+    KJ_IF_MAYBE(next, w.nextTick()) {
+      return runTimers(context, *next);
+    }
+    timerTaskTick = nullptr;
+    return kj::READY_NOW;
+  });
+}
+
 void IoContext::TimeoutManagerImpl::clearTimeout(
     IoContext& context, TimeoutId timeoutId) {
   auto timeout = timeouts.find(timeoutId);
@@ -977,6 +1036,35 @@ IoContext::OwnedObjectList::~OwnedObjectList() noexcept(false) {
   }
 }
 
+void* IoContext::OwnedObjectArena::allocateSlot() {
+  if (freeList == nullptr) {
+    auto chunk = kj::heapArray<Slot>(nextChunkSlots);
+    // Thread the free list through the chunk in order, so that consecutive allocations are
+    // adjacent in memory.
+    for (size_t i = chunk.size(); i-- > 0;) {
+      chunk[i].nextFree = freeList;
+      freeList = &chunk[i];
+    }
+    chunks.add(kj::mv(chunk));
+    nextChunkSlots = kj::min(nextChunkSlots * 2, MAX_CHUNK_SLOTS);
+  }
+
+  auto slot = freeList;
+  freeList = slot->nextFree;
+  return slot;
+}
+
+void IoContext::OwnedObjectArena::disposeImpl(void* pointer) const {
+  auto& object = *static_cast<OwnedObject*>(pointer);
+  object.destroy(object);
+
+  // Destroying the object may have freed others, which is fine: the slot isn't back on the free
+  // list until now.
+  auto slot = static_cast<Slot*>(pointer);
+  slot->nextFree = freeList;
+  freeList = slot;
+}
+
 void IoContext::OwnedObjectList::unlink(OwnedObject& object) {
   KJ_IF_MAYBE(next, object.next) {
     next->get()->prev = object.prev;
@@ -1068,15 +1156,11 @@ public:
 
     KJ_ON_SCOPE_FAILURE(context.currentLock = nullptr; context.currentInputLock = nullptr);
 
-    {
-      // Handle any pending deletions that arrived while the worker was processing a different
-      // request.
-      auto lock = context.deleteQueue->crossThreadDeleteQueue.lockExclusive();
-      auto& state = KJ_ASSERT_NONNULL(*lock);
-      for (auto& object: state.queue) {
-        OwnedObjectList::unlink(*object);
-      }
-      state.queue.clear();
+    // Handle any pending deletions that arrived while the worker was processing a different
+    // request.
+    uint deleted = context.deleteQueue->drain();
+    if (deleted > 0) {
+      context.worker->getIsolate().getMetrics().crossThreadDeletions(deleted);
     }
   }
   ~Scope() {
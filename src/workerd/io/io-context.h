@@ -9,6 +9,7 @@
 #include <kj/mutex.h>
 #include <kj/function.h>
 #include <kj/map.h>
+#include <atomic>
 
 #include "trace.h"
 #include "worker.h"
@@ -239,6 +240,11 @@ public:
 
   kj::Maybe<WorkerTracer&> getWorkerTracer() { return workerTracer; }
 
+  void setLockPriority(AsyncLockPriority priority) { lockPriority = priority; }
+  // Sets the priority with which the IoContext takes the isolate lock while this is its current
+  // request. Defaults to FETCH; drain() lowers it to WAIT_UNTIL, since the client is no longer
+  // waiting.
+
 private:
   kj::Own<IoContext> context;
   kj::Own<RequestObserver> metrics;
@@ -247,6 +253,8 @@ private:
 
   bool wasDelivered = false;
 
+  AsyncLockPriority lockPriority = AsyncLockPriority::FETCH;
+
   bool waitedForWaitUntil = false;
   // Used for debugging, tracks whether we properly called drain() or some other mechanism to
   // wait for waitUntil tasks.
@@ -319,6 +327,12 @@ public:
 
   LimitEnforcer& getLimitEnforcer() { return *limitEnforcer; }
 
+  AsyncLockPriority getLockPriority() {
+    // Priority for taking the isolate lock on behalf of the current incoming request.
+    if (incomingRequests.empty()) return AsyncLockPriority::WAIT_UNTIL;
+    return getCurrentIncomingRequest().lockPriority;
+  }
+
   InputGate::Lock getInputLock();
   // Get the current input lock. Throws an exception if no input lock is held (e.g. because this is
   // not an actor request).
@@ -854,6 +868,15 @@ private:
     kj::Maybe<kj::Own<OwnedObject>> next;
     kj::Maybe<kj::Own<OwnedObject>>* prev;
     kj::Maybe<Finalizeable&> finalizer;
+
+    OwnedObject* nextDeletion = nullptr;
+    // Link in DeleteQueue's list of pending cross-thread deletions. (`next` and `prev` can't be
+    // reused for this, since the object stays in its OwnedObjectList until it's actually deleted.)
+
+    void (*destroy)(OwnedObject& self) = nullptr;
+    // Runs the destructor of the SpecificOwnedObject<T> this really is. Set by OwnedObjectArena,
+    // which has to destroy objects without knowing their type. (A function pointer rather than a
+    // virtual destructor, which would cost a vtable per T for no other benefit.)
   };
 
   template <typename T>
@@ -862,12 +885,50 @@ private:
     kj::Own<T> ptr;
   };
 
+  class OwnedObjectArena final: public kj::Disposer {
+    // Allocates the OwnedObjects of one OwnedObjectList. A typical request creates dozens of them
+    // and they all have the same size no matter what T is, so rather than going to the heap for
+    // each one, we carve them out of chunks of fixed-size slots. Freed slots are reused, so
+    // long-lived contexts (e.g. actors') stay bounded by their peak object count, and the chunks
+    // themselves are only freed, all at once, when the arena is destroyed with the IoContext.
+    //
+    // Only the IoContext's thread may allocate or free; cross-thread deletions go through the
+    // DeleteQueue as usual.
+
+  public:
+    OwnedObjectArena() = default;
+    KJ_DISALLOW_COPY_AND_MOVE(OwnedObjectArena);
+
+    template <typename T>
+    kj::Own<OwnedObject> allocate(kj::Own<T> obj);
+
+  private:
+    union Slot {
+      Slot* nextFree;
+      alignas(SpecificOwnedObject<int>) kj::byte storage[sizeof(SpecificOwnedObject<int>)];
+    };
+
+    static constexpr size_t MIN_CHUNK_SLOTS = 16;
+    static constexpr size_t MAX_CHUNK_SLOTS = 256;
+
+    kj::Vector<kj::Array<Slot>> chunks;
+    mutable Slot* freeList = nullptr;
+    size_t nextChunkSlots = MIN_CHUNK_SLOTS;
+
+    void* allocateSlot();
+    void disposeImpl(void* pointer) const override;
+  };
+
   class OwnedObjectList {
   public:
     OwnedObjectList() = default;
     KJ_DISALLOW_COPY_AND_MOVE(OwnedObjectList);
     ~OwnedObjectList() noexcept(false);
 
+    template <typename T>
+    kj::Own<OwnedObject> allocate(kj::Own<T> obj) { return arena.allocate(kj::mv(obj)); }
+    // Allocates an OwnedObject wrapping `obj`, to be passed to link().
+
     void link(kj::Own<OwnedObject> object);
     static void unlink(OwnedObject& object);
 
@@ -880,6 +941,9 @@ private:
     }
 
   private:
+    OwnedObjectArena arena;
+    // Declared first so that it outlives every object in the list.
+
     kj::Maybe<kj::Own<OwnedObject>> head;
 
     bool finalizersRan = false;
@@ -887,46 +951,53 @@ private:
 
   class DeleteQueue: public kj::AtomicRefcounted {
     // Object which receives possibly-cross-thread deletions of owned objects.
+    //
+    // Objects dropped in other threads are pushed onto a lock-free intrusive stack, and deleted in
+    // a batch whenever the IoContext next runs. Pushing never allocates and never blocks, except
+    // that close() waits for pushes already under way to finish.
 
   public:
-    DeleteQueue()
-        : crossThreadDeleteQueue(State { kj::Vector<OwnedObject*>() }) {}
-
     void scheduleDeletion(OwnedObject* object) const;
 
-    struct State {
-      kj::Vector<OwnedObject*> queue;
-    };
+    uint drain();
+    // Deletes all objects whose deletion was scheduled from other threads, returning how many
+    // there were. Must be called in the IoContext's thread.
 
-    kj::MutexGuarded<kj::Maybe<State>> crossThreadDeleteQueue;
-    // Pointers from IoOwns that were dropped in other threads, and therefore should be deleted
-    // whenever the IoContext gets around to it. The maybe is changed to nullptr when the
-    // IoContext goes away, at which point all OwnedObjects have already been deleted so
-    // cross-thread deletions can just be ignored.
+    void close();
+    // Called when the IoContext is being destroyed, before its OwnedObjects are. Cross-thread
+    // deletions are ignored from then on, since the OwnedObjectList's destructor will take care of
+    // everything.
 
     template <typename T> IoOwn<T> addObject(kj::Own<T> obj, OwnedObjectList& ownedObjects);
     // Implements the corresponding methods of IoContext and ActorContext.
+
+  private:
+    mutable std::atomic<OwnedObject*> head = nullptr;
+    // Objects pending deletion, linked through `OwnedObject::nextDeletion`, most recent first.
+
+    mutable std::atomic<uint> pushesInFlight = 0;
+    std::atomic<bool> closed = false;
+    // A pusher writes to the object, which the IoContext may delete once it's closed. So pushers
+    // count themselves in before checking `closed`, and close() waits for the count to drop to
+    // zero after setting it.
   };
 
-  class DeleteQueuePtr: public kj::Own<DeleteQueue> {
-    // When the IoContext is destroyed, we need to null out the DeleteQueue. Complicating
-    // matters a bit, we need to cancel all tasks (destroy the TaskSet) before this happens, so
-    // we can't just do it in IoContext's destrucrtor. As a hack, we customize our pointer
-    // to the delete queue to get the tear-down order right.
+  class DeleteQueueCloser {
+    // Closes the DeleteQueue when destroyed. When the IoContext is destroyed, we need to close the
+    // DeleteQueue after all tasks are canceled (the TaskSet is destroyed) but before the
+    // OwnedObjects are deleted, so we can't just do it in IoContext's destructor. As a hack, this
+    // is declared just after `ownedObjects` to get the tear-down order right.
 
   public:
-    DeleteQueuePtr(kj::Own<DeleteQueue> value)
-        : kj::Own<DeleteQueue>(kj::mv(value)) {}
-    KJ_DISALLOW_COPY_AND_MOVE(DeleteQueuePtr);
-    ~DeleteQueuePtr() noexcept(false) {
-      auto ptr = get();
-      if (ptr != nullptr) {
-        *ptr->crossThreadDeleteQueue.lockExclusive() = nullptr;
-      }
-    }
+    explicit DeleteQueueCloser(DeleteQueue& queue): queue(queue) {}
+    KJ_DISALLOW_COPY_AND_MOVE(DeleteQueueCloser);
+    ~DeleteQueueCloser() noexcept(false) { queue.close(); }
+
+  private:
+    DeleteQueue& queue;
   };
 
-  DeleteQueuePtr deleteQueue;
+  kj::Own<DeleteQueue> deleteQueue;
 
   kj::Own<kj::PromiseFulfiller<void>> abortFulfiller;
   kj::ForkedPromise<void> abortPromise = nullptr;
@@ -941,6 +1012,8 @@ private:
   // NOTE: This must live below `deleteQueue`, as some of these OwnedObjects may own attachctx()'ed
   //   objects which reference `deleteQueue` in their destructors.
 
+  DeleteQueueCloser deleteQueueCloser;
+
   constexpr static size_t GB = 1 << 30;
   constexpr static size_t MAX_TOTAL_PUT_SIZE = 5 * GB;
   constexpr static size_t MAX_INDIVIDUAL_PUT_SIZE = 5 * GB;
@@ -1128,15 +1201,21 @@ kj::PromiseForResult<Func, Worker::Lock&> IoContext::run(
   kj::Promise<Worker::AsyncLock> asyncLockPromise = nullptr;
   KJ_IF_MAYBE(a, actor) {
     if (inputLock == nullptr) {
-      return a->getInputGate().wait()
-          .then([this,func=kj::fwd<Func>(func)](InputGate::Lock&& inputLock) mutable {
-        return run(kj::fwd<Func>(func), kj::mv(inputLock));
-      });
+      // Most events arrive while the gate is open, so skip the extra turn of wait() when we can.
+      KJ_IF_MAYBE(lock, a->getInputGate().tryLock()) {
+        inputLock = kj::mv(*lock);
+      } else {
+        return a->getInputGate().wait()
+            .then([this,func=kj::fwd<Func>(func)](InputGate::Lock&& inputLock) mutable {
+          return run(kj::fwd<Func>(func), kj::mv(inputLock));
+        });
+      }
     }
 
-    asyncLockPromise = worker->takeAsyncLockWhenActorCacheReady(now(), *a, getMetrics());
+    asyncLockPromise = worker->takeAsyncLockWhenActorCacheReady(
+        now(), *a, getMetrics(), getLockPriority());
   } else {
-    asyncLockPromise = worker->takeAsyncLock(getMetrics());
+    asyncLockPromise = worker->takeAsyncLock(getMetrics(), getLockPriority());
   }
 
   return asyncLockPromise
@@ -1392,19 +1471,7 @@ template <typename T>
 inline IoOwn<T> IoContext::DeleteQueue::addObject(
     kj::Own<T> obj, OwnedObjectList& ownedObjects) {
   auto& ref = *obj;
-
-  // HACK: We need an Own<OwnedObject>, but we actually need to allocate it as the subclass
-  //   SpecificOwnedObject<T>. OwnedObject is not polymorphic, which means kj::Own will refuse
-  //   to upcast kj::Own<SpecificOwnedObject<T>> to kj::Own<OwnedObject> since it can't guarantee
-  //   the disposers are compatible. However, since we're only using single inheritance here, the
-  //   disposers *are* compatible (the numeric value of pointers to SpecificOwnedObject<T> and
-  //   its parent OwnedObject are equal). So, instead of forcing OwnedObject to be polymorphic
-  //   (which would have forced a bunch of useless vtables and vtable pointers)... I'm manually
-  //   constructing the kj::Own<> using a disposer that I know is compatible.
-  // TODO(cleanup): Can KJ be made to support this use case?
-  kj::Own<OwnedObject> ownedObject(
-      new SpecificOwnedObject<T>(kj::mv(obj)),
-      kj::_::HeapDisposer<SpecificOwnedObject<T>>::instance);
+  auto ownedObject = ownedObjects.allocate(kj::mv(obj));
 
   if constexpr (kj::canConvert<T&, Finalizeable&>()) {
     ownedObject->finalizer = ref;
@@ -1416,6 +1483,22 @@ inline IoOwn<T> IoContext::DeleteQueue::addObject(
   return result;
 }
 
+template <typename T>
+kj::Own<IoContext::OwnedObject> IoContext::OwnedObjectArena::allocate(kj::Own<T> obj) {
+  static_assert(sizeof(SpecificOwnedObject<T>) <= sizeof(Slot) &&
+                alignof(SpecificOwnedObject<T>) <= alignof(Slot));
+
+  // Note that we hand out an Own<OwnedObject> pointing at a SpecificOwnedObject<T>, which works
+  // since the arena itself is the disposer, and it knows how to destroy the real type through
+  // `OwnedObject::destroy`. (The numeric value of pointers to SpecificOwnedObject<T> and its
+  // parent OwnedObject are equal, since we're only using single inheritance here.)
+  auto object = new (allocateSlot()) SpecificOwnedObject<T>(kj::mv(obj));
+  object->destroy = [](OwnedObject& self) {
+    static_cast<SpecificOwnedObject<T>&>(self).~SpecificOwnedObject<T>();
+  };
+  return kj::Own<OwnedObject>(object, *this);
+}
+
 template <typename T>
 inline IoPtr<T> IoContext::addObject(T& obj) {
   requireCurrent();
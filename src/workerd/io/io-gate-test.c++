@@ -352,6 +352,30 @@ KJ_TEST("InputGate broken") {
   KJ_EXPECT_THROW_MESSAGE("foobar", cs2->wait().wait(ws));
   KJ_EXPECT_THROW_MESSAGE("foobar", brokenPromise.wait(ws));
   KJ_EXPECT_THROW_MESSAGE("foobar", gate.onBroken().wait(ws));
+  KJ_EXPECT(gate.tryLock() == nullptr);
+}
+
+KJ_TEST("InputGate tryLock") {
+  kj::EventLoop loop;
+  kj::WaitScope ws(loop);
+
+  InputGate gate;
+
+  {
+    auto lock = KJ_ASSERT_NONNULL(gate.tryLock());
+    KJ_EXPECT(lock.isFor(gate));
+    KJ_EXPECT(gate.tryLock() == nullptr);
+
+    // Waiters queued behind a lock taken this way are released as usual.
+    auto promise = gate.wait();
+    KJ_EXPECT(!promise.poll(ws));
+    { auto drop = kj::mv(lock); }
+    KJ_ASSERT(promise.poll(ws));
+    auto lock2 = promise.wait(ws);
+    KJ_EXPECT(gate.tryLock() == nullptr);
+  }
+
+  KJ_EXPECT(gate.tryLock() != nullptr);
 }
 
 // =======================================================================================
@@ -54,6 +54,14 @@ kj::Promise<InputGate::Lock> InputGate::wait() {
   }
 }
 
+kj::Maybe<InputGate::Lock> InputGate::tryLock() {
+  if (lockCount == 0 && brokenState.is<kj::Own<kj::PromiseFulfiller<void>>>()) {
+    return Lock(*this);
+  } else {
+    return nullptr;
+  }
+}
+
 kj::Promise<void> InputGate::onBroken() {
   KJ_IF_MAYBE(e, brokenState.tryGet<kj::Exception>()) {
     return kj::cp(*e);
@@ -101,6 +101,11 @@ public:
   kj::Promise<Lock> wait();
   // Wait until there are no `Lock`s, then create a new one and return it.
 
+  kj::Maybe<Lock> tryLock();
+  // If `wait()` would return a Lock right away, returns it directly instead, which saves
+  // allocating a promise and waiting for a turn of the event loop. Returns null if the gate is
+  // locked or broken, in which case the caller should fall back to `wait()`.
+
   kj::Promise<void> onBroken();
   // Rejects if and when calls to `wait()` become broken due to a failed critical section. The
   // actor should be shut down in this case. This promise never resolves, only rejects.
@@ -109,6 +109,11 @@ public:
   // Gets a byte size limit to apply to operations that will buffer a possibly large amount of
   // data in C++ memory, such as reading an entire HTTP response into an `ArrayBuffer`.
 
+  virtual kj::Maybe<size_t> getTeeBackpressureThreshold() = 0;
+  // If non-null, tees of native streams buffer at most roughly this many bytes for the slower
+  // branch, throttling reads for the faster one until it catches up. If null, the slower branch
+  // buffers up to getBufferingLimit() and then fails.
+
   virtual kj::Maybe<EventOutcome> getLimitsExceeded() = 0;
   // If a limit has been exceeded which prevents further JavaScript execution, such as the CPU or
   // memory limit, returns a request status code indicating which one. Returns null if no limits
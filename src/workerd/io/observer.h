@@ -15,10 +15,30 @@
 
 namespace workerd {
 
+namespace jsg { class ExternalMemoryTracker; }
+
 class WorkerInterface;
 class LimitEnforcer;
 class TimerChannel;
 
+enum class AsyncLockPriority: uint8_t {
+  // Classes of work competing for an isolate's AsyncLock, most urgent first. When the lock is
+  // released it goes to the most urgent waiter, but each waiter is promoted one class for every
+  // `Worker::Isolate::ASYNC_LOCK_AGING_INTERVAL` it has waited, so nothing waits forever.
+
+  FETCH,
+  // Work for an event whose client is waiting on the response, e.g. an HTTP request.
+
+  ALARM,
+  // Work for a Durable Object alarm.
+
+  SCHEDULED,
+  // Work for a scheduled (cron) event.
+
+  WAIT_UNTIL
+  // Work left over after the response was sent, e.g. `waitUntil()` tasks.
+};
+
 class RequestObserver: public kj::Refcounted {
   // Observes a specific request to a specific worker. Also observes outgoing subrequests.
   //
@@ -81,10 +101,34 @@ public:
   // Called when the owning Worker::Script is being destroyed. The IsolateObserver may
   // live a while longer to handle deferred proxy requests.
 
+  virtual void externalMemoryTracked(const jsg::ExternalMemoryTracker& tracker) {}
+  // Called once, just after created(), with the tracker of memory held by C++ objects on the
+  // isolate's behalf, by type. The tracker is thread-safe and atomic-refcounted; add a reference
+  // to read it later, e.g. when metrics are collected.
+
   virtual void teardownStarted() {}
   virtual void teardownLockAcquired() {}
   virtual void teardownFinished() {}
 
+  virtual void crossThreadDeletions(uint count) const {}
+  // Called when the isolate's thread deletes `count` objects belonging to an IoContext, whose
+  // IoOwns were dropped in other threads.
+
+  virtual void asyncLockQueued(AsyncLockPriority priority, kj::Duration waitTime) const {}
+  // Called when an AsyncLock of the given priority is obtained, having spent `waitTime` in the
+  // isolate's queue.
+
+  virtual void lockReleased(bool synchronous, kj::Duration waitTime, kj::Duration holdTime) const {}
+  // Called each time a `Worker::Lock` on this isolate is released. `synchronous` is true if it was
+  // taken with `TakeSynchronously` rather than an `AsyncLock`. `waitTime` is how long it took to
+  // get the lock, including, for an async lock, time spent in the isolate's queue; `holdTime` is
+  // how long it was held. Called for every lock, traced or not, so keep it cheap.
+
+  virtual void crossIsolateLockWakeup(bool spurious) const {}
+  // Called when a lock attempt on this isolate, which had been waiting for its thread to release
+  // a lock on a different isolate, is woken. `spurious` is true if the thread had already taken
+  // another lock by the time the attempt ran, so it had to go back to waiting.
+
   enum class StartType: uint8_t {
     // Describes why a worker was started.
 
@@ -213,6 +257,16 @@ public:
   virtual void addStorageWriteUnits(uint32_t units) {}
   virtual void addStorageDeletes(uint32_t count) {}
 
+  virtual void storageCacheEntryEvicted() {}
+  // A clean entry was evicted from the storage cache for memory pressure or staleness. May be
+  // called on a thread other than the actor's, when another actor's activity triggers eviction
+  // from a shared LRU.
+
+  virtual void storageFlushStarted(size_t dirtyBytes) {}
+  virtual void storageBatchSent(size_t bytes) {}
+  // Sizes of storage flushes and of the batch RPCs they're split into, typically recorded as
+  // histograms. See ActorCache::Hooks.
+
   virtual void inputGateLocked() {}
   virtual void inputGateReleased() {}
   virtual void inputGateWaiterAdded() {}
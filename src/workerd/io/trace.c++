@@ -429,8 +429,6 @@ void WorkerTracer::setEventInfo(kj::Date timestamp, Trace::EventInfo&& info) {
   // TODO(someday): For now, we're using logLevel == none as a hint to avoid doing anything
   //   expensive while tracing.  We may eventually want separate configuration for event info vs.
   //   logs.
-  // TODO(perf): Find a way to allow caller to avoid the cost of generation if the info struct
-  //   won't be used?
   if (pipelineLogLevel == PipelineLogLevel::NONE) {
     return;
   }
@@ -463,6 +461,18 @@ void WorkerTracer::setEventInfo(kj::Date timestamp, Trace::EventInfo&& info) {
   trace->eventInfo = kj::mv(info);
 }
 
+void WorkerTracer::setLazyEventInfo(
+    kj::Date timestamp, kj::FunctionParam<Trace::EventInfo()> makeInfo) {
+  KJ_ASSERT(trace->eventInfo == nullptr, "tracer can only be used for a single event");
+
+  // Same check as in setEventInfo(), made before the info is built rather than after.
+  if (pipelineLogLevel == PipelineLogLevel::NONE) {
+    return;
+  }
+
+  setEventInfo(timestamp, makeInfo());
+}
+
 void WorkerTracer::setOutcome(EventOutcome outcome) {
   trace->outcome = outcome;
 }
@@ -5,6 +5,7 @@
 #pragma once
 
 #include <kj/async.h>
+#include <kj/function.h>
 #include <kj/one-of.h>
 #include <kj/refcount.h>
 #include <kj/string.h>
@@ -288,6 +289,10 @@ public:
   void setEventInfo(kj::Date timestamp, Trace::EventInfo&&);
   // Adds info about the event that triggered the trace.  Must not be called more than once.
 
+  void setLazyEventInfo(kj::Date timestamp, kj::FunctionParam<Trace::EventInfo()> makeInfo);
+  // Like setEventInfo(), but only calls `makeInfo` if the event info is actually going to be
+  // recorded. Use this when building the info is costly, e.g. because it copies request headers.
+
   void setFetchResponseInfo(Trace::FetchResponseInfo&&);
   // Adds info about the response. Must not be called more than once, and only
   // after passing a FetchEventInfo to setEventInfo().
@@ -126,32 +126,33 @@ kj::Promise<void> WorkerEntrypoint::request(
   bool isActor = context.getActor() != nullptr;
 
   KJ_IF_MAYBE(t, incomingRequest->getWorkerTracer()) {
-    auto timestamp = context.now();
-    kj::String cfJson;
-    KJ_IF_MAYBE(c, cfBlobJson) {
-      cfJson = kj::str(*c);
-    }
+    t->setLazyEventInfo(context.now(), [&]() -> Trace::EventInfo {
+      kj::String cfJson;
+      KJ_IF_MAYBE(c, cfBlobJson) {
+        cfJson = kj::str(*c);
+      }
 
-    // To match our historical behavior (when we used to pull the headers from the JavaScript
-    // object later on), we need to canonicalize the headers, including:
-    // - Lower-case the header name.
-    // - Combine multiple headers with the same name into a comma-delimited list. (This explicitly
-    //   breaks the Set-Cookie header, incidentally, but should be equivalent for all other
-    //   headers.)
-    kj::TreeMap<kj::String, kj::Vector<kj::StringPtr>> traceHeaders;
-    headers.forEach([&](kj::StringPtr name, kj::StringPtr value) {
-      kj::String lower = api::toLower(name);
-      auto& slot = traceHeaders.findOrCreate(lower,
-          [&]() { return decltype(traceHeaders)::Entry {kj::mv(lower), {}}; });
-      slot.add(value);
-    });
-    auto traceHeadersArray = KJ_MAP(entry, traceHeaders) {
-      return Trace::FetchEventInfo::Header(kj::mv(entry.key),
-          kj::strArray(entry.value, ", "));
-    };
+      // To match our historical behavior (when we used to pull the headers from the JavaScript
+      // object later on), we need to canonicalize the headers, including:
+      // - Lower-case the header name.
+      // - Combine multiple headers with the same name into a comma-delimited list. (This
+      //   explicitly breaks the Set-Cookie header, incidentally, but should be equivalent for all
+      //   other headers.)
+      kj::TreeMap<kj::String, kj::Vector<kj::StringPtr>> traceHeaders;
+      headers.forEach([&](kj::StringPtr name, kj::StringPtr value) {
+        kj::String lower = api::toLower(name);
+        auto& slot = traceHeaders.findOrCreate(lower,
+            [&]() { return decltype(traceHeaders)::Entry {kj::mv(lower), {}}; });
+        slot.add(value);
+      });
+      auto traceHeadersArray = KJ_MAP(entry, traceHeaders) {
+        return Trace::FetchEventInfo::Header(kj::mv(entry.key),
+            kj::strArray(entry.value, ", "));
+      };
 
-    t->setEventInfo(timestamp, Trace::FetchEventInfo(method, kj::str(url),
-        kj::mv(cfJson), kj::mv(traceHeadersArray)));
+      return Trace::FetchEventInfo(method, kj::str(url),
+          kj::mv(cfJson), kj::mv(traceHeadersArray));
+    });
   }
 
   auto metricsForCatch = kj::addRef(incomingRequest->getMetrics());
@@ -340,6 +341,7 @@ kj::Promise<WorkerInterface::ScheduledResult> WorkerEntrypoint::runScheduled(
   auto incomingRequest = kj::mv(KJ_REQUIRE_NONNULL(this->incomingRequest,
                                 "runScheduled() can only be called once"));
   this->incomingRequest = nullptr;
+  incomingRequest->setLockPriority(AsyncLockPriority::SCHEDULED);
   incomingRequest->delivered();
   auto& context = incomingRequest->getContext();
 
@@ -394,6 +396,7 @@ kj::Promise<WorkerInterface::AlarmResult> WorkerEntrypoint::runAlarm(
   auto promise = actor.dedupAlarm(scheduledTime,
       [this,&context,scheduledTime,incomingRequest = kj::mv(incomingRequest)]() mutable
       -> kj::Promise<WorkerInterface::AlarmResult> {
+    incomingRequest->setLockPriority(AsyncLockPriority::ALARM);
     incomingRequest->delivered();
 
     KJ_IF_MAYBE(t, incomingRequest->getWorkerTracer()) {
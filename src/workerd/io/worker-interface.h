@@ -34,9 +34,12 @@ public:
   // Make an HTTP request. (This method is inherited from HttpService, but re-declared here for
   // visibility.)
   //
-  // TODO(perf): Consider changing this to return Promise<DeferredProxy>. This would allow
-  //   more resources to be dropped when merely proxying a request. However, it means we would no
-  //   longer be immplementing kj::HttpService. But maybe that doesn't matter too much in practice.
+  // This returns a plain Promise<void> rather than Promise<DeferredProxy>, so that WorkerInterface
+  // remains a kj::HttpService and can be handed to kj::newHttpClient(), kj::HttpServer and
+  // http-over-capnp as-is. WorkerEntrypoint does the deferring internally instead: it drops its
+  // IoContext as soon as the JavaScript part of the request is done, before it finishes proxying
+  // the response. Anything that should likewise be released at that point, rather than when this
+  // promise completes, can be passed to it as `ioContextDependency`.
 
   virtual kj::Promise<void> connect(kj::StringPtr host,
                                     const kj::HttpHeaders& headers,
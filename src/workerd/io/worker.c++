@@ -21,12 +21,15 @@
 #include <kj/encoding.h>
 #include <kj/filesystem.h>
 #include <kj/map.h>
+#include <kj/mutex.h>
+#include <kj/thread.h>
 #include <v8-inspector.h>
 #include <v8-profiler.h>
 #include <map>
 #include <time.h>
 #include <sys/syscall.h>
 #include <numeric>
+#include <algorithm>
 
 namespace v8_inspector {
   kj::String KJ_STRINGIFY(const v8_inspector::StringView& view) {
@@ -508,6 +511,132 @@ struct Worker::Impl {
   // If set, then any attempt to use this worker shall throw this exception.
 };
 
+namespace {
+
+class LongLockSampler {
+  // A background thread which interrupts JavaScript that has held its isolate's lock for longer
+  // than the isolate's long-lock threshold, so that the lock can record what was running. Started
+  // the first time an isolate with a threshold is locked, and runs until the process exits.
+
+public:
+  struct Hold {
+    v8::Isolate* isolate;
+    kj::TimePoint deadline;
+    v8::InterruptCallback callback;
+    void* callbackData;
+
+    bool interrupted = false;
+    // Protected by the sampler's mutex.
+  };
+
+  static LongLockSampler& get() {
+    static LongLockSampler instance;
+    return instance;
+  }
+
+  ~LongLockSampler() noexcept(false) {
+    // `thread` is joined when it's destroyed, right after this.
+    state.lockExclusive()->shutdown = true;
+  }
+
+  void add(Hold& hold) {
+    auto lock = state.lockExclusive();
+    lock->holds.add(&hold);
+    ++lock->additions;
+  }
+
+  void remove(Hold& hold) {
+    // Once this returns, the thread won't request any more interrupts for `hold`. One it has
+    // already requested may still be pending, so the callback must check whether it's still
+    // wanted.
+    auto lock = state.lockExclusive();
+    auto& holds = lock->holds;
+    for (auto i: kj::indices(holds)) {
+      if (holds[i] == &hold) {
+        holds[i] = holds.back();
+        holds.removeLast();
+        break;
+      }
+    }
+  }
+
+private:
+  struct State {
+    kj::Vector<Hold*> holds;
+    uint64_t additions = 0;
+    // Bumped by add() so that the thread wakes up to take the new hold's deadline into account.
+
+    bool shutdown = false;
+  };
+  kj::MutexGuarded<State> state;
+
+  kj::Thread thread;
+  // Declared last so that everything the thread uses is initialized first.
+
+  LongLockSampler(): thread([this]() { run(); }) {}
+
+  void run() {
+    // Sleeps until the earliest deadline among the holds it knows about, or until a hold is added
+    // or the sampler is shutting down. With no outstanding deadline, it sleeps indefinitely.
+    // Removing a hold doesn't wake the thread; at worst it wakes up early and finds nothing to do.
+    uint64_t seen = 0;
+    kj::Maybe<kj::TimePoint> next;
+    for (;;) {
+      kj::Maybe<kj::Duration> timeout = next.map([](kj::TimePoint deadline) {
+        auto now = kj::systemPreciseMonotonicClock().now();
+        return deadline > now ? deadline - now : 0 * kj::NANOSECONDS;
+      });
+
+      bool shutdown = state.when([&](const State& s) {
+        return s.shutdown || s.additions != seen;
+      }, [&](State& s) {
+        if (s.shutdown) return true;
+        seen = s.additions;
+        next = nullptr;
+
+        auto now = kj::systemPreciseMonotonicClock().now();
+        for (auto hold: s.holds) {
+          if (hold->interrupted) continue;
+          if (now >= hold->deadline) {
+            hold->interrupted = true;
+            hold->isolate->RequestInterrupt(hold->callback, hold->callbackData);
+          } else KJ_IF_MAYBE(n, next) {
+            if (hold->deadline < *n) *n = hold->deadline;
+          } else {
+            next = hold->deadline;
+          }
+        }
+        return false;
+      }, timeout);
+
+      if (shutdown) return;
+    }
+  }
+};
+
+kj::String sampleJsStack(v8::Isolate* isolate) {
+  v8::HandleScope scope(isolate);
+  auto stackTrace = v8::StackTrace::CurrentStackTrace(isolate, 10);
+  auto frameCount = stackTrace->GetFrameCount();
+  if (frameCount == 0) {
+    return kj::str("(no JavaScript on the stack)");
+  }
+
+  kj::Vector<kj::String> frames(frameCount);
+  for (int i = 0; i < frameCount; i++) {
+    auto frame = stackTrace->GetFrame(isolate, i);
+    auto func = frame->GetFunctionName();
+    auto url = frame->GetScriptNameOrSourceURL();
+    frames.add(kj::str("at ",
+        func.IsEmpty() || func->Length() == 0 ? kj::str("<anonymous>") : kj::str(func), " (",
+        url.IsEmpty() ? kj::str("<unknown>") : kj::str(url), ':',
+        frame->GetLineNumber(), ':', frame->GetColumn(), ')'));
+  }
+  return kj::strArray(frames, "; ");
+}
+
+}  // namespace
+
 struct Worker::Isolate::Impl {
   // Note that Isolate mutable state is protected by locking the JsgWorkerIsolate unless otherwise
   // noted.
@@ -537,6 +666,18 @@ struct Worker::Isolate::Impl {
   // attempt. This allows watchdogs to see evidence of forward progress in other threads, even if
   // their own thread has blocked waiting for the lock for a long time.
 
+  mutable uint64_t syncLockCount = 0;
+  mutable uint64_t asyncLockCount = 0;
+  mutable int64_t totalLockWaitNs = 0;
+  mutable int64_t totalLockHoldNs = 0;
+  mutable int64_t maxLockHoldNs = 0;
+  mutable uint64_t longLockCount = 0;
+  // See getLockStats(). Only written while holding the lock, but read from any thread, so always
+  // accessed atomically.
+
+  kj::Maybe<kj::Duration> longLockThreshold;
+  // See setLongLockThreshold().
+
   class Lock {
     // Wrapper around JsgWorkerIsolate::Lock and various RAII objects which help us report metrics,
     // measure instantaneous load, avoid spurious watchdog kills, and defer context destruction.
@@ -546,12 +687,18 @@ struct Worker::Isolate::Impl {
   public:
     explicit Lock(const Worker::Isolate& isolate, Worker::LockType lockType)
         : impl(*isolate.impl),
+          isolate(isolate),
+          synchronous(lockType.origin.is<Worker::Lock::TakeSynchronously>()),
+          waitStart([&lockType]() {
+            KJ_IF_MAYBE(async, lockType.origin.tryGet<AsyncLock*>()) {
+              return (*async)->waiter->queuedAt;
+            }
+            return kj::systemPreciseMonotonicClock().now();
+          }()),
           metrics([&isolate, &lockType]()
               -> kj::Maybe<kj::Own<IsolateObserver::LockTiming>> {
             KJ_SWITCH_ONEOF(lockType.origin) {
               KJ_CASE_ONEOF(sync, Worker::Lock::TakeSynchronously) {
-                // TODO(perf): We could do some tracking here to discover overly harmful synchronous
-                //   locks.
                 return isolate.getMetrics().tryCreateLockTiming(sync.getRequest());
               }
               KJ_CASE_ONEOF(async, AsyncLock*) {
@@ -574,6 +721,17 @@ struct Worker::Isolate::Impl {
       __atomic_add_fetch(&impl.lockSuccessCount, 1, __ATOMIC_RELAXED);
       metrics.locked();
 
+      lockedAt = kj::systemPreciseMonotonicClock().now();
+      KJ_IF_MAYBE(threshold, impl.longLockThreshold) {
+        auto& hold = longLockHold.emplace(LongLockSampler::Hold {
+          .isolate = lock->v8Isolate,
+          .deadline = lockedAt + *threshold,
+          .callback = &sampleLongLock,
+          .callbackData = const_cast<Impl*>(&impl),
+        });
+        LongLockSampler::get().add(hold);
+      }
+
       // We record the current lock so our GC prologue/epilogue callbacks can report GC time via
       // Jaeger tracing.
       KJ_DASSERT(impl.currentLock == nullptr, "Isolate lock taken recursively");
@@ -593,6 +751,11 @@ struct Worker::Isolate::Impl {
     ~Lock() noexcept(false) {
       currentApiIsolate = oldCurrentApiIsolate;
 
+      KJ_IF_MAYBE(hold, longLockHold) {
+        LongLockSampler::get().remove(*hold);
+      }
+      recordHold(kj::systemPreciseMonotonicClock().now() - lockedAt);
+
 #ifdef KJ_DEBUG
       // We lack a KJ_DASSERT_NONNULL because it would have to look a lot like KJ_IF_MAYBE, thus
       // we use a pragma around KJ_DEBUG here.
@@ -666,6 +829,15 @@ struct Worker::Isolate::Impl {
 
   private:
     const Impl& impl;
+    const Worker::Isolate& isolate;
+    bool synchronous;
+    kj::TimePoint waitStart;
+    kj::TimePoint lockedAt = kj::origin<kj::TimePoint>();
+
+    kj::Maybe<LongLockSampler::Hold> longLockHold;
+    kj::Maybe<kj::String> stackSample;
+    // Only used when the isolate has a long-lock threshold.
+
     IsolateObserver::LockRecord metrics;
     ThreadProgressCounter progressCounter;
     bool shouldReportIsolateMetrics = false;
@@ -673,6 +845,47 @@ struct Worker::Isolate::Impl {
 
     const IsolateLimitEnforcer& limitEnforcer;  // only so we can call getIsolateStats()
 
+    static void sampleLongLock(v8::Isolate* v8Isolate, void* data) {
+      // Interrupt requested by LongLockSampler. It may only run after the lock that asked for it
+      // has been released (if no more JavaScript ran in the meantime), so check that the current
+      // lock is itself over the threshold.
+      auto& impl = *reinterpret_cast<Impl*>(data);
+      KJ_IF_MAYBE(currentLock, impl.currentLock) {
+        KJ_IF_MAYBE(hold, currentLock->longLockHold) {
+          if (currentLock->stackSample == nullptr &&
+              kj::systemPreciseMonotonicClock().now() >= hold->deadline) {
+            currentLock->stackSample = sampleJsStack(v8Isolate);
+          }
+        }
+      }
+    }
+
+    void recordHold(kj::Duration holdTime) {
+      auto waitTime = lockedAt - waitStart;
+      __atomic_add_fetch(synchronous ? &impl.syncLockCount : &impl.asyncLockCount, 1,
+                         __ATOMIC_RELAXED);
+      __atomic_add_fetch(&impl.totalLockWaitNs, waitTime / kj::NANOSECONDS, __ATOMIC_RELAXED);
+      __atomic_add_fetch(&impl.totalLockHoldNs, holdTime / kj::NANOSECONDS, __ATOMIC_RELAXED);
+      // Only the lock holder writes `maxLockHoldNs`, so there's no need to compare-and-swap.
+      if (holdTime / kj::NANOSECONDS > __atomic_load_n(&impl.maxLockHoldNs, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&impl.maxLockHoldNs, holdTime / kj::NANOSECONDS, __ATOMIC_RELAXED);
+      }
+
+      impl.metrics.lockReleased(synchronous, waitTime, holdTime);
+
+      KJ_IF_MAYBE(threshold, impl.longLockThreshold) {
+        if (holdTime > *threshold) {
+          __atomic_add_fetch(&impl.longLockCount, 1, __ATOMIC_RELAXED);
+          kj::StringPtr stack = "(JavaScript wasn't interrupted in time to sample its stack)"_kj;
+          KJ_IF_MAYBE(s, stackSample) {
+            stack = *s;
+          }
+          KJ_LOG(WARNING, "isolate lock held for a long time", isolate.getId(),
+              synchronous ? "synchronous"_kj : "async"_kj, holdTime, waitTime, stack);
+        }
+      }
+    }
+
   public:
     kj::Own<jsg::Lock> lock;
   };
@@ -703,7 +916,7 @@ struct Worker::Isolate::Impl {
   Impl(const ApiIsolate& apiIsolate, IsolateObserver& metrics,
        IsolateLimitEnforcer& limitEnforcer, bool allowInspector)
       : metrics(metrics),
-        actorCacheLru(limitEnforcer.getActorCacheLruOptions()) {
+        actorCacheLru(makeActorCacheLruOptions(apiIsolate, limitEnforcer)) {
     auto lock = apiIsolate.lock();
     limitEnforcer.customizeIsolate(lock->v8Isolate);
 
@@ -713,6 +926,13 @@ struct Worker::Isolate::Impl {
       inspector = v8_inspector::V8Inspector::create(lock->v8Isolate, &inspectorClient);
     }
   }
+
+  static ActorCache::SharedLru::Options makeActorCacheLruOptions(
+      const ApiIsolate& apiIsolate, IsolateLimitEnforcer& limitEnforcer) {
+    auto options = limitEnforcer.getActorCacheLruOptions();
+    options.memoryCounter = apiIsolate.lock()->getExternalMemory().getCounter("ActorCache");
+    return options;
+  }
 };
 
 namespace {
@@ -743,12 +963,8 @@ static void startProfiling(v8::CpuProfiler& profiler, v8::Isolate* isolate) {
   profiler.StartProfiling(jsg::v8Str(isolate, PROFILE_NAME.cStr()), kj::mv(options));
 }
 
-static void stopProfiling(v8::CpuProfiler& profiler,v8::Isolate* isolate,
-    cdp::Command::Builder& cmd) {
-  v8::HandleScope handleScope(isolate);
-  auto cpuProfile = profiler.StopProfiling(jsg::v8Str(isolate, PROFILE_NAME.cStr()));
-  if (cpuProfile == nullptr) return; // profiling never started
-
+static void buildProfile(const v8::CpuProfile* cpuProfile,
+                         cdp::Profiler::Profile::Builder profile) {
   kj::Vector<const v8::CpuProfileNode*> allNodes;
   kj::Vector<const v8::CpuProfileNode*> unvisited;
 
@@ -762,8 +978,6 @@ static void stopProfiling(v8::CpuProfiler& profiler,v8::Isolate* isolate,
     }
   }
 
-  auto res = cmd.getProfilerStop().initResult();
-  auto profile = res.initProfile();
   profile.setStartTime(cpuProfile->GetStartTime());
   profile.setEndTime(cpuProfile->GetEndTime());
 
@@ -814,6 +1028,15 @@ static void stopProfiling(v8::CpuProfiler& profiler,v8::Isolate* isolate,
   }
 }
 
+static void stopProfiling(v8::CpuProfiler& profiler,v8::Isolate* isolate,
+    cdp::Command::Builder& cmd) {
+  v8::HandleScope handleScope(isolate);
+  auto cpuProfile = profiler.StopProfiling(jsg::v8Str(isolate, PROFILE_NAME.cStr()));
+  if (cpuProfile == nullptr) return; // profiling never started
+
+  buildProfile(cpuProfile, cmd.getProfilerStop().initResult().initProfile());
+}
+
 } // anonymous namespace
 
 struct Worker::Script::Impl {
@@ -973,13 +1196,15 @@ Worker::Isolate::Isolate(kj::Own<ApiIsolate> apiIsolateParam,
     : id(kj::str(id)),
       limitEnforcer(kj::mv(limitEnforcerParam)),
       apiIsolate(kj::mv(apiIsolateParam)),
-      featureFlagsForFl(makeCompatJson(decompileCompatibilityFlagsForFl(apiIsolate->getFeatureFlags()))),
+      featureFlagsForFl(makeCompatJson(
+          decompileCompatibilityFlagsForFl(apiIsolate->getFeatureFlags()))),
       metrics(kj::mv(metricsParam)),
       impl(kj::heap<Impl>(*apiIsolate, *metrics, *limitEnforcer, allowInspector)),
       weakIsolateRef(kj::atomicRefcounted<WeakIsolateRef>(this)) {
   metrics->created();
   // We just created our isolate, so we don't need to use Isolate::Impl::Lock (nor an async lock).
   auto lock = apiIsolate->lock();
+  metrics->externalMemoryTracked(lock->getExternalMemory());
   auto features = apiIsolate->getFeatureFlags();
 
   lock->setCaptureThrowsAsRejections(features.getCaptureThrowsAsRejections());
@@ -1132,12 +1357,12 @@ Worker::Script::Script(kj::Own<const Isolate> isolateParam, kj::StringPtr id,
           impl->globals = script.compileGlobals(lock, *isolate->apiIsolate);
 
           {
-            // It's unclear to me if CompileUnboundScript() can get trapped in any infinite loops or
-            // excessively-expensive computation requiring a time limit. We'll go ahead and apply a time
-            // limit just to be safe. Don't add it to the rollover bank, though.
+            // It's unclear to me if CompileUnboundScript() can get trapped in any infinite loops
+            // or excessively-expensive computation requiring a time limit. We'll go ahead and
+            // apply a time limit just to be safe. Don't add it to the rollover bank, though.
             auto limitScope = isolate->getLimitEnforcer().enterStartupJs(lock, maybeLimitError);
             impl->unboundScriptOrMainModule =
-                jsg::NonModuleScript::compile(script.mainScript, lock);
+                jsg::NonModuleScript::compile(script.mainScript, lock, script.codeCache);
           }
 
           break;
@@ -1336,12 +1561,14 @@ Worker::Worker(kj::Own<const Script> scriptParam,
 
       KJ_SWITCH_ONEOF(script->impl->unboundScriptOrMainModule) {
         KJ_CASE_ONEOF(unboundScript, jsg::NonModuleScript) {
-          auto limitScope = script->isolate->getLimitEnforcer().enterStartupJs(lock, maybeLimitError);
+          auto limitScope =
+              script->isolate->getLimitEnforcer().enterStartupJs(lock, maybeLimitError);
           unboundScript.run(lock.v8Isolate->GetCurrentContext());
         }
         KJ_CASE_ONEOF(mainModule, kj::Path) {
           // const_cast OK because we hold the lock.
-          auto& registry = KJ_ASSERT_NONNULL(const_cast<Script&>(*script).impl->getModuleRegistry());
+          auto& registry =
+              KJ_ASSERT_NONNULL(const_cast<Script&>(*script).impl->getModuleRegistry());
           KJ_IF_MAYBE(entry, registry.resolve(lock, mainModule)) {
             JSG_REQUIRE(entry->maybeSynthetic == nullptr, TypeError,
                         "Main module must be an ES module.");
@@ -1382,9 +1609,9 @@ Worker::Worker(kj::Own<const Script> scriptParam,
                   obj.ctx = jsg::alloc<api::ExecutionContext>();
 
                   if (handler.name == "default") {
-                    // The default export is given the string name "default". I guess that means that
-                    // you can't actually name an export "default"? Anyway, this is our default
-                    // handler.
+                    // The default export is given the string name "default". I guess that means
+                    // that you can't actually name an export "default"? Anyway, this is our
+                    // default handler.
                     impl->defaultHandler = kj::mv(obj);
                   } else {
                     impl->namedHandlers.insert(kj::mv(handler.name), kj::mv(obj));
@@ -1435,7 +1662,8 @@ Worker::~Worker() noexcept(false) {
   lock->push(kj::mv(impl));
 }
 
-void Worker::handleLog(jsg::Lock& js, LogLevel level, const v8::FunctionCallbackInfo<v8::Value>& info) {
+void Worker::handleLog(jsg::Lock& js, LogLevel level,
+                       const v8::FunctionCallbackInfo<v8::Value>& info) {
   // The TryCatch is initialised here to catch cases where the v8 isolate's execution is
   // terminating, usually as a result of an infinite loop. We need to perform the initialisation
   // here because `message` is called multiple times.
@@ -1462,8 +1690,9 @@ void Worker::handleLog(jsg::Lock& js, LogLevel level, const v8::FunctionCallback
       v8::HandleScope handleScope(js.v8Isolate);
       auto context = js.v8Isolate->GetCurrentContext();
       bool shouldSerialiseToJson = false;
-      if (arg->IsNull() || arg->IsNumber() || arg->IsArray() || arg->IsBoolean() || arg->IsString() ||
-          arg->IsUndefined()) { // This is special cased for backwards compatibility.
+      // This is special cased for backwards compatibility.
+      if (arg->IsNull() || arg->IsNumber() || arg->IsArray() || arg->IsBoolean() ||
+          arg->IsString() || arg->IsUndefined()) {
         shouldSerialiseToJson = true;
       }
       if (arg->IsObject()) {
@@ -1743,6 +1972,82 @@ void Worker::Lock::validateHandlers(ValidationErrorReporter& errorReporter) {
 // AsyncLock implementation
 
 thread_local Worker::AsyncWaiter* Worker::AsyncWaiter::threadCurrentWaiter = nullptr;
+thread_local Worker::AsyncWaiter::ReleaseWaiterList Worker::AsyncWaiter::threadReleaseWaiters;
+
+struct Worker::AsyncWaiter::ReleaseWaiter {
+  // One entry in `threadReleaseWaiters`. Lives in the frame of the waiting coroutine, or is
+  // attached to the `whenThreadIdle()` promise.
+
+  const Isolate* isolate;
+  // The isolate the waiting attempt wants to lock, or null for `whenThreadIdle()`.
+
+  kj::Own<kj::PromiseFulfiller<void>> fulfiller;
+  ReleaseWaiter* prev = nullptr;
+  ReleaseWaiter* next = nullptr;
+
+  bool woken = false;
+  bool resumed = false;
+  // `woken` is set when the entry is unlinked and fulfilled, `resumed` once the waiting
+  // coroutine actually runs again.
+
+  ReleaseWaiter(const Isolate* isolate, kj::Own<kj::PromiseFulfiller<void>> fulfiller,
+                bool atFront = false)
+      : isolate(isolate), fulfiller(kj::mv(fulfiller)) {
+    auto& list = threadReleaseWaiters;
+    if (atFront) {
+      next = list.head;
+      (next == nullptr ? list.tail : next->prev) = this;
+      list.head = this;
+    } else {
+      prev = list.tail;
+      (prev == nullptr ? list.head : prev->next) = this;
+      list.tail = this;
+    }
+  }
+
+  ~ReleaseWaiter() noexcept {
+    if (!woken) {
+      unlink();
+    } else if (!resumed && isolate != nullptr && threadCurrentWaiter == nullptr) {
+      // We were woken to take the thread's next lock, but were canceled before we got to. Pass
+      // the turn on, or the rest of the queue would sleep forever.
+      wakeReleaseWaiters();
+    }
+  }
+
+  KJ_DISALLOW_COPY_AND_MOVE(ReleaseWaiter);
+
+  void unlink() {
+    auto& list = threadReleaseWaiters;
+    (prev == nullptr ? list.head : prev->next) = next;
+    (next == nullptr ? list.tail : next->prev) = prev;
+    prev = nullptr;
+    next = nullptr;
+  }
+
+  void wake() {
+    unlink();
+    woken = true;
+    fulfiller->fulfill();
+  }
+};
+
+void Worker::AsyncWaiter::wakeReleaseWaiters() {
+  const Isolate* nextIsolate = nullptr;
+  for (auto w = threadReleaseWaiters.head; w != nullptr;) {
+    auto& waiter = *w;
+    w = waiter.next;
+
+    if (waiter.isolate != nullptr) {
+      if (nextIsolate == nullptr) {
+        nextIsolate = waiter.isolate;
+      } else if (waiter.isolate != nextIsolate) {
+        continue;
+      }
+    }
+    waiter.wake();
+  }
+}
 
 Worker::Isolate::AsyncWaiterList::~AsyncWaiterList() noexcept {
   // It should be impossible for this list to be non-empty since each member of the list holds a
@@ -1759,18 +2064,25 @@ kj::Promise<Worker::AsyncLock> Worker::Isolate::takeAsyncLockWithoutRequest(
 }
 
 kj::Promise<Worker::AsyncLock> Worker::Isolate::takeAsyncLock(
-    RequestObserver& request) const {
+    RequestObserver& request, AsyncLockPriority priority) const {
   auto lockTiming = getMetrics().tryCreateLockTiming(kj::Maybe<RequestObserver&>(request));
-  return takeAsyncLockImpl(kj::mv(lockTiming));
+  return takeAsyncLockImpl(kj::mv(lockTiming), priority);
 }
 
 kj::Promise<Worker::AsyncLock> Worker::Isolate::takeAsyncLockImpl(
-    kj::Maybe<kj::Own<IsolateObserver::LockTiming>> lockTiming) const {
+    kj::Maybe<kj::Own<IsolateObserver::LockTiming>> lockTiming,
+    AsyncLockPriority priority) const {
   kj::Maybe<uint> currentLoad;
   if (lockTiming != nullptr) {
     currentLoad = getCurrentLoad();
   }
 
+  auto queuedAt = kj::systemPreciseMonotonicClock().now();
+  auto reportQueued = [&]() {
+    getMetrics().asyncLockQueued(priority, kj::systemPreciseMonotonicClock().now() - queuedAt);
+  };
+
+  bool retrying = false;
   for (uint threadWaitingDifferentLockCount = 0; ; ++threadWaitingDifferentLockCount) {
     AsyncWaiter* waiter = AsyncWaiter::threadCurrentWaiter;
 
@@ -1781,8 +2093,10 @@ kj::Promise<Worker::AsyncLock> Worker::Isolate::takeAsyncLockImpl(
             KJ_ASSERT_NONNULL(currentLoad), false /* threadWaitingSameLock */,
             threadWaitingDifferentLockCount);
       }
-      auto newWaiter = kj::refcounted<AsyncWaiter>(kj::atomicAddRef(*this));
+      auto newWaiter = kj::refcounted<AsyncWaiter>(kj::atomicAddRef(*this), priority);
       co_await newWaiter->readyPromise.addBranch();
+      co_await newWaiter->takeTurn(AsyncWaiter::rank(queuedAt, priority));
+      reportQueued();
       co_return AsyncLock(kj::mv(newWaiter), kj::mv(lockTiming));
     } else if (waiter->isolate == this) {
       // Thread is waiting on a lock already, and it's for the same isolate. We can coalesce the
@@ -1793,17 +2107,33 @@ kj::Promise<Worker::AsyncLock> Worker::Isolate::takeAsyncLockImpl(
             threadWaitingDifferentLockCount);
       }
       auto newWaiterRef = kj::addRef(*waiter);
+      {
+        // Our work is now waiting in the queue under this waiter, so it should be at least as
+        // urgent as we are.
+        auto lock = asyncWaiters.lockExclusive();
+        if (priority < waiter->priority) {
+          waiter->priority = priority;
+        }
+      }
       co_await newWaiterRef->readyPromise.addBranch();
+      co_await newWaiterRef->takeTurn(AsyncWaiter::rank(queuedAt, priority));
+      reportQueued();
       co_return AsyncLock(kj::mv(newWaiterRef), kj::mv(lockTiming));
     } else {
       // Thread is already waiting for or holding a different isolate lock. Wait for that one to
-      // be released before we try to lock a different isolate.
-      // TODO(perf): Use of ForkedPromise leads to thundering herd here. Should be minor in practice,
-      //   but we could consider creating another linked list instead...
+      // be released before we try to lock a different isolate. If we were already woken once
+      // and lost the race, we keep our place at the front of the line.
       KJ_IF_MAYBE(lt, lockTiming) {
         lt->get()->waitingForOtherIsolate(waiter->isolate->getId());
       }
-      co_await waiter->releasePromise.addBranch();
+      auto paf = kj::newPromiseAndFulfiller<void>();
+      AsyncWaiter::ReleaseWaiter releaseWaiter(this, kj::mv(paf.fulfiller), retrying);
+      co_await paf.promise;
+      releaseWaiter.resumed = true;
+
+      auto current = AsyncWaiter::threadCurrentWaiter;
+      retrying = current != nullptr && current->isolate != this;
+      getMetrics().crossIsolateLockWakeup(retrying);
     }
   }
 }
@@ -1812,20 +2142,16 @@ kj::Promise<Worker::AsyncLock> Worker::takeAsyncLockWithoutRequest(SpanParent pa
   return script->getIsolate().takeAsyncLockWithoutRequest(kj::mv(parentSpan));
 }
 
-kj::Promise<Worker::AsyncLock> Worker::takeAsyncLock(RequestObserver& request) const {
-  return script->getIsolate().takeAsyncLock(request);
+kj::Promise<Worker::AsyncLock> Worker::takeAsyncLock(
+    RequestObserver& request, AsyncLockPriority priority) const {
+  return script->getIsolate().takeAsyncLock(request, priority);
 }
 
-Worker::AsyncWaiter::AsyncWaiter(kj::Own<const Isolate> isolateParam)
+Worker::AsyncWaiter::AsyncWaiter(kj::Own<const Isolate> isolateParam, AsyncLockPriority priority)
     : executor(kj::getCurrentThreadExecutor()),
-      isolate(kj::mv(isolateParam)) {
-  // Init `releasePromise` / `releaseFulfiller`.
-  {
-    auto paf = kj::newPromiseAndFulfiller<void>();
-    releasePromise = paf.promise.fork();
-    releaseFulfiller = kj::mv(paf.fulfiller);
-  }
-
+      isolate(kj::mv(isolateParam)),
+      priority(priority),
+      queuedAt(kj::systemPreciseMonotonicClock().now()) {
   // Add ourselves to the wait queue for this isolate.
   auto lock = isolate->asyncWaiters.lockExclusive();
   if (lock->tail == &lock->head) {
@@ -1855,34 +2181,88 @@ Worker::AsyncWaiter::~AsyncWaiter() noexcept {
 
   __atomic_sub_fetch(&isolate->impl->lockAttemptGauge, 1, __ATOMIC_RELAXED);
 
-  auto lock = isolate->asyncWaiters.lockExclusive();
+  {
+    auto lock = isolate->asyncWaiters.lockExclusive();
 
-  releaseFulfiller->fulfill();
+    // Remove ourselves from the list.
+    *prev = next;
+    KJ_IF_MAYBE(n, next) {
+      n->prev = prev;
+    } else {
+      lock->tail = prev;
+    }
 
-  // Remove ourselves from the list.
-  *prev = next;
-  KJ_IF_MAYBE(n, next) {
-    n->prev = prev;
-  } else {
-    lock->tail = prev;
-  }
+    if (prev == &lock->head) {
+      // We held the lock before now. Pick the most urgent of the remaining waiters, move it to the
+      // front of the line, and alert it that it holds the lock. Ties go to the earliest arrival.
+      AsyncWaiter* best = nullptr;
+      for (auto w = lock->head; w != nullptr;) {
+        auto& waiter = KJ_ASSERT_NONNULL(w);
+        if (best == nullptr || waiter.rank() < best->rank()) {
+          best = &waiter;
+        }
+        w = waiter.next;
+      }
 
-  if (prev == &lock->head) {
-    // We held the lock before now. Alert the next waiter that they are now at the front of the
-    // line.
-    KJ_IF_MAYBE(n, next) {
-      n->readyFulfiller->fulfill();
+      if (best != nullptr) {
+        if (best->prev != &lock->head) {
+          // Unlink...
+          *best->prev = best->next;
+          KJ_IF_MAYBE(n, best->next) {
+            n->prev = best->prev;
+          } else {
+            lock->tail = best->prev;
+          }
+
+          // ...and relink at the head. The list is non-empty, since `best` wasn't at its head.
+          auto& oldHead = KJ_ASSERT_NONNULL(lock->head);
+          best->next = oldHead;
+          oldHead.prev = &best->next;
+          best->prev = &lock->head;
+          lock->head = *best;
+        }
+
+        best->readyFulfiller->fulfill();
+      }
     }
   }
 
   KJ_ASSERT(threadCurrentWaiter == this);
   threadCurrentWaiter = nullptr;
+
+  wakeReleaseWaiters();
+}
+
+kj::Promise<void> Worker::AsyncWaiter::takeTurn(kj::TimePoint rank) {
+  auto paf = kj::newPromiseAndFulfiller<void>();
+  turns.add(Turn { rank, kj::mv(paf.fulfiller) });
+
+  if (!handOutTurnsScheduled) {
+    handOutTurnsScheduled = true;
+    handOutTurnsTask = kj::evalLast([this]() {
+      handOutTurnsScheduled = false;
+      auto batch = kj::mv(turns);
+      turns = kj::Vector<Turn>();
+      std::stable_sort(batch.begin(), batch.end(), [](const Turn& a, const Turn& b) {
+        return a.rank < b.rank;
+      });
+      // Fulfilling queues each attempt's continuation, so they run in this order. Attempts that
+      // were canceled meanwhile are skipped.
+      for (auto& turn: batch) {
+        turn.fulfiller->fulfill();
+      }
+    }).eagerlyEvaluate(nullptr);
+  }
+
+  return kj::mv(paf.promise);
 }
 
 kj::Promise<void> Worker::AsyncLock::whenThreadIdle() {
   auto waiter = AsyncWaiter::threadCurrentWaiter;
   if (waiter != nullptr) {
-    return waiter->releasePromise.addBranch().then([]() { return whenThreadIdle(); });
+    auto paf = kj::newPromiseAndFulfiller<void>();
+    auto releaseWaiter = kj::heap<AsyncWaiter::ReleaseWaiter>(nullptr, kj::mv(paf.fulfiller));
+    return paf.promise.attach(kj::mv(releaseWaiter)).then([]() { return whenThreadIdle(); });
   }
 
   return kj::evalLast([]() -> kj::Promise<void> {
@@ -2440,6 +2820,158 @@ kj::Promise<void> Worker::Isolate::attachInspector(
       .attach(kj::mv(channel));
 }
 
+kj::Promise<kj::String> Worker::Isolate::takeCpuProfile(
+    kj::Timer& timer, kj::Duration duration, kj::Duration samplingInterval) const {
+  // Each call gets a profiler of its own, so that it doesn't disturb an inspector's profile, or
+  // another call's.
+  auto self = kj::atomicAddRef(*this);
+  v8::CpuProfiler* profiler;
+  {
+    Isolate::Impl::Lock recordedLock(*self, Worker::Lock::TakeSynchronously(nullptr));
+    auto& lock = *recordedLock.lock;
+    profiler = v8::CpuProfiler::New(lock.v8Isolate, v8::kDebugNaming, v8::kLazyLogging);
+    setSamplingInterval(*profiler, samplingInterval / kj::MICROSECONDS);
+    startProfiling(*profiler, lock.v8Isolate);
+  }
+  KJ_DEFER({
+    // Also runs if the caller gives up on the profile early.
+    Isolate::Impl::Lock recordedLock(*self, Worker::Lock::TakeSynchronously(nullptr));
+    profiler->Dispose();
+  });
+
+  co_await timer.afterDelay(duration);
+
+  capnp::MallocMessageBuilder message;
+  auto profile = message.initRoot<cdp::Profiler::Profile>();
+  {
+    Isolate::Impl::Lock recordedLock(*self, Worker::Lock::TakeSynchronously(nullptr));
+    auto& lock = *recordedLock.lock;
+    v8::HandleScope handleScope(lock.v8Isolate);
+    auto cpuProfile = profiler->StopProfiling(jsg::v8Str(lock.v8Isolate, PROFILE_NAME.cStr()));
+    KJ_ASSERT(cpuProfile != nullptr);
+    KJ_DEFER(cpuProfile->Delete());
+    buildProfile(cpuProfile, profile);
+  }
+  co_return getCdpJsonCodec().encode(profile);
+}
+
+namespace {
+
+class HeapSnapshotPipe {
+  // Hands a heap snapshot's JSON from the thread serializing it to the thread writing it out,
+  // one chunk at a time. The serializing thread waits for each chunk to be taken before it
+  // produces the next.
+
+public:
+  bool put(kj::ArrayPtr<const char> chunk) {
+    // Called on the serializing thread. Returns false if the reader has gone away.
+    return state.when([](const State& s) { return s.chunk == nullptr || s.canceled; },
+        [&](State& s) {
+      if (s.canceled) return false;
+      s.chunk = kj::heapArray(chunk);
+      wakeReader(s);
+      return true;
+    });
+  }
+
+  void end() {
+    // Called on the serializing thread once the last chunk has been put.
+    auto lock = state.lockExclusive();
+    lock->done = true;
+    wakeReader(*lock);
+  }
+
+  kj::Promise<kj::Maybe<kj::Array<char>>> take() {
+    // Called on the writing thread. Resolves to the next chunk, or null once there are no more.
+    auto lock = state.lockExclusive();
+    KJ_IF_MAYBE(chunk, lock->chunk) {
+      kj::Maybe<kj::Array<char>> result = kj::mv(*chunk);
+      lock->chunk = nullptr;
+      return kj::mv(result);
+    }
+    if (lock->done) {
+      return kj::Maybe<kj::Array<char>>(nullptr);
+    }
+    auto paf = kj::newPromiseAndCrossThreadFulfiller<void>();
+    lock->readerWaiting = kj::mv(paf.fulfiller);
+    return paf.promise.then([this]() { return take(); });
+  }
+
+  void cancel() {
+    // Called on the writing thread if it gives up. The serializing thread stops at its next chunk.
+    state.lockExclusive()->canceled = true;
+  }
+
+private:
+  struct State {
+    kj::Maybe<kj::Array<char>> chunk;
+    bool done = false;
+    bool canceled = false;
+    kj::Maybe<kj::Own<kj::CrossThreadPromiseFulfiller<void>>> readerWaiting;
+  };
+  kj::MutexGuarded<State> state;
+
+  static void wakeReader(State& s) {
+    KJ_IF_MAYBE(fulfiller, s.readerWaiting) {
+      (*fulfiller)->fulfill();
+      s.readerWaiting = nullptr;
+    }
+  }
+};
+
+}  // namespace
+
+kj::Promise<void> Worker::Isolate::writeHeapSnapshot(kj::AsyncOutputStream& out) const {
+  struct Writer: public v8::OutputStream {
+    HeapSnapshotPipe& pipe;
+
+    Writer(HeapSnapshotPipe& pipe): pipe(pipe) {}
+    void EndOfStream() override {}
+
+    int GetChunkSize() override {
+      return 65536;  // as for the inspector's snapshots
+    }
+
+    v8::OutputStream::WriteResult WriteAsciiChunk(char* data, int size) override {
+      return pipe.put(kj::arrayPtr(data, size))
+          ? v8::OutputStream::WriteResult::kContinue
+          : v8::OutputStream::WriteResult::kAbort;
+    }
+  };
+
+  auto self = kj::atomicAddRef(*this);
+  std::unique_ptr<const v8::HeapSnapshot> snapshot;
+  {
+    Isolate::Impl::Lock recordedLock(*self, Worker::Lock::TakeSynchronously(nullptr));
+    auto& lock = *recordedLock.lock;
+    v8::HandleScope handleScope(lock.v8Isolate);
+    snapshot.reset(lock.v8Isolate->GetHeapProfiler()->TakeHeapSnapshot(
+        nullptr, nullptr, false, false));
+  }
+  KJ_DEFER({
+    Isolate::Impl::Lock recordedLock(*self, Worker::Lock::TakeSynchronously(nullptr));
+    snapshot = nullptr;
+  });
+
+  // The snapshot is a copy of the heap graph, so serializing it doesn't need the isolate, which
+  // goes on serving requests meanwhile.
+  HeapSnapshotPipe pipe;
+  kj::Thread thread([&]() {
+    Writer writer(pipe);
+    snapshot->Serialize(&writer);
+    pipe.end();
+  });
+  KJ_DEFER(pipe.cancel());  // before the thread is joined, in case we're canceled
+
+  for (;;) {
+    KJ_IF_MAYBE(chunk, co_await pipe.take()) {
+      co_await out.write(chunk->begin(), chunk->size());
+    } else {
+      break;
+    }
+  }
+}
+
 void Worker::Isolate::disconnectInspector() {
   // If an inspector session is connected, proactively drop it, so as to force it to drop its
   // reference on the script, so that the script can be deleted.
@@ -2544,7 +3076,7 @@ struct Worker::Actor::Impl final: public kj::TaskSet::ErrorHandler {
   // If the actor is backed by a class, this field tracks the instance through its stages. The
   // instance is constructed as part of the first request to be delivered.
 
-  class HooksImpl: public InputGate::Hooks, public OutputGate::Hooks {
+  class HooksImpl: public InputGate::Hooks, public OutputGate::Hooks, public ActorCache::Hooks {
   public:
     HooksImpl(TimerChannel& timerChannel, ActorObserver& metrics)
         : timerChannel(timerChannel), metrics(metrics) {}
@@ -2570,6 +3102,13 @@ struct Worker::Actor::Impl final: public kj::TaskSet::ErrorHandler {
     void outputGateWaiterRemoved() override { metrics.outputGateWaiterRemoved(); }
     // Implements OutputGate::Hooks.
 
+    void storageFlushStarted(size_t dirtyBytes) override {
+      metrics.storageFlushStarted(dirtyBytes);
+    }
+    void storageBatchSent(size_t bytes) override { metrics.storageBatchSent(bytes); }
+    void entryEvicted() override { metrics.storageCacheEntryEvicted(); }
+    // Implements ActorCache::Hooks.
+
   private:
     TimerChannel& timerChannel;    // only for afterLimitTimeout()
     ActorObserver& metrics;
@@ -2620,6 +3159,7 @@ struct Worker::Actor::Impl final: public kj::TaskSet::ErrorHandler {
        bool hasTransient, kj::Maybe<rpc::ActorStorage::Stage::Client> persistent,
        MakeStorageFunc makeStorage, TimerChannel& timerChannel,
        kj::Own<ActorObserver> metricsParam,
+       kj::Maybe<const ActorCache::SharedLru&> actorCacheLru,
        kj::PromiseFulfillerPair<void> paf = kj::newPromiseAndFulfiller<void>())
       : actorId(kj::mv(actorId)), makeStorage(kj::mv(makeStorage)),
         metrics(kj::mv(metricsParam)),
@@ -2636,8 +3176,8 @@ struct Worker::Actor::Impl final: public kj::TaskSet::ErrorHandler {
     }
 
     KJ_IF_MAYBE(p, persistent) {
-      actorCache.emplace(kj::mv(*p), self.worker->getIsolate().impl->actorCacheLru,
-                         outputGate);
+      auto& lru = actorCacheLru.orDefault(self.worker->getIsolate().impl->actorCacheLru);
+      actorCache.emplace(kj::mv(*p), lru, outputGate, hooks);
     }
   }
 
@@ -2647,7 +3187,7 @@ struct Worker::Actor::Impl final: public kj::TaskSet::ErrorHandler {
 };
 
 kj::Promise<Worker::AsyncLock> Worker::takeAsyncLockWhenActorCacheReady(
-    kj::Date now, Actor& actor, RequestObserver& request) const {
+    kj::Date now, Actor& actor, RequestObserver& request, AsyncLockPriority priority) const {
   auto lockTiming = getIsolate().getMetrics()
       .tryCreateLockTiming(kj::Maybe<RequestObserver&>(request));
 
@@ -2655,24 +3195,28 @@ kj::Promise<Worker::AsyncLock> Worker::takeAsyncLockWhenActorCacheReady(
     KJ_IF_MAYBE(p, c->evictStale(now)) {
       // Got backpressure, wait for it.
       // TODO(someday): Count this time period differently in lock timing data?
-      return p->then([this, lockTiming = kj::mv(lockTiming)]() mutable {
-        return getIsolate().takeAsyncLockImpl(kj::mv(lockTiming));
+      return p->then([this, lockTiming = kj::mv(lockTiming), priority]() mutable {
+        return getIsolate().takeAsyncLockImpl(kj::mv(lockTiming), priority);
       });
     }
   }
 
-  return getIsolate().takeAsyncLockImpl(kj::mv(lockTiming));
+  return getIsolate().takeAsyncLockImpl(kj::mv(lockTiming), priority);
 }
 
 Worker::Actor::Actor(const Worker& worker, Actor::Id actorId,
     bool hasTransient, kj::Maybe<rpc::ActorStorage::Stage::Client> persistent,
     kj::Maybe<kj::StringPtr> className, MakeStorageFunc makeStorage, LockType lockType,
     TimerChannel& timerChannel,
-    kj::Own<ActorObserver> metrics)
-    : worker(kj::atomicAddRef(worker)) {
+    kj::Own<ActorObserver> metrics,
+    kj::Maybe<const ActorCacheSharedLru&> actorCacheLru,
+    kj::Maybe<kj::Own<HibernationManager>> hibernationManager,
+    kj::Maybe<MakeHibernationManagerFunc> makeHibernationManager)
+    : worker(kj::atomicAddRef(worker)), hibernationManager(kj::mv(hibernationManager)),
+      makeHibernationManager(kj::mv(makeHibernationManager)) {
   Worker::Lock lock(worker, lockType);
   impl = kj::heap<Impl>(*this, lock, kj::mv(actorId), hasTransient, kj::mv(persistent),
-                        kj::mv(makeStorage), timerChannel, kj::mv(metrics));
+                        kj::mv(makeStorage), timerChannel, kj::mv(metrics), actorCacheLru);
 
   KJ_IF_MAYBE(c, className) {
     KJ_IF_MAYBE(cls, lock.getWorker().impl->actorClasses.find(*c)) {
@@ -2742,6 +3286,11 @@ Worker::Actor::~Actor() noexcept(false) {
   //   namespace and hence would be locking the same isolate anyway -- it's not like one of the
   //   other actors could be running while we wait for this lock.
   Worker::Lock lock(*worker, Worker::Lock::TakeSynchronously(nullptr));
+  KJ_IF_MAYBE(m, hibernationManager) {
+    // The manager outlives this instance of the actor, so it must let go of the JavaScript objects
+    // it holds for us while we have the lock.
+    m->get()->dropJsObjects(lock);
+  }
   impl = nullptr;
 }
 
@@ -3024,6 +3573,21 @@ ActorObserver& Worker::Actor::getMetrics() {
   return *impl->metrics;
 }
 
+kj::Maybe<HibernationManager&> Worker::Actor::getHibernationManager() {
+  return hibernationManager.map([](kj::Own<HibernationManager>& m) -> HibernationManager& {
+    return *m;
+  });
+}
+
+kj::Maybe<HibernationManager&> Worker::Actor::getOrCreateHibernationManager() {
+  if (hibernationManager == nullptr) {
+    KJ_IF_MAYBE(make, makeHibernationManager) {
+      hibernationManager = (*make)();
+    }
+  }
+  return getHibernationManager();
+}
+
 InputGate& Worker::Actor::getInputGate() {
   return impl->inputGate;
 }
@@ -3058,6 +3622,22 @@ uint Worker::Isolate::getCurrentLoad() const {
   return __atomic_load_n(&impl->lockAttemptGauge, __ATOMIC_RELAXED);
 }
 
+Worker::Isolate::LockStats Worker::Isolate::getLockStats() const {
+  auto load = [](const auto& field) { return __atomic_load_n(&field, __ATOMIC_RELAXED); };
+  return LockStats {
+    .syncLocks = load(impl->syncLockCount),
+    .asyncLocks = load(impl->asyncLockCount),
+    .totalWait = load(impl->totalLockWaitNs) * kj::NANOSECONDS,
+    .totalHold = load(impl->totalLockHoldNs) * kj::NANOSECONDS,
+    .maxHold = load(impl->maxLockHoldNs) * kj::NANOSECONDS,
+    .longHolds = load(impl->longLockCount),
+  };
+}
+
+void Worker::Isolate::setLongLockThreshold(kj::Duration threshold) {
+  impl->longLockThreshold = threshold;
+}
+
 uint Worker::Isolate::getLockSuccessCount() const {
   return __atomic_load_n(&impl->lockSuccessCount, __ATOMIC_RELAXED);
 }
@@ -14,6 +14,7 @@
 #include <workerd/jsg/jsg.h>
 #include <kj/mutex.h>
 #include "io-channels.h"
+#include "hibernation-manager.h"
 #include <workerd/io/actor-storage.capnp.h>
 
 namespace v8 { class Isolate; }
@@ -36,6 +37,7 @@ namespace api {
 
 class IoContext;
 class ActorCache;
+class ActorCacheSharedLru;
 class InputGate;
 class OutputGate;
 
@@ -95,19 +97,25 @@ public:
 
   class AsyncLock;
   kj::Promise<AsyncLock> takeAsyncLockWithoutRequest(SpanParent parentSpan) const;
-  kj::Promise<AsyncLock> takeAsyncLock(RequestObserver& request) const;
+  kj::Promise<AsyncLock> takeAsyncLock(RequestObserver& request,
+      AsyncLockPriority priority = AsyncLockPriority::FETCH) const;
   // Places this thread into the queue of threads which are interested in locking this isolate,
   // and returns when it is this thread's turn. The thread must still obtain a `Worker::Lock`, but
   // by obtaining an `AsyncLock` first, the thread ensures that it is not fighting over the lock
   // with many other threads, and all interested threads get their fair turn.
   //
+  // Turns are handed out by `priority` (see AsyncLockPriority), and then in order of arrival. If
+  // the thread is already waiting on this isolate for something less urgent, its place in the
+  // queue is upgraded to `priority`. The attempts that share the thread's place are themselves
+  // resumed in order of priority once it comes up.
+  //
   // The version accepting a `request` metrics object accumulates lock timing data and reports the
   // data via `request`'s trace span.
 
   class Actor;
 
   kj::Promise<AsyncLock> takeAsyncLockWhenActorCacheReady(kj::Date now, Actor& actor,
-      RequestObserver& request) const;
+      RequestObserver& request, AsyncLockPriority priority = AsyncLockPriority::FETCH) const;
   // Like takeAsyncLock(), but also takes care of actor cache time-based eviction and backpressure.
 
   class WarnAboutIsolateLockScope {
@@ -189,6 +197,9 @@ public:
     kj::Function<kj::Array<CompiledGlobal>(jsg::Lock& lock, const ApiIsolate& apiIsolate)>
         compileGlobals;
     // Callback which will compile the script-level globals, returning a list of them.
+
+    kj::Maybe<const jsg::CodeCache&> codeCache = nullptr;
+    // Code cache to consult when compiling `mainScript`, if any.
   };
   struct ModulesSource {
     kj::StringPtr mainModule;
@@ -265,6 +276,25 @@ public:
   uint getLockSuccessCount() const;
   // Returns a count that is incremented upon every successful lock.
 
+  struct LockStats {
+    uint64_t syncLocks = 0;
+    uint64_t asyncLocks = 0;
+    kj::Duration totalWait = 0 * kj::NANOSECONDS;
+    kj::Duration totalHold = 0 * kj::NANOSECONDS;
+    kj::Duration maxHold = 0 * kj::NANOSECONDS;
+    uint64_t longHolds = 0;
+    // Locks held for longer than the long-lock threshold, if one is set.
+  };
+  LockStats getLockStats() const;
+  // Totals over every `Worker::Lock` taken on this isolate so far. Can be called from any thread;
+  // the fields are read individually, so they may be very slightly inconsistent with each other.
+
+  void setLongLockThreshold(kj::Duration threshold);
+  // Logs a warning, with a sample of the JavaScript stack, whenever this isolate's lock is held
+  // for longer than `threshold`. The sample is taken by interrupting the JavaScript once the
+  // threshold passes, so it shows what was running at that point. Call before the isolate is
+  // first locked.
+
   kj::Promise<void> attachInspector(
       kj::Timer& timer,
       kj::Duration timerOffset,
@@ -278,6 +308,19 @@ public:
       kj::Duration timerOffset,
       kj::WebSocket& webSocket) const;
 
+  kj::Promise<kj::String> takeCpuProfile(
+      kj::Timer& timer, kj::Duration duration, kj::Duration samplingInterval) const;
+  // Runs V8's sampling CPU profiler on this isolate for `duration`, and returns the profile as a
+  // `.cpuprofile` JSON document, as DevTools would save it. The sampler runs on a thread of its
+  // own, so the isolate is only locked to start and stop it, and goes on serving requests
+  // meanwhile. Works whether or not an inspector is attached.
+
+  kj::Promise<void> writeHeapSnapshot(kj::AsyncOutputStream& out) const;
+  // Takes a heap snapshot and writes it to `out` as `.heapsnapshot` JSON. The isolate is locked
+  // only to take and delete the snapshot. The JSON is produced on a thread of its own, which waits
+  // for each 64KiB chunk to be written before it produces the next, so only a chunk or two is
+  // ever buffered, however large the snapshot. (The snapshot itself is held in memory throughout.)
+
   void logWarning(kj::StringPtr description, Worker::Lock& lock);
   void logWarningOnce(kj::StringPtr description, Worker::Lock& lock);
   // Log a warning to the inspector if attached, and log an INFO severity message. logWarningOnce()
@@ -300,9 +343,13 @@ public:
   // Called after each completed request. Does not require a lock.
 
   kj::Promise<AsyncLock> takeAsyncLockWithoutRequest(SpanParent parentSpan) const;
-  kj::Promise<AsyncLock> takeAsyncLock(RequestObserver&) const;
+  kj::Promise<AsyncLock> takeAsyncLock(RequestObserver&,
+      AsyncLockPriority priority = AsyncLockPriority::FETCH) const;
   // See Worker::takeAsyncLock().
 
+  static constexpr kj::Duration ASYNC_LOCK_AGING_INTERVAL = 10 * kj::MILLISECONDS;
+  // How long a waiter for the AsyncLock must wait to be promoted by one AsyncLockPriority class.
+
   bool isInspectorEnabled() const;
 
   class WeakIsolateRef: public kj::AtomicRefcounted {
@@ -351,7 +398,8 @@ public:
 
 private:
   kj::Promise<AsyncLock> takeAsyncLockImpl(
-      kj::Maybe<kj::Own<IsolateObserver::LockTiming>> lockTiming) const;
+      kj::Maybe<kj::Own<IsolateObserver::LockTiming>> lockTiming,
+      AsyncLockPriority priority = AsyncLockPriority::FETCH) const;
 
   kj::String id;
   kj::Own<IsolateLimitEnforcer> limitEnforcer;
@@ -384,9 +432,11 @@ private:
     ~AsyncWaiterList() noexcept;
   };
   kj::MutexGuarded<AsyncWaiterList> asyncWaiters;
-  // Mutex-guarded linked list of threads waiting for an async lock on this worker. The lock
-  // protects the `AsyncWaiterList` as well as the next/prev pointers in each `AsyncWaiter` that
-  // is currently in the list.
+  // Mutex-guarded linked list of threads waiting for an async lock on this worker. The head of
+  // the list holds the lock; the rest are in order of arrival, but the lock is handed to the most
+  // urgent of them (see `AsyncWaiter::rank()`), which is first moved to the head. The lock
+  // protects the `AsyncWaiterList` as well as the next/prev pointers and priority of each
+  // `AsyncWaiter` that is currently in the list.
   //
   // TODO(perf): Use a lock-free list? Tricky to get right. `asyncWaiters` should only be locked
   //   briefly so there's probably not that much to gain.
@@ -622,14 +672,27 @@ public:
   using MakeStorageFunc = kj::Function<jsg::Ref<api::DurableObjectStorage>(
       jsg::Lock& js, const ApiIsolate& apiIsolate, ActorCache& actorCache)>;
 
+  using MakeHibernationManagerFunc = kj::Function<kj::Own<HibernationManager>()>;
+
   using Id = kj::OneOf<kj::Own<ActorIdFactory::ActorId>, kj::String>;
 
   Actor(const Worker& worker, Id actorId,
         bool hasTransient, kj::Maybe<rpc::ActorStorage::Stage::Client> persistent,
         kj::Maybe<kj::StringPtr> className, MakeStorageFunc makeStorage, LockType lockType,
-        TimerChannel& timerChannel, kj::Own<ActorObserver> metrics);
+        TimerChannel& timerChannel, kj::Own<ActorObserver> metrics,
+        kj::Maybe<const ActorCacheSharedLru&> actorCacheLru = nullptr,
+        kj::Maybe<kj::Own<HibernationManager>> hibernationManager = nullptr,
+        kj::Maybe<MakeHibernationManagerFunc> makeHibernationManager = nullptr);
   // Create a new Actor hosted by this Worker. Note that this Actor object may only be manipulated
   // from the thread that created it.
+  //
+  // The `persistent` storage is cached in `actorCacheLru`, if given, which must outlive the Actor.
+  // By default, the isolate's LRU is used.
+  //
+  // `hibernationManager`, if given, holds the actor ID's hibernatable WebSockets. It is shared by
+  // every instance of the actor created for that ID, so sockets stay connected across instances.
+  // If there isn't one yet, `makeHibernationManager` is called to get one the first time the
+  // actor calls `state.acceptWebSocket()`, so that actors which never do don't pay for one.
 
   ~Actor() noexcept(false);
 
@@ -673,6 +736,13 @@ public:
 
   ActorObserver& getMetrics();
 
+  kj::Maybe<HibernationManager&> getHibernationManager();
+  // Returns null if no hibernatable WebSocket has been accepted for this actor's ID yet.
+
+  kj::Maybe<HibernationManager&> getOrCreateHibernationManager();
+  // Like getHibernationManager(), but creates the manager if there isn't one yet. Returns null if
+  // this actor doesn't support `state.acceptWebSocket()`.
+
   InputGate& getInputGate();
   OutputGate& getOutputGate();
 
@@ -701,6 +771,10 @@ public:
 
 private:
   kj::Own<const Worker> worker;
+  kj::Maybe<kj::Own<HibernationManager>> hibernationManager;
+  // Declared before `impl` so that sockets referenced from the IoContext are destroyed first.
+  kj::Maybe<MakeHibernationManagerFunc> makeHibernationManager;
+
   struct Impl;
   kj::Own<Impl> impl;
 
@@ -718,7 +792,7 @@ class Worker::AsyncWaiter: public kj::Refcounted {
   // `AsyncWaiter`s. A particular thread only ever owns one `AsyncWaiter` at a time.
 
 public:
-  AsyncWaiter(kj::Own<const Isolate> isolate);
+  AsyncWaiter(kj::Own<const Isolate> isolate, AsyncLockPriority priority);
   ~AsyncWaiter() noexcept;
   KJ_DISALLOW_COPY_AND_MOVE(AsyncWaiter);
 
@@ -734,21 +808,63 @@ private:
   // Promise/fulfiller to fire when the waiter reaches the front of the list for the corresponding
   // isolate.
 
-  kj::ForkedPromise<void> releasePromise = nullptr;
-  kj::Own<kj::PromiseFulfiller<void>> releaseFulfiller;
-  // Promise/fulfiller to fire when the AsyncLock is finally released. This is used when a thread
-  // tries to take locks on multiple different isolates concurrently, in order to serialize the
-  // locks so only one is taken at a time. This is NOT a cross-thread fulfiller; it can only be
-  // fulfilled by the thread that owns the waiter.
-
   kj::Maybe<AsyncWaiter&> next;
   kj::Maybe<AsyncWaiter&>* prev;
+  AsyncLockPriority priority;
   // Protected by the lock on `Isolate::asyncWaiters` for the isolate identified by
   // `currentIsolate`. Must be null if `currentIsolate` is null. (All other members of `Waiter`
-  // can only be accessed by the thread that created the `Waiter`.)
+  // can only be accessed by the thread that created the `Waiter`, except `queuedAt`, which is
+  // immutable.)
+
+  kj::TimePoint queuedAt;
+  // When the waiter joined the queue.
+
+  kj::TimePoint rank() const {
+    // The waiter with the lowest rank gets the lock next. Requires the `asyncWaiters` lock.
+    return rank(queuedAt, priority);
+  }
+
+  static kj::TimePoint rank(kj::TimePoint queuedAt, AsyncLockPriority priority) {
+    // Work ranks as if it had arrived one aging interval later for each class it is below FETCH,
+    // so urgent work goes first but long-waiting work eventually catches up.
+    return queuedAt + uint(priority) * Isolate::ASYNC_LOCK_AGING_INTERVAL;
+  }
+
+  struct Turn {
+    kj::TimePoint rank;
+    kj::Own<kj::PromiseFulfiller<void>> fulfiller;
+  };
+  kj::Vector<Turn> turns;
+  kj::Promise<void> handOutTurnsTask = nullptr;
+  bool handOutTurnsScheduled = false;
+  // The lock attempts coalesced onto this waiter that are ready to resume, once the thread has
+  // nothing else to do. Only accessed by the waiter's thread.
+
+  kj::Promise<void> takeTurn(kj::TimePoint rank);
+  // Called by each lock attempt sharing this waiter, once the waiter holds the lock. Resolves
+  // when it's the attempt's turn: all attempts that get this far before the thread's event queue
+  // runs dry are resumed in order of rank, so e.g. a fetch that arrived together with the
+  // continuation of a `waitUntil()` task runs first.
 
   static thread_local AsyncWaiter* threadCurrentWaiter;
 
+  struct ReleaseWaiter;
+  struct ReleaseWaiterList {
+    ReleaseWaiter* head = nullptr;
+    ReleaseWaiter* tail = nullptr;
+  };
+  static thread_local ReleaseWaiterList threadReleaseWaiters;
+  // Lock attempts and `AsyncLock::whenThreadIdle()` calls waiting for this thread's current
+  // waiter to be released, in order of arrival. A thread only takes locks on one isolate at a
+  // time, so attempts on other isolates queue up here. Only ever touched by its own thread, so it
+  // needs no lock.
+
+  static void wakeReleaseWaiters();
+  // Called once the thread's waiter is released. Wakes the first queued lock attempt -- along
+  // with any others for the same isolate, which will share its waiter -- and every
+  // `whenThreadIdle()` call. The rest stay queued until that lock is released in turn, rather
+  // than all waking up only to find the thread busy again.
+
   friend class Worker::Isolate;
   friend class Worker::AsyncLock;
 };
@@ -0,0 +1,61 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "external-memory.h"
+#include <kj/test.h>
+
+namespace workerd::jsg {
+namespace {
+
+KJ_TEST("ExternalMemoryTracker tallies memory by type") {
+  auto tracker = kj::atomicRefcounted<ExternalMemoryTracker>();
+  auto& buffers = tracker->getCounter("Buffers");
+  auto& cache = tracker->getCounter("Cache");
+  KJ_EXPECT(&tracker->getCounter("Buffers") == &buffers);
+
+  buffers.adjust(100);
+  cache.adjust(50);
+  buffers.adjust(-30);
+  KJ_EXPECT(tracker->takeUnreported() == 120);
+  KJ_EXPECT(tracker->takeUnreported() == 0);
+
+  auto usage = tracker->getUsage();
+  KJ_ASSERT(usage.size() == 2);
+  KJ_EXPECT(usage[0].type == "Buffers");
+  KJ_EXPECT(usage[0].bytes == 70);
+  KJ_EXPECT(usage[1].type == "Cache");
+  KJ_EXPECT(usage[1].bytes == 50);
+}
+
+KJ_TEST("ExternalMemoryAdjustment counts its amount until destroyed") {
+  auto tracker = kj::atomicRefcounted<ExternalMemoryTracker>();
+  auto& counter = tracker->getCounter("Thing");
+
+  {
+    ExternalMemoryAdjustment adjustment(counter, 10);
+    KJ_EXPECT(counter.get() == 10);
+    adjustment.set(25);
+    KJ_EXPECT(counter.get() == 25);
+
+    ExternalMemoryAdjustment moved = kj::mv(adjustment);
+    KJ_EXPECT(adjustment.get() == 0);
+    KJ_EXPECT(moved.get() == 25);
+    KJ_EXPECT(counter.get() == 25);
+
+    ExternalMemoryAdjustment other(counter, 5);
+    other = kj::mv(moved);
+    KJ_EXPECT(counter.get() == 25);
+  }
+  KJ_EXPECT(counter.get() == 0);
+  KJ_EXPECT(tracker->takeUnreported() == 0);
+
+  // An adjustment keeps the tracker alive.
+  auto& counterRef = counter;
+  ExternalMemoryAdjustment adjustment(counterRef, 8);
+  tracker = nullptr;
+  KJ_EXPECT(counterRef.get() == 8);
+}
+
+}  // namespace
+}  // namespace workerd::jsg
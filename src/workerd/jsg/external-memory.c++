@@ -0,0 +1,63 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "external-memory.h"
+#include <kj/debug.h>
+
+namespace workerd::jsg {
+
+const ExternalMemoryTracker::Counter& ExternalMemoryTracker::getCounter(kj::StringPtr type) const {
+  auto lock = counters.lockExclusive();
+  return *lock->findOrCreate(type, [&]() {
+    return decltype(counters)::Entry {
+      type, kj::heap<Counter>(kj::Badge<ExternalMemoryTracker>(), *this, type)
+    };
+  });
+}
+
+kj::Array<ExternalMemoryTracker::Usage> ExternalMemoryTracker::getUsage() const {
+  auto lock = counters.lockShared();
+  return KJ_MAP(entry, *lock) {
+    return Usage { entry.key, entry.value->get() };
+  };
+}
+
+ExternalMemoryAdjustment::ExternalMemoryAdjustment(
+    const ExternalMemoryTracker::Counter& counter, size_t amount)
+    : tracker(counter.getTracker().addRef()), counter(&counter) {
+  set(amount);
+}
+
+ExternalMemoryAdjustment::ExternalMemoryAdjustment(ExternalMemoryAdjustment&& other)
+    : tracker(kj::mv(other.tracker)), counter(other.counter), amount(other.amount) {
+  other.counter = nullptr;
+  other.amount = 0;
+}
+
+ExternalMemoryAdjustment& ExternalMemoryAdjustment::operator=(ExternalMemoryAdjustment&& other) {
+  if (this != &other) {
+    set(0);
+    tracker = kj::mv(other.tracker);
+    counter = other.counter;
+    amount = other.amount;
+    other.counter = nullptr;
+    other.amount = 0;
+  }
+  return *this;
+}
+
+ExternalMemoryAdjustment::~ExternalMemoryAdjustment() noexcept(false) {
+  set(0);
+}
+
+void ExternalMemoryAdjustment::set(size_t newAmount) {
+  if (counter == nullptr) {
+    KJ_REQUIRE(newAmount == 0, "ExternalMemoryAdjustment has no counter");
+    return;
+  }
+  counter->adjust(int64_t(newAmount) - int64_t(amount));
+  amount = newAmount;
+}
+
+}  // namespace workerd::jsg
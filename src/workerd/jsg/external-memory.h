@@ -0,0 +1,100 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#pragma once
+
+#include <kj/map.h>
+#include <kj/mutex.h>
+#include <kj/refcount.h>
+#include <kj/string.h>
+#include <atomic>
+
+namespace workerd::jsg {
+
+class ExternalMemoryTracker final: public kj::AtomicRefcounted {
+  // Tallies memory that C++ objects hold on behalf of one isolate -- cache entries, buffers, and
+  // so on -- by type, so that it's possible to tell where an isolate's memory has gone, and so
+  // that V8 can take it into account when deciding to collect garbage. (V8 already counts the
+  // backing stores of ArrayBuffers; don't count them again here.)
+  //
+  // Each isolate has one (see `Lock::getExternalMemory()`). Changes are reported to V8 with
+  // `AdjustAmountOfExternalAllocatedMemory()` the next time the isolate is locked. Everything is
+  // safe to call from any thread, without the isolate lock, so objects may account for memory
+  // they free in their destructors wherever those run. The tracker is atomic-refcounted, so
+  // observers may keep it and read it after the isolate is gone.
+
+public:
+  class Counter {
+    // Bytes of one type of memory. Adjusting it is a pair of relaxed atomic additions.
+
+  public:
+    Counter(kj::Badge<ExternalMemoryTracker>, const ExternalMemoryTracker& tracker,
+            kj::StringPtr type)
+        : tracker(tracker), type(type) {}
+    KJ_DISALLOW_COPY_AND_MOVE(Counter);
+
+    kj::StringPtr getType() const { return type; }
+    const ExternalMemoryTracker& getTracker() const { return tracker; }
+
+    int64_t get() const { return bytes.load(std::memory_order_relaxed); }
+
+    void adjust(int64_t delta) const {
+      bytes.fetch_add(delta, std::memory_order_relaxed);
+      tracker.unreported.fetch_add(delta, std::memory_order_relaxed);
+    }
+
+  private:
+    const ExternalMemoryTracker& tracker;
+    kj::StringPtr type;
+    mutable std::atomic<int64_t> bytes = 0;
+  };
+
+  const Counter& getCounter(kj::StringPtr type) const;
+  // Returns the counter for `type`, creating it on first use. `type` is kept by reference, so it
+  // should be a string literal. The counter lives as long as the tracker. Look the counter up
+  // once and keep it, rather than on every adjustment: this takes a lock.
+
+  struct Usage {
+    kj::StringPtr type;
+    int64_t bytes;
+  };
+  kj::Array<Usage> getUsage() const;
+  // Current bytes of every type that has been counted, ordered by type.
+
+  int64_t takeUnreported() const {
+    // Returns the change in the total since the last call. The isolate calls this to report to V8.
+    return unreported.exchange(0, std::memory_order_relaxed);
+  }
+
+  kj::Own<const ExternalMemoryTracker> addRef() const { return kj::atomicAddRef(*this); }
+
+private:
+  kj::MutexGuarded<kj::TreeMap<kj::StringPtr, kj::Own<Counter>>> counters;
+  mutable std::atomic<int64_t> unreported = 0;
+};
+
+class ExternalMemoryAdjustment {
+  // Counts `amount` bytes against an ExternalMemoryTracker::Counter for as long as it exists. Use
+  // this as a member of an object whose memory use is easiest to describe by a size that gets set
+  // and reset. Keeps the tracker alive, so it may outlive the isolate.
+
+public:
+  ExternalMemoryAdjustment() = default;
+  explicit ExternalMemoryAdjustment(const ExternalMemoryTracker::Counter& counter,
+                                    size_t amount = 0);
+  ExternalMemoryAdjustment(ExternalMemoryAdjustment&& other);
+  ExternalMemoryAdjustment& operator=(ExternalMemoryAdjustment&& other);
+  ~ExternalMemoryAdjustment() noexcept(false);
+  KJ_DISALLOW_COPY(ExternalMemoryAdjustment);
+
+  void set(size_t amount);
+  size_t get() const { return amount; }
+
+private:
+  kj::Own<const ExternalMemoryTracker> tracker;
+  const ExternalMemoryTracker::Counter* counter = nullptr;
+  size_t amount = 0;
+};
+
+}  // namespace workerd::jsg
@@ -164,6 +164,14 @@ void Lock::setLoggerCallback(kj::Function<Logger>&& logger) {
   IsolateBase::from(v8Isolate).setLoggerCallback({}, kj::mv(logger));
 }
 
+bool Lock::runIdleGc(kj::Duration budget) const {
+  return IsolateBase::from(v8Isolate).runIdleGc({}, budget);
+}
+
+const ExternalMemoryTracker& Lock::getExternalMemory() const {
+  return IsolateBase::from(v8Isolate).getExternalMemory();
+}
+
 void Lock::requestGcForTesting() const {
   if (!isPredictableModeForTest()) {
     KJ_LOG(ERROR, "Test GC used while not in a test");
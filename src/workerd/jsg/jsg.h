@@ -15,6 +15,7 @@
 #include <v8.h>
 #include "macro-meta.h"
 #include "wrappable.h"
+#include "external-memory.h"
 
 #define JSG_ASSERT(cond, jsErrorType, ...)                                              \
   KJ_ASSERT(cond, kj::str(JSG_EXCEPTION(jsErrorType) ": ", ##__VA_ARGS__))
@@ -286,6 +287,24 @@ private:
 // Use inside a JSG_RESOURCE_TYPE block to declare that the given method should be callable from
 // JavaScript on instances of the resource type.
 
+#define JSG_FAST_METHOD(name) \
+  do { \
+    static const char NAME[] = #name; \
+    registry.template registerFastMethod<NAME, decltype(&Self::name), &Self::name>(); \
+  } while (false)
+// Like JSG_METHOD, but also gives V8 a "fast API" entry point for the method, which optimized
+// code can call directly, without going through a FunctionCallbackInfo or unwrapping arguments
+// one by one. This only suits small, hot methods, and the method must be written for it:
+//
+// - Its parameters may only be `bool` and `double`, and it may only return `void`, `bool`,
+//   `double`, `int32_t` or `uint32_t`. It does not take a `jsg::Lock&`.
+// - It must not throw, and must not touch the JavaScript heap, since V8 provides neither a lock
+//   nor a way to report an exception on the fast path.
+//
+// V8 still uses the ordinary callback whenever the call can't take the fast path, e.g. before
+// the caller is optimized or when an argument isn't already of the parameter's type, so the
+// method must behave the same either way.
+
 #define JSG_METHOD_NAMED(name, method) \
   do { \
     static const char NAME[] = #name; \
@@ -1997,6 +2016,16 @@ public:
   // ---------------------------------------------------------------------------
   // Misc. Stuff
 
+  bool runIdleGc(kj::Duration budget) const;
+  // Gives V8 up to `budget` to do garbage collection work -- incremental marking steps, and
+  // finishing a collection if marking is done -- that it would otherwise do in the middle of
+  // running JavaScript. If the platform was created with `PlatformOptions::idleTasks`, V8's
+  // pending idle tasks run first, within the same budget. Call this only while the isolate has
+  // nothing else to do. Returns true if V8 reports that it has no more GC work to do for now.
+
+  const ExternalMemoryTracker& getExternalMemory() const;
+  // Tracker of memory held by C++ objects on behalf of this isolate. See ExternalMemoryTracker.
+
   void requestGcForTesting() const;
   // Sends an immediate request for full GC, this function is to ONLY be used in testing, otherwise
   // it will throw. If a need for a minor GC is needed look at the call in jsg.c++ and the
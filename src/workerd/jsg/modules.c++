@@ -38,6 +38,22 @@ private:
   // The key is the address of the static global that was compiled to produce the CachedData.
 };
 
+template <typename Script>
+void addToCodeCache(const CodeCache& codeCache, kj::ArrayPtr<const char> source,
+                    v8::Local<Script> script) {
+  auto cachedData = std::unique_ptr<v8::ScriptCompiler::CachedData>(
+      v8::ScriptCompiler::CreateCodeCache(script));
+  if (cachedData != nullptr) {
+    codeCache.add(source, kj::arrayPtr(cachedData->data, cachedData->length));
+  }
+}
+
+v8::ScriptCompiler::CachedData* wrapCachedData(kj::ArrayPtr<const kj::byte> data) {
+  // The result is owned by the v8::ScriptCompiler::Source it's passed to, but doesn't own `data`.
+  return new v8::ScriptCompiler::CachedData(
+      data.begin(), data.size(), v8::ScriptCompiler::CachedData::BufferNotOwned);
+}
+
 ModuleRegistry* getModulesForResolveCallback(v8::Isolate* isolate) {
   return static_cast<ModuleRegistry*>(
       isolate->GetCurrentContext()->GetAlignedPointerFromEmbedderData(2));
@@ -264,10 +280,31 @@ void NonModuleScript::run(v8::Local<v8::Context> context) const {
   check(boundScript->Run(context));
 }
 
-NonModuleScript NonModuleScript::compile(kj::StringPtr code, jsg::Lock& js) {
+NonModuleScript NonModuleScript::compile(kj::StringPtr code, jsg::Lock& js,
+    kj::Maybe<const CodeCache&> codeCache) {
   // Create a dummy script origin for it to appear in Sources panel.
   auto isolate = js.v8Isolate;
   v8::ScriptOrigin origin(isolate, v8StrIntern(isolate, "worker.js"));
+
+  KJ_IF_MAYBE(c, codeCache) {
+    auto cached = c->find(code);
+    KJ_IF_MAYBE(data, cached) {
+      v8::ScriptCompiler::Source source(v8Str(isolate, code), origin, wrapCachedData(*data));
+      auto script = check(v8::ScriptCompiler::CompileUnboundScript(
+          isolate, &source, v8::ScriptCompiler::kConsumeCodeCache));
+      if (source.GetCachedData()->rejected) {
+        // V8 fell back to compiling from source. Replace the stale data.
+        addToCodeCache(*c, code, script);
+      }
+      return NonModuleScript(js, script);
+    }
+
+    v8::ScriptCompiler::Source source(v8Str(isolate, code), origin);
+    auto script = check(v8::ScriptCompiler::CompileUnboundScript(isolate, &source));
+    addToCodeCache(*c, code, script);
+    return NonModuleScript(js, script);
+  }
+
   v8::ScriptCompiler::Source source(v8Str(isolate, code), origin);
   return NonModuleScript(js,
       check(v8::ScriptCompiler::CompileUnboundScript(isolate, &source)));
@@ -305,7 +342,8 @@ v8::Local<v8::Module> compileEsmModule(
     jsg::Lock& js,
     kj::StringPtr name,
     kj::ArrayPtr<const char> content,
-    ModuleInfoCompileOption option) {
+    ModuleInfoCompileOption option,
+    kj::Maybe<const CodeCache&> codeCache) {
   // Must pass true for `is_module`, but we can skip everything else.
   const int resourceLineOffset = 0;
   const int resourceColumnOffset = 0;
@@ -350,6 +388,25 @@ v8::Local<v8::Module> compileEsmModule(
 
   contentStr = jsg::v8Str(js.v8Isolate, content);
 
+  KJ_IF_MAYBE(c, codeCache) {
+    auto cached = c->find(content);
+    KJ_IF_MAYBE(data, cached) {
+      v8::ScriptCompiler::Source source(contentStr, origin, wrapCachedData(*data));
+      auto module = jsg::check(v8::ScriptCompiler::CompileModule(
+          js.v8Isolate, &source, v8::ScriptCompiler::kConsumeCodeCache));
+      if (source.GetCachedData()->rejected) {
+        // V8 fell back to compiling from source. Replace the stale data.
+        addToCodeCache(*c, content, module->GetUnboundModuleScript());
+      }
+      return module;
+    }
+
+    v8::ScriptCompiler::Source source(contentStr, origin);
+    auto module = jsg::check(v8::ScriptCompiler::CompileModule(js.v8Isolate, &source));
+    addToCodeCache(*c, content, module->GetUnboundModuleScript());
+    return module;
+  }
+
   v8::ScriptCompiler::Source source(contentStr, origin);
   auto module = jsg::check(v8::ScriptCompiler::CompileModule(js.v8Isolate, &source));
 
@@ -386,8 +443,9 @@ ModuleRegistry::ModuleInfo::ModuleInfo(
     jsg::Lock& js,
     kj::StringPtr name,
     kj::ArrayPtr<const char> content,
-    CompileOption flags)
-    : ModuleInfo(js, compileEsmModule(js, name, content, flags)) {}
+    CompileOption flags,
+    kj::Maybe<const CodeCache&> codeCache)
+    : ModuleInfo(js, compileEsmModule(js, name, content, flags, codeCache)) {}
 
 ModuleRegistry::ModuleInfo::ModuleInfo(
     jsg::Lock& js,
@@ -51,6 +51,22 @@ private:
   jsg::Value exports;
 };
 
+class CodeCache {
+  // Storage for V8 code caches of scripts and modules provided by the worker bundle, so that they
+  // don't have to be parsed and compiled from scratch every time the process starts.
+  //
+  // Implementations must be thread-safe, since isolates on different threads may share one.
+  // They should only return data produced from the same source by the same V8 version and flags;
+  // V8 rejects anything else anyway, but only after deserializing it.
+
+public:
+  virtual kj::Maybe<kj::Array<const kj::byte>> find(kj::ArrayPtr<const char> source) const = 0;
+  // Returns data previously passed to `add()` for this source, if available.
+
+  virtual void add(kj::ArrayPtr<const char> source, kj::ArrayPtr<const kj::byte> data) const = 0;
+  // Called after `source` was compiled without usable cached data, with a fresh code cache.
+};
+
 class NonModuleScript {
   // jsg::NonModuleScript wraps a v8::UnboundScript.
 public:
@@ -64,7 +80,8 @@ public:
   // Running the script will create a v8::Script instance bound to the given
   // context then will run it to completion.
 
-  static jsg::NonModuleScript compile(kj::StringPtr code, jsg::Lock& js);
+  static jsg::NonModuleScript compile(kj::StringPtr code, jsg::Lock& js,
+      kj::Maybe<const CodeCache&> codeCache = nullptr);
 
 private:
   v8::Global<v8::UnboundScript> unboundScript;
@@ -189,7 +206,10 @@ public:
     ModuleInfo(jsg::Lock& js,
                kj::StringPtr name,
                kj::ArrayPtr<const char> content,
-               CompileOption flags = CompileOption::BUNDLE);
+               CompileOption flags = CompileOption::BUNDLE,
+               kj::Maybe<const CodeCache&> codeCache = nullptr);
+    // `codeCache`, if given, is consulted for BUNDLE modules. (BUILTIN modules always use the
+    // process-lifetime in-memory cache.)
 
     ModuleInfo(jsg::Lock& js, kj::StringPtr name,
                kj::Maybe<kj::ArrayPtr<kj::StringPtr>> maybeExports,
@@ -238,6 +258,13 @@ public:
     entries.insert(Entry(specifier, Type::BUNDLE, kj::fwd<ModuleInfo>(info)));
   }
 
+  void add(kj::Path& specifier, kj::Function<ModuleInfo(Lock&)> factory) {
+    // Registers a worker bundle module that is only compiled (by calling `factory`) the first
+    // time it is resolved, so modules the worker never imports cost nothing at startup. Anything
+    // `factory` captures must outlive this ModuleRegistry.
+    entries.insert(Entry(specifier, Type::BUNDLE, kj::mv(factory)));
+  }
+
   void addBuiltinModule(kj::StringPtr specifier,
                         kj::ArrayPtr<const char> sourceCode,
                         Type type = Type::BUILTIN) {
@@ -52,6 +52,10 @@ struct PromiseContext: public Object {
     return rejectedPromise<kj::String>(isolate, kj::mv(exception));
   }
 
+  Promise<kj::String> makeResolved(Lock& js, int i) {
+    return js.resolvedPromise(kj::str(i));
+  }
+
   Promise<kj::String> makeRejectedKj(Lock& js) {
     return js.rejectedPromise<kj::String>(JSG_KJ_EXCEPTION(FAILED, TypeError, "bar"));
   }
@@ -99,6 +103,7 @@ struct PromiseContext: public Object {
 
     JSG_METHOD(makeRejected);
     JSG_METHOD(makeRejectedKj);
+    JSG_METHOD(makeResolved);
 
     JSG_METHOD(testConsumeResolved);
     JSG_METHOD(whenResolved);
@@ -122,6 +127,26 @@ KJ_TEST("jsg::Promise<T>") {
   KJ_EXPECT(promiseTestResult == 62481);
 }
 
+KJ_TEST("jsg::Promise<T> already resolved") {
+  Evaluator<PromiseContext, PromiseIsolate> e(v8System);
+
+  // Promises that are already fulfilled when they cross between C++ and JavaScript are converted
+  // straight away, but must still behave like promises.
+  promiseTestResult = 0;
+  e.expectEval("setResult(Promise.resolve(321))", "undefined", "undefined");
+  KJ_EXPECT(promiseTestResult == 0);
+  e.runMicrotasks();
+  KJ_EXPECT(promiseTestResult == 60321);
+
+  promiseTestResult = 0;
+  e.expectEval(
+      "makeResolved(1234).then(s => setResult(Promise.resolve(s + '5'))); undefined",
+      "undefined", "undefined");
+  KJ_EXPECT(promiseTestResult == 0);
+  e.runMicrotasks();
+  KJ_EXPECT(promiseTestResult == 72345);
+}
+
 KJ_TEST("jsg::Promise<T> exception catching") {
   Evaluator<PromiseContext, PromiseIsolate> e(v8System);
 
@@ -8,6 +8,7 @@
 #include "wrappable.h"
 #include "jsg.h"
 #include "web-idl.h"
+#include <kj/map.h>
 
 namespace workerd::jsg {
 
@@ -654,11 +655,48 @@ public:
     // cannot be GC'd while the callback still exists. This gives us the KJ-style guarantee that
     // the object whose method returned the promise will not be destroyed while the promise is
     // still executing.
+    auto isolate = context->GetIsolate();
     auto markedAsHandled = promise.markedAsHandled;
+    auto handle = promise.consumeHandle(Lock::from(isolate));
+
+    if (handle->State() == v8::Promise::kFulfilled) {
+      // The value is already here, so convert it now rather than in a continuation. This saves
+      // allocating the continuation function and running a microtask, and there's nothing left
+      // for `creator` to keep alive.
+      auto resolver = check(v8::Promise::Resolver::New(context));
+      v8::TryCatch tryCatch(isolate);
+      try {
+        v8::Local<v8::Value> value;
+        if constexpr (isVoid<T>()) {
+          value = v8::Undefined(isolate);
+        } else if constexpr (isV8Ref<T>()) {
+          value = handle->Result();
+        } else {
+          auto& wrapper = *static_cast<TypeWrapper*>(this);
+          value = wrapper.wrap(context, nullptr, unwrapOpaque<T>(isolate, handle->Result()));
+        }
+        check(resolver->Resolve(context, value));
+      } catch (JsExceptionThrown&) {
+        if (!tryCatch.HasCaught() || !tryCatch.CanContinue()) {
+          // probably TerminateExecution() called
+          if (tryCatch.CanContinue()) tryCatch.ReThrow();
+          throw;
+        }
+        check(resolver->Reject(context, tryCatch.Exception()));
+      } catch (kj::Exception& e) {
+        check(resolver->Reject(context, makeInternalError(isolate, kj::mv(e))));
+      }
+      auto ret = resolver->GetPromise();
+      if (markedAsHandled) {
+        ret->MarkAsHandled();
+      }
+      return ret;
+    }
+
     auto then = check(v8::Function::New(context,
         &thenWrap<TypeWrapper, T>, creator.orDefault({}), 1, v8::ConstructorBehavior::kThrow));
 
-    auto ret = check(promise.consumeHandle(context->GetIsolate())->Then(context, then));
+    auto ret = check(handle->Then(context, then));
     // Although we added a .then() to the promise to translate the value to JavaScript, we would
     // like things to behave as if the C++ code returned this Promise directly to JavaScript. In
     // particular, if the C++ code marked the Promise handled, then the derived JavaScript promise
@@ -677,16 +715,21 @@ public:
     if (handle->IsPromise()) {
       auto promise = handle.As<v8::Promise>();
       if constexpr (!isVoid<T>() && !isV8Ref<T>()) {
+        if (promise->State() == v8::Promise::kFulfilled) {
+          // Already resolved; unwrap the result now rather than in a continuation. As with the
+          // continuation, a value of the wrong type rejects the promise rather than throwing.
+          auto& wrapper = *static_cast<TypeWrapper*>(this);
+          auto result = promise->Result();
+          return Lock::from(context->GetIsolate()).evalNow([&]() {
+            return wrapper.template unwrap<T>(context, result,
+                TypeErrorContext::promiseResolution());
+          });
+        }
+
         // Add a .then() to unwrap the promise's resolution (i.e. convert it from JS to C++).
         // Note that we don't need to handle the rejection case here as there is no wrapping
         // applied to exception values, so we just let it propagate through.
-        //
-        // TODO(perf): We could in theory check if promise->State() is kFulfilled and, in that
-        //   case, pull out promise->Result(), unwrap it, and make a new immediate promise.
-        //   Similarly in `wrap()`. Not clear if the added complexity is worth it, though.
-        auto then = check(v8::Function::New(context,
-            &thenUnwrap<TypeWrapper, T>, {}, 1, v8::ConstructorBehavior::kThrow));
-        promise = check(promise->Then(context, then));
+        promise = check(promise->Then(context, getUnwrapContinuation<T>(context)));
       }
       return Promise<T>(context->GetIsolate(), promise);
     } else {
@@ -717,6 +760,26 @@ public:
       }
     }
   }
+
+private:
+  kj::HashMap<const void*, v8::Global<v8::FunctionTemplate>> unwrapContinuations;
+  // Templates for the thenUnwrap<T>() continuations, keyed by function. V8 instantiates a
+  // template's function only once per context, so unwrapping a pending promise doesn't allocate a
+  // new continuation function each time.
+
+  template <typename T>
+  v8::Local<v8::Function> getUnwrapContinuation(v8::Local<v8::Context> context) {
+    auto isolate = context->GetIsolate();
+    auto callback = &thenUnwrap<TypeWrapper, T>;
+    auto& tmpl = unwrapContinuations.findOrCreate(reinterpret_cast<const void*>(callback), [&]() {
+      return decltype(unwrapContinuations)::Entry {
+        reinterpret_cast<const void*>(callback),
+        v8::Global<v8::FunctionTemplate>(isolate, v8::FunctionTemplate::New(
+            isolate, callback, {}, {}, 1, v8::ConstructorBehavior::kThrow))
+      };
+    });
+    return check(tmpl.Get(isolate)->GetFunction(context));
+  }
 };
 
 // -----------------------------------------------------------------------------
@@ -105,6 +105,48 @@ KJ_TEST("JSG_METHODs can be implemented by mixins") {
 
 // ========================================================================================
 
+struct FastCounter: public Object {
+  double total = 0;
+
+  static Ref<FastCounter> constructor() { return alloc<FastCounter>(); }
+
+  void add(double amount) { total += amount; }
+  bool isAbove(double threshold) { return total > threshold; }
+  double getTotal() { return total; }
+
+  JSG_RESOURCE_TYPE(FastCounter) {
+    JSG_FAST_METHOD(add);
+    JSG_FAST_METHOD(isAbove);
+    JSG_FAST_METHOD(getTotal);
+  }
+};
+
+struct FastCounterContext: public Object {
+  JSG_RESOURCE_TYPE(FastCounterContext) {
+    JSG_NESTED_TYPE(FastCounter);
+  }
+};
+JSG_DECLARE_ISOLATE_TYPE(FastCounterIsolate, FastCounterContext, FastCounter);
+
+KJ_TEST("JSG_FAST_METHODs") {
+  Evaluator<FastCounterContext, FastCounterIsolate> e(v8System);
+  e.expectEval(
+      "var c = new FastCounter();\n"
+      "for (var i = 0; i < 100000; i++) c.add(1);\n"
+      "c.getTotal()", "number", "100000");
+
+  // Arguments that aren't already numbers take the ordinary path, and are converted as usual.
+  e.expectEval(
+      "var c = new FastCounter();\n"
+      "c.add('12');\n"
+      "c.isAbove(11)", "boolean", "true");
+
+  e.expectEval(
+      "FastCounter.prototype.add.call({}, 1)", "throws", "TypeError: Illegal invocation");
+}
+
+// ========================================================================================
+
 struct PrototypePropertyObject: public Object {
   double value;
 
@@ -13,6 +13,7 @@
 #include "util.h"
 #include "wrappable.h"
 #include "jsg.h"
+#include <v8-fast-api-calls.h>
 #include <kj/tuple.h>
 #include <kj/debug.h>
 #include <type_traits>
@@ -324,6 +325,42 @@ struct MethodCallback<TypeWrapper, methodName, isContext,
   }
 };
 
+template <typename T>
+constexpr bool isFastApiParameter() {
+  return kj::isSameType<T, bool>() || kj::isSameType<T, double>();
+}
+
+template <typename T>
+constexpr bool isFastApiReturn() {
+  return isVoid<T>() || kj::isSameType<T, bool>() || kj::isSameType<T, double>() ||
+      kj::isSameType<T, int32_t>() || kj::isSameType<T, uint32_t>();
+}
+// Types which a JSG_FAST_METHOD can accept and return. V8 can pass and return more types than
+// these, but for these the fast path converts values exactly as our TypeWrapper does.
+
+template <typename T, typename Method, Method method>
+struct FastMethodCallback;
+// Implements the V8 fast API entry point for a method declared with JSG_FAST_METHOD.
+
+template <typename T, typename U, typename Ret, typename... Args, Ret (U::*method)(Args...)>
+struct FastMethodCallback<T, Ret (U::*)(Args...), method> {
+  static_assert(isFastApiReturn<Ret>() && (isFastApiParameter<Args>() && ...),
+      "JSG_FAST_METHOD methods may only take bool and double parameters, and may only return "
+      "void, bool, double, int32_t or uint32_t.");
+
+  static Ret callback(v8::Local<v8::Object> receiver, Args... args) {
+    // The method's signature guarantees that `receiver` is an instance of T.
+    auto& self = *reinterpret_cast<T*>(receiver->GetAlignedPointerFromInternalField(
+        Wrappable::WRAPPED_OBJECT_FIELD_INDEX));
+    return (self.*method)(args...);
+  }
+
+  static const v8::CFunction* get() {
+    static const v8::CFunction cFunction = v8::CFunction::Make(&callback);
+    return &cFunction;
+  }
+};
+
 template <typename TypeWrapper, const char* methodName,
           typename T, typename Method, Method* method, typename Indexes>
 struct StaticMethodCallback;
@@ -591,6 +628,22 @@ struct SetterCallback<TypeWrapper, methodName,
   }
 };
 
+template <typename TypeWrapper, typename Type>
+struct NestedTypeCallback {
+  // Implements the lazy data property through which a nested type's constructor is exposed. The
+  // constructor's template is only built, and its function only instantiated, when script first
+  // looks it up, so that creating a context doesn't have to do this for every type in the API.
+
+  static void callback(v8::Local<v8::Name>, const v8::PropertyCallbackInfo<v8::Value>& info) {
+    liftKj(info, [&]() -> v8::Local<v8::Value> {
+      auto isolate = info.GetIsolate();
+      auto context = isolate->GetCurrentContext();
+      auto& wrapper = TypeWrapper::from(isolate);
+      return check(wrapper.getTemplate(isolate, (Type*)nullptr)->GetFunction(context));
+    });
+  }
+};
+
 template <typename T, typename Constructor = decltype(&T::constructor)>
 constexpr bool hasConstructorMethod(T*) {
   static_assert(!std::is_member_function_pointer<Constructor>::value,
@@ -710,6 +763,16 @@ struct ResourceTypeBuilder {
         v8::Local<v8::Value>(), signature, 0, v8::ConstructorBehavior::kThrow));
   }
 
+  template<const char* name, typename Method, Method method>
+  inline void registerFastMethod() {
+    static_assert(!isContext, "JSG_FAST_METHOD can't be used on the global object.");
+    prototype->Set(isolate, name, v8::FunctionTemplate::New(isolate,
+        &MethodCallback<TypeWrapper, name, isContext, Self, Method, method,
+                        ArgumentIndexes<Method>>::callback,
+        v8::Local<v8::Value>(), signature, 0, v8::ConstructorBehavior::kThrow,
+        v8::SideEffectType::kHasSideEffect, FastMethodCallback<Self, Method, method>::get()));
+  }
+
   template<const char* name, typename Method, Method method>
   inline void registerStaticMethod() {
     auto v8Name = v8Str(isolate, name, v8::NewStringType::kInternalized);
@@ -827,7 +890,9 @@ struct ResourceTypeBuilder {
     static_assert(hasGetTemplate,
           "Type must be listed in JSG_DECLARE_ISOLATE_TYPE to be declared nested.");
 
-    prototype->Set(isolate, name, typeWrapper.getTemplate(isolate, (Type*)nullptr));
+    prototype->SetLazyDataProperty(
+        v8Str(isolate, name, v8::NewStringType::kInternalized),
+        &NestedTypeCallback<TypeWrapper, Type>::callback);
   }
 
   inline void registerTypeScriptRoot() { /* only needed for RTTI */ }
@@ -478,6 +478,9 @@ struct MemberCounter {
   template<const char* name, typename Method, Method method>
   inline void registerMethod() { ++count; }
 
+  template<const char* name, typename Method, Method method>
+  inline void registerFastMethod() { ++count; }
+
   template<typename Type>
   inline void registerInherit() { /* inherit is not a member */ }
 
@@ -629,6 +632,11 @@ struct MembersBuilder {
     TupleRttiBuilder<Configuration, Args>::build(method.initArgs(std::tuple_size_v<Args>), rtti);
   }
 
+  template<const char* name, typename Method, Method method>
+  inline void registerFastMethod() {
+    registerMethod<name, Method, method>();
+  }
+
   template<const char* name, typename Method, Method>
   inline void registerStaticMethod() {
     auto method = members[index++].initMethod();
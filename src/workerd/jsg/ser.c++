@@ -115,6 +115,208 @@ void SerializedBufferDisposer::disposeImpl(
   free(firstElement);
 }
 
+namespace {
+
+// A subset of v8::ValueSerializer's wire format; see src/objects/value-serializer.cc.
+constexpr kj::byte TAG_VERSION = 0xFF;
+constexpr kj::byte TAG_PADDING = 0x00;
+constexpr kj::byte TAG_UNDEFINED = '_';
+constexpr kj::byte TAG_NULL = '0';
+constexpr kj::byte TAG_TRUE = 'T';
+constexpr kj::byte TAG_FALSE = 'F';
+constexpr kj::byte TAG_INT32 = 'I';
+constexpr kj::byte TAG_DOUBLE = 'N';
+constexpr kj::byte TAG_ONE_BYTE_STRING = '"';
+constexpr kj::byte TAG_TWO_BYTE_STRING = 'c';
+constexpr kj::byte TAG_ARRAY_BUFFER = 'B';
+constexpr uint32_t SIMPLE_VALUE_VERSION = 15;
+
+size_t varintSize(uint32_t value) {
+  size_t size = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    ++size;
+  }
+  return size;
+}
+
+kj::byte* writeVarint(kj::byte* out, uint32_t value) {
+  while (value >= 0x80) {
+    *out++ = static_cast<kj::byte>(value) | 0x80;
+    value >>= 7;
+  }
+  *out++ = static_cast<kj::byte>(value);
+  return out;
+}
+
+kj::Maybe<uint32_t> readVarint(kj::ArrayPtr<const kj::byte>& data) {
+  uint32_t value = 0;
+  for (uint shift = 0; shift < 32; shift += 7) {
+    if (data.size() == 0) return nullptr;
+    kj::byte b = data[0];
+    data = data.slice(1, data.size());
+    value |= static_cast<uint32_t>(b & 0x7f) << shift;
+    if ((b & 0x80) == 0) return value;
+  }
+  return nullptr;
+}
+
+}  // namespace
+
+kj::Maybe<kj::Array<kj::byte>> trySerializeSimpleValue(
+    v8::Isolate* isolate, v8::Local<v8::Value> value) {
+  constexpr size_t HEADER_SIZE = 2;
+
+  auto withBody = [](size_t bodySize, auto&& writeBody) {
+    auto result = kj::heapArray<kj::byte>(HEADER_SIZE + bodySize);
+    result[0] = TAG_VERSION;
+    result[1] = SIMPLE_VALUE_VERSION;
+    writeBody(result.begin() + HEADER_SIZE);
+    return result;
+  };
+  auto tagOnly = [&](kj::byte tag) {
+    return withBody(1, [&](kj::byte* out) { *out = tag; });
+  };
+
+  if (value->IsUndefined()) {
+    return tagOnly(TAG_UNDEFINED);
+  } else if (value->IsNull()) {
+    return tagOnly(TAG_NULL);
+  } else if (value->IsTrue()) {
+    return tagOnly(TAG_TRUE);
+  } else if (value->IsFalse()) {
+    return tagOnly(TAG_FALSE);
+  } else if (value->IsInt32()) {
+    // V8 writes Smis zigzag-encoded and heap numbers as doubles. Which of the two an integer is
+    // isn't visible through the API, but either reads back as the same number; we use the Smi
+    // encoding for integers in the Smi range, as V8 does for the common case.
+    int32_t i = value.As<v8::Int32>()->Value();
+    if (i >= -(1 << 30) && i < (1 << 30)) {
+      uint32_t zigzag = (static_cast<uint32_t>(i) << 1) ^ static_cast<uint32_t>(i >> 31);
+      return withBody(1 + varintSize(zigzag), [&](kj::byte* out) {
+        *out++ = TAG_INT32;
+        writeVarint(out, zigzag);
+      });
+    }
+    return nullptr;
+  } else if (value->IsNumber()) {
+    double d = value.As<v8::Number>()->Value();
+    return withBody(1 + sizeof(double), [&](kj::byte* out) {
+      *out++ = TAG_DOUBLE;
+      memcpy(out, &d, sizeof(double));
+    });
+  } else if (value->IsString()) {
+    auto str = value.As<v8::String>();
+    uint32_t length = str->Length();
+    if (str->IsOneByte()) {
+      return withBody(1 + varintSize(length) + length, [&](kj::byte* out) {
+        *out++ = TAG_ONE_BYTE_STRING;
+        out = writeVarint(out, length);
+        str->WriteOneByte(isolate, out, 0, length, v8::String::NO_NULL_TERMINATION);
+      });
+    } else {
+      // V8 pads so that the UTF-16 data starts at an even offset.
+      uint32_t byteLength = length * 2;
+      bool pad = (HEADER_SIZE + 1 + varintSize(byteLength)) & 1;
+      return withBody(pad + 1 + varintSize(byteLength) + byteLength, [&](kj::byte* out) {
+        if (pad) *out++ = TAG_PADDING;
+        *out++ = TAG_TWO_BYTE_STRING;
+        out = writeVarint(out, byteLength);
+        auto chars = kj::heapArray<uint16_t>(length);
+        str->Write(isolate, chars.begin(), 0, length, v8::String::NO_NULL_TERMINATION);
+        memcpy(out, chars.begin(), byteLength);
+      });
+    }
+  } else if (value->IsArrayBuffer()) {
+    auto buffer = value.As<v8::ArrayBuffer>();
+    if (buffer->WasDetached()) return nullptr;
+    size_t byteLength = buffer->ByteLength();
+    if (byteLength > uint32_t(kj::maxValue)) return nullptr;
+    return withBody(1 + varintSize(byteLength) + byteLength, [&](kj::byte* out) {
+      *out++ = TAG_ARRAY_BUFFER;
+      out = writeVarint(out, byteLength);
+      if (byteLength > 0) memcpy(out, buffer->Data(), byteLength);
+    });
+  }
+
+  return nullptr;
+}
+
+kj::Maybe<v8::Local<v8::Value>> tryDeserializeSimpleValue(
+    v8::Isolate* isolate, kj::ArrayPtr<const kj::byte> data) {
+  if (data.size() < 3 || data[0] != TAG_VERSION || data[1] < 13 || data[1] > 15) {
+    return nullptr;
+  }
+  data = data.slice(2, data.size());
+  while (data.size() > 0 && data[0] == TAG_PADDING) {
+    data = data.slice(1, data.size());
+  }
+  if (data.size() == 0) return nullptr;
+
+  kj::byte tag = data[0];
+  data = data.slice(1, data.size());
+
+  auto readLength = [&]() -> kj::Maybe<uint32_t> {
+    KJ_IF_MAYBE(length, readVarint(data)) {
+      // The value must take up exactly the rest of the buffer.
+      if (*length == data.size()) return *length;
+    }
+    return nullptr;
+  };
+
+  switch (tag) {
+    case TAG_UNDEFINED:
+      if (data.size() == 0) return v8::Local<v8::Value>(v8::Undefined(isolate));
+      break;
+    case TAG_NULL:
+      if (data.size() == 0) return v8::Local<v8::Value>(v8::Null(isolate));
+      break;
+    case TAG_TRUE:
+      if (data.size() == 0) return v8::Local<v8::Value>(v8::True(isolate));
+      break;
+    case TAG_FALSE:
+      if (data.size() == 0) return v8::Local<v8::Value>(v8::False(isolate));
+      break;
+    case TAG_INT32:
+      KJ_IF_MAYBE(zigzag, readVarint(data)) {
+        if (data.size() == 0) {
+          int32_t i = static_cast<int32_t>((*zigzag >> 1) ^ -(*zigzag & 1));
+          return v8::Local<v8::Value>(v8::Integer::New(isolate, i));
+        }
+      }
+      break;
+    case TAG_DOUBLE:
+      if (data.size() == sizeof(double)) {
+        double d;
+        memcpy(&d, data.begin(), sizeof(double));
+        return v8::Local<v8::Value>(v8::Number::New(isolate, d));
+      }
+      break;
+    case TAG_ONE_BYTE_STRING:
+      KJ_IF_MAYBE(length, readLength()) {
+        return v8::Local<v8::Value>(v8StrFromLatin1(isolate, data));
+      }
+      break;
+    case TAG_TWO_BYTE_STRING:
+      KJ_IF_MAYBE(length, readLength()) {
+        if (*length % 2 != 0) break;
+        auto chars = kj::heapArray<uint16_t>(*length / 2);
+        memcpy(chars.begin(), data.begin(), *length);
+        return v8::Local<v8::Value>(v8Str(isolate, chars.asPtr()));
+      }
+      break;
+    case TAG_ARRAY_BUFFER:
+      KJ_IF_MAYBE(length, readLength()) {
+        auto buffer = v8::ArrayBuffer::New(isolate, *length);
+        if (*length > 0) memcpy(buffer->Data(), data.begin(), *length);
+        return v8::Local<v8::Value>(buffer);
+      }
+      break;
+  }
+
+  return nullptr;
+}
+
 v8::Local<v8::Value> structuredClone(
     v8::Local<v8::Value> value,
     v8::Isolate* isolate,
@@ -115,6 +115,21 @@ protected:
 };
 constexpr SerializedBufferDisposer SERIALIZED_BUFFER_DISPOSER;
 
+kj::Maybe<kj::Array<kj::byte>> trySerializeSimpleValue(
+    v8::Isolate* isolate, v8::Local<v8::Value> value);
+// Produces the same bytes v8::ValueSerializer would, header included, for undefined, null,
+// booleans, numbers, strings and ArrayBuffers, without constructing a serializer. Returns null for
+// anything else, which must go through Serializer. The output is ordinary V8 wire format
+// (version 15), so it can be read back by Deserializer, or by a process that doesn't know about
+// this fast path.
+
+kj::Maybe<v8::Local<v8::Value>> tryDeserializeSimpleValue(
+    v8::Isolate* isolate, kj::ArrayPtr<const kj::byte> data);
+// The reverse of trySerializeSimpleValue(): if `data` is a V8 header (version 13 to 15) followed
+// by just one of the values it handles, returns that value without constructing a deserializer.
+// Returns null for anything else, including malformed data, which must then go through
+// Deserializer.
+
 v8::Local<v8::Value> structuredClone(
     v8::Local<v8::Value> value,
     v8::Isolate* isolate,
@@ -63,11 +63,17 @@ JSG_DECLARE_ISOLATE_TYPE(ConfigIsolate, ConfigContext, ConfigContext::Nested,
     ConfigContext::OtherNested);
 
 KJ_TEST("configuration values reach nested type declarations") {
+  auto lookUpNested = [](ConfigIsolate::Lock& lock) {
+    auto context = lock.newContext<ConfigContext>().getHandle(lock.v8Isolate);
+    v8::Context::Scope contextScope(context);
+    check(context->Global()->Get(context, v8StrIntern(lock.v8Isolate, "Nested")));
+  };
+
   {
     ConfigIsolate isolate(v8System, 123);
     ConfigIsolate::Lock lock(isolate);
     v8::HandleScope handleScope(lock.v8Isolate);
-    lock.newContext<ConfigContext>().getHandle(lock.v8Isolate);
+    lookUpNested(lock);
   }
   {
     KJ_EXPECT_LOG(ERROR, "failed: expected configuration == 123");
@@ -75,9 +81,20 @@ KJ_TEST("configuration values reach nested type declarations") {
     ConfigIsolate isolate(v8System, 456);
     ConfigIsolate::Lock lock(isolate);
     v8::HandleScope handleScope(lock.v8Isolate);
-    lock.newContext<ConfigContext>().getHandle(lock.v8Isolate);
+    lookUpNested(lock);
   }
 }
 
+KJ_TEST("nested types are only built when first looked up") {
+  // Nested's declaration would fail its expectation with this configuration, but nothing looks
+  // it up.
+  ConfigIsolate isolate(v8System, 456);
+  ConfigIsolate::Lock lock(isolate);
+  v8::HandleScope handleScope(lock.v8Isolate);
+  auto context = lock.newContext<ConfigContext>().getHandle(lock.v8Isolate);
+  v8::Context::Scope contextScope(context);
+  check(context->Global()->Get(context, v8StrIntern(lock.v8Isolate, "OtherNested")));
+}
+
 }  // namespace
 }  // namespace workerd::jsg::test
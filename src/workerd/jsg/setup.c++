@@ -13,6 +13,10 @@
 #include <ucontext.h>
 #include <v8-cppgc.h>
 
+#if __linux__
+#include <sched.h>
+#endif
+
 #ifdef WORKERD_ICU_DATA_EMBED
 #include <icudata-embed.capnp.h>
 #include <unicode/udata.h>
@@ -50,13 +54,45 @@ public:
 const PlatformDisposer PlatformDisposer::instance {};
 
 kj::Own<v8::Platform> defaultPlatform(uint backgroundThreadCount) {
-  return kj::Own<v8::Platform>(
-      v8::platform::NewDefaultPlatform(
-        backgroundThreadCount,  // default thread pool size
-        v8::platform::IdleTaskSupport::kDisabled,  // TODO(perf): investigate enabling
-        v8::platform::InProcessStackDumping::kDisabled,  // KJ's stack traces are better
-        nullptr)  // default TracingController
-      .release(), PlatformDisposer::instance);
+  return defaultPlatform(PlatformOptions { .backgroundThreadCount = backgroundThreadCount });
+}
+
+kj::Own<v8::Platform> defaultPlatform(const PlatformOptions& options) {
+  auto create = [&]() {
+    return kj::Own<v8::Platform>(
+        v8::platform::NewDefaultPlatform(
+          options.backgroundThreadCount,  // default thread pool size
+          options.idleTasks ? v8::platform::IdleTaskSupport::kEnabled
+                            : v8::platform::IdleTaskSupport::kDisabled,
+          v8::platform::InProcessStackDumping::kDisabled,  // KJ's stack traces are better
+          nullptr)  // default TracingController
+        .release(), PlatformDisposer::instance);
+  };
+
+  if (options.backgroundThreadCpus.size() == 0) {
+    return create();
+  }
+
+#if __linux__
+  // NewDefaultPlatform() starts the worker threads before returning, and new threads inherit the
+  // CPU affinity of the thread that creates them. So, narrow this thread's affinity while the
+  // platform is created, then put it back.
+  cpu_set_t original;
+  KJ_SYSCALL(sched_getaffinity(0, sizeof(original), &original));
+
+  cpu_set_t pinned;
+  CPU_ZERO(&pinned);
+  for (uint cpu: options.backgroundThreadCpus) {
+    KJ_REQUIRE(cpu < CPU_SETSIZE, "CPU index out of range", cpu);
+    CPU_SET(cpu, &pinned);
+  }
+  KJ_SYSCALL(sched_setaffinity(0, sizeof(pinned), &pinned));
+  KJ_DEFER(sched_setaffinity(0, sizeof(original), &original));
+
+  return create();
+#else
+  KJ_FAIL_REQUIRE("pinning V8 background threads to CPUs is only supported on Linux");
+#endif
 }
 
 static kj::Own<v8::Platform> userPlatform(v8::Platform& platform) {
@@ -68,6 +104,10 @@ static kj::Own<v8::Platform> userPlatform(v8::Platform& platform) {
 
 V8System::V8System(): V8System(defaultPlatform(0), nullptr) {}
 V8System::V8System(kj::ArrayPtr<const kj::StringPtr> flags): V8System(defaultPlatform(0), flags) {}
+V8System::V8System(const PlatformOptions& options, kj::ArrayPtr<const kj::StringPtr> flags)
+    : V8System(defaultPlatform(options), flags) {
+  idleTasks = options.idleTasks;
+}
 V8System::V8System(v8::Platform& platformParam): V8System(platformParam, nullptr) {}
 V8System::V8System(v8::Platform& platformParam, kj::ArrayPtr<const kj::StringPtr> flags)
     : V8System(userPlatform(platformParam), flags) {}
@@ -148,6 +188,23 @@ void IsolateBase::terminateExecution() const {
   ptr->TerminateExecution();
 }
 
+bool IsolateBase::runIdleGc(kj::Badge<Lock>, kj::Duration budget) {
+  // Let the collector see memory freed or allocated since the lock was taken.
+  reportExternalMemory();
+
+  // V8 measures the deadline against the platform's clock.
+  double deadline = system.platform->MonotonicallyIncreasingTime() +
+      double(budget / kj::NANOSECONDS) / 1e9;
+  if (system.idleTasks) {
+    // Idle tasks V8 has posted for this isolate, e.g. finalizing lazy compilation or flushing
+    // bytecode of functions that haven't run in a while. This returns once the queue is empty or
+    // the deadline has passed; whatever time is left goes to GC below.
+    v8::platform::RunIdleTasks(system.platform.get(), ptr,
+        double(budget / kj::NANOSECONDS) / 1e9);
+  }
+  return ptr->IdleNotificationDeadline(deadline);
+}
+
 void IsolateBase::clearDestructionQueue() {
   // Safe to destroy the popped batch outside of the lock because the lock is only actually used to
   // guard the push buffer.
@@ -155,6 +212,13 @@ void IsolateBase::clearDestructionQueue() {
   auto drop = queue.lockExclusive()->pop();
 }
 
+void IsolateBase::reportExternalMemory() {
+  auto delta = externalMemory->takeUnreported();
+  if (delta != 0) {
+    ptr->AdjustAmountOfExternalAllocatedMemory(delta);
+  }
+}
+
 HeapTracer::HeapTracer(v8::Isolate* isolate): isolate(isolate) {
   isolate->AddGCPrologueCallback(
       [](v8::Isolate* isolate, v8::GCType type, v8::GCCallbackFlags flags, void* data) {
@@ -174,6 +238,14 @@ HeapTracer::HeapTracer(v8::Isolate* isolate): isolate(isolate) {
     reinterpret_cast<HeapTracer*>(data)->clearFreelistedShims();
   }, this, v8::GCType::kGCTypeMarkSweepCompact);
 
+  isolate->AddGCPrologueCallback(
+      [](v8::Isolate* isolate, v8::GCType type, v8::GCCallbackFlags flags, void* data) {
+    // Start a new trace epoch, so that objects without wrappers are traced again in this pass
+    // (see `Wrappable::lastTraceEpoch`). This is done for every type of GC, not just full GCs,
+    // so that the epoch stays correct should minor GCs ever trace through cppgc.
+    ++reinterpret_cast<HeapTracer*>(data)->traceEpoch;
+  }, this, v8::GCType::kGCTypeAll);
+
   isolate->AddGCEpilogueCallback(
       [](v8::Isolate* isolate, v8::GCType type, v8::GCCallbackFlags flags, void* data) {
     auto& self = *reinterpret_cast<HeapTracer*>(data);
@@ -339,6 +411,9 @@ void IsolateBase::dropWrappers(kj::Own<void> typeWrapperInstance) {
   // Make sure everything in the deferred destruction queue is dropped.
   clearDestructionQueue();
 
+  // Isolate-local objects may hold handles, so drop them under lock too.
+  isolateLocals.clear();
+
   // We MUST call heapTracer.destroy(), but we can't do it yet because destroying other handles
   // may call into the heap tracer.
   KJ_DEFER(heapTracer.destroy());
@@ -25,6 +25,23 @@ kj::Own<v8::Platform> defaultPlatform(uint backgroundThreadCount);
 // if you're in a sandbox, that probably won't work. And anyway, you probably don't actually want
 // V8 to consume all available cores with background work. So, please specify a thread pool size.
 
+struct PlatformOptions {
+  uint backgroundThreadCount = 0;
+  // Size of V8's background thread pool, which runs concurrent compilation and GC tasks. See
+  // `defaultPlatform(uint)` above for why zero is a bad idea.
+
+  bool idleTasks = false;
+  // Whether V8 may post idle tasks -- finalizing lazily-compiled functions, flushing unused code,
+  // memory reduction -- to be run when an isolate has nothing else to do. They only run when the
+  // embedder calls `Lock::runIdleGc()`; until then they simply queue up.
+
+  kj::ArrayPtr<const uint> backgroundThreadCpus = nullptr;
+  // If non-empty, the background threads may only run on these CPUs. Only supported on Linux.
+};
+
+kj::Own<v8::Platform> defaultPlatform(const PlatformOptions& options);
+// Like `defaultPlatform(uint)`, with more knobs.
+
 class V8System {
   // In order to use any part of the JSG API, you must first construct a V8System. You can only
   // construct one of these per process. This performs process-wide initialization of the V8
@@ -47,6 +64,10 @@ public:
   explicit V8System(v8::Platform& platform, kj::ArrayPtr<const kj::StringPtr> flags);
   // Use a possibly-custom v8::Platform implementation, and apply flags.
 
+  explicit V8System(const PlatformOptions& options, kj::ArrayPtr<const kj::StringPtr> flags);
+  // Use the default v8::Platform implementation, created with `defaultPlatform(options)`, and
+  // apply flags.
+
   ~V8System() noexcept(false);
 
   typedef void FatalErrorCallback(kj::StringPtr location, kj::StringPtr message);
@@ -54,6 +75,9 @@ public:
 
 private:
   kj::Own<v8::Platform> platform;
+  bool idleTasks = false;
+  // True if `platform` is V8's default platform created with idle task support, in which case
+  // `v8::platform::RunIdleTasks()` may be called on it.
   friend class IsolateBase;
 
   explicit V8System(kj::Own<v8::Platform>, kj::ArrayPtr<const kj::StringPtr>);
@@ -90,6 +114,11 @@ public:
     exportCommonJsDefault = exportDefault;
   }
 
+  bool runIdleGc(kj::Badge<Lock>, kj::Duration budget);
+  // See Lock::runIdleGc().
+
+  const ExternalMemoryTracker& getExternalMemory() const { return *externalMemory; }
+
   inline bool areWarningsLogged() const { return maybeLogger != nullptr; }
 
   inline void logWarning(Lock& js, kj::StringPtr message) {
@@ -99,6 +128,19 @@ public:
     KJ_IF_MAYBE(logger, maybeLogger) { (*logger)(js, message); }
   }
 
+  template <typename T>
+  T& getIsolateLocal(Lock& js) {
+    // Returns this isolate's instance of T, default-constructing it on first use. This lets API
+    // implementations keep per-isolate state, such as caches, without the isolate knowing their
+    // types. The instance is destroyed under the isolate lock before the isolate is disposed, so
+    // it may hold V8Refs.
+    static const char KEY = 0;
+    auto& value = isolateLocals.findOrCreate(&KEY, []() {
+      return decltype(isolateLocals)::Entry { &KEY, kj::heap<T>() };
+    });
+    return *static_cast<T*>(value.get());
+  }
+
 private:
   template <typename TypeWrapper>
   friend class Isolate;
@@ -140,6 +182,13 @@ private:
 
   kj::Maybe<kj::Function<Logger>> maybeLogger;
 
+  kj::Own<const ExternalMemoryTracker> externalMemory =
+      kj::atomicRefcounted<ExternalMemoryTracker>();
+  // See Lock::getExternalMemory(). Reported to V8 by reportExternalMemory().
+
+  kj::HashMap<const void*, kj::Own<void>> isolateLocals;
+  // See getIsolateLocal(). Keyed on a static address unique to each type.
+
   v8::Global<v8::FunctionTemplate> opaqueTemplate;
   // FunctionTemplate used by Wrappable::attachOpaqueWrapper(). Just a constructor for an empty
   // object with 2 internal fields.
@@ -190,6 +239,10 @@ private:
   void clearDestructionQueue();
   // Destroy everything in the deferred destruction queue. Must be called under the isolate lock.
 
+  void reportExternalMemory();
+  // Tell V8 how external memory has changed since the last call. Must be called under the isolate
+  // lock.
+
   static void fatalError(const char* location, const char* message);
   static void oomError(const char* location, const v8::OOMDetails& details);
 
@@ -307,6 +360,7 @@ public:
     Lock(const Isolate& isolate)
         : jsg::Lock(isolate.ptr), jsgIsolate(const_cast<Isolate&>(isolate)) {
       jsgIsolate.clearDestructionQueue();
+      jsgIsolate.reportExternalMemory();
     }
 
     template <typename T>
@@ -87,6 +87,13 @@ kj::Array<uint32_t> writeFromV8String(v8::Isolate *isolate, v8::Local<v8::Value>
   auto string = check(value->ToString(isolate->GetCurrentContext()));
   if (string->Length() == 0) return kj::Array<uint32_t>();
 
+  if (string->IsOneByte()) {
+    // Latin1 code units are code points, with no surrogates to pair up.
+    auto latin1 = kj::heapArray<uint8_t>(string->Length());
+    string->WriteOneByte(isolate, latin1.begin(), 0, -1, v8::String::NO_NULL_TERMINATION);
+    return KJ_MAP(c, latin1) -> uint32_t { return c; };
+  }
+
   auto buffer = kj::heapArray<uint16_t>(string->Length());
   string->Write(isolate, buffer.begin(), 0, -1, v8::String::NO_NULL_TERMINATION);
 
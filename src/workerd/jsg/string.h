@@ -418,6 +418,9 @@ class UsvStringBuilder {
 public:
   UsvStringBuilder() = default;
   UsvStringBuilder(size_t reservedSize) { reserve(reservedSize); }
+  explicit UsvStringBuilder(UsvString&& string): buffer(kj::mv(string.buffer)) {}
+  // Takes over the storage of `string` without copying. If nothing is appended, finish() hands
+  // the same storage back without copying either.
   UsvStringBuilder(UsvStringBuilder&& other) = default;
   UsvStringBuilder& operator=(UsvStringBuilder&& other) = default;
 
@@ -101,6 +101,34 @@ private:
   }
 };
 
+class TraceCounter: public jsg::Object {
+  // Counts how many times it is visited. Never given to JavaScript, so it never has a wrapper.
+
+public:
+  uint visits = 0;
+
+  JSG_RESOURCE_TYPE(TraceCounter) {}
+
+private:
+  void visitForGc(GcVisitor& visitor) {
+    ++visits;
+  }
+};
+
+class TraceCounterHolder: public jsg::Object {
+public:
+  explicit TraceCounterHolder(jsg::Ref<TraceCounter> inner): inner(kj::mv(inner)) {}
+
+  jsg::Ref<TraceCounter> inner;
+
+  JSG_RESOURCE_TYPE(TraceCounterHolder) {}
+
+private:
+  void visitForGc(GcVisitor& visitor) {
+    visitor.visit(inner);
+  }
+};
+
 struct TraceTestContext: public Object {
   kj::Maybe<jsg::Ref<NumberBox>> strongRef;
   // A strong reference to a NumberBox which may be get and set.
@@ -129,6 +157,21 @@ struct TraceTestContext: public Object {
     return kj::arr(kj::mv(obj1), kj::mv(obj2));
   }
 
+  kj::Maybe<jsg::Ref<TraceCounter>> traceCounter;
+
+  kj::Array<jsg::Ref<TraceCounterHolder>> makeTraceCounterHolders() {
+    // Two holders sharing one wrapper-less object.
+    auto counter = jsg::alloc<TraceCounter>();
+    auto result = kj::arr(jsg::alloc<TraceCounterHolder>(counter.addRef()),
+                          jsg::alloc<TraceCounterHolder>(counter.addRef()));
+    traceCounter = kj::mv(counter);
+    return result;
+  }
+
+  uint getTraceCount() {
+    return KJ_REQUIRE_NONNULL(traceCounter)->visits;
+  }
+
   void assert_(bool condition, jsg::Optional<kj::String> message) {
     JSG_ASSERT(condition, Error, message.orDefault(nullptr));
   }
@@ -140,13 +183,16 @@ struct TraceTestContext: public Object {
     JSG_NESTED_TYPE(ValueBox);
     JSG_METHOD(makeGcDetectorPair);
     JSG_METHOD(makeGcDetectorBoxPair);
+    JSG_METHOD(makeTraceCounterHolders);
+    JSG_READONLY_PROTOTYPE_PROPERTY(traceCount, getTraceCount);
     JSG_METHOD_NAMED(assert, assert_);
     JSG_PROTOTYPE_PROPERTY(strongRef, getStrongRef, setStrongRef);
   }
 };
 
 JSG_DECLARE_ISOLATE_TYPE(TraceTestIsolate, TraceTestContext, NumberBox,
-                         NumberBoxHolder, GcDetector, GcDetectorBox, ValueBox);
+                         NumberBoxHolder, GcDetector, GcDetectorBox, ValueBox,
+                         TraceCounter, TraceCounterHolder);
 
 KJ_TEST("GC collects objects when expected") {
   Evaluator<TraceTestContext, TraceTestIsolate> e(v8System);
@@ -276,5 +322,18 @@ KJ_TEST("TracedReference usage does not lead to crashes") {
       "holder.inner.value", "number", "123");
 }
 
+KJ_TEST("GC traces through an object without a wrapper once per pass") {
+  Evaluator<TraceTestContext, TraceTestIsolate> e(v8System);
+
+  e.expectEval(R"(
+    let holders = makeTraceCounterHolders();
+    gc();
+    let before = traceCount;
+    gc();
+    assert(traceCount - before == 1, "traced " + (traceCount - before) + " times");
+    holders.length
+  )", "number", "2");
+}
+
 }  // namespace
 }  // namespace workerd::jsg::test
@@ -813,6 +813,88 @@ private:
 using ExternOneByteString = ExternString<v8::String::ExternalOneByteStringResource, char>;
 using ExternTwoByteString = ExternString<v8::String::ExternalStringResource, uint16_t>;
 
+namespace {
+
+class OwnedExternOneByteString final: public v8::String::ExternalOneByteStringResource {
+  // An external string which owns its buffer. V8 calls Dispose(), which deletes this, once the
+  // string has been collected.
+public:
+  explicit OwnedExternOneByteString(kj::String str): str(kj::mv(str)) {}
+
+  const char* data() const override { return str.begin(); }
+  size_t length() const override { return str.size(); }
+
+private:
+  kj::String str;
+};
+
+constexpr size_t MIN_EXTERNAL_STRING_LENGTH = 64 * 1024;
+// Below this size, copying into V8's heap is cheaper than the bookkeeping V8 does for each
+// external string.
+
+bool isAscii(kj::ArrayPtr<const char> chars) {
+  for (char c: chars) {
+    if (static_cast<kj::byte>(c) >= 0x80) return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+v8::Local<v8::String> v8Str(v8::Isolate* isolate, kj::String&& str) {
+  // V8's one-byte strings are Latin1, so only ASCII can be shared as-is with a UTF-8 kj::String.
+  if (str.size() >= MIN_EXTERNAL_STRING_LENGTH && isAscii(str)) {
+    auto resource = new OwnedExternOneByteString(kj::mv(str));
+    v8::Local<v8::String> result;
+    if (!v8::String::NewExternalOneByte(isolate, resource).ToLocal(&result)) {
+      // The string is too long for V8, which has thrown.
+      delete resource;
+      throw JsExceptionThrown();
+    }
+    return result;
+  }
+  return v8Str(isolate, str.asPtr());
+}
+
+kj::String toKjString(v8::Isolate* isolate, v8::Local<v8::String> str) {
+  if (str->IsOneByte()) {
+    size_t length = str->Length();
+    auto buf = kj::heapArray<char>(length + 1);
+    str->WriteOneByte(isolate, reinterpret_cast<uint8_t*>(buf.begin()), 0, length,
+                      v8::String::NO_NULL_TERMINATION);
+    auto latin1 = buf.slice(0, length);
+
+    size_t highBytes = 0;
+    for (char c: latin1) {
+      if (static_cast<kj::byte>(c) >= 0x80) ++highBytes;
+    }
+    if (highBytes == 0) {
+      buf[length] = '\0';
+      return kj::String(kj::mv(buf));
+    }
+
+    // Code points U+0080 to U+00FF take two bytes in UTF-8.
+    auto utf8 = kj::heapArray<char>(length + highBytes + 1);
+    auto out = utf8.begin();
+    for (char c: latin1) {
+      auto b = static_cast<kj::byte>(c);
+      if (b < 0x80) {
+        *out++ = b;
+      } else {
+        *out++ = 0xc0 | (b >> 6);
+        *out++ = 0x80 | (b & 0x3f);
+      }
+    }
+    *out = '\0';
+    return kj::String(kj::mv(utf8));
+  }
+
+  auto buf = kj::heapArray<char>(str->Utf8Length(isolate) + 1);
+  str->WriteUtf8(isolate, buf.begin(), buf.size());
+  buf[buf.size() - 1] = 0;
+  return kj::String(kj::mv(buf));
+}
+
 v8::MaybeLocal<v8::String> newExternalOneByteString(Lock& js, kj::ArrayPtr<const char> buf) {
   return ExternOneByteString::createExtern(js.v8Isolate, buf);
 }
@@ -219,6 +219,17 @@ inline v8::Local<v8::String> v8Str(v8::Isolate* isolate, kj::StringPtr str,
   return v8Str(isolate, str.asArray(), newType);
 }
 
+v8::Local<v8::String> v8Str(v8::Isolate* isolate, kj::String&& str);
+// Like v8Str(isolate, kj::StringPtr), but takes ownership of the string. A large ASCII-only
+// string -- a response body read as text, say -- is not copied into V8's heap: it becomes an
+// external string backed by the kj::String's buffer, which is freed when V8 collects it.
+
+kj::String toKjString(v8::Isolate* isolate, v8::Local<v8::String> str);
+// Converts a JavaScript string to a UTF-8 kj::String. Strings that V8 stores as Latin1 -- which
+// is most of them, since that's how it stores ASCII text -- are copied out with a single
+// WriteOneByte(), and transcoded only if they turn out not to be ASCII, rather than taking
+// separate passes to measure and write their UTF-8 form.
+
 inline v8::Local<v8::String> v8StrFromLatin1(
     v8::Isolate* isolate,
     kj::ArrayPtr<const kj::byte> ptr,
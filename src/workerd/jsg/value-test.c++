@@ -798,8 +798,21 @@ struct StringContext: public Object {
   kj::String takeString(kj::String s) {
     return kj::mv(s);
   }
+  double takeStringUtf8Length(kj::String s) {
+    return s.size();
+  }
+  kj::String makeRepeatedString(kj::String s, double count) {
+    kj::Vector<char> result;
+    for (uint i = 0; i < count; i++) {
+      result.addAll(s);
+    }
+    result.add('\0');
+    return kj::String(result.releaseAsArray());
+  }
   JSG_RESOURCE_TYPE(StringContext) {
     JSG_METHOD(takeString);
+    JSG_METHOD(takeStringUtf8Length);
+    JSG_METHOD(makeRepeatedString);
   }
 };
 JSG_DECLARE_ISOLATE_TYPE(StringIsolate, StringContext);
@@ -816,6 +829,17 @@ KJ_TEST("kj::Strings") {
   e.expectEval("takeString('an actual string')", "string", "an actual string");
   e.expectEval("takeString({ toString: function() { return 'toString()ed'; } })",
                "string", "toString()ed");
+
+  // Latin1 strings, which V8 stores one byte per character, are transcoded to UTF-8.
+  e.expectEval("takeStringUtf8Length('abc')", "number", "3");
+  e.expectEval("takeStringUtf8Length('caf\\xe9')", "number", "5");
+  e.expectEval("takeString('caf\\xe9 \\xff') === 'caf\\xe9 \\xff'", "boolean", "true");
+  e.expectEval("takeStringUtf8Length('caf\\u00e9\\u2603')", "number", "8");
+
+  // Large ASCII strings are handed to V8 without copying.
+  e.expectEval("makeRepeatedString('ab', 100000).length", "number", "200000");
+  e.expectEval("makeRepeatedString('ab', 100000).slice(-3)", "string", "bab");
+  e.expectEval("makeRepeatedString('\\u2603', 30000).length", "number", "30000");
 }
 
 // ========================================================================================
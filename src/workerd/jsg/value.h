@@ -442,6 +442,19 @@ public:
     return v8Str(isolate, value);
   }
 
+  v8::Local<v8::String> wrap(
+      v8::Local<v8::Context> context, kj::Maybe<v8::Local<v8::Object>> creator,
+      kj::String&& value) {
+    return wrap(context->GetIsolate(), creator, kj::mv(value));
+  }
+
+  v8::Local<v8::String> wrap(
+      v8::Isolate* isolate, kj::Maybe<v8::Local<v8::Object>> creator,
+      kj::String&& value) {
+    // An owned string may be handed to V8 without copying; see v8Str(isolate, kj::String&&).
+    return v8Str(isolate, kj::mv(value));
+  }
+
   v8::Local<v8::String> wrap(
       v8::Local<v8::Context> context, kj::Maybe<v8::Local<v8::Object>> creator,
       const ByteString& value) {
@@ -453,11 +466,7 @@ public:
       v8::Local<v8::Context> context, v8::Local<v8::Value> handle, kj::String*,
       kj::Maybe<v8::Local<v8::Object>> parentObject) {
     v8::Local<v8::String> str = check(handle->ToString(context));
-    v8::Isolate* isolate = context->GetIsolate();
-    auto buf = kj::heapArray<char>(str->Utf8Length(isolate) + 1);
-    str->WriteUtf8(isolate, buf.begin(), buf.size());
-    buf[buf.size() - 1] = 0;
-    return kj::String(kj::mv(buf));
+    return toKjString(context->GetIsolate(), str);
   }
 
   kj::Maybe<ByteString> tryUnwrap(
@@ -465,18 +474,15 @@ public:
       kj::Maybe<v8::Local<v8::Object>> parentObject) {
     // TODO(cleanup): Move to a HeaderStringWrapper in the api directory.
     v8::Local<v8::String> str = check(handle->ToString(context));
-    auto result = ByteString(KJ_ASSERT_NONNULL(tryUnwrap(context, str, (kj::String*)nullptr, parentObject)));
-    if (str->ContainsOnlyOneByte()) {
-      auto buf = kj::heapArray<kj::byte>(str->Length() + 1);
-      str->WriteOneByte(context->GetIsolate(), buf.begin());
-      for (auto b: buf) {
-        if (b >= 128) {
-          result.warning = ByteString::Warning::CONTAINS_EXTENDED_ASCII;
-          break;
-        }
+    auto result = ByteString(toKjString(context->GetIsolate(), str));
+    for (char c: result) {
+      if (static_cast<kj::byte>(c) >= 128) {
+        // Not ASCII. Whether the string fits in Latin1 decides which warning applies.
+        result.warning = str->ContainsOnlyOneByte()
+            ? ByteString::Warning::CONTAINS_EXTENDED_ASCII
+            : ByteString::Warning::CONTAINS_UNICODE;
+        break;
       }
-    } else {
-      result.warning = ByteString::Warning::CONTAINS_UNICODE;
     }
     return kj::mv(result);
   }
@@ -895,9 +901,22 @@ public:
     return "ArrayBuffer or ArrayBufferView";
   }
 
+  static constexpr size_t MAX_COPIED_ARRAY_BUFFER_SIZE = 64;
+  // Arrays up to this size are copied into a new ArrayBuffer rather than handed over to V8.
+
   v8::Local<v8::ArrayBuffer> wrap(
       v8::Isolate* isolate, kj::Maybe<v8::Local<v8::Object>> creator,
       kj::Array<byte> value) {
+    if (value.size() <= MAX_COPIED_ARRAY_BUFFER_SIZE) {
+      // For small arrays, copying into a buffer V8 allocates itself is cheaper than setting up a
+      // BackingStore with a deleter, and lets `value` be freed right away.
+      auto result = v8::ArrayBuffer::New(isolate, value.size());
+      if (value.size() > 0) {
+        memcpy(result->Data(), value.begin(), value.size());
+      }
+      return result;
+    }
+
     // We need to construct a BackingStore that owns the byte array. We use the version of
     // v8::ArrayBuffer::NewBackingStore() that accepts a deleter callback, and arrange for it to
     // delete an Array<byte> placed on the heap.
@@ -907,7 +926,9 @@ public:
     //   "deleter_data" for NewBackingStore. However, KJ doesn't give us any way to decompose an
     //   Array<T> this way, and it might not want to, as this could make it impossible to support
     //   unifying Array<T> and Vector<T> in the future (i.e. making all Array<T>s growable). So
-    //   it may be best to stick with allocating an Array<byte> on the heap after all...
+    //   it may be best to stick with allocating an Array<byte> on the heap after all... Pooling
+    //   the holders instead wouldn't obviously win: V8 may call the deleter from a background
+    //   thread, so the pool would need to be synchronized.
     byte* begin = value.begin();
     size_t size = value.size();
     auto ownerPtr = new kj::Array<byte>(kj::mv(value));
@@ -988,10 +1009,7 @@ public:
     // TypeErrorContext, or worrying about whether the tryUnwrap(kj::String*) version will ever be
     // modified to return nullptr in the future.
     const auto convertToUtf8 = [isolate = context->GetIsolate()](v8::Local<v8::String> v8String) {
-      auto buf = kj::heapArray<char>(v8String->Utf8Length(isolate) + 1);
-      v8String->WriteUtf8(isolate, buf.begin(), buf.size());
-      buf[buf.size() - 1] = 0;
-      return kj::String(kj::mv(buf));
+      return toKjString(isolate, v8String);
     };
 
     if (!handle->IsObject() || handle->IsArray()) {
@@ -372,9 +372,13 @@ void Wrappable::visitRef(GcVisitor& visitor, kj::Maybe<Wrappable&>& refParent, b
     } else {
       // This object doesn't currently have a wrapper, so traces must transitively trace through
       // it. However, as an optimization, we can skip the trace if we've already been traced in
-      // this trace pass.
-      GcVisitor subVisitor(*this, visitor.cppgcVisitor);
-      jsgVisitForGc(subVisitor);
+      // this trace pass: tracing the same references again would mark nothing new.
+      auto epoch = HeapTracer::getTracer(isolate).getTraceEpoch();
+      if (lastTraceEpoch != epoch) {
+        lastTraceEpoch = epoch;
+        GcVisitor subVisitor(*this, visitor.cppgcVisitor);
+        jsgVisitForGc(subVisitor);
+      }
     }
   }
 }
@@ -159,6 +159,12 @@ private:
   kj::ListLink<Wrappable> link;
   // When `wrapperRef` is non-empty, the Wrappable is a member of the list `HeapTracer::wrappers`.
 
+  uint lastTraceEpoch = 0;
+  // `HeapTracer::traceEpoch` as of the last time a GC trace passed through this object while it
+  // had no wrapper. An object without a wrapper is traced transitively by each wrapper that
+  // reaches it, so this lets a trace pass skip it after the first time, instead of re-walking
+  // the same subgraph once per path that leads to it.
+
   friend class GcVisitor;
   friend class HeapTracer;
 };
@@ -192,6 +198,9 @@ public:
   Wrappable::CppgcShim* allocateShim(Wrappable& wrappable);
   void clearFreelistedShims();
 
+  uint getTraceEpoch() const { return traceEpoch; }
+  // Number of GC passes started so far. Compared against `Wrappable::lastTraceEpoch`.
+
   // implements EmbedderRootsHandler -------------------------------------------
   bool IsRoot(const v8::TracedReference<v8::Value>& handle) override;
   void ResetRoot(const v8::TracedReference<v8::Value>& handle) override;
@@ -209,6 +218,10 @@ private:
   kj::Maybe<Wrappable::CppgcShim&> freelistedShims;
   // List of shim objects for wrappers that were collected during a minor GC. The shim objects
   // can be reused for future allocations.
+
+  uint traceEpoch = 0;
+  // Incremented in the prologue of every GC pass. Traces are atomic (see the CppHeap setup in
+  // setup.c++), so a pass never sees objects marked with its own epoch from an earlier pass.
 };
 
 #define DISALLOW_KJ_IO_DESTRUCTORS_SCOPE \
@@ -0,0 +1,75 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "actor-placement.h"
+#include <kj/async-io.h>
+#include <kj/test.h>
+#include <kj/thread.h>
+
+namespace workerd::server {
+namespace {
+
+KJ_TEST("ActorPlacement homes each object on one thread") {
+  auto placement = kj::atomicRefcounted<ActorPlacement>(4);
+
+  uint perThread[4] = {0, 0, 0, 0};
+  for (uint i = 0; i < 1000; i++) {
+    auto id = kj::str("object-", i);
+    uint home = placement->getHomeThread(id);
+    KJ_ASSERT(home < 4);
+    KJ_EXPECT(placement->getHomeThread(id) == home);
+    ++perThread[home];
+  }
+  for (auto count: perThread) {
+    KJ_EXPECT(count > 150, count);
+  }
+}
+
+KJ_TEST("ActorPlacement connects to another thread") {
+  auto io = kj::setupAsyncIo();
+  auto placement = kj::atomicRefcounted<ActorPlacement>(2);
+
+  // Not serving yet, so the connection waits for the thread to register.
+  auto promise = placement->connect(1);
+  KJ_EXPECT(!promise.poll(io.waitScope));
+
+  kj::Own<kj::Thread> thread = kj::heap<kj::Thread>([&]() {
+    auto threadIo = kj::setupAsyncIo();
+    auto paf = kj::newPromiseAndFulfiller<void>();
+
+    struct Acceptor final: public ActorPlacement::Thread {
+      kj::LowLevelAsyncIoProvider& provider;
+      kj::PromiseFulfiller<void>& done;
+      kj::Maybe<kj::Promise<void>> write;
+
+      Acceptor(kj::LowLevelAsyncIoProvider& provider, kj::PromiseFulfiller<void>& done)
+          : provider(provider), done(done) {}
+
+      void acceptConnection(kj::AutoCloseFd fd) override {
+        auto stream = provider.wrapSocketFd(kj::mv(fd));
+        auto& ref = *stream;
+        write = ref.write("hello", 5).attach(kj::mv(stream)).then([this]() {
+          done.fulfill();
+        }).eagerlyEvaluate(nullptr);
+      }
+    };
+    Acceptor acceptor(*threadIo.lowLevelProvider, *paf.fulfiller);
+
+    auto registration = placement->registerThread(1, acceptor);
+    paf.promise.wait(threadIo.waitScope);
+  });
+
+  auto fd = promise.wait(io.waitScope);
+  auto stream = io.lowLevelProvider->wrapSocketFd(kj::mv(fd));
+  char buffer[6] = {};
+  stream->read(buffer, 5).wait(io.waitScope);
+  KJ_EXPECT(kj::StringPtr(buffer) == "hello");
+
+  // Once the thread has stopped serving, there's no waiting for it.
+  thread = nullptr;
+  KJ_EXPECT_THROW_MESSAGE("no longer serving", placement->connect(1).wait(io.waitScope));
+}
+
+}  // namespace
+}  // namespace workerd::server
@@ -0,0 +1,102 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "actor-placement.h"
+#include <kj/debug.h>
+#include <kj/hash.h>
+#include <sys/socket.h>
+
+namespace workerd::server {
+
+ActorPlacement::ActorPlacement(uint threadCount)
+    : threadCount(threadCount),
+      threads(kj::heapArray<Slot>(threadCount)) {
+  KJ_REQUIRE(threadCount > 0);
+}
+
+uint ActorPlacement::getHomeThread(kj::StringPtr actorId) const {
+  // IDs of Durable Objects are hashes already, but names of ephemeral objects may not be, so
+  // hash them either way.
+  return kj::hashCode(actorId) % threadCount;
+}
+
+kj::Own<void> ActorPlacement::registerThread(uint index, Thread& thread) const {
+  KJ_REQUIRE(index < threadCount);
+  kj::Vector<kj::Own<kj::CrossThreadPromiseFulfiller<void>>> waiters;
+  {
+    auto lock = threads.lockExclusive();
+    auto& slot = (*lock)[index];
+    KJ_REQUIRE(slot.registration == nullptr, "thread already registered", index);
+    slot.registration = Registration { &thread, kj::getCurrentThreadExecutor().addRef() };
+    slot.stopped = false;
+    waiters = kj::mv(slot.waiters);
+  }
+
+  // Connections requested before the thread started serving can go ahead now. Each retries its
+  // connect() on its own thread.
+  for (auto& waiter: waiters) {
+    waiter->fulfill();
+  }
+
+  return kj::heap(kj::defer([self = kj::atomicAddRef(*this), index]() {
+    kj::Vector<kj::Own<kj::CrossThreadPromiseFulfiller<void>>> waiters;
+    {
+      auto lock = self->threads.lockExclusive();
+      auto& slot = (*lock)[index];
+      slot.registration = nullptr;
+      slot.stopped = true;
+      waiters = kj::mv(slot.waiters);
+    }
+    for (auto& waiter: waiters) {
+      waiter->reject(KJ_EXCEPTION(DISCONNECTED, "thread is no longer serving", index));
+    }
+  }));
+}
+
+kj::Promise<kj::AutoCloseFd> ActorPlacement::connect(uint index) const {
+  KJ_REQUIRE(index < threadCount);
+
+  kj::Own<const kj::Executor> executor;
+  {
+    auto lock = threads.lockExclusive();
+    auto& slot = (*lock)[index];
+    KJ_IF_MAYBE(r, slot.registration) {
+      executor = r->executor->addRef();
+    } else if (slot.stopped) {
+      return KJ_EXCEPTION(DISCONNECTED, "thread is no longer serving", index);
+    } else {
+      // Not started serving yet. Try again once it has.
+      auto paf = kj::newPromiseAndCrossThreadFulfiller<void>();
+      slot.waiters.add(kj::mv(paf.fulfiller));
+      return paf.promise.then([self = kj::atomicAddRef(*this), index]() {
+        return self->connect(index);
+      });
+    }
+  }
+
+  int fds[2];
+  KJ_SYSCALL(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds));
+  kj::AutoCloseFd ours(fds[0]);
+  kj::AutoCloseFd theirs(fds[1]);
+
+  return executor->executeAsync(
+      [self = kj::atomicAddRef(*this), index, theirs = kj::mv(theirs)]() mutable {
+    // On the target thread now. Look the registration up again, since it may have been dropped
+    // while this was queued.
+    Thread* thread;
+    {
+      auto lock = self->threads.lockShared();
+      auto& r = KJ_UNWRAP_OR((*lock)[index].registration, {
+        kj::throwFatalException(
+            KJ_EXCEPTION(DISCONNECTED, "thread is no longer serving", index));
+      });
+      thread = r.thread;
+    }
+    thread->acceptConnection(kj::mv(theirs));
+  }).then([ours = kj::mv(ours)]() mutable {
+    return kj::mv(ours);
+  });
+}
+
+}  // namespace workerd::server
@@ -0,0 +1,72 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#pragma once
+
+#include <kj/async.h>
+#include <kj/io.h>
+#include <kj/mutex.h>
+#include <kj/refcount.h>
+#include <kj/string.h>
+#include <kj/vector.h>
+
+namespace workerd::server {
+
+using kj::uint;
+
+class ActorPlacement final: public kj::AtomicRefcounted {
+  // Homes each Durable Object on one of the threads of a server running on several (see
+  // `Config.threads`), so that a namespace's objects are spread across every thread's isolate
+  // instead of all waiting on one isolate lock. An object's home thread is a hash of its ID, so
+  // every thread agrees on it without coordinating, and the object never moves. Requests for an
+  // object homed elsewhere must be sent to its home thread; `connect()` provides the connection.
+  //
+  // Shared by the Servers of all threads.
+
+public:
+  explicit ActorPlacement(uint threadCount);
+  KJ_DISALLOW_COPY_AND_MOVE(ActorPlacement);
+
+  uint getThreadCount() const { return threadCount; }
+
+  uint getHomeThread(kj::StringPtr actorId) const;
+  // Returns the index of the thread that `actorId` lives on. The ID is the string form of a
+  // Durable Object ID, or an ephemeral object's name.
+
+  class Thread {
+  public:
+    virtual void acceptConnection(kj::AutoCloseFd fd) = 0;
+    // Called on the registered thread with its end of a new connection from another thread.
+  };
+
+  kj::Own<void> registerThread(uint index, Thread& thread) const;
+  // Makes `thread` the receiver of connections to thread `index`. Must be called on that thread,
+  // which must keep running its event loop until the returned handle is dropped.
+
+  kj::Promise<kj::AutoCloseFd> connect(uint index) const;
+  // Opens a connection to thread `index`. Resolves to the caller's end, a Unix stream socket,
+  // once the other end has been handed to the thread's `acceptConnection()`. If the thread
+  // hasn't registered yet -- the threads of a server start up concurrently, so one may receive
+  // requests before the others are serving -- waits for it to. Fails with DISCONNECTED if the
+  // thread has stopped serving.
+
+private:
+  uint threadCount;
+
+  struct Registration {
+    Thread* thread;
+    kj::Own<const kj::Executor> executor;
+  };
+  struct Slot {
+    kj::Maybe<Registration> registration;
+    bool stopped = false;
+    // Set once the thread's registration is dropped.
+
+    kj::Vector<kj::Own<kj::CrossThreadPromiseFulfiller<void>>> waiters;
+    // Fulfilled when the thread registers (or rejected if it stops without registering).
+  };
+  kj::MutexGuarded<kj::Array<Slot>> threads;
+};
+
+}  // namespace workerd::server
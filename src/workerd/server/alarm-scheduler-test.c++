@@ -0,0 +1,218 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "alarm-scheduler.h"
+#include <kj/test.h>
+
+namespace workerd::server {
+namespace {
+
+struct TestClock final: public kj::Clock {
+  // Calendar time that moves with the test's timer, starting at the epoch.
+
+  explicit TestClock(kj::Timer& timer): timer(timer) {}
+  kj::Timer& timer;
+
+  kj::Date now() const override {
+    return kj::UNIX_EPOCH + (timer.now() - kj::origin<kj::TimePoint>());
+  }
+};
+
+kj::Date at(int64_t seconds) {
+  return kj::UNIX_EPOCH + seconds * kj::SECONDS;
+}
+
+struct SchedulerTest {
+  kj::EventLoop loop;
+  kj::WaitScope ws;
+  kj::TimerImpl timer;
+  TestClock clock;
+  kj::Own<const kj::Directory> dir = kj::newInMemoryDirectory(kj::nullClock());
+
+  kj::Vector<kj::String> delivered;
+  kj::Vector<kj::Own<kj::PromiseFulfiller<WorkerInterface::AlarmResult>>> pending;
+  bool hold = false;
+  // If set, deliveries wait in `pending` instead of completing right away.
+  bool fail = false;
+
+  kj::Maybe<kj::Own<AlarmScheduler>> scheduler;
+
+  explicit SchedulerTest(AlarmSchedulerOptions options = {})
+      : ws(loop), timer(kj::origin<kj::TimePoint>()), clock(timer) {
+    restart(options);
+  }
+
+  AlarmScheduler& get() { return *KJ_ASSERT_NONNULL(scheduler); }
+
+  void restart(AlarmSchedulerOptions options = {}) {
+    scheduler = nullptr;
+    scheduler = kj::heap<AlarmScheduler>(clock, timer, *dir, kj::Path({"alarms.index"}),
+        [this](kj::StringPtr actorId, kj::Date scheduledTime)
+            -> kj::Promise<WorkerInterface::AlarmResult> {
+      delivered.add(kj::str(actorId, "@", (scheduledTime - kj::UNIX_EPOCH) / kj::SECONDS));
+      if (hold) {
+        auto paf = kj::newPromiseAndFulfiller<WorkerInterface::AlarmResult>();
+        pending.add(kj::mv(paf.fulfiller));
+        return kj::mv(paf.promise);
+      }
+      return WorkerInterface::AlarmResult {
+        .retry = fail,
+        .outcome = fail ? EventOutcome::EXCEPTION : EventOutcome::OK,
+      };
+    }, options);
+  }
+
+  void advanceTo(kj::Date time) {
+    timer.advanceTo(kj::origin<kj::TimePoint>() + (time - kj::UNIX_EPOCH));
+    ws.poll();
+  }
+
+  kj::String takeDelivered() {
+    auto result = kj::strArray(delivered, ", ");
+    delivered.clear();
+    return result;
+  }
+
+  kj::String readIndex() {
+    return dir->openFile(kj::Path({"alarms.index"}))->readAllText();
+  }
+};
+
+KJ_TEST("AlarmScheduler delivers alarms when they fall due") {
+  SchedulerTest test;
+  test.get().alarmChanged("a", at(10));
+  test.get().alarmChanged("b", at(20));
+  test.get().alarmChanged("c", at(30));
+  test.get().alarmChanged("b", nullptr);
+  KJ_EXPECT(test.get().size() == 2);
+
+  test.advanceTo(at(9));
+  KJ_EXPECT(test.takeDelivered() == "");
+
+  test.advanceTo(at(10));
+  KJ_EXPECT(test.takeDelivered() == "a@10");
+  KJ_EXPECT(test.get().size() == 1);
+
+  // Moving an alarm earlier rearms the timer.
+  test.get().alarmChanged("c", at(15));
+  test.advanceTo(at(15));
+  KJ_EXPECT(test.takeDelivered() == "c@15");
+  KJ_EXPECT(test.get().size() == 0);
+}
+
+KJ_TEST("AlarmScheduler delivers alarms due at the same time in one wakeup") {
+  SchedulerTest test({ .maxConcurrentDeliveries = 2 });
+  test.hold = true;
+  for (auto id: {"a", "b", "c"}) {
+    test.get().alarmChanged(id, at(10));
+  }
+
+  test.advanceTo(at(10));
+  KJ_EXPECT(test.delivered.size() == 2);
+
+  // The third waits for a delivery to finish.
+  test.pending[0]->fulfill({ .retry = false, .outcome = EventOutcome::OK });
+  test.ws.poll();
+  KJ_EXPECT(test.delivered.size() == 3);
+  KJ_EXPECT(test.get().size() == 2);
+}
+
+KJ_TEST("AlarmScheduler retries failed alarms with backoff") {
+  SchedulerTest test;
+  test.fail = true;
+  test.get().alarmChanged("a", at(10));
+
+  test.advanceTo(at(10));
+  KJ_EXPECT(test.takeDelivered() == "a@10");
+
+  // Retries pass the original time, 2s, 4s, 8s... after each failure.
+  test.advanceTo(at(11));
+  KJ_EXPECT(test.takeDelivered() == "");
+  test.advanceTo(at(12));
+  KJ_EXPECT(test.takeDelivered() == "a@10");
+  test.advanceTo(at(16));
+  KJ_EXPECT(test.takeDelivered() == "a@10");
+  test.advanceTo(at(24));
+  KJ_EXPECT(test.takeDelivered() == "a@10");
+  test.advanceTo(at(40));
+  KJ_EXPECT(test.takeDelivered() == "a@10");
+  test.advanceTo(at(72));
+  KJ_EXPECT(test.takeDelivered() == "a@10");
+
+  // That was the last try.
+  KJ_EXPECT(test.get().size() == 0);
+  test.advanceTo(at(1000));
+  KJ_EXPECT(test.takeDelivered() == "");
+}
+
+KJ_TEST("AlarmScheduler follows alarms changed while delivering") {
+  SchedulerTest test;
+  test.hold = true;
+  test.get().alarmChanged("a", at(10));
+  test.advanceTo(at(10));
+  KJ_EXPECT(test.takeDelivered() == "a@10");
+  KJ_EXPECT(test.get().isScheduled("a", at(10)));
+
+  // The handler sets the next alarm, then ends asking for a retry of its own. The new alarm wins.
+  test.get().alarmChanged("a", at(50));
+  KJ_EXPECT(!test.get().isScheduled("a", at(10)));
+  test.pending[0]->fulfill({ .retry = true, .outcome = EventOutcome::EXCEPTION });
+  test.ws.poll();
+
+  test.advanceTo(at(49));
+  KJ_EXPECT(test.takeDelivered() == "");
+  test.advanceTo(at(50));
+  KJ_EXPECT(test.takeDelivered() == "a@50");
+}
+
+KJ_TEST("AlarmScheduler keeps its index across restarts") {
+  SchedulerTest test;
+  test.get().alarmChanged("a", at(10));
+  test.get().alarmChanged("b", at(20));
+  test.ws.poll();
+
+  auto index = test.readIndex();
+  KJ_EXPECT(index == "10000 a\n20000 b\n" || index == "20000 b\n10000 a\n", index);
+
+  test.restart();
+  KJ_EXPECT(test.get().size() == 2);
+  test.advanceTo(at(20));
+  KJ_EXPECT(test.takeDelivered() == "a@10, b@20");
+  test.ws.poll();
+  KJ_EXPECT(test.readIndex() == "");
+
+  // Junk in the file is skipped.
+  test.dir->openFile(kj::Path({"alarms.index"}), kj::WriteMode::MODIFY)
+      ->writeAll("garbage\n30000 c\n");
+  test.restart();
+  KJ_EXPECT(test.get().size() == 1);
+  KJ_EXPECT(test.get().isScheduled("c", at(30)));
+}
+
+KJ_TEST("AlarmScheduler adopts index files left by other runs") {
+  SchedulerTest test;
+  test.get().alarmChanged("a", at(10));
+  test.ws.poll();
+
+  test.dir->openFile(kj::Path({"alarms-3.index"}), kj::WriteMode::CREATE)
+      ->writeAll("20000 b\n5000 a\n");
+  test.get().adopt(kj::Path({"alarms-3.index"}));
+  KJ_EXPECT(test.dir->tryOpenFile(kj::Path({"alarms-3.index"})) == nullptr);
+
+  // The entry we already had wins, and the adopted one is saved in our own index.
+  KJ_EXPECT(test.get().size() == 2);
+  KJ_EXPECT(test.get().isScheduled("a", at(10)));
+  auto index = test.readIndex();
+  KJ_EXPECT(index == "10000 a\n20000 b\n" || index == "20000 b\n10000 a\n", index);
+
+  test.advanceTo(at(20));
+  KJ_EXPECT(test.takeDelivered() == "a@10, b@20");
+
+  // Adopting a file that isn't there is harmless.
+  test.get().adopt(kj::Path({"alarms-4.index"}));
+  KJ_EXPECT(test.get().size() == 0);
+}
+
+}  // namespace
+}  // namespace workerd::server
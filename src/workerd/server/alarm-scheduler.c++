@@ -0,0 +1,283 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "alarm-scheduler.h"
+#include <kj/debug.h>
+
+namespace workerd::server {
+
+// The index file is text, one line per object with an alarm:
+//
+//     <scheduled time, in milliseconds since the Unix epoch> <object ID>
+//
+// It's always replaced atomically, so it's never torn.
+
+AlarmScheduler::AlarmScheduler(const kj::Clock& clock, kj::Timer& timer, const kj::Directory& dir,
+                               kj::Path indexPath, DeliverFunc deliver,
+                               AlarmSchedulerOptions options)
+    : clock(clock), timer(timer), dir(dir), indexPath(kj::mv(indexPath)),
+      deliver(kj::mv(deliver)), options(options), tasks(*this) {
+  KJ_REQUIRE(options.maxConcurrentDeliveries > 0);
+  load(this->indexPath);
+  arm();
+}
+
+AlarmScheduler::~AlarmScheduler() noexcept(false) {}
+
+void AlarmScheduler::adopt(kj::PathPtr path) {
+  if (!load(path)) return;
+
+  // Our own index must have the entries before the file holding them goes away.
+  save();
+  dir.tryRemove(path);
+  arm();
+}
+
+void AlarmScheduler::alarmChanged(kj::StringPtr actorId, kj::Maybe<kj::Date> scheduledTime) {
+  // Note that this is called while the object's storage is being opened, and so possibly in the
+  // middle of looking the object up, so it must not start a delivery directly. It only arms the
+  // timer.
+  KJ_IF_MAYBE(entry, entries.find(actorId)) {
+    KJ_IF_MAYBE(t, scheduledTime) {
+      KJ_IF_MAYBE(current, entry->scheduledTime) {
+        if (*current == *t) return;
+      }
+    } else if (entry->scheduledTime == nullptr) {
+      return;
+    }
+
+    entry->scheduledTime = scheduledTime;
+    entry->retries = 0;
+    if (entry->running) {
+      // finish() takes care of it.
+    } else KJ_IF_MAYBE(t, scheduledTime) {
+      dequeue(actorId, *entry);
+      entry->wakeTime = *t;
+      enqueue(actorId, *entry);
+    } else {
+      dequeue(actorId, *entry);
+      entries.erase(actorId);
+    }
+  } else KJ_IF_MAYBE(t, scheduledTime) {
+    auto& entry = entries.insert(kj::str(actorId), Entry { *t, *t });
+    enqueue(entry.key, entry.value);
+  } else {
+    return;
+  }
+
+  scheduleSave();
+  arm();
+}
+
+bool AlarmScheduler::isScheduled(kj::StringPtr actorId, kj::Date scheduledTime) const {
+  KJ_IF_MAYBE(entry, entries.find(actorId)) {
+    KJ_IF_MAYBE(t, entry->scheduledTime) {
+      return *t == scheduledTime;
+    }
+  }
+  return false;
+}
+
+void AlarmScheduler::enqueue(kj::StringPtr actorId, Entry& entry) {
+  queue.findOrCreate(entry.wakeTime, [&]() {
+    return decltype(queue)::Entry { entry.wakeTime, {} };
+  }).add(kj::str(actorId));
+}
+
+void AlarmScheduler::dequeue(kj::StringPtr actorId, Entry& entry) {
+  kj::Date wakeTime = entry.wakeTime;
+  KJ_IF_MAYBE(bucket, queue.find(wakeTime)) {
+    for (auto i: kj::indices(*bucket)) {
+      if ((*bucket)[i] == actorId) {
+        (*bucket)[i] = kj::mv(bucket->back());
+        bucket->removeLast();
+        break;
+      }
+    }
+    if (bucket->empty()) {
+      queue.erase(wakeTime);
+    }
+  }
+}
+
+void AlarmScheduler::arm() {
+  if (inFlight >= options.maxConcurrentDeliveries) {
+    // finish() will arm the timer once a delivery completes.
+    return;
+  }
+
+  auto first = queue.begin();
+  if (first == queue.end()) {
+    armedFor = nullptr;
+    wakeTask = nullptr;
+    return;
+  }
+
+  kj::Date time = first->key;
+  KJ_IF_MAYBE(armed, armedFor) {
+    // Waking up early is harmless: there's just nothing to deliver yet.
+    if (*armed <= time) return;
+  }
+
+  armedFor = time;
+  auto now = clock.now();
+  auto wake = time > now ? timer.afterDelay(time - now) : kj::Promise<void>(kj::READY_NOW);
+  wakeTask = wake.then([this]() {
+    armedFor = nullptr;
+    // pump() re-arms the timer, replacing this promise, so it can't run in this continuation.
+    tasks.add(kj::evalLater([this]() { pump(); }));
+  }).eagerlyEvaluate(nullptr);
+}
+
+void AlarmScheduler::pump() {
+  // Starts deliveries of every alarm that is due, up to the concurrency limit. Alarms that fell
+  // due at the same time share a bucket, and so a wakeup.
+
+  auto now = clock.now();
+  while (inFlight < options.maxConcurrentDeliveries) {
+    auto first = queue.begin();
+    if (first == queue.end() || first->key > now) break;
+
+    kj::Date wakeTime = first->key;
+    auto& bucket = first->value;
+    auto actorId = kj::mv(bucket.back());
+    bucket.removeLast();
+    if (bucket.empty()) {
+      queue.erase(wakeTime);
+    }
+
+    auto& entry = KJ_ASSERT_NONNULL(entries.find(actorId));
+    entry.running = true;
+    ++inFlight;
+    auto scheduledTime = KJ_ASSERT_NONNULL(entry.scheduledTime);
+    tasks.add(run(kj::mv(actorId), scheduledTime));
+  }
+
+  arm();
+}
+
+kj::Promise<void> AlarmScheduler::run(kj::String actorId, kj::Date scheduledTime) {
+  return kj::evalNow([&]() {
+    return deliver(actorId, scheduledTime);
+  }).catch_([actorId = actorId.asPtr()](kj::Exception&& e) {
+    KJ_LOG(ERROR, "delivering Durable Object alarm failed", actorId, e);
+    return WorkerInterface::AlarmResult {
+      .retry = true,
+      .outcome = EventOutcome::EXCEPTION,
+    };
+  }).then([this, actorId = kj::mv(actorId), scheduledTime]
+          (WorkerInterface::AlarmResult result) {
+    finish(actorId, scheduledTime, result);
+  });
+}
+
+void AlarmScheduler::finish(kj::StringPtr actorId, kj::Date scheduledTime,
+                            WorkerInterface::AlarmResult result) {
+  --inFlight;
+  auto& entry = KJ_ASSERT_NONNULL(entries.find(actorId));
+  entry.running = false;
+
+  KJ_IF_MAYBE(t, entry.scheduledTime) {
+    if (*t != scheduledTime) {
+      // The alarm was set again while this one ran.
+      entry.wakeTime = *t;
+      enqueue(actorId, entry);
+    } else if (result.retry) {
+      if (result.retryCountsAgainstLimit) {
+        ++entry.retries;
+      }
+      if (entry.retries >= uint(WorkerInterface::ALARM_RETRY_MAX_TRIES)) {
+        // Like the preview implementation, give up. The alarm stays in the object's storage, so
+        // it's tried again the next time the object is opened.
+        KJ_LOG(WARNING, "Durable Object alarm failed too many times; giving up", actorId);
+        entries.erase(actorId);
+        scheduleSave();
+      } else {
+        auto backoff = entry.retries > 0 ? entry.retries - 1 : 0;
+        entry.wakeTime = clock.now() +
+            (WorkerInterface::ALARM_RETRY_START_SECONDS << backoff) * kj::SECONDS;
+        enqueue(actorId, entry);
+      }
+    } else {
+      // Delivered (or canceled). The object deletes the alarm from its storage itself, and we'll
+      // hear about that, but it may not have happened yet.
+      entries.erase(actorId);
+      scheduleSave();
+    }
+  } else {
+    // Deleted while running, usually by the successful handler.
+    entries.erase(actorId);
+  }
+
+  arm();
+}
+
+bool AlarmScheduler::load(kj::PathPtr path) {
+  // Adds the entries of the index file at `path` that we don't already have. Returns false if
+  // there's no such file.
+  auto file = KJ_UNWRAP_OR(dir.tryOpenFile(path), return false);
+  auto text = file->readAllText();
+
+  uint malformed = 0;
+  kj::StringPtr rest = text;
+  while (rest.size() > 0) {
+    auto lineEnd = rest.findFirst('\n').orDefault(rest.size());
+    auto line = kj::heapString(rest.slice(0, lineEnd));
+    rest = lineEnd < rest.size() ? rest.slice(lineEnd + 1) : kj::StringPtr();
+
+    KJ_IF_MAYBE(space, line.findFirst(' ')) {
+      auto ms = kj::heapString(line.slice(0, *space)).tryParseAs<int64_t>();
+      kj::StringPtr actorId = line.slice(*space + 1);
+      KJ_IF_MAYBE(m, ms) {
+        if (actorId.size() > 0) {
+          if (entries.find(actorId) == nullptr) {
+            auto time = kj::UNIX_EPOCH + *m * kj::MILLISECONDS;
+            auto& entry = entries.insert(kj::str(actorId), Entry { time, time });
+            enqueue(entry.key, entry.value);
+          }
+          continue;
+        }
+      }
+    }
+    ++malformed;
+  }
+
+  if (malformed > 0) {
+    KJ_LOG(WARNING, "ignored malformed lines in Durable Object alarm index",
+           path.toString(), malformed);
+  }
+  return true;
+}
+
+void AlarmScheduler::scheduleSave() {
+  // All changes made in the same turn of the event loop are saved together.
+  if (saveScheduled) return;
+  saveScheduled = true;
+  tasks.add(kj::evalLater([this]() {
+    saveScheduled = false;
+    save();
+  }));
+}
+
+void AlarmScheduler::save() {
+  kj::Vector<kj::String> lines(entries.size());
+  for (auto& entry: entries) {
+    KJ_IF_MAYBE(t, entry.value.scheduledTime) {
+      lines.add(kj::str((*t - kj::UNIX_EPOCH) / kj::MILLISECONDS, ' ', entry.key, '\n'));
+    }
+  }
+
+  auto replacer = dir.replaceFile(indexPath, kj::WriteMode::CREATE | kj::WriteMode::MODIFY);
+  auto& file = replacer->get();
+  file.writeAll(kj::strArray(lines, ""));
+  file.sync();
+  replacer->commit();
+  dir.sync();
+}
+
+void AlarmScheduler::taskFailed(kj::Exception&& exception) {
+  KJ_LOG(ERROR, "Durable Object alarm scheduler task failed", exception);
+}
+
+}  // namespace workerd::server
@@ -0,0 +1,112 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#pragma once
+
+#include "local-actor-storage.h"
+#include <workerd/io/worker-interface.h>
+#include <kj/filesystem.h>
+#include <kj/map.h>
+#include <kj/timer.h>
+#include <kj/vector.h>
+
+namespace workerd::server {
+
+using kj::uint;
+
+struct AlarmSchedulerOptions {
+  uint maxConcurrentDeliveries = 16;
+  // Alarms that fall due together are delivered this many at a time, so that a burst of them
+  // doesn't start every object at once.
+};
+
+class AlarmScheduler final: public LocalActorStorageAlarmListener,
+                            private kj::TaskSet::ErrorHandler {
+  // Delivers the alarms of one namespace of Durable Objects with on-disk storage, whether or not
+  // the objects are running. The objects' storage reports each alarm change (see
+  // `LocalActorStorageOptions::alarmListener`), and the scheduler keeps an index of them, ordered
+  // by time, with a single timer armed for the earliest. When it fires, every alarm that has
+  // fallen due is delivered in the same wakeup, through `DeliverFunc`, which starts the object if
+  // needed. A delivery that asks to be retried is retried with exponential backoff, up to
+  // `WorkerInterface::ALARM_RETRY_MAX_TRIES` times.
+  //
+  // The index is saved to a file, rewritten at most once per turn of the event loop, so that
+  // objects which aren't running when the process restarts still get their alarms. The file is
+  // only a hint: an object's storage reports its real alarm when opened, before the alarm is
+  // delivered, so an out-of-date entry costs a wakeup but never runs an alarm at the wrong time.
+
+public:
+  using DeliverFunc = kj::Function<kj::Promise<WorkerInterface::AlarmResult>(
+      kj::StringPtr actorId, kj::Date scheduledTime)>;
+  // Runs the object's alarm handler for `scheduledTime`. Should check `isScheduled()` once the
+  // object's storage is open, and return a CANCELED result without retry if it isn't.
+
+  AlarmScheduler(const kj::Clock& clock, kj::Timer& timer, const kj::Directory& dir,
+                 kj::Path indexPath, DeliverFunc deliver, AlarmSchedulerOptions options = {});
+  // Loads the index from `indexPath` in `dir`, if the file exists, and arms the timer.
+  ~AlarmScheduler() noexcept(false);
+  KJ_DISALLOW_COPY_AND_MOVE(AlarmScheduler);
+
+  void adopt(kj::PathPtr path);
+  // Merges the index file at `path` in `dir`, left by a run with a different number of threads,
+  // into this scheduler's index, saves the result, then removes the file. Entries this scheduler
+  // already has win. Does nothing if the file doesn't exist.
+
+  void alarmChanged(kj::StringPtr actorId, kj::Maybe<kj::Date> scheduledTime) override;
+
+  bool isScheduled(kj::StringPtr actorId, kj::Date scheduledTime) const;
+  // Is `actorId`'s alarm still set for `scheduledTime`?
+
+  size_t size() const { return entries.size(); }
+  // Number of objects with an alarm set.
+
+private:
+  struct Entry {
+    kj::Maybe<kj::Date> scheduledTime;
+    // The object's alarm. Null only while a delivery is running and the alarm was deleted in
+    // the meantime, usually by the handler's own success.
+
+    kj::Date wakeTime;
+    // When to deliver it next: `scheduledTime`, or later when retrying.
+
+    uint retries = 0;
+    bool running = false;
+  };
+
+  const kj::Clock& clock;
+  kj::Timer& timer;
+  const kj::Directory& dir;
+  kj::Path indexPath;
+  DeliverFunc deliver;
+  AlarmSchedulerOptions options;
+
+  kj::HashMap<kj::String, Entry> entries;
+  kj::TreeMap<kj::Date, kj::Vector<kj::String>> queue;
+  // Entries waiting for their wake time, grouped by it. Running entries aren't queued.
+
+  uint inFlight = 0;
+  kj::Maybe<kj::Date> armedFor;
+  // When the timer will next fire, if it's armed.
+  bool saveScheduled = false;
+
+  kj::Promise<void> wakeTask = nullptr;
+  kj::TaskSet tasks;
+  // Deliveries and index saves. Declared last, so that they're canceled before anything they
+  // use is destroyed.
+
+  void enqueue(kj::StringPtr actorId, Entry& entry);
+  void dequeue(kj::StringPtr actorId, Entry& entry);
+  void arm();
+  void pump();
+  kj::Promise<void> run(kj::String actorId, kj::Date scheduledTime);
+  void finish(kj::StringPtr actorId, kj::Date scheduledTime, WorkerInterface::AlarmResult result);
+
+  bool load(kj::PathPtr path);
+  void scheduleSave();
+  void save();
+
+  void taskFailed(kj::Exception&& exception) override;
+};
+
+}  // namespace workerd::server
@@ -0,0 +1,117 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "analytics-batcher.h"
+#include <workerd/api/analytics-engine.capnp.h>
+#include <kj/test.h>
+
+namespace workerd::server {
+namespace {
+
+struct AnalyticsBatcherTest {
+  kj::EventLoop loop;
+  kj::WaitScope ws;
+  kj::TimerImpl timer;
+  kj::Vector<kj::String> batches;
+  kj::Maybe<kj::Own<kj::PromiseFulfiller<void>>> pendingSend;
+  bool holdSends = false;
+  AnalyticsBatcher batcher;
+
+  explicit AnalyticsBatcherTest(AnalyticsBatcherOptions options)
+      : ws(loop), timer(kj::origin<kj::TimePoint>()),
+        batcher(timer, [this](kj::String batch) -> kj::Promise<void> {
+          batches.add(kj::mv(batch));
+          if (holdSends) {
+            auto paf = kj::newPromiseAndFulfiller<void>();
+            pendingSend = kj::mv(paf.fulfiller);
+            return kj::mv(paf.promise);
+          }
+          return kj::READY_NOW;
+        }, options) {}
+
+  void write(double value) {
+    batcher.write([&](capnp::AnyPointer::Builder ptr) {
+      auto event = ptr.initAs<api::AnalyticsEngineEvent>();
+      event.setDataset("ds"_kj.asBytes());
+      event.setDouble1(value);
+      event.setBlob1("b"_kj.asBytes());
+    });
+  }
+
+  void advance(kj::Duration duration) {
+    timer.advanceTo(timer.now() + duration);
+    loop.run();
+  }
+};
+
+KJ_TEST("AnalyticsBatcher: batches flush by size and by interval") {
+  AnalyticsBatcherTest test({ .maxBatchSize = 2, .flushInterval = 1 * kj::SECONDS });
+
+  test.write(1);
+  test.loop.run();
+  KJ_EXPECT(test.batches.size() == 0);
+
+  test.write(2);
+  test.loop.run();
+  KJ_ASSERT(test.batches.size() == 1);
+  KJ_EXPECT(test.batches[0] ==
+      "{\"dataset\":\"ds\",\"double1\":1,\"blob1\":\"b\"}\n"
+      "{\"dataset\":\"ds\",\"double1\":2,\"blob1\":\"b\"}\n");
+
+  test.write(3);
+  test.advance(999 * kj::MILLISECONDS);
+  test.write(4);
+  test.loop.run();
+  KJ_ASSERT(test.batches.size() == 2);
+  KJ_EXPECT(test.batches[1] ==
+      "{\"dataset\":\"ds\",\"double1\":3,\"blob1\":\"b\"}\n"
+      "{\"dataset\":\"ds\",\"double1\":4,\"blob1\":\"b\"}\n");
+
+  test.write(5);
+  test.advance(999 * kj::MILLISECONDS);
+  KJ_EXPECT(test.batches.size() == 2);
+  test.advance(1 * kj::MILLISECONDS);
+  KJ_ASSERT(test.batches.size() == 3);
+  KJ_EXPECT(test.batches[2] == "{\"dataset\":\"ds\",\"double1\":5,\"blob1\":\"b\"}\n");
+}
+
+KJ_TEST("AnalyticsBatcher: one batch is sent at a time") {
+  AnalyticsBatcherTest test({ .maxBatchSize = 1, .maxPendingPoints = 3 });
+  test.holdSends = true;
+
+  test.write(1);
+  test.write(2);
+  test.write(3);
+  {
+    KJ_EXPECT_LOG(WARNING, "dropping data points");
+    test.write(4);  // three points are pending
+  }
+  test.loop.run();
+  KJ_ASSERT(test.batches.size() == 1);
+
+  KJ_ASSERT_NONNULL(test.pendingSend)->fulfill();
+  test.loop.run();
+  KJ_ASSERT(test.batches.size() == 2);
+  KJ_EXPECT(test.batches[1] == "{\"dataset\":\"ds\",\"double1\":2,\"blob1\":\"b\"}\n");
+
+  // A failed send is dropped, and sending carries on.
+  {
+    KJ_EXPECT_LOG(ERROR, "failed to send Analytics Engine data points");
+    KJ_ASSERT_NONNULL(test.pendingSend)->reject(KJ_EXCEPTION(FAILED, "collector is down"));
+    test.loop.run();
+  }
+  KJ_ASSERT(test.batches.size() == 3);
+  KJ_EXPECT(test.batches[2] == "{\"dataset\":\"ds\",\"double1\":3,\"blob1\":\"b\"}\n");
+
+  test.holdSends = false;
+  KJ_ASSERT_NONNULL(test.pendingSend)->fulfill();
+  test.loop.run();
+  test.write(5);
+  test.loop.run();
+  KJ_ASSERT(test.batches.size() == 4);
+  KJ_EXPECT(test.batches[3] == "{\"dataset\":\"ds\",\"double1\":5,\"blob1\":\"b\"}\n");
+}
+
+}  // namespace
+}  // namespace workerd::server
@@ -0,0 +1,109 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "analytics-batcher.h"
+#include <workerd/api/analytics-engine.capnp.h>
+#include <capnp/compat/json.h>
+#include <capnp/message.h>
+#include <kj/debug.h>
+
+namespace workerd::server {
+
+namespace {
+
+class DataAsTextHandler final: public capnp::JsonCodec::Handler<capnp::Data> {
+  // `writeDataPoint()` fills blobs and indexes with either bytes or UTF-8 text; text is by far the
+  // common case, so they're written as JSON strings rather than arrays of numbers.
+public:
+  void encode(const capnp::JsonCodec& codec, capnp::Data::Reader input,
+              capnp::JsonValue::Builder output) const override {
+    output.setString(kj::str(input.asChars()));
+  }
+
+  capnp::Orphan<capnp::Data> decode(const capnp::JsonCodec& codec,
+      capnp::JsonValue::Reader input, capnp::Orphanage orphanage) const override {
+    KJ_UNIMPLEMENTED("AnalyticsBatcher only encodes");
+  }
+};
+
+kj::String encodeEvent(api::AnalyticsEngineEvent::Reader event) {
+  static const DataAsTextHandler dataHandler;
+  capnp::JsonCodec json;
+  json.setHasMode(capnp::HasMode::NON_DEFAULT);
+  json.addTypeHandler(dataHandler);
+  return kj::str(json.encode(event), '\n');
+}
+
+}  // namespace
+
+AnalyticsBatcher::AnalyticsBatcher(
+    kj::Timer& timer, Sender send, AnalyticsBatcherOptions options)
+    : timer(timer), send(kj::mv(send)), options(options), tasks(*this) {
+  KJ_REQUIRE(options.maxBatchSize > 0);
+}
+
+void AnalyticsBatcher::write(kj::FunctionParam<void(capnp::AnyPointer::Builder)> buildMessage) {
+  capnp::MallocMessageBuilder message;
+  auto root = message.getRoot<capnp::AnyPointer>();
+  buildMessage(root);
+
+  if (points.size() + sendingPoints >= options.maxPendingPoints) {
+    if (!dropping) {
+      KJ_LOG(WARNING, "Analytics Engine destination is falling behind; dropping data points",
+          options.maxPendingPoints);
+      dropping = true;
+    }
+    return;
+  }
+  dropping = false;
+
+  if (points.size() == 0) {
+    oldestPointTime = timer.now();
+  }
+  points.add(encodeEvent(root.getAs<api::AnalyticsEngineEvent>().asReader()));
+  maybeSend();
+}
+
+void AnalyticsBatcher::maybeSend() {
+  if (sendingPoints > 0 || points.size() == 0) return;
+
+  auto deadline = oldestPointTime + options.flushInterval;
+  if (points.size() >= options.maxBatchSize || timer.now() >= deadline) {
+    sendBatch();
+  } else if (!timerArmed) {
+    timerArmed = true;
+    tasks.add(timer.atTime(deadline).then([this]() {
+      // The batch this timer was set for may have been sent already, in which case this re-arms
+      // the timer for the current batch.
+      timerArmed = false;
+      maybeSend();
+    }));
+  }
+}
+
+void AnalyticsBatcher::sendBatch() {
+  sendingPoints = kj::min(points.size(), size_t(options.maxBatchSize));
+
+  auto batch = kj::strArray(points.asPtr().slice(0, sendingPoints), "");
+  kj::Vector<kj::String> rest(points.size() - sendingPoints);
+  for (auto& point: points.asPtr().slice(sendingPoints, points.size())) {
+    rest.add(kj::mv(point));
+  }
+  points = kj::mv(rest);
+  oldestPointTime = timer.now();
+
+  tasks.add(kj::evalNow([&]() { return send(kj::mv(batch)); })
+      .catch_([count = sendingPoints](kj::Exception&& e) {
+    KJ_LOG(ERROR, "failed to send Analytics Engine data points", count, e);
+  }).then([this]() {
+    sendingPoints = 0;
+    maybeSend();
+  }));
+}
+
+void AnalyticsBatcher::taskFailed(kj::Exception&& exception) {
+  KJ_LOG(ERROR, exception);
+}
+
+}  // namespace workerd::server
@@ -0,0 +1,72 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#pragma once
+
+#include <capnp/any.h>
+#include <kj/async.h>
+#include <kj/function.h>
+#include <kj/time.h>
+#include <kj/timer.h>
+#include <kj/vector.h>
+
+namespace workerd::server {
+
+struct AnalyticsBatcherOptions {
+  uint maxBatchSize = 100;
+  // A batch is sent as soon as it holds this many data points.
+
+  kj::Duration flushInterval = 1 * kj::SECONDS;
+  // A batch that isn't full is sent at most this long after its first data point was written.
+
+  uint maxPendingPoints = 10000;
+  // Data points written while this many are waiting to be sent, or being sent, are dropped, so
+  // that a slow or unreachable destination can't make the batcher grow without bound.
+};
+
+class AnalyticsBatcher final: private kj::TaskSet::ErrorHandler {
+  // Collects the Analytics Engine data points written through one binding, on one thread, and
+  // passes them to `send` in batches rather than one at a time.
+  //
+  // Each batch is newline-delimited JSON: one `AnalyticsEngineEvent` per line, as encoded by
+  // `capnp::JsonCodec`, except that blobs and indexes are written as strings. Only one batch is
+  // sent at a time, so batches reach `send` in the order their points were written. If `send`
+  // fails, the batch is logged and dropped; like logfwdr, the batcher makes no delivery
+  // guarantees. Points not yet sent when the batcher is destroyed are lost.
+
+public:
+  using Sender = kj::Function<kj::Promise<void>(kj::String batch)>;
+
+  AnalyticsBatcher(kj::Timer& timer, Sender send, AnalyticsBatcherOptions options = {});
+
+  void write(kj::FunctionParam<void(capnp::AnyPointer::Builder)> buildMessage);
+  // Adds one data point. `buildMessage` is called immediately to fill in an
+  // `AnalyticsEngineEvent`, as with `IoChannelFactory::writeLogfwdr()`.
+
+private:
+  kj::Timer& timer;
+  Sender send;
+  AnalyticsBatcherOptions options;
+
+  kj::Vector<kj::String> points;
+  // Encoded data points not yet sent, oldest first.
+
+  kj::TimePoint oldestPointTime = kj::origin<kj::TimePoint>();
+  // When the oldest point in `points` was written, or, for points left over after sending a full
+  // batch, when that batch was sent.
+
+  uint sendingPoints = 0;
+  // Size of the batch being sent, or zero if none is.
+
+  bool timerArmed = false;
+  bool dropping = false;
+
+  kj::TaskSet tasks;
+
+  void maybeSend();
+  void sendBatch();
+  void taskFailed(kj::Exception&& exception) override;
+};
+
+}  // namespace workerd::server
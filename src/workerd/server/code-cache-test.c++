@@ -0,0 +1,81 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "code-cache.h"
+#include <kj/test.h>
+#include <capnp/message.h>
+#include <kj/encoding.h>
+
+namespace workerd::server {
+namespace {
+
+kj::String findText(const jsg::CodeCache& cache, kj::StringPtr source) {
+  KJ_IF_MAYBE(data, cache.find(source)) {
+    return kj::str(data->asChars());
+  } else {
+    return kj::str("(none)");
+  }
+}
+
+KJ_TEST("code cache: directory") {
+  auto dir = kj::newInMemoryDirectory(kj::nullClock());
+  auto cache = newDirectoryCodeCache(dir->clone());
+
+  KJ_EXPECT(findText(*cache, "foo()") == "(none)");
+  cache->add("foo()"_kj, "compiled foo"_kj.asBytes());
+  cache->add("bar()"_kj, "compiled bar"_kj.asBytes());
+  KJ_EXPECT(findText(*cache, "foo()") == "compiled foo");
+  KJ_EXPECT(findText(*cache, "bar()") == "compiled bar");
+  KJ_EXPECT(findText(*cache, "baz()") == "(none)");
+
+  // Another instance on the same directory sees the same data.
+  KJ_EXPECT(findText(*newDirectoryCodeCache(dir->clone()), "foo()") == "compiled foo");
+
+  // Files written by another V8 are ignored.
+  auto names = dir->listNames();
+  KJ_ASSERT(names.size() == 2);
+  for (auto& name: names) {
+    uint32_t tag = v8::ScriptCompiler::CachedDataVersionTag() + 1;
+    dir->openFile(kj::Path(kj::mv(name)), kj::WriteMode::MODIFY)
+        ->write(0, kj::arrayPtr(&tag, 1).asBytes());
+  }
+  KJ_EXPECT(findText(*cache, "foo()") == "(none)");
+
+  // Adding replaces them.
+  cache->add("foo()"_kj, "new foo"_kj.asBytes());
+  KJ_EXPECT(findText(*cache, "foo()") == "new foo");
+}
+
+KJ_TEST("code cache: embedded") {
+  auto dir = kj::newInMemoryDirectory(kj::nullClock());
+  auto fallback = newDirectoryCodeCache(dir->clone());
+  fallback->add("bar()"_kj, "compiled bar"_kj.asBytes());
+
+  // Borrow the directory cache's hashing to fill in some entries.
+  capnp::MallocMessageBuilder message;
+  auto entries = message.initRoot<config::Config>().initCodeCache(2);
+  auto setEntry = [&](uint i, kj::StringPtr source, kj::StringPtr data, uint32_t tag) {
+    auto scratch = kj::newInMemoryDirectory(kj::nullClock());
+    newDirectoryCodeCache(scratch->clone())->add(source, ""_kj.asBytes());
+    entries[i].setSourceHash(kj::decodeHex(scratch->listNames()[0]));
+    entries[i].setV8VersionTag(tag);
+    entries[i].setData(data.asBytes());
+  };
+  auto currentTag = v8::ScriptCompiler::CachedDataVersionTag();
+  setEntry(0, "foo()", "embedded foo", currentTag);
+  setEntry(1, "bar()", "stale bar", currentTag + 1);
+
+  auto cache = newEmbeddedCodeCache(entries.asReader(), kj::mv(fallback));
+  KJ_EXPECT(findText(*cache, "foo()") == "embedded foo");
+  KJ_EXPECT(findText(*cache, "bar()") == "compiled bar");
+  KJ_EXPECT(findText(*cache, "baz()") == "(none)");
+
+  // Additions go to the fallback.
+  cache->add("baz()"_kj, "compiled baz"_kj.asBytes());
+  KJ_EXPECT(findText(*cache, "baz()") == "compiled baz");
+  KJ_EXPECT(dir->listNames().size() == 2);
+}
+
+}  // namespace
+}  // namespace workerd::server
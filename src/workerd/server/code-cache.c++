@@ -0,0 +1,230 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "code-cache.h"
+#include <openssl/sha.h>
+#include <kj/encoding.h>
+#include <kj/map.h>
+
+namespace workerd::server {
+
+namespace {
+
+kj::FixedArray<kj::byte, SHA256_DIGEST_LENGTH> hashSource(kj::ArrayPtr<const char> source) {
+  kj::FixedArray<kj::byte, SHA256_DIGEST_LENGTH> result;
+  SHA256(source.asBytes().begin(), source.size(), result.begin());
+  return result;
+}
+
+class DirectoryCodeCache final: public jsg::CodeCache {
+public:
+  explicit DirectoryCodeCache(kj::Own<const kj::Directory> directory)
+      : directory(kj::mv(directory)) {}
+
+  kj::Maybe<kj::Array<const kj::byte>> find(kj::ArrayPtr<const char> source) const override {
+    auto path = pathFor(source);
+    kj::Maybe<kj::Array<const kj::byte>> result;
+    KJ_IF_MAYBE(exception, kj::runCatchingExceptions([&]() {
+      auto file = KJ_UNWRAP_OR(directory->tryOpenFile(path), return);
+      auto size = file->stat().size;
+      if (size <= sizeof(uint32_t)) return;
+
+      uint32_t tag;
+      file->read(0, kj::arrayPtr(&tag, 1).asBytes());
+      if (tag != v8::ScriptCompiler::CachedDataVersionTag()) return;
+
+      result = file->mmap(sizeof(tag), size - sizeof(tag));
+    })) {
+      KJ_LOG(WARNING, "failed to read code cache", path, *exception);
+    }
+    return result;
+  }
+
+  void add(kj::ArrayPtr<const char> source, kj::ArrayPtr<const kj::byte> data) const override {
+    auto path = pathFor(source);
+    KJ_IF_MAYBE(exception, kj::runCatchingExceptions([&]() {
+      auto replacer = directory->replaceFile(path,
+          kj::WriteMode::CREATE | kj::WriteMode::MODIFY);
+      auto& file = replacer->get();
+      uint32_t tag = v8::ScriptCompiler::CachedDataVersionTag();
+      file.write(0, kj::arrayPtr(&tag, 1).asBytes());
+      file.write(sizeof(tag), data);
+      replacer->commit();
+    })) {
+      KJ_LOG(WARNING, "failed to write code cache", path, *exception);
+    }
+  }
+
+private:
+  kj::Own<const kj::Directory> directory;
+
+  static kj::Path pathFor(kj::ArrayPtr<const char> source) {
+    return kj::Path(kj::encodeHex(hashSource(source)));
+  }
+};
+
+class EmbeddedCodeCache final: public jsg::CodeCache {
+public:
+  EmbeddedCodeCache(capnp::List<config::CodeCacheEntry>::Reader entries,
+                    kj::Maybe<kj::Own<jsg::CodeCache>> fallback)
+      : fallback(kj::mv(fallback)) {
+    for (auto entry: entries) {
+      this->entries.upsert(entry.getSourceHash(), entry);
+    }
+  }
+
+  kj::Maybe<kj::Array<const kj::byte>> find(kj::ArrayPtr<const char> source) const override {
+    auto hash = hashSource(source);
+    KJ_IF_MAYBE(entry, entries.find(kj::ArrayPtr<const kj::byte>(hash.asPtr()))) {
+      if (entry->getV8VersionTag() == v8::ScriptCompiler::CachedDataVersionTag()) {
+        auto data = entry->getData();
+        return kj::Array<const kj::byte>(data.begin(), data.size(),
+                                         kj::NullArrayDisposer::instance);
+      }
+    }
+    KJ_IF_MAYBE(f, fallback) {
+      return (*f)->find(source);
+    }
+    return nullptr;
+  }
+
+  void add(kj::ArrayPtr<const char> source, kj::ArrayPtr<const kj::byte> data) const override {
+    KJ_IF_MAYBE(f, fallback) {
+      (*f)->add(source, data);
+    }
+  }
+
+private:
+  kj::HashMap<kj::ArrayPtr<const kj::byte>, config::CodeCacheEntry::Reader> entries;
+  // Keyed by source hash. The keys point into the entries themselves.
+
+  kj::Maybe<kj::Own<jsg::CodeCache>> fallback;
+};
+
+struct Compiled {
+  kj::FixedArray<kj::byte, SHA256_DIGEST_LENGTH> sourceHash;
+  kj::Array<kj::byte> data;
+};
+
+template <typename Script>
+kj::Maybe<Compiled> createCodeCache(kj::ArrayPtr<const char> source, v8::Local<Script> script) {
+  auto cachedData = std::unique_ptr<v8::ScriptCompiler::CachedData>(
+      v8::ScriptCompiler::CreateCodeCache(script));
+  if (cachedData == nullptr) return nullptr;
+  return Compiled {
+    hashSource(source),
+    kj::heapArray<kj::byte>(cachedData->data, cachedData->length)
+  };
+}
+
+kj::Maybe<Compiled> compileModule(v8::Isolate* isolate, kj::StringPtr name,
+                                  kj::ArrayPtr<const char> source) {
+  // The origin and source string must match the ones used by jsg::ModuleRegistry::ModuleInfo,
+  // or V8 will reject the cache.
+  v8::ScriptOrigin origin(isolate, jsg::v8StrIntern(isolate, name), 0, 0, false, -1, {},
+                          false, false, true /* isModule */);
+  v8::ScriptCompiler::Source scriptSource(jsg::v8Str(isolate, source), origin);
+  v8::Local<v8::Module> module;
+  if (!v8::ScriptCompiler::CompileModule(isolate, &scriptSource).ToLocal(&module)) {
+    return nullptr;
+  }
+  return createCodeCache(source, module->GetUnboundModuleScript());
+}
+
+kj::Maybe<Compiled> compileScript(v8::Isolate* isolate, kj::StringPtr source) {
+  // Matches jsg::NonModuleScript::compile().
+  v8::ScriptOrigin origin(isolate, jsg::v8StrIntern(isolate, "worker.js"));
+  v8::ScriptCompiler::Source scriptSource(jsg::v8Str(isolate, source), origin);
+  v8::Local<v8::UnboundScript> script;
+  if (!v8::ScriptCompiler::CompileUnboundScript(isolate, &scriptSource).ToLocal(&script)) {
+    return nullptr;
+  }
+  return createCodeCache(source, script);
+}
+
+}  // namespace
+
+kj::Own<jsg::CodeCache> newDirectoryCodeCache(kj::Own<const kj::Directory> directory) {
+  return kj::heap<DirectoryCodeCache>(kj::mv(directory));
+}
+
+kj::Own<jsg::CodeCache> newEmbeddedCodeCache(
+    capnp::List<config::CodeCacheEntry>::Reader entries,
+    kj::Maybe<kj::Own<jsg::CodeCache>> fallback) {
+  return kj::heap<EmbeddedCodeCache>(entries, kj::mv(fallback));
+}
+
+void embedCodeCache(jsg::V8System&, config::Config::Builder config) {
+  // The code cache doesn't depend on the global scope, so a bare isolate does the job.
+  auto allocator = std::unique_ptr<v8::ArrayBuffer::Allocator>(
+      v8::ArrayBuffer::Allocator::NewDefaultAllocator());
+  v8::Isolate::CreateParams params;
+  params.array_buffer_allocator = allocator.get();
+  auto isolate = v8::Isolate::New(params);
+  KJ_DEFER(isolate->Dispose());
+
+  kj::Vector<Compiled> results;
+  kj::HashSet<kj::ArrayPtr<const kj::byte>> seen;
+  auto addResult = [&](kj::Maybe<Compiled> maybeCompiled) {
+    KJ_IF_MAYBE(compiled, maybeCompiled) {
+      if (!seen.contains(compiled->sourceHash.asPtr())) {
+        // (Pointers to the hashes stay valid since `results` is reserved up front.)
+        seen.insert(results.add(kj::mv(*compiled)).sourceHash.asPtr());
+      }
+    }
+  };
+
+  {
+    v8::Isolate::Scope isolateScope(isolate);
+    v8::HandleScope handleScope(isolate);
+    auto context = v8::Context::New(isolate);
+    v8::Context::Scope contextScope(context);
+    v8::TryCatch tryCatch(isolate);
+
+    auto configReader = config.asReader();
+    size_t scriptCount = 0;
+    for (auto service: configReader.getServices()) {
+      if (!service.isWorker()) continue;
+      auto worker = service.getWorker();
+      if (worker.isModules()) {
+        scriptCount += worker.getModules().size();
+      } else if (worker.isServiceWorkerScript()) {
+        ++scriptCount;
+      }
+    }
+    results.reserve(scriptCount);
+
+    for (auto service: configReader.getServices()) {
+      if (!service.isWorker()) continue;
+      auto worker = service.getWorker();
+      switch (worker.which()) {
+        case config::Worker::MODULES:
+          for (auto module: worker.getModules()) {
+            if (module.isEsModule()) {
+              addResult(compileModule(isolate, module.getName(), module.getEsModule()));
+              tryCatch.Reset();
+            }
+          }
+          break;
+        case config::Worker::SERVICE_WORKER_SCRIPT:
+          addResult(compileScript(isolate, worker.getServiceWorkerScript()));
+          tryCatch.Reset();
+          break;
+        default:
+          break;
+      }
+    }
+  }
+
+  auto tag = v8::ScriptCompiler::CachedDataVersionTag();
+  auto entries = config.initCodeCache(results.size());
+  for (auto i: kj::indices(results)) {
+    auto entry = entries[i];
+    entry.setSourceHash(results[i].sourceHash);
+    entry.setV8VersionTag(tag);
+    entry.setData(results[i].data);
+  }
+}
+
+}  // namespace workerd::server
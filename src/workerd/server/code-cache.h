@@ -0,0 +1,38 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#pragma once
+
+#include <workerd/jsg/jsg.h>
+#include <workerd/server/workerd.capnp.h>
+#include <kj/filesystem.h>
+
+namespace workerd::server {
+
+kj::Own<jsg::CodeCache> newDirectoryCodeCache(kj::Own<const kj::Directory> directory);
+// Creates a code cache that persists its contents as files in `directory`, named by the hex
+// SHA-256 of the source they were compiled from. Each file also records the
+// `v8::ScriptCompiler::CachedDataVersionTag()` in effect when it was written (which covers both
+// the V8 version and its flags); files written by a different V8 are ignored, and replaced when
+// the script is next compiled.
+//
+// The directory may be shared by several processes. Files are written atomically, and errors
+// reading or writing them are logged rather than thrown, since a broken cache only costs time.
+
+kj::Own<jsg::CodeCache> newEmbeddedCodeCache(
+    capnp::List<config::CodeCacheEntry>::Reader entries,
+    kj::Maybe<kj::Own<jsg::CodeCache>> fallback = nullptr);
+// Creates a code cache serving the entries that `workerd compile` embeds in the config (see
+// `Config.codeCache`). The entries must outlive the returned object. Lookups that miss, or find
+// data from a different V8, go to `fallback`, as do all additions.
+
+void embedCodeCache(jsg::V8System& v8System, config::Config::Builder config);
+// Compiles every ES module and service worker script in `config` and stores the resulting V8
+// code caches in `config.codeCache`. Scripts that fail to compile are skipped; they'll report
+// their errors when the config is served.
+//
+// `v8System` must have been constructed with `config.v8Flags`, otherwise the caches will be
+// rejected at startup.
+
+}  // namespace workerd::server
@@ -0,0 +1,107 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "concurrency-limiter.h"
+#include <kj/test.h>
+#include <kj/vector.h>
+
+namespace workerd::server {
+namespace {
+
+struct LimiterTest {
+  kj::EventLoop loop;
+  kj::WaitScope ws;
+  kj::TimerImpl timer;
+  ConcurrencyLimiter limiter;
+
+  explicit LimiterTest(ConcurrencyLimiterOptions options)
+      : ws(loop), timer(kj::origin<kj::TimePoint>()), limiter(timer, options) {}
+
+  kj::Own<void> admit() {
+    auto promise = limiter.acquire();
+    KJ_ASSERT(promise.poll(ws));
+    return KJ_ASSERT_NONNULL(promise.wait(ws));
+  }
+};
+
+KJ_TEST("ConcurrencyLimiter queues requests over the limit, and rejects when it must") {
+  LimiterTest test({ .targetLockWait = 10 * kj::MILLISECONDS, .initialLimit = 2,
+                     .maxQueued = 1, .maxQueueTime = 1 * kj::SECONDS });
+  auto& ws = test.ws;
+
+  auto first = test.admit();
+  auto second = test.admit();
+  KJ_EXPECT(test.limiter.getInFlight() == 2);
+
+  // The third request waits, and the fourth doesn't fit in the queue.
+  auto third = test.limiter.acquire();
+  KJ_EXPECT(!third.poll(ws));
+  KJ_EXPECT(test.limiter.getQueued() == 1);
+  KJ_EXPECT(test.limiter.acquire().wait(ws) == nullptr);
+
+  // Finishing a request lets the queued one in.
+  first = nullptr;
+  KJ_ASSERT(third.poll(ws));
+  auto thirdPermit = KJ_ASSERT_NONNULL(third.wait(ws));
+  KJ_EXPECT(test.limiter.getInFlight() == 2);
+  KJ_EXPECT(test.limiter.getQueued() == 0);
+
+  // A request that waits too long is rejected, and leaves the queue.
+  auto fourth = test.limiter.acquire();
+  test.timer.advanceTo(test.timer.now() + 999 * kj::MILLISECONDS);
+  KJ_EXPECT(!fourth.poll(ws));
+  test.timer.advanceTo(test.timer.now() + 1 * kj::MILLISECONDS);
+  KJ_ASSERT(fourth.poll(ws));
+  KJ_EXPECT(fourth.wait(ws) == nullptr);
+  KJ_EXPECT(test.limiter.getQueued() == 0);
+
+  // So does one that is canceled.
+  {
+    auto fifth = test.limiter.acquire();
+    KJ_EXPECT(test.limiter.getQueued() == 1);
+  }
+  KJ_EXPECT(test.limiter.getQueued() == 0);
+}
+
+KJ_TEST("ConcurrencyLimiter adjusts its limit to the isolate lock wait") {
+  LimiterTest test({ .targetLockWait = 10 * kj::MILLISECONDS, .initialLimit = 20,
+                     .minLimit = 2, .maxLimit = 21 });
+  auto lockWaits = test.limiter.getLockWaits();
+
+  auto runBatch = [&](uint count, kj::Duration lockWait) {
+    kj::Vector<kj::Own<void>> permits;
+    for (uint i = 0; i < count; i++) {
+      permits.add(test.admit());
+      lockWaits->add(lockWait);
+    }
+  };
+
+  // After `limit` requests with long lock waits, the limit is cut by 10%.
+  runBatch(20, 50 * kj::MILLISECONDS);
+  KJ_EXPECT(test.limiter.getLimit() == 18);
+
+  // Short waits leave the limit alone while nothing was held back.
+  runBatch(18, 1 * kj::MILLISECONDS);
+  KJ_EXPECT(test.limiter.getLimit() == 18);
+
+  // While requests are being rejected, the limit grows by one per `limit` requests, up to the
+  // maximum.
+  for (uint i = 0; i < 5; i++) {
+    kj::Vector<kj::Own<void>> permits;
+    for (uint j = 0; j < test.limiter.getLimit(); j++) {
+      permits.add(test.admit());
+    }
+    KJ_EXPECT(test.limiter.acquire().wait(test.ws) == nullptr);
+  }
+  KJ_EXPECT(test.limiter.getLimit() == 21);
+
+  // It never goes under the minimum.
+  for (uint i = 0; i < 50; i++) {
+    runBatch(test.limiter.getLimit(), 1 * kj::SECONDS);
+  }
+  KJ_EXPECT(test.limiter.getLimit() == 2);
+}
+
+}  // namespace
+}  // namespace workerd::server
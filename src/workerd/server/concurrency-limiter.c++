@@ -0,0 +1,87 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "concurrency-limiter.h"
+#include <kj/debug.h>
+
+namespace workerd::server {
+
+LockWaitSamples::Totals LockWaitSamples::take() const {
+  // The two exchanges aren't atomic together, so a wait reported in between is counted without
+  // its duration, or vice versa. That's fine for an average.
+  uint64_t n = count.exchange(0, std::memory_order_relaxed);
+  int64_t ns = totalNs.exchange(0, std::memory_order_relaxed);
+  return { n, ns * kj::NANOSECONDS };
+}
+
+ConcurrencyLimiter::ConcurrencyLimiter(kj::Timer& timer, ConcurrencyLimiterOptions options,
+                                       kj::Own<const LockWaitSamples> lockWaits)
+    : timer(timer), options(options), lockWaits(kj::mv(lockWaits)),
+      limit(kj::max(options.minLimit, kj::min(options.initialLimit, options.maxLimit))) {
+  KJ_REQUIRE(options.minLimit > 0 && options.minLimit <= options.maxLimit);
+}
+
+ConcurrencyLimiter::~ConcurrencyLimiter() noexcept(false) {
+  // Permits and waiters refer to the limiter, so must be gone by now.
+  KJ_ASSERT(inFlight == 0 && queue.empty(), "ConcurrencyLimiter destroyed while in use");
+}
+
+ConcurrencyLimiter::Waiter::Waiter(
+    kj::PromiseFulfiller<kj::Maybe<kj::Own<void>>>& fulfiller, ConcurrencyLimiter& limiter)
+    : fulfiller(fulfiller), limiter(limiter) {
+  limiter.queue.add(*this);
+}
+ConcurrencyLimiter::Waiter::~Waiter() noexcept(false) {
+  if (link.isLinked()) {
+    limiter.queue.remove(*this);
+  }
+}
+
+kj::Promise<kj::Maybe<kj::Own<void>>> ConcurrencyLimiter::acquire() {
+  if (inFlight < limit && queue.empty()) {
+    return kj::Maybe<kj::Own<void>>(makePermit());
+  }
+
+  limitedSinceAdjustment = true;
+  if (queue.size() >= options.maxQueued) {
+    return kj::Maybe<kj::Own<void>>(nullptr);
+  }
+
+  return kj::newAdaptedPromise<kj::Maybe<kj::Own<void>>, Waiter>(*this)
+      .exclusiveJoin(timer.afterDelay(options.maxQueueTime).then([]() {
+    return kj::Maybe<kj::Own<void>>(nullptr);
+  }));
+}
+
+kj::Own<void> ConcurrencyLimiter::makePermit() {
+  ++inFlight;
+  return kj::heap(kj::defer([this]() { release(); }));
+}
+
+void ConcurrencyLimiter::release() {
+  --inFlight;
+  if (++completedSinceAdjustment >= limit) {
+    adjust();
+  }
+
+  while (inFlight < limit && !queue.empty()) {
+    auto& waiter = *queue.begin();
+    queue.remove(waiter);
+    waiter.fulfiller.fulfill(makePermit());
+  }
+}
+
+void ConcurrencyLimiter::adjust() {
+  auto waits = lockWaits->take();
+  if (waits.count > 0 && waits.total / waits.count > options.targetLockWait) {
+    limit = kj::max(options.minLimit, limit - kj::max(limit / 10, 1u));
+  } else if (limitedSinceAdjustment) {
+    limit = kj::min(options.maxLimit, limit + 1);
+  }
+
+  completedSinceAdjustment = 0;
+  limitedSinceAdjustment = false;
+}
+
+}  // namespace workerd::server
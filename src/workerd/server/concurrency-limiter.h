@@ -0,0 +1,118 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#pragma once
+
+#include <kj/async.h>
+#include <kj/list.h>
+#include <kj/refcount.h>
+#include <kj/timer.h>
+#include <atomic>
+
+namespace workerd::server {
+
+using kj::uint;
+
+class LockWaitSamples final: public kj::AtomicRefcounted {
+  // Accumulates how long requests waited for a Worker's isolate locks. Isolates report to this
+  // from whichever thread takes their lock, and the ConcurrencyLimiter consumes the totals.
+
+public:
+  void add(kj::Duration wait) const {
+    totalNs.fetch_add(wait / kj::NANOSECONDS, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  struct Totals {
+    uint64_t count;
+    kj::Duration total;
+  };
+
+  Totals take() const;
+  // Returns the waits added since the last call, and resets them.
+
+private:
+  mutable std::atomic<uint64_t> count = 0;
+  mutable std::atomic<int64_t> totalNs = 0;
+};
+
+struct ConcurrencyLimiterOptions {
+  kj::Duration targetLockWait;
+  // The limit is lowered whenever the average wait for the isolate lock exceeds this.
+
+  uint initialLimit = 16;
+  uint minLimit = 1;
+  uint maxLimit = 1000;
+
+  uint maxQueued = 0;
+  // How many requests may wait for a slot when the limit has been reached. Further requests are
+  // rejected right away.
+
+  kj::Duration maxQueueTime = 1 * kj::SECONDS;
+  // How long a request may wait for a slot before it is rejected.
+};
+
+class ConcurrencyLimiter {
+  // Limits how many requests to a Worker run at once, adjusting the limit with AIMD
+  // (additive-increase, multiplicative-decrease) based on how long requests wait for the isolate
+  // lock. Every `limit` completed requests, the limiter looks at the lock waits reported since
+  // the last adjustment: if the average is over `targetLockWait`, the isolate is falling behind,
+  // and the limit is cut by 10%. Otherwise, if requests had to be queued or rejected because of
+  // the limit, it is raised by one.
+  //
+  // Requests over the limit wait in a bounded FIFO queue, with a deadline, and are rejected when
+  // the queue is full or the deadline passes. Rejecting early keeps the latency of admitted
+  // requests bounded, rather than letting every request queue on the isolate lock until they all
+  // time out.
+  //
+  // Not thread-safe, except for the LockWaitSamples returned by `getLockWaits()`.
+
+public:
+  ConcurrencyLimiter(kj::Timer& timer, ConcurrencyLimiterOptions options,
+                     kj::Own<const LockWaitSamples> lockWaits =
+                         kj::atomicRefcounted<LockWaitSamples>());
+  // `lockWaits` may be shared with the Worker's isolates, which were created before the limiter.
+  ~ConcurrencyLimiter() noexcept(false);
+  KJ_DISALLOW_COPY_AND_MOVE(ConcurrencyLimiter);
+
+  kj::Promise<kj::Maybe<kj::Own<void>>> acquire();
+  // Waits for a slot. Resolves to a permit, which must be held for as long as the request runs,
+  // or to null if the request should be rejected.
+
+  kj::Own<const LockWaitSamples> getLockWaits() const { return kj::atomicAddRef(*lockWaits); }
+  // The Worker's isolates should report their lock waits here.
+
+  uint getLimit() const { return limit; }
+  uint getInFlight() const { return inFlight; }
+  size_t getQueued() const { return queue.size(); }
+
+private:
+  struct Waiter {
+    Waiter(kj::PromiseFulfiller<kj::Maybe<kj::Own<void>>>& fulfiller,
+           ConcurrencyLimiter& limiter);
+    ~Waiter() noexcept(false);
+
+    kj::PromiseFulfiller<kj::Maybe<kj::Own<void>>>& fulfiller;
+    ConcurrencyLimiter& limiter;
+    kj::ListLink<Waiter> link;
+  };
+
+  kj::Timer& timer;
+  ConcurrencyLimiterOptions options;
+  kj::Own<const LockWaitSamples> lockWaits;
+
+  uint limit;
+  uint inFlight = 0;
+  kj::List<Waiter, &Waiter::link> queue;
+
+  uint completedSinceAdjustment = 0;
+  bool limitedSinceAdjustment = false;
+  // Whether any request was queued or rejected because of the limit since it was last adjusted.
+
+  kj::Own<void> makePermit();
+  void release();
+  void adjust();
+};
+
+}  // namespace workerd::server
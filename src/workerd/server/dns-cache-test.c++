@@ -0,0 +1,135 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "dns-cache.h"
+#include <kj/test.h>
+#include <kj/map.h>
+
+namespace workerd::server {
+namespace {
+
+class FakeAddress final: public kj::NetworkAddress {
+public:
+  explicit FakeAddress(kj::String name): name(kj::mv(name)) {}
+
+  kj::Promise<kj::Own<kj::AsyncIoStream>> connect() override { KJ_UNIMPLEMENTED("fake"); }
+  kj::Own<kj::ConnectionReceiver> listen() override { KJ_UNIMPLEMENTED("fake"); }
+  kj::Own<kj::NetworkAddress> clone() override { return kj::heap<FakeAddress>(kj::str(name)); }
+  kj::String toString() override { return kj::str(name); }
+
+private:
+  kj::String name;
+};
+
+class FakeNetwork final: public kj::Network {
+  // Resolves any name to "<name>:<port>#<n>", where n counts lookups of that name, except that
+  // names starting with "bad" fail.
+
+public:
+  uint lookups = 0;
+  kj::HashMap<kj::String, uint> generations;
+
+  kj::Promise<kj::Own<kj::NetworkAddress>> parseAddress(
+      kj::StringPtr addr, uint portHint) override {
+    ++lookups;
+    if (addr.startsWith("bad")) {
+      return KJ_EXCEPTION(FAILED, "no such host", addr);
+    }
+    auto& generation = generations.findOrCreate(addr, [&]() {
+      return decltype(generations)::Entry { kj::str(addr), 0u };
+    });
+    ++generation;
+    kj::Own<kj::NetworkAddress> result =
+        kj::heap<FakeAddress>(kj::str(addr, ':', portHint, '#', generation));
+    return kj::mv(result);
+  }
+
+  kj::Own<kj::NetworkAddress> getSockaddr(const void* sockaddr, uint len) override {
+    KJ_UNIMPLEMENTED("fake");
+  }
+  kj::Own<kj::Network> restrictPeers(
+      kj::ArrayPtr<const kj::StringPtr> allow,
+      kj::ArrayPtr<const kj::StringPtr> deny = nullptr) override {
+    KJ_UNIMPLEMENTED("fake");
+  }
+};
+
+struct DnsCacheTest {
+  kj::EventLoop loop;
+  kj::WaitScope ws;
+  kj::TimerImpl timer;
+  FakeNetwork inner;
+  kj::Own<kj::Network> network;
+
+  DnsCacheTest(DnsCacheOptions options = {})
+      : ws(loop), timer(kj::origin<kj::TimePoint>()),
+        network(newCachingNetwork(inner, timer, options)) {}
+
+  kj::String resolve(kj::StringPtr addr, uint portHint = 80) {
+    return network->parseAddress(addr, portHint).wait(ws)->toString();
+  }
+
+  void advance(kj::Duration amount) {
+    timer.advanceTo(timer.now() + amount);
+  }
+};
+
+KJ_TEST("DNS cache: results are reused until they expire") {
+  DnsCacheTest test;
+
+  KJ_EXPECT(test.resolve("foo") == "foo:80#1");
+  KJ_EXPECT(test.resolve("foo") == "foo:80#1");
+  KJ_EXPECT(test.inner.lookups == 1);
+
+  // The port hint is part of the key.
+  KJ_EXPECT(test.resolve("foo", 443) == "foo:443#2");
+  KJ_EXPECT(test.inner.lookups == 2);
+
+  test.advance(61 * kj::SECONDS);
+  KJ_EXPECT(test.resolve("foo") == "foo:80#3");
+  KJ_EXPECT(test.inner.lookups == 3);
+}
+
+KJ_TEST("DNS cache: concurrent lookups are coalesced") {
+  DnsCacheTest test;
+
+  auto promise1 = test.network->parseAddress("foo", 80);
+  auto promise2 = test.network->parseAddress("foo", 80);
+  KJ_EXPECT(promise1.wait(test.ws)->toString() == "foo:80#1");
+  KJ_EXPECT(promise2.wait(test.ws)->toString() == "foo:80#1");
+  KJ_EXPECT(test.inner.lookups == 1);
+}
+
+KJ_TEST("DNS cache: failures are cached briefly") {
+  DnsCacheTest test;
+
+  KJ_EXPECT_THROW_MESSAGE("no such host", test.resolve("bad.example"));
+  KJ_EXPECT_THROW_MESSAGE("no such host", test.resolve("bad.example"));
+  KJ_EXPECT(test.inner.lookups == 1);
+
+  test.advance(6 * kj::SECONDS);
+  KJ_EXPECT_THROW_MESSAGE("no such host", test.resolve("bad.example"));
+  KJ_EXPECT(test.inner.lookups == 2);
+}
+
+KJ_TEST("DNS cache: names in use are refreshed in the background before they expire") {
+  DnsCacheTest test;
+
+  KJ_EXPECT(test.resolve("foo") == "foo:80#1");
+
+  // Within the refresh window, the old result is still returned, but a new lookup starts.
+  test.advance(55 * kj::SECONDS);
+  KJ_EXPECT(test.resolve("foo") == "foo:80#1");
+  test.loop.run();
+  KJ_EXPECT(test.inner.lookups == 2);
+  KJ_EXPECT(test.resolve("foo") == "foo:80#2");
+
+  // The refreshed result got a full TTL.
+  test.advance(45 * kj::SECONDS);
+  KJ_EXPECT(test.resolve("foo") == "foo:80#2");
+  KJ_EXPECT(test.inner.lookups == 2);
+}
+
+}  // namespace
+}  // namespace workerd::server
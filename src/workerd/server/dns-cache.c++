@@ -0,0 +1,173 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "dns-cache.h"
+#include <kj/map.h>
+#include <kj/debug.h>
+
+namespace workerd::server {
+
+namespace {
+
+class CachingNetwork final: public kj::Network, private kj::TaskSet::ErrorHandler {
+public:
+  CachingNetwork(kj::Network& inner, kj::Timer& timer, DnsCacheOptions options)
+      : inner(inner), timer(timer), options(options), tasks(*this) {}
+
+  kj::Promise<kj::Own<kj::NetworkAddress>> parseAddress(
+      kj::StringPtr addr, uint portHint) override {
+    auto key = kj::str(portHint, '/', addr);
+    auto now = timer.now();
+
+    KJ_IF_MAYBE(entry, entries.find(key)) {
+      KJ_IF_MAYBE(pending, entry->pending) {
+        // Someone else is already looking this name up; wait for them.
+        return waitFor(*pending, kj::mv(key), addr, portHint);
+      } else if (now < entry->expires) {
+        if (entry->address != nullptr && !entry->refreshing &&
+            entry->expires - now <= options.refreshAhead) {
+          entry->refreshing = true;
+          tasks.add(startLookup(key, addr, portHint));
+        }
+        return entry->get();
+      }
+    }
+
+    // Not cached, or expired.
+    auto forked = startLookup(key, addr, portHint).fork();
+    auto result = waitFor(forked, kj::str(key), addr, portHint);
+    // Keep the lookup going even if every caller loses interest, so the result still gets cached.
+    tasks.add(forked.addBranch());
+
+    Entry entry;
+    entry.pending = kj::mv(forked);
+    entries.upsert(kj::mv(key), kj::mv(entry), [](Entry& existing, Entry&& replacement) {
+      existing = kj::mv(replacement);
+    });
+    purgeIfNeeded();
+    return kj::mv(result);
+  }
+
+  kj::Own<kj::NetworkAddress> getSockaddr(const void* sockaddr, uint len) override {
+    return inner.getSockaddr(sockaddr, len);
+  }
+
+  kj::Own<kj::Network> restrictPeers(
+      kj::ArrayPtr<const kj::StringPtr> allow,
+      kj::ArrayPtr<const kj::StringPtr> deny = nullptr) override {
+    // Lookups through the result aren't cached. Wrap it in a new CachingNetwork if that's wanted.
+    return inner.restrictPeers(allow, deny);
+  }
+
+private:
+  kj::Network& inner;
+  kj::Timer& timer;
+  DnsCacheOptions options;
+
+  struct Entry {
+    kj::Maybe<kj::ForkedPromise<void>> pending;
+    // Non-null while a foreground lookup for this name is in progress. Background refreshes
+    // don't set this, since the previous result keeps being served during those.
+
+    kj::Maybe<kj::Own<kj::NetworkAddress>> address;
+    kj::Maybe<kj::Exception> error;
+    // Exactly one of these is set once a lookup has completed.
+
+    kj::TimePoint expires = kj::origin<kj::TimePoint>();
+    bool refreshing = false;
+
+    kj::Promise<kj::Own<kj::NetworkAddress>> get() {
+      KJ_IF_MAYBE(a, address) {
+        return a->get()->clone();
+      } else {
+        return kj::cp(KJ_ASSERT_NONNULL(error));
+      }
+    }
+  };
+
+  kj::HashMap<kj::String, Entry> entries;
+  kj::TaskSet tasks;
+
+  kj::Promise<void> startLookup(kj::StringPtr key, kj::StringPtr addr, uint portHint) {
+    // Resolves `addr` and stores the outcome in the entry for `key`. Never fails.
+    return kj::evalNow([&]() { return inner.parseAddress(addr, portHint); })
+        .then([this, key = kj::str(key)](kj::Own<kj::NetworkAddress> result) {
+      store(key, kj::mv(result));
+    }, [this, key = kj::str(key)](kj::Exception&& e) {
+      store(key, kj::mv(e));
+    });
+  }
+
+  kj::Promise<kj::Own<kj::NetworkAddress>> waitFor(
+      kj::ForkedPromise<void>& lookup, kj::String key, kj::StringPtr addr, uint portHint) {
+    return lookup.addBranch()
+        .then([this, key = kj::mv(key), addr = kj::str(addr), portHint]() {
+      KJ_IF_MAYBE(entry, entries.find(key)) {
+        if (entry->pending == nullptr) return entry->get();
+      }
+      // The entry was flushed or superseded in the meantime; just start over.
+      return parseAddress(addr, portHint);
+    });
+  }
+
+  void store(kj::StringPtr key, kj::OneOf<kj::Own<kj::NetworkAddress>, kj::Exception> result) {
+    auto& entry = KJ_UNWRAP_OR(entries.find(key), {
+      // Entries with a lookup in flight are never purged, so this can't happen, but there's no
+      // harm in dropping the result.
+      return;
+    });
+
+    auto now = timer.now();
+    KJ_SWITCH_ONEOF(result) {
+      KJ_CASE_ONEOF(address, kj::Own<kj::NetworkAddress>) {
+        entry.address = kj::mv(address);
+        entry.error = nullptr;
+        entry.expires = now + options.ttl;
+      }
+      KJ_CASE_ONEOF(exception, kj::Exception) {
+        if (entry.refreshing && entry.pending == nullptr && now < entry.expires) {
+          // A background refresh failed. Keep serving the old result until it expires; the next
+          // use after that does a foreground lookup and reports the error.
+          entry.refreshing = false;
+          return;
+        }
+        entry.address = nullptr;
+        entry.error = kj::mv(exception);
+        entry.expires = now + options.negativeTtl;
+      }
+    }
+    entry.refreshing = false;
+
+    // Safe even though we're running inside the forked promise: `tasks` holds a branch of it.
+    entry.pending = nullptr;
+  }
+
+  void purgeIfNeeded() {
+    if (entries.size() <= options.maxEntries) return;
+
+    auto now = timer.now();
+    entries.eraseAll([&](kj::StringPtr, Entry& entry) {
+      return entry.pending == nullptr && !entry.refreshing && entry.expires <= now;
+    });
+    if (entries.size() <= options.maxEntries) return;
+
+    // Lots of distinct live names. Start over rather than tracking recency.
+    entries.eraseAll([&](kj::StringPtr, Entry& entry) {
+      return entry.pending == nullptr && !entry.refreshing;
+    });
+  }
+
+  void taskFailed(kj::Exception&& exception) override {
+    KJ_LOG(ERROR, exception);
+  }
+};
+
+}  // namespace
+
+kj::Own<kj::Network> newCachingNetwork(
+    kj::Network& inner, kj::Timer& timer, DnsCacheOptions options) {
+  return kj::heap<CachingNetwork>(inner, timer, options);
+}
+
+}  // namespace workerd::server
@@ -0,0 +1,40 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#pragma once
+
+#include <kj/async-io.h>
+#include <kj/timer.h>
+
+namespace workerd::server {
+
+struct DnsCacheOptions {
+  kj::Duration ttl = 60 * kj::SECONDS;
+  // How long a successful lookup is reused. getaddrinfo() doesn't report record TTLs, so this
+  // applies uniformly to all names.
+
+  kj::Duration negativeTtl = 5 * kj::SECONDS;
+  // How long a failed lookup (e.g. unknown host, or no permitted addresses) is remembered.
+
+  kj::Duration refreshAhead = 10 * kj::SECONDS;
+  // When a cached result is used within this much time of its expiry, a new lookup is started in
+  // the background, so that busy names are never looked up in the foreground after the first time.
+
+  uint maxEntries = 4096;
+  // Bound on the number of names held in the cache. When exceeded, expired entries are dropped,
+  // and if that doesn't help, the whole cache is flushed.
+};
+
+kj::Own<kj::Network> newCachingNetwork(
+    kj::Network& inner, kj::Timer& timer, DnsCacheOptions options = {});
+// Wraps `inner` so that the results of parseAddress() are cached, keyed by the address text and
+// port hint. Concurrent lookups of the same name are coalesced into one.
+//
+// If `inner` is a restricted network (see kj::Network::restrictPeers()), its allow/deny check
+// is performed during parseAddress(), so the verdict for each name is cached along with the
+// addresses.
+//
+// The returned object must only be used from the thread that created it.
+
+}  // namespace workerd::server
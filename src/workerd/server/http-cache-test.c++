@@ -0,0 +1,162 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "http-cache.h"
+#include <kj/test.h>
+
+namespace workerd::server {
+namespace {
+
+struct HttpCacheTest {
+  kj::EventLoop loop;
+  kj::WaitScope ws;
+  kj::TimerImpl timer;
+  kj::HttpHeaderTable::Builder builder;
+  kj::Own<kj::HttpService> cache;
+  kj::HttpHeaderId hNamespace;
+  kj::HttpHeaderId hLanguage;
+  kj::Own<kj::HttpHeaderTable> table;
+  kj::Own<kj::HttpClient> client;
+
+  HttpCacheTest(HttpCacheOptions options = {})
+      : ws(loop), timer(kj::origin<kj::TimePoint>()),
+        cache(newHttpCache(timer, builder, options)),
+        hNamespace(builder.add("CF-Cache-Namespace")),
+        hLanguage(builder.add("Accept-Language")),
+        table(builder.build()),
+        client(kj::newHttpClient(*cache)) {}
+
+  kj::HttpHeaders headers(kj::Maybe<kj::StringPtr> language = nullptr,
+                          kj::Maybe<kj::StringPtr> ns = nullptr) {
+    kj::HttpHeaders result(*table);
+    KJ_IF_MAYBE(l, language) result.set(hLanguage, *l);
+    KJ_IF_MAYBE(n, ns) result.set(hNamespace, *n);
+    return result;
+  }
+
+  uint put(kj::StringPtr url, kj::StringPtr payload, kj::HttpHeaders requestHeaders) {
+    auto req = client->request(kj::HttpMethod::PUT, url, requestHeaders, payload.size());
+    req.body->write(payload.begin(), payload.size()).wait(ws);
+    req.body = nullptr;
+    return req.response.wait(ws).statusCode;
+  }
+  uint put(kj::StringPtr url, kj::StringPtr payload) {
+    return put(url, payload, headers());
+  }
+
+  kj::String get(kj::StringPtr url, kj::HttpHeaders requestHeaders) {
+    auto req = client->request(kj::HttpMethod::GET, url, requestHeaders, uint64_t(0));
+    auto response = req.response.wait(ws);
+    auto body = response.body->readAllText().wait(ws);
+    auto status = response.headers->get(KJ_ASSERT_NONNULL(table->stringToId("CF-Cache-Status")));
+    return kj::str(response.statusCode, ' ', status.orDefault("(none)"), ' ', body);
+  }
+  kj::String get(kj::StringPtr url) {
+    return get(url, headers());
+  }
+
+  uint purge(kj::StringPtr url, kj::HttpHeaders requestHeaders) {
+    auto req = client->request(kj::HttpMethod::PURGE, url, requestHeaders, uint64_t(0));
+    return req.response.wait(ws).statusCode;
+  }
+};
+
+constexpr kj::StringPtr CACHEABLE =
+    "HTTP/1.1 200 OK\r\nCache-Control: max-age=60\r\nContent-Length: 5\r\n\r\nhello"_kj;
+
+KJ_TEST("HttpCache: stored responses are served until they expire") {
+  HttpCacheTest test;
+
+  KJ_EXPECT(test.get("http://example.com/foo") == "504 MISS ");
+  KJ_EXPECT(test.put("http://example.com/foo", CACHEABLE) == 204);
+  KJ_EXPECT(test.get("http://example.com/foo") == "200 HIT hello");
+  KJ_EXPECT(test.get("http://example.com/bar") == "504 MISS ");
+
+  test.timer.advanceTo(test.timer.now() + 59 * kj::SECONDS);
+  KJ_EXPECT(test.get("http://example.com/foo") == "200 HIT hello");
+  test.timer.advanceTo(test.timer.now() + 1 * kj::SECONDS);
+  KJ_EXPECT(test.get("http://example.com/foo") == "504 MISS ");
+}
+
+KJ_TEST("HttpCache: uncacheable responses are not stored") {
+  HttpCacheTest test;
+
+  KJ_EXPECT(test.put("http://example.com/a",
+      "HTTP/1.1 200 OK\r\nCache-Control: no-store\r\nContent-Length: 1\r\n\r\na") == 204);
+  KJ_EXPECT(test.put("http://example.com/b",
+      "HTTP/1.1 200 OK\r\nContent-Length: 1\r\n\r\nb") == 204);
+  KJ_EXPECT(test.put("http://example.com/c",
+      "HTTP/1.1 200 OK\r\nCache-Control: max-age=60\r\nSet-Cookie: x=y\r\n"
+      "Content-Length: 1\r\n\r\nc") == 204);
+  KJ_EXPECT(test.get("http://example.com/a") == "504 MISS ");
+  KJ_EXPECT(test.get("http://example.com/b") == "504 MISS ");
+  KJ_EXPECT(test.get("http://example.com/c") == "504 MISS ");
+
+  // s-maxage overrides max-age, and defaultTtl only applies when neither is given.
+  HttpCacheTest test2({ .defaultTtl = 10 * kj::SECONDS });
+  KJ_EXPECT(test2.put("http://example.com/b",
+      "HTTP/1.1 200 OK\r\nContent-Length: 1\r\n\r\nb") == 204);
+  KJ_EXPECT(test2.put("http://example.com/d",
+      "HTTP/1.1 200 OK\r\nCache-Control: max-age=0, s-maxage=30\r\n"
+      "Content-Length: 1\r\n\r\nd") == 204);
+  test2.timer.advanceTo(test2.timer.now() + 20 * kj::SECONDS);
+  KJ_EXPECT(test2.get("http://example.com/b") == "504 MISS ");
+  KJ_EXPECT(test2.get("http://example.com/d") == "200 HIT d");
+}
+
+KJ_TEST("HttpCache: Vary") {
+  HttpCacheTest test;
+
+  auto put = [&](kj::StringPtr language, kj::StringPtr body) {
+    auto payload = kj::str(
+        "HTTP/1.1 200 OK\r\nCache-Control: max-age=60\r\nVary: Accept-Language\r\n"
+        "Content-Length: ", body.size(), "\r\n\r\n", body);
+    KJ_EXPECT(test.put("http://example.com/", payload, test.headers(language)) == 204);
+  };
+  put("en", "hello");
+  put("fr", "bonjour");
+
+  KJ_EXPECT(test.get("http://example.com/", test.headers("en"_kj)) == "200 HIT hello");
+  KJ_EXPECT(test.get("http://example.com/", test.headers("fr"_kj)) == "200 HIT bonjour");
+  KJ_EXPECT(test.get("http://example.com/", test.headers("de"_kj)) == "504 MISS ");
+  KJ_EXPECT(test.get("http://example.com/") == "504 MISS ");
+
+  // Re-storing a variant replaces it.
+  put("en", "hi");
+  KJ_EXPECT(test.get("http://example.com/", test.headers("en"_kj)) == "200 HIT hi");
+  KJ_EXPECT(test.get("http://example.com/", test.headers("fr"_kj)) == "200 HIT bonjour");
+}
+
+KJ_TEST("HttpCache: namespaces and purge") {
+  HttpCacheTest test;
+
+  KJ_EXPECT(test.put("http://example.com/foo", CACHEABLE,
+                     test.headers(nullptr, "other"_kj)) == 204);
+  KJ_EXPECT(test.get("http://example.com/foo") == "504 MISS ");
+  KJ_EXPECT(test.get("http://example.com/foo", test.headers(nullptr, "other"_kj)) ==
+            "200 HIT hello");
+
+  KJ_EXPECT(test.purge("http://example.com/foo", test.headers()) == 404);
+  KJ_EXPECT(test.purge("http://example.com/foo", test.headers(nullptr, "other"_kj)) == 200);
+  KJ_EXPECT(test.get("http://example.com/foo", test.headers(nullptr, "other"_kj)) ==
+            "504 MISS ");
+}
+
+KJ_TEST("HttpCache: size limits") {
+  HttpCacheTest test({ .maxTotalSize = 2048, .maxEntrySize = 4 });
+
+  KJ_EXPECT(test.put("http://example.com/big", CACHEABLE) == 413);
+  KJ_EXPECT(test.get("http://example.com/big") == "504 MISS ");
+
+  // Fill the cache well past its limit; the oldest entries go first.
+  auto small = "HTTP/1.1 200 OK\r\nCache-Control: max-age=60\r\nContent-Length: 1\r\n\r\nx"_kj;
+  for (uint i = 0; i < 100; i++) {
+    KJ_EXPECT(test.put(kj::str("http://example.com/", i), small) == 204);
+  }
+  KJ_EXPECT(test.get("http://example.com/0") == "504 MISS ");
+  KJ_EXPECT(test.get("http://example.com/99") == "200 HIT x");
+}
+
+}  // namespace
+}  // namespace workerd::server
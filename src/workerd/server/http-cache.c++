@@ -0,0 +1,380 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "http-cache.h"
+#include <kj/map.h>
+#include <kj/list.h>
+#include <kj/vector.h>
+#include <kj/debug.h>
+#include <strings.h>
+
+namespace workerd::server {
+
+namespace {
+
+kj::ArrayPtr<const char> trimWhitespace(kj::ArrayPtr<const char> text) {
+  while (text.size() > 0 && (text.front() == ' ' || text.front() == '\t')) text = text.slice(1);
+  while (text.size() > 0 && (text.back() == ' ' || text.back() == '\t')) {
+    text = text.slice(0, text.size() - 1);
+  }
+  return text;
+}
+
+bool equalsIgnoreCase(kj::ArrayPtr<const char> a, kj::StringPtr b) {
+  return a.size() == b.size() && strncasecmp(a.begin(), b.begin(), a.size()) == 0;
+}
+
+template <typename Func>
+void forEachListItem(kj::StringPtr list, Func&& func) {
+  // Calls `func` for each item of a comma-separated header value, with whitespace trimmed.
+
+  size_t pos = 0;
+  while (pos < list.size()) {
+    size_t end = pos;
+    while (end < list.size() && list[end] != ',') ++end;
+    auto item = trimWhitespace(list.slice(pos, end));
+    if (item.size() > 0) func(item);
+    pos = end + 1;
+  }
+}
+
+struct Freshness {
+  bool storable = true;
+  kj::Maybe<kj::Duration> lifetime;
+};
+
+Freshness parseCacheControl(kj::StringPtr cacheControl) {
+  Freshness result;
+  kj::Maybe<kj::Duration> maxAge;
+  kj::Maybe<kj::Duration> sMaxAge;
+
+  forEachListItem(cacheControl, [&](kj::ArrayPtr<const char> directive) {
+    size_t eq = 0;
+    while (eq < directive.size() && directive[eq] != '=') ++eq;
+    auto name = trimWhitespace(directive.slice(0, eq));
+    kj::Maybe<kj::Duration> seconds;
+    if (eq < directive.size()) {
+      auto value = kj::str(trimWhitespace(directive.slice(eq + 1, directive.size())));
+      KJ_IF_MAYBE(n, value.tryParseAs<uint64_t>()) {
+        seconds = *n * kj::SECONDS;
+      }
+    }
+
+    if (equalsIgnoreCase(name, "no-store") || equalsIgnoreCase(name, "no-cache") ||
+        equalsIgnoreCase(name, "private")) {
+      result.storable = false;
+    } else if (equalsIgnoreCase(name, "max-age")) {
+      maxAge = seconds;
+    } else if (equalsIgnoreCase(name, "s-maxage")) {
+      sMaxAge = seconds;
+    }
+  });
+
+  // We're a shared cache, so s-maxage wins.
+  KJ_IF_MAYBE(s, sMaxAge) {
+    result.lifetime = *s;
+  } else {
+    result.lifetime = maxAge;
+  }
+  return result;
+}
+
+class HttpCache final: public kj::HttpService {
+public:
+  HttpCache(kj::Timer& timer, kj::HttpHeaderTable::Builder& headerTableBuilder,
+            HttpCacheOptions options)
+      : timer(timer), options(options),
+        headerTable(headerTableBuilder.getFutureTable()),
+        hAge(headerTableBuilder.add("Age")),
+        hCacheControl(headerTableBuilder.add("Cache-Control")),
+        hCfCacheNamespace(headerTableBuilder.add("CF-Cache-Namespace")),
+        hCfCacheStatus(headerTableBuilder.add("CF-Cache-Status")),
+        hSetCookie(headerTableBuilder.add("Set-Cookie")),
+        hVary(headerTableBuilder.add("Vary")) {}
+
+  ~HttpCache() noexcept(false) {
+    for (auto& bucket: map) {
+      for (auto& entry: bucket.value) {
+        lru.remove(*entry);
+      }
+    }
+  }
+
+  kj::Promise<void> request(
+      kj::HttpMethod method, kj::StringPtr url, const kj::HttpHeaders& headers,
+      kj::AsyncInputStream& requestBody, kj::HttpService::Response& response) override {
+    auto key = kj::str(headers.get(hCfCacheNamespace).orDefault(nullptr), ' ', url);
+
+    switch (method) {
+      case kj::HttpMethod::GET:
+        return match(key, headers, response);
+      case kj::HttpMethod::PUT:
+        return put(kj::mv(key), headers, requestBody, response);
+      case kj::HttpMethod::PURGE:
+        return purge(key, response);
+      default:
+        return response.sendError(501, "Not Implemented", headerTable);
+    }
+  }
+
+private:
+  kj::Timer& timer;
+  HttpCacheOptions options;
+  kj::HttpHeaderTable& headerTable;
+  kj::HttpHeaderId hAge;
+  kj::HttpHeaderId hCacheControl;
+  kj::HttpHeaderId hCfCacheNamespace;
+  kj::HttpHeaderId hCfCacheStatus;
+  kj::HttpHeaderId hSetCookie;
+  kj::HttpHeaderId hVary;
+
+  struct VaryValue {
+    kj::String name;
+    kj::Maybe<kj::String> value;
+  };
+
+  class Entry: public kj::Refcounted {
+  public:
+    Entry(kj::String key, kj::HttpHeaders headers): key(kj::mv(key)), headers(kj::mv(headers)) {}
+
+    kj::String key;
+
+    kj::Array<VaryValue> vary;
+    // Request header values this variant was stored for.
+
+    uint statusCode = 200;
+    kj::String statusText;
+    kj::HttpHeaders headers;
+
+    kj::Array<kj::Array<kj::byte>> chunks;
+    kj::Array<kj::ArrayPtr<const kj::byte>> pieces;
+    uint64_t bodySize = 0;
+
+    kj::TimePoint storedAt = kj::origin<kj::TimePoint>();
+    kj::Duration lifetime = 0 * kj::SECONDS;
+
+    size_t size() const { return sizeof(*this) + key.size() + bodySize; }
+
+  private:
+    kj::ListLink<Entry> link;
+    friend class HttpCache;
+  };
+
+  kj::HashMap<kj::String, kj::Vector<kj::Own<Entry>>> map;
+  // Each URL can have several variants, distinguished by their `vary` values.
+
+  kj::List<Entry, &Entry::link> lru;  // least-recently-used first
+  uint64_t totalSize = 0;
+
+  static kj::Maybe<kj::String> getHeader(
+      const kj::HttpHeaders& headers, kj::ArrayPtr<const char> name) {
+    // Looks up a header by name, whether or not the name is in the header table. Repeated headers
+    // are combined.
+
+    kj::Vector<kj::StringPtr> values;
+    headers.forEach([&](kj::StringPtr n, kj::StringPtr v) {
+      if (equalsIgnoreCase(name, n)) values.add(v);
+    });
+    if (values.empty()) return nullptr;
+    return kj::strArray(values, ", ");
+  }
+
+  static bool sameValue(const kj::Maybe<kj::String>& a, const kj::Maybe<kj::String>& b) {
+    KJ_IF_MAYBE(x, a) {
+      KJ_IF_MAYBE(y, b) return *x == *y;
+      return false;
+    }
+    return b == nullptr;
+  }
+
+  static bool varyMatches(Entry& entry, const kj::HttpHeaders& requestHeaders) {
+    for (auto& v: entry.vary) {
+      if (!sameValue(getHeader(requestHeaders, v.name), v.value)) return false;
+    }
+    return true;
+  }
+
+  kj::Promise<void> match(kj::StringPtr key, const kj::HttpHeaders& requestHeaders,
+                          kj::HttpService::Response& response) {
+    auto now = timer.now();
+
+    KJ_IF_MAYBE(bucket, map.find(key)) {
+      for (auto& e: *bucket) {
+        if (now - e->storedAt >= e->lifetime) continue;
+        if (!varyMatches(*e, requestHeaders)) continue;
+
+        auto& entry = *e;
+        lru.remove(entry);
+        lru.add(entry);
+
+        auto headers = entry.headers.cloneShallow();
+        headers.set(hCfCacheStatus, "HIT");
+        headers.set(hAge, kj::str((now - entry.storedAt) / kj::SECONDS));
+        auto out = response.send(entry.statusCode, entry.statusText, headers, entry.bodySize);
+
+        // Hold a reference in case the entry is evicted or purged while we're writing.
+        return out->write(entry.pieces).attach(kj::mv(out), kj::addRef(entry));
+      }
+    }
+
+    kj::HttpHeaders headers(headerTable);
+    headers.set(hCfCacheStatus, "MISS");
+    response.send(504, "Gateway Timeout", headers, uint64_t(0));
+    return kj::READY_NOW;
+  }
+
+  kj::Promise<void> put(kj::String key, const kj::HttpHeaders& requestHeaders,
+                        kj::AsyncInputStream& requestBody,
+                        kj::HttpService::Response& response) {
+    // We only learn which request headers matter once the payload's headers arrive, but
+    // `requestHeaders` may not be valid by then, so take a copy.
+    auto savedRequestHeaders = requestHeaders.clone();
+
+    auto payload = kj::newHttpInputStream(requestBody, headerTable);
+    auto stored = co_await payload->readResponse(kj::HttpMethod::GET);
+
+    Freshness freshness;
+    KJ_IF_MAYBE(cc, stored.headers->get(hCacheControl)) {
+      freshness = parseCacheControl(*cc);
+    }
+    if (stored.headers->get(hSetCookie) != nullptr || stored.statusCode == 206) {
+      freshness.storable = false;
+    }
+    auto lifetime = freshness.lifetime.orDefault(options.defaultTtl);
+    if (lifetime <= 0 * kj::SECONDS) freshness.storable = false;
+
+    auto entry = kj::refcounted<Entry>(kj::mv(key), stored.headers->clone());
+    entry->statusCode = stored.statusCode;
+    entry->statusText = kj::str(stored.statusText);
+    entry->lifetime = lifetime;
+    // Framing is decided afresh when the entry is served.
+    entry->headers.unset(kj::HttpHeaderId::CONTENT_LENGTH);
+    entry->headers.unset(kj::HttpHeaderId::TRANSFER_ENCODING);
+
+    KJ_IF_MAYBE(vary, stored.headers->get(hVary)) {
+      kj::Vector<VaryValue> varyValues;
+      forEachListItem(*vary, [&](kj::ArrayPtr<const char> name) {
+        if (name.size() == 1 && name[0] == '*') freshness.storable = false;
+        varyValues.add(VaryValue { kj::str(name), getHeader(savedRequestHeaders, name) });
+      });
+      entry->vary = varyValues.releaseAsArray();
+    }
+
+    // Accumulate the body in the buffers it'll be served from.
+    kj::Vector<kj::Array<kj::byte>> chunks;
+    for (;;) {
+      size_t want = 64 * 1024;
+      KJ_IF_MAYBE(length, stored.body->tryGetLength()) {
+        if (*length == 0) break;
+        want = kj::min(want, *length);
+      }
+      // Read at most one byte past the limit, to find out whether it's exceeded.
+      want = kj::min(want, options.maxEntrySize + 1 - entry->bodySize);
+
+      auto buffer = kj::heapArray<kj::byte>(want);
+      size_t n = co_await stored.body->tryRead(buffer.begin(), 1, buffer.size());
+      if (n == 0) break;
+      entry->bodySize += n;
+      if (entry->bodySize > options.maxEntrySize) {
+        kj::HttpHeaders headers(headerTable);
+        response.send(413, "Payload Too Large", headers, uint64_t(0));
+        co_return;
+      }
+      chunks.add(n == buffer.size() ? kj::mv(buffer)
+                                    : kj::heapArray<kj::byte>(buffer.slice(0, n)));
+    }
+
+    // We got here only if the complete payload arrived; a truncated chunked body throws above.
+    if (freshness.storable) {
+      entry->chunks = chunks.releaseAsArray();
+      entry->pieces = KJ_MAP(c, entry->chunks) { return c.asPtr().asConst(); };
+      entry->storedAt = timer.now();
+      insert(kj::mv(entry));
+    }
+
+    kj::HttpHeaders headers(headerTable);
+    response.send(204, "No Content", headers);
+  }
+
+  kj::Promise<void> purge(kj::StringPtr key, kj::HttpService::Response& response) {
+    kj::HttpHeaders headers(headerTable);
+    KJ_IF_MAYBE(bucket, map.findEntry(key)) {
+      for (auto& entry: bucket->value) {
+        lru.remove(*entry);
+        totalSize -= entry->size();
+      }
+      map.erase(*bucket);
+      response.send(200, "OK", headers, uint64_t(0));
+    } else {
+      response.send(404, "Not Found", headers, uint64_t(0));
+    }
+    return kj::READY_NOW;
+  }
+
+  void insert(kj::Own<Entry> entry) {
+    auto& bucket = map.findOrCreate(entry->key, [&]() {
+      return decltype(map)::Entry { kj::str(entry->key), {} };
+    });
+
+    // A new variant replaces any previous one with the same Vary values.
+    for (size_t i = 0; i < bucket.size();) {
+      if (sameVariant(*bucket[i], *entry)) {
+        lru.remove(*bucket[i]);
+        totalSize -= bucket[i]->size();
+        removeVariant(bucket, i);
+      } else {
+        ++i;
+      }
+    }
+
+    totalSize += entry->size();
+    lru.add(*entry);
+    bucket.add(kj::mv(entry));
+    evictIfNeeded();
+  }
+
+  static void removeVariant(kj::Vector<kj::Own<Entry>>& variants, size_t i) {
+    if (i + 1 < variants.size()) variants[i] = kj::mv(variants.back());
+    variants.removeLast();
+  }
+
+  static bool sameVariant(Entry& a, Entry& b) {
+    if (a.vary.size() != b.vary.size()) return false;
+    for (auto i: kj::indices(a.vary)) {
+      if (!equalsIgnoreCase(a.vary[i].name, b.vary[i].name) ||
+          !sameValue(a.vary[i].value, b.vary[i].value)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void evictIfNeeded() {
+    while (totalSize > options.maxTotalSize && !lru.empty()) {
+      auto& victim = lru.front();
+      lru.remove(victim);
+      totalSize -= victim.size();
+
+      auto& bucket = KJ_ASSERT_NONNULL(map.findEntry(victim.key));
+      auto& variants = bucket.value;
+      for (auto i: kj::indices(variants)) {
+        if (variants[i].get() == &victim) {
+          removeVariant(variants, i);
+          break;
+        }
+      }
+      if (variants.empty()) map.erase(bucket);
+    }
+  }
+};
+
+}  // namespace
+
+kj::Own<kj::HttpService> newHttpCache(
+    kj::Timer& timer, kj::HttpHeaderTable::Builder& headerTableBuilder,
+    HttpCacheOptions options) {
+  return kj::heap<HttpCache>(timer, headerTableBuilder, options);
+}
+
+}  // namespace workerd::server
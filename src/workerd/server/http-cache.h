@@ -0,0 +1,49 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#pragma once
+
+#include <kj/compat/http.h>
+#include <kj/timer.h>
+
+namespace workerd::server {
+
+struct HttpCacheOptions {
+  uint64_t maxTotalSize = 64ull << 20;
+  // Upper bound on the bytes held by the cache (bodies plus a rough per-entry overhead).
+  // Least-recently-used entries are evicted beyond this.
+
+  uint64_t maxEntrySize = 8ull << 20;
+  // Bodies bigger than this are refused with "413 Payload Too Large", as the Cache API expects.
+
+  kj::Duration defaultTtl = 0 * kj::SECONDS;
+  // Freshness lifetime of responses that don't specify `s-maxage` or `max-age`. Zero means such
+  // responses aren't stored at all.
+};
+
+kj::Own<kj::HttpService> newHttpCache(
+    kj::Timer& timer, kj::HttpHeaderTable::Builder& headerTableBuilder,
+    HttpCacheOptions options = {});
+// Creates an in-memory implementation of the HTTP protocol that the Cache API (`caches.default`
+// and `caches.open()`) speaks to its `cacheApiOutbound` service:
+// - `GET` (sent with `Cache-Control: only-if-cached`) returns the stored response with
+//   `CF-Cache-Status: HIT`, or "504 Gateway Timeout" with `CF-Cache-Status: MISS`.
+// - `PUT` carries a complete serialized HTTP response as its body, which is stored under the
+//   request URL. Replies "204 No Content", or "413 Payload Too Large" if the body exceeds
+//   `maxEntrySize`. The entry is only committed once the whole payload has been received.
+// - `PURGE` removes the entries for the URL, replying 200, or 404 if there were none.
+//
+// Entries are keyed by URL and the `CF-Cache-Namespace` request header, which distinguishes
+// caches opened with `caches.open()`. The stored response's `Vary` header is honored: each
+// variant remembers the request header values it was stored with, and only matches requests
+// carrying the same values.
+//
+// Responses are not stored if their `Cache-Control` says `no-store`, `no-cache`, or `private`,
+// or if they set a cookie. Freshness comes from `s-maxage`, then `max-age`, then
+// `HttpCacheOptions::defaultTtl`; expired entries are never returned.
+//
+// Bodies are accumulated as they stream in and written out directly from the stored buffers, so
+// a hit involves no copying and no I/O.
+
+}  // namespace workerd::server
@@ -0,0 +1,191 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "kv-store.h"
+#include <kj/test.h>
+
+namespace workerd::server {
+namespace {
+
+class FakeClock final: public kj::Clock {
+public:
+  kj::Date time = kj::UNIX_EPOCH + 1000 * kj::SECONDS;
+  kj::Date now() const override { return time; }
+};
+
+struct LocalKvStoreTest {
+  kj::EventLoop loop;
+  kj::WaitScope ws;
+  FakeClock clock;
+  kj::Own<const kj::Directory> dir;
+  kj::HttpHeaderTable::Builder builder;
+  kj::Own<kj::HttpService> store;
+  kj::HttpHeaderId hMetadata;
+  kj::Own<kj::HttpHeaderTable> table;
+  kj::Own<kj::HttpClient> client;
+
+  LocalKvStoreTest()
+      : ws(loop), dir(kj::newInMemoryDirectory(clock)),
+        store(newLocalKvStore(dir->clone(), clock, builder)),
+        hMetadata(builder.add("CF-KV-Metadata")),
+        table(builder.build()),
+        client(kj::newHttpClient(*store)) {}
+
+  void reopen() {
+    client = nullptr;
+    store = nullptr;
+    kj::HttpHeaderTable::Builder newBuilder;
+    store = newLocalKvStore(dir->clone(), clock, newBuilder);
+    hMetadata = newBuilder.add("CF-KV-Metadata");
+    table = newBuilder.build();
+    client = kj::newHttpClient(*store);
+  }
+
+  uint put(kj::StringPtr url, kj::StringPtr value, kj::Maybe<kj::StringPtr> metadata = nullptr) {
+    kj::HttpHeaders headers(*table);
+    KJ_IF_MAYBE(m, metadata) headers.set(hMetadata, *m);
+    auto req = client->request(kj::HttpMethod::PUT, url, headers, value.size());
+    req.body->write(value.begin(), value.size()).wait(ws);
+    req.body = nullptr;
+    return req.response.wait(ws).statusCode;
+  }
+
+  kj::String get(kj::StringPtr url) {
+    kj::HttpHeaders headers(*table);
+    auto req = client->request(kj::HttpMethod::GET, url, headers, uint64_t(0));
+    auto response = req.response.wait(ws);
+    auto body = response.body->readAllText().wait(ws);
+    if (response.statusCode != 200) return kj::str(response.statusCode);
+    KJ_IF_MAYBE(m, response.headers->get(hMetadata)) {
+      return kj::str(body, ' ', *m);
+    }
+    return kj::mv(body);
+  }
+
+  kj::String post(kj::StringPtr url, kj::StringPtr body) {
+    kj::HttpHeaders headers(*table);
+    auto req = client->request(kj::HttpMethod::POST, url, headers, body.size());
+    req.body->write(body.begin(), body.size()).wait(ws);
+    req.body = nullptr;
+    auto response = req.response.wait(ws);
+    auto text = response.body->readAllText().wait(ws);
+    if (response.statusCode != 200) return kj::str(response.statusCode);
+    return kj::mv(text);
+  }
+
+  uint delete_(kj::StringPtr url) {
+    kj::HttpHeaders headers(*table);
+    auto req = client->request(kj::HttpMethod::DELETE, url, headers, uint64_t(0));
+    return req.response.wait(ws).statusCode;
+  }
+};
+
+KJ_TEST("LocalKvStore: put, get, delete") {
+  LocalKvStoreTest test;
+
+  KJ_EXPECT(test.get("https://fake-host/foo?urlencoded=true") == "404");
+  KJ_EXPECT(test.put("https://fake-host/foo?urlencoded=true", "hello") == 200);
+  KJ_EXPECT(test.get("https://fake-host/foo?urlencoded=true") == "hello");
+
+  KJ_EXPECT(test.put("https://fake-host/foo?urlencoded=true", "world", "{\"a\":1}"_kj) == 200);
+  KJ_EXPECT(test.get("https://fake-host/foo?urlencoded=true") == "world {\"a\":1}");
+
+  KJ_EXPECT(test.put("https://fake-host/a%2Fb?urlencoded=true", "slash") == 200);
+  KJ_EXPECT(test.get("https://fake-host/a%2Fb?urlencoded=true") == "slash");
+
+  KJ_EXPECT(test.delete_("https://fake-host/foo?urlencoded=true") == 200);
+  KJ_EXPECT(test.get("https://fake-host/foo?urlencoded=true") == "404");
+  KJ_EXPECT(test.get("https://fake-host/a%2Fb?urlencoded=true") == "slash");
+}
+
+KJ_TEST("LocalKvStore: contents persist") {
+  LocalKvStoreTest test;
+
+  KJ_EXPECT(test.put("https://fake-host/foo?urlencoded=true", "hello", "\"meta\""_kj) == 200);
+  KJ_EXPECT(test.put("https://fake-host/bar?urlencoded=true", "world") == 200);
+  test.reopen();
+  KJ_EXPECT(test.get("https://fake-host/foo?urlencoded=true") == "hello \"meta\"");
+  KJ_EXPECT(test.get("https://fake-host/bar?urlencoded=true") == "world");
+  KJ_EXPECT(test.get("https://fake-host/?prefix=b") ==
+      "{\"keys\":[{\"name\":\"bar\"}],\"list_complete\":true}");
+}
+
+KJ_TEST("LocalKvStore: expiration") {
+  LocalKvStoreTest test;
+
+  KJ_EXPECT(test.put("https://fake-host/foo?urlencoded=true&expiration_ttl=60", "hello") == 200);
+  KJ_EXPECT(test.get("https://fake-host/foo?urlencoded=true") == "hello");
+  KJ_EXPECT(test.get("https://fake-host/") ==
+      "{\"keys\":[{\"name\":\"foo\",\"expiration\":1060}],\"list_complete\":true}");
+
+  test.clock.time += 60 * kj::SECONDS;
+  KJ_EXPECT(test.get("https://fake-host/foo?urlencoded=true") == "404");
+  KJ_EXPECT(test.get("https://fake-host/") == "{\"keys\":[],\"list_complete\":true}");
+}
+
+KJ_TEST("LocalKvStore: list") {
+  LocalKvStoreTest test;
+
+  for (auto key: { "a1", "a2", "a3", "b1" }) {
+    KJ_EXPECT(test.put(kj::str("https://fake-host/", key, "?urlencoded=true"), "x") == 200);
+  }
+  KJ_EXPECT(test.put("https://fake-host/a4?urlencoded=true", "x", "{\"m\":\"\\\"\"}"_kj) == 200);
+
+  KJ_EXPECT(test.get("https://fake-host/?prefix=a&key_count_limit=2") ==
+      "{\"keys\":[{\"name\":\"a1\"},{\"name\":\"a2\"}],\"list_complete\":false,"
+      "\"cursor\":\"a2\"}");
+  KJ_EXPECT(test.get("https://fake-host/?prefix=a&key_count_limit=2&cursor=a2") ==
+      "{\"keys\":[{\"name\":\"a3\"},"
+      "{\"name\":\"a4\",\"metadata\":\"{\\\"m\\\":\\\"\\\\\\\"\\\"}\"}],"
+      "\"list_complete\":true}");
+  KJ_EXPECT(test.get("https://fake-host/?prefix=b") ==
+      "{\"keys\":[{\"name\":\"b1\"}],\"list_complete\":true}");
+}
+
+KJ_TEST("LocalKvStore: bulk get") {
+  LocalKvStoreTest test;
+
+  KJ_EXPECT(test.put("https://fake-host/foo?urlencoded=true", "hello") == 200);
+  KJ_EXPECT(test.put("https://fake-host/bar?urlencoded=true", "{\"a\":\"\\n\"}") == 200);
+  KJ_EXPECT(test.put("https://fake-host/old?urlencoded=true&expiration_ttl=10", "x") == 200);
+  test.clock.time += 10 * kj::SECONDS;
+
+  KJ_EXPECT(test.post("https://fake-host/bulk/get?urlencoded=true",
+                      "[\"foo\",\"missing\",\"bar\",\"old\"]") ==
+      "{\"foo\":\"hello\",\"missing\":null,\"bar\":\"{\\\"a\\\":\\\"\\\\n\\\"}\",\"old\":null}");
+  KJ_EXPECT(test.post("https://fake-host/bulk/get?urlencoded=true", "[]") == "{}");
+
+  KJ_EXPECT(test.post("https://fake-host/bulk/get?urlencoded=true", "{\"foo\":1}") == "400");
+  KJ_EXPECT(test.post("https://fake-host/bulk/get?urlencoded=true", "[1]") == "400");
+  KJ_EXPECT(test.post("https://fake-host/bulk/get?urlencoded=true", "[\"foo\"") == "400");
+}
+
+KJ_TEST("LocalKvStore: reads are cached for cache_ttl") {
+  LocalKvStoreTest test;
+
+  KJ_EXPECT(test.put("https://fake-host/foo?urlencoded=true", "hello") == 200);
+  KJ_EXPECT(test.get("https://fake-host/foo?urlencoded=true&cache_ttl=120") == "hello");
+
+  // Replace the file behind the store's back: the cached value is still served.
+  auto names = test.dir->listNames();
+  KJ_ASSERT(names.size() == 1);
+  auto path = kj::Path(kj::mv(names[0]));
+  auto modified = test.dir->openFile(path)->readAllBytes();
+  modified[modified.size() - 1] = 'p';
+  auto replacer = test.dir->replaceFile(path, kj::WriteMode::MODIFY);
+  replacer->get().writeAll(modified);
+  replacer->commit();
+
+  test.clock.time += 119 * kj::SECONDS;
+  KJ_EXPECT(test.get("https://fake-host/foo?urlencoded=true") == "hello");
+  test.clock.time += 1 * kj::SECONDS;
+  KJ_EXPECT(test.get("https://fake-host/foo?urlencoded=true") == "hellp");
+
+  // Writes through the store are seen immediately.
+  KJ_EXPECT(test.put("https://fake-host/foo?urlencoded=true", "bye") == 200);
+  KJ_EXPECT(test.get("https://fake-host/foo?urlencoded=true") == "bye");
+}
+
+}  // namespace
+}  // namespace workerd::server
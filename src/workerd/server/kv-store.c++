@@ -0,0 +1,513 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "kv-store.h"
+#include <openssl/sha.h>
+#include <capnp/compat/json.h>
+#include <capnp/message.h>
+#include <kj/debug.h>
+#include <kj/encoding.h>
+#include <kj/list.h>
+#include <kj/map.h>
+#include <kj/vector.h>
+
+namespace workerd::server {
+
+namespace {
+
+struct FileHeader {
+  // Start of each file in the store. The key, the metadata (if any), and the value follow.
+
+  uint32_t magic;
+  uint32_t keySize;
+  uint32_t metadataSize;
+  uint32_t flags;
+  int64_t expiration;
+  // Seconds since the Unix epoch, or zero if the key doesn't expire.
+};
+
+constexpr uint32_t FILE_MAGIC = 0x31564b77;  // "wKV1"
+constexpr uint32_t FLAG_HAS_METADATA = 1;
+
+constexpr size_t MAX_LIST_LIMIT = 1000;
+constexpr size_t MAX_BULK_GET_KEYS = 100;
+constexpr size_t MAX_BULK_GET_REQUEST_SIZE = 128 * 1024;
+
+int64_t toUnixSeconds(kj::Date date) {
+  return (date - kj::UNIX_EPOCH) / kj::SECONDS;
+}
+
+kj::Path pathFor(kj::StringPtr key) {
+  kj::FixedArray<kj::byte, SHA256_DIGEST_LENGTH> hash;
+  SHA256(key.asBytes().begin(), key.size(), hash.begin());
+  return kj::Path(kj::encodeHex(hash));
+}
+
+void addJsonString(kj::Vector<char>& out, kj::ArrayPtr<const char> text) {
+  static constexpr char HEX[] = "0123456789abcdef";
+  out.add('"');
+  for (char c: text) {
+    if (c == '"' || c == '\\') {
+      out.add('\\');
+      out.add(c);
+    } else if (static_cast<kj::byte>(c) < 0x20) {
+      out.addAll("\\u00"_kj);
+      out.add(HEX[c >> 4]);
+      out.add(HEX[c & 0xf]);
+    } else {
+      out.add(c);
+    }
+  }
+  out.add('"');
+}
+
+kj::Maybe<kj::StringPtr> getParam(const kj::Url& url, kj::StringPtr name) {
+  for (auto& param: url.query) {
+    if (param.name == name) return param.value.asPtr();
+  }
+  return nullptr;
+}
+
+class LocalKvStore final: public kj::HttpService {
+public:
+  LocalKvStore(kj::Own<const kj::Directory> directory, const kj::Clock& clock,
+               kj::HttpHeaderTable::Builder& headerTableBuilder, LocalKvStoreOptions options)
+      : directory(kj::mv(directory)), clock(clock), options(options),
+        headerTable(headerTableBuilder.getFutureTable()),
+        hCfKvMetadata(headerTableBuilder.add("CF-KV-Metadata")) {
+    loadIndex();
+  }
+
+  ~LocalKvStore() noexcept(false) {
+    for (auto& entry: cache) {
+      lru.remove(*entry.value);
+    }
+  }
+
+  kj::Promise<void> request(
+      kj::HttpMethod method, kj::StringPtr urlStr, const kj::HttpHeaders& headers,
+      kj::AsyncInputStream& requestBody, kj::HttpService::Response& response) override {
+    auto url = kj::Url::parse(urlStr, kj::Url::HTTP_PROXY_REQUEST);
+
+    if (url.path.size() == 0) {
+      if (method == kj::HttpMethod::GET) {
+        return list(url, response);
+      }
+    } else if (url.path.size() == 2 && url.path[0] == "bulk" && url.path[1] == "get") {
+      if (method == kj::HttpMethod::POST) {
+        return bulkGet(url, requestBody, response);
+      }
+    } else if (url.path.size() == 1) {
+      auto& key = url.path[0];
+      switch (method) {
+        case kj::HttpMethod::GET:
+          return get(key, url, response);
+        case kj::HttpMethod::PUT:
+          return put(kj::mv(key), url, headers, requestBody, response);
+        case kj::HttpMethod::DELETE:
+          return delete_(key, response);
+        default:
+          break;
+      }
+    } else {
+      return response.sendError(404, "Not Found", headerTable);
+    }
+
+    return response.sendError(501, "Not Implemented", headerTable);
+  }
+
+private:
+  kj::Own<const kj::Directory> directory;
+  const kj::Clock& clock;
+  LocalKvStoreOptions options;
+  kj::HttpHeaderTable& headerTable;
+  kj::HttpHeaderId hCfKvMetadata;
+
+  struct IndexEntry {
+    kj::Maybe<kj::String> metadata;
+    int64_t expiration;
+  };
+
+  kj::TreeMap<kj::String, IndexEntry> index;
+  // Every key in the store, in order.
+
+  class CachedValue: public kj::Refcounted {
+  public:
+    kj::String key;
+    kj::Array<const kj::byte> mapping;
+    // The whole file, memory-mapped.
+
+    kj::ArrayPtr<const kj::byte> value;
+    kj::Date cachedUntil = kj::UNIX_EPOCH;
+
+    size_t size() const { return sizeof(*this) + key.size() + value.size(); }
+
+  private:
+    kj::ListLink<CachedValue> link;
+    friend class LocalKvStore;
+  };
+
+  kj::HashMap<kj::String, kj::Own<CachedValue>> cache;
+  kj::List<CachedValue, &CachedValue::link> lru;  // least-recently-used first
+  uint64_t cacheSize = 0;
+
+  void loadIndex() {
+    auto now = toUnixSeconds(clock.now());
+    for (auto& name: directory->listNames()) {
+      KJ_IF_MAYBE(exception, kj::runCatchingExceptions([&]() {
+        auto path = kj::Path(name);
+        auto file = KJ_UNWRAP_OR(directory->tryOpenFile(path), return);
+
+        FileHeader header;
+        auto fileSize = file->stat().size;
+        if (fileSize < sizeof(header) ||
+            file->read(0, kj::arrayPtr(&header, 1).asBytes()) < sizeof(header) ||
+            header.magic != FILE_MAGIC ||
+            fileSize < sizeof(header) + header.keySize + header.metadataSize) {
+          KJ_LOG(WARNING, "ignoring unrecognized file in KV store", name);
+          return;
+        }
+
+        if (header.expiration != 0 && header.expiration <= now) {
+          directory->tryRemove(path);
+          return;
+        }
+
+        auto key = kj::heapString(header.keySize);
+        file->read(sizeof(header), key.asArray().asBytes());
+        kj::Maybe<kj::String> metadata;
+        if (header.flags & FLAG_HAS_METADATA) {
+          auto& m = metadata.emplace(kj::heapString(header.metadataSize));
+          file->read(sizeof(header) + header.keySize, m.asArray().asBytes());
+        }
+
+        index.upsert(kj::mv(key), IndexEntry { kj::mv(metadata), header.expiration });
+      })) {
+        KJ_LOG(WARNING, "failed to read KV store entry", name, *exception);
+      }
+    }
+  }
+
+  kj::Maybe<IndexEntry&> findLive(kj::StringPtr key) {
+    KJ_IF_MAYBE(entry, index.find(key)) {
+      if (entry->expiration != 0 && entry->expiration <= toUnixSeconds(clock.now())) {
+        remove(key);
+        return nullptr;
+      }
+      return *entry;
+    }
+    return nullptr;
+  }
+
+  void remove(kj::StringPtr key) {
+    uncache(key);
+    directory->tryRemove(pathFor(key));
+    index.erase(key);
+  }
+
+  kj::Promise<void> get(kj::StringPtr key, const kj::Url& url,
+                        kj::HttpService::Response& response) {
+    IndexEntry* entry;
+    KJ_IF_MAYBE(e, findLive(key)) {
+      entry = e;
+    } else {
+      return response.sendError(404, "Not Found", headerTable);
+    }
+
+    auto value = read(key, getCacheTtl(url));
+
+    kj::HttpHeaders headers(headerTable);
+    KJ_IF_MAYBE(m, entry->metadata) {
+      headers.set(hCfKvMetadata, kj::str(*m));
+    }
+    auto out = response.send(200, "OK", headers, value->value.size());
+
+    // Hold a reference in case the value is evicted or overwritten while we're writing.
+    auto bytes = value->value;
+    return out->write(bytes.begin(), bytes.size()).attach(kj::mv(out), kj::mv(value));
+  }
+
+  kj::Promise<void> bulkGet(const kj::Url& url, kj::AsyncInputStream& requestBody,
+                            kj::HttpService::Response& response) {
+    // The request body is a JSON array of keys. The response maps each key to its value as a
+    // JSON string, or to null if it is missing.
+    return bulkGetImpl(getCacheTtl(url), requestBody, response);
+  }
+
+  kj::Promise<void> bulkGetImpl(kj::Duration ttl, kj::AsyncInputStream& requestBody,
+                                kj::HttpService::Response& response) {
+    auto text = co_await requestBody.readAllText(MAX_BULK_GET_REQUEST_SIZE);
+
+    capnp::MallocMessageBuilder message;
+    auto keys = message.initRoot<capnp::JsonValue>();
+    bool valid = kj::runCatchingExceptions([&]() {
+      capnp::JsonCodec().decodeRaw(text, keys);
+    }) == nullptr;
+    if (valid && keys.isArray() && keys.getArray().size() <= MAX_BULK_GET_KEYS) {
+      for (auto key: keys.getArray()) {
+        if (!key.isString()) valid = false;
+      }
+    } else {
+      valid = false;
+    }
+    if (!valid) {
+      co_await response.sendError(400, "Bad Request", headerTable);
+      co_return;
+    }
+
+    kj::Vector<char> json;
+    json.add('{');
+    bool first = true;
+    for (auto key: keys.getArray()) {
+      kj::StringPtr name = key.getString();
+      if (!first) json.add(',');
+      first = false;
+      addJsonString(json, name);
+      json.add(':');
+      if (findLive(name) == nullptr) {
+        json.addAll("null"_kj);
+      } else {
+        auto value = read(name, ttl);
+        addJsonString(json, value->value.asChars());
+      }
+    }
+    json.add('}');
+
+    json.add('\0');
+    auto body = kj::String(json.releaseAsArray());
+    kj::HttpHeaders headers(headerTable);
+    headers.set(kj::HttpHeaderId::CONTENT_TYPE, "application/json");
+    auto out = response.send(200, "OK", headers, body.size());
+    co_await out->write(body.begin(), body.size());
+  }
+
+  kj::Duration getCacheTtl(const kj::Url& url) {
+    KJ_IF_MAYBE(param, getParam(url, "cache_ttl")) {
+      KJ_IF_MAYBE(seconds, param->tryParseAs<uint64_t>()) {
+        return *seconds * kj::SECONDS;
+      }
+    }
+    return options.defaultCacheTtl;
+  }
+
+  kj::Own<CachedValue> read(kj::StringPtr key, kj::Duration ttl) {
+    // Returns the value of `key`, which must be live, from the read cache if it's there or else
+    // from its file.
+    auto now = clock.now();
+    KJ_IF_MAYBE(cached, cache.find(key)) {
+      if (now < (*cached)->cachedUntil) {
+        lru.remove(**cached);
+        lru.add(**cached);
+        return kj::addRef(**cached);
+      }
+      uncache(key);
+    }
+    return load(key, now + ttl);
+  }
+
+  kj::Own<CachedValue> load(kj::StringPtr key, kj::Date cachedUntil) {
+    auto file = KJ_UNWRAP_OR(directory->tryOpenFile(pathFor(key)), {
+      KJ_FAIL_REQUIRE("KV store file disappeared", key);
+    });
+    auto size = file->stat().size;
+    auto mapping = file->mmap(0, size);
+
+    FileHeader header;
+    KJ_REQUIRE(mapping.size() >= sizeof(header), "KV store file is truncated", key);
+    memcpy(&header, mapping.begin(), sizeof(header));
+    size_t offset = sizeof(header) + header.keySize + header.metadataSize;
+    KJ_REQUIRE(header.magic == FILE_MAGIC && mapping.size() >= offset,
+        "KV store file is corrupt", key);
+
+    auto result = kj::refcounted<CachedValue>();
+    result->key = kj::str(key);
+    result->value = mapping.slice(offset, mapping.size());
+    result->mapping = kj::mv(mapping);
+    result->cachedUntil = cachedUntil;
+
+    if (result->size() <= options.maxCacheSize) {
+      cacheSize += result->size();
+      lru.add(*result);
+      cache.upsert(kj::str(key), kj::addRef(*result));
+      evictIfNeeded();
+    }
+    return result;
+  }
+
+  void uncache(kj::StringPtr key) {
+    KJ_IF_MAYBE(cached, cache.findEntry(key)) {
+      lru.remove(*cached->value);
+      cacheSize -= cached->value->size();
+      cache.erase(*cached);
+    }
+  }
+
+  void evictIfNeeded() {
+    while (cacheSize > options.maxCacheSize && !lru.empty()) {
+      uncache(kj::str(lru.front().key));
+    }
+  }
+
+  kj::Promise<void> put(kj::String key, const kj::Url& url, const kj::HttpHeaders& headers,
+                        kj::AsyncInputStream& requestBody,
+                        kj::HttpService::Response& response) {
+    // `url` and `headers` may not outlive the first suspension of receiveValue(), so take what we
+    // need from them here.
+    int64_t expiration = 0;
+    KJ_IF_MAYBE(param, getParam(url, "expiration")) {
+      KJ_IF_MAYBE(n, param->tryParseAs<int64_t>()) {
+        expiration = *n;
+      } else {
+        return response.sendError(400, "Bad Request", headerTable);
+      }
+    }
+    KJ_IF_MAYBE(param, getParam(url, "expiration_ttl")) {
+      KJ_IF_MAYBE(ttl, param->tryParseAs<int64_t>()) {
+        expiration = toUnixSeconds(clock.now()) + *ttl;
+      } else {
+        return response.sendError(400, "Bad Request", headerTable);
+      }
+    }
+
+    auto metadata = headers.get(hCfKvMetadata).map([](kj::StringPtr m) { return kj::str(m); });
+
+    KJ_IF_MAYBE(length, requestBody.tryGetLength()) {
+      if (*length > options.maxValueSize) {
+        return response.sendError(413, "Payload Too Large", headerTable);
+      }
+    }
+
+    return receiveValue(kj::mv(key), expiration, kj::mv(metadata), requestBody, response);
+  }
+
+  kj::Promise<void> receiveValue(kj::String key, int64_t expiration,
+                                 kj::Maybe<kj::String> metadata,
+                                 kj::AsyncInputStream& requestBody,
+                                 kj::HttpService::Response& response) {
+    kj::Vector<kj::byte> value;
+    kj::byte buffer[64 * 1024];
+    for (;;) {
+      size_t n = co_await requestBody.tryRead(buffer, 1, sizeof(buffer));
+      if (n == 0) break;
+      if (value.size() + n > options.maxValueSize) {
+        co_await response.sendError(413, "Payload Too Large", headerTable);
+        co_return;
+      }
+      value.addAll(kj::arrayPtr(buffer, n));
+    }
+
+    auto metadataBytes = metadata.map([](kj::String& m) { return m.asBytes(); })
+        .orDefault(nullptr);
+    FileHeader header {
+      .magic = FILE_MAGIC,
+      .keySize = uint32_t(key.size()),
+      .metadataSize = uint32_t(metadataBytes.size()),
+      .flags = metadata == nullptr ? 0 : FLAG_HAS_METADATA,
+      .expiration = expiration,
+    };
+
+    auto replacer = directory->replaceFile(pathFor(key),
+        kj::WriteMode::CREATE | kj::WriteMode::MODIFY);
+    auto& file = replacer->get();
+    uint64_t offset = 0;
+    for (auto part: { kj::arrayPtr(&header, 1).asBytes().asConst(), key.asBytes(),
+                      metadataBytes, value.asPtr().asConst() }) {
+      file.write(offset, part);
+      offset += part.size();
+    }
+    replacer->commit();
+
+    uncache(key);
+    index.upsert(kj::mv(key), IndexEntry { kj::mv(metadata), expiration },
+        [](IndexEntry& existing, IndexEntry&& replacement) {
+      existing = kj::mv(replacement);
+    });
+
+    kj::HttpHeaders responseHeaders(headerTable);
+    response.send(200, "OK", responseHeaders, uint64_t(0));
+  }
+
+  kj::Promise<void> delete_(kj::StringPtr key, kj::HttpService::Response& response) {
+    if (index.find(key) != nullptr) {
+      remove(key);
+    }
+
+    kj::HttpHeaders headers(headerTable);
+    response.send(200, "OK", headers, uint64_t(0));
+    return kj::READY_NOW;
+  }
+
+  kj::Promise<void> list(const kj::Url& url, kj::HttpService::Response& response) {
+    auto prefix = getParam(url, "prefix").orDefault(""_kj);
+    auto cursor = getParam(url, "cursor");
+    size_t limit = MAX_LIST_LIMIT;
+    KJ_IF_MAYBE(param, getParam(url, "key_count_limit")) {
+      KJ_IF_MAYBE(n, param->tryParseAs<size_t>()) {
+        if (*n > 0) limit = kj::min(*n, MAX_LIST_LIMIT);
+      }
+    }
+
+    auto now = toUnixSeconds(clock.now());
+    kj::Vector<char> json;
+    json.addAll("{\"keys\":["_kj);
+    size_t count = 0;
+    bool complete = true;
+    kj::StringPtr last;
+    for (auto& entry: index) {
+      kj::StringPtr key = entry.key;
+      if (!key.startsWith(prefix)) {
+        // Keys are in order, so once we're past the prefix there's nothing more to find.
+        if (key > prefix) break;
+        continue;
+      }
+      KJ_IF_MAYBE(c, cursor) {
+        if (key <= *c) continue;
+      }
+      if (entry.value.expiration != 0 && entry.value.expiration <= now) continue;
+
+      if (count == limit) {
+        complete = false;
+        break;
+      }
+
+      if (count > 0) json.add(',');
+      json.addAll("{\"name\":"_kj);
+      addJsonString(json, key);
+      if (entry.value.expiration != 0) {
+        json.addAll(kj::str(",\"expiration\":", entry.value.expiration));
+      }
+      KJ_IF_MAYBE(m, entry.value.metadata) {
+        // KV sends the metadata JSON as a string, which the binding parses.
+        json.addAll(",\"metadata\":"_kj);
+        addJsonString(json, *m);
+      }
+      json.add('}');
+      last = key;
+      ++count;
+    }
+    json.addAll(complete ? "],\"list_complete\":true"_kj : "],\"list_complete\":false"_kj);
+    if (!complete) {
+      json.addAll(",\"cursor\":"_kj);
+      addJsonString(json, last);
+    }
+    json.add('}');
+
+    json.add('\0');
+    auto body = kj::String(json.releaseAsArray());
+    kj::HttpHeaders headers(headerTable);
+    headers.set(kj::HttpHeaderId::CONTENT_TYPE, "application/json");
+    auto out = response.send(200, "OK", headers, body.size());
+    return out->write(body.begin(), body.size()).attach(kj::mv(out), kj::mv(body));
+  }
+};
+
+}  // namespace
+
+kj::Own<kj::HttpService> newLocalKvStore(
+    kj::Own<const kj::Directory> directory, const kj::Clock& clock,
+    kj::HttpHeaderTable::Builder& headerTableBuilder, LocalKvStoreOptions options) {
+  return kj::heap<LocalKvStore>(kj::mv(directory), clock, headerTableBuilder, options);
+}
+
+}  // namespace workerd::server
@@ -0,0 +1,50 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#pragma once
+
+#include <kj/compat/http.h>
+#include <kj/filesystem.h>
+#include <kj/time.h>
+
+namespace workerd::server {
+
+struct LocalKvStoreOptions {
+  uint64_t maxCacheSize = 16ull << 20;
+  // Upper bound on the bytes of values held in the read cache. Least-recently-used values are
+  // dropped beyond this.
+
+  kj::Duration defaultCacheTtl = 60 * kj::SECONDS;
+  // How long a value read without a `cache_ttl` stays in the read cache.
+
+  uint64_t maxValueSize = 25ull << 20;
+  // Values bigger than this are refused with "413 Payload Too Large", as KV does.
+};
+
+kj::Own<kj::HttpService> newLocalKvStore(
+    kj::Own<const kj::Directory> directory, const kj::Clock& clock,
+    kj::HttpHeaderTable::Builder& headerTableBuilder, LocalKvStoreOptions options = {});
+// Creates an implementation of the HTTP protocol that `KvNamespace` bindings speak to their
+// service, storing the namespace in `directory`:
+// - `GET /<key>` returns the value, with its metadata in the `CF-KV-Metadata` header, or
+//   "404 Not Found".
+// - `PUT /<key>` stores the request body, along with the `CF-KV-Metadata` header and the
+//   `expiration` or `expiration_ttl` query parameters.
+// - `DELETE /<key>` removes the key.
+// - `GET /` lists keys in order, honoring the `prefix`, `cursor` and `key_count_limit` query
+//   parameters, in the JSON format KV uses.
+// - `POST /bulk/get` takes a JSON array of up to 100 keys and returns a JSON object mapping each
+//   key to its value as a string, or to null if it's missing. `cache_ttl` applies as for `GET`.
+//
+// Each key is stored as one file, named by the hex SHA-256 of the key, holding the key, its
+// metadata and expiration, and the value. The keys and metadata are read into memory when the
+// store is created; values are memory-mapped when read. Values read recently are kept mapped in
+// a per-process read cache, for the `cache_ttl` passed with the read (or
+// `LocalKvStoreOptions::defaultCacheTtl`), so hot keys are served without touching the
+// filesystem, straight from the mapping. Writes drop the cached value, so reads always see them.
+//
+// `clock` is used both for expiration and for the read cache. The directory must not be modified
+// by anything else while the store exists.
+
+}  // namespace workerd::server
@@ -0,0 +1,267 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "limit-enforcers.h"
+#include <kj/debug.h>
+#include <pthread.h>
+
+namespace workerd::server {
+
+CpuWatchdog::CpuWatchdog(kj::Duration interval)
+    : interval(interval), thread([this]() { run(); }) {}
+
+CpuWatchdog::~CpuWatchdog() noexcept(false) {
+  // `thread` is joined when it's destroyed, right after this.
+  state.lockExclusive()->shutdown = true;
+}
+
+void CpuWatchdog::run() {
+  for (;;) {
+    bool shutdown = state.when([](const State& s) { return s.shutdown; }, [](State& s) {
+      if (!s.shutdown) {
+        for (auto scope: s.active) {
+          if (!scope->wasTerminated() &&
+              readClock(scope->clock) - scope->start > scope->budget) {
+            scope->terminated.store(true, std::memory_order_relaxed);
+            scope->isolate->TerminateExecution();
+          }
+        }
+      }
+      return s.shutdown;
+    }, interval);
+
+    if (shutdown) return;
+  }
+}
+
+kj::Duration CpuWatchdog::readClock(clockid_t clock) {
+  struct timespec ts;
+  KJ_SYSCALL(clock_gettime(clock, &ts));
+  return ts.tv_sec * kj::SECONDS + ts.tv_nsec * kj::NANOSECONDS;
+}
+
+CpuWatchdog::Scope::Scope(CpuWatchdog& watchdog, v8::Isolate* isolate, kj::Duration budget)
+    : watchdog(watchdog), isolate(isolate), budget(budget) {
+  int error = pthread_getcpuclockid(pthread_self(), &clock);
+  if (error != 0) {
+    KJ_FAIL_SYSCALL("pthread_getcpuclockid", error);
+  }
+  start = readClock(clock);
+  watchdog.state.lockExclusive()->active.add(this);
+}
+
+CpuWatchdog::Scope::~Scope() noexcept(false) {
+  {
+    auto lock = watchdog.state.lockExclusive();
+    auto& active = lock->active;
+    for (auto i: kj::indices(active)) {
+      if (active[i] == this) {
+        active[i] = active.back();
+        active.removeLast();
+        break;
+      }
+    }
+  }
+
+  if (wasTerminated()) {
+    // The termination may have been requested just after the JavaScript finished, in which case
+    // it would otherwise hit whatever runs next.
+    isolate->CancelTerminateExecution();
+  }
+}
+
+kj::Duration CpuWatchdog::Scope::getElapsed() const {
+  return readClock(clock) - start;
+}
+
+// =======================================================================================
+
+WorkerdIsolateLimitEnforcer::WorkerdIsolateLimitEnforcer(
+    WorkerLimits limits, ActorCacheSharedLruOptions lruOptions,
+    kj::Maybe<CpuWatchdog&> watchdog)
+    : limits(kj::mv(limits)), lruOptions(lruOptions), watchdog(watchdog) {
+  KJ_REQUIRE(this->limits.cpuTime == nullptr || watchdog != nullptr,
+      "a CPU time limit requires a watchdog");
+  KJ_REQUIRE(this->limits.startupCpuTime == nullptr || watchdog != nullptr,
+      "a CPU time limit requires a watchdog");
+}
+
+v8::Isolate::CreateParams WorkerdIsolateLimitEnforcer::getCreateParams() {
+  v8::Isolate::CreateParams params;
+  KJ_IF_MAYBE(size, limits.heapSize) {
+    params.constraints.ConfigureDefaultsFromHeapSize(0, *size);
+  }
+  return params;
+}
+
+void WorkerdIsolateLimitEnforcer::customizeIsolate(v8::Isolate* isolate) {
+  this->isolate = isolate;
+  if (limits.heapSize != nullptr) {
+    isolate->AddNearHeapLimitCallback(&nearHeapLimit, this);
+  }
+}
+
+size_t WorkerdIsolateLimitEnforcer::nearHeapLimit(
+    void* data, size_t currentHeapLimit, size_t initialHeapLimit) {
+  auto& self = *static_cast<WorkerdIsolateLimitEnforcer*>(data);
+  if (!self.condemned.exchange(true)) {
+    KJ_LOG(WARNING, "isolate reached its heap limit; condemning it", initialHeapLimit);
+    self.isolate->TerminateExecution();
+  }
+
+  // Returning the same limit would make V8 abort the process. Allow a bit more so that the
+  // termination can unwind.
+  return currentHeapLimit + initialHeapLimit / 4;
+}
+
+kj::Own<void> WorkerdIsolateLimitEnforcer::enterStartupJs(
+    jsg::Lock& lock, kj::Maybe<kj::Exception>& error) const {
+  return enterLimitedJs(lock, error, "Worker exceeded CPU time limit during startup.");
+}
+
+kj::Own<void> WorkerdIsolateLimitEnforcer::enterDynamicImportJs(
+    jsg::Lock& lock, kj::Maybe<kj::Exception>& error) const {
+  return enterLimitedJs(lock, error, "Worker exceeded CPU time limit during dynamic import.");
+}
+
+kj::Own<void> WorkerdIsolateLimitEnforcer::enterLimitedJs(
+    jsg::Lock& lock, kj::Maybe<kj::Exception>& error, kj::StringPtr cpuMessage) const {
+  if (limits.startupCpuTime == nullptr && limits.heapSize == nullptr) {
+    return {};
+  }
+
+  class LimitScope {
+  public:
+    LimitScope(const WorkerdIsolateLimitEnforcer& enforcer, kj::Maybe<kj::Exception>& error,
+               kj::StringPtr cpuMessage, kj::Maybe<kj::Own<CpuWatchdog::Scope>> cpuScope)
+        : enforcer(enforcer), error(error), cpuMessage(cpuMessage),
+          cpuScope(kj::mv(cpuScope)) {}
+
+    ~LimitScope() noexcept(false) {
+      bool cpuExceeded = false;
+      KJ_IF_MAYBE(s, cpuScope) {
+        cpuExceeded = (*s)->wasTerminated();
+      }
+      cpuScope = nullptr;
+
+      if (enforcer.isCondemned()) {
+        error = KJ_EXCEPTION(OVERLOADED,
+            "broken.exceededMemory; jsg.Error: Worker exceeded memory limit.");
+      } else if (cpuExceeded) {
+        error = kj::Exception(kj::Exception::Type::OVERLOADED, __FILE__, __LINE__,
+            kj::str("broken.exceededCpu; jsg.Error: ", cpuMessage));
+      }
+    }
+
+  private:
+    const WorkerdIsolateLimitEnforcer& enforcer;
+    kj::Maybe<kj::Exception>& error;
+    kj::StringPtr cpuMessage;
+    kj::Maybe<kj::Own<CpuWatchdog::Scope>> cpuScope;
+  };
+
+  kj::Maybe<kj::Own<CpuWatchdog::Scope>> cpuScope;
+  KJ_IF_MAYBE(budget, limits.startupCpuTime) {
+    cpuScope = KJ_ASSERT_NONNULL(watchdog).watch(lock.v8Isolate, *budget);
+  }
+  return kj::heap<LimitScope>(*this, error, cpuMessage, kj::mv(cpuScope));
+}
+
+// =======================================================================================
+
+class WorkerdRequestLimitEnforcer::JsScope {
+public:
+  JsScope(WorkerdRequestLimitEnforcer& enforcer,
+          kj::Maybe<kj::Own<CpuWatchdog::Scope>> cpuScope)
+      : enforcer(enforcer), cpuScope(kj::mv(cpuScope)) {}
+
+  ~JsScope() noexcept(false) {
+    KJ_IF_MAYBE(s, cpuScope) {
+      enforcer.cpuUsed += (*s)->getElapsed();
+      bool terminated = (*s)->wasTerminated();
+      cpuScope = nullptr;
+
+      auto& budget = KJ_ASSERT_NONNULL(enforcer.isolateLimits.getLimits().cpuTime);
+      if ((terminated || enforcer.cpuUsed > budget) && enforcer.exceeded == nullptr) {
+        enforcer.exceeded = EventOutcome::EXCEEDED_CPU;
+      }
+    }
+    enforcer.checkCondemned();
+  }
+
+private:
+  WorkerdRequestLimitEnforcer& enforcer;
+  kj::Maybe<kj::Own<CpuWatchdog::Scope>> cpuScope;
+};
+
+WorkerdRequestLimitEnforcer::WorkerdRequestLimitEnforcer(
+    const WorkerdIsolateLimitEnforcer& isolateLimits)
+    : isolateLimits(isolateLimits) {
+  checkCondemned();
+}
+
+kj::Own<void> WorkerdRequestLimitEnforcer::enterJs(jsg::Lock& lock) {
+  checkCondemned();
+  if (exceeded != nullptr) {
+    // Don't run any more JavaScript for this request. IoContext will find out why through
+    // requireLimitsNotExceeded().
+    lock.v8Isolate->TerminateExecution();
+    return {};
+  }
+
+  kj::Maybe<kj::Own<CpuWatchdog::Scope>> cpuScope;
+  KJ_IF_MAYBE(budget, isolateLimits.getLimits().cpuTime) {
+    cpuScope = KJ_ASSERT_NONNULL(isolateLimits.getWatchdog())
+        .watch(lock.v8Isolate, *budget - cpuUsed);
+  }
+  return kj::heap<JsScope>(*this, kj::mv(cpuScope));
+}
+
+void WorkerdRequestLimitEnforcer::topUpActor() {
+  // Each event delivered to an actor gets a fresh budget.
+  if (exceeded == nullptr) {
+    cpuUsed = 0 * kj::NANOSECONDS;
+  }
+}
+
+kj::Maybe<EventOutcome> WorkerdRequestLimitEnforcer::getLimitsExceeded() {
+  checkCondemned();
+  return exceeded;
+}
+
+kj::Promise<void> WorkerdRequestLimitEnforcer::onLimitsExceeded() {
+  // Limits are only checked around JavaScript execution, which reports them synchronously through
+  // requireLimitsNotExceeded(), so the only case left for this promise is a request which starts
+  // out over its limits.
+  checkCondemned();
+  KJ_IF_MAYBE(e, exceeded) {
+    return makeException(*e);
+  }
+  return kj::NEVER_DONE;
+}
+
+void WorkerdRequestLimitEnforcer::requireLimitsNotExceeded() {
+  checkCondemned();
+  KJ_IF_MAYBE(e, exceeded) {
+    kj::throwFatalException(makeException(*e));
+  }
+}
+
+void WorkerdRequestLimitEnforcer::checkCondemned() {
+  if (exceeded == nullptr && isolateLimits.isCondemned()) {
+    exceeded = EventOutcome::EXCEEDED_MEMORY;
+  }
+}
+
+kj::Exception WorkerdRequestLimitEnforcer::makeException(EventOutcome outcome) {
+  if (outcome == EventOutcome::EXCEEDED_MEMORY) {
+    return KJ_EXCEPTION(OVERLOADED,
+        "broken.exceededMemory; jsg.Error: Worker exceeded memory limit.");
+  } else {
+    return KJ_EXCEPTION(OVERLOADED,
+        "broken.exceededCpu; jsg.Error: Worker exceeded CPU time limit.");
+  }
+}
+
+}  // namespace workerd::server
@@ -0,0 +1,180 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#pragma once
+
+#include <workerd/io/limit-enforcer.h>
+#include <workerd/io/actor-cache.h>
+#include <kj/mutex.h>
+#include <kj/thread.h>
+#include <atomic>
+#include <time.h>
+
+namespace workerd::server {
+
+class CpuWatchdog {
+  // Terminates JavaScript that runs past its CPU time budget. A background thread wakes up every
+  // `interval` and reads the CPU clock of each thread that is inside a watched scope, calling
+  // `v8::Isolate::TerminateExecution()` on any that has gone over.
+  //
+  // Only CPU time counts, so time a thread spends blocked or descheduled is not charged to the
+  // JavaScript it was running.
+
+public:
+  explicit CpuWatchdog(kj::Duration interval = 1 * kj::MILLISECONDS);
+  ~CpuWatchdog() noexcept(false);
+  KJ_DISALLOW_COPY(CpuWatchdog);
+
+  class Scope {
+  public:
+    Scope(CpuWatchdog& watchdog, v8::Isolate* isolate, kj::Duration budget);
+    ~Scope() noexcept(false);
+    KJ_DISALLOW_COPY(Scope);
+
+    kj::Duration getElapsed() const;
+    // CPU time the calling thread has used since the scope was entered.
+
+    bool wasTerminated() const { return terminated.load(std::memory_order_relaxed); }
+    // True if the watchdog terminated execution because the budget ran out.
+
+  private:
+    CpuWatchdog& watchdog;
+    v8::Isolate* isolate;
+    clockid_t clock;
+    kj::Duration start;
+    kj::Duration budget;
+    std::atomic<bool> terminated = false;
+
+    friend class CpuWatchdog;
+  };
+
+  kj::Own<Scope> watch(v8::Isolate* isolate, kj::Duration budget) {
+    return kj::heap<Scope>(*this, isolate, budget);
+  }
+  // Watches JavaScript that the calling thread runs in `isolate` (whose lock it must hold) until
+  // the returned object is dropped. If execution is terminated for going over `budget`, the
+  // termination is cancelled again when the scope is dropped, so it can't leak into whatever runs
+  // in the isolate next.
+
+private:
+  kj::Duration interval;
+
+  struct State {
+    kj::Vector<Scope*> active;
+    bool shutdown = false;
+  };
+  kj::MutexGuarded<State> state;
+
+  kj::Thread thread;
+  // Declared last so that everything the thread uses is initialized first.
+
+  void run();
+
+  static kj::Duration readClock(clockid_t clock);
+};
+
+struct WorkerLimits {
+  // Resource limits for one Worker, from `config::Worker::Limits`.
+
+  kj::Maybe<kj::Duration> cpuTime;
+  // CPU time each request may spend in JavaScript.
+
+  kj::Maybe<kj::Duration> startupCpuTime;
+  // CPU time the Worker's top-level script evaluation, and each dynamic import, may take.
+
+  kj::Maybe<size_t> heapSize;
+  // Maximum size of the isolate's heap.
+
+  kj::Maybe<size_t> teeBuffer;
+  // Bytes a tee may buffer for its slower branch before reads for the faster one wait.
+};
+
+class WorkerdIsolateLimitEnforcer final: public IsolateLimitEnforcer {
+  // Enforces the isolate-wide parts of WorkerLimits: the startup CPU time and the heap size.
+  //
+  // When the heap nears its limit, the running JavaScript is terminated and the isolate is
+  // condemned. V8 is then given a little headroom so that termination can unwind without
+  // crashing. A condemned isolate can't be trusted to make progress, so every request to it fails
+  // from then on.
+
+public:
+  WorkerdIsolateLimitEnforcer(WorkerLimits limits, ActorCacheSharedLruOptions lruOptions,
+                              kj::Maybe<CpuWatchdog&> watchdog);
+
+  bool isCondemned() const { return condemned.load(std::memory_order_relaxed); }
+
+  bool hasLimits() const {
+    return limits.cpuTime != nullptr || limits.startupCpuTime != nullptr ||
+           limits.heapSize != nullptr || limits.teeBuffer != nullptr;
+  }
+
+  const WorkerLimits& getLimits() const { return limits; }
+  const ActorCacheSharedLruOptions& getLruOptions() const { return lruOptions; }
+  kj::Maybe<CpuWatchdog&> getWatchdog() const { return watchdog; }
+
+  v8::Isolate::CreateParams getCreateParams() override;
+  void customizeIsolate(v8::Isolate* isolate) override;
+  ActorCacheSharedLruOptions getActorCacheLruOptions() override { return lruOptions; }
+  kj::Own<void> enterStartupJs(
+      jsg::Lock& lock, kj::Maybe<kj::Exception>& error) const override;
+  kj::Own<void> enterDynamicImportJs(
+      jsg::Lock& lock, kj::Maybe<kj::Exception>& error) const override;
+  kj::Own<void> enterLoggingJs(
+      jsg::Lock& lock, kj::Maybe<kj::Exception>& error) const override { return {}; }
+  kj::Own<void> enterInspectorJs(
+      jsg::Lock& lock, kj::Maybe<kj::Exception>& error) const override { return {}; }
+  void completedRequest(kj::StringPtr id) const override {}
+  bool exitJs(jsg::Lock& lock) const override { return isCondemned(); }
+  void reportMetrics(IsolateObserver& isolateMetrics) const override {}
+
+private:
+  WorkerLimits limits;
+  ActorCacheSharedLruOptions lruOptions;
+  kj::Maybe<CpuWatchdog&> watchdog;
+  v8::Isolate* isolate = nullptr;  // set by customizeIsolate()
+  std::atomic<bool> condemned = false;
+
+  kj::Own<void> enterLimitedJs(jsg::Lock& lock, kj::Maybe<kj::Exception>& error,
+                               kj::StringPtr cpuMessage) const;
+
+  static size_t nearHeapLimit(void* data, size_t currentHeapLimit, size_t initialHeapLimit);
+};
+
+class WorkerdRequestLimitEnforcer final: public LimitEnforcer {
+  // Enforces the per-request CPU time limit, and fails requests to a condemned isolate. Every
+  // `enterJs()` for the request draws from the same CPU budget.
+  //
+  // Limits other than CPU and memory aren't enforced.
+
+public:
+  explicit WorkerdRequestLimitEnforcer(const WorkerdIsolateLimitEnforcer& isolateLimits);
+
+  kj::Own<void> enterJs(jsg::Lock& lock) override;
+  void topUpActor() override;
+  void newSubrequest(bool isInHouse) override {}
+  void newKvRequest(KvOpType op) override {}
+  void newAnalyticsEngineRequest() override {}
+  kj::Promise<void> limitDrain() override { return kj::NEVER_DONE; }
+  kj::Promise<void> limitScheduled() override { return kj::NEVER_DONE; }
+  size_t getBufferingLimit() override { return kj::maxValue; }
+  kj::Maybe<size_t> getTeeBackpressureThreshold() override {
+    return isolateLimits.getLimits().teeBuffer;
+  }
+  kj::Maybe<EventOutcome> getLimitsExceeded() override;
+  kj::Promise<void> onLimitsExceeded() override;
+  void requireLimitsNotExceeded() override;
+  void reportMetrics(RequestObserver& requestMetrics) override {}
+
+private:
+  const WorkerdIsolateLimitEnforcer& isolateLimits;
+  kj::Duration cpuUsed = 0 * kj::NANOSECONDS;
+  kj::Maybe<EventOutcome> exceeded;
+
+  class JsScope;
+
+  void checkCondemned();
+  kj::Exception makeException(EventOutcome outcome);
+};
+
+}  // namespace workerd::server
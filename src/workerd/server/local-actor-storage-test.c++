@@ -0,0 +1,380 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "local-actor-storage.h"
+#include <kj/test.h>
+#include <kj/async.h>
+#include <kj/vector.h>
+
+namespace workerd::server {
+namespace {
+
+class ListCollector final: public rpc::ActorStorage::ListStream::Server {
+public:
+  explicit ListCollector(kj::Vector<kj::String>& results): results(results) {}
+
+  kj::Promise<void> values(ValuesContext context) override {
+    for (auto kv: context.getParams().getList()) {
+      results.add(kj::str(kv.getKey().asChars(), "=", kv.getValue().asChars()));
+    }
+    return kj::READY_NOW;
+  }
+  kj::Promise<void> end(EndContext context) override {
+    results.add(kj::str("(end)"));
+    return kj::READY_NOW;
+  }
+
+private:
+  kj::Vector<kj::String>& results;
+};
+
+capnp::Data::Reader bytes(kj::StringPtr text) {
+  return text.asBytes();
+}
+
+struct TestStorage {
+  kj::EventLoop loop;
+  kj::WaitScope ws;
+  kj::Own<const kj::Directory> dir = kj::newInMemoryDirectory(kj::nullClock());
+  LocalActorStorageOptions options;
+  kj::Maybe<rpc::ActorStorage::Stage::Client> client;
+
+  TestStorage(): ws(loop) { reopen(); }
+
+  rpc::ActorStorage::Stage::Client& open() { return KJ_ASSERT_NONNULL(client); }
+
+  void reopen() {
+    client = nullptr;
+    client = rpc::ActorStorage::Stage::Client(newLocalActorStorage(*dir, "obj", options));
+  }
+
+  template <typename Ops>
+  void put(Ops ops, kj::StringPtr key, kj::StringPtr value) {
+    auto req = ops.putRequest();
+    auto entry = req.initEntries(1)[0];
+    entry.setKey(bytes(key));
+    entry.setValue(bytes(value));
+    req.send().wait(ws);
+  }
+
+  template <typename Ops>
+  kj::String get(Ops ops, kj::StringPtr key) {
+    auto req = ops.getRequest();
+    req.setKey(bytes(key));
+    auto resp = req.send().wait(ws);
+    if (!resp.hasValue()) return kj::str("(none)");
+    return kj::str(resp.getValue().asChars());
+  }
+
+  template <typename Ops>
+  int del(Ops ops, kj::StringPtr key) {
+    auto req = ops.deleteRequest();
+    req.initKeys(1).set(0, bytes(key));
+    return req.send().wait(ws).getNumDeleted();
+  }
+
+  kj::String list(kj::Maybe<kj::StringPtr> start, kj::Maybe<kj::StringPtr> end,
+                  int limit = 0, bool reverse = false, kj::Maybe<kj::StringPtr> prefix = nullptr) {
+    kj::Vector<kj::String> results;
+    auto req = open().listRequest();
+    KJ_IF_MAYBE(s, start) req.setStart(bytes(*s));
+    KJ_IF_MAYBE(e, end) req.setEnd(bytes(*e));
+    KJ_IF_MAYBE(p, prefix) req.setPrefix(bytes(*p));
+    req.setLimit(limit);
+    req.setReverse(reverse);
+    req.setStream(kj::heap<ListCollector>(results));
+    req.send().wait(ws);
+    return kj::strArray(results, ", ");
+  }
+};
+
+KJ_TEST("LocalActorStorage: basic reads and writes") {
+  TestStorage test;
+  auto& stage = test.open();
+
+  KJ_EXPECT(test.get(stage, "foo") == "(none)");
+  test.put(stage, "foo", "123");
+  test.put(stage, "bar", "456");
+  test.put(stage, "baz", "789");
+  KJ_EXPECT(test.get(stage, "foo") == "123");
+  KJ_EXPECT(test.get(stage, "bar") == "456");
+
+  test.put(stage, "foo", "abc");
+  KJ_EXPECT(test.get(stage, "foo") == "abc");
+
+  KJ_EXPECT(test.del(stage, "bar") == 1);
+  KJ_EXPECT(test.del(stage, "bar") == 0);
+  KJ_EXPECT(test.get(stage, "bar") == "(none)");
+
+  KJ_EXPECT(test.list(nullptr, nullptr) == "baz=789, foo=abc, (end)");
+}
+
+KJ_TEST("LocalActorStorage: list ranges") {
+  TestStorage test;
+  auto& stage = test.open();
+
+  for (auto key: {"a", "ab", "abc", "b", "ba", "c"}) {
+    test.put(stage, key, "x");
+  }
+
+  KJ_EXPECT(test.list("ab"_kj, "b"_kj) == "ab=x, abc=x, (end)");
+  KJ_EXPECT(test.list("ab"_kj, "b"_kj, 0, true) == "abc=x, ab=x, (end)");
+  KJ_EXPECT(test.list(nullptr, nullptr, 2) == "a=x, ab=x, (end)");
+  KJ_EXPECT(test.list(nullptr, nullptr, 2, true) == "c=x, ba=x, (end)");
+  KJ_EXPECT(test.list(nullptr, nullptr, 0, false, "a"_kj) == "a=x, ab=x, abc=x, (end)");
+  KJ_EXPECT(test.list(nullptr, nullptr, 0, true, "b"_kj) == "ba=x, b=x, (end)");
+  KJ_EXPECT(test.list("aa"_kj, nullptr, 0, false, "a"_kj) == "ab=x, abc=x, (end)");
+  KJ_EXPECT(test.list("d"_kj, nullptr) == "(end)");
+}
+
+KJ_TEST("LocalActorStorage: transactions") {
+  TestStorage test;
+  auto& stage = test.open();
+  test.put(stage, "foo", "123");
+
+  {
+    auto txn = stage.txnRequest().send().wait(test.ws).getTransaction();
+    test.put(txn, "bar", "456");
+    KJ_EXPECT(test.del(txn, "foo") == 1);
+    KJ_EXPECT(test.get(txn, "bar") == "456");
+    KJ_EXPECT(test.get(txn, "foo") == "(none)");
+
+    // Not visible outside the transaction until committed.
+    KJ_EXPECT(test.get(stage, "bar") == "(none)");
+    KJ_EXPECT(test.get(stage, "foo") == "123");
+
+    txn.commitRequest().send().wait(test.ws);
+  }
+
+  KJ_EXPECT(test.get(stage, "bar") == "456");
+  KJ_EXPECT(test.get(stage, "foo") == "(none)");
+
+  {
+    auto txn = stage.txnRequest().send().wait(test.ws).getTransaction();
+    test.put(txn, "baz", "789");
+    txn.rollbackRequest().send().wait(test.ws);
+  }
+
+  KJ_EXPECT(test.get(stage, "baz") == "(none)");
+}
+
+KJ_TEST("LocalActorStorage: sequenced transactions") {
+  TestStorage test;
+  auto& stage = test.open();
+
+  auto sequencedTxn = [&](uint64_t sequence) {
+    auto req = stage.txnRequest();
+    req.initSettings().setSequence(sequence);
+    return req.send().wait(test.ws).getTransaction();
+  };
+
+  auto txn1 = sequencedTxn(1);
+  auto txn2 = sequencedTxn(2);
+  test.put(txn1, "foo", "1");
+  test.put(txn2, "foo", "2");
+
+  // The second commit arrives first, so it waits for the first.
+  auto commit2 = txn2.commitRequest().send();
+  KJ_EXPECT(!commit2.poll(test.ws));
+  KJ_EXPECT(test.get(stage, "foo") == "(none)");
+
+  txn1.commitRequest().send().wait(test.ws);
+  commit2.wait(test.ws);
+  KJ_EXPECT(test.get(stage, "foo") == "2");
+
+  // Retrying an applied sequence number is a no-op.
+  auto retry = sequencedTxn(1);
+  test.put(retry, "foo", "1");
+  retry.commitRequest().send().wait(test.ws);
+  KJ_EXPECT(test.get(stage, "foo") == "2");
+}
+
+KJ_TEST("LocalActorStorage: sequenced transactions that don't commit") {
+  TestStorage test;
+  auto& stage = test.open();
+
+  auto sequencedTxn = [&](uint64_t sequence) {
+    auto req = stage.txnRequest();
+    req.initSettings().setSequence(sequence);
+    return req.send().wait(test.ws).getTransaction();
+  };
+
+  auto commitSequenced = [&](uint64_t sequence, kj::StringPtr key, kj::StringPtr value) {
+    auto txn = sequencedTxn(sequence);
+    test.put(txn, key, value);
+    txn.commitRequest().send().wait(test.ws);
+  };
+
+  {
+    // A transaction that's dropped without committing fails the commits waiting on it.
+    auto txn2 = sequencedTxn(2);
+    test.put(txn2, "foo", "2");
+    auto commit2 = txn2.commitRequest().send();
+    {
+      auto txn1 = sequencedTxn(1);
+      test.put(txn1, "foo", "1");
+    }
+    KJ_EXPECT_THROW(DISCONNECTED, commit2.wait(test.ws));
+    KJ_EXPECT(test.get(stage, "foo") == "(none)");
+  }
+
+  // Both can be retried.
+  commitSequenced(1, "foo", "1");
+  commitSequenced(2, "foo", "2");
+  KJ_EXPECT(test.get(stage, "foo") == "2");
+
+  auto big = kj::str(kj::repeat('x', 1 << 20));
+  auto txn3 = sequencedTxn(3);
+  auto txn4 = sequencedTxn(4);
+  test.put(txn3, "foo", big);
+  test.put(txn4, "bar", "4");
+  auto commit4 = txn4.commitRequest().send();
+  KJ_EXPECT(!commit4.poll(test.ws));
+
+  {
+    // An in-memory file can't grow while it's mapped, so appending to the log fails.
+    auto wal = test.dir->openFile(kj::Path("obj.wal"));
+    auto mapping = wal->mmap(0, wal->stat().size);
+    KJ_EXPECT_THROW(FAILED, txn3.commitRequest().send().wait(test.ws));
+  }
+
+  // The commit waiting on the failed one fails too, and nothing was applied.
+  KJ_EXPECT_THROW(DISCONNECTED, commit4.wait(test.ws));
+  KJ_EXPECT(test.get(stage, "foo") == "2");
+  KJ_EXPECT(test.get(stage, "bar") == "(none)");
+
+  commitSequenced(3, "foo", big);
+  commitSequenced(4, "bar", "4");
+  KJ_EXPECT(test.get(stage, "foo") == big);
+  KJ_EXPECT(test.get(stage, "bar") == "4");
+}
+
+KJ_TEST("LocalActorStorage: alarms") {
+  TestStorage test;
+  auto& stage = test.open();
+
+  // No alarm is reported as zero.
+  KJ_EXPECT(stage.getAlarmRequest().send().wait(test.ws).getScheduledTimeMs() == 0);
+
+  {
+    auto req = stage.setAlarmRequest();
+    req.setScheduledTimeMs(1234);
+    req.send().wait(test.ws);
+  }
+  KJ_EXPECT(stage.getAlarmRequest().send().wait(test.ws).getScheduledTimeMs() == 1234);
+
+  {
+    auto req = stage.deleteAlarmRequest();
+    req.setTimeToDeleteMs(999);
+    KJ_EXPECT(!req.send().wait(test.ws).getDeleted());
+  }
+  KJ_EXPECT(stage.getAlarmRequest().send().wait(test.ws).getScheduledTimeMs() == 1234);
+
+  test.reopen();
+  KJ_EXPECT(test.open().getAlarmRequest().send().wait(test.ws).getScheduledTimeMs() == 1234);
+
+  {
+    auto req = test.open().deleteAlarmRequest();
+    req.setTimeToDeleteMs(1234);
+    KJ_EXPECT(req.send().wait(test.ws).getDeleted());
+  }
+  KJ_EXPECT(test.open().getAlarmRequest().send().wait(test.ws).getScheduledTimeMs() == 0);
+}
+
+KJ_TEST("LocalActorStorage: alarm changes are reported") {
+  struct Listener final: public LocalActorStorageAlarmListener {
+    kj::Vector<kj::String> events;
+
+    void alarmChanged(kj::StringPtr name, kj::Maybe<kj::Date> scheduledTime) override {
+      KJ_IF_MAYBE(t, scheduledTime) {
+        events.add(kj::str(name, "@", (*t - kj::UNIX_EPOCH) / kj::MILLISECONDS));
+      } else {
+        events.add(kj::str(name, "@none"));
+      }
+    }
+  };
+  Listener listener;
+
+  TestStorage test;
+  test.options.alarmListener = listener;
+  test.reopen();
+
+  {
+    auto req = test.open().setAlarmRequest();
+    req.setScheduledTimeMs(1234);
+    req.send().wait(test.ws);
+  }
+  // Writes that don't touch the alarm aren't reported.
+  test.put(test.open(), "foo", "123");
+
+  // Nor is a delete that doesn't match.
+  {
+    auto req = test.open().deleteAlarmRequest();
+    req.setTimeToDeleteMs(999);
+    req.send().wait(test.ws);
+  }
+
+  test.reopen();
+  {
+    auto req = test.open().deleteAlarmRequest();
+    req.setTimeToDeleteMs(1234);
+    req.send().wait(test.ws);
+  }
+
+  KJ_EXPECT(kj::strArray(listener.events, ", ") == "obj@none, obj@1234, obj@1234, obj@none",
+            kj::strArray(listener.events, ", "));
+}
+
+KJ_TEST("LocalActorStorage: data survives reopening") {
+  TestStorage test;
+  test.put(test.open(), "foo", "123");
+  test.put(test.open(), "bar", "456");
+  test.del(test.open(), "foo");
+
+  test.reopen();
+  KJ_EXPECT(test.list(nullptr, nullptr) == "bar=456, (end)");
+}
+
+KJ_TEST("LocalActorStorage: torn log record is discarded") {
+  TestStorage test;
+  test.put(test.open(), "foo", "123");
+  test.put(test.open(), "bar", "456");
+  test.client = nullptr;
+
+  // Chop a few bytes off the end of the log, as if we crashed while writing the last record.
+  auto wal = test.dir->openFile(kj::Path("obj.wal"), kj::WriteMode::MODIFY);
+  wal->truncate(wal->stat().size - 3);
+
+  test.reopen();
+  KJ_EXPECT(test.list(nullptr, nullptr) == "foo=123, (end)");
+
+  // New writes are appended after the valid prefix.
+  test.put(test.open(), "baz", "789");
+  test.reopen();
+  KJ_EXPECT(test.list(nullptr, nullptr) == "baz=789, foo=123, (end)");
+}
+
+KJ_TEST("LocalActorStorage: compaction") {
+  TestStorage test;
+  test.options.compactionThreshold = 64;
+  test.reopen();
+
+  for (uint i = 0; i < 20; i++) {
+    test.put(test.open(), kj::str("key", i % 5), kj::str("value", i));
+  }
+  test.del(test.open(), "key3");
+
+  // The log should have been folded into the data file at least once by now.
+  KJ_EXPECT(test.dir->openFile(kj::Path("obj.data"))->stat().size > 0);
+  KJ_EXPECT(test.dir->openFile(kj::Path("obj.wal"))->stat().size < 200);
+
+  auto expected = "key0=value15, key1=value16, key2=value17, key4=value19, (end)";
+  KJ_EXPECT(test.list(nullptr, nullptr) == expected);
+  test.reopen();
+  KJ_EXPECT(test.list(nullptr, nullptr) == expected);
+  KJ_EXPECT(test.get(test.open(), "key2") == "value17");
+}
+
+}  // namespace
+}  // namespace workerd::server
@@ -0,0 +1,911 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "local-actor-storage.h"
+#include <kj/table.h>
+#include <kj/map.h>
+#include <kj/vector.h>
+#include <kj/debug.h>
+#include <kj/async.h>
+
+namespace workerd::server {
+
+namespace {
+
+// =======================================================================================
+// On-disk format
+//
+// The write-ahead log (`<name>.wal`) is a sequence of records, each of which is:
+//
+//     uint32 magic      WAL_RECORD_MAGIC
+//     uint32 size       size of the payload in bytes
+//     uint64 checksum   FNV-1a of the payload
+//     byte[size]        payload: a sequence of ops (see `Op`)
+//
+// Each record is one atomic commit. All integers are little-endian; integers inside payloads are
+// unsigned LEB128 varints unless noted.
+//
+// The data file (`<name>.data`) is written only by compaction, and always replaced atomically:
+//
+//     uint64 magic      DATA_FILE_MAGIC
+//     uint8  hasAlarm
+//     int64  alarmMs
+//     records...        until end of file, in key order
+//
+// where each record is:
+//
+//     varint shared     length of the prefix shared with the previous record's key
+//     varint suffixLen
+//     varint valueLen
+//     byte[suffixLen]   key suffix
+//     byte[valueLen]    value
+//
+// Replaying the log over a data file which already contains some of the log's effects is
+// harmless, because every op's effect is determined entirely by the op itself. This is what
+// makes it safe to truncate the log only after a compacted data file has been committed.
+
+constexpr uint32_t WAL_RECORD_MAGIC = 0x4c41574bu;
+constexpr uint64_t DATA_FILE_MAGIC = 0x31415441444b4c57ull;
+constexpr size_t WAL_HEADER_SIZE = 16;
+constexpr size_t DATA_HEADER_SIZE = 17;
+
+constexpr size_t LIST_CHUNK_ENTRIES = rpc::ActorStorage::MAX_KEYS;
+constexpr size_t LIST_CHUNK_BYTES = 1u << 20;
+// list() and getMultiple() stream their results in chunks no bigger than this.
+
+enum class Op: kj::byte {
+  PUT = 1,           // varint keyLen, key, varint valueLen, value
+  DELETE = 2,        // varint keyLen, key
+  DELETE_ALL = 3,    // (nothing)
+  SET_ALARM = 4,     // int64 scheduledTimeMs (fixed-width)
+  DELETE_ALARM = 5,  // (nothing)
+};
+
+uint64_t checksum(kj::ArrayPtr<const kj::byte> bytes) {
+  // 64-bit FNV-1a. This only needs to detect torn writes, not adversarial corruption.
+  uint64_t result = 0xcbf29ce484222325ull;
+  for (kj::byte b: bytes) {
+    result ^= b;
+    result *= 0x100000001b3ull;
+  }
+  return result;
+}
+
+class Writer {
+public:
+  void writeVarint(uint64_t value) {
+    while (value >= 0x80) {
+      bytes.add(static_cast<kj::byte>(value | 0x80));
+      value >>= 7;
+    }
+    bytes.add(static_cast<kj::byte>(value));
+  }
+  void writeFixed32(uint32_t value) {
+    for (uint i = 0; i < 4; i++) bytes.add(static_cast<kj::byte>(value >> (i * 8)));
+  }
+  void writeFixed64(uint64_t value) {
+    for (uint i = 0; i < 8; i++) bytes.add(static_cast<kj::byte>(value >> (i * 8)));
+  }
+  void writeByte(kj::byte value) { bytes.add(value); }
+  void writeBytes(kj::ArrayPtr<const kj::byte> data) { bytes.addAll(data); }
+
+  size_t size() const { return bytes.size(); }
+  kj::ArrayPtr<const kj::byte> asPtr() const { return bytes.asPtr(); }
+  void clear() { bytes.clear(); }
+  kj::Array<kj::byte> finish() { return bytes.releaseAsArray(); }
+
+private:
+  kj::Vector<kj::byte> bytes;
+};
+
+class Reader {
+public:
+  explicit Reader(kj::ArrayPtr<const kj::byte> bytes): bytes(bytes) {}
+
+  bool atEnd() const { return pos == bytes.size(); }
+  size_t position() const { return pos; }
+
+  uint64_t readVarint() {
+    uint64_t result = 0;
+    for (uint shift = 0;; shift += 7) {
+      KJ_REQUIRE(shift < 64 && pos < bytes.size(), "local actor storage is corrupt");
+      kj::byte b = bytes[pos++];
+      result |= static_cast<uint64_t>(b & 0x7f) << shift;
+      if ((b & 0x80) == 0) return result;
+    }
+  }
+  uint32_t readFixed32() {
+    auto data = readBytes(4);
+    uint32_t result = 0;
+    for (uint i = 0; i < 4; i++) result |= static_cast<uint32_t>(data[i]) << (i * 8);
+    return result;
+  }
+  uint64_t readFixed64() {
+    auto data = readBytes(8);
+    uint64_t result = 0;
+    for (uint i = 0; i < 8; i++) result |= static_cast<uint64_t>(data[i]) << (i * 8);
+    return result;
+  }
+  kj::byte readByte() { return readBytes(1)[0]; }
+  kj::ArrayPtr<const kj::byte> readBytes(uint64_t size) {
+    KJ_REQUIRE(size <= bytes.size() - pos, "local actor storage is corrupt");
+    auto result = bytes.slice(pos, pos + size);
+    pos += size;
+    return result;
+  }
+
+private:
+  kj::ArrayPtr<const kj::byte> bytes;
+  size_t pos = 0;
+};
+
+kj::Maybe<kj::String> prefixEnd(kj::StringPtr prefix) {
+  // Returns the smallest key greater than every key starting with `prefix`, or null if there is
+  // no such key (the prefix is empty or all 0xff bytes).
+  auto bytes = prefix.asBytes();
+  for (size_t i = bytes.size(); i > 0; i--) {
+    if (bytes[i - 1] != 0xff) {
+      auto result = kj::heapString(prefix.begin(), i);
+      result[i - 1] = static_cast<char>(bytes[i - 1] + 1);
+      return kj::mv(result);
+    }
+  }
+  return nullptr;
+}
+
+kj::String keyFromData(capnp::Data::Reader data) {
+  return kj::heapString(data.asChars());
+}
+
+// =======================================================================================
+// Batch
+
+class Batch {
+  // Accumulates the ops of one commit, along with an overlay of their effects so that reads
+  // made before the commit can observe them.
+
+public:
+  void put(kj::StringPtr key, kj::ArrayPtr<const kj::byte> value) {
+    writer.writeByte(static_cast<kj::byte>(Op::PUT));
+    writer.writeVarint(key.size());
+    writer.writeBytes(key.asBytes());
+    writer.writeVarint(value.size());
+    writer.writeBytes(value);
+    overlay.upsert(kj::str(key), kj::heapArray(value),
+        [](auto& existing, auto&& replacement) { existing = kj::mv(replacement); });
+  }
+
+  void del(kj::StringPtr key) {
+    writer.writeByte(static_cast<kj::byte>(Op::DELETE));
+    writer.writeVarint(key.size());
+    writer.writeBytes(key.asBytes());
+    overlay.upsert(kj::str(key), nullptr,
+        [](auto& existing, auto&& replacement) { existing = kj::mv(replacement); });
+  }
+
+  void deleteAll() {
+    writer.writeByte(static_cast<kj::byte>(Op::DELETE_ALL));
+    overlay.clear();
+    clearedAll = true;
+  }
+
+  void setAlarm(kj::Maybe<int64_t> scheduledTimeMs) {
+    KJ_IF_MAYBE(t, scheduledTimeMs) {
+      writer.writeByte(static_cast<kj::byte>(Op::SET_ALARM));
+      writer.writeFixed64(static_cast<uint64_t>(*t));
+    } else {
+      writer.writeByte(static_cast<kj::byte>(Op::DELETE_ALARM));
+    }
+    alarm = scheduledTimeMs;
+  }
+
+  bool empty() const { return writer.size() == 0; }
+
+  void clear() {
+    writer.clear();
+    overlay.clear();
+    clearedAll = false;
+    alarm = nullptr;
+  }
+
+private:
+  Writer writer;
+  kj::HashMap<kj::String, kj::Maybe<kj::Array<kj::byte>>> overlay;
+  bool clearedAll = false;
+  kj::Maybe<kj::Maybe<int64_t>> alarm;
+
+  friend class LocalStore;
+};
+
+// =======================================================================================
+// LocalStore
+
+class LocalStore final: public kj::Refcounted, private kj::TaskSet::ErrorHandler {
+public:
+  LocalStore(const kj::Directory& dir, kj::StringPtr name, LocalActorStorageOptions options)
+      : dir(dir),
+        name(kj::str(name)),
+        dataPath(kj::Path(kj::str(name, ".data"))),
+        walPath(kj::Path(kj::str(name, ".wal"))),
+        options(options),
+        walFile(dir.openFile(walPath, kj::WriteMode::CREATE | kj::WriteMode::MODIFY)),
+        tasks(*this) {
+    KJ_IF_MAYBE(file, dir.tryOpenFile(dataPath)) {
+      dataFile = kj::mv(*file);
+      loadDataFile();
+    }
+    replayWal();
+    notifyAlarm();
+  }
+
+  struct Location {
+    bool inWal;
+    uint64_t offset;
+    uint32_t size;
+  };
+
+  struct Entry {
+    kj::String key;
+    Location location;
+  };
+
+  struct EntryCallbacks {
+    inline kj::StringPtr keyForRow(const Entry& row) const { return row.key; }
+
+    inline bool isBefore(const Entry& row, kj::StringPtr key) const { return row.key < key; }
+    inline bool isBefore(const Entry& a, const Entry& b) const { return a.key < b.key; }
+
+    inline bool matches(const Entry& row, kj::StringPtr key) const { return row.key == key; }
+  };
+
+  using Index = kj::Table<Entry, kj::TreeIndex<EntryCallbacks>>;
+
+  Index& getIndex() { return index; }
+  // The committed (but not necessarily yet synced) contents. list() reads this directly.
+
+  kj::Array<kj::byte> readValue(const Location& location) {
+    const kj::ReadableFile& file = location.inWal ? *walFile : *KJ_ASSERT_NONNULL(dataFile);
+    auto result = kj::heapArray<kj::byte>(location.size);
+    size_t n = file.read(location.offset, result);
+    KJ_REQUIRE(n == result.size(), "local actor storage is truncated");
+    return result;
+  }
+
+  kj::Maybe<kj::Array<kj::byte>> get(Batch& batch, kj::StringPtr key) {
+    KJ_IF_MAYBE(pending, batch.overlay.find(key)) {
+      return pending->map([](kj::Array<kj::byte>& value) { return kj::heapArray(value.asPtr()); });
+    }
+    if (batch.clearedAll) return nullptr;
+    return index.find(key).map([&](Entry& entry) { return readValue(entry.location); });
+  }
+
+  bool has(Batch& batch, kj::StringPtr key) {
+    KJ_IF_MAYBE(pending, batch.overlay.find(key)) {
+      return *pending != nullptr;
+    }
+    return !batch.clearedAll && index.find(key) != nullptr;
+  }
+
+  size_t count(Batch& batch) {
+    // Number of keys that would exist if `batch` were committed now.
+    size_t result = batch.clearedAll ? 0 : index.size();
+    for (auto& entry: batch.overlay) {
+      bool existed = !batch.clearedAll && index.find(entry.key) != nullptr;
+      bool exists = entry.value != nullptr;
+      result = result + exists - existed;
+    }
+    return result;
+  }
+
+  kj::Maybe<int64_t> getAlarm(Batch& batch) {
+    KJ_IF_MAYBE(pending, batch.alarm) {
+      return *pending;
+    }
+    return alarm;
+  }
+
+  kj::Promise<void> commit(Batch& batch) {
+    // Makes `batch` visible immediately. The returned promise resolves once it is durable.
+
+    if (batch.empty()) return kj::READY_NOW;
+
+    auto payload = batch.writer.asPtr();
+    Writer header;
+    header.writeFixed32(WAL_RECORD_MAGIC);
+    header.writeFixed32(payload.size());
+    header.writeFixed64(checksum(payload));
+
+    uint64_t recordOffset = walSize;
+    walFile->write(recordOffset, header.asPtr());
+    walFile->write(recordOffset + WAL_HEADER_SIZE, payload);
+    applyOps(payload, recordOffset + WAL_HEADER_SIZE);
+    walSize = recordOffset + WAL_HEADER_SIZE + payload.size();
+
+    bool alarmChanged = batch.alarm != nullptr;
+    batch.clear();
+    if (alarmChanged) notifyAlarm();
+    return whenSynced();
+  }
+
+  kj::Promise<void> commitInSequence(Batch& batch, uint64_t sequence) {
+    // Commits `batch` as the sequenced transaction numbered `sequence` (see
+    // `DbSettings.sequence`), first waiting for its predecessor if that hasn't committed yet.
+
+    if (sequence <= lastSequence) {
+      // Already applied. This is a retry of a commit whose result was lost.
+      batch.clear();
+      return kj::READY_NOW;
+    }
+
+    if (sequence > lastSequence + 1) {
+      auto paf = kj::newPromiseAndFulfiller<void>();
+      sequenceWaiters.upsert(sequence, kj::mv(paf.fulfiller),
+          [](auto& existing, auto&& replacement) { existing = kj::mv(replacement); });
+      return paf.promise.then([this, &batch, sequence]() {
+        return commitInSequence(batch, sequence);
+      });
+    }
+
+    kj::Promise<void> promise = nullptr;
+    KJ_IF_MAYBE(exception, kj::runCatchingExceptions([&]() {
+      promise = commit(batch);
+    })) {
+      abandonSequence(sequence);
+      return kj::mv(*exception);
+    }
+
+    lastSequence = sequence;
+    KJ_IF_MAYBE(next, sequenceWaiters.find(sequence + 1)) {
+      (*next)->fulfill();
+      sequenceWaiters.erase(sequence + 1);
+    }
+    return promise;
+  }
+
+  void abandonSequence(uint64_t sequence) {
+    // Called when the sequenced transaction numbered `sequence` ended without committing, e.g.
+    // because the commit failed or the client dropped it. Nothing after it can commit before it
+    // does, so later commits that are waiting fail with DISCONNECTED, which tells the client to
+    // retry them once it has retried this one. Does nothing if `sequence` has been committed.
+
+    if (sequence <= lastSequence) return;
+
+    kj::Vector<uint64_t> abandoned;
+    for (auto& waiter: sequenceWaiters) {
+      if (waiter.key >= sequence) abandoned.add(waiter.key);
+    }
+    for (auto later: abandoned) {
+      KJ_IF_MAYBE(fulfiller, sequenceWaiters.find(later)) {
+        (*fulfiller)->reject(KJ_EXCEPTION(DISCONNECTED,
+            "an earlier sequenced transaction was abandoned", sequence, later));
+      }
+      sequenceWaiters.erase(later);
+    }
+  }
+
+private:
+  const kj::Directory& dir;
+  kj::String name;
+  kj::Path dataPath;
+  kj::Path walPath;
+  LocalActorStorageOptions options;
+
+  kj::Maybe<kj::Own<const kj::ReadableFile>> dataFile;
+  kj::Own<const kj::File> walFile;
+  uint64_t dataSize = 0;
+  uint64_t walSize = 0;
+
+  Index index;
+  kj::Maybe<int64_t> alarm;
+
+  kj::Vector<kj::Own<kj::PromiseFulfiller<void>>> syncWaiters;
+  bool syncScheduled = false;
+
+  uint64_t lastSequence = 0;
+  // The last sequenced transaction committed through this store.
+
+  kj::HashMap<uint64_t, kj::Own<kj::PromiseFulfiller<void>>> sequenceWaiters;
+  // Sequenced commits that arrived before their predecessor, keyed by sequence number.
+  kj::TaskSet tasks;
+
+  void taskFailed(kj::Exception&& exception) override {
+    KJ_LOG(ERROR, "local actor storage background task failed", exception);
+  }
+
+  void notifyAlarm() {
+    KJ_IF_MAYBE(listener, options.alarmListener) {
+      listener->alarmChanged(name, alarm.map([](int64_t ms) {
+        return kj::UNIX_EPOCH + ms * kj::MILLISECONDS;
+      }));
+    }
+  }
+
+  void putEntry(kj::ArrayPtr<const char> key, Location location) {
+    index.upsert(Entry { kj::heapString(key), location },
+                 [&](Entry& existing, Entry&& replacement) {
+      existing.location = replacement.location;
+    });
+  }
+
+  void loadDataFile() {
+    auto& file = *KJ_ASSERT_NONNULL(dataFile);
+    dataSize = file.stat().size;
+    if (dataSize == 0) return;
+
+    auto mapping = file.mmap(0, dataSize);
+    Reader reader(mapping);
+    KJ_REQUIRE(reader.readFixed64() == DATA_FILE_MAGIC, "not a local actor storage data file");
+    bool hasAlarm = reader.readByte();
+    int64_t alarmMs = static_cast<int64_t>(reader.readFixed64());
+    if (hasAlarm) alarm = alarmMs;
+
+    kj::Vector<char> key;
+    while (!reader.atEnd()) {
+      uint64_t shared = reader.readVarint();
+      uint64_t suffixLen = reader.readVarint();
+      uint64_t valueLen = reader.readVarint();
+      KJ_REQUIRE(shared <= key.size() && valueLen <= 0xffffffffu,
+          "local actor storage is corrupt");
+      key.resize(shared);
+      key.addAll(reader.readBytes(suffixLen).asChars());
+      uint64_t valueOffset = reader.position();
+      reader.readBytes(valueLen);
+
+      // Records are written in key order, so we could insert at the end, but kj::TreeIndex
+      // doesn't offer a way to hint that.
+      putEntry(key.asPtr(),
+          Location { false, valueOffset, static_cast<uint32_t>(valueLen) });
+    }
+  }
+
+  void replayWal() {
+    uint64_t size = walFile->stat().size;
+    uint64_t validSize = 0;
+
+    if (size > 0) {
+      auto mapping = walFile->mmap(0, size);
+      while (size - validSize >= WAL_HEADER_SIZE) {
+        Reader header(mapping.slice(validSize, validSize + WAL_HEADER_SIZE));
+        uint32_t magic = header.readFixed32();
+        uint64_t payloadSize = header.readFixed32();
+        uint64_t expectedChecksum = header.readFixed64();
+        uint64_t payloadOffset = validSize + WAL_HEADER_SIZE;
+
+        if (magic != WAL_RECORD_MAGIC || payloadSize > size - payloadOffset) break;
+        auto payload = mapping.slice(payloadOffset, payloadOffset + payloadSize);
+        if (checksum(payload) != expectedChecksum) break;
+
+        applyOps(payload, payloadOffset);
+        validSize = payloadOffset + payloadSize;
+      }
+    }
+
+    if (validSize < size) {
+      // The tail of the log was torn by a crash in the middle of a write. Nothing in it was ever
+      // acknowledged as committed, so discard it.
+      KJ_LOG(WARNING, "discarding incomplete record at end of local actor storage log",
+          walPath, validSize, size);
+      walFile->truncate(validSize);
+      walFile->datasync();
+    }
+    walSize = validSize;
+  }
+
+  void applyOps(kj::ArrayPtr<const kj::byte> payload, uint64_t payloadOffset) {
+    Reader reader(payload);
+    while (!reader.atEnd()) {
+      switch (static_cast<Op>(reader.readByte())) {
+        case Op::PUT: {
+          auto key = reader.readBytes(reader.readVarint()).asChars();
+          uint64_t valueLen = reader.readVarint();
+          uint64_t valueOffset = payloadOffset + reader.position();
+          reader.readBytes(valueLen);
+          putEntry(key,
+              Location { true, valueOffset, static_cast<uint32_t>(valueLen) });
+          continue;
+        }
+        case Op::DELETE: {
+          auto key = reader.readBytes(reader.readVarint()).asChars();
+          auto ownKey = kj::heapString(key);
+          index.eraseMatch(kj::StringPtr(ownKey));
+          continue;
+        }
+        case Op::DELETE_ALL:
+          index.clear();
+          continue;
+        case Op::SET_ALARM:
+          alarm = static_cast<int64_t>(reader.readFixed64());
+          continue;
+        case Op::DELETE_ALARM:
+          alarm = nullptr;
+          continue;
+      }
+      KJ_FAIL_REQUIRE("local actor storage is corrupt: unknown op");
+    }
+  }
+
+  kj::Promise<void> whenSynced() {
+    // Group commit: every commit made in the same turn of the event loop shares one datasync().
+    auto paf = kj::newPromiseAndFulfiller<void>();
+    syncWaiters.add(kj::mv(paf.fulfiller));
+    if (!syncScheduled) {
+      syncScheduled = true;
+      tasks.add(kj::evalLater([this]() { sync(); }));
+    }
+    return kj::mv(paf.promise);
+  }
+
+  void sync() {
+    syncScheduled = false;
+    auto waiters = kj::mv(syncWaiters);
+
+    KJ_IF_MAYBE(exception, kj::runCatchingExceptions([&]() { walFile->datasync(); })) {
+      for (auto& waiter: waiters) waiter->reject(kj::cp(*exception));
+      return;
+    }
+    for (auto& waiter: waiters) waiter->fulfill();
+
+    if (walSize > kj::max(options.compactionThreshold, dataSize)) {
+      compact();
+    }
+  }
+
+  void compact() {
+    // Rewrites the live data, sorted and prefix-compressed, into a new data file and then empties
+    // the log. Values are streamed through a bounded buffer, so this works even when the data set
+    // doesn't fit in memory.
+
+    auto replacer = dir.replaceFile(dataPath, kj::WriteMode::CREATE | kj::WriteMode::MODIFY);
+    auto& file = replacer->get();
+
+    Writer buffer;
+    uint64_t fileOffset = 0;
+    auto flush = [&]() {
+      file.write(fileOffset, buffer.asPtr());
+      fileOffset += buffer.size();
+      buffer.clear();
+    };
+
+    buffer.writeFixed64(DATA_FILE_MAGIC);
+    KJ_IF_MAYBE(a, alarm) {
+      buffer.writeByte(1);
+      buffer.writeFixed64(static_cast<uint64_t>(*a));
+    } else {
+      buffer.writeByte(0);
+      buffer.writeFixed64(0);
+    }
+    KJ_ASSERT(buffer.size() == DATA_HEADER_SIZE);
+
+    auto newOffsets = kj::heapArrayBuilder<uint64_t>(index.size());
+    kj::StringPtr prevKey;
+    for (auto& entry: index.ordered()) {
+      size_t shared = 0;
+      size_t limit = kj::min(prevKey.size(), entry.key.size());
+      while (shared < limit && prevKey[shared] == entry.key[shared]) ++shared;
+
+      auto value = readValue(entry.location);
+      buffer.writeVarint(shared);
+      buffer.writeVarint(entry.key.size() - shared);
+      buffer.writeVarint(value.size());
+      buffer.writeBytes(entry.key.asBytes().slice(shared, entry.key.size()));
+      newOffsets.add(fileOffset + buffer.size());
+      buffer.writeBytes(value);
+      if (buffer.size() >= LIST_CHUNK_BYTES) flush();
+
+      prevKey = entry.key;
+    }
+    flush();
+
+    file.sync();
+    replacer->commit();
+    dir.sync();
+
+    // The new data file is durable, so the log is now redundant.
+    dataFile = dir.openFile(dataPath);
+    dataSize = fileOffset;
+    auto offsets = newOffsets.finish();
+    size_t i = 0;
+    for (auto& entry: index.ordered()) {
+      entry.location.inWal = false;
+      entry.location.offset = offsets[i++];
+    }
+
+    walFile->truncate(0);
+    walFile->datasync();
+    walSize = 0;
+  }
+};
+
+// =======================================================================================
+// RPC interface
+
+template <typename Base>
+class OperationsImpl: public Base {
+  // Implements ActorStorage::Operations for both Stage and Transaction. Stage commits every
+  // write as its own batch, while Transaction accumulates its writes until commit().
+
+public:
+  explicit OperationsImpl(kj::Own<LocalStore> store): store(kj::mv(store)) {}
+
+protected:
+  kj::Own<LocalStore> store;
+  Batch batch;
+
+  virtual kj::Promise<void> writeDone() = 0;
+  // Called after each write op has been added to `batch`.
+
+  kj::Promise<void> get(typename Base::GetContext context) override {
+    auto key = keyFromData(context.getParams().getKey());
+    KJ_IF_MAYBE(value, store->get(batch, key)) {
+      context.initResults(capnp::MessageSize { 4 + value->size() / sizeof(capnp::word), 0 })
+          .setValue(*value);
+    }
+    return kj::READY_NOW;
+  }
+
+  kj::Promise<void> getMultiple(typename Base::GetMultipleContext context) override {
+    auto params = context.getParams();
+    auto keys = KJ_MAP(key, params.getKeys()) { return keyFromData(key); };
+    auto stream = params.getStream();
+    context.releaseParams();
+
+    kj::Vector<Result> chunk;
+    size_t chunkBytes = 0;
+    for (auto& key: keys) {
+      KJ_IF_MAYBE(value, store->get(batch, key)) {
+        chunkBytes += key.size() + value->size();
+        chunk.add(Result { kj::mv(key), kj::mv(*value) });
+      }
+      if (chunk.size() >= LIST_CHUNK_ENTRIES || chunkBytes >= LIST_CHUNK_BYTES) {
+        co_await sendChunk(stream, chunk.releaseAsArray());
+        chunkBytes = 0;
+      }
+    }
+    if (chunk.size() > 0) {
+      co_await sendChunk(stream, chunk.releaseAsArray());
+    }
+    co_await stream.endRequest(capnp::MessageSize {2, 0}).send().ignoreResult();
+  }
+
+  kj::Promise<void> list(typename Base::ListContext context) override {
+    auto params = context.getParams();
+    kj::Maybe<kj::String> begin;
+    kj::Maybe<kj::String> end;
+    if (params.hasStart()) begin = keyFromData(params.getStart());
+    if (params.hasEnd()) end = keyFromData(params.getEnd());
+    if (params.hasPrefix()) {
+      // Narrow [begin, end) to the keys starting with the prefix.
+      auto prefix = keyFromData(params.getPrefix());
+      KJ_IF_MAYBE(pe, prefixEnd(prefix)) {
+        KJ_IF_MAYBE(e, end) {
+          if (*pe < *e) end = kj::mv(*pe);
+        } else {
+          end = kj::mv(*pe);
+        }
+      }
+      KJ_IF_MAYBE(b, begin) {
+        if (*b < prefix) begin = kj::mv(prefix);
+      } else {
+        begin = kj::mv(prefix);
+      }
+    }
+    size_t limit = kj::maxValue;
+    if (params.getLimit() > 0) limit = params.getLimit();
+    bool reverse = params.getReverse();
+    auto stream = params.getStream();
+    context.releaseParams();
+
+    // The index may change while we wait for the stream, so we re-seek by key for every chunk.
+    // For a forward scan `begin` is the inclusive lower bound of what's left to send, and for a
+    // reverse scan `end` is the exclusive upper bound.
+    bool beginInclusive = true;
+    auto& index = store->getIndex();
+    while (limit > 0) {
+      kj::Vector<Result> chunk;
+      size_t chunkBytes = 0;
+      auto full = [&]() {
+        return chunk.size() >= kj::min(limit, LIST_CHUNK_ENTRIES) ||
+               chunkBytes >= LIST_CHUNK_BYTES;
+      };
+      auto ordered = index.ordered();
+
+      if (reverse) {
+        auto iter = ordered.end();
+        KJ_IF_MAYBE(e, end) iter = index.seek(*e);
+        while (!full() && iter != ordered.begin()) {
+          --iter;
+          KJ_IF_MAYBE(b, begin) {
+            if (iter->key < *b) break;
+          }
+          auto value = store->readValue(iter->location);
+          chunkBytes += iter->key.size() + value.size();
+          chunk.add(Result { kj::str(iter->key), kj::mv(value) });
+        }
+        if (chunk.size() > 0) end = kj::str(chunk.back().key);
+      } else {
+        auto iter = ordered.begin();
+        KJ_IF_MAYBE(b, begin) {
+          iter = index.seek(*b);
+          if (!beginInclusive && iter != ordered.end() && iter->key == *b) ++iter;
+        }
+        for (; !full() && iter != ordered.end(); ++iter) {
+          KJ_IF_MAYBE(e, end) {
+            if (!(iter->key < *e)) break;
+          }
+          auto value = store->readValue(iter->location);
+          chunkBytes += iter->key.size() + value.size();
+          chunk.add(Result { kj::str(iter->key), kj::mv(value) });
+        }
+        if (chunk.size() > 0) {
+          begin = kj::str(chunk.back().key);
+          beginInclusive = false;
+        }
+      }
+
+      if (chunk.size() == 0) break;
+      bool more = full();
+      limit -= chunk.size();
+      co_await sendChunk(stream, chunk.releaseAsArray());
+      if (!more) break;
+    }
+
+    co_await stream.endRequest(capnp::MessageSize {2, 0}).send().ignoreResult();
+  }
+
+  kj::Promise<void> put(typename Base::PutContext context) override {
+    for (auto entry: context.getParams().getEntries()) {
+      batch.put(keyFromData(entry.getKey()), entry.getValue());
+    }
+    return writeDone();
+  }
+
+  kj::Promise<void> delete_(typename Base::DeleteContext context) override {
+    int32_t numDeleted = 0;
+    for (auto keyData: context.getParams().getKeys()) {
+      auto key = keyFromData(keyData);
+      if (store->has(batch, key)) ++numDeleted;
+      batch.del(key);
+    }
+    context.initResults(capnp::MessageSize {4, 0}).setNumDeleted(numDeleted);
+    return writeDone();
+  }
+
+  kj::Promise<void> deleteAll(typename Base::DeleteAllContext context) override {
+    int32_t numDeleted = store->count(batch);
+    batch.deleteAll();
+    context.initResults(capnp::MessageSize {4, 0}).setNumDeleted(numDeleted);
+    return writeDone();
+  }
+
+  kj::Promise<void> rename(typename Base::RenameContext context) override {
+    auto entries = context.getParams().getEntries();
+    kj::Vector<kj::String> renamed(entries.size());
+    for (auto entry: entries) {
+      auto oldKey = keyFromData(entry.getOldKey());
+      auto newKey = keyFromData(entry.getNewKey());
+      KJ_IF_MAYBE(value, store->get(batch, oldKey)) {
+        if (oldKey != newKey) {
+          batch.put(newKey, *value);
+          batch.del(oldKey);
+        }
+        renamed.add(kj::mv(oldKey));
+      }
+    }
+
+    size_t words = 4;
+    for (auto& key: renamed) words += 1 + key.size() / sizeof(capnp::word) + 1;
+    auto list = context.initResults(capnp::MessageSize { words, 0 }).initRenamed(renamed.size());
+    for (auto i: kj::indices(renamed)) {
+      list.set(i, renamed[i].asBytes());
+    }
+    return writeDone();
+  }
+
+  kj::Promise<void> getAlarm(typename Base::GetAlarmContext context) override {
+    KJ_IF_MAYBE(t, store->getAlarm(batch)) {
+      context.initResults(capnp::MessageSize {4, 0}).setScheduledTimeMs(*t);
+    }
+    return kj::READY_NOW;
+  }
+
+  kj::Promise<void> setAlarm(typename Base::SetAlarmContext context) override {
+    batch.setAlarm(context.getParams().getScheduledTimeMs());
+    return writeDone();
+  }
+
+  kj::Promise<void> deleteAlarm(typename Base::DeleteAlarmContext context) override {
+    int64_t timeToDelete = context.getParams().getTimeToDeleteMs();
+    bool deleted = false;
+    KJ_IF_MAYBE(t, store->getAlarm(batch)) {
+      if (timeToDelete == 0 || *t == timeToDelete) {
+        batch.setAlarm(nullptr);
+        deleted = true;
+      }
+    }
+    context.initResults(capnp::MessageSize {4, 0}).setDeleted(deleted);
+    return writeDone();
+  }
+
+private:
+  struct Result {
+    kj::String key;
+    kj::Array<kj::byte> value;
+  };
+
+  static kj::Promise<void> sendChunk(rpc::ActorStorage::ListStream::Client& stream,
+                                     kj::Array<Result> chunk) {
+    size_t words = 4;
+    for (auto& result: chunk) {
+      words += 4 + (result.key.size() + result.value.size()) / sizeof(capnp::word) + 2;
+    }
+    auto req = stream.valuesRequest(capnp::MessageSize { words, 0 });
+    auto list = req.initList(chunk.size());
+    for (auto i: kj::indices(chunk)) {
+      list[i].setKey(chunk[i].key.asBytes());
+      list[i].setValue(chunk[i].value);
+    }
+    return req.send();
+  }
+};
+
+class TransactionImpl final: public OperationsImpl<rpc::ActorStorage::Stage::Transaction::Server> {
+public:
+  TransactionImpl(kj::Own<LocalStore> store, uint64_t sequence)
+      : OperationsImpl(kj::mv(store)), sequence(sequence) {}
+  ~TransactionImpl() noexcept(false) {
+    if (sequence != 0) {
+      // If this was never committed, successors waiting on it would otherwise wait forever.
+      store->abandonSequence(sequence);
+    }
+  }
+
+protected:
+  kj::Promise<void> writeDone() override {
+    // Writes are held until commit().
+    return kj::READY_NOW;
+  }
+
+  kj::Promise<void> commit(CommitContext context) override {
+    if (sequence != 0) {
+      return store->commitInSequence(batch, sequence);
+    }
+    return store->commit(batch);
+  }
+
+  kj::Promise<void> rollback(RollbackContext context) override {
+    batch.clear();
+    if (sequence != 0) store->abandonSequence(sequence);
+    return kj::READY_NOW;
+  }
+
+private:
+  uint64_t sequence;
+  // `DbSettings.sequence`, or zero if the transaction isn't sequenced.
+};
+
+class LocalActorStorageImpl final: public OperationsImpl<rpc::ActorStorage::Stage::Server> {
+public:
+  using OperationsImpl::OperationsImpl;
+
+protected:
+  kj::Promise<void> writeDone() override {
+    return store->commit(batch);
+  }
+
+  kj::Promise<void> txn(TxnContext context) override {
+    auto results = context.getResults(capnp::MessageSize {2, 1});
+    auto sequence = context.getParams().getSettings().getSequence();
+    results.setTransaction(kj::heap<TransactionImpl>(kj::addRef(*store), sequence));
+    return kj::READY_NOW;
+  }
+};
+
+}  // namespace
+
+kj::Own<rpc::ActorStorage::Stage::Server> newLocalActorStorage(
+    const kj::Directory& dir, kj::StringPtr name, LocalActorStorageOptions options) {
+  return kj::heap<LocalActorStorageImpl>(kj::refcounted<LocalStore>(dir, name, options));
+}
+
+}  // namespace workerd::server
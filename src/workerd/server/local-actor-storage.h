@@ -0,0 +1,52 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#pragma once
+
+#include <kj/filesystem.h>
+#include <kj/time.h>
+#include <workerd/io/actor-storage.capnp.h>
+
+namespace workerd::server {
+
+class LocalActorStorageAlarmListener {
+public:
+  virtual void alarmChanged(kj::StringPtr name, kj::Maybe<kj::Date> scheduledTime) = 0;
+  // Called with the object's alarm time (null if none) when its storage is opened, and again
+  // each time a commit sets or deletes the alarm. Called synchronously, as the change becomes
+  // visible, which is before it is durable.
+};
+
+struct LocalActorStorageOptions {
+  uint64_t compactionThreshold = 4ull << 20;
+  // Once the write-ahead log grows beyond this many bytes (and also beyond the size of the
+  // compacted data file), the log is folded into a new data file.
+
+  kj::Maybe<LocalActorStorageAlarmListener&> alarmListener;
+  // Told about the alarm, e.g. so that it can be delivered while the object isn't running. Must
+  // outlive the storage.
+};
+
+kj::Own<rpc::ActorStorage::Stage::Server> newLocalActorStorage(
+    const kj::Directory& dir, kj::StringPtr name, LocalActorStorageOptions options = {});
+// Creates an ActorStorage implementation which persists one Durable Object's data in `dir`,
+// using the files `<name>.data` and `<name>.wal`.
+//
+// The store is an ordered key/value store with write-ahead logging:
+// - Each commit (a transaction, or a single non-transactional write) is appended to the
+//   write-ahead log as one checksummed record. All commits made in the same turn of the event
+//   loop are made durable with a single `fdatasync()`, and no commit's RPC completes before then.
+// - When the log grows large, the live data is rewritten, in key order and with key-prefix
+//   compression, to a new data file which atomically replaces the old one.
+// - Only keys and value locations are kept in memory; values are read from disk on demand, so
+//   the data set may be larger than RAM. Reads of spans of keys (list()) are served directly from
+//   the in-memory ordered index.
+//
+// On open, a torn record at the end of the log (e.g. due to a crash mid-write) is discarded.
+//
+// The caller is expected to be the only user of the files, which is naturally the case for
+// Durable Objects. Reads performed inside a transaction observe the transaction's own point
+// writes, but list() inside a transaction only observes committed data.
+
+}  // namespace workerd::server
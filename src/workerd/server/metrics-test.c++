@@ -0,0 +1,130 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "metrics.h"
+#include <kj/test.h>
+#include <string.h>
+
+namespace workerd::server {
+namespace {
+
+bool contains(kj::StringPtr haystack, kj::StringPtr needle) {
+  return strstr(haystack.cStr(), needle.cStr()) != nullptr;
+}
+
+KJ_TEST("MetricsRegistry: metrics are rendered in Prometheus text format") {
+  auto registry = kj::atomicRefcounted<MetricsRegistry>();
+  auto metrics = registry->addWorker("hello");
+
+  metrics->increment(WorkerMetrics::Counter::REQUESTS);
+  metrics->increment(WorkerMetrics::Counter::REQUESTS);
+  metrics->adjust(WorkerMetrics::Gauge::REQUESTS_IN_FLIGHT, 1);
+  metrics->record(WorkerMetrics::Histogram::SUBREQUESTS_PER_REQUEST, uint64_t(0));
+  metrics->record(WorkerMetrics::Histogram::SUBREQUESTS_PER_REQUEST, uint64_t(3));
+  metrics->record(WorkerMetrics::Histogram::REQUEST_DURATION, 2 * kj::MILLISECONDS);
+
+  auto text = registry->render();
+  KJ_EXPECT(text.endsWith("\n"));
+  KJ_EXPECT(contains(text,
+      "# HELP workerd_requests_total Requests delivered to the Worker.\n"
+      "# TYPE workerd_requests_total counter\n"
+      "workerd_requests_total{worker=\"hello\"} 2\n"), text);
+  KJ_EXPECT(contains(text, "workerd_requests_in_flight{worker=\"hello\"} 1\n"), text);
+
+  KJ_EXPECT(contains(text,
+      "workerd_request_subrequests_bucket{worker=\"hello\",le=\"1\"} 1\n"
+      "workerd_request_subrequests_bucket{worker=\"hello\",le=\"4\"} 2\n"
+      "workerd_request_subrequests_bucket{worker=\"hello\",le=\"16\"} 2\n"), text);
+  KJ_EXPECT(contains(text,
+      "workerd_request_subrequests_bucket{worker=\"hello\",le=\"+Inf\"} 2\n"
+      "workerd_request_subrequests_sum{worker=\"hello\"} 3\n"
+      "workerd_request_subrequests_count{worker=\"hello\"} 2\n"), text);
+
+  // 2000us falls in the 4^6 = 4096us bucket.
+  KJ_EXPECT(contains(text,
+      "workerd_request_duration_seconds_bucket{worker=\"hello\",le=\"0.001024\"} 0\n"
+      "workerd_request_duration_seconds_bucket{worker=\"hello\",le=\"0.004096\"} 1\n"), text);
+  KJ_EXPECT(contains(text, "workerd_request_duration_seconds_sum{worker=\"hello\"} 0.002\n"),
+            text);
+}
+
+KJ_TEST("MetricsRegistry: histograms that share a name are told apart by label") {
+  auto registry = kj::atomicRefcounted<MetricsRegistry>();
+  auto metrics = registry->addWorker("hello");
+
+  metrics->record(WorkerMetrics::Histogram::LOCK_QUEUE_WAIT_UNTIL, 3 * kj::MICROSECONDS);
+
+  auto text = registry->render();
+  KJ_EXPECT(contains(text,
+      "# TYPE workerd_isolate_lock_queue_seconds histogram\n"
+      "workerd_isolate_lock_queue_seconds_bucket{worker=\"hello\",priority=\"fetch\",le="),
+      text);
+  KJ_EXPECT(contains(text,
+      "workerd_isolate_lock_queue_seconds_count{worker=\"hello\",priority=\"fetch\"} 0\n"
+      "workerd_isolate_lock_queue_seconds_bucket{worker=\"hello\",priority=\"alarm\","), text);
+  KJ_EXPECT(contains(text,
+      "workerd_isolate_lock_queue_seconds_count{worker=\"hello\",priority=\"wait_until\"} 1\n"),
+      text);
+
+  // One header for all of them.
+  auto header = "# TYPE workerd_isolate_lock_queue_seconds histogram\n"_kj;
+  auto first = strstr(text.cStr(), header.cStr());
+  KJ_ASSERT(first != nullptr);
+  KJ_EXPECT(strstr(first + header.size(), header.cStr()) == nullptr, text);
+}
+
+KJ_TEST("MetricsRegistry: Workers with the same name are summed, and outlive reloads") {
+  auto registry = kj::atomicRefcounted<MetricsRegistry>();
+  auto thread1 = registry->addWorker("w\"1");
+  auto thread2 = registry->addWorker("w\"1");
+  auto other = registry->addWorker("a");
+
+  thread1->increment(WorkerMetrics::Counter::SUBREQUESTS, 5);
+  thread2->increment(WorkerMetrics::Counter::SUBREQUESTS, 7);
+  thread2->adjust(WorkerMetrics::Gauge::WAIT_UNTIL_TASKS, 1);
+
+  auto text = registry->render();
+  KJ_EXPECT(contains(text,
+      "workerd_subrequests_total{worker=\"a\"} 0\n"
+      "workerd_subrequests_total{worker=\"w\\\"1\"} 12\n"), text);
+  KJ_EXPECT(contains(text, "workerd_wait_until_tasks{worker=\"w\\\"1\"} 1\n"), text);
+
+  // A destroyed Worker's counters are kept, but its gauges are not.
+  thread2 = nullptr;
+  auto replacement = registry->addWorker("w\"1");
+  replacement->increment(WorkerMetrics::Counter::SUBREQUESTS);
+
+  text = registry->render();
+  KJ_EXPECT(contains(text, "workerd_subrequests_total{worker=\"w\\\"1\"} 13\n"), text);
+  KJ_EXPECT(contains(text, "workerd_wait_until_tasks{worker=\"w\\\"1\"} 0\n"), text);
+}
+
+KJ_TEST("MetricsRegistry: external memory is reported by Worker and type") {
+  auto registry = kj::atomicRefcounted<MetricsRegistry>();
+  auto thread1 = registry->addWorker("w");
+  auto thread2 = registry->addWorker("w");
+
+  auto isolate1 = kj::atomicRefcounted<jsg::ExternalMemoryTracker>();
+  auto isolate2 = kj::atomicRefcounted<jsg::ExternalMemoryTracker>();
+  thread1->addExternalMemory(isolate1->addRef());
+  thread2->addExternalMemory(isolate2->addRef());
+  isolate1->getCounter("ActorCache").adjust(1000);
+  isolate2->getCounter("ActorCache").adjust(24);
+  isolate2->getCounter("Other").adjust(5);
+
+  auto text = registry->render();
+  KJ_EXPECT(contains(text,
+      "# TYPE workerd_external_memory_bytes gauge\n"
+      "workerd_external_memory_bytes{worker=\"w\",type=\"ActorCache\"} 1024\n"
+      "workerd_external_memory_bytes{worker=\"w\",type=\"Other\"} 5\n"), text);
+
+  thread2->removeExternalMemory(*isolate2);
+  text = registry->render();
+  KJ_EXPECT(contains(text,
+      "workerd_external_memory_bytes{worker=\"w\",type=\"ActorCache\"} 1000\n"), text);
+  KJ_EXPECT(!contains(text, "type=\"Other\""), text);
+}
+
+}  // namespace
+}  // namespace workerd::server
@@ -0,0 +1,259 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "metrics.h"
+
+namespace workerd::server {
+
+namespace {
+
+struct MetricInfo {
+  kj::StringPtr name;
+  kj::StringPtr help;
+};
+
+const MetricInfo COUNTERS[] = {
+  { "workerd_requests_total"_kj, "Requests delivered to the Worker."_kj },
+  { "workerd_request_failures_total"_kj, "Requests to the Worker that failed."_kj },
+  { "workerd_subrequests_total"_kj, "Subrequests made by the Worker."_kj },
+  { "workerd_subrequests_coalesced_total"_kj,
+    "Subrequests that shared the response to an identical one instead of being sent."_kj },
+  { "workerd_isolates_created_total"_kj, "Isolates created for the Worker."_kj },
+  { "workerd_isolates_evicted_total"_kj, "Isolates of the Worker that were evicted."_kj },
+  { "workerd_idle_gcs_total"_kj,
+    "Idle periods in which the Worker's isolates were given time to collect garbage."_kj },
+  { "workerd_websocket_received_bytes_total"_kj,
+    "Bytes of WebSocket messages received by the Worker's Durable Objects."_kj },
+  { "workerd_websocket_sent_bytes_total"_kj,
+    "Bytes of WebSocket messages sent by the Worker's Durable Objects."_kj },
+  { "workerd_durable_object_cache_hits_total"_kj,
+    "Durable Object storage read units answered from the cache."_kj },
+  { "workerd_durable_object_cache_misses_total"_kj,
+    "Durable Object storage read units that had to go to storage."_kj },
+  { "workerd_durable_object_cache_evictions_total"_kj,
+    "Durable Object cache entries evicted for memory pressure or staleness."_kj },
+};
+static_assert(kj::size(COUNTERS) == uint(WorkerMetrics::Counter::COUNT));
+
+const MetricInfo GAUGES[] = {
+  { "workerd_requests_in_flight"_kj, "Requests to the Worker that have not yet finished."_kj },
+  { "workerd_wait_until_tasks"_kj, "waitUntil() tasks of the Worker still running."_kj },
+};
+static_assert(kj::size(GAUGES) == uint(WorkerMetrics::Gauge::COUNT));
+
+struct HistogramInfo {
+  kj::StringPtr name;
+  kj::StringPtr help;
+  double scale;
+  // Multiplies recorded values to get the reported unit.
+
+  kj::StringPtr labels = nullptr;
+  // Extra labels, for histograms that share a name and differ by label.
+};
+
+const HistogramInfo HISTOGRAMS[] = {
+  { "workerd_request_duration_seconds"_kj,
+    "Time from delivering a request until its response was complete."_kj, 1e-6 },
+  { "workerd_isolate_lock_wait_seconds"_kj, "Time spent waiting for the isolate lock."_kj, 1e-6 },
+  { "workerd_isolate_lock_hold_seconds"_kj,
+    "Time the isolate lock was held, which approximates JavaScript CPU time."_kj, 1e-6 },
+  { "workerd_gc_pause_seconds"_kj, "Garbage collection pauses."_kj, 1e-6 },
+  { "workerd_request_subrequests"_kj, "Subrequests made by each request."_kj, 1 },
+  { "workerd_isolate_lock_queue_seconds"_kj,
+    "Time spent queued for the isolate lock, by the priority of the work waiting."_kj, 1e-6,
+    "priority=\"fetch\""_kj },
+  { "workerd_isolate_lock_queue_seconds"_kj, nullptr, 1e-6, "priority=\"alarm\""_kj },
+  { "workerd_isolate_lock_queue_seconds"_kj, nullptr, 1e-6, "priority=\"scheduled\""_kj },
+  { "workerd_isolate_lock_queue_seconds"_kj, nullptr, 1e-6, "priority=\"wait_until\""_kj },
+};
+static_assert(kj::size(HISTOGRAMS) == uint(WorkerMetrics::Histogram::COUNT));
+
+kj::String escapeLabel(kj::StringPtr value) {
+  kj::Vector<char> result(value.size() + 1);
+  for (char c: value) {
+    switch (c) {
+      case '\\': result.addAll("\\\\"_kj); break;
+      case '"': result.addAll("\\\""_kj); break;
+      case '\n': result.addAll("\\n"_kj); break;
+      default: result.add(c); break;
+    }
+  }
+  result.add('\0');
+  return kj::String(result.releaseAsArray());
+}
+
+}  // namespace
+
+WorkerMetrics::WorkerMetrics(kj::Badge<MetricsRegistry>, kj::Own<const MetricsRegistry> registry,
+                             kj::String workerName)
+    : registry(kj::mv(registry)), workerName(kj::mv(workerName)) {}
+
+WorkerMetrics::~WorkerMetrics() noexcept(false) {
+  registry->retire(*this);
+}
+
+void WorkerMetrics::record(Histogram histogram, uint64_t value) const {
+  uint bucket = 0;
+  for (uint64_t bound = 1; bucket < BUCKET_COUNT - 1 && value > bound; bound *= 4) {
+    ++bucket;
+  }
+
+  auto& data = histograms[uint(histogram)];
+  data.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+  data.sum.fetch_add(value, std::memory_order_relaxed);
+}
+
+void WorkerMetrics::addExternalMemory(kj::Own<const jsg::ExternalMemoryTracker> tracker) const {
+  externalMemory.lockExclusive()->add(kj::mv(tracker));
+}
+
+void WorkerMetrics::removeExternalMemory(const jsg::ExternalMemoryTracker& tracker) const {
+  auto lock = externalMemory.lockExclusive();
+  for (auto i: kj::indices(*lock)) {
+    if ((*lock)[i].get() == &tracker) {
+      (*lock)[i] = kj::mv(lock->back());
+      lock->removeLast();
+      break;
+    }
+  }
+}
+
+void MetricsRegistry::Totals::add(const WorkerMetrics& metrics, bool includeGauges) {
+  for (auto i: kj::indices(counters)) {
+    counters[i] += metrics.counters[i].load(std::memory_order_relaxed);
+  }
+  if (includeGauges) {
+    for (auto i: kj::indices(gauges)) {
+      gauges[i] += metrics.gauges[i].load(std::memory_order_relaxed);
+    }
+  }
+  for (auto i: kj::indices(histograms)) {
+    auto& from = metrics.histograms[i];
+    auto& to = histograms[i];
+    for (auto j: kj::indices(to.buckets)) {
+      to.buckets[j] += from.buckets[j].load(std::memory_order_relaxed);
+    }
+    to.sum += from.sum.load(std::memory_order_relaxed);
+  }
+}
+
+kj::Own<WorkerMetrics> MetricsRegistry::addWorker(kj::StringPtr workerName) const {
+  auto result = kj::atomicRefcounted<WorkerMetrics>(
+      kj::Badge<MetricsRegistry>(), kj::atomicAddRef(*this), kj::str(workerName));
+  state.lockExclusive()->live.add(result.get());
+  return result;
+}
+
+void MetricsRegistry::retire(const WorkerMetrics& metrics) const {
+  auto lock = state.lockExclusive();
+
+  auto& live = lock->live;
+  for (auto i: kj::indices(live)) {
+    if (live[i] == &metrics) {
+      live[i] = live.back();
+      live.removeLast();
+      break;
+    }
+  }
+
+  lock->retired.findOrCreate(metrics.workerName, [&]() {
+    return kj::HashMap<kj::String, Totals>::Entry { kj::str(metrics.workerName), Totals() };
+  }).add(metrics, false);
+}
+
+kj::String MetricsRegistry::render() const {
+  kj::TreeMap<kj::StringPtr, Totals> totals;
+  // Keys point into `state`, so `lock` must be held until rendering is done.
+
+  auto lock = state.lockShared();
+  for (auto& entry: lock->retired) {
+    totals.insert(entry.key, entry.value);
+  }
+  kj::TreeMap<kj::StringPtr, kj::TreeMap<kj::StringPtr, int64_t>> externalMemory;
+  // Bytes by Worker, then by type. Types are string literals, per ExternalMemoryTracker.
+
+  for (auto metrics: lock->live) {
+    totals.findOrCreate(metrics->workerName, [&]() {
+      return kj::TreeMap<kj::StringPtr, Totals>::Entry { metrics->workerName, Totals() };
+    }).add(*metrics, true);
+
+    auto trackers = metrics->externalMemory.lockShared();
+    if (trackers->empty()) continue;
+    auto& byType = externalMemory.findOrCreate(metrics->workerName, [&]() {
+      return decltype(externalMemory)::Entry { metrics->workerName, {} };
+    });
+    for (auto& tracker: *trackers) {
+      for (auto& usage: tracker->getUsage()) {
+        byType.upsert(usage.type, usage.bytes, [](int64_t& existing, int64_t&& more) {
+          existing += more;
+        });
+      }
+    }
+  }
+
+  struct Row {
+    kj::String labels;
+    const Totals& totals;
+  };
+  auto rows = KJ_MAP(entry, totals) {
+    return Row { kj::str("worker=\"", escapeLabel(entry.key), '"'), entry.value };
+  };
+
+  kj::Vector<kj::String> lines;
+  auto addHeader = [&](kj::StringPtr name, kj::StringPtr help, kj::StringPtr type) {
+    lines.add(kj::str("# HELP ", name, ' ', help));
+    lines.add(kj::str("# TYPE ", name, ' ', type));
+  };
+
+  for (auto i: kj::indices(COUNTERS)) {
+    addHeader(COUNTERS[i].name, COUNTERS[i].help, "counter");
+    for (auto& row: rows) {
+      lines.add(kj::str(COUNTERS[i].name, '{', row.labels, "} ", row.totals.counters[i]));
+    }
+  }
+
+  for (auto i: kj::indices(GAUGES)) {
+    addHeader(GAUGES[i].name, GAUGES[i].help, "gauge");
+    for (auto& row: rows) {
+      lines.add(kj::str(GAUGES[i].name, '{', row.labels, "} ", row.totals.gauges[i]));
+    }
+  }
+
+  addHeader("workerd_external_memory_bytes"_kj,
+      "Memory held by the Worker's C++ objects outside the JavaScript heap, by type."_kj,
+      "gauge"_kj);
+  for (auto& worker: externalMemory) {
+    for (auto& entry: worker.value) {
+      lines.add(kj::str("workerd_external_memory_bytes{worker=\"", escapeLabel(worker.key),
+                        "\",type=\"", escapeLabel(entry.key), "\"} ", entry.value));
+    }
+  }
+
+  for (auto i: kj::indices(HISTOGRAMS)) {
+    auto& info = HISTOGRAMS[i];
+    if (i == 0 || HISTOGRAMS[i - 1].name != info.name) {
+      addHeader(info.name, info.help, "histogram");
+    }
+    for (auto& row: rows) {
+      auto& histogram = row.totals.histograms[i];
+      auto labels = info.labels == nullptr ? kj::str(row.labels)
+                                           : kj::str(row.labels, ',', info.labels);
+      uint64_t count = 0;
+      double bound = info.scale;
+      for (auto b: kj::indices(histogram.buckets)) {
+        count += histogram.buckets[b];
+        auto le = b == WorkerMetrics::BUCKET_COUNT - 1 ? kj::str("+Inf") : kj::str(bound);
+        lines.add(kj::str(info.name, "_bucket{", labels, ",le=\"", le, "\"} ", count));
+        bound *= 4;
+      }
+      lines.add(kj::str(info.name, "_sum{", labels, "} ", histogram.sum * info.scale));
+      lines.add(kj::str(info.name, "_count{", labels, "} ", count));
+    }
+  }
+
+  lines.add(kj::String());  // for the final newline
+  return kj::strArray(lines, "\n");
+}
+
+}  // namespace workerd::server
@@ -0,0 +1,148 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#pragma once
+
+#include <workerd/jsg/external-memory.h>
+#include <kj/map.h>
+#include <kj/mutex.h>
+#include <kj/refcount.h>
+#include <kj/string.h>
+#include <kj/time.h>
+#include <kj/vector.h>
+#include <atomic>
+
+namespace workerd::server {
+
+using kj::uint;
+
+class MetricsRegistry;
+
+class WorkerMetrics final: public kj::AtomicRefcounted {
+  // Counters and histograms for one Worker service on one thread. All updates are relaxed atomic
+  // operations, so observers may record from any thread without taking a lock, and only the
+  // threads running this Worker write to its cache lines.
+  //
+  // Create with `MetricsRegistry::addWorker()`. When the last reference is dropped, the counts are
+  // folded into the registry's totals for the Worker's name, so counters never go backwards when
+  // a Worker is reloaded.
+
+public:
+  enum class Counter: uint {
+    REQUESTS,                  // requests delivered to the Worker
+    REQUEST_FAILURES,          // requests reported as failed
+    SUBREQUESTS,               // subrequests made by the Worker
+    SUBREQUESTS_COALESCED,     // subrequests that shared an identical one instead of being sent
+    ISOLATES_CREATED,
+    ISOLATES_EVICTED,
+    IDLE_GCS,                  // idle periods in which V8 was given time to collect garbage
+    WEBSOCKET_BYTES_RECEIVED,  // by Durable Objects
+    WEBSOCKET_BYTES_SENT,      // by Durable Objects
+    STORAGE_CACHE_HITS,        // Durable Object storage read units answered by the cache
+    STORAGE_CACHE_MISSES,      // Durable Object storage read units that went to storage
+    STORAGE_CACHE_EVICTIONS,   // clean entries dropped from the cache, for memory or staleness
+    COUNT
+  };
+
+  enum class Gauge: uint {
+    REQUESTS_IN_FLIGHT,
+    WAIT_UNTIL_TASKS,
+    COUNT
+  };
+
+  enum class Histogram: uint {
+    REQUEST_DURATION,          // from delivery until the response is complete
+    LOCK_WAIT,                 // time taken to get the isolate lock
+    LOCK_HOLD,                 // time the isolate lock was held, i.e. CPU time spent in JS
+    GC_PAUSE,
+    SUBREQUESTS_PER_REQUEST,
+    LOCK_QUEUE_FETCH,          // time spent in the isolate's AsyncLock queue, for each
+    LOCK_QUEUE_ALARM,          // AsyncLockPriority in order
+    LOCK_QUEUE_SCHEDULED,
+    LOCK_QUEUE_WAIT_UNTIL,
+    COUNT
+  };
+
+  static constexpr uint BUCKET_COUNT = 14;
+  // Histogram buckets have upper bounds of 4^0 through 4^12, plus one for anything larger.
+  // Durations are recorded in microseconds, so the largest finite bucket is about 16.8 seconds.
+
+  WorkerMetrics(kj::Badge<MetricsRegistry>, kj::Own<const MetricsRegistry> registry,
+                kj::String workerName);
+  ~WorkerMetrics() noexcept(false);
+  KJ_DISALLOW_COPY_AND_MOVE(WorkerMetrics);
+
+  void increment(Counter counter, uint64_t amount = 1) const {
+    counters[uint(counter)].fetch_add(amount, std::memory_order_relaxed);
+  }
+  void adjust(Gauge gauge, int64_t delta) const {
+    gauges[uint(gauge)].fetch_add(delta, std::memory_order_relaxed);
+  }
+  void record(Histogram histogram, uint64_t value) const;
+  void record(Histogram histogram, kj::Duration duration) const {
+    record(histogram, uint64_t(kj::max(duration, 0 * kj::NANOSECONDS) / kj::MICROSECONDS));
+  }
+
+  void addExternalMemory(kj::Own<const jsg::ExternalMemoryTracker> tracker) const;
+  void removeExternalMemory(const jsg::ExternalMemoryTracker& tracker) const;
+  // An isolate of the Worker registers the tracker of memory that C++ objects hold on its behalf
+  // (see IsolateObserver::externalMemoryTracked()), which is rendered, by type, as a gauge.
+
+  kj::Own<const WorkerMetrics> addRef() const { return kj::atomicAddRef(*this); }
+
+private:
+  struct HistogramData {
+    std::atomic<uint64_t> buckets[BUCKET_COUNT] = {};
+    std::atomic<uint64_t> sum = 0;
+  };
+
+  kj::Own<const MetricsRegistry> registry;
+  kj::String workerName;
+
+  mutable std::atomic<uint64_t> counters[uint(Counter::COUNT)] = {};
+  mutable std::atomic<int64_t> gauges[uint(Gauge::COUNT)] = {};
+  mutable HistogramData histograms[uint(Histogram::COUNT)];
+
+  kj::MutexGuarded<kj::Vector<kj::Own<const jsg::ExternalMemoryTracker>>> externalMemory;
+
+  friend class MetricsRegistry;
+};
+
+class MetricsRegistry final: public kj::AtomicRefcounted {
+  // Collects the metrics of every Worker, on every thread, and renders them in the Prometheus
+  // text exposition format. One registry is shared by all the threads of a workerd process, so
+  // that a scrape, whichever thread it lands on, sees the whole process.
+
+public:
+  kj::Own<WorkerMetrics> addWorker(kj::StringPtr workerName) const;
+
+  kj::String render() const;
+  // Sums the metrics of all Workers with the same name and returns them as Prometheus text.
+  // Histograms report their values in seconds where they measure time.
+
+private:
+  struct Totals {
+    uint64_t counters[uint(WorkerMetrics::Counter::COUNT)] = {};
+    int64_t gauges[uint(WorkerMetrics::Gauge::COUNT)] = {};
+    struct Histogram {
+      uint64_t buckets[WorkerMetrics::BUCKET_COUNT] = {};
+      uint64_t sum = 0;
+    } histograms[uint(WorkerMetrics::Histogram::COUNT)];
+
+    void add(const WorkerMetrics& metrics, bool includeGauges);
+  };
+
+  struct State {
+    kj::Vector<const WorkerMetrics*> live;
+    kj::HashMap<kj::String, Totals> retired;
+    // Totals of Workers that have been destroyed, by name. Gauges are not carried over.
+  };
+  kj::MutexGuarded<State> state;
+
+  void retire(const WorkerMetrics& metrics) const;
+
+  friend class WorkerMetrics;
+};
+
+}  // namespace workerd::server
@@ -0,0 +1,342 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "r2-store.h"
+#include <kj/test.h>
+
+namespace workerd::server {
+namespace {
+
+class FakeClock final: public kj::Clock {
+public:
+  kj::Date time = kj::UNIX_EPOCH + 1000 * kj::SECONDS;
+  kj::Date now() const override { return time; }
+};
+
+bool contains(kj::StringPtr haystack, kj::StringPtr needle) {
+  for (size_t i = 0; i + needle.size() <= haystack.size(); i++) {
+    if (haystack.slice(i).startsWith(needle)) return true;
+  }
+  return false;
+}
+
+struct LocalR2BucketTest {
+  kj::EventLoop loop;
+  kj::WaitScope ws;
+  FakeClock clock;
+  kj::Own<const kj::Directory> dir;
+  kj::HttpHeaderTable::Builder builder;
+  kj::Own<kj::HttpService> bucket;
+  kj::HttpHeaderId hRequest;
+  kj::HttpHeaderId hMetadataSize;
+  kj::HttpHeaderId hError;
+  kj::Own<kj::HttpHeaderTable> table;
+  kj::Own<kj::HttpClient> client;
+
+  LocalR2BucketTest()
+      : ws(loop), dir(kj::newInMemoryDirectory(clock)),
+        bucket(newLocalR2Bucket(dir->clone(), clock, builder)),
+        hRequest(builder.add("CF-R2-Request")),
+        hMetadataSize(builder.add("CF-R2-Metadata-Size")),
+        hError(builder.add("CF-R2-Error")),
+        table(builder.build()),
+        client(kj::newHttpClient(*bucket)) {}
+
+  void reopen() {
+    client = nullptr;
+    bucket = nullptr;
+    kj::HttpHeaderTable::Builder newBuilder;
+    bucket = newLocalR2Bucket(dir->clone(), clock, newBuilder);
+    hRequest = newBuilder.add("CF-R2-Request");
+    hMetadataSize = newBuilder.add("CF-R2-Metadata-Size");
+    hError = newBuilder.add("CF-R2-Error");
+    table = newBuilder.build();
+    client = kj::newHttpClient(*bucket);
+  }
+
+  struct Result {
+    uint status;
+    kj::String metadata;
+    kj::String content;
+    // For errors, `metadata` is the error.
+  };
+
+  Result read(kj::StringPtr request) {
+    kj::HttpHeaders headers(*table);
+    headers.set(hRequest, request);
+    auto req = client->request(kj::HttpMethod::GET, "https://fake-host/", headers, uint64_t(0));
+    auto response = req.response.wait(ws);
+    auto body = response.body->readAllText().wait(ws);
+    size_t metadataSize = 0;
+    KJ_IF_MAYBE(size, response.headers->get(hMetadataSize)) {
+      metadataSize = KJ_ASSERT_NONNULL(size->tryParseAs<size_t>());
+    }
+    if (response.statusCode >= 400 && metadataSize == 0) {
+      return { response.statusCode, kj::str(KJ_ASSERT_NONNULL(response.headers->get(hError))) };
+    }
+    return {
+      response.statusCode, kj::str(body.slice(0, metadataSize)), kj::str(body.slice(metadataSize))
+    };
+  }
+
+  Result write(kj::StringPtr request, kj::StringPtr content = nullptr) {
+    kj::HttpHeaders headers(*table);
+    headers.set(hMetadataSize, kj::str(request.size()));
+    auto body = kj::str(request, content);
+    auto req = client->request(kj::HttpMethod::PUT, "https://fake-host/", headers, body.size());
+    req.body->write(body.begin(), body.size()).wait(ws);
+    req.body = nullptr;
+    auto response = req.response.wait(ws);
+    auto text = response.body->readAllText().wait(ws);
+    if (response.statusCode >= 400) {
+      return { response.statusCode, kj::str(KJ_ASSERT_NONNULL(response.headers->get(hError))) };
+    }
+    return { response.statusCode, kj::mv(text) };
+  }
+
+  kj::String put(kj::StringPtr key, kj::StringPtr content) {
+    // Returns the new version.
+    auto result = write(kj::str("{\"version\":1,\"method\":\"put\",\"object\":\"", key, "\"}"),
+                        content);
+    KJ_ASSERT(result.status == 200, result.metadata);
+    return field(result.metadata, "version");
+  }
+
+  static kj::String field(kj::StringPtr json, kj::StringPtr name) {
+    // Plucks a string field out of a JSON object, which is all these tests need.
+    auto marker = kj::str("\"", name, "\":\"");
+    for (size_t i = 0; i + marker.size() <= json.size(); i++) {
+      if (json.slice(i).startsWith(marker)) {
+        auto rest = json.slice(i + marker.size());
+        return kj::str(rest.slice(0, KJ_ASSERT_NONNULL(rest.findFirst('"'))));
+      }
+    }
+    KJ_FAIL_ASSERT("field not found", json, name);
+  }
+};
+
+KJ_TEST("LocalR2Bucket: put, get, head, delete") {
+  LocalR2BucketTest test;
+
+  auto missing = test.read(R"({"version":1,"method":"get","object":"foo"})");
+  KJ_EXPECT(missing.status == 404);
+  KJ_EXPECT(contains(missing.metadata, "10007"), missing.metadata);
+
+  auto version = test.put("foo", "hello world");
+
+  auto got = test.read(R"({"version":1,"method":"get","object":"foo"})");
+  KJ_EXPECT(got.status == 200);
+  KJ_EXPECT(got.content == "hello world");
+  KJ_EXPECT(LocalR2BucketTest::field(got.metadata, "name") == "foo");
+  KJ_EXPECT(LocalR2BucketTest::field(got.metadata, "version") == version);
+  KJ_EXPECT(LocalR2BucketTest::field(got.metadata, "etag") == "5eb63bbbe01eeed093cb22bb8f5acdc3");
+  KJ_EXPECT(contains(got.metadata, "\"size\":\"11\""), got.metadata);
+  KJ_EXPECT(contains(got.metadata, "\"uploaded\":\"1000000\""), got.metadata);
+
+  auto head = test.read(R"({"version":1,"method":"head","object":"foo"})");
+  KJ_EXPECT(head.status == 200);
+  KJ_EXPECT(head.content == "");
+  KJ_EXPECT(LocalR2BucketTest::field(head.metadata, "version") == version);
+
+  // Replacing the object removes the old content.
+  auto newVersion = test.put("foo", "bye");
+  KJ_EXPECT(newVersion != version);
+  KJ_EXPECT(test.read(R"({"version":1,"method":"get","object":"foo"})").content == "bye");
+  KJ_EXPECT(test.dir->listNames().size() == 2);
+
+  KJ_EXPECT(test.write(R"({"version":1,"method":"delete","object":"foo"})").status == 200);
+  KJ_EXPECT(test.read(R"({"version":1,"method":"head","object":"foo"})").status == 404);
+  KJ_EXPECT(test.dir->listNames().size() == 0);
+}
+
+KJ_TEST("LocalR2Bucket: ranged reads") {
+  LocalR2BucketTest test;
+  test.put("foo", "0123456789");
+
+  auto got = test.read(
+      R"({"version":1,"method":"get","object":"foo","range":{"offset":"2","length":"3"}})");
+  KJ_EXPECT(got.content == "234");
+  KJ_EXPECT(contains(got.metadata, "\"range\":{\"offset\":\"2\",\"length\":\"3\"}"),
+      got.metadata);
+
+  got = test.read(R"({"version":1,"method":"get","object":"foo","range":{"offset":"7"}})");
+  KJ_EXPECT(got.content == "789");
+
+  got = test.read(R"({"version":1,"method":"get","object":"foo","range":{"suffix":"4"}})");
+  KJ_EXPECT(got.content == "6789");
+
+  got = test.read(R"({"version":1,"method":"get","object":"foo","rangeHeader":"bytes=1-2"})");
+  KJ_EXPECT(got.content == "12");
+
+  got = test.read(R"({"version":1,"method":"get","object":"foo","range":{"offset":"11"}})");
+  KJ_EXPECT(got.status == 416);
+
+  // A large object is served from a mapping of the file.
+  auto big = kj::heapString(1 << 20);
+  for (auto i: kj::indices(big)) big[i] = 'a' + i % 26;
+  test.put("big", big);
+  got = test.read(
+      R"({"version":1,"method":"get","object":"big","range":{"offset":"1","length":"524288"}})");
+  KJ_EXPECT(got.content == kj::str(big.slice(1, 524289)));
+}
+
+KJ_TEST("LocalR2Bucket: conditional requests") {
+  LocalR2BucketTest test;
+  test.put("foo", "hello world");
+  auto etag = "5eb63bbbe01eeed093cb22bb8f5acdc3"_kj;
+
+  auto got = test.read(kj::str(
+      R"({"version":1,"method":"get","object":"foo","onlyIf":{"etagMatches":")", etag, R"("}})"));
+  KJ_EXPECT(got.status == 200);
+  KJ_EXPECT(got.content == "hello world");
+
+  got = test.read(kj::str(
+      R"({"version":1,"method":"get","object":"foo","onlyIf":{"etagDoesNotMatch":"\")", etag,
+      R"(\""}})"));
+  KJ_EXPECT(got.status == 412);
+  KJ_EXPECT(LocalR2BucketTest::field(got.metadata, "etag") == etag);
+
+  // Put-if-absent.
+  auto putIfAbsent =
+      R"({"version":1,"method":"put","object":"foo","onlyIf":{"etagDoesNotMatch":"*"}})"_kj;
+  auto put = test.write(putIfAbsent, "again");
+  KJ_EXPECT(put.status == 412);
+  KJ_EXPECT(contains(put.metadata, "10031"), put.metadata);
+  KJ_EXPECT(test.read(R"({"version":1,"method":"get","object":"foo"})").content ==
+      "hello world");
+  KJ_EXPECT(test.write(
+      R"({"version":1,"method":"put","object":"bar","onlyIf":{"etagDoesNotMatch":"*"}})",
+      "new").status == 200);
+
+  // Checksums are verified.
+  auto badMd5 = test.write(
+      R"({"version":1,"method":"put","object":"baz","md5":"AAAAAAAAAAAAAAAAAAAAAA=="})", "x");
+  KJ_EXPECT(badMd5.status == 400);
+  KJ_EXPECT(contains(badMd5.metadata, "10037"), badMd5.metadata);
+  KJ_EXPECT(test.read(R"({"version":1,"method":"head","object":"baz"})").status == 404);
+}
+
+KJ_TEST("LocalR2Bucket: list") {
+  LocalR2BucketTest test;
+  for (auto key: { "a/1", "a/2", "b", "c/x/1", "c/y" }) {
+    test.put(key, "x");
+  }
+
+  auto listed = test.read(R"({"version":1,"method":"list","limit":2})");
+  KJ_EXPECT(contains(listed.metadata, "\"truncated\":true"), listed.metadata);
+  KJ_EXPECT(LocalR2BucketTest::field(listed.metadata, "cursor") == "a/2");
+
+  listed = test.read(R"({"version":1,"method":"list","cursor":"a/2"})");
+  KJ_EXPECT(contains(listed.metadata, "\"name\":\"b\""), listed.metadata);
+  KJ_EXPECT(!contains(listed.metadata, "\"name\":\"a/2\""), listed.metadata);
+  KJ_EXPECT(!contains(listed.metadata, "\"truncated\":true"), listed.metadata);
+
+  listed = test.read(R"({"version":1,"method":"list","delimiter":"/"})");
+  KJ_EXPECT(contains(listed.metadata, "\"delimitedPrefixes\":[\"a/\",\"c/\"]"), listed.metadata);
+  KJ_EXPECT(contains(listed.metadata, "\"name\":\"b\""), listed.metadata);
+  KJ_EXPECT(!contains(listed.metadata, "\"name\":\"a/1\""), listed.metadata);
+
+  listed = test.read(R"({"version":1,"method":"list","prefix":"c/","delimiter":"/"})");
+  KJ_EXPECT(contains(listed.metadata, "\"delimitedPrefixes\":[\"c/x/\"]"), listed.metadata);
+  KJ_EXPECT(contains(listed.metadata, "\"name\":\"c/y\""), listed.metadata);
+}
+
+KJ_TEST("LocalR2Bucket: multipart uploads") {
+  LocalR2BucketTest test;
+
+  auto create = [&]() {
+    auto created = test.write(R"({"version":1,"method":"createMultipartUpload","object":"foo",)"
+                              R"("customFields":[{"k":"a","v":"b"}]})");
+    KJ_ASSERT(created.status == 200, created.metadata);
+    return LocalR2BucketTest::field(created.metadata, "uploadId");
+  };
+  auto uploadPart = [&](kj::StringPtr uploadId, uint partNumber, kj::StringPtr content) {
+    return test.write(kj::str(
+        R"({"version":1,"method":"uploadPart","object":"foo","uploadId":")", uploadId,
+        R"(","partNumber":)", partNumber, "}"), content);
+  };
+  auto complete = [&](kj::StringPtr uploadId, kj::StringPtr parts) {
+    return test.write(kj::str(
+        R"({"version":1,"method":"completeMultipartUpload","object":"foo","uploadId":")",
+        uploadId, R"(","parts":)", parts, "}"));
+  };
+
+  auto uploadId = create();
+
+  // Parts can arrive in any order, and uploading a part again replaces it.
+  KJ_EXPECT(uploadPart(uploadId, 2, "earth").status == 200);
+  auto part2 = uploadPart(uploadId, 2, "world");
+  KJ_EXPECT(LocalR2BucketTest::field(part2.metadata, "etag") ==
+      "7d793037a0760186574b0282f2f435e7");
+  auto part1 = uploadPart(uploadId, 1, "hello ");
+  KJ_EXPECT(LocalR2BucketTest::field(part1.metadata, "etag") ==
+      "f814893777bcc2295fff05f00e508da6");
+  KJ_EXPECT(test.dir->listNames().size() == 2);
+  KJ_EXPECT(test.read(R"({"version":1,"method":"head","object":"foo"})").status == 404);
+
+  auto parts = R"([{"etag":"f814893777bcc2295fff05f00e508da6","part":1},)"
+               R"({"etag":"7d793037a0760186574b0282f2f435e7","part":2}])"_kj;
+  auto wrongEtag = complete(uploadId,
+      R"([{"etag":"f814893777bcc2295fff05f00e508da6","part":1},{"etag":"x","part":2}])");
+  KJ_EXPECT(wrongEtag.status == 400);
+  KJ_EXPECT(contains(wrongEtag.metadata, "10025"), wrongEtag.metadata);
+  auto wrongOrder = complete(uploadId,
+      R"([{"etag":"7d793037a0760186574b0282f2f435e7","part":2},)"
+      R"({"etag":"f814893777bcc2295fff05f00e508da6","part":1}])");
+  KJ_EXPECT(wrongOrder.status == 400);
+
+  // The ETag of a multipart object is the MD5 of its parts' MD5s, and the number of parts.
+  auto completed = complete(uploadId, parts);
+  KJ_ASSERT(completed.status == 200, completed.metadata);
+  KJ_EXPECT(LocalR2BucketTest::field(completed.metadata, "etag") ==
+      "e09e4fd6265b36115fe3db32df945d84-2");
+
+  auto got = test.read(R"({"version":1,"method":"get","object":"foo"})");
+  KJ_EXPECT(got.content == "hello world");
+  KJ_EXPECT(contains(got.metadata, "\"size\":\"11\""), got.metadata);
+  KJ_EXPECT(contains(got.metadata, R"("customFields":[{"k":"a","v":"b"}])"), got.metadata);
+  KJ_EXPECT(test.dir->listNames().size() == 2);
+
+  // A finished upload is gone.
+  auto late = uploadPart(uploadId, 3, "!");
+  KJ_EXPECT(late.status == 404);
+  KJ_EXPECT(contains(late.metadata, "10024"), late.metadata);
+  KJ_EXPECT(complete(uploadId, parts).status == 404);
+
+  // Aborting removes the parts, and leaves the object as it was.
+  uploadId = create();
+  KJ_EXPECT(uploadPart(uploadId, 1, "bye").status == 200);
+  auto abort = kj::str(
+      R"({"version":1,"method":"abortMultipartUpload","object":"foo","uploadId":")", uploadId,
+      R"("})");
+  KJ_EXPECT(test.write(abort).status == 200);
+  KJ_EXPECT(test.write(abort).status == 200);
+  KJ_EXPECT(uploadPart(uploadId, 2, "bye").status == 404);
+  KJ_EXPECT(test.dir->listNames().size() == 2);
+  KJ_EXPECT(test.read(R"({"version":1,"method":"get","object":"foo"})").content == "hello world");
+
+  // Uploads in progress don't survive the bucket being reopened.
+  uploadId = create();
+  KJ_EXPECT(uploadPart(uploadId, 1, "bye").status == 200);
+  test.reopen();
+  KJ_EXPECT(test.dir->listNames().size() == 2);
+  KJ_EXPECT(uploadPart(uploadId, 2, "bye").status == 404);
+}
+
+KJ_TEST("LocalR2Bucket: contents persist") {
+  LocalR2BucketTest test;
+  auto version = test.put("foo", "hello");
+
+  // Content left behind by a put that never published its metadata is cleaned up.
+  test.dir->openFile(kj::Path("0123.data"), kj::WriteMode::CREATE)->writeAll("junk"_kj);
+
+  test.reopen();
+  auto got = test.read(R"({"version":1,"method":"get","object":"foo"})");
+  KJ_EXPECT(got.content == "hello");
+  KJ_EXPECT(LocalR2BucketTest::field(got.metadata, "version") == version);
+  KJ_EXPECT(test.dir->tryOpenFile(kj::Path("0123.data")) == nullptr);
+}
+
+}  // namespace
+}  // namespace workerd::server
@@ -0,0 +1,939 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "r2-store.h"
+#include <workerd/api/r2-api.capnp.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/sha.h>
+#include <capnp/compat/json.h>
+#include <capnp/message.h>
+#include <capnp/serialize.h>
+#include <kj/debug.h>
+#include <kj/encoding.h>
+#include <kj/map.h>
+#include <kj/vector.h>
+
+namespace workerd::server {
+
+namespace {
+
+namespace r2 = api::public_beta;
+
+// R2's V4 API error codes, which the binding reports to JavaScript.
+constexpr uint ERROR_INTERNAL = 10001;
+constexpr uint ERROR_NOT_IMPLEMENTED = 10004;
+constexpr uint ERROR_NO_SUCH_KEY = 10007;
+constexpr uint ERROR_INVALID_OBJECT_NAME = 10020;
+constexpr uint ERROR_NO_SUCH_UPLOAD = 10024;
+constexpr uint ERROR_INVALID_PART = 10025;
+constexpr uint ERROR_PRECONDITION_FAILED = 10031;
+constexpr uint ERROR_BAD_DIGEST = 10037;
+constexpr uint ERROR_INVALID_RANGE = 10039;
+
+constexpr uint64_t UNSET = 0xffffffffffffffff;
+// The default of the optional integer fields in r2-api.capnp.
+
+constexpr size_t MAX_KEY_SIZE = 1024;
+constexpr uint MAX_LIST_LIMIT = 1000;
+constexpr size_t MAX_METADATA_SIZE = 1024 * 1024;
+constexpr uint MAX_PART_NUMBER = 10000;
+
+constexpr size_t IO_CHUNK_SIZE = 64 * 1024;
+constexpr uint64_t MMAP_THRESHOLD = 256 * 1024;
+constexpr uint64_t MMAP_CHUNK_SIZE = 16 << 20;
+
+struct ByteRange {
+  uint64_t start;
+  uint64_t end;  // exclusive
+};
+
+kj::Path metadataPathFor(kj::StringPtr key) {
+  kj::FixedArray<kj::byte, SHA256_DIGEST_LENGTH> hash;
+  SHA256(key.asBytes().begin(), key.size(), hash.begin());
+  return kj::Path(kj::str(kj::encodeHex(hash), ".meta"));
+}
+
+kj::Path contentPathFor(kj::StringPtr version) {
+  return kj::Path(kj::str(version, ".data"));
+}
+
+bool isValidKey(kj::StringPtr key) {
+  return key.size() > 0 && key.size() <= MAX_KEY_SIZE;
+}
+
+kj::String newVersion() {
+  kj::FixedArray<kj::byte, 16> id;
+  KJ_ASSERT(RAND_bytes(id.begin(), id.size()) == 1);
+  return kj::encodeHex(id);
+}
+
+class Digest {
+  // Incrementally hashes an object's content as it is written.
+
+public:
+  explicit Digest(const EVP_MD* type): ctx(EVP_MD_CTX_new()) {
+    KJ_ASSERT(ctx != nullptr);
+    KJ_ASSERT(EVP_DigestInit_ex(ctx, type, nullptr) == 1);
+  }
+  ~Digest() noexcept(false) { EVP_MD_CTX_free(ctx); }
+  KJ_DISALLOW_COPY_AND_MOVE(Digest);
+
+  void update(kj::ArrayPtr<const kj::byte> data) {
+    KJ_ASSERT(EVP_DigestUpdate(ctx, data.begin(), data.size()) == 1);
+  }
+
+  kj::Array<kj::byte> finish() {
+    auto result = kj::heapArray<kj::byte>(EVP_MD_CTX_size(ctx));
+    uint size;
+    KJ_ASSERT(EVP_DigestFinal_ex(ctx, result.begin(), &size) == 1);
+    return result;
+  }
+
+private:
+  EVP_MD_CTX* ctx;
+};
+
+bool etagListMatches(kj::StringPtr list, kj::StringPtr etag) {
+  // Checks whether `etag` appears in `list`, a comma-separated list of ETags that may be quoted
+  // or weak, as in `If-Match` and `If-None-Match` headers.
+
+  size_t pos = 0;
+  while (pos < list.size()) {
+    size_t end = pos;
+    while (end < list.size() && list[end] != ',') ++end;
+    auto candidate = list.slice(pos, end);
+    pos = end + 1;
+
+    while (candidate.size() > 0 && candidate.front() == ' ') candidate = candidate.slice(1);
+    while (candidate.size() > 0 && candidate.back() == ' ') {
+      candidate = candidate.slice(0, candidate.size() - 1);
+    }
+    if (candidate == "*"_kj.asArray()) return true;
+    if (candidate.size() >= 2 && candidate[0] == 'W' && candidate[1] == '/') {
+      candidate = candidate.slice(2);
+    }
+    if (candidate.size() >= 2 && candidate.front() == '"' && candidate.back() == '"') {
+      candidate = candidate.slice(1, candidate.size() - 1);
+    }
+    if (candidate == etag.asArray()) return true;
+  }
+  return false;
+}
+
+bool conditionsPass(r2::R2Conditional::Reader onlyIf,
+                    kj::Maybe<r2::R2HeadResponse::Reader> existing) {
+  // Evaluates `onlyIf` against the current version of the object, with the precedence S3 gives
+  // the corresponding HTTP conditional headers.
+
+  r2::R2HeadResponse::Reader object;
+  KJ_IF_MAYBE(e, existing) {
+    object = *e;
+  } else {
+    // There's nothing for the dates or a negative ETag condition to be compared against.
+    return !onlyIf.hasEtagMatches();
+  }
+
+  auto etag = object.getEtag();
+  uint64_t granularity = onlyIf.getSecondsGranularity() ? 1000 : 1;
+  uint64_t uploaded = object.getUploadedMillisecondsSinceEpoch() / granularity;
+
+  if (onlyIf.hasEtagMatches() && !etagListMatches(onlyIf.getEtagMatches(), etag)) {
+    return false;
+  }
+  if (onlyIf.hasEtagDoesNotMatch() && etagListMatches(onlyIf.getEtagDoesNotMatch(), etag)) {
+    return false;
+  }
+
+  // A date condition is ignored when the corresponding ETag condition passed.
+  auto before = onlyIf.getUploadedBefore();
+  if (before != UNSET && !onlyIf.hasEtagMatches() && uploaded >= before / granularity) {
+    return false;
+  }
+  auto after = onlyIf.getUploadedAfter();
+  if (after != UNSET && !onlyIf.hasEtagDoesNotMatch() && uploaded <= after / granularity) {
+    return false;
+  }
+  return true;
+}
+
+kj::Maybe<ByteRange> parseRangeHeader(kj::StringPtr value, uint64_t size, bool& unsatisfiable) {
+  // Parses a `Range` header that selects a single range. Returns null if the header should be
+  // ignored, setting `unsatisfiable` if that's because the range lies outside the object.
+
+  if (!value.startsWith("bytes=")) return nullptr;
+  auto spec = value.slice(6);
+  if (spec.findFirst(',') != nullptr) return nullptr;
+  auto dash = KJ_UNWRAP_OR(spec.findFirst('-'), return nullptr);
+
+  auto firstText = kj::str(spec.slice(0, dash));
+  auto lastText = spec.slice(dash + 1);
+
+  if (firstText.size() == 0) {
+    KJ_IF_MAYBE(suffix, lastText.tryParseAs<uint64_t>()) {
+      return ByteRange { size - kj::min(*suffix, size), size };
+    }
+  } else KJ_IF_MAYBE(first, firstText.tryParseAs<uint64_t>()) {
+    if (*first >= size) {
+      unsatisfiable = true;
+    } else if (lastText.size() == 0) {
+      return ByteRange { *first, size };
+    } else KJ_IF_MAYBE(last, lastText.tryParseAs<uint64_t>()) {
+      if (*last >= *first) {
+        return ByteRange { *first, kj::min(*last, size - 1) + 1 };
+      }
+    }
+  }
+  return nullptr;
+}
+
+class LocalR2Bucket final: public kj::HttpService {
+public:
+  LocalR2Bucket(kj::Own<const kj::Directory> directory, const kj::Clock& clock,
+                kj::HttpHeaderTable::Builder& headerTableBuilder)
+      : directory(kj::mv(directory)), clock(clock),
+        headerTable(headerTableBuilder.getFutureTable()),
+        hR2Request(headerTableBuilder.add("CF-R2-Request")),
+        hR2MetadataSize(headerTableBuilder.add("CF-R2-Metadata-Size")),
+        hR2Error(headerTableBuilder.add("CF-R2-Error")) {
+    loadIndex();
+  }
+
+  kj::Promise<void> request(
+      kj::HttpMethod method, kj::StringPtr urlStr, const kj::HttpHeaders& headers,
+      kj::AsyncInputStream& requestBody, kj::HttpService::Response& response) override {
+    // Reads arrive as GETs with the request in a header. Writes arrive as PUTs whose body starts
+    // with the request, followed by the object's content. The URL only names the bucket for
+    // admin bindings, which we don't distinguish.
+    if (method == kj::HttpMethod::GET) {
+      KJ_IF_MAYBE(requestJson, headers.get(hR2Request)) {
+        return handleRead(*requestJson, response);
+      }
+    } else if (method == kj::HttpMethod::PUT) {
+      KJ_IF_MAYBE(sizeText, headers.get(hR2MetadataSize)) {
+        KJ_IF_MAYBE(size, sizeText->tryParseAs<size_t>()) {
+          if (*size <= MAX_METADATA_SIZE) {
+            return handleWrite(*size, requestBody, response);
+          }
+        }
+      }
+    }
+
+    return sendR2Error(response, 400, "Bad Request", ERROR_INTERNAL, "Malformed R2 request.");
+  }
+
+private:
+  kj::Own<const kj::Directory> directory;
+  const kj::Clock& clock;
+  kj::HttpHeaderTable& headerTable;
+  kj::HttpHeaderId hR2Request;
+  kj::HttpHeaderId hR2MetadataSize;
+  kj::HttpHeaderId hR2Error;
+
+  kj::TreeMap<kj::String, kj::Own<capnp::MallocMessageBuilder>> index;
+  // The metadata of every object, as an R2HeadResponse, in key order.
+
+  struct Part {
+    kj::Path file;
+    uint64_t size;
+    kj::Array<kj::byte> md5;
+    kj::String etag;
+  };
+
+  struct Upload {
+    kj::String key;
+    kj::Own<capnp::MallocMessageBuilder> fields;
+    // An R2HeadResponse holding the metadata given when the upload was created.
+
+    kj::TreeMap<uint, Part> parts;
+    // The latest upload of each part number.
+  };
+
+  kj::HashMap<kj::String, Upload> uploads;
+  // Multipart uploads in progress, by upload ID.
+
+  void loadIndex() {
+    kj::HashSet<kj::String> versions;
+    auto names = directory->listNames();
+    for (auto& name: names) {
+      if (!name.endsWith(".meta")) continue;
+      KJ_IF_MAYBE(exception, kj::runCatchingExceptions([&]() {
+        auto bytes = directory->openFile(kj::Path(name))->readAllBytes();
+        KJ_REQUIRE(bytes.size() % sizeof(capnp::word) == 0, "R2 metadata file is corrupt");
+        auto words = kj::heapArray<capnp::word>(bytes.size() / sizeof(capnp::word));
+        memcpy(words.begin(), bytes.begin(), bytes.size());
+
+        capnp::FlatArrayMessageReader reader(words);
+        auto message = kj::heap<capnp::MallocMessageBuilder>();
+        message->setRoot(reader.getRoot<r2::R2HeadResponse>());
+        auto object = message->getRoot<r2::R2HeadResponse>().asReader();
+
+        versions.insert(kj::str(object.getVersion(), ".data"));
+        index.upsert(kj::str(object.getName()), kj::mv(message));
+      })) {
+        KJ_LOG(WARNING, "failed to read R2 object metadata", name, *exception);
+      }
+    }
+
+    // Content whose metadata was never written belongs to a put that didn't finish, and parts
+    // belong to multipart uploads, which only last as long as the bucket is open.
+    for (auto& name: names) {
+      if ((name.endsWith(".data") && !versions.contains(name)) || name.endsWith(".part")) {
+        directory->tryRemove(kj::Path(name));
+      }
+    }
+  }
+
+  kj::Maybe<r2::R2HeadResponse::Reader> find(kj::StringPtr key) {
+    return index.find(key).map([](kj::Own<capnp::MallocMessageBuilder>& message) {
+      return message->getRoot<r2::R2HeadResponse>().asReader();
+    });
+  }
+
+  kj::Maybe<Upload&> findUpload(kj::StringPtr uploadId, kj::StringPtr key) {
+    KJ_IF_MAYBE(upload, uploads.find(uploadId)) {
+      if (upload->key == key) return *upload;
+    }
+    return nullptr;
+  }
+
+  // ---------------------------------------------------------------------------
+  // Responses
+
+  template <typename T>
+  static kj::String encode(T reader) {
+    capnp::JsonCodec json;
+    json.handleByAnnotation<capnp::FromAny<T>>();
+    json.setHasMode(capnp::HasMode::NON_DEFAULT);
+    return json.encode(reader);
+  }
+
+  kj::Promise<void> sendR2Error(kj::HttpService::Response& response, uint statusCode,
+                                kj::StringPtr statusText, uint v4code, kj::StringPtr message) {
+    capnp::MallocMessageBuilder errorMessage;
+    auto error = errorMessage.initRoot<r2::R2ErrorResponse>();
+    error.setVersion(r2::VERSION_PUBLIC_BETA);
+    error.setV4code(v4code);
+    error.setMessage(message);
+
+    kj::HttpHeaders headers(headerTable);
+    headers.set(hR2Error, encode(error.asReader()));
+    return response.sendError(statusCode, statusText, headers);
+  }
+
+  kj::Promise<void> sendMetadata(kj::HttpService::Response& response, uint statusCode,
+                                 kj::StringPtr statusText, kj::String metadata,
+                                 kj::HttpHeaders& headers) {
+    // Sends a response to a read consisting only of metadata.
+    headers.set(hR2MetadataSize, kj::str(metadata.size()));
+    auto out = response.send(statusCode, statusText, headers, metadata.size());
+    auto promise = out->write(metadata.begin(), metadata.size());
+    return promise.attach(kj::mv(out), kj::mv(metadata));
+  }
+
+  kj::Promise<void> sendMetadata(kj::HttpService::Response& response, kj::String metadata) {
+    kj::HttpHeaders headers(headerTable);
+    return sendMetadata(response, 200, "OK", kj::mv(metadata), headers);
+  }
+
+  kj::Promise<void> sendWriteResult(kj::HttpService::Response& response, kj::String body) {
+    kj::HttpHeaders headers(headerTable);
+    auto out = response.send(200, "OK", headers, body.size());
+    auto promise = out->write(body.begin(), body.size());
+    return promise.attach(kj::mv(out), kj::mv(body));
+  }
+
+  kj::Promise<void> sendPreconditionFailed(kj::HttpService::Response& response,
+                                           r2::R2HeadResponse::Reader object) {
+    // The binding reports a failed precondition on a read with the object's metadata.
+    capnp::MallocMessageBuilder errorMessage;
+    auto error = errorMessage.initRoot<r2::R2ErrorResponse>();
+    error.setVersion(r2::VERSION_PUBLIC_BETA);
+    error.setV4code(ERROR_PRECONDITION_FAILED);
+    error.setMessage("The operation was not performed because a precondition failed.");
+
+    kj::HttpHeaders headers(headerTable);
+    headers.set(hR2Error, encode(error.asReader()));
+    return sendMetadata(response, 412, "Precondition Failed", encode(object), headers);
+  }
+
+  // ---------------------------------------------------------------------------
+  // Reads
+
+  kj::Promise<void> handleRead(kj::StringPtr requestJson, kj::HttpService::Response& response) {
+    capnp::MallocMessageBuilder requestMessage;
+    auto request = requestMessage.initRoot<r2::R2BindingRequest>();
+    KJ_IF_MAYBE(exception, kj::runCatchingExceptions([&]() {
+      capnp::JsonCodec json;
+      json.handleByAnnotation<r2::R2BindingRequest>();
+      json.decode(requestJson, request);
+    })) {
+      return sendR2Error(response, 400, "Bad Request", ERROR_INTERNAL, "Malformed R2 request.");
+    }
+
+    auto payload = request.getPayload().asReader();
+    switch (payload.which()) {
+      case r2::R2BindingRequest::Payload::HEAD:
+        return head(payload.getHead(), response);
+      case r2::R2BindingRequest::Payload::GET:
+        return get(payload.getGet(), response);
+      case r2::R2BindingRequest::Payload::LIST:
+        return list(payload.getList(), response);
+      default:
+        return sendR2Error(response, 501, "Not Implemented", ERROR_NOT_IMPLEMENTED,
+            "Local R2 buckets don't support this operation.");
+    }
+  }
+
+  kj::Promise<void> head(r2::R2HeadRequest::Reader request, kj::HttpService::Response& response) {
+    KJ_IF_MAYBE(object, find(request.getObject())) {
+      return sendMetadata(response, encode(*object));
+    }
+    return sendNoSuchKey(response);
+  }
+
+  kj::Promise<void> sendNoSuchKey(kj::HttpService::Response& response) {
+    return sendR2Error(response, 404, "Not Found", ERROR_NO_SUCH_KEY,
+        "The specified key does not exist.");
+  }
+
+  kj::Promise<void> sendNoSuchUpload(kj::HttpService::Response& response) {
+    return sendR2Error(response, 404, "Not Found", ERROR_NO_SUCH_UPLOAD,
+        "The specified multipart upload does not exist.");
+  }
+
+  kj::Promise<void> get(r2::R2GetRequest::Reader request, kj::HttpService::Response& response) {
+    r2::R2HeadResponse::Reader object;
+    KJ_IF_MAYBE(o, find(request.getObject())) {
+      object = *o;
+    } else {
+      return sendNoSuchKey(response);
+    }
+
+    if (request.hasOnlyIf() && !conditionsPass(request.getOnlyIf(), object)) {
+      return sendPreconditionFailed(response, object);
+    }
+
+    uint64_t size = object.getSize();
+    kj::Maybe<ByteRange> range;
+    bool unsatisfiable = false;
+    if (request.hasRange()) {
+      auto r = request.getRange();
+      if (r.getSuffix() != UNSET) {
+        range = ByteRange { size - kj::min(r.getSuffix(), size), size };
+      } else {
+        uint64_t offset = r.getOffset() == UNSET ? 0 : r.getOffset();
+        if (offset > size) {
+          unsatisfiable = true;
+        } else {
+          uint64_t length = kj::min(r.getLength(), size - offset);
+          range = ByteRange { offset, offset + length };
+        }
+      }
+    } else if (request.hasRangeHeader()) {
+      range = parseRangeHeader(request.getRangeHeader(), size, unsatisfiable);
+    }
+    if (unsatisfiable) {
+      return sendR2Error(response, 416, "Range Not Satisfiable", ERROR_INVALID_RANGE,
+          "The requested range is not satisfiable.");
+    }
+
+    auto file = KJ_UNWRAP_OR(directory->tryOpenFile(contentPathFor(object.getVersion())), {
+      KJ_LOG(ERROR, "R2 object content is missing", object.getName());
+      return sendR2Error(response, 500, "Internal Server Error", ERROR_INTERNAL,
+          "The object's content is missing.");
+    });
+
+    ByteRange served { 0, size };
+    kj::String metadata;
+    KJ_IF_MAYBE(r, range) {
+      // Echo the range that is served back, as R2 does.
+      capnp::MallocMessageBuilder message;
+      message.setRoot(object);
+      auto rangeBuilder = message.getRoot<r2::R2HeadResponse>().initRange();
+      rangeBuilder.setOffset(r->start);
+      rangeBuilder.setLength(r->end - r->start);
+      metadata = encode(message.getRoot<r2::R2HeadResponse>().asReader());
+      served = *r;
+    } else {
+      metadata = encode(object);
+    }
+
+    kj::HttpHeaders headers(headerTable);
+    headers.set(hR2MetadataSize, kj::str(metadata.size()));
+    auto out = response.send(200, "OK", headers, metadata.size() + (served.end - served.start));
+    return sendContent(kj::mv(out), kj::mv(metadata), kj::mv(file), served);
+  }
+
+  static kj::Promise<void> sendContent(kj::Own<kj::AsyncOutputStream> out, kj::String metadata,
+                                       kj::Own<const kj::ReadableFile> file, ByteRange range) {
+    // Writes the metadata and then bytes [start, end) of `file` to `out`. Large ranges are
+    // written in slices of a read-only mapping, so the content goes from the page cache to the
+    // connection without passing through a buffer of ours; small ones are simply read. The file
+    // is open, so this keeps serving the content it started with even if the object is replaced
+    // or deleted meanwhile.
+
+    co_await out->write(metadata.begin(), metadata.size());
+
+    uint64_t pos = range.start;
+    if (range.end - range.start >= MMAP_THRESHOLD) {
+      while (pos < range.end) {
+        auto mapping = file->mmap(pos, kj::min(range.end - pos, MMAP_CHUNK_SIZE));
+        co_await out->write(mapping.begin(), mapping.size());
+        pos += mapping.size();
+      }
+    } else {
+      auto buffer = kj::heapArray<kj::byte>(range.end - range.start);
+      size_t n = file->read(pos, buffer);
+      KJ_REQUIRE(n == buffer.size(), "R2 object content is truncated");
+      co_await out->write(buffer.begin(), buffer.size());
+    }
+  }
+
+  kj::Promise<void> list(r2::R2ListRequest::Reader request, kj::HttpService::Response& response) {
+    uint limit = request.getLimit();
+    if (limit == 0 || limit > MAX_LIST_LIMIT) limit = MAX_LIST_LIMIT;
+    kj::StringPtr prefix = request.getPrefix();
+    kj::StringPtr delimiter = request.getDelimiter();
+    kj::Maybe<kj::StringPtr> cursor;
+    if (request.hasCursor()) cursor = request.getCursor();
+    kj::Maybe<kj::StringPtr> startAfter;
+    if (request.hasStartAfter()) startAfter = request.getStartAfter();
+
+    bool includeHttp = true;
+    bool includeCustom = true;
+    if (request.hasInclude()) {
+      includeHttp = includeCustom = false;
+      for (auto field: request.getInclude()) {
+        if (field == static_cast<uint16_t>(r2::R2ListRequest::IncludeField::HTTP)) {
+          includeHttp = true;
+        } else if (field == static_cast<uint16_t>(r2::R2ListRequest::IncludeField::CUSTOM)) {
+          includeCustom = true;
+        }
+      }
+    }
+
+    kj::Vector<r2::R2HeadResponse::Reader> objects;
+    kj::Vector<kj::String> delimitedPrefixes;
+    bool truncated = false;
+    kj::StringPtr last;
+    for (auto& entry: index) {
+      kj::StringPtr key = entry.key;
+      if (!key.startsWith(prefix)) {
+        // Keys are in order, so once we're past the prefix there's nothing more to find.
+        if (key > prefix) break;
+        continue;
+      }
+      KJ_IF_MAYBE(c, cursor) {
+        if (key <= *c) continue;
+      }
+      KJ_IF_MAYBE(s, startAfter) {
+        if (key <= *s) continue;
+      }
+
+      kj::Maybe<size_t> delimited;
+      // The length of the key's delimited prefix, if it has one.
+      if (delimiter.size() > 0) {
+        for (size_t i = prefix.size(); i + delimiter.size() <= key.size(); i++) {
+          if (key.slice(i).startsWith(delimiter)) {
+            delimited = i + delimiter.size();
+            break;
+          }
+        }
+      }
+      KJ_IF_MAYBE(d, delimited) {
+        if (!delimitedPrefixes.empty() && delimitedPrefixes.back().size() == *d &&
+            key.startsWith(delimitedPrefixes.back())) {
+          // Rolled up into the prefix we already listed.
+          last = key;
+          continue;
+        }
+      }
+
+      if (objects.size() + delimitedPrefixes.size() == limit) {
+        truncated = true;
+        break;
+      }
+      KJ_IF_MAYBE(d, delimited) {
+        delimitedPrefixes.add(kj::heapString(key.slice(0, *d)));
+      } else {
+        objects.add(entry.value->getRoot<r2::R2HeadResponse>().asReader());
+      }
+      last = key;
+    }
+
+    capnp::MallocMessageBuilder responseMessage;
+    auto result = responseMessage.initRoot<r2::R2ListResponse>();
+    auto objectsBuilder = result.initObjects(objects.size());
+    for (auto i: kj::indices(objects)) {
+      objectsBuilder.setWithCaveats(i, objects[i]);
+      auto object = objectsBuilder[i];
+      if (!includeHttp) object.disownHttpFields();
+      if (!includeCustom) object.disownCustomFields();
+    }
+    result.setTruncated(truncated);
+    if (truncated) result.setCursor(last);
+    if (delimitedPrefixes.size() > 0) {
+      auto prefixesBuilder = result.initDelimitedPrefixes(delimitedPrefixes.size());
+      for (auto i: kj::indices(delimitedPrefixes)) {
+        prefixesBuilder.set(i, delimitedPrefixes[i]);
+      }
+    }
+
+    return sendMetadata(response, encode(result.asReader()));
+  }
+
+  // ---------------------------------------------------------------------------
+  // Writes
+
+  kj::Promise<void> handleWrite(size_t metadataSize, kj::AsyncInputStream& requestBody,
+                                kj::HttpService::Response& response) {
+    auto requestJson = kj::heapArray<char>(metadataSize);
+    size_t n = co_await requestBody.tryRead(requestJson.begin(), metadataSize, metadataSize);
+
+    capnp::MallocMessageBuilder requestMessage;
+    auto request = requestMessage.initRoot<r2::R2BindingRequest>();
+    bool valid = n == metadataSize && kj::runCatchingExceptions([&]() {
+      capnp::JsonCodec json;
+      json.handleByAnnotation<r2::R2BindingRequest>();
+      json.decode(requestJson, request);
+    }) == nullptr;
+    if (!valid) {
+      co_await sendR2Error(response, 400, "Bad Request", ERROR_INTERNAL, "Malformed R2 request.");
+      co_return;
+    }
+
+    auto payload = request.getPayload().asReader();
+    switch (payload.which()) {
+      case r2::R2BindingRequest::Payload::PUT:
+        co_await put(payload.getPut(), requestBody, response);
+        break;
+      case r2::R2BindingRequest::Payload::DELETE:
+        co_await delete_(payload.getDelete(), response);
+        break;
+      case r2::R2BindingRequest::Payload::CREATE_MULTIPART_UPLOAD:
+        co_await createMultipartUpload(payload.getCreateMultipartUpload(), response);
+        break;
+      case r2::R2BindingRequest::Payload::UPLOAD_PART:
+        co_await uploadPart(payload.getUploadPart(), requestBody, response);
+        break;
+      case r2::R2BindingRequest::Payload::COMPLETE_MULTIPART_UPLOAD:
+        co_await completeMultipartUpload(payload.getCompleteMultipartUpload(), response);
+        break;
+      case r2::R2BindingRequest::Payload::ABORT_MULTIPART_UPLOAD:
+        co_await abortMultipartUpload(payload.getAbortMultipartUpload(), response);
+        break;
+      default:
+        co_await sendR2Error(response, 501, "Not Implemented", ERROR_NOT_IMPLEMENTED,
+            "Local R2 buckets don't support this operation.");
+        break;
+    }
+  }
+
+  kj::Promise<void> put(r2::R2PutRequest::Reader request, kj::AsyncInputStream& requestBody,
+                        kj::HttpService::Response& response) {
+    auto key = kj::str(request.getObject());
+    if (!isValidKey(key)) {
+      co_await sendR2Error(response, 400, "Bad Request", ERROR_INVALID_OBJECT_NAME,
+          "The specified object name is not valid.");
+      co_return;
+    }
+
+    // Stream the content into a file of its own, which nothing refers to until the metadata is
+    // replaced below. If we don't get that far, the file is removed.
+    auto version = newVersion();
+    auto contentPath = contentPathFor(version);
+    auto file = directory->openFile(contentPath, kj::WriteMode::CREATE);
+    bool published = false;
+    KJ_DEFER(if (!published) directory->tryRemove(contentPath));
+
+    Digest md5(EVP_md5());
+    struct Expected {
+      kj::Own<Digest> digest;
+      capnp::Data::Reader value;
+    };
+    kj::Vector<Expected> expected;
+    if (request.hasSha1()) {
+      expected.add(Expected { kj::heap<Digest>(EVP_sha1()), request.getSha1() });
+    }
+    if (request.hasSha256()) {
+      expected.add(Expected { kj::heap<Digest>(EVP_sha256()), request.getSha256() });
+    }
+    if (request.hasSha384()) {
+      expected.add(Expected { kj::heap<Digest>(EVP_sha384()), request.getSha384() });
+    }
+    if (request.hasSha512()) {
+      expected.add(Expected { kj::heap<Digest>(EVP_sha512()), request.getSha512() });
+    }
+
+    kj::Vector<Digest*> digests;
+    digests.add(&md5);
+    for (auto& e: expected) digests.add(e.digest.get());
+    uint64_t size = co_await receiveContent(requestBody, *file, digests.releaseAsArray());
+
+    auto md5Hash = md5.finish();
+    bool digestsMatch = !request.hasMd5() || request.getMd5() == md5Hash.asPtr().asConst();
+    for (auto& e: expected) {
+      if (e.digest->finish().asPtr().asConst() != e.value) digestsMatch = false;
+    }
+    if (!digestsMatch) {
+      co_await sendR2Error(response, 400, "Bad Request", ERROR_BAD_DIGEST,
+          "The provided checksum doesn't match the object's content.");
+      co_return;
+    }
+
+    // Conditions are checked against whatever version is current now that the content is in.
+    auto existing = find(key);
+    if (request.hasOnlyIf() && !conditionsPass(request.getOnlyIf(), existing)) {
+      co_await sendR2Error(response, 412, "Precondition Failed", ERROR_PRECONDITION_FAILED,
+          "The operation was not performed because a precondition failed.");
+      co_return;
+    }
+
+    auto message = kj::heap<capnp::MallocMessageBuilder>();
+    auto object = message->initRoot<r2::R2HeadResponse>();
+    object.setName(key);
+    object.setVersion(version);
+    object.setSize(size);
+    object.setEtag(kj::encodeHex(md5Hash));
+    object.setUploadedMillisecondsSinceEpoch((clock.now() - kj::UNIX_EPOCH) / kj::MILLISECONDS);
+    if (request.hasHttpFields()) object.setHttpFields(request.getHttpFields());
+    if (request.hasCustomFields()) object.setCustomFields(request.getCustomFields());
+    auto checksums = object.initChecksums();
+    checksums.setMd5(md5Hash);
+    if (request.hasSha1()) checksums.setSha1(request.getSha1());
+    if (request.hasSha256()) checksums.setSha256(request.getSha256());
+    if (request.hasSha384()) checksums.setSha384(request.getSha384());
+    if (request.hasSha512()) checksums.setSha512(request.getSha512());
+
+    auto body = publish(kj::mv(key), kj::mv(message));
+    published = true;
+    co_await sendWriteResult(response, kj::mv(body));
+  }
+
+  static kj::Promise<uint64_t> receiveContent(kj::AsyncInputStream& body, const kj::File& file,
+                                              kj::Array<Digest*> digests) {
+    // Streams `body` into `file`, feeding it to each of `digests`, and returns its size.
+    auto buffer = kj::heapArray<kj::byte>(IO_CHUNK_SIZE);
+    uint64_t size = 0;
+    for (;;) {
+      size_t n = co_await body.tryRead(buffer.begin(), 1, buffer.size());
+      if (n == 0) break;
+      auto chunk = buffer.slice(0, n).asConst();
+      file.write(size, chunk);
+      for (auto digest: digests) digest->update(chunk);
+      size += n;
+    }
+    co_return size;
+  }
+
+  kj::String publish(kj::String key, kj::Own<capnp::MallocMessageBuilder> message) {
+    // Makes `message`, the R2HeadResponse of a version whose content is already written, the
+    // current version of `key` by atomically replacing its metadata file, then removes the
+    // content of the version it replaced. Returns the metadata encoded for the response.
+    auto oldVersion = find(key).map([](r2::R2HeadResponse::Reader o) {
+      return kj::str(o.getVersion());
+    });
+
+    auto replacer = directory->replaceFile(metadataPathFor(key),
+        kj::WriteMode::CREATE | kj::WriteMode::MODIFY);
+    replacer->get().writeAll(capnp::messageToFlatArray(*message).asBytes());
+    replacer->commit();
+
+    KJ_IF_MAYBE(v, oldVersion) {
+      directory->tryRemove(contentPathFor(*v));
+    }
+
+    auto body = encode(message->getRoot<r2::R2HeadResponse>().asReader());
+    index.upsert(kj::mv(key), kj::mv(message),
+        [](kj::Own<capnp::MallocMessageBuilder>& slot,
+           kj::Own<capnp::MallocMessageBuilder>&& replacement) {
+      slot = kj::mv(replacement);
+    });
+    return body;
+  }
+
+  // ---------------------------------------------------------------------------
+  // Multipart uploads
+  //
+  // Each uploaded part is a file of its own until the upload is completed, when the parts are
+  // copied into the content file of a new version, which is then published like a put. As in
+  // R2, the ETag of the result is the MD5 of the parts' MD5s followed by the number of parts.
+  // Uploads in progress are only kept in memory.
+
+  kj::Promise<void> createMultipartUpload(r2::R2CreateMultipartUploadRequest::Reader request,
+                                          kj::HttpService::Response& response) {
+    if (!isValidKey(request.getObject())) {
+      return sendR2Error(response, 400, "Bad Request", ERROR_INVALID_OBJECT_NAME,
+          "The specified object name is not valid.");
+    }
+
+    auto fields = kj::heap<capnp::MallocMessageBuilder>();
+    auto object = fields->initRoot<r2::R2HeadResponse>();
+    if (request.hasHttpFields()) object.setHttpFields(request.getHttpFields());
+    if (request.hasCustomFields()) object.setCustomFields(request.getCustomFields());
+
+    auto uploadId = newVersion();
+    uploads.insert(kj::str(uploadId),
+        Upload { kj::str(request.getObject()), kj::mv(fields), {} });
+
+    capnp::MallocMessageBuilder responseMessage;
+    auto result = responseMessage.initRoot<r2::R2CreateMultipartUploadResponse>();
+    result.setUploadId(uploadId);
+    return sendWriteResult(response, encode(result.asReader()));
+  }
+
+  kj::Promise<void> uploadPart(r2::R2UploadPartRequest::Reader request,
+                               kj::AsyncInputStream& requestBody,
+                               kj::HttpService::Response& response) {
+    auto uploadId = kj::str(request.getUploadId());
+    auto key = kj::str(request.getObject());
+    uint partNumber = request.getPartNumber();
+    if (findUpload(uploadId, key) == nullptr) {
+      co_await sendNoSuchUpload(response);
+      co_return;
+    }
+    if (partNumber < 1 || partNumber > MAX_PART_NUMBER) {
+      co_await sendR2Error(response, 400, "Bad Request", ERROR_INVALID_PART,
+          kj::str("Part number must be between 1 and ", MAX_PART_NUMBER, "."));
+      co_return;
+    }
+
+    auto path = kj::Path(kj::str(newVersion(), ".part"));
+    auto file = directory->openFile(path, kj::WriteMode::CREATE);
+    bool kept = false;
+    KJ_DEFER(if (!kept) directory->tryRemove(path));
+
+    Digest md5(EVP_md5());
+    uint64_t size = co_await receiveContent(requestBody, *file, kj::arr(&md5));
+
+    // The upload may have been completed or aborted while the part was arriving.
+    KJ_IF_MAYBE(upload, findUpload(uploadId, key)) {
+      auto md5Hash = md5.finish();
+      auto etag = kj::encodeHex(md5Hash);
+      kept = true;
+      upload->parts.upsert(partNumber, Part { kj::mv(path), size, kj::mv(md5Hash), kj::str(etag) },
+          [this](Part& slot, Part&& replacement) {
+        directory->tryRemove(slot.file);
+        slot = kj::mv(replacement);
+      });
+
+      capnp::MallocMessageBuilder responseMessage;
+      auto result = responseMessage.initRoot<r2::R2UploadPartResponse>();
+      result.setEtag(etag);
+      co_await sendWriteResult(response, encode(result.asReader()));
+    } else {
+      co_await sendNoSuchUpload(response);
+    }
+  }
+
+  kj::Promise<void> completeMultipartUpload(
+      r2::R2CompleteMultipartUploadRequest::Reader request,
+      kj::HttpService::Response& response) {
+    auto& upload = KJ_UNWRAP_OR(findUpload(request.getUploadId(), request.getObject()), {
+      return sendNoSuchUpload(response);
+    });
+
+    auto requested = request.getParts();
+    if (requested.size() == 0) {
+      return sendR2Error(response, 400, "Bad Request", ERROR_INVALID_PART,
+          "A multipart upload must be completed with at least one part.");
+    }
+    uint previous = 0;
+    for (auto p: requested) {
+      if (p.getPart() <= previous) {
+        return sendR2Error(response, 400, "Bad Request", ERROR_INVALID_PART,
+            "Parts must be listed in ascending order of part number.");
+      }
+      previous = p.getPart();
+      KJ_IF_MAYBE(part, upload.parts.find(p.getPart())) {
+        if (part->etag == p.getEtag()) continue;
+      }
+      return sendR2Error(response, 400, "Bad Request", ERROR_INVALID_PART,
+          "One or more of the specified parts could not be found.");
+    }
+
+    auto version = newVersion();
+    auto contentPath = contentPathFor(version);
+    auto file = directory->openFile(contentPath, kj::WriteMode::CREATE);
+    bool published = false;
+    KJ_DEFER(if (!published) directory->tryRemove(contentPath));
+
+    Digest etagDigest(EVP_md5());
+    uint64_t size = 0;
+    for (auto p: requested) {
+      auto& part = KJ_ASSERT_NONNULL(upload.parts.find(p.getPart()));
+      size_t n = file->copy(size, *directory->openFile(part.file), 0, part.size);
+      KJ_REQUIRE(n == part.size, "R2 multipart upload part is truncated");
+      etagDigest.update(part.md5);
+      size += part.size;
+    }
+
+    auto message = kj::heap<capnp::MallocMessageBuilder>();
+    message->setRoot(upload.fields->getRoot<r2::R2HeadResponse>().asReader());
+    auto object = message->getRoot<r2::R2HeadResponse>();
+    object.setName(upload.key);
+    object.setVersion(version);
+    object.setSize(size);
+    object.setEtag(kj::str(kj::encodeHex(etagDigest.finish()), '-', requested.size()));
+    object.setUploadedMillisecondsSinceEpoch((clock.now() - kj::UNIX_EPOCH) / kj::MILLISECONDS);
+
+    auto body = publish(kj::str(upload.key), kj::mv(message));
+    published = true;
+    removeUpload(request.getUploadId());
+
+    return sendWriteResult(response, kj::mv(body));
+  }
+
+  kj::Promise<void> abortMultipartUpload(r2::R2AbortMultipartUploadRequest::Reader request,
+                                         kj::HttpService::Response& response) {
+    // Aborting an upload that doesn't exist, perhaps because it was already aborted, succeeds.
+    if (findUpload(request.getUploadId(), request.getObject()) != nullptr) {
+      removeUpload(request.getUploadId());
+    }
+    return sendWriteResult(response, kj::str("{}"));
+  }
+
+  void removeUpload(kj::StringPtr uploadId) {
+    auto& upload = KJ_ASSERT_NONNULL(uploads.find(uploadId));
+    for (auto& part: upload.parts) {
+      directory->tryRemove(part.value.file);
+    }
+    uploads.erase(uploadId);
+  }
+
+  kj::Promise<void> delete_(r2::R2DeleteRequest::Reader request,
+                            kj::HttpService::Response& response) {
+    switch (request.which()) {
+      case r2::R2DeleteRequest::OBJECT:
+        remove(request.getObject());
+        break;
+      case r2::R2DeleteRequest::OBJECTS:
+        for (auto key: request.getObjects()) {
+          remove(key);
+        }
+        break;
+    }
+    return sendWriteResult(response, kj::str("{}"));
+  }
+
+  void remove(kj::StringPtr key) {
+    KJ_IF_MAYBE(object, find(key)) {
+      auto version = kj::str(object->getVersion());
+      directory->tryRemove(metadataPathFor(key));
+      directory->tryRemove(contentPathFor(version));
+      index.erase(key);
+    }
+  }
+};
+
+}  // namespace
+
+kj::Own<kj::HttpService> newLocalR2Bucket(
+    kj::Own<const kj::Directory> directory, const kj::Clock& clock,
+    kj::HttpHeaderTable::Builder& headerTableBuilder) {
+  return kj::heap<LocalR2Bucket>(kj::mv(directory), clock, headerTableBuilder);
+}
+
+}  // namespace workerd::server
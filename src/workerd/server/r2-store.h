@@ -0,0 +1,34 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#pragma once
+
+#include <kj/compat/http.h>
+#include <kj/filesystem.h>
+#include <kj/time.h>
+
+namespace workerd::server {
+
+kj::Own<kj::HttpService> newLocalR2Bucket(
+    kj::Own<const kj::Directory> directory, const kj::Clock& clock,
+    kj::HttpHeaderTable::Builder& headerTableBuilder);
+// Creates an implementation of the protocol that `r2Bucket` bindings speak to their service (see
+// `r2-rpc.c++` and `r2-api.capnp`), storing the bucket in `directory`. `head`, `get`, `put`,
+// `list`, `delete` and multipart uploads are supported; bucket administration is answered with a
+// "not implemented" error.
+//
+// Each object's content is one file, named by the object's version, and its metadata is a
+// sidecar file named by the hex SHA-256 of the key. The metadata is read into memory when the
+// bucket is created, so `head()` and `list()` never touch the disk. `get()` writes the requested
+// range straight from the file into the response, and `put()` streams the body to a new file,
+// hashing it as it goes, then atomically replaces the metadata to publish it. A reader that
+// started before a put or delete keeps reading the content it started with. Multipart uploads
+// store each part in a file of its own and copy them into the object's content file when the
+// upload completes. Uploads in progress are forgotten, and their parts removed, when the bucket
+// is next created.
+//
+// `clock` supplies upload times. The directory must not be modified by anything else while the
+// bucket exists.
+
+}  // namespace workerd::server
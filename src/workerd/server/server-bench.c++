@@ -0,0 +1,326 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+// End-to-end HTTP benchmark for `Server`. Each scenario starts a Server from a config, then drives
+// it with in-process clients connected through a pipe standing in for the listening socket, so
+// every request goes through HttpListener, WorkerService, IoContext, and the JavaScript handler,
+// with no real network involved.
+//
+// Run with `bazel run -c opt //src/workerd/server:server-bench -- [options] [scenarios]`.
+
+#include "server.h"
+#include <workerd/jsg/setup.h>
+#include <capnp/message.h>
+#include <capnp/serialize-text.h>
+#include <kj/async-io.h>
+#include <kj/compat/http.h>
+#include <kj/main.h>
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+#include <unistd.h>
+
+namespace {
+
+std::atomic<uint64_t> allocationCount(0);
+// Counts calls to the global operator new below. Memory that V8 allocates for the JavaScript heap
+// does not go through operator new, so this measures allocations made by workerd and KJ.
+
+}  // namespace
+
+void* operator new(size_t size) {
+  allocationCount.fetch_add(1, std::memory_order_relaxed);
+  void* result = malloc(size == 0 ? 1 : size);
+  if (result == nullptr) throw std::bad_alloc();
+  return result;
+}
+void operator delete(void* ptr) noexcept { free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { free(ptr); }
+
+namespace workerd::server {
+namespace {
+
+struct Scenario {
+  kj::StringPtr name;
+  kj::StringPtr path;
+  kj::StringPtr config;
+  // The config must define a socket named "main", which the benchmark connects to.
+};
+
+const Scenario SCENARIOS[] = {
+  { "hello"_kj, "/"_kj, R"((
+    services = [
+      ( name = "main",
+        worker = (
+          compatibilityDate = "2022-08-17",
+          modules = [
+            ( name = "main.js",
+              esModule =
+                `export default {
+                `  fetch(request) {
+                `    return new Response("Hello World\n");
+                `  }
+                `}
+            )
+          ]
+        )
+      )
+    ],
+    sockets = [ (name = "main", service = "main") ]
+  ))"_kj },
+
+  { "proxy"_kj, "/"_kj, R"((
+    services = [
+      ( name = "main",
+        worker = (
+          compatibilityDate = "2022-08-17",
+          modules = [
+            ( name = "main.js",
+              esModule =
+                `export default {
+                `  async fetch(request, env) {
+                `    let response = await env.backend.fetch(request);
+                `    return new Response(response.body, response);
+                `  }
+                `}
+            )
+          ],
+          bindings = [ (name = "backend", service = "backend") ]
+        )
+      ),
+      ( name = "backend",
+        worker = (
+          compatibilityDate = "2022-08-17",
+          modules = [
+            ( name = "main.js",
+              esModule =
+                `const BODY = "x".repeat(65536);
+                `export default {
+                `  fetch(request) {
+                `    return new Response(BODY);
+                `  }
+                `}
+            )
+          ]
+        )
+      )
+    ],
+    sockets = [ (name = "main", service = "main") ]
+  ))"_kj },
+
+  { "durable-object"_kj, "/"_kj, R"((
+    services = [
+      ( name = "main",
+        worker = (
+          compatibilityDate = "2022-08-17",
+          modules = [
+            ( name = "main.js",
+              esModule =
+                `export default {
+                `  async fetch(request, env) {
+                `    return env.ns.get(env.ns.idFromName("counter")).fetch(request);
+                `  }
+                `}
+                `export class Counter {
+                `  constructor(state, env) {
+                `    this.storage = state.storage;
+                `  }
+                `  async fetch(request) {
+                `    let count = (await this.storage.get("count")) || 0;
+                `    this.storage.put("count", count + 1);
+                `    return new Response(String(count));
+                `  }
+                `}
+            )
+          ],
+          bindings = [ (name = "ns", durableObjectNamespace = "Counter") ],
+          durableObjectNamespaces = [ (className = "Counter", uniqueKey = "bench") ],
+          durableObjectStorage = (inMemory = void)
+        )
+      )
+    ],
+    sockets = [ (name = "main", service = "main") ]
+  ))"_kj },
+
+  { "html-rewriter"_kj, "/"_kj, R"((
+    services = [
+      ( name = "main",
+        worker = (
+          compatibilityDate = "2022-08-17",
+          modules = [
+            ( name = "main.js",
+              esModule =
+                `const PAGE = "<!DOCTYPE html><html><body>" +
+                `    "<p><a href='/page'>link</a></p>".repeat(200) + "</body></html>";
+                `export default {
+                `  fetch(request) {
+                `    let response = new Response(PAGE, {headers: {"Content-Type": "text/html"}});
+                `    return new HTMLRewriter()
+                `        .on("a", { element(e) { e.setAttribute("rel", "nofollow"); } })
+                `        .transform(response);
+                `  }
+                `}
+            )
+          ]
+        )
+      )
+    ],
+    sockets = [ (name = "main", service = "main") ]
+  ))"_kj },
+};
+
+class EntropySourceImpl final: public kj::EntropySource {
+public:
+  void generate(kj::ArrayPtr<kj::byte> buffer) override {
+    // Durable Object IDs are derived from this, but the benchmark doesn't need them to be secret.
+    memset(buffer.begin(), 4, buffer.size());
+  }
+};
+
+class BenchmarkMain {
+public:
+  BenchmarkMain(kj::ProcessContext& context): context(context) {}
+
+  kj::MainFunc getMain() {
+    return kj::MainBuilder(context, "server-bench",
+          "Measures HTTP throughput and latency through workerd's Server.",
+          "Runs each <scenario> in turn and reports requests per second, p50 and p99 latency, "
+          "and heap allocations per request. Scenarios are: hello, proxy, durable-object, "
+          "html-rewriter. All are run if none are given.")
+        .addOptionWithArg({'n', "requests"}, KJ_BIND_METHOD(*this, setRequests), "<count>",
+            "Send <count> requests per scenario, after warming up. Defaults to 10000.")
+        .addOptionWithArg({'c', "concurrency"}, KJ_BIND_METHOD(*this, setConcurrency), "<count>",
+            "Send requests on <count> connections at once. Defaults to 1.")
+        .expectZeroOrMoreArgs("<scenario>", KJ_BIND_METHOD(*this, addScenario))
+        .callAfterParsing(KJ_BIND_METHOD(*this, run))
+        .build();
+  }
+
+private:
+  kj::ProcessContext& context;
+
+  kj::Own<kj::Filesystem> fs = kj::newDiskFilesystem();
+  kj::AsyncIoContext io = kj::setupAsyncIo();
+  EntropySourceImpl entropySource;
+  kj::HttpHeaderTable headerTable;
+
+  uint requests = 10000;
+  uint concurrency = 1;
+  kj::Vector<const Scenario*> scenarios;
+
+  static constexpr uint WARMUP_REQUESTS = 1000;
+
+  kj::MainBuilder::Validity setRequests(kj::StringPtr param) {
+    requests = KJ_UNWRAP_OR(param.tryParseAs<uint>(), return "expected a number");
+    if (requests == 0) return "must be at least 1";
+    return true;
+  }
+
+  kj::MainBuilder::Validity setConcurrency(kj::StringPtr param) {
+    concurrency = KJ_UNWRAP_OR(param.tryParseAs<uint>(), return "expected a number");
+    if (concurrency == 0) return "must be at least 1";
+    return true;
+  }
+
+  kj::MainBuilder::Validity addScenario(kj::StringPtr name) {
+    for (auto& scenario: SCENARIOS) {
+      if (scenario.name == name) {
+        scenarios.add(&scenario);
+        return true;
+      }
+    }
+    return "no such scenario";
+  }
+
+  kj::MainBuilder::Validity run() {
+    if (scenarios.empty()) {
+      for (auto& scenario: SCENARIOS) {
+        scenarios.add(&scenario);
+      }
+    }
+
+    jsg::V8System v8System;
+    for (auto scenario: scenarios) {
+      runScenario(v8System, *scenario);
+    }
+    return true;
+  }
+
+  void runScenario(jsg::V8System& v8System, const Scenario& scenario) {
+    capnp::MallocMessageBuilder configMessage;
+    auto config = configMessage.initRoot<config::Config>();
+    capnp::TextCodec().decode(scenario.config, config);
+
+    // The socket is replaced by a pipe, so that connecting to it doesn't touch the network.
+    auto pipe = kj::newCapabilityPipe();
+    kj::CapabilityStreamNetworkAddress address(nullptr, *pipe.ends[1]);
+
+    Server server(*fs, io.provider->getTimer(), io.provider->getNetwork(), entropySource,
+        [&](kj::String error) {
+      context.exitError(kj::str(scenario.name, ": ", error));
+    });
+    server.overrideSocket(kj::str("main"),
+        kj::heap<kj::CapabilityStreamConnectionReceiver>(*pipe.ends[0]));
+
+    auto serverTask = server.run(v8System, config.asReader())
+        .eagerlyEvaluate([&](kj::Exception&& e) {
+      context.exitError(kj::str(scenario.name, ": ", e));
+    });
+
+    drive(address, scenario.path, WARMUP_REQUESTS);
+
+    auto allocationsBefore = allocationCount.load(std::memory_order_relaxed);
+    auto start = kj::systemPreciseMonotonicClock().now();
+    auto latencies = drive(address, scenario.path, requests);
+    auto elapsed = kj::systemPreciseMonotonicClock().now() - start;
+    auto allocations = allocationCount.load(std::memory_order_relaxed) - allocationsBefore;
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](uint p) {
+      return latencies[kj::min(latencies.size() * p / 100, latencies.size() - 1)];
+    };
+
+    auto report = kj::str(scenario.name, ": ",
+        uint64_t(double(requests) / (elapsed / kj::NANOSECONDS) * 1e9), " requests/s, "
+        "p50 ", percentile(50), ", p99 ", percentile(99), ", ",
+        double(allocations) / requests, " allocations/request\n");
+    kj::FdOutputStream(STDOUT_FILENO).write(report.begin(), report.size());
+  }
+
+  kj::Array<kj::Duration> drive(kj::NetworkAddress& address, kj::StringPtr path, uint count) {
+    // Sends `count` requests spread over `concurrency` connections and returns their latencies.
+
+    kj::Vector<kj::Duration> latencies(count);
+    uint remaining = count;
+    auto clients = KJ_MAP(i, kj::zeroTo(kj::min(concurrency, count))) {
+      return runClient(address, path, remaining, latencies);
+    };
+    kj::joinPromises(kj::mv(clients)).wait(io.waitScope);
+    return latencies.releaseAsArray();
+  }
+
+  kj::Promise<void> runClient(kj::NetworkAddress& address, kj::StringPtr path, uint& remaining,
+                              kj::Vector<kj::Duration>& latencies) {
+    auto stream = co_await address.connect();
+    auto client = kj::newHttpClient(headerTable, *stream);
+    kj::HttpHeaders headers(headerTable);
+    headers.set(kj::HttpHeaderId::HOST, "bench");
+
+    auto& clock = kj::systemPreciseMonotonicClock();
+    while (remaining > 0) {
+      --remaining;
+      auto start = clock.now();
+      auto response = co_await client->request(kj::HttpMethod::GET, path, headers).response;
+      auto body = co_await response.body->readAllText();
+      KJ_REQUIRE(response.statusCode == 200, "request failed", response.statusCode, body);
+      latencies.add(clock.now() - start);
+    }
+  }
+};
+
+}  // namespace
+}  // namespace workerd::server
+
+KJ_MAIN(workerd::server::BenchmarkMain);
@@ -3,11 +3,17 @@
 //     https://opensource.org/licenses/Apache-2.0
 
 #include "server.h"
+#include "actor-placement.h"
+#include "metrics.h"
+#include "workerd-api.h"
 #include <kj/test.h>
 #include <workerd/util/capnp-mock.h>
 #include <capnp/serialize-text.h>
 #include <workerd/jsg/setup.h>
 #include <kj/async-queue.h>
+#include <kj/encoding.h>
+#include <kj/thread.h>
+#include <string.h>
 
 namespace workerd::server {
 namespace {
@@ -119,6 +125,57 @@ public:
     recvHttp200(expectedResponse, loc);
   }
 
+  void sendWebSocketFrame(kj::byte opcode, kj::StringPtr payload, kj::SourceLocation loc = {}) {
+    // Sends a single, final WebSocket frame. A client's frames must be masked; the mask used here
+    // is all zeros, so the payload goes out unchanged.
+    KJ_ASSERT_AT(payload.size() < 126, loc, "payload too long for this helper");
+    kj::Vector<kj::byte> frame;
+    frame.add(0x80 | opcode);
+    frame.add(0x80 | payload.size());
+    for (uint i = 0; i < 4; i++) frame.add(0);
+    frame.addAll(payload.asBytes());
+    stream->write(frame.begin(), frame.size()).wait(ws);
+  }
+
+  void recvWebSocketText(kj::StringPtr expected, kj::SourceLocation loc = {}) {
+    // Expects a single, final, unmasked text frame, as a server sends. (`expected` must not be 13
+    // bytes long, since received `\r`s are stripped.)
+    char header[3] = { '\x81', char(expected.size()), '\0' };
+    recv(kj::str(kj::StringPtr(header, 2), expected), loc);
+  }
+
+  kj::String recvAll() {
+    // Receives whatever has arrived so far, for responses that a test only checks parts of.
+    return readAllAvailable();
+  }
+
+  kj::String recvUntil(kj::StringPtr terminator) {
+    // Receives until the data ends with `terminator`, waiting for it as long as it takes, for
+    // responses produced off the event loop's thread. `\r`s are stripped, as by recv().
+    kj::Vector<char> buffer;
+    char chunk[4096];
+    while (!kj::StringPtr(buffer.begin(), buffer.size()).endsWith(terminator)) {
+      size_t n = stream->tryRead(chunk, 1, sizeof(chunk)).wait(ws);
+      KJ_ASSERT(n > 0, "stream ended before terminator", terminator);
+      for (char c: kj::arrayPtr(chunk, n)) {
+        if (c != '\r') buffer.add(c);
+      }
+    }
+    buffer.add('\0');
+    return kj::String(buffer.releaseAsArray());
+  }
+
+  kj::String recvHeaders(kj::SourceLocation loc = {}) {
+    // Receives a response whose body isn't text, returning only its headers.
+    auto actual = readAllAvailable();
+    const char* end = strstr(actual.cStr(), "\n\n");
+    if (end == nullptr) {
+      KJ_FAIL_EXPECT_AT(loc, "headers never received", actual);
+      return nullptr;
+    }
+    return kj::str(actual.slice(0, end - actual.begin() + 1));
+  }
+
 private:
   kj::WaitScope& ws;
   kj::Own<kj::AsyncIoStream> stream;
@@ -161,7 +218,8 @@ private:
 class TestServer final: private kj::Filesystem, private kj::EntropySource, private kj::Clock {
 public:
   TestServer(kj::StringPtr configText, kj::SourceLocation loc = {})
-      : ws(loop),
+      : io(kj::setupAsyncIo()),
+        ws(io.waitScope),
         config(parseConfig(configText, loc)),
         root(kj::newInMemoryDirectory(*this)),
         pwd(kj::Path({"current", "dir"})),
@@ -244,8 +302,9 @@ public:
     return receiveSubrequest(addr, {"public"_kj}, {}, loc);
   }
 
-  kj::EventLoop loop;
-  kj::WaitScope ws;
+  kj::AsyncIoContext io;
+  // Network access goes through the mock network, but threads talk over real socket pairs.
+  kj::WaitScope& ws;
 
   kj::Own<config::Config::Reader> config;
   kj::Own<const kj::Directory> root;
@@ -787,6 +846,96 @@ KJ_TEST("Server: WebCrypto bindings") {
       "ec extractable? false, true");
 }
 
+kj::String htmlRewriterWorker(kj::StringPtr compatibilityFlags) {
+  return singleWorker(kj::str(R"((
+    compatibilityDate = "2022-08-17",
+    compatibilityFlags = [)", compatibilityFlags, R"(],
+    modules = [
+      ( name = "main.js",
+        esModule =
+          `const HTML = '<p class="a">hello <b>world</b></p><div>gone</div>';
+          `function inPieces(parts) {
+          `  return new Response(new ReadableStream({
+          `    start(controller) {
+          `      for (let part of parts) controller.enqueue(new TextEncoder().encode(part));
+          `      controller.close();
+          `    }
+          `  }));
+          `}
+          `class Handler {
+          `  before = "<bad>";
+          `  remove = true;
+          `  element(element) { element.setAttribute("seen", "yes"); }
+          `}
+          `export default {
+          `  async fetch(request) {
+          `    let path = new URL(request.url).pathname;
+          `    let rewriter = new HTMLRewriter();
+          `    let input = new Response(HTML);
+          `    let texts = [];
+          `    if (path == "/rules") {
+          `      rewriter
+          `        .on("p", {}, { rules: { setAttribute: { id: "x" }, removeAttribute: ["class"],
+          `                                before: "<hr>", append: "<i>!</i>", html: true } })
+          `        .on("b", {}, { rules: { before: "<&>" } })
+          `        .on("div", {}, { rules: { remove: true } });
+          `    } else if (path == "/class") {
+          `      rewriter.on("p", new Handler());
+          `    } else if (path == "/text") {
+          `      rewriter.on("p", { text(text) { texts.push(text.text); } },
+          `                  { textChunkLimit: 64 });
+          `      input = inPieces(["<p>he", "llo wo", "rld</p>"]);
+          `    } else if (path == "/replace") {
+          `      rewriter.on("p", { text(text) { text.replace("bye"); } }, { textChunkLimit: 64 });
+          `      input = inPieces(["<p>he", "llo wo", "rld</p>"]);
+          `    } else if (path == "/bad-limit") {
+          `      try {
+          `        rewriter.on("p", {}, { textChunkLimit: 0 });
+          `      } catch (e) {
+          `        return new Response(e.name + ": " + e.message);
+          `      }
+          `    }
+          `    let output = await rewriter.transform(input).text();
+          `    return new Response(texts.map(t => "[" + t + "]").join("") + output);
+          `  }
+          `}
+      )
+    ]
+  ))"));
+}
+
+KJ_TEST("Server: HTMLRewriter options") {
+  TestServer test(htmlRewriterWorker(R"("html_rewriter_options")"));
+  test.server.allowExperimental();
+  test.start();
+  auto conn = test.connect("test-addr");
+
+  // Rules are applied without a JavaScript handler. Content is escaped unless `html` is set.
+  conn.httpGet200("/rules", R"(<hr><p id="x">hello &lt;&amp;&gt;<b>world</b><i>!</i></p>)");
+
+  // Properties of a handler aren't mistaken for rules.
+  conn.httpGet200("/class",
+      R"(<p class="a" seen="yes">hello <b>world</b></p><div>gone</div>)");
+
+  // The text handler sees the whole text node at once, and changes apply to all of it.
+  conn.httpGet200("/text", R"([hello world]<p>hello world</p>)");
+  conn.httpGet200("/replace", R"(<p>bye</p>)");
+
+  conn.httpGet200("/bad-limit",
+      "RangeError: textChunkLimit must be between 1 and 1048576 bytes.");
+}
+
+KJ_TEST("Server: HTMLRewriter options need a compatibility flag") {
+  TestServer test(htmlRewriterWorker(""));
+  test.start();
+  auto conn = test.connect("test-addr");
+
+  // Without the flag, the options are ignored, as any extra argument was before.
+  conn.httpGet200("/rules", R"(<p class="a">hello <b>world</b></p><div>gone</div>)");
+  conn.httpGet200("/class",
+      R"(<p class="a" seen="yes">hello <b>world</b></p><div>gone</div>)");
+}
+
 KJ_TEST("Server: subrequest to default outbound") {
   TestServer test(singleWorker(R"((
     compatibilityDate = "2022-08-17",
@@ -931,6 +1080,78 @@ KJ_TEST("Server: override globalOutbound") {
   conn.recvHttp200("OK");
 }
 
+kj::String socketWorker(kj::StringPtr extraConfig) {
+  // A Worker that connects to "subhost:1234", writes "ping", and responds with the first chunk
+  // it reads back.
+  return kj::str(R"((
+    services = [
+      ( name = "hello",
+        worker = (
+          compatibilityDate = "2022-08-17",
+          compatibilityFlags = ["tcp_sockets_support"],)"_kj, extraConfig, R"(
+          modules = [
+            ( name = "main.js",
+              esModule =
+                `export default {
+                `  async fetch(request) {
+                `    let socket = connect("subhost:1234", {noDelay: false, keepAlive: true});
+                `    let writer = socket.writable.getWriter();
+                `    await writer.write(new TextEncoder().encode("ping"));
+                `    let {value} = await socket.readable.getReader().read();
+                `    return new Response(new TextDecoder().decode(value));
+                `  }
+                `}
+            )
+          ]
+        )
+      ),
+      ( name = "proxy", external = "proxy-host" ),
+    ],
+    sockets = [
+      ( name = "main",
+        address = "test-addr",
+        service = "hello"
+      )
+    ]
+  ))"_kj);
+}
+
+KJ_TEST("Server: connect() goes straight to the network") {
+  TestServer test(socketWorker(""));
+  test.server.allowExperimental();
+
+  test.start();
+  auto conn = test.connect("test-addr");
+  conn.sendHttpGet("/");
+
+  // The network service opens the connection itself, so there's no CONNECT request on the wire.
+  auto subreq = test.receiveInternetSubrequest("subhost:1234");
+  subreq.recv("ping");
+  subreq.send("pong");
+
+  conn.recvHttp200("pong");
+}
+
+KJ_TEST("Server: connect() doesn't pass its socket options on to external servers") {
+  TestServer test(socketWorker(R"(
+          globalOutbound = "proxy",)"));
+  test.server.allowExperimental();
+
+  test.start();
+  auto conn = test.connect("test-addr");
+  conn.sendHttpGet("/");
+
+  auto subreq = test.receiveSubrequest("proxy-host");
+  auto request = subreq.recvUntil("\n\n");
+  KJ_EXPECT(request.startsWith("CONNECT subhost:1234 HTTP/1.1\n"), request);
+  KJ_EXPECT(strstr(request.cStr(), "CF-Socket-Options") == nullptr, request);
+  subreq.send("HTTP/1.1 200 OK\n\n");
+
+  subreq.recv("ping");
+  subreq.send("pong");
+  conn.recvHttp200("pong");
+}
+
 KJ_TEST("Server: capability bindings") {
   TestServer test(R"((
     services = [
@@ -1036,6 +1257,66 @@ KJ_TEST("Server: capability bindings") {
   )"_blockquote);
 }
 
+KJ_TEST("Server: R2 puts can stream in parts to a local bucket") {
+  TestServer test(R"((
+    services = [
+      ( name = "hello",
+        worker = (
+          compatibilityDate = "2022-08-17",
+          modules = [
+            ( name = "main.js",
+              esModule =
+                `export default {
+                `  async fetch(request, env) {
+                `    let mib = "0123456789abcdef".repeat(65536);
+                `    let content = "";
+                `    for (let i = 0; i < 11; i++) {
+                `      content += String.fromCharCode(97 + i) + mib.slice(1);
+                `    }
+                `    let multipart = {partSize: 5 * 1024 * 1024, concurrency: 2};
+                `
+                `    let put = await env.r2.put("big", new Response(content).body,
+                `                               {multipart, customMetadata: {a: "b"}});
+                `    let got = await env.r2.get("big");
+                `    let results = [put.etag.endsWith("-3"), put.size, got.size,
+                `                   await got.text() == content, got.customMetadata.a];
+                `
+                `    // A stream that fails part way aborts the upload.
+                `    let {readable, writable} = new TransformStream();
+                `    let writer = writable.getWriter();
+                `    let failed = env.r2.put("broken", readable, {multipart})
+                `        .then(() => "put succeeded", e => "put failed");
+                `    let sixMib = content.slice(0, 6 * 1024 * 1024);
+                `    await writer.write(new TextEncoder().encode(sixMib));
+                `    writer.abort(new Error("oops"));
+                `    results.push(await failed, await env.r2.head("broken"));
+                `    return new Response(results.join(", "));
+                `  }
+                `}
+            )
+          ],
+          bindings = [
+            ( name = "r2",
+              r2Bucket = "bucket"
+            )
+          ]
+        )
+      ),
+      ( name = "bucket", r2Store = (path = "/r2") ),
+    ],
+    sockets = [
+      ( name = "main",
+        address = "test-addr",
+        service = "hello"
+      )
+    ]
+  ))"_kj);
+
+  test.start();
+  auto conn = test.connect("test-addr");
+  conn.httpGet200("/", "true, 11534336, 11534336, true, b, put failed, ");
+}
+
 KJ_TEST("Server: cyclic bindings") {
   TestServer test(R"((
     services = [
@@ -1180,138 +1461,1488 @@ KJ_TEST("Server: invalid entrypoint") {
           "has no such named entrypoint.\n");
 }
 
-KJ_TEST("Server: Durable Objects") {
-  TestServer test(R"((
-    services = [
-      ( name = "hello",
-        worker = (
-          compatibilityDate = "2022-08-17",
-          modules = [
-            ( name = "main.js",
-              esModule =
-                `export default {
-                `  async fetch(request, env) {
-                `    let id = env.ns.idFromName(request.url)
-                `    let actor = env.ns.get(id)
-                `    return await actor.fetch(request)
-                `  }
-                `}
-                `export class MyActorClass {
-                `  constructor(state, env) {
-                `    this.storage = state.storage;
-                `    this.id = state.id;
-                `  }
-                `  async fetch(request) {
-                `    let count = (await this.storage.get("foo")) || 0;
-                `    this.storage.put("foo", count + 1);
-                `    return new Response(this.id + ": " + request.url + " " + count);
-                `  }
-                `}
-            )
-          ],
-          bindings = [(name = "ns", durableObjectNamespace = "MyActorClass")],
-          durableObjectNamespaces = [
-            ( className = "MyActorClass",
-              uniqueKey = "mykey",
-            )
-          ],
-          durableObjectStorage = (inMemory = void)
-        )
-      ),
-    ],
-    sockets = [
-      ( name = "main",
-        address = "test-addr",
-        service = "hello"
+KJ_TEST("Server: CPU time limit") {
+  TestServer test(singleWorker(R"((
+    compatibilityDate = "2022-08-17",
+    modules = [
+      ( name = "main.js",
+        esModule =
+          `export default {
+          `  async fetch(request) {
+          `    if (request.url.endsWith("/spin")) {
+          `      for (;;) {}
+          `    }
+          `    return new Response("ok");
+          `  }
+          `}
       )
-    ]
-  ))"_kj);
+    ],
+    limits = (cpuMillis = 50)
+  ))"_kj));
 
   test.start();
   auto conn = test.connect("test-addr");
-  conn.httpGet200("/",
-      "59002eb8cf872e541722977a258a12d6a93bbe8192b502e1c0cb250aa91af234: http://foo/ 0");
-  conn.httpGet200("/",
-      "59002eb8cf872e541722977a258a12d6a93bbe8192b502e1c0cb250aa91af234: http://foo/ 1");
-  conn.httpGet200("/",
-      "59002eb8cf872e541722977a258a12d6a93bbe8192b502e1c0cb250aa91af234: http://foo/ 2");
-  conn.httpGet200("/bar",
-      "02b496f65dd35cbac90e3e72dc5a398ee93926ea4a3821e26677082d2e6f9b79: http://foo/bar 0");
-  conn.httpGet200("/bar",
-      "02b496f65dd35cbac90e3e72dc5a398ee93926ea4a3821e26677082d2e6f9b79: http://foo/bar 1");
-  conn.httpGet200("/",
-      "59002eb8cf872e541722977a258a12d6a93bbe8192b502e1c0cb250aa91af234: http://foo/ 3");
-  conn.httpGet200("/bar",
-      "02b496f65dd35cbac90e3e72dc5a398ee93926ea4a3821e26677082d2e6f9b79: http://foo/bar 2");
+  conn.httpGet200("/", "ok");
+
+  {
+    KJ_EXPECT_LOG(ERROR, "Worker exceeded CPU time limit");
+    auto spinConn = test.connect("test-addr");
+    spinConn.sendHttpGet("/spin");
+    spinConn.recv(R"(
+      HTTP/1.1 500 Internal Server Error
+      Content-Length: 21
+
+      Internal Server Error)"_blockquote);
+  }
+
+  // Other requests are unaffected.
+  conn.httpGet200("/", "ok");
 }
 
-KJ_TEST("Server: Ephemeral Objects") {
-  TestServer test(R"((
-    services = [
-      ( name = "hello",
-        worker = (
-          compatibilityDate = "2022-08-17",
-          modules = [
-            ( name = "main.js",
-              esModule =
-                `export default {
-                `  async fetch(request, env) {
-                `    let actor = env.ns.get(request.url)
-                `    return await actor.fetch(request)
-                `  }
-                `}
-                `export class MyActorClass {
-                `  constructor(state, env) {
-                `    if (state.storage) throw new Error("storage shouldn't be present");
-                `    this.id = state.id;
-                `    this.count = 0;
-                `  }
-                `  async fetch(request) {
-                `    return new Response(this.id + ": " + request.url + " " + this.count++);
-                `  }
-                `}
-            )
-          ],
-          bindings = [(name = "ns", durableObjectNamespace = "MyActorClass")],
-          durableObjectNamespaces = [
-            ( className = "MyActorClass",
-              ephemeralLocal = void,
-            )
-          ],
-          durableObjectStorage = (inMemory = void)
-        )
-      ),
-    ],
-    sockets = [
-      ( name = "main",
-        address = "test-addr",
-        service = "hello"
+KJ_TEST("Server: long isolate lock holds are logged and counted") {
+  TestServer test(singleWorker(R"((
+    compatibilityDate = "2022-08-17",
+    modules = [
+      ( name = "main.js",
+        esModule =
+          `function spin() {
+          `  let x = 0;
+          `  for (let i = 0; i < 100000000; i++) x += i;
+          `  return x;
+          `}
+          `export default {
+          `  async fetch(request) {
+          `    if (request.url.endsWith("/spin")) {
+          `      return new Response(spin() > 0 ? "spun" : "?");
+          `    }
+          `    return new Response("ok");
+          `  }
+          `}
       )
-    ]
-  ))"_kj);
+    ],
+    logLockHoldsOverMillis = 1
+  ))"_kj));
+
+  test.server.enableInspector(kj::str("inspector-addr"));
+  test.start();
+  auto conn = test.connect("test-addr");
+  conn.httpGet200("/", "ok");
+
+  {
+    // The sampler interrupts the spinning code, so the warning says where it was.
+    KJ_EXPECT_LOG(WARNING, "at spin (");
+    conn.httpGet200("/spin", "spun");
+  }
+
+  auto inspector = test.connect("inspector-addr");
+  inspector.sendHttpGet("/json/locks");
+  auto response = inspector.recvAll();
+  auto contains = [&](kj::StringPtr text) {
+    return strstr(response.cStr(), text.cStr()) != nullptr;
+  };
+  KJ_EXPECT(contains("\"id\":\"hello\""), response);
+  KJ_EXPECT(contains("\"asyncLocks\":"), response);
+  KJ_EXPECT(!contains("\"asyncLocks\":0,"), response);
+  KJ_EXPECT(contains("\"longHolds\":"), response);
+  KJ_EXPECT(!contains("\"longHolds\":0}"), response);
+}
+
+KJ_TEST("Server: concurrency limit sheds requests until the running one is done") {
+  TestServer test(singleWorker(R"((
+    compatibilityDate = "2022-08-17",
+    modules = [
+      ( name = "main.js",
+        esModule =
+          `export default {
+          `  async fetch(request) {
+          `    let path = new URL(request.url).pathname;
+          `    if (path == "/wait") {
+          `      let resp = await fetch("http://subhost/wait");
+          `      return new Response("waited: " + await resp.text());
+          `    } else if (path == "/proxy") {
+          `      return fetch("http://subhost/proxy");
+          `    }
+          `    return new Response("ok");
+          `  }
+          `}
+      )
+    ],
+    concurrencyLimit = (
+      targetLockWaitMillis = 1000,
+      initialLimit = 1,
+      maxLimit = 1,
+      maxQueued = 0,
+      retryAfterSeconds = 7
+    )
+  ))"_kj));
+
+  test.start();
+
+  auto expectShed = [&](TestStream& conn) {
+    conn.sendHttpGet("/");
+    auto response = conn.recvAll();
+    KJ_EXPECT(response.startsWith("HTTP/1.1 503 Service Unavailable\n"), response);
+    KJ_EXPECT(strstr(response.cStr(), "\nRetry-After: 7\n") != nullptr, response);
+    KJ_EXPECT(response.endsWith("\n\nService Unavailable"), response);
+  };
+
+  {
+    // While one request is running, the next one is turned away.
+    auto conn = test.connect("test-addr");
+    conn.sendHttpGet("/wait");
+    auto subreq = test.receiveInternetSubrequest("subhost");
+    subreq.recv(R"(
+      GET /wait HTTP/1.1
+      Host: subhost
+
+    )"_blockquote);
+
+    auto shed = test.connect("test-addr");
+    expectShed(shed);
+
+    subreq.send(R"(
+      HTTP/1.1 200 OK
+      Content-Length: 4
+
+      done)"_blockquote);
+    conn.recvHttp200("waited: done");
+  }
+
+  {
+    // A response that's only being proxied from a subrequest doesn't use the isolate, so it
+    // doesn't hold on to the Worker's only slot.
+    auto conn = test.connect("test-addr");
+    conn.sendHttpGet("/proxy");
+    auto subreq = test.receiveInternetSubrequest("subhost");
+    subreq.recv(R"(
+      GET /proxy HTTP/1.1
+      Host: subhost
+
+    )"_blockquote);
+    subreq.send(R"(
+      HTTP/1.1 200 OK
+      Content-Length: 10
+
+      hello)"_blockquote);
+    conn.recv(R"(
+      HTTP/1.1 200 OK
+      Content-Length: 10
+
+      hello)"_blockquote);
+
+    auto other = test.connect("test-addr");
+    other.httpGet200("/", "ok");
+
+    subreq.send("world");
+    conn.recv("world");
+  }
+}
+
+KJ_TEST("Server: isolate pool") {
+  TestServer test(singleWorker(R"((
+    compatibilityDate = "2022-08-17",
+    modules = [
+      ( name = "main.js",
+        esModule =
+          `let count = 0;
+          `export default {
+          `  async fetch(request) {
+          `    return new Response("count: " + ++count);
+          `  }
+          `}
+      )
+    ],
+    isolatePoolSize = 3
+  ))"_kj));
+
+  test.start();
+  auto conn = test.connect("test-addr");
+
+  // Requests that don't overlap all go to the home isolate.
+  conn.httpGet200("/", "count: 1");
+  conn.httpGet200("/", "count: 2");
+}
+
+KJ_TEST("Server: isolate pool must not be empty") {
+  TestServer test(singleWorker(R"((
+    compatibilityDate = "2022-08-17",
+    modules = [
+      ( name = "main.js",
+        esModule =
+          `export default {
+          `  async fetch(request) {
+          `    return new Response("ok");
+          `  }
+          `}
+      )
+    ],
+    isolatePoolSize = 0
+  ))"_kj));
+
+  test.expectErrors(R"(
+    service hello: isolatePoolSize must be at least one.
+  )"_blockquote);
+}
+
+KJ_TEST("Server: threads share metrics") {
+  // Like `workerd serve` with `threads = 2`: one Server per thread, each with its own event loop,
+  // reporting to a single registry.
+  kj::StringPtr config = R"((
+    services = [
+      ( name = "hello",
+        worker = (
+          compatibilityDate = "2022-08-17",
+          modules = [
+            ( name = "main.js",
+              esModule =
+                `export default {
+                `  async fetch(request) {
+                `    return new Response("ok");
+                `  }
+                `}
+            )
+          ]
+        )
+      ),
+      (name = "metrics", metrics = void)
+    ],
+    sockets = [
+      (name = "main", address = "test-addr", service = "hello"),
+      (name = "metrics", address = "metrics-addr", service = "metrics")
+    ]
+  ))"_kj;
+
+  auto registry = kj::atomicRefcounted<MetricsRegistry>();
+
+  TestServer test(config);
+  test.server.shareMetrics(kj::atomicAddRef(*registry));
+  test.start();
+  auto conn = test.connect("test-addr");
+  conn.httpGet200("/", "ok");
+
+  kj::String response;
+  kj::String metrics;
+  {
+    // Failures on this thread are rethrown here when it is joined.
+    kj::Thread thread([&]() {
+      TestServer test(config);
+      test.server.shareMetrics(kj::atomicAddRef(*registry));
+      test.start();
+
+      auto conn = test.connect("test-addr");
+      conn.sendHttpGet("/");
+      response = conn.recvAll();
+
+      // A scrape on this thread includes the request served by the other.
+      auto metricsConn = test.connect("metrics-addr");
+      metricsConn.sendHttpGet("/");
+      metrics = metricsConn.recvAll();
+    });
+  }
+
+  KJ_EXPECT(response.endsWith("\n\nok"), response);
+  auto line = "workerd_requests_total{worker=\"hello\"} 2\n"_kj;
+  KJ_EXPECT(strstr(metrics.cStr(), line.cStr()) != nullptr, metrics);
+
+  // The other thread's counts outlive its Server.
+  auto metricsConn = test.connect("metrics-addr");
+  metricsConn.sendHttpGet("/");
+  auto text = metricsConn.recvAll();
+  KJ_EXPECT(strstr(text.cStr(), line.cStr()) != nullptr, text);
+
+  // This thread keeps serving.
+  conn.httpGet200("/", "ok");
+}
+
+KJ_TEST("Server: memory held by Blobs is reported") {
+  TestServer test(R"((
+    services = [
+      ( name = "hello",
+        worker = (
+          compatibilityDate = "2022-08-17",
+          modules = [
+            ( name = "main.js",
+              esModule =
+                `let kept;
+                `export default {
+                `  async fetch(request) {
+                `    kept = new Blob(["x".repeat(5000), "y".repeat(6000)]);
+                `    return new Response("ok");
+                `  }
+                `}
+            )
+          ]
+        )
+      ),
+      ( name = "metrics", metrics = void ),
+    ],
+    sockets = [
+      ( name = "main", address = "test-addr", service = "hello" ),
+      ( name = "metrics", address = "metrics-addr", service = "metrics" ),
+    ]
+  ))"_kj);
+
+  test.start();
+  auto conn = test.connect("test-addr");
+  conn.httpGet200("/", "ok");
+
+  // The Blob owns the strings it was built from.
+  auto metricsConn = test.connect("metrics-addr");
+  metricsConn.sendHttpGet("/");
+  auto text = metricsConn.recvAll();
+  auto line = "workerd_external_memory_bytes{worker=\"hello\",type=\"Blob\"} 11000\n"_kj;
+  KJ_EXPECT(strstr(text.cStr(), line.cStr()) != nullptr, text);
+}
+
+KJ_TEST("Server: Blobs made of several segments can be sliced and streamed") {
+  TestServer test(singleWorker(R"((
+    compatibilityDate = "2022-08-17",
+    modules = [
+      ( name = "main.js",
+        esModule =
+          `export default {
+          `  async fetch(request) {
+          `    let a = "a".repeat(5000), b = "b".repeat(5000), c = "c".repeat(5000);
+          `    let blob = new Blob([a, new Blob([b]), "-", c]);
+          `    let results = [blob.size, await blob.text() == a + b + "-" + c];
+          `
+          `    // Slices that start and end in different segments, and a slice of a slice.
+          `    let middle = a.slice(-10) + b + "-" + c.slice(0, 10);
+          `    let slice = blob.slice(4990, 10011);
+          `    results.push(await slice.text() == middle);
+          `    results.push(await slice.slice(5, -5).text() == middle.slice(5, -5));
+          `    results.push(await blob.slice(-3).text());
+          `    results.push(await blob.slice(10000, 10001).text());
+          `
+          `    // Reading a stream crosses segment boundaries.
+          `    let reader = blob.stream().getReader();
+          `    let streamed = "";
+          `    let decoder = new TextDecoder();
+          `    for (;;) {
+          `      let {done, value} = await reader.read();
+          `      if (done) break;
+          `      streamed += decoder.decode(value, {stream: true});
+          `    }
+          `    results.push(streamed == a + b + "-" + c);
+          `
+          `    if (request.url.endsWith("/stream")) {
+          `      return new Response(blob.slice(4998, 10003).stream());
+          `    }
+          `    return new Response(results.join(", "));
+          `  }
+          `}
+      )
+    ]
+  ))"_kj));
+
+  test.start();
+  auto conn = test.connect("test-addr");
+  conn.httpGet200("/", "15001, true, true, true, ccc, -, true");
+
+  // Pumping a sliced stream to the client writes all of its segments.
+  conn.httpGet200("/stream", kj::str("aa", kj::repeat('b', 5000), "-cc"));
+}
+
+KJ_TEST("Server: Blobs copy small parts and reference large ones") {
+  TestServer test(R"((
+    services = [
+      ( name = "hello",
+        worker = (
+          compatibilityDate = "2022-08-17",
+          modules = [
+            ( name = "main.js",
+              esModule =
+                `let kept;
+                `export default {
+                `  async fetch(request) {
+                `    let big = new Blob(["x".repeat(5000)]);
+                `    let small = new Blob(["y".repeat(100)]);
+                `    kept = [big, small, new Blob([big, small, "z"])];
+                `    let expected = "x".repeat(5000) + "y".repeat(100) + "z";
+                `    return new Response(await kept[2].text() == expected);
+                `  }
+                `}
+            )
+          ]
+        )
+      ),
+      ( name = "metrics", metrics = void ),
+    ],
+    sockets = [
+      ( name = "main", address = "test-addr", service = "hello" ),
+      ( name = "metrics", address = "metrics-addr", service = "metrics" ),
+    ]
+  ))"_kj);
+
+  test.start();
+  auto conn = test.connect("test-addr");
+  conn.httpGet200("/", "true");
+
+  // The last Blob references `big` rather than copying it, but copies `small` and "z" together
+  // into a buffer of its own: 5000 + 100 + 101 bytes in all.
+  auto metricsConn = test.connect("metrics-addr");
+  metricsConn.sendHttpGet("/");
+  auto text = metricsConn.recvAll();
+  auto line = "workerd_external_memory_bytes{worker=\"hello\",type=\"Blob\"} 5201\n"_kj;
+  KJ_EXPECT(strstr(text.cStr(), line.cStr()) != nullptr, text);
+}
+
+KJ_TEST("Server: FormData serializes Blobs made of several segments") {
+  TestServer test(singleWorker(R"((
+    compatibilityDate = "2022-08-17",
+    modules = [
+      ( name = "main.js",
+        esModule =
+          `export default {
+          `  async fetch(request) {
+          `    let a = "a".repeat(5000), b = "b".repeat(5000);
+          `    let form = new FormData();
+          `    form.append("blob", new Blob([a, b]));
+          `    form.append("renamed", new File([b, a], "old.txt"), "new.txt");
+          `    let parsed = await new Response(form).formData();
+          `    let results = [];
+          `    for (let [name, file] of parsed) {
+          `      results.push(name + " " + file.name + " " + file.size + " " +
+          `                   (await file.text() == (name == "blob" ? a + b : b + a)));
+          `    }
+          `    return new Response(results.join(", "));
+          `  }
+          `}
+      )
+    ]
+  ))"_kj));
+
+  test.start();
+  auto conn = test.connect("test-addr");
+  conn.httpGet200("/", "blob blob 10000 true, renamed new.txt 10000 true");
+}
+
+KJ_TEST("Server: threads forward requests to Durable Objects homed elsewhere") {
+  kj::StringPtr config = R"((
+    services = [
+      ( name = "hello",
+        worker = (
+          compatibilityDate = "2022-08-17",
+          modules = [
+            ( name = "main.js",
+              esModule =
+                `export default {
+                `  async fetch(request, env) {
+                `    let params = new URL(request.url).searchParams;
+                `    let id = params.has("name") ? env.ns.idFromName(params.get("name"))
+                `                                : env.ns.idFromString(params.get("id"));
+                `    return await env.ns.get(id).fetch(request);
+                `  }
+                `}
+                `export class MyActorClass {
+                `  constructor(state, env) {
+                `    this.id = state.id;
+                `    this.count = 0;
+                `  }
+                `  async fetch(request) {
+                `    if (request.headers.get("Upgrade") == "websocket") {
+                `      let pair = new WebSocketPair();
+                `      pair[1].accept();
+                `      pair[1].addEventListener("message", event => {
+                `        pair[1].send(this.id + " " + this.count++ + ": " + event.data);
+                `      });
+                `      return new Response(null, { status: 101, webSocket: pair[0] });
+                `    }
+                `    return new Response(this.id + " " + this.count++);
+                `  }
+                `}
+            )
+          ],
+          bindings = [(name = "ns", durableObjectNamespace = "MyActorClass")],
+          durableObjectNamespaces = [
+            ( className = "MyActorClass",
+              uniqueKey = "mykey",
+            )
+          ],
+          durableObjectStorage = (inMemory = void)
+        )
+      ),
+    ],
+    sockets = [
+      ( name = "main",
+        address = "test-addr",
+        service = "hello"
+      )
+    ]
+  ))"_kj;
+
+  auto placement = kj::atomicRefcounted<ActorPlacement>(2);
+
+  // Find a name whose object is homed on the other thread. The name needs escaping in the
+  // header that carries it there.
+  auto factory = newActorIdFactory("mykey");
+  kj::String name;
+  kj::String id;
+  for (uint i = 0;; i++) {
+    name = kj::str("room #", i);
+    id = factory->idFromName(kj::str(name))->toString();
+    if (placement->getHomeThread(id) == 1) break;
+  }
+  auto query = kj::str("name=", kj::encodeUriComponent(name));
+
+  TestServer test(config);
+  test.server.shareActorPlacement(kj::atomicAddRef(*placement), *test.io.lowLevelProvider, 0);
+  test.start();
+
+  kj::MutexGuarded<bool> startThread(false);
+  kj::MutexGuarded<kj::Maybe<kj::Own<kj::CrossThreadPromiseFulfiller<void>>>> stopThread;
+  kj::Thread thread([&]() {
+    startThread.when([](bool start) { return start; }, [](bool) {});
+    TestServer test(config);
+    test.server.shareActorPlacement(kj::atomicAddRef(*placement), *test.io.lowLevelProvider, 1);
+    test.start();
+
+    auto paf = kj::newPromiseAndCrossThreadFulfiller<void>();
+    *stopThread.lockExclusive() = kj::mv(paf.fulfiller);
+    paf.promise.wait(test.ws);
+  });
+  KJ_DEFER({
+    *startThread.lockExclusive() = true;
+    stopThread.when([](const auto& f) { return f != nullptr; }, [](auto& f) {
+      KJ_ASSERT_NONNULL(f)->fulfill();
+    });
+  });
+
+  // Responses are produced on the other thread, so wait for them rather than polling.
+  auto expectResponse = [&](TestStream& conn, kj::StringPtr body) {
+    auto response = conn.recvUntil(body);
+    KJ_EXPECT(response.startsWith("HTTP/1.1 200 OK\n"), response);
+  };
+
+  // By name, and by the string form of the same ID, which carries no name.
+  // The first request is made before the other thread has started serving, so its connection
+  // waits for the thread to register.
+  auto conn = test.connect("test-addr");
+  conn.sendHttpGet(kj::str("/?", query));
+  test.ws.poll();
+  *startThread.lockExclusive() = true;
+  expectResponse(conn, kj::str(id, " 0"));
+  conn.sendHttpGet(kj::str("/?id=", id));
+  expectResponse(conn, kj::str(id, " 1"));
+
+  // A WebSocket to the object is carried across too.
+  auto wsConn = test.connect("test-addr");
+  wsConn.send(kj::str(
+      "GET /?", query, " HTTP/1.1\n"
+      "Host: foo\n"
+      "Upgrade: websocket\n"
+      "Connection: Upgrade\n"
+      "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\n"
+      "Sec-WebSocket-Version: 13\n"
+      "\n"));
+  auto headers = wsConn.recvUntil("\n\n");
+  KJ_EXPECT(headers.startsWith("HTTP/1.1 101 Switching Protocols\n"), headers);
+
+  for (auto i: kj::range(2, 4)) {
+    wsConn.sendWebSocketFrame(0x1, "hi");
+    auto payload = kj::str(id, " ", i, ": hi");
+    char header[3] = { '\x81', char(payload.size()), '\0' };
+    KJ_EXPECT(wsConn.recvUntil(payload) == kj::str(kj::StringPtr(header, 2), payload));
+  }
+
+  // Plain requests still reach the same object while its WebSocket is open.
+  conn.sendHttpGet(kj::str("/?", query));
+  expectResponse(conn, kj::str(id, " 4"));
+}
+
+KJ_TEST("Server: idle-time garbage collection") {
+  TestServer test(R"((
+    services = [
+      ( name = "hello",
+        worker = (
+          compatibilityDate = "2022-08-17",
+          modules = [
+            ( name = "main.js",
+              esModule =
+                `export default {
+                `  async fetch(request, env, ctx) {
+                `    if (request.url.endsWith("/linger")) {
+                `      ctx.waitUntil(new Promise(resolve => setTimeout(resolve, 100)));
+                `    }
+                `    return new Response("ok");
+                `  }
+                `}
+            )
+          ],
+          garbageCollection = (idleMillis = 1, idleBudgetMillis = 5)
+        )
+      ),
+      (name = "metrics", metrics = void)
+    ],
+    sockets = [
+      (name = "main", address = "test-addr", service = "hello"),
+      (name = "metrics", address = "metrics-addr", service = "metrics")
+    ]
+  ))"_kj);
+
+  auto expectIdleGcs = [&](uint count) {
+    auto conn = test.connect("metrics-addr");
+    conn.sendHttpGet("/");
+    auto text = conn.recvAll();
+    auto line = kj::str("workerd_idle_gcs_total{worker=\"hello\"} ", count, "\n");
+    KJ_EXPECT(strstr(text.cStr(), line.cStr()) != nullptr, line, text);
+  };
+
+  test.start();
+  auto conn = test.connect("test-addr");
+  conn.httpGet200("/", "ok");
+  expectIdleGcs(0);
+
+  // Once the isolate has been idle for `idleMillis`, V8 gets its turn.
+  test.timer.advanceTo(test.timer.now() + 1 * kj::MILLISECONDS);
+  test.ws.poll();
+  expectIdleGcs(1);
+
+  // A request is busy until its waitUntil() tasks are done, even after it has responded.
+  conn.httpGet200("/linger", "ok");
+  test.timer.advanceTo(test.timer.now() + 1 * kj::MILLISECONDS);
+  test.ws.poll();
+  expectIdleGcs(1);
+
+  test.timer.advanceTo(test.timer.now() + 1 * kj::SECONDS);
+  test.ws.poll();
+  expectIdleGcs(1);
+  test.timer.advanceTo(test.timer.now() + 1 * kj::MILLISECONDS);
+  test.ws.poll();
+  expectIdleGcs(2);
+}
+
+KJ_TEST("Server: lazy Worker startup") {
+  TestServer test(R"((
+    services = [
+      ( name = "hello",
+        worker = (
+          compatibilityDate = "2022-08-17",
+          modules = [
+            ( name = "main.js",
+              esModule =
+                `export default {
+                `  async fetch(request, env) {
+                `    return new Response("hello from default entrypoint");
+                `  }
+                `}
+                `export let foo = {
+                `  async fetch(request, env) {
+                `    return new Response("hello from foo entrypoint");
+                `  }
+                `}
+            )
+          ]
+        )
+      ),
+      ( name = "broken",
+        worker = (
+          compatibilityDate = "2022-08-17",
+          modules = [
+            ( name = "main.js", esModule = "throw new Error('oops');" )
+          ]
+        )
+      ),
+    ],
+    sockets = [
+      ( name = "main", address = "test-addr", service = "hello" ),
+      ( name = "alt1", address = "foo-addr", service = (name = "hello", entrypoint = "foo")),
+      ( name = "alt2", address = "broken-addr", service = "broken" ),
+    ],
+    workerStartup = (lazy = ())
+  ))"_kj);
+
+  // The broken Worker isn't instantiated, so its error isn't reported at startup.
+  test.start();
+
+  {
+    auto conn = test.connect("foo-addr");
+    conn.httpGet200("/", "hello from foo entrypoint");
+  }
+
+  {
+    auto conn = test.connect("test-addr");
+    conn.httpGet200("/", "hello from default entrypoint");
+  }
+
+  {
+    KJ_EXPECT_LOG(ERROR, "Worker failed to start");
+    auto conn = test.connect("broken-addr");
+    conn.sendHttpGet("/");
+    conn.recv(R"(
+      HTTP/1.1 500 Internal Server Error
+      Content-Length: 21
+
+      Internal Server Error)"_blockquote);
+  }
+}
+
+KJ_TEST("Server: parallel Worker startup") {
+  TestServer test(R"((
+    services = [
+      ( name = "hello",
+        worker = (
+          compatibilityDate = "2022-08-17",
+          modules = [
+            ( name = "main.js",
+              esModule =
+                `export default {
+                `  async fetch(request, env) {
+                `    return env.other.fetch(request);
+                `  }
+                `}
+            )
+          ],
+          bindings = [(name = "other", service = "other")]
+        )
+      ),
+      ( name = "other",
+        worker = (
+          compatibilityDate = "2022-08-17",
+          serviceWorkerScript =
+            `addEventListener("fetch", event => {
+            `  event.respondWith(new Response("hello from other"));
+            `});
+        )
+      ),
+    ],
+    sockets = [
+      ( name = "main", address = "test-addr", service = "hello" ),
+    ],
+    workerStartup = (eagerParallel = 2)
+  ))"_kj);
+
+  test.start();
+  auto conn = test.connect("test-addr");
+  conn.httpGet200("/", "hello from other");
+}
+
+KJ_TEST("Server: reload changed Worker") {
+  auto makeConfig = [](kj::StringPtr message, kj::StringPtr exportName = "foo",
+                       kj::StringPtr socketAddr = "test-addr") {
+    return kj::str(R"((
+      services = [
+        ( name = "hello",
+          worker = (
+            compatibilityDate = "2022-08-17",
+            modules = [
+              ( name = "main.js",
+                esModule =
+                  `export default {
+                  `  async fetch(request, env) {
+                  `    return env.other.fetch(request);
+                  `  }
+                  `}
+              )
+            ],
+            bindings = [(name = "other", service = (name = "other", entrypoint = "foo"))]
+          )
+        ),
+        ( name = "other",
+          worker = (
+            compatibilityDate = "2022-08-17",
+            modules = [
+              ( name = "main.js",
+                esModule =
+                  `export let )", exportName, R"( = {
+                  `  async fetch(request, env) {
+                  `    return new Response(")", message, R"(");
+                  `  }
+                  `}
+              )
+            ]
+          )
+        ),
+      ],
+      sockets = [
+        ( name = "main", address = ")", socketAddr, R"(", service = "hello" ),
+      ]
+    ))");
+  };
+
+  // Declared before the server, which sets them when it lets go of each config.
+  bool v2Released = false;
+  bool v3Released = false;
+
+  TestServer test(makeConfig("v1"));
+  test.start();
+
+  auto conn = test.connect("test-addr");
+  conn.httpGet200("/", "v1");
+
+  // Lets the test see when the server is done with a reloaded config.
+  auto reload = [&](kj::StringPtr text, bool& released) {
+    auto config = parseConfig(text, {});
+    auto& reader = *config;
+    return test.server.reload(reader, kj::mv(config).attach(kj::defer([&released]() {
+      released = true;
+    })));
+  };
+
+  {
+    // A broken config leaves the old Worker in place. Here the entrypoint "hello" uses is gone.
+    bool released = false;
+    auto result = reload(makeConfig("v2", "bar"), released);
+    KJ_EXPECT(result.restartReason == nullptr);
+    KJ_EXPECT(kj::strArray(result.errors, "\n") ==
+        "Worker \"other\" no longer has a named entrypoint \"foo\", but something still refers "
+        "to it.");
+    KJ_EXPECT(released);
+    conn.httpGet200("/", "v1");
+  }
+
+  // The open connection carries on, and its next request goes to the new Worker.
+  auto result = reload(makeConfig("v2"), v2Released);
+  KJ_EXPECT(result.restartReason == nullptr);
+  KJ_EXPECT(result.errors.size() == 0, kj::strArray(result.errors, "\n"));
+  conn.httpGet200("/", "v2");
+  test.connect("test-addr").httpGet200("/", "v2");
+  KJ_EXPECT(!v2Released);
+
+  {
+    // Changing a socket needs a restart.
+    bool released = false;
+    auto result = reload(makeConfig("v2", "foo", "other-addr"), released);
+    KJ_EXPECT(result.restartReason != nullptr);
+    KJ_EXPECT(released);
+    conn.httpGet200("/", "v2");
+  }
+
+  // Once the Worker built from v2 is replaced and has drained, nothing refers to v2 any more.
+  result = reload(makeConfig("v3"), v3Released);
+  KJ_EXPECT(result.errors.size() == 0, kj::strArray(result.errors, "\n"));
+  conn.httpGet200("/", "v3");
+  test.ws.poll();
+  KJ_EXPECT(v2Released);
+  KJ_EXPECT(!v3Released);
+}
+
+KJ_TEST("Server: reload keeps the old Worker until its waitUntil() tasks are done") {
+  auto makeConfig = [](kj::StringPtr message) {
+    return kj::str(R"((
+      services = [
+        ( name = "hello",
+          worker = (
+            compatibilityDate = "2022-08-17",
+            modules = [
+              ( name = "main.js",
+                esModule =
+                  `export default {
+                  `  async fetch(request, env, ctx) {
+                  `    if (request.url.endsWith("/slow")) {
+                  `      ctx.waitUntil(new Promise(resolve => setTimeout(resolve, 100))
+                  `          .then(() => env.out.fetch("http://foo/after")));
+                  `      let response = await env.out.fetch("http://foo/during");
+                  `      return new Response(")", message, R"( " + await response.text());
+                  `    }
+                  `    return new Response(")", message, R"(");
+                  `  }
+                  `}
+              )
+            ],
+            bindings = [(name = "out", service = "out")]
+          )
+        ),
+        ( name = "out", external = "out-host" ),
+      ],
+      sockets = [
+        ( name = "main", address = "test-addr", service = "hello" ),
+      ]
+    ))");
+  };
+
+  TestServer test(makeConfig("v1"));
+  test.start();
+
+  // Start a request that is still running when the config is reloaded.
+  auto slowConn = test.connect("test-addr");
+  slowConn.sendHttpGet("/slow");
+  auto during = test.receiveSubrequest("out-host");
+  during.recv(R"(
+    GET /during HTTP/1.1
+    Host: foo
+
+  )"_blockquote);
+
+  auto config = parseConfig(makeConfig("v2"), {});
+  auto& reader = *config;
+  auto result = test.server.reload(reader, kj::mv(config));
+  KJ_EXPECT(result.errors.size() == 0, kj::strArray(result.errors, "\n"));
+  test.ws.poll();
+
+  // New requests go to the new Worker while the old one finishes its request...
+  auto conn = test.connect("test-addr");
+  conn.httpGet200("/", "v2");
+
+  during.send(R"(
+    HTTP/1.1 200 OK
+    Content-Length: 7
+
+    during
+  )"_blockquote);
+  slowConn.recvHttp200("v1 during\n");
+
+  // ...and the background work that request started after it responded.
+  test.timer.advanceTo(test.timer.now() + 100 * kj::MILLISECONDS);
+  test.ws.poll();
+  auto after = test.receiveSubrequest("out-host");
+  after.recv(R"(
+    GET /after HTTP/1.1
+    Host: foo
+
+  )"_blockquote);
+  after.send(R"(
+    HTTP/1.1 200 OK
+    Content-Length: 0
+
+  )"_blockquote);
+  test.ws.poll();
+
+  conn.httpGet200("/", "v2");
+}
+
+KJ_TEST("Server: requests that are ready together take the isolate lock by priority") {
+  TestServer test(R"((
+    services = [
+      ( name = "hello",
+        worker = (
+          compatibilityDate = "2022-08-17",
+          modules = [
+            ( name = "main.js",
+              esModule =
+                `let log = [];
+                `export default {
+                `  async fetch(request, env, ctx) {
+                `    let path = new URL(request.url).pathname;
+                `    if (path == "/background") {
+                `      ctx.waitUntil(env.out.fetch("http://foo/")
+                `          .then(() => log.push("background")));
+                `    } else if (path == "/log") {
+                `      return new Response(log.join(", "));
+                `    } else {
+                `      log.push("fetch");
+                `    }
+                `    return new Response("ok");
+                `  }
+                `}
+            )
+          ],
+          bindings = [(name = "out", service = "out")]
+        )
+      ),
+      ( name = "out", external = "out-host" ),
+      ( name = "metrics", metrics = void ),
+    ],
+    sockets = [
+      ( name = "main", address = "test-addr", service = "hello" ),
+      ( name = "metrics", address = "metrics-addr", service = "metrics" ),
+    ]
+  ))"_kj);
+
+  test.start();
+
+  // The response has been sent, so the rest of this request is background work.
+  auto background = test.connect("test-addr");
+  background.httpGet200("/background", "ok");
+  auto subrequest = test.receiveSubrequest("out-host");
+  subrequest.recv(R"(
+    GET / HTTP/1.1
+    Host: foo
+
+  )"_blockquote);
+
+  // The background task's subrequest completes, and a new request arrives, before the event loop
+  // runs again. Both then wait on the lock together, and the new request goes first although it
+  // came second.
+  auto conn = test.connect("test-addr");
+  subrequest.send(R"(
+    HTTP/1.1 200 OK
+    Content-Length: 0
+
+  )"_blockquote);
+  conn.sendHttpGet("/");
+  test.ws.poll();
+  conn.recvHttp200("ok");
+  conn.httpGet200("/log", "fetch, background");
+
+  auto metricsConn = test.connect("metrics-addr");
+  metricsConn.sendHttpGet("/");
+  auto text = metricsConn.recvAll();
+  // The time each waited is reported by priority.
+  auto prefix = "workerd_isolate_lock_queue_seconds_count{worker=\"hello\","_kj;
+  for (auto priority: {"fetch"_kj, "wait_until"_kj}) {
+    auto count = kj::str(prefix, "priority=\"", priority, "\"} ");
+    KJ_EXPECT(strstr(text.cStr(), count.cStr()) != nullptr, text);
+    KJ_EXPECT(strstr(text.cStr(), kj::str(count, "0\n").cStr()) == nullptr, text);
+  }
+}
+
+KJ_TEST("Server: Durable Objects") {
+  TestServer test(R"((
+    services = [
+      ( name = "hello",
+        worker = (
+          compatibilityDate = "2022-08-17",
+          modules = [
+            ( name = "main.js",
+              esModule =
+                `export default {
+                `  async fetch(request, env) {
+                `    let id = env.ns.idFromName(request.url)
+                `    let actor = env.ns.get(id)
+                `    return await actor.fetch(request)
+                `  }
+                `}
+                `export class MyActorClass {
+                `  constructor(state, env) {
+                `    this.storage = state.storage;
+                `    this.id = state.id;
+                `  }
+                `  async fetch(request) {
+                `    let count = (await this.storage.get("foo")) || 0;
+                `    this.storage.put("foo", count + 1);
+                `    return new Response(this.id + ": " + request.url + " " + count);
+                `  }
+                `}
+            )
+          ],
+          bindings = [(name = "ns", durableObjectNamespace = "MyActorClass")],
+          durableObjectNamespaces = [
+            ( className = "MyActorClass",
+              uniqueKey = "mykey",
+            )
+          ],
+          durableObjectStorage = (inMemory = void)
+        )
+      ),
+    ],
+    sockets = [
+      ( name = "main",
+        address = "test-addr",
+        service = "hello"
+      )
+    ]
+  ))"_kj);
+
+  test.start();
+  auto conn = test.connect("test-addr");
+  conn.httpGet200("/",
+      "59002eb8cf872e541722977a258a12d6a93bbe8192b502e1c0cb250aa91af234: http://foo/ 0");
+  conn.httpGet200("/",
+      "59002eb8cf872e541722977a258a12d6a93bbe8192b502e1c0cb250aa91af234: http://foo/ 1");
+  conn.httpGet200("/",
+      "59002eb8cf872e541722977a258a12d6a93bbe8192b502e1c0cb250aa91af234: http://foo/ 2");
+  conn.httpGet200("/bar",
+      "02b496f65dd35cbac90e3e72dc5a398ee93926ea4a3821e26677082d2e6f9b79: http://foo/bar 0");
+  conn.httpGet200("/bar",
+      "02b496f65dd35cbac90e3e72dc5a398ee93926ea4a3821e26677082d2e6f9b79: http://foo/bar 1");
+  conn.httpGet200("/",
+      "59002eb8cf872e541722977a258a12d6a93bbe8192b502e1c0cb250aa91af234: http://foo/ 3");
+  conn.httpGet200("/bar",
+      "02b496f65dd35cbac90e3e72dc5a398ee93926ea4a3821e26677082d2e6f9b79: http://foo/bar 2");
+}
+
+KJ_TEST("Server: Ephemeral Objects") {
+  TestServer test(R"((
+    services = [
+      ( name = "hello",
+        worker = (
+          compatibilityDate = "2022-08-17",
+          modules = [
+            ( name = "main.js",
+              esModule =
+                `export default {
+                `  async fetch(request, env) {
+                `    let actor = env.ns.get(request.url)
+                `    return await actor.fetch(request)
+                `  }
+                `}
+                `export class MyActorClass {
+                `  constructor(state, env) {
+                `    if (state.storage) throw new Error("storage shouldn't be present");
+                `    this.id = state.id;
+                `    this.count = 0;
+                `  }
+                `  async fetch(request) {
+                `    return new Response(this.id + ": " + request.url + " " + this.count++);
+                `  }
+                `}
+            )
+          ],
+          bindings = [(name = "ns", durableObjectNamespace = "MyActorClass")],
+          durableObjectNamespaces = [
+            ( className = "MyActorClass",
+              ephemeralLocal = void,
+            )
+          ],
+          durableObjectStorage = (inMemory = void)
+        )
+      ),
+    ],
+    sockets = [
+      ( name = "main",
+        address = "test-addr",
+        service = "hello"
+      )
+    ]
+  ))"_kj);
+
+  test.server.allowExperimental();
+  test.start();
+  auto conn = test.connect("test-addr");
+  conn.httpGet200("/",
+      "http://foo/: http://foo/ 0");
+  conn.httpGet200("/",
+      "http://foo/: http://foo/ 1");
+  conn.httpGet200("/",
+      "http://foo/: http://foo/ 2");
+  conn.httpGet200("/bar",
+      "http://foo/bar: http://foo/bar 0");
+  conn.httpGet200("/bar",
+      "http://foo/bar: http://foo/bar 1");
+  conn.httpGet200("/",
+      "http://foo/: http://foo/ 3");
+  conn.httpGet200("/bar",
+      "http://foo/bar: http://foo/bar 2");
+}
+
+KJ_TEST("Server: Durable Objects hibernate while their WebSockets stay connected") {
+  TestServer test(R"((
+    services = [
+      ( name = "hello",
+        worker = (
+          compatibilityDate = "2022-08-17",
+          modules = [
+            ( name = "main.js",
+              esModule =
+                `let instances = 0;
+                `let events = [];
+                `export default {
+                `  async fetch(request, env) {
+                `    let actor = env.ns.get(env.ns.idFromName("room"))
+                `    return await actor.fetch(request)
+                `  }
+                `}
+                `export class MyActorClass {
+                `  constructor(state, env) {
+                `    this.state = state;
+                `    this.instance = ++instances;
+                `  }
+                `  async fetch(request) {
+                `    let name = new URL(request.url).pathname.slice(1);
+                `    if (name == "events") {
+                `      return new Response(events.join(", "));
+                `    }
+                `    let pair = new WebSocketPair();
+                `    this.state.acceptWebSocket(pair[1], ["room", name]);
+                `    pair[1].serializeAttachment({ name });
+                `    return new Response(null, { status: 101, webSocket: pair[0] });
+                `  }
+                `  webSocketMessage(ws, message) {
+                `    let name = ws.deserializeAttachment().name;
+                `    let counts = this.state.getWebSockets("room").length + "/" +
+                `                 this.state.getWebSockets(name).length;
+                `    ws.send(this.instance + " " + name + " " + counts + ": " + message);
+                `  }
+                `  webSocketClose(ws, code, reason, wasClean) {
+                `    let name = ws.deserializeAttachment().name;
+                `    events.push(
+                `        "close " + name + " " + code + " " + (wasClean ? reason : "unclean"));
+                `  }
+                `  webSocketError(ws, error) {
+                `    events.push("error " + ws.deserializeAttachment().name);
+                `  }
+                `}
+            )
+          ],
+          bindings = [(name = "ns", durableObjectNamespace = "MyActorClass")],
+          durableObjectNamespaces = [
+            ( className = "MyActorClass",
+              uniqueKey = "mykey",
+            )
+          ],
+          durableObjectStorage = (localDisk = "do-storage")
+        )
+      ),
+      ( name = "do-storage",
+        disk = (path = "/var/do-storage", writable = true)
+      ),
+    ],
+    sockets = [
+      ( name = "main",
+        address = "test-addr",
+        service = "hello"
+      )
+    ]
+  ))"_kj);
+
+  auto mode = kj::WriteMode::CREATE | kj::WriteMode::CREATE_PARENT;
+  test.root->openSubdir(kj::Path({"var"_kj, "do-storage"_kj}), mode);
 
   test.server.allowExperimental();
   test.start();
+
+  auto upgrade = [&](TestStream& conn, kj::StringPtr name) {
+    conn.send(kj::str(
+        "GET /", name, " HTTP/1.1\n"
+        "Host: foo\n"
+        "Upgrade: websocket\n"
+        "Connection: Upgrade\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\n"
+        "Sec-WebSocket-Version: 13\n"
+        "\n"));
+    auto headers = conn.recvHeaders();
+    KJ_EXPECT(headers.startsWith("HTTP/1.1 101 Switching Protocols\n"), headers);
+  };
+
+  auto bob = test.connect("test-addr");
+  upgrade(bob, "bob");
+
+  {
+    auto alice = test.connect("test-addr");
+    upgrade(alice, "alice");
+
+    // Both sockets are tagged "room", and each with its own name.
+    alice.sendWebSocketFrame(0x1, "hi");
+    alice.recvWebSocketText("1 alice 2/1: hi");
+
+    // Nothing is using the actor but its sockets, so the next check hibernates it.
+    test.timer.advanceTo(test.timer.now() + 10 * kj::SECONDS);
+    test.ws.poll();
+
+    // The next message runs on a new instance, which sees both sockets with their attachments.
+    alice.sendWebSocketFrame(0x1, "again");
+    alice.recvWebSocketText("2 alice 2/1: again");
+    bob.sendWebSocketFrame(0x1, "hello");
+    bob.recvWebSocketText("2 bob 2/1: hello");
+
+    // `alice` disconnects without sending a Close frame.
+  }
+  test.ws.poll();
+
+  // Code 1000, reason "done".
+  bob.sendWebSocketFrame(0x8, "\x03\xe8" "done");
+  test.ws.poll();
+
+  auto conn = test.connect("test-addr");
+  conn.httpGet200("/events", "close alice 1006 unclean, close bob 1000 done");
+}
+
+KJ_TEST("Server: in-memory Durable Objects keep their hibernatable WebSockets resident") {
+  TestServer test(R"((
+    services = [
+      ( name = "hello",
+        worker = (
+          compatibilityDate = "2022-08-17",
+          modules = [
+            ( name = "main.js",
+              esModule =
+                `let instances = 0;
+                `export default {
+                `  async fetch(request, env) {
+                `    let actor = env.ns.get(env.ns.idFromName("room"))
+                `    return await actor.fetch(request)
+                `  }
+                `}
+                `export class MyActorClass {
+                `  constructor(state, env) {
+                `    this.state = state;
+                `    this.instance = ++instances;
+                `  }
+                `  async fetch(request) {
+                `    let pair = new WebSocketPair();
+                `    let errors = [];
+                `    try {
+                `      pair[1].serializeAttachment(1);
+                `    } catch (e) {
+                `      errors.push("unaccepted");
+                `    }
+                `    try {
+                `      this.state.acceptWebSocket(pair[1], new Array(11).fill("tag"));
+                `    } catch (e) {
+                `      errors.push(e.message);
+                `    }
+                `    this.state.acceptWebSocket(pair[1]);
+                `    pair[1].serializeAttachment(errors.join(", "));
+                `    return new Response(null, { status: 101, webSocket: pair[0] });
+                `  }
+                `  webSocketMessage(ws, message) {
+                `    ws.send(this.instance + ": " + ws.deserializeAttachment());
+                `  }
+                `}
+            )
+          ],
+          bindings = [(name = "ns", durableObjectNamespace = "MyActorClass")],
+          durableObjectNamespaces = [
+            ( className = "MyActorClass",
+              uniqueKey = "mykey",
+            )
+          ],
+          durableObjectStorage = (inMemory = void)
+        )
+      ),
+    ],
+    sockets = [
+      ( name = "main",
+        address = "test-addr",
+        service = "hello"
+      )
+    ]
+  ))"_kj);
+
+  test.start();
+  auto conn = test.connect("test-addr");
+  conn.send(R"(
+    GET / HTTP/1.1
+    Host: foo
+    Upgrade: websocket
+    Connection: Upgrade
+    Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==
+    Sec-WebSocket-Version: 13
+
+  )"_blockquote);
+  auto headers = conn.recvHeaders();
+  KJ_EXPECT(headers.startsWith("HTTP/1.1 101 Switching Protocols\n"), headers);
+
+  // In-memory storage would be lost, so the actor is never hibernated.
+  test.timer.advanceTo(test.timer.now() + 10 * kj::SECONDS);
+  test.ws.poll();
+
+  conn.sendWebSocketFrame(0x1, "hi");
+  conn.recvWebSocketText("1: unaccepted, A WebSocket can have at most 10 tags.");
+}
+
+// =======================================================================================
+// Test HttpOptions on receive
+
+KJ_TEST("Server: WebSocket.broadcast() fans out to every open socket") {
+  TestServer test(R"((
+    services = [
+      ( name = "hello",
+        worker = (
+          compatibilityDate = "2022-08-17",
+          modules = [
+            ( name = "main.js",
+              esModule =
+                `export default {
+                `  async fetch(request, env) {
+                `    return env.ns.get(env.ns.idFromName("room")).fetch(request);
+                `  }
+                `}
+                `export class Room {
+                `  constructor() {
+                `    this.sockets = [];
+                `    this.events = [];
+                `  }
+                `  async fetch(request) {
+                `    let name = new URL(request.url).pathname.slice(1);
+                `    if (name == "events") {
+                `      return new Response(this.events.join(", "));
+                `    }
+                `    let pair = new WebSocketPair();
+                `    let ws = pair[1];
+                `    ws.accept();
+                `    this.sockets.push(ws);
+                `    ws.addEventListener("message", event => {
+                `      if (event.data == "bytes") {
+                `        let bytes = new Uint8Array([1, 2, 3]);
+                `        WebSocket.broadcast(this.sockets, bytes.buffer);
+                `        // The message was copied out of JavaScript, so this doesn't change it.
+                `        bytes.fill(9);
+                `      } else if (event.data == "last") {
+                `        // Sent before the Close frame, even though it's still queued.
+                `        WebSocket.broadcast(this.sockets, name + ": last");
+                `        ws.close(1000, "bye");
+                `      } else {
+                `        WebSocket.broadcast(this.sockets, name + ": " + event.data);
+                `      }
+                `    });
+                `    ws.addEventListener("close", event => {
+                `      this.events.push("close " + name + " " + event.code);
+                `      WebSocket.broadcast(this.sockets, name + " left");
+                `    });
+                `    return new Response(null, { status: 101, webSocket: pair[0] });
+                `  }
+                `}
+            )
+          ],
+          bindings = [(name = "ns", durableObjectNamespace = "Room")],
+          durableObjectNamespaces = [
+            ( className = "Room",
+              uniqueKey = "mykey",
+            )
+          ],
+          durableObjectStorage = (inMemory = void)
+        )
+      ),
+    ],
+    sockets = [
+      ( name = "main",
+        address = "test-addr",
+        service = "hello"
+      )
+    ]
+  ))"_kj);
+
+  test.start();
+
+  auto upgrade = [&](TestStream& conn, kj::StringPtr name) {
+    conn.send(kj::str(
+        "GET /", name, " HTTP/1.1\n"
+        "Host: foo\n"
+        "Upgrade: websocket\n"
+        "Connection: Upgrade\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\n"
+        "Sec-WebSocket-Version: 13\n"
+        "\n"));
+    auto headers = conn.recvHeaders();
+    KJ_EXPECT(headers.startsWith("HTTP/1.1 101 Switching Protocols\n"), headers);
+  };
+
+  auto alice = test.connect("test-addr");
+  upgrade(alice, "alice");
+  auto bob = test.connect("test-addr");
+  upgrade(bob, "bob");
+
+  {
+    auto carol = test.connect("test-addr");
+    upgrade(carol, "carol");
+
+    // Every socket gets the message, including the one it came from.
+    alice.sendWebSocketFrame(0x1, "hi");
+    alice.recvWebSocketText("alice: hi");
+    bob.recvWebSocketText("alice: hi");
+    carol.recvWebSocketText("alice: hi");
+
+    // Binary messages go out as they were when broadcast() was called.
+    alice.sendWebSocketFrame(0x1, "bytes");
+    alice.recv("\x82\x03\x01\x02\x03");
+    bob.recv("\x82\x03\x01\x02\x03");
+    carol.recv("\x82\x03\x01\x02\x03");
+
+    // `carol` disconnects without sending a Close frame.
+  }
+  test.ws.poll();
+
+  // The broadcast announcing it includes carol's broken socket, which doesn't keep the others
+  // from getting the message.
+  alice.recvWebSocketText("carol left");
+  bob.recvWebSocketText("carol left");
+
+  // bob's socket is closed right after the broadcast, but still sends the message first.
+  bob.sendWebSocketFrame(0x1, "last");
+  bob.recv("\x81\x09" "bob: last" "\x88\x05\x03\xe8" "bye");
+  alice.recvWebSocketText("bob: last");
+
+  // Closed sockets are skipped, rather than making broadcast() throw.
+  alice.sendWebSocketFrame(0x1, "still here");
+  alice.recvWebSocketText("alice: still here");
+  KJ_EXPECT(bob.recvAll() == "");
+
   auto conn = test.connect("test-addr");
-  conn.httpGet200("/",
-      "http://foo/: http://foo/ 0");
-  conn.httpGet200("/",
-      "http://foo/: http://foo/ 1");
-  conn.httpGet200("/",
-      "http://foo/: http://foo/ 2");
-  conn.httpGet200("/bar",
-      "http://foo/bar: http://foo/bar 0");
-  conn.httpGet200("/bar",
-      "http://foo/bar: http://foo/bar 1");
-  conn.httpGet200("/",
-      "http://foo/: http://foo/ 3");
-  conn.httpGet200("/bar",
-      "http://foo/bar: http://foo/bar 2");
+  conn.httpGet200("/events", "close carol 1006");
 }
 
-// =======================================================================================
-// Test HttpOptions on receive
-
 KJ_TEST("Server: serve proxy requests") {
   TestServer test(R"((
     services = [
@@ -1524,6 +3155,105 @@ KJ_TEST("Server: inject headers on incoming request/response") {
   )"_blockquote);
 }
 
+KJ_TEST("Server: autoCompress responses") {
+  TestServer test(R"((
+    services = [
+      ( name = "hello",
+        worker = (
+          compatibilityDate = "2022-08-17",
+          modules = [
+            ( name = "main.js",
+              esModule =
+                `export default {
+                `  async fetch(request) {
+                `    let url = new URL(request.url);
+                `    let headers = {"Content-Type": url.searchParams.get("type")};
+                `    if (url.searchParams.has("encoding")) {
+                `      headers["Content-Encoding"] = url.searchParams.get("encoding");
+                `    }
+                `    return new Response("x".repeat(url.searchParams.get("size")), {
+                `      headers, encodeBody: "manual"
+                `    });
+                `  }
+                `}
+            )
+          ]
+        )
+      )
+    ],
+    sockets = [
+      ( name = "main",
+        address = "test-addr",
+        service = "hello",
+        http = (autoCompress = true)
+      )
+    ]
+  ))"_kj);
+
+  test.start();
+
+  auto conn = test.connect("test-addr");
+
+  // Large textual bodies are compressed for clients that accept gzip.
+  conn.send(R"(
+    GET /?type=text/html&size=4000 HTTP/1.1
+    Host: example.com
+    Accept-Encoding: br, gzip
+
+  )"_blockquote);
+  auto headers = conn.recvHeaders();
+  KJ_EXPECT(headers.startsWith("HTTP/1.1 200 OK\n"), headers);
+  KJ_EXPECT(strstr(headers.cStr(), "Transfer-Encoding: chunked\n") != nullptr, headers);
+  KJ_EXPECT(strstr(headers.cStr(), "Content-Encoding: gzip\n") != nullptr, headers);
+  KJ_EXPECT(strstr(headers.cStr(), "Vary: Accept-Encoding\n") != nullptr, headers);
+  KJ_EXPECT(strstr(headers.cStr(), "Content-Length") == nullptr, headers);
+
+  // Small bodies, bodies that aren't text, and bodies that are already encoded are left alone.
+  conn.send(R"(
+    GET /?type=text/html&size=10 HTTP/1.1
+    Host: example.com
+    Accept-Encoding: gzip
+
+  )"_blockquote);
+  conn.recv(R"(
+    HTTP/1.1 200 OK
+    Content-Length: 10
+    Content-Type: text/html
+
+    xxxxxxxxxx)"_blockquote);
+
+  conn.send(R"(
+    GET /?type=image/png&size=4000 HTTP/1.1
+    Host: example.com
+    Accept-Encoding: gzip
+
+  )"_blockquote);
+  headers = conn.recvHeaders();
+  KJ_EXPECT(strstr(headers.cStr(), "Content-Length: 4000\n") != nullptr, headers);
+  KJ_EXPECT(strstr(headers.cStr(), "Content-Encoding") == nullptr, headers);
+
+  conn.send(R"(
+    GET /?type=text/html&size=4000&encoding=br HTTP/1.1
+    Host: example.com
+    Accept-Encoding: gzip, br
+
+  )"_blockquote);
+  headers = conn.recvHeaders();
+  KJ_EXPECT(strstr(headers.cStr(), "Content-Encoding: br\n") != nullptr, headers);
+  KJ_EXPECT(strstr(headers.cStr(), "Vary") == nullptr, headers);
+
+  // As are responses to clients that don't accept gzip.
+  conn.send(R"(
+    GET /?type=text/html&size=4000 HTTP/1.1
+    Host: example.com
+    Accept-Encoding: gzip;q=0, deflate
+
+  )"_blockquote);
+  headers = conn.recvHeaders();
+  KJ_EXPECT(strstr(headers.cStr(), "Content-Length: 4000\n") != nullptr, headers);
+  KJ_EXPECT(strstr(headers.cStr(), "Content-Encoding") == nullptr, headers);
+}
+
 // =======================================================================================
 // Test alternate service types
 //
@@ -1815,6 +3545,7 @@ KJ_TEST("Server: disk service") {
     HTTP/1.1 200 OK
     Content-Length: 19
     Content-Type: application/octet-stream
+    Accept-Ranges: bytes
     Last-Modified: Sat, 03 Jan 1970 05:18:23 GMT
 
     hello from foo.txt
@@ -1825,6 +3556,7 @@ KJ_TEST("Server: disk service") {
     HTTP/1.1 200 OK
     Content-Length: 19
     Content-Type: application/octet-stream
+    Accept-Ranges: bytes
     Last-Modified: Fri, 05 Feb 1971 02:52:09 GMT
 
     hello from bar.txt
@@ -1835,11 +3567,77 @@ KJ_TEST("Server: disk service") {
     HTTP/1.1 200 OK
     Content-Length: 19
     Content-Type: application/octet-stream
+    Accept-Ranges: bytes
     Last-Modified: Thu, 01 Jan 1970 00:00:00 GMT
 
     hello from qux.txt
   )"_blockquote);
 
+  // Range requests.
+  conn.send(R"(
+    GET /foo.txt HTTP/1.1
+    Host: foo
+    Range: bytes=6-9
+
+  )"_blockquote);
+  conn.recv(R"(
+    HTTP/1.1 206 Partial Content
+    Content-Length: 4
+    Content-Type: application/octet-stream
+    Accept-Ranges: bytes
+    Content-Range: bytes 6-9/19
+    Last-Modified: Sat, 03 Jan 1970 05:18:23 GMT
+
+    from)"_blockquote);
+
+  conn.send(R"(
+    GET /foo.txt HTTP/1.1
+    Host: foo
+    Range: bytes=-8
+
+  )"_blockquote);
+  conn.recv(R"(
+    HTTP/1.1 206 Partial Content
+    Content-Length: 8
+    Content-Type: application/octet-stream
+    Accept-Ranges: bytes
+    Content-Range: bytes 11-18/19
+    Last-Modified: Sat, 03 Jan 1970 05:18:23 GMT
+
+    foo.txt
+  )"_blockquote);
+
+  conn.send(R"(
+    GET /foo.txt HTTP/1.1
+    Host: foo
+    Range: bytes=19-
+
+  )"_blockquote);
+  conn.recv(R"(
+    HTTP/1.1 416 Range Not Satisfiable
+    Content-Length: 21
+    Content-Range: bytes */19
+
+    Range Not Satisfiable)"_blockquote);
+
+  // A stale If-Range validator means the whole file is sent.
+  conn.send(R"(
+    GET /foo.txt HTTP/1.1
+    Host: foo
+    Range: bytes=6-9
+    If-Range: Thu, 01 Jan 1970 00:00:00 GMT
+
+  )"_blockquote);
+  conn.recv(R"(
+    HTTP/1.1 200 OK
+    Content-Length: 19
+    Content-Type: application/octet-stream
+    Accept-Ranges: bytes
+    Last-Modified: Sat, 03 Jan 1970 05:18:23 GMT
+
+    hello from foo.txt
+  )"_blockquote);
+
   // TODO(beta): Test listing a directory. Unfortunately it doesn't work against the in-memory
   //   filesystem right now.
   //
@@ -1906,6 +3704,128 @@ KJ_TEST("Server: disk service") {
     Not Found)"_blockquote);
 }
 
+KJ_TEST("Server: disk service memory cache") {
+  TestServer test(R"((
+    services = [
+      (name = "hello", disk = (path = "/frob/blah", writable = true, memoryCache = ()))
+    ],
+    sockets = [
+      (name = "main", address = "test-addr", service = "hello")
+    ]
+  ))"_kj);
+
+  auto mode = kj::WriteMode::CREATE | kj::WriteMode::CREATE_PARENT;
+  auto dir = test.root->openSubdir(kj::Path({"frob"_kj, "blah"_kj}), mode);
+  test.fakeDate = kj::UNIX_EPOCH + 2 * kj::DAYS + 5 * kj::HOURS +
+                  18 * kj::MINUTES + 23 * kj::SECONDS;
+  dir->openFile(kj::Path({"foo.txt"}), mode)->writeAll("hello from foo.txt\n");
+
+  test.start();
+
+  auto conn = test.connect("test-addr");
+
+  // Too small to be worth compressing, so even a gzip-accepting client gets the identity
+  // encoding.
+  conn.send(R"(
+    GET /foo.txt HTTP/1.1
+    Host: foo
+    Accept-Encoding: gzip, deflate
+
+  )"_blockquote);
+  conn.recv(R"(
+    HTTP/1.1 200 OK
+    Content-Length: 19
+    Content-Type: application/octet-stream
+    Accept-Ranges: bytes
+    ETag: "ae88e6257600-13"
+    Last-Modified: Sat, 03 Jan 1970 05:18:23 GMT
+    Vary: Accept-Encoding
+
+    hello from foo.txt
+  )"_blockquote);
+
+  // Conditional requests.
+  conn.send(R"(
+    GET /foo.txt HTTP/1.1
+    Host: foo
+    If-None-Match: "abc", W/"ae88e6257600-13"
+
+  )"_blockquote);
+  conn.recv(R"(
+    HTTP/1.1 304 Not Modified
+    Content-Type: application/octet-stream
+    Accept-Ranges: bytes
+    ETag: "ae88e6257600-13"
+    Last-Modified: Sat, 03 Jan 1970 05:18:23 GMT
+    Vary: Accept-Encoding
+
+  )"_blockquote);
+
+  conn.send(R"(
+    GET /foo.txt HTTP/1.1
+    Host: foo
+    If-Modified-Since: Sat, 03 Jan 1970 05:18:23 GMT
+
+  )"_blockquote);
+  conn.recv(R"(
+    HTTP/1.1 304 Not Modified
+    Content-Type: application/octet-stream
+    Accept-Ranges: bytes
+    ETag: "ae88e6257600-13"
+    Last-Modified: Sat, 03 Jan 1970 05:18:23 GMT
+    Vary: Accept-Encoding
+
+  )"_blockquote);
+
+  // If-None-Match takes precedence over If-Modified-Since.
+  conn.send(R"(
+    GET /foo.txt HTTP/1.1
+    Host: foo
+    If-None-Match: "abc"
+    If-Modified-Since: Sat, 03 Jan 1970 05:18:23 GMT
+    Range: bytes=6-9
+
+  )"_blockquote);
+  conn.recv(R"(
+    HTTP/1.1 206 Partial Content
+    Content-Length: 4
+    Content-Type: application/octet-stream
+    Accept-Ranges: bytes
+    Content-Range: bytes 6-9/19
+    ETag: "ae88e6257600-13"
+    Last-Modified: Sat, 03 Jan 1970 05:18:23 GMT
+    Vary: Accept-Encoding
+
+    from)"_blockquote);
+
+  // Overwriting the file invalidates the cached copy immediately.
+  test.fakeDate = kj::UNIX_EPOCH + 3 * kj::DAYS;
+  conn.send(R"(
+    PUT /foo.txt HTTP/1.1
+    Host: foo
+    Content-Length: 6
+
+    corge
+  )"_blockquote);
+  conn.recv(R"(
+    HTTP/1.1 204 No Content
+
+  )"_blockquote);
+
+  conn.sendHttpGet("/foo.txt");
+  conn.recv(R"(
+    HTTP/1.1 200 OK
+    Content-Length: 6
+    Content-Type: application/octet-stream
+    Accept-Ranges: bytes
+    ETag: "ebbdb3ed0000-6"
+    Last-Modified: Sun, 04 Jan 1970 00:00:00 GMT
+    Vary: Accept-Encoding
+
+    corge
+  )"_blockquote);
+}
+
 KJ_TEST("Server: disk service writable") {
   TestServer test(R"((
     services = [
@@ -2054,6 +3974,7 @@ KJ_TEST("Server: disk service allow dotfiles") {
     HTTP/1.1 200 OK
     Content-Length: 6
     Content-Type: application/octet-stream
+    Accept-Ranges: bytes
     Last-Modified: Thu, 01 Jan 1970 00:00:00 GMT
 
     waldo
@@ -2104,6 +4025,64 @@ KJ_TEST("Server: disk service allow dotfiles") {
 }
 
 
+KJ_TEST("Server: profiler service") {
+  TestServer test(R"((
+    services = [
+      ( name = "hello",
+        worker = (
+          compatibilityDate = "2022-08-17",
+          modules = [
+            ( name = "main.js",
+              esModule =
+                `export default {
+                `  async fetch(request) {
+                `    return new Response("Hello");
+                `  }
+                `}
+            )
+          ]
+        )
+      ),
+      (name = "prof", profiler = void)
+    ],
+    sockets = [
+      (name = "main", address = "test-addr", service = "prof")
+    ]
+  ))"_kj);
+
+  test.start();
+  auto conn = test.connect("test-addr");
+
+  conn.sendHttpGet("/heap-snapshot?worker=nope");
+  conn.recv(R"(
+    HTTP/1.1 404 No such Worker
+    Content-Length: 14
+
+    No such Worker)"_blockquote);
+
+  // The snapshot is written out, as chunks, from another thread.
+  conn.sendHttpGet("/heap-snapshot?worker=hello");
+  auto snapshot = conn.recvUntil("\n0\n\n");
+  KJ_EXPECT(snapshot.startsWith("HTTP/1.1 200 OK\n"));
+  KJ_EXPECT(strstr(snapshot.cStr(), "Transfer-Encoding: chunked\n") != nullptr);
+  KJ_EXPECT(strstr(snapshot.cStr(), "{\"snapshot\":{") != nullptr);
+
+  // The connection is then ready for the next request.
+  conn.sendHttpGet("/cpu-profile?worker=hello&seconds=soon");
+  conn.recv(R"(
+    HTTP/1.1 400 Bad Request
+    Content-Length: 11
+
+    Bad Request)"_blockquote);
+
+  conn.sendHttpGet("/flame-graph?worker=hello");
+  conn.recv(R"(
+    HTTP/1.1 404 Not Found
+    Content-Length: 9
+
+    Not Found)"_blockquote);
+}
+
 KJ_TEST("Cache: If no cache service is defined, access to the cache API should error") {
   TestServer test(singleWorker(R"((
     compatibilityDate = "2022-08-17",
@@ -4,11 +4,14 @@
 
 #include "server.h"
 #include <kj/debug.h>
+#include <kj/compat/gzip.h>
 #include <kj/compat/http.h>
 #include <kj/compat/tls.h>
 #include <kj/compat/url.h>
 #include <kj/encoding.h>
 #include <kj/map.h>
+#include <kj/thread.h>
+#include <capnp/message.h>
 #include <workerd/io/worker-interface.h>
 #include <workerd/io/worker-entrypoint.h>
 #include <workerd/io/worker.h>
@@ -16,12 +19,37 @@
 #include <workerd/io/compatibility-date.h>
 #include <workerd/io/io-context.h>
 #include <workerd/io/worker.h>
+#include <algorithm>
+#include <atomic>
 #include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <string.h>
+#include <strings.h>
+#include <zlib.h>
 #include <openssl/bio.h>
 #include <openssl/pem.h>
 #include <workerd/io/actor-cache.h>
 #include <workerd/api/actor-state.h>
+#include <workerd/api/sockets.h>
 #include "workerd-api.h"
+#include "actor-placement.h"
+#include "alarm-scheduler.h"
+#include "analytics-batcher.h"
+#include "code-cache.h"
+#include "concurrency-limiter.h"
+#include "dns-cache.h"
+#include "http-cache.h"
+#include "kv-store.h"
+#include "r2-store.h"
+#include "limit-enforcers.h"
+#include "local-actor-storage.h"
+#include "metrics.h"
+#include "span-exporter.h"
+#include "subrequest-coalescer.h"
 
 namespace workerd::server {
 
@@ -76,6 +104,56 @@ static kj::String httpTime(kj::Date date) {
   return kj::heapString(buf, n);
 }
 
+struct ByteRange {
+  uint64_t start;
+  uint64_t end;  // exclusive
+};
+struct UnsatisfiableRange {};
+using ParsedRange = kj::OneOf<ByteRange, UnsatisfiableRange>;
+
+static kj::Maybe<ParsedRange> parseRangeHeader(kj::StringPtr value, uint64_t size) {
+  // Parses the value of a `Range` header against a resource of `size` bytes. Returns null if the
+  // header should be ignored and the whole resource served -- this includes syntactically
+  // invalid headers and requests for multiple ranges, which we don't bother to support (RFC 9110
+  // permits both).
+
+  if (!value.startsWith("bytes=")) return nullptr;
+  auto spec = value.slice(6);
+  if (spec.findFirst(',') != nullptr) return nullptr;
+  size_t dash;
+  KJ_IF_MAYBE(d, spec.findFirst('-')) {
+    dash = *d;
+  } else {
+    return nullptr;
+  }
+
+  auto firstText = kj::str(spec.slice(0, dash));
+  auto lastText = spec.slice(dash + 1);
+
+  kj::Maybe<ParsedRange> result;
+  if (firstText.size() == 0) {
+    // "bytes=-N" requests the last N bytes.
+    KJ_IF_MAYBE(suffix, lastText.tryParseAs<uint64_t>()) {
+      if (*suffix == 0 || size == 0) {
+        result = ParsedRange(UnsatisfiableRange {});
+      } else {
+        result = ParsedRange(ByteRange { size - kj::min(*suffix, size), size });
+      }
+    }
+  } else KJ_IF_MAYBE(first, firstText.tryParseAs<uint64_t>()) {
+    if (*first >= size) {
+      result = ParsedRange(UnsatisfiableRange {});
+    } else if (lastText.size() == 0) {
+      result = ParsedRange(ByteRange { *first, size });
+    } else KJ_IF_MAYBE(last, lastText.tryParseAs<uint64_t>()) {
+      if (*last >= *first) {
+        result = ParsedRange(ByteRange { *first, kj::min(*last, size - 1) + 1 });
+      }
+    }
+  }
+  return result;
+}
+
 static kj::Vector<char> escapeJsonString(kj::StringPtr text) {
   static const char HEXDIGITS[] = "0123456789abcdef";
   kj::Vector<char> escaped(text.size() + 1);
@@ -105,6 +183,241 @@ static kj::Vector<char> escapeJsonString(kj::StringPtr text) {
   return escaped;
 }
 
+static kj::Maybe<kj::Array<kj::byte>> gzipCompress(kj::ArrayPtr<const kj::byte> input) {
+  // Compresses `input` in gzip format. Returns null if that wouldn't save a meaningful amount of
+  // space, e.g. because the input is an image which is already compressed.
+
+  z_stream ctx;
+  memset(&ctx, 0, sizeof(ctx));
+  // Use the best compression, since a cached variant is compressed once and served many times.
+  KJ_ASSERT(deflateInit2(&ctx, Z_BEST_COMPRESSION, Z_DEFLATED,
+                         15 + 16,  // max window size, gzip format
+                         8, Z_DEFAULT_STRATEGY) == Z_OK);
+  KJ_DEFER(deflateEnd(&ctx));
+
+  auto output = kj::heapArray<kj::byte>(deflateBound(&ctx, input.size()));
+  ctx.next_in = const_cast<kj::byte*>(input.begin());
+  ctx.avail_in = input.size();
+  ctx.next_out = output.begin();
+  ctx.avail_out = output.size();
+  KJ_ASSERT(deflate(&ctx, Z_FINISH) == Z_STREAM_END);
+
+  if (ctx.total_out > input.size() - input.size() / 8) return nullptr;
+  return kj::heapArray<kj::byte>(output.slice(0, ctx.total_out));
+}
+
+static kj::ArrayPtr<const char> trimWhitespace(kj::ArrayPtr<const char> text) {
+  while (text.size() > 0 && (text.front() == ' ' || text.front() == '\t')) text = text.slice(1);
+  while (text.size() > 0 && (text.back() == ' ' || text.back() == '\t')) {
+    text = text.slice(0, text.size() - 1);
+  }
+  return text;
+}
+
+static bool acceptsGzip(kj::StringPtr acceptEncoding) {
+  // Check whether an `Accept-Encoding` header value permits gzip. We don't bother ranking by
+  // q-value, since gzip is the only encoding we produce; we just honor an explicit `q=0`.
+
+  bool result = false;
+  size_t pos = 0;
+  while (pos < acceptEncoding.size()) {
+    size_t end = pos;
+    while (end < acceptEncoding.size() && acceptEncoding[end] != ',') ++end;
+    auto item = acceptEncoding.slice(pos, end);
+    pos = end + 1;
+
+    size_t semicolon = 0;
+    while (semicolon < item.size() && item[semicolon] != ';') ++semicolon;
+    auto coding = trimWhitespace(item.slice(0, semicolon));
+    bool isGzip = coding.size() == 4 && strncasecmp(coding.begin(), "gzip", 4) == 0;
+    bool isWildcard = coding.size() == 1 && coding[0] == '*';
+    if (!isGzip && !isWildcard) continue;
+
+    bool acceptable = true;
+    if (semicolon < item.size()) {
+      auto param = kj::str(trimWhitespace(item.slice(semicolon + 1, item.size())));
+      if (param.startsWith("q=") || param.startsWith("Q=")) {
+        KJ_IF_MAYBE(q, param.slice(2).tryParseAs<double>()) {
+          acceptable = *q > 0;
+        }
+      }
+    }
+
+    // An explicit "gzip" entry overrides a wildcard.
+    if (isGzip) return acceptable;
+    result = acceptable;
+  }
+  return result;
+}
+
+class DiskFileCache {
+  // In-memory cache of small files served by a DiskDirectoryService, along with lazily-built
+  // gzip variants. Bounded in total size, evicting least-recently-used files.
+  //
+  // A cached file is trusted for `revalidateInterval` after it was last checked, during which
+  // requests for it don't touch the disk at all. After that, the next request stat()s the file
+  // and re-reads it only if its size or modification time changed.
+
+public:
+  DiskFileCache(config::DiskDirectory::MemoryCache::Reader conf, kj::Timer& timer)
+      : timer(timer),
+        maxTotalSize(conf.getMaxTotalSize()),
+        maxFileSize(conf.getMaxFileSize()),
+        revalidateInterval(conf.getRevalidateMillis() * kj::MILLISECONDS),
+        gzip(conf.getGzip()) {}
+
+  ~DiskFileCache() noexcept(false) {
+    for (auto& entry: map) {
+      lru.remove(*entry.value);
+    }
+  }
+
+  class Entry: public kj::Refcounted {
+  public:
+    Entry(kj::String key, kj::Array<const kj::byte> content, kj::Date lastModified)
+        : key(kj::mv(key)), content(kj::mv(content)), lastModified(lastModified),
+          lastModifiedText(httpTime(lastModified)),
+          etag(kj::str('"', kj::hex((uint64_t)((lastModified - kj::UNIX_EPOCH) / kj::NANOSECONDS)),
+                       '-', kj::hex((uint64_t)this->content.size()), '"')),
+          gzipEtag(kj::str(etag.slice(0, etag.size() - 1), "-gzip\"")) {}
+
+    const kj::String key;
+    const kj::Array<const kj::byte> content;
+    const kj::Date lastModified;
+    const kj::String lastModifiedText;
+    const kj::String etag;
+    const kj::String gzipEtag;
+
+    kj::Maybe<kj::Maybe<kj::Array<kj::byte>>> gzipped;
+    // Outer null = not yet attempted; inner null = compression didn't help.
+
+    kj::TimePoint validatedAt = kj::origin<kj::TimePoint>();
+
+    size_t size() const {
+      size_t result = sizeof(*this) + key.size() + content.size();
+      KJ_IF_MAYBE(g, gzipped) {
+        KJ_IF_MAYBE(bytes, *g) result += bytes->size();
+      }
+      return result;
+    }
+
+  private:
+    kj::ListLink<Entry> link;
+    friend class DiskFileCache;
+  };
+
+  kj::Maybe<kj::Own<Entry>> lookup(const kj::ReadableDirectory& dir, const kj::Path& path) {
+    // Returns the cached content for `path`, loading it if necessary. Returns null if the path
+    // isn't a file that can be cached, in which case the caller should serve it from disk.
+
+    auto key = path.toString();
+    auto now = timer.now();
+
+    KJ_IF_MAYBE(existing, map.find(key)) {
+      auto& entry = **existing;
+      if (now - entry.validatedAt < revalidateInterval) {
+        touch(entry);
+        return kj::addRef(entry);
+      }
+    }
+
+    auto file = KJ_UNWRAP_OR(dir.tryOpenFile(path), {
+      erase(key);
+      return nullptr;
+    });
+    auto meta = file->stat();
+    if (meta.type != kj::FsNode::Type::FILE || meta.size > maxFileSize) {
+      erase(key);
+      return nullptr;
+    }
+
+    KJ_IF_MAYBE(existing, map.find(key)) {
+      auto& entry = **existing;
+      if (entry.lastModified == meta.lastModified && entry.content.size() == meta.size) {
+        entry.validatedAt = now;
+        touch(entry);
+        return kj::addRef(entry);
+      }
+    }
+
+    erase(key);
+    auto entry = kj::refcounted<Entry>(kj::mv(key), file->readAllBytes(), meta.lastModified);
+    entry->validatedAt = now;
+    if (entry->size() > maxTotalSize) {
+      // Serve it this once without caching.
+      return kj::mv(entry);
+    }
+
+    totalSize += entry->size();
+    lru.add(*entry);
+    auto result = kj::addRef(*entry);
+    kj::StringPtr keyPtr = entry->key;
+    map.insert(keyPtr, kj::mv(entry));
+    evictIfNeeded();
+    return kj::mv(result);
+  }
+
+  kj::Maybe<kj::ArrayPtr<const kj::byte>> getGzipped(Entry& entry) {
+    // Returns the gzip variant of `entry`, building it if needed, or null if gzip is disabled or
+    // doesn't help for this content.
+
+    if (!gzip) return nullptr;
+    if (entry.gzipped == nullptr) {
+      bool cached = entry.link.isLinked();
+      if (cached) totalSize -= entry.size();
+      entry.gzipped = gzipCompress(entry.content);
+      if (cached) {
+        totalSize += entry.size();
+        evictIfNeeded();
+      }
+    }
+    return KJ_ASSERT_NONNULL(entry.gzipped).map([](kj::Array<kj::byte>& bytes) {
+      return bytes.asPtr().asConst();
+    });
+  }
+
+  bool isGzipEnabled() { return gzip; }
+
+  void invalidate(const kj::Path& path) {
+    // Drop the cached copy of `path`, e.g. because it was just overwritten.
+    erase(path.toString());
+  }
+
+private:
+  kj::Timer& timer;
+  uint64_t maxTotalSize;
+  uint64_t maxFileSize;
+  kj::Duration revalidateInterval;
+  bool gzip;
+
+  kj::HashMap<kj::StringPtr, kj::Own<Entry>> map;
+  kj::List<Entry, &Entry::link> lru;  // least-recently-used first
+  uint64_t totalSize = 0;
+
+  void touch(Entry& entry) {
+    if (entry.link.isLinked()) {
+      lru.remove(entry);
+      lru.add(entry);
+    }
+  }
+
+  void erase(kj::StringPtr key) {
+    KJ_IF_MAYBE(existing, map.findEntry(key)) {
+      auto& entry = *existing->value;
+      totalSize -= entry.size();
+      lru.remove(entry);
+      // Requests in flight may still hold references to the entry.
+      map.erase(*existing);
+    }
+  }
+
+  void evictIfNeeded() {
+    while (totalSize > maxTotalSize && !lru.empty()) {
+      erase(lru.front().key);
+    }
+  }
+};
+
 class EmptyReadOnlyActorStorageImpl final: public rpc::ActorStorage::Stage::Server {
   // An ActorStorage implementation which will always respond to reads as if the state is empty,
   // and will fail any writes.
@@ -152,6 +465,377 @@ private:
   };
 };
 
+ActorCacheSharedLruOptions makeActorCacheLruOptions(
+    config::Worker::DurableObjectCache::Reader conf, bool neverFlush,
+    kj::Maybe<const ActorCacheMemoryBudget&> budget) {
+  return {
+    .softLimit = size_t(conf.getSoftLimitMegabytes()) << 20,
+    .hardLimit = size_t(conf.getHardLimitMegabytes()) << 20,
+    .staleTimeout = conf.getStaleTimeoutSeconds() * kj::SECONDS,
+    .dirtyKeySoftLimit = conf.getDirtyKeySoftLimit(),
+    .maxKeysPerRpc = conf.getMaxKeysPerRpc(),
+    .maxBytesPerRpc = size_t(conf.getMaxKilobytesPerRpc()) << 10,
+    .maxBatchesInFlight = conf.getMaxBatchesInFlight(),
+    .neverFlush = neverFlush,
+    .budget = budget,
+    .maxFlushesInFlight = conf.getMaxFlushesInFlight(),
+    .listReadAhead = conf.getListReadAhead(),
+  };
+}
+
+class WorkerdIsolateObserver final: public IsolateObserver {
+  // Uses the hooks of LockTiming to log garbage collection pauses that take longer than
+  // `logGcPausesOver`, and, if `traceLocks` is set, to record a span for each wait for the
+  // isolate lock by a traced request. (The GC hooks fire for any GC that happens while a
+  // Worker::Lock is held, which is nearly all of them.) If `metrics` is set, also records
+  // isolate lifetimes, lock waits and holds, GC pauses, and external memory there. If `lockWaits`
+  // is set, reports each asynchronous lock wait to it, for the Worker's ConcurrencyLimiter.
+
+public:
+  WorkerdIsolateObserver(kj::StringPtr workerName, kj::Maybe<kj::Duration> logGcPausesOver,
+                         bool traceLocks, kj::Maybe<kj::Own<const WorkerMetrics>> metrics,
+                         kj::Maybe<kj::Own<const LockWaitSamples>> lockWaits)
+      : workerName(kj::str(workerName)), logGcPausesOver(logGcPausesOver),
+        traceLocks(traceLocks), metrics(kj::mv(metrics)), lockWaits(kj::mv(lockWaits)) {}
+
+  void created() override {
+    KJ_IF_MAYBE(m, metrics) (*m)->increment(WorkerMetrics::Counter::ISOLATES_CREATED);
+  }
+  ~WorkerdIsolateObserver() noexcept(false) {
+    stopTrackingExternalMemory();
+  }
+
+  void evicted() override {
+    KJ_IF_MAYBE(m, metrics) (*m)->increment(WorkerMetrics::Counter::ISOLATES_EVICTED);
+    stopTrackingExternalMemory();
+  }
+
+  void externalMemoryTracked(const jsg::ExternalMemoryTracker& tracker) override {
+    KJ_IF_MAYBE(m, metrics) {
+      (*m)->addExternalMemory(tracker.addRef());
+      externalMemory = tracker;
+    }
+  }
+
+  void asyncLockQueued(AsyncLockPriority priority, kj::Duration waitTime) const override {
+    KJ_IF_MAYBE(m, metrics) {
+      static_assert(uint(WorkerMetrics::Histogram::LOCK_QUEUE_WAIT_UNTIL) -
+                    uint(WorkerMetrics::Histogram::LOCK_QUEUE_FETCH) ==
+                    uint(AsyncLockPriority::WAIT_UNTIL));
+      auto histogram = uint(WorkerMetrics::Histogram::LOCK_QUEUE_FETCH) + uint(priority);
+      (*m)->record(WorkerMetrics::Histogram(histogram), waitTime);
+    }
+  }
+
+  void lockReleased(bool synchronous, kj::Duration waitTime,
+                    kj::Duration holdTime) const override {
+    KJ_IF_MAYBE(m, metrics) {
+      (*m)->record(WorkerMetrics::Histogram::LOCK_WAIT, waitTime);
+      (*m)->record(WorkerMetrics::Histogram::LOCK_HOLD, holdTime);
+    }
+    KJ_IF_MAYBE(l, lockWaits) {
+      // Synchronous locks are taken at startup and by the inspector, not by requests.
+      if (!synchronous) (*l)->add(waitTime);
+    }
+  }
+
+  kj::Maybe<kj::Own<LockTiming>> tryCreateLockTiming(
+      kj::OneOf<SpanParent, kj::Maybe<RequestObserver&>> parentOrRequest) const override {
+    SpanBuilder waitSpan = nullptr;
+    if (traceLocks) {
+      KJ_SWITCH_ONEOF(parentOrRequest) {
+        KJ_CASE_ONEOF(parent, SpanParent) {
+          waitSpan = parent.newChild("isolate_lock_wait");
+        }
+        KJ_CASE_ONEOF(request, kj::Maybe<RequestObserver&>) {
+          KJ_IF_MAYBE(r, request) {
+            waitSpan = r->getSpan().newChild("isolate_lock_wait");
+          }
+        }
+      }
+    }
+
+    if (!waitSpan.isObserved() && logGcPausesOver == nullptr && metrics == nullptr) {
+      return nullptr;
+    }
+    return kj::Own<LockTiming>(kj::heap<Timing>(*this, kj::mv(waitSpan)));
+  }
+
+private:
+  kj::String workerName;
+  kj::Maybe<kj::Duration> logGcPausesOver;
+  bool traceLocks;
+  kj::Maybe<kj::Own<const WorkerMetrics>> metrics;
+  kj::Maybe<kj::Own<const LockWaitSamples>> lockWaits;
+  kj::Maybe<const jsg::ExternalMemoryTracker&> externalMemory;
+  // Registered with `metrics` until the isolate is evicted.
+
+  void stopTrackingExternalMemory() {
+    KJ_IF_MAYBE(t, externalMemory) {
+      KJ_IF_MAYBE(m, metrics) (*m)->removeExternalMemory(*t);
+      externalMemory = nullptr;
+    }
+  }
+
+  class Timing final: public LockTiming {
+  public:
+    Timing(const WorkerdIsolateObserver& observer, SpanBuilder waitSpan)
+        : observer(observer), waitSpan(kj::mv(waitSpan)) {}
+
+    void waitingForOtherIsolate(kj::StringPtr id) override {
+      waitSpan.addLog(kj::systemPreciseCalendarClock().now(), "waiting_for_other_isolate",
+                      kj::str(id));
+    }
+    void locked() override {
+      waitSpan.end();
+    }
+
+    void gcPrologue() override {
+      if (depth++ == 0) {
+        start = kj::systemPreciseMonotonicClock().now();
+      }
+    }
+    void gcEpilogue() override {
+      if (depth > 0 && --depth == 0) {
+        auto pause = kj::systemPreciseMonotonicClock().now() - start;
+        KJ_IF_MAYBE(threshold, observer.logGcPausesOver) {
+          if (pause > *threshold) {
+            KJ_LOG(WARNING, "long garbage collection pause", observer.workerName, pause);
+          }
+        }
+        KJ_IF_MAYBE(m, observer.metrics) {
+          (*m)->record(WorkerMetrics::Histogram::GC_PAUSE, pause);
+        }
+      }
+    }
+
+  private:
+    const WorkerdIsolateObserver& observer;
+    SpanBuilder waitSpan;
+    uint depth = 0;
+    kj::TimePoint start = kj::origin<kj::TimePoint>();
+  };
+};
+
+class WorkerdRequestObserver final: public RequestObserver {
+  // Observer for a request to a Worker that is traced by the SpanExporter, records metrics, or
+  // both. `span` covers the whole request, down to its last `waitUntil()` task, and is the
+  // parent of the spans the request makes.
+
+public:
+  WorkerdRequestObserver(SpanBuilder span, kj::Maybe<kj::Own<const WorkerMetrics>> metricsParam)
+      : span(kj::mv(span)), metrics(kj::mv(metricsParam)) {
+    KJ_IF_MAYBE(m, metrics) (*m)->adjust(WorkerMetrics::Gauge::REQUESTS_IN_FLIGHT, 1);
+  }
+  ~WorkerdRequestObserver() noexcept(false) {
+    KJ_IF_MAYBE(m, metrics) {
+      (*m)->adjust(WorkerMetrics::Gauge::REQUESTS_IN_FLIGHT, -1);
+      if (wasDelivered) {
+        (*m)->record(WorkerMetrics::Histogram::SUBREQUESTS_PER_REQUEST, subrequests);
+      }
+    }
+  }
+
+  SpanParent getSpan() override { return SpanParent(span); }
+
+  void delivered() override {
+    wasDelivered = true;
+    KJ_IF_MAYBE(m, metrics) (*m)->increment(WorkerMetrics::Counter::REQUESTS);
+  }
+
+  void reportFailure(const kj::Exception& e) override {
+    KJ_IF_MAYBE(m, metrics) (*m)->increment(WorkerMetrics::Counter::REQUEST_FAILURES);
+  }
+
+  WorkerInterface& wrapWorkerInterface(WorkerInterface& worker) override {
+    KJ_IF_MAYBE(m, metrics) {
+      return timedWorker.emplace(worker, **m);
+    }
+    return worker;
+  }
+
+  kj::Own<WorkerInterface> wrapSubrequestClient(kj::Own<WorkerInterface> client) override {
+    KJ_IF_MAYBE(m, metrics) {
+      (*m)->increment(WorkerMetrics::Counter::SUBREQUESTS);
+      ++subrequests;
+    }
+    return kj::mv(client);
+  }
+
+  void addedWaitUntilTask() override {
+    KJ_IF_MAYBE(m, metrics) (*m)->adjust(WorkerMetrics::Gauge::WAIT_UNTIL_TASKS, 1);
+  }
+  void finishedWaitUntilTask() override {
+    KJ_IF_MAYBE(m, metrics) (*m)->adjust(WorkerMetrics::Gauge::WAIT_UNTIL_TASKS, -1);
+  }
+
+private:
+  class TimedWorkerInterface final: public WorkerInterface {
+    // Records how long the event delivered through it takes, up to the end of the response.
+    // `connect()` isn't timed, since a tunnel lasts as long as the client wants.
+
+  public:
+    TimedWorkerInterface(WorkerInterface& inner, const WorkerMetrics& metrics)
+        : inner(inner), metrics(metrics) {}
+
+    kj::Promise<void> request(
+        kj::HttpMethod method, kj::StringPtr url, const kj::HttpHeaders& headers,
+        kj::AsyncInputStream& requestBody, kj::HttpService::Response& response) override {
+      return time(inner.request(method, url, headers, requestBody, response));
+    }
+    kj::Promise<void> connect(kj::StringPtr host, const kj::HttpHeaders& headers,
+        kj::AsyncIoStream& connection, kj::HttpService::ConnectResponse& response) override {
+      return inner.connect(host, headers, connection, response);
+    }
+    void prewarm(kj::StringPtr url) override {
+      inner.prewarm(url);
+    }
+    kj::Promise<ScheduledResult> runScheduled(kj::Date scheduledTime,
+                                              kj::StringPtr cron) override {
+      return time(inner.runScheduled(scheduledTime, cron));
+    }
+    kj::Promise<AlarmResult> runAlarm(kj::Date scheduledTime) override {
+      return time(inner.runAlarm(scheduledTime));
+    }
+    kj::Promise<CustomEvent::Result> customEvent(kj::Own<CustomEvent> event) override {
+      return time(inner.customEvent(kj::mv(event)));
+    }
+
+  private:
+    WorkerInterface& inner;
+    const WorkerMetrics& metrics;
+
+    template <typename T>
+    kj::Promise<T> time(kj::Promise<T> promise) {
+      auto start = kj::systemPreciseMonotonicClock().now();
+      return promise.attach(kj::defer([metrics = metrics.addRef(), start]() {
+        metrics->record(WorkerMetrics::Histogram::REQUEST_DURATION,
+                       kj::systemPreciseMonotonicClock().now() - start);
+      }));
+    }
+  };
+
+  SpanBuilder span;
+  kj::Maybe<kj::Own<const WorkerMetrics>> metrics;
+  kj::Maybe<TimedWorkerInterface> timedWorker;
+  bool wasDelivered = false;
+  uint subrequests = 0;
+};
+
+class WorkerdActorObserver final: public ActorObserver {
+  // Records a Durable Object's WebSocket traffic and storage cache use in its Worker's metrics.
+
+public:
+  explicit WorkerdActorObserver(kj::Own<const WorkerMetrics> metrics)
+      : metrics(kj::mv(metrics)) {}
+
+  void receivedWebSocketMessage(size_t bytes) override {
+    metrics->increment(WorkerMetrics::Counter::WEBSOCKET_BYTES_RECEIVED, bytes);
+  }
+  void sentWebSocketMessage(size_t bytes) override {
+    metrics->increment(WorkerMetrics::Counter::WEBSOCKET_BYTES_SENT, bytes);
+  }
+
+  void addCachedStorageReadUnits(uint32_t units) override {
+    metrics->increment(WorkerMetrics::Counter::STORAGE_CACHE_HITS, units);
+  }
+  void addUncachedStorageReadUnits(uint32_t units) override {
+    metrics->increment(WorkerMetrics::Counter::STORAGE_CACHE_MISSES, units);
+  }
+  void storageCacheEntryEvicted() override {
+    metrics->increment(WorkerMetrics::Counter::STORAGE_CACHE_EVICTIONS);
+  }
+
+private:
+  kj::Own<const WorkerMetrics> metrics;
+};
+
+class ConcurrencyLimitedWorkerInterface final: public WorkerInterface {
+  // Holds each event delivered through it until the Worker's ConcurrencyLimiter admits it, and
+  // rejects the event if the limiter sheds it instead: HTTP requests get a 503 with a
+  // `Retry-After` header, other events an OVERLOADED exception. An admitted event's permit goes
+  // into a PermitSlot owned by the event's IoContext, so it's held until the IoContext is
+  // released, like the Worker's idle accounting: proxying a response body after that doesn't
+  // need the isolate, and shouldn't keep other requests waiting.
+
+public:
+  struct PermitSlot {
+    kj::Maybe<kj::Own<void>> permit;
+  };
+
+  ConcurrencyLimitedWorkerInterface(kj::Own<WorkerInterface> inner, ConcurrencyLimiter& limiter,
+                                    PermitSlot& slot, uint retryAfterSeconds,
+                                    const kj::HttpHeaderTable& headerTable)
+      : inner(kj::mv(inner)), limiter(limiter), slot(slot), retryAfterSeconds(retryAfterSeconds),
+        headerTable(headerTable) {}
+  // `slot` must be owned by the IoContext of the event that `inner` delivers, by being passed to
+  // WorkerEntrypoint::construct() as part of its `ioContextDependency`.
+
+  kj::Promise<void> request(
+      kj::HttpMethod method, kj::StringPtr url, const kj::HttpHeaders& headers,
+      kj::AsyncInputStream& requestBody, kj::HttpService::Response& response) override {
+    if (co_await tryAdmit()) {
+      co_await inner->request(method, url, headers, requestBody, response);
+    } else {
+      kj::HttpHeaders responseHeaders(headerTable);
+      responseHeaders.add("Retry-After", kj::str(retryAfterSeconds));
+      auto body = "Service Unavailable"_kj;
+      auto out = response.send(503, "Service Unavailable", responseHeaders, body.size());
+      co_await out->write(body.begin(), body.size());
+    }
+  }
+  kj::Promise<void> connect(kj::StringPtr host, const kj::HttpHeaders& headers,
+      kj::AsyncIoStream& connection, kj::HttpService::ConnectResponse& response) override {
+    if (co_await tryAdmit()) {
+      co_await inner->connect(host, headers, connection, response);
+    } else {
+      kj::HttpHeaders responseHeaders(headerTable);
+      responseHeaders.add("Retry-After", kj::str(retryAfterSeconds));
+      response.reject(503, "Service Unavailable", responseHeaders, uint64_t(0));
+    }
+  }
+  void prewarm(kj::StringPtr url) override {
+    inner->prewarm(url);
+  }
+  kj::Promise<ScheduledResult> runScheduled(kj::Date scheduledTime,
+                                            kj::StringPtr cron) override {
+    co_await admit();
+    co_return co_await inner->runScheduled(scheduledTime, cron);
+  }
+  kj::Promise<AlarmResult> runAlarm(kj::Date scheduledTime) override {
+    // Only Durable Objects have alarms, and they aren't limited.
+    return inner->runAlarm(scheduledTime);
+  }
+  kj::Promise<CustomEvent::Result> customEvent(kj::Own<CustomEvent> event) override {
+    co_await admit();
+    co_return co_await inner->customEvent(kj::mv(event));
+  }
+
+private:
+  kj::Own<WorkerInterface> inner;
+  ConcurrencyLimiter& limiter;
+  PermitSlot& slot;
+  uint retryAfterSeconds;
+  const kj::HttpHeaderTable& headerTable;
+
+  kj::Promise<bool> tryAdmit() {
+    // Returns false if the event was shed. `slot` is still alive here, because `inner` owns the
+    // IoContext until the event is delivered to it.
+    auto permit = co_await limiter.acquire();
+    KJ_IF_MAYBE(p, permit) {
+      slot.permit = kj::mv(*p);
+      co_return true;
+    }
+    co_return false;
+  }
+
+  kj::Promise<void> admit() {
+    if (!co_await tryAdmit()) {
+      kj::throwFatalException(KJ_EXCEPTION(OVERLOADED, "Worker is over its concurrency limit"));
+    }
+  }
+};
+
 }  // namespace
 
 // =======================================================================================
@@ -159,10 +843,21 @@ private:
 Server::Server(kj::Filesystem& fs, kj::Timer& timer, kj::Network& network,
                kj::EntropySource& entropySource, kj::Function<void(kj::String)> reportConfigError)
     : fs(fs), timer(timer), network(network), entropySource(entropySource),
-      reportConfigError(kj::mv(reportConfigError)), tasks(*this) {}
+      reportConfigError(kj::mv(reportConfigError)),
+      metricsRegistry(kj::atomicRefcounted<MetricsRegistry>()), tasks(*this) {}
 
 Server::~Server() noexcept(false) {}
 
+void Server::shareMetrics(kj::Own<const MetricsRegistry> registry) {
+  metricsRegistry = kj::mv(registry);
+}
+
+void Server::shareActorPlacement(kj::Own<const ActorPlacement> placement,
+                                 kj::LowLevelAsyncIoProvider& lowLevelProvider, uint threadIndex) {
+  KJ_REQUIRE(threadIndex < placement->getThreadCount());
+  actorPlacement = ActorPlacementOptions { kj::mv(placement), lowLevelProvider, threadIndex };
+}
+
 struct Server::GlobalContext {
   jsg::V8System& v8System;
   capnp::ByteStreamFactory byteStreamFactory;
@@ -295,6 +990,16 @@ public:
     if (httpOptions.hasCfBlobHeader()) {
       cfBlobHeader = headerTableBuilder.add(httpOptions.getCfBlobHeader());
     }
+    if (httpOptions.getAutoCompress()) {
+      compressionHeaders = CompressionHeaders {
+        .acceptEncoding = headerTableBuilder.add("Accept-Encoding"),
+        .contentEncoding = headerTableBuilder.add("Content-Encoding"),
+        .contentRange = headerTableBuilder.add("Content-Range"),
+        .cacheControl = headerTableBuilder.add("Cache-Control"),
+        .etag = headerTableBuilder.add("ETag"),
+        .vary = headerTableBuilder.add("Vary"),
+      };
+    }
   }
 
   bool hasCfBlobHeader() {
@@ -384,11 +1089,116 @@ public:
     responseInjector.apply(headers);
   }
 
+  bool mayCompressResponse(kj::HttpMethod method, const kj::HttpHeaders& requestHeaders) {
+    // Whether the response to this request is a candidate for `autoCompress`, i.e. whether it
+    // has a body and the client accepts gzip.
+
+    auto& ids = KJ_UNWRAP_OR_RETURN(compressionHeaders, false);
+    if (method == kj::HttpMethod::HEAD) return false;
+    return acceptsGzip(KJ_UNWRAP_OR_RETURN(requestHeaders.get(ids.acceptEncoding), false));
+  }
+
+  bool startCompressedResponse(uint statusCode, kj::HttpHeaders& headers,
+                               kj::Maybe<uint64_t> expectedBodySize) {
+    // Decides whether to gzip a response for which mayCompressResponse() returned true. If so,
+    // rewrites `headers` for the compressed body, which the caller must then produce.
+
+    auto& ids = KJ_ASSERT_NONNULL(compressionHeaders);
+
+    // Only full, successful-ish responses, with bodies worth compressing.
+    if (statusCode < 200 || statusCode == 204 || statusCode == 206 || statusCode == 304) {
+      return false;
+    }
+    KJ_IF_MAYBE(size, expectedBodySize) {
+      if (*size < MIN_COMPRESSED_BODY_SIZE) return false;
+    }
+
+    // Skip bodies that are already encoded, or that we've been asked not to touch.
+    KJ_IF_MAYBE(encoding, headers.get(ids.contentEncoding)) {
+      if (!strcaseEqual(trimWhitespace(*encoding), "identity")) return false;
+    }
+    if (headers.get(ids.contentRange) != nullptr) return false;
+    KJ_IF_MAYBE(cacheControl, headers.get(ids.cacheControl)) {
+      kj::ArrayPtr<const char> rest = *cacheControl;
+      while (rest.size() > 0) {
+        auto comma = std::find(rest.begin(), rest.end(), ',');
+        if (strcaseEqual(trimWhitespace(kj::arrayPtr(rest.begin(), comma)), "no-transform")) {
+          return false;
+        }
+        if (comma == rest.end()) break;
+        rest = kj::arrayPtr(comma + 1, rest.end());
+      }
+    }
+
+    auto contentType = KJ_UNWRAP_OR_RETURN(headers.get(kj::HttpHeaderId::CONTENT_TYPE), false);
+    if (!isCompressibleType(contentType)) return false;
+
+    headers.set(ids.contentEncoding, "gzip");
+    headers.unset(kj::HttpHeaderId::CONTENT_LENGTH);
+    KJ_IF_MAYBE(vary, headers.get(ids.vary)) {
+      headers.set(ids.vary, kj::str(*vary, ", Accept-Encoding"));
+    } else {
+      headers.set(ids.vary, "Accept-Encoding");
+    }
+    KJ_IF_MAYBE(etag, headers.get(ids.etag)) {
+      // The compressed body is no longer byte-for-byte what the strong ETag promised.
+      if (etag->startsWith("\"")) {
+        headers.set(ids.etag, kj::str("W/", *etag));
+      }
+    }
+    return true;
+  }
+
 private:
   config::HttpOptions::Style style;
   kj::Maybe<kj::HttpHeaderId> forwardedProtoHeader;
   kj::Maybe<kj::HttpHeaderId> cfBlobHeader;
 
+  struct CompressionHeaders {
+    kj::HttpHeaderId acceptEncoding;
+    kj::HttpHeaderId contentEncoding;
+    kj::HttpHeaderId contentRange;
+    kj::HttpHeaderId cacheControl;
+    kj::HttpHeaderId etag;
+    kj::HttpHeaderId vary;
+  };
+  kj::Maybe<CompressionHeaders> compressionHeaders;
+  // Set if `autoCompress` is enabled.
+
+  static constexpr uint64_t MIN_COMPRESSED_BODY_SIZE = 1024;
+  // Bodies known to be smaller than this aren't worth the gzip header overhead.
+
+  static bool isCompressibleType(kj::StringPtr contentType) {
+    auto mimeType = trimWhitespace(kj::arrayPtr(contentType.begin(),
+        std::find(contentType.begin(), contentType.end(), ';')));
+    auto slash = std::find(mimeType.begin(), mimeType.end(), '/');
+    if (slash == mimeType.end()) return false;
+    auto type = kj::arrayPtr(mimeType.begin(), slash);
+    auto subtype = kj::arrayPtr(slash + 1, mimeType.end());
+
+    // Event streams are excluded because compression would hold back each event until enough
+    // of them arrive to fill a gzip block.
+    if (strcaseEqual(type, "text")) return !strcaseEqual(subtype, "event-stream");
+
+    auto endsWith = [&](kj::StringPtr suffix) {
+      return subtype.size() >= suffix.size() &&
+          strcaseEqual(subtype.slice(subtype.size() - suffix.size()), suffix);
+    };
+    if (endsWith("+json") || endsWith("+xml")) return true;
+
+    if (strcaseEqual(type, "application")) {
+      for (auto compressible: {"json"_kj, "javascript"_kj, "x-javascript"_kj, "ecmascript"_kj,
+                               "xml"_kj, "wasm"_kj, "x-www-form-urlencoded"_kj}) {
+        if (strcaseEqual(subtype, compressible)) return true;
+      }
+    }
+    return false;
+  }
+
+  static bool strcaseEqual(kj::ArrayPtr<const char> a, kj::StringPtr b) {
+    return a.size() == b.size() && strncasecmp(a.begin(), b.begin(), a.size()) == 0;
+  }
+
   class HeaderInjector {
   public:
     HeaderInjector(capnp::List<config::HttpOptions::Header>::Reader headers,
@@ -499,12 +1309,14 @@ class Server::ExternalHttpService final: public Service {
 public:
   ExternalHttpService(kj::Own<kj::NetworkAddress> addrParam,
                       kj::Own<HttpRewriter> rewriter, kj::HttpHeaderTable& headerTable,
-                      kj::Timer& timer, kj::EntropySource& entropySource)
+                      kj::Timer& timer, kj::EntropySource& entropySource,
+                      config::ExternalServer::ConnectionPool::Reader poolConf)
       : addr(kj::mv(addrParam)),
-        inner(kj::newHttpClient(timer, headerTable, *addr, {
+        inner(limitConcurrency(kj::newHttpClient(timer, headerTable, *addr, {
+          .idleTimeout = poolConf.getIdleTimeoutMillis() * kj::MILLISECONDS,
           .entropySource = entropySource,
           .webSocketCompressionMode = kj::HttpClientSettings::MANUAL_COMPRESSION
-        })),
+        }), poolConf.getMaxConcurrentRequests())),
         serviceAdapter(kj::newHttpService(*inner)),
         rewriter(kj::mv(rewriter)) {}
 
@@ -518,6 +1330,17 @@ private:
   kj::Own<kj::HttpClient> inner;
   kj::Own<kj::HttpService> serviceAdapter;
 
+  static kj::Own<kj::HttpClient> limitConcurrency(kj::Own<kj::HttpClient> client, uint limit) {
+    // The client returned by newHttpClient() keeps idle connections around for reuse, but opens
+    // a new one whenever all existing ones are busy. If configured, cap the number of requests
+    // in flight, so a burst of subrequests queues up behind a bounded set of warm (and, for
+    // HTTPS, already-handshaken) connections rather than opening a socket each.
+    if (limit == 0) return kj::mv(client);
+    auto& ref = *client;
+    return kj::newConcurrencyLimitingHttpClient(ref, limit, [](uint, uint) {})
+        .attach(kj::mv(client));
+  }
+
   kj::Own<HttpRewriter> rewriter;
 
   class WorkerInterfaceImpl final: public WorkerInterface, private kj::HttpService::Response {
@@ -542,7 +1365,12 @@ private:
     kj::Promise<void> connect(
         kj::StringPtr host, const kj::HttpHeaders& headers, kj::AsyncIoStream& connection,
         ConnectResponse& tunnel) override {
-      return parent.serviceAdapter->connect(host, headers, connection, tunnel);
+      // The socket options that `connect()` passes along are only meant for a network service
+      // (see NetworkService::connect()), so they aren't sent on to the external server.
+      auto forwarded = kj::heap(headers.cloneShallow());
+      forwarded->unset(api::SOCKET_OPTIONS_HEADER);
+      return parent.serviceAdapter->connect(host, *forwarded, connection, tunnel)
+          .attach(kj::mv(forwarded));
     }
 
     void prewarm(kj::StringPtr url) override {}
@@ -616,7 +1444,8 @@ kj::Own<Server::Service> Server::makeExternalService(
       auto rewriter = kj::heap<HttpRewriter>(conf.getHttp(), headerTableBuilder);
       auto addr = kj::heap<PromisedNetworkAddress>(network.parseAddress(addrStr, 80));
       return kj::heap<ExternalHttpService>(
-          kj::mv(addr), kj::mv(rewriter), globalContext->headerTable, timer, entropySource);
+          kj::mv(addr), kj::mv(rewriter), globalContext->headerTable, timer, entropySource,
+          conf.getConnectionPool());
     }
     case config::ExternalServer::HTTPS: {
       auto httpsConf = conf.getHttps();
@@ -628,7 +1457,8 @@ kj::Own<Server::Service> Server::makeExternalService(
       auto addr = kj::heap<PromisedNetworkAddress>(
           makeTlsNetworkAddress(httpsConf.getTlsOptions(), addrStr, certificateHost, 443));
       return kj::heap<ExternalHttpService>(
-          kj::mv(addr), kj::mv(rewriter), globalContext->headerTable, timer, entropySource);
+          kj::mv(addr), kj::mv(rewriter), globalContext->headerTable, timer, entropySource,
+          conf.getConnectionPool());
     }
   }
   reportConfigError(kj::str(
@@ -645,7 +1475,8 @@ public:
                  kj::Timer& timer, kj::EntropySource& entropySource,
                  kj::Own<kj::Network> networkParam,
                  kj::Maybe<kj::Own<kj::Network>> tlsNetworkParam)
-      : network(kj::mv(networkParam)), tlsNetwork(kj::mv(tlsNetworkParam)),
+      : headerTable(headerTable), network(kj::mv(networkParam)),
+        tlsNetwork(kj::mv(tlsNetworkParam)),
         inner(kj::newHttpClient(timer, headerTable, *network, tlsNetwork, {
           .entropySource = entropySource,
           .webSocketCompressionMode = kj::HttpClientSettings::MANUAL_COMPRESSION
@@ -660,16 +1491,78 @@ public:
       kj::StringPtr host, const kj::HttpHeaders& headers, kj::AsyncIoStream& connection,
       ConnectResponse& tunnel) override {
     // This code is hit when the global `connect` function is called in a JS worker script.
-    // It represents a proxy-less TCP connection, which means we can simply defer the handling of
-    // the connection to the service adapter (likely NetworkHttpClient). Its behaviour will be to
-    // connect directly to the host over TCP.
-    return serviceAdapter->connect(host, headers, connection, tunnel);
-  }
-
-private:
-  kj::Own<kj::Network> network;
-  kj::Maybe<kj::Own<kj::Network>> tlsNetwork;
-  kj::Own<kj::HttpClient> inner;
+    // It represents a proxy-less TCP connection, so we connect directly to the host, applying the
+    // socket options passed along by `connect()`. Without those, we simply defer the handling of
+    // the connection to the service adapter.
+    kj::Maybe<kj::StringPtr> optionsHeader;
+    headers.forEach([&](kj::StringPtr name, kj::StringPtr value) {
+      if (strcasecmp(name.cStr(), api::SOCKET_OPTIONS_HEADER.cStr()) == 0) {
+        optionsHeader = value;
+      }
+    });
+    KJ_IF_MAYBE(o, optionsHeader) {
+      bool useTls = false;
+      int noDelay = 0;
+      int keepAlive = 0;
+      kj::StringPtr rest = *o;
+      while (rest.size() > 0) {
+        kj::ArrayPtr<const char> flag = rest;
+        KJ_IF_MAYBE(comma, rest.findFirst(',')) {
+          flag = rest.slice(0, *comma);
+          rest = rest.slice(*comma + 1);
+        } else {
+          rest = nullptr;
+        }
+        if (flag == api::SOCKET_OPTION_TLS.asArray()) {
+          useTls = true;
+        } else if (flag == api::SOCKET_OPTION_NO_DELAY.asArray()) {
+          noDelay = 1;
+        } else if (flag == api::SOCKET_OPTION_KEEP_ALIVE.asArray()) {
+          keepAlive = 1;
+        }
+      }
+
+      kj::Network* targetNetwork = network.get();
+      if (useTls) {
+        targetNetwork = JSG_REQUIRE_NONNULL(tlsNetwork, Error,
+            "This network service is not configured for TLS connections.").get();
+      }
+
+      return targetNetwork->parseAddress(host)
+          .then([](kj::Own<kj::NetworkAddress> addr) {
+        return addr->connect().attach(kj::mv(addr));
+      }).then([this, &connection, &tunnel, noDelay, keepAlive](
+          kj::Own<kj::AsyncIoStream> stream) -> kj::Promise<void> {
+        // Not every destination is a TCP socket (a network service may permit Unix sockets), so
+        // options that don't apply are ignored.
+        kj::runCatchingExceptions([&]() {
+          stream->setsockopt(IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+        });
+        kj::runCatchingExceptions([&]() {
+          stream->setsockopt(SOL_SOCKET, SO_KEEPALIVE, &keepAlive, sizeof(keepAlive));
+        });
+
+        tunnel.accept(200, "OK", kj::HttpHeaders(headerTable));
+
+        auto upstream = connection.pumpTo(*stream).then([&stream = *stream](uint64_t) {
+          stream.shutdownWrite();
+        });
+        auto downstream = stream->pumpTo(connection).then([&connection](uint64_t) {
+          connection.shutdownWrite();
+        });
+        return kj::joinPromises(kj::arr(kj::mv(upstream), kj::mv(downstream)))
+            .attach(kj::mv(stream));
+      });
+    } else {
+      return serviceAdapter->connect(host, headers, connection, tunnel);
+    }
+  }
+
+private:
+  kj::HttpHeaderTable& headerTable;
+  kj::Own<kj::Network> network;
+  kj::Maybe<kj::Own<kj::Network>> tlsNetwork;
+  kj::Own<kj::HttpClient> inner;
   kj::Own<kj::HttpService> serviceAdapter;
 
   kj::Promise<void> request(
@@ -699,6 +1592,10 @@ kj::Own<Server::Service> Server::makeNetworkService(config::Network::Reader conf
       KJ_MAP(a, conf.getAllow()) -> kj::StringPtr { return a; },
       KJ_MAP(a, conf.getDeny() ) -> kj::StringPtr { return a; });
 
+  // Cache lookups on top of the restrictions, so that the allow/deny verdict is cached too.
+  restrictedNetwork = newCachingNetwork(*restrictedNetwork, timer)
+      .attach(kj::mv(restrictedNetwork));
+
   kj::Maybe<kj::Own<kj::Network>> tlsNetwork;
   if (conf.hasTlsOptions()) {
     auto tlsContext = makeTlsContext(conf.getTlsOptions());
@@ -715,27 +1612,199 @@ class Server::DiskDirectoryService final: public Service, private WorkerInterfac
 public:
   DiskDirectoryService(config::DiskDirectory::Reader conf,
                        kj::Own<const kj::Directory> dir,
-                       kj::HttpHeaderTable::Builder& headerTableBuilder)
-      : writable(*dir), readable(kj::mv(dir)), headerTable(headerTableBuilder.getFutureTable()),
-        hLastModified(headerTableBuilder.add("Last-Modified")),
-        allowDotfiles(conf.getAllowDotfiles()) {}
+                       kj::HttpHeaderTable::Builder& headerTableBuilder, kj::Timer& timer)
+      : DiskDirectoryService(conf, kj::Own<const kj::ReadableDirectory>(kj::mv(dir)),
+                             headerTableBuilder, timer) {
+    writable = kj::downcast<const kj::Directory>(*readable);
+  }
   DiskDirectoryService(config::DiskDirectory::Reader conf,
                        kj::Own<const kj::ReadableDirectory> dir,
-                       kj::HttpHeaderTable::Builder& headerTableBuilder)
+                       kj::HttpHeaderTable::Builder& headerTableBuilder, kj::Timer& timer)
       : readable(kj::mv(dir)), headerTable(headerTableBuilder.getFutureTable()),
         hLastModified(headerTableBuilder.add("Last-Modified")),
-        allowDotfiles(conf.getAllowDotfiles()) {}
+        hAcceptRanges(headerTableBuilder.add("Accept-Ranges")),
+        hContentRange(headerTableBuilder.add("Content-Range")),
+        hRange(headerTableBuilder.add("Range")),
+        hIfRange(headerTableBuilder.add("If-Range")),
+        hETag(headerTableBuilder.add("ETag")),
+        hIfNoneMatch(headerTableBuilder.add("If-None-Match")),
+        hIfModifiedSince(headerTableBuilder.add("If-Modified-Since")),
+        hAcceptEncoding(headerTableBuilder.add("Accept-Encoding")),
+        hContentEncoding(headerTableBuilder.add("Content-Encoding")),
+        hVary(headerTableBuilder.add("Vary")),
+        allowDotfiles(conf.getAllowDotfiles()) {
+    if (conf.hasMemoryCache()) {
+      cache.emplace(conf.getMemoryCache(), timer);
+    }
+  }
 
   kj::Own<WorkerInterface> startRequest(IoChannelFactory::SubrequestMetadata metadata) override {
     return { this, kj::NullDisposer::instance };
   }
 
+  kj::Maybe<const kj::Directory&> getWritable() { return writable; }
+  // Returns the directory if this service was configured as writable.
+
 private:
   kj::Maybe<const kj::Directory&> writable;
   kj::Own<const kj::ReadableDirectory> readable;
   kj::HttpHeaderTable& headerTable;
   kj::HttpHeaderId hLastModified;
+  kj::HttpHeaderId hAcceptRanges;
+  kj::HttpHeaderId hContentRange;
+  kj::HttpHeaderId hRange;
+  kj::HttpHeaderId hIfRange;
+  kj::HttpHeaderId hETag;
+  kj::HttpHeaderId hIfNoneMatch;
+  kj::HttpHeaderId hIfModifiedSince;
+  kj::HttpHeaderId hAcceptEncoding;
+  kj::HttpHeaderId hContentEncoding;
+  kj::HttpHeaderId hVary;
   bool allowDotfiles;
+  kj::Maybe<DiskFileCache> cache;
+
+  static constexpr uint64_t MMAP_THRESHOLD = 64 * 1024;
+  // File content at least this big is sent directly from a memory mapping rather than read into a
+  // buffer first.
+
+  static kj::Promise<void> sendFileContent(
+      kj::AsyncOutputStream& out, const kj::ReadableFile& file, ByteRange range) {
+    // Writes bytes [start, end) of `file` to `out`.
+    //
+    // Large ranges are written straight out of a read-only mapping of the file, so the content is
+    // never copied through a userspace buffer: for a plain TCP connection the kernel copies from
+    // the page cache directly into the socket. Mapping has a fixed cost that isn't worth paying
+    // for small files, which are simply read().
+    //
+    // Note that files written through this service are replaced atomically (see PUT below), so
+    // an in-flight response keeps seeing the old content rather than a truncated mapping.
+
+    uint64_t size = range.end - range.start;
+    if (size == 0) return kj::READY_NOW;
+
+    kj::Array<const kj::byte> content;
+    if (size >= MMAP_THRESHOLD) {
+      content = file.mmap(range.start, size);
+    } else {
+      auto buffer = kj::heapArray<kj::byte>(size);
+      size_t n = file.read(range.start, buffer);
+      KJ_REQUIRE(n == size, "file changed size while being served");
+      content = kj::mv(buffer);
+    }
+
+    auto promise = out.write(content.begin(), content.size());
+    return promise.attach(kj::mv(content));
+  }
+
+  static bool etagMatches(kj::StringPtr ifNoneMatch, kj::StringPtr etag) {
+    // Check whether an `If-None-Match` header value matches `etag`, using the weak comparison
+    // that RFC 9110 prescribes for this header.
+
+    size_t pos = 0;
+    while (pos < ifNoneMatch.size()) {
+      size_t end = pos;
+      while (end < ifNoneMatch.size() && ifNoneMatch[end] != ',') ++end;
+      auto candidate = trimWhitespace(ifNoneMatch.slice(pos, end));
+      pos = end + 1;
+
+      if (candidate.size() == 1 && candidate[0] == '*') return true;
+      if (candidate.size() >= 2 && candidate[0] == 'W' && candidate[1] == '/') {
+        candidate = candidate.slice(2);
+      }
+      if (candidate == etag.asArray()) return true;
+    }
+    return false;
+  }
+
+  kj::Promise<void> serveCached(
+      kj::HttpMethod method, const kj::HttpHeaders& requestHeaders, DiskFileCache::Entry& entry,
+      kj::Maybe<kj::StringPtr> requestedRange, kj::Maybe<kj::StringPtr> ifRange,
+      kj::HttpService::Response& response) {
+    // Serves a GET or HEAD for a file held in the memory cache. Unlike the uncached path, this
+    // honors conditional requests and may pick a precompressed variant.
+
+    auto& c = KJ_ASSERT_NONNULL(cache);
+
+    kj::HttpHeaders headers(headerTable);
+    headers.set(kj::HttpHeaderId::CONTENT_TYPE, "application/octet-stream");
+    headers.set(hLastModified, entry.lastModifiedText);
+    headers.set(hAcceptRanges, "bytes");
+    if (c.isGzipEnabled()) {
+      headers.set(hVary, "Accept-Encoding");
+    }
+
+    kj::ArrayPtr<const kj::byte> body = entry.content;
+    kj::StringPtr etag = entry.etag;
+    uint statusCode = 200;
+    kj::StringPtr statusText = "OK";
+
+    KJ_IF_MAYBE(validator, ifRange) {
+      if (*validator != entry.lastModifiedText && *validator != entry.etag) {
+        requestedRange = nullptr;
+      }
+    }
+
+    KJ_IF_MAYBE(rangeText, requestedRange) {
+      // Ranges always refer to the identity encoding.
+      KJ_IF_MAYBE(parsed, parseRangeHeader(*rangeText, body.size())) {
+        KJ_SWITCH_ONEOF(*parsed) {
+          KJ_CASE_ONEOF(r, ByteRange) {
+            headers.set(hContentRange,
+                kj::str("bytes ", r.start, "-", r.end - 1, "/", body.size()));
+            body = body.slice(r.start, r.end);
+            statusCode = 206;
+            statusText = "Partial Content";
+          }
+          KJ_CASE_ONEOF(_, UnsatisfiableRange) {
+            kj::HttpHeaders errorHeaders(headerTable);
+            errorHeaders.set(hContentRange, kj::str("bytes */", body.size()));
+            return response.sendError(416, "Range Not Satisfiable", errorHeaders);
+          }
+        }
+      }
+    }
+
+    if (statusCode == 200) {
+      KJ_IF_MAYBE(acceptEncoding, requestHeaders.get(hAcceptEncoding)) {
+        if (acceptsGzip(*acceptEncoding)) {
+          KJ_IF_MAYBE(gzipped, c.getGzipped(entry)) {
+            body = *gzipped;
+            etag = entry.gzipEtag;
+            headers.set(hContentEncoding, "gzip");
+          }
+        }
+      }
+    }
+
+    headers.set(hETag, etag);
+
+    bool notModified = false;
+    KJ_IF_MAYBE(ifNoneMatch, requestHeaders.get(hIfNoneMatch)) {
+      notModified = etagMatches(*ifNoneMatch, etag);
+    } else KJ_IF_MAYBE(ifModifiedSince, requestHeaders.get(hIfModifiedSince)) {
+      // We only have second granularity to compare against, so an exact match of the date we
+      // handed out is the only reliable signal.
+      notModified = *ifModifiedSince == entry.lastModifiedText;
+    }
+    if (notModified) {
+      headers.unset(hContentRange);
+      response.send(304, "Not Modified", headers);
+      return kj::READY_NOW;
+    }
+
+    // See the uncached path for why Content-Length is set explicitly.
+    headers.set(kj::HttpHeaderId::CONTENT_LENGTH, kj::str(body.size()));
+
+    auto out = response.send(statusCode, statusText, headers, body.size());
+
+    if (method == kj::HttpMethod::HEAD) {
+      return kj::READY_NOW;
+    } else {
+      // The entry may be evicted while we're writing, so hold a reference to it.
+      return out->write(body.begin(), body.size())
+          .attach(kj::mv(out), kj::addRef(entry));
+    }
+  }
 
   kj::Promise<void> request(
       kj::HttpMethod method, kj::StringPtr urlStr, const kj::HttpHeaders& headers,
@@ -765,6 +1834,15 @@ private:
         return response.sendError(404, "Not Found", headerTable);
       }
 
+      kj::Maybe<kj::StringPtr> requestedRange = headers.get(hRange);
+      kj::Maybe<kj::StringPtr> ifRange = headers.get(hIfRange);
+
+      KJ_IF_MAYBE(c, cache) {
+        KJ_IF_MAYBE(entry, c->lookup(*readable, path)) {
+          return serveCached(method, headers, **entry, requestedRange, ifRange, response);
+        }
+      }
+
       auto file = KJ_UNWRAP_OR(readable->tryOpenFile(path), {
         return response.sendError(404, "Not Found", headerTable);
       });
@@ -774,8 +1852,39 @@ private:
       switch (meta.type) {
         case kj::FsNode::Type::FILE: {
           kj::HttpHeaders headers(headerTable);
+          auto lastModified = httpTime(meta.lastModified);
           headers.set(kj::HttpHeaderId::CONTENT_TYPE, "application/octet-stream");
-          headers.set(hLastModified, httpTime(meta.lastModified));
+          headers.set(hLastModified, lastModified);
+          headers.set(hAcceptRanges, "bytes");
+
+          KJ_IF_MAYBE(validator, ifRange) {
+            // The range only applies if the client's copy is still current. The only validator we
+            // hand out is the modification date, which must match exactly.
+            if (*validator != lastModified) requestedRange = nullptr;
+          }
+
+          uint statusCode = 200;
+          kj::StringPtr statusText = "OK";
+          ByteRange range { 0, meta.size };
+          KJ_IF_MAYBE(rangeText, requestedRange) {
+            KJ_IF_MAYBE(parsed, parseRangeHeader(*rangeText, meta.size)) {
+              KJ_SWITCH_ONEOF(*parsed) {
+                KJ_CASE_ONEOF(r, ByteRange) {
+                  range = r;
+                  statusCode = 206;
+                  statusText = "Partial Content";
+                  headers.set(hContentRange,
+                      kj::str("bytes ", r.start, "-", r.end - 1, "/", meta.size));
+                }
+                KJ_CASE_ONEOF(_, UnsatisfiableRange) {
+                  kj::HttpHeaders errorHeaders(headerTable);
+                  errorHeaders.set(hContentRange, kj::str("bytes */", meta.size));
+                  return response.sendError(416, "Range Not Satisfiable", errorHeaders);
+                }
+              }
+            }
+          }
+          uint64_t length = range.end - range.start;
 
           // We explicitly set the Content-Length header because if we don't, and we were called
           // by a local Worker (without an actual HTTP connection in between), then the Worker
@@ -785,18 +1894,15 @@ private:
           //   if no `Content-Length` header is returned, but the body size is known via the KJ
           //   HTTP API, then the header shoud be filled in automatically. Unclear if this is safe
           //   to change without a compat flag.
-          headers.set(kj::HttpHeaderId::CONTENT_LENGTH, kj::str(meta.size));
+          headers.set(kj::HttpHeaderId::CONTENT_LENGTH, kj::str(length));
 
-          auto out = response.send(200, "OK", headers, meta.size);
+          auto out = response.send(statusCode, statusText, headers, length);
 
           if (method == kj::HttpMethod::HEAD) {
             return kj::READY_NOW;
           } else {
-            auto in = kj::heap<kj::FileInputStream>(*file);
-
-            return in->pumpTo(*out, meta.size)
-                .ignoreResult()
-                .attach(kj::mv(in), kj::mv(out), kj::mv(file));
+            return sendFileContent(*out, *file, range)
+                .attach(kj::mv(out), kj::mv(file));
           }
         }
         case kj::FsNode::Type::DIRECTORY: {
@@ -862,8 +1968,10 @@ private:
       auto stream = kj::heap<kj::FileOutputStream>(replacer->get());
 
       return requestBody.pumpTo(*stream).attach(kj::mv(stream))
-          .then([this, replacer = kj::mv(replacer), &response](uint64_t) mutable {
+          .then([this, path = kj::mv(path), replacer = kj::mv(replacer), &response](uint64_t)
+                mutable {
         replacer->commit();
+        KJ_IF_MAYBE(c, cache) c->invalidate(path);
         kj::HttpHeaders headers(headerTable);
         response.send(204, "No Content", headers);
       });
@@ -919,7 +2027,7 @@ kj::Own<Server::Service> Server::makeDiskDirectoryService(
       return makeInvalidConfigService();
     });
 
-    return kj::heap<DiskDirectoryService>(conf, kj::mv(openDir), headerTableBuilder);
+    return kj::heap<DiskDirectoryService>(conf, kj::mv(openDir), headerTableBuilder, timer);
   } else {
     auto openDir = KJ_UNWRAP_OR(fs.getRoot().tryOpenSubdir(kj::mv(path)), {
       reportConfigError(kj::str(
@@ -927,7 +2035,7 @@ kj::Own<Server::Service> Server::makeDiskDirectoryService(
       return makeInvalidConfigService();
     });
 
-    return kj::heap<DiskDirectoryService>(conf, kj::mv(openDir), headerTableBuilder);
+    return kj::heap<DiskDirectoryService>(conf, kj::mv(openDir), headerTableBuilder, timer);
   }
 }
 
@@ -1054,8 +2162,10 @@ public:
           fields.add(kj::str("\"description\":\"workerd worker\""));
           fields.add(kj::str("\"webSocketDebuggerUrl\":\"ws://",
                               baseWsUrl ,"/", entry.key ,"\""));
-          fields.add(kj::str("\"devtoolsFrontendUrl\":\"devtools://devtools/bundled/js_app.html?experiments=true&v8only=true&ws=", baseWsUrl ,"/\""));
-          fields.add(kj::str("\"devtoolsFrontendUrlCompat\":\"devtools://devtools/bundled/inspector.html?experiments=true&v8only=true&ws=", baseWsUrl ,"/\""));
+          fields.add(kj::str("\"devtoolsFrontendUrl\":\"devtools://devtools/bundled/js_app.html"
+                             "?experiments=true&v8only=true&ws=", baseWsUrl ,"/\""));
+          fields.add(kj::str("\"devtoolsFrontendUrlCompat\":\"devtools://devtools/bundled/"
+                             "inspector.html?experiments=true&v8only=true&ws=", baseWsUrl ,"/\""));
           fields.add(kj::str("\"faviconUrl\":\"https://workers.cloudflare.com/favicon.ico\""));
           fields.add(kj::str("\"url\":\"https://workers.dev\""));
           entries.add(kj::str('{', kj::strArray(fields, ",") ,'}'));
@@ -1073,6 +2183,31 @@ public:
 
       auto content = kj::str('[', kj::strArray(entries, ","), ']');
 
+      auto out = response.send(200, "OK", responseHeaders, content.size());
+      return out->write(content.begin(), content.size()).attach(kj::mv(content), kj::mv(out));
+    } else if (url.endsWith("/json/locks")) {
+      // Not part of the inspector protocol: isolate lock statistics, for finding out which Worker
+      // is keeping a thread busy. Durations are in microseconds.
+      responseHeaders.set(kj::HttpHeaderId::CONTENT_TYPE, "application/json"_kj);
+
+      auto micros = [](kj::Duration d) { return d / kj::MICROSECONDS; };
+      kj::Vector<kj::String> entries(isolates.size());
+      for (auto& entry : isolates) {
+        KJ_IF_MAYBE(ref, entry.value->tryAddStrongRef()) {
+          auto stats = (*ref)->getLockStats();
+          entries.add(kj::str(
+              "{\"id\":\"", entry.key, "\","
+              "\"syncLocks\":", stats.syncLocks, ","
+              "\"asyncLocks\":", stats.asyncLocks, ","
+              "\"totalWaitMicros\":", micros(stats.totalWait), ","
+              "\"totalHoldMicros\":", micros(stats.totalHold), ","
+              "\"maxHoldMicros\":", micros(stats.maxHold), ","
+              "\"longHolds\":", stats.longHolds, "}"));
+        }
+      }
+
+      auto content = kj::str('[', kj::strArray(entries, ","), ']');
+
       auto out = response.send(200, "OK", responseHeaders, content.size());
       return out->write(content.begin(), content.size()).attach(kj::mv(content), kj::mv(out));
     }
@@ -1084,8 +2219,12 @@ public:
     return server.listenHttp(*listener).attach(kj::mv(listener));
   }
 
-  void registerIsolate(kj::StringPtr name, Worker::Isolate* isolate) {
-    isolates.insert(kj::str(name), isolate->getWeakRef());
+  void registerIsolate(kj::StringPtr name, const Worker::Isolate& isolate) {
+    // Replaces any isolate registered under the same name before, since a Worker that is evicted
+    // gets a new isolate when it's next instantiated.
+    isolates.upsert(kj::str(name), isolate.getWeakRef(), [](auto& existing, auto&& replacement) {
+      existing = kj::mv(replacement);
+    });
   }
 
 private:
@@ -1104,6 +2243,290 @@ kj::Own<Server::InspectorService> Server::makeInspectorService(
 
 // =======================================================================================
 
+class Server::ActorRouter final: public kj::HttpService, public ActorPlacement::Thread,
+                                 private kj::TaskSet::ErrorHandler {
+  // Carries requests for Durable Objects between threads, when the server runs on several. A
+  // request for an object homed on another thread is sent there over HTTP, on a pool of
+  // connections to that thread, with headers naming the object; the home thread looks the
+  // object up and delivers the request to it. Only HTTP requests (including WebSocket upgrades)
+  // can be forwarded, but those are the only events other Workers can send an object. A thread
+  // can also have an object opened on its home thread without sending it anything, which hands
+  // the object's alarm to the home thread (see wakeRemoteActor()).
+
+public:
+  ActorRouter(Server& server, const ActorPlacementOptions& options,
+              kj::HttpHeaderTable::Builder& headerTableBuilder)
+      : server(server), placement(kj::atomicAddRef(*options.placement)),
+        lowLevelProvider(options.lowLevelProvider), threadIndex(options.threadIndex),
+        headerTable(headerTableBuilder.getFutureTable()),
+        headerIds {
+          .service = headerTableBuilder.add("Workerd-Actor-Service"),
+          .className = headerTableBuilder.add("Workerd-Actor-Class"),
+          .id = headerTableBuilder.add("Workerd-Actor-Id"),
+          .name = headerTableBuilder.add("Workerd-Actor-Name"),
+          .cfBlob = headerTableBuilder.add("Workerd-Actor-Cf"),
+          .wake = headerTableBuilder.add("Workerd-Actor-Wake"),
+        },
+        threadClients(kj::heapArray<kj::Maybe<kj::Own<ThreadClient>>>(
+            placement->getThreadCount())),
+        httpServer(server.timer, headerTable, *this),
+        connectionTasks(*this) {}
+
+  void startServing() {
+    // Starts accepting requests from other threads. Call once the services are linked.
+    registration = placement->registerThread(threadIndex, *this);
+  }
+
+  uint getThreadIndex() { return threadIndex; }
+  uint getThreadCount() { return placement->getThreadCount(); }
+
+  bool isHome(kj::StringPtr actorId) {
+    // Is the object with this ID (or ephemeral name) homed on this thread?
+    return placement->getHomeThread(actorId) == threadIndex;
+  }
+
+  kj::Maybe<kj::Own<IoChannelFactory::ActorChannel>> getRemoteActor(
+      kj::StringPtr serviceName, kj::StringPtr className, const Worker::Actor::Id& id) {
+    // Returns a channel to the object if it's homed on another thread, or null if it lives on
+    // this one.
+    Route route {
+      .service = kj::str(serviceName),
+      .className = kj::str(className),
+    };
+    KJ_SWITCH_ONEOF(id) {
+      KJ_CASE_ONEOF(obj, kj::Own<ActorIdFactory::ActorId>) {
+        route.id = obj->toString();
+        route.name = obj->getName().map([](kj::StringPtr name) { return kj::str(name); });
+      }
+      KJ_CASE_ONEOF(str, kj::String) {
+        route.id = kj::str(str);
+      }
+    }
+
+    uint home = placement->getHomeThread(route.id);
+    if (home == threadIndex) {
+      return nullptr;
+    }
+
+    return kj::Own<IoChannelFactory::ActorChannel>(
+        kj::heap<RemoteActorChannel>(getThreadClient(home), kj::mv(route)));
+  }
+
+  kj::Promise<void> wakeRemoteActor(kj::StringPtr serviceName, kj::StringPtr className,
+                                    kj::StringPtr actorId) {
+    // Opens the object with this ID on its home thread, which must be another one, without
+    // delivering it any event. Opening the object's storage reports its alarm to the home
+    // thread's alarm scheduler.
+    uint home = placement->getHomeThread(actorId);
+    KJ_REQUIRE(home != threadIndex);
+    auto client = getThreadClient(home);
+
+    kj::HttpHeaders headers(headerTable);
+    headers.set(headerIds.service, kj::encodeUriComponent(serviceName));
+    headers.set(headerIds.className, kj::encodeUriComponent(className));
+    headers.set(headerIds.id, kj::encodeUriComponent(actorId));
+    headers.set(headerIds.wake, "1");
+    auto response = co_await client->client->request(
+        kj::HttpMethod::POST, "/", headers, uint64_t(0)).response;
+    KJ_REQUIRE(response.statusCode == 204, "waking a Durable Object on its home thread failed",
+               response.statusCode, response.statusText);
+  }
+
+  kj::Promise<void> request(
+      kj::HttpMethod method, kj::StringPtr url, const kj::HttpHeaders& headers,
+      kj::AsyncInputStream& requestBody, kj::HttpService::Response& response) override;
+  // Delivers a request forwarded from another thread. Defined after ServiceSlot.
+
+  void acceptConnection(kj::AutoCloseFd fd) override {
+    connectionTasks.add(httpServer.listenHttp(lowLevelProvider.wrapSocketFd(kj::mv(fd))));
+  }
+
+private:
+  struct HeaderIds {
+    kj::HttpHeaderId service;
+    kj::HttpHeaderId className;
+    kj::HttpHeaderId id;
+    kj::HttpHeaderId name;
+    kj::HttpHeaderId cfBlob;
+    kj::HttpHeaderId wake;
+    // Set instead of forwarding a request, by wakeRemoteActor().
+
+    void unsetAll(kj::HttpHeaders& headers) const {
+      for (auto header: {service, className, id, name, cfBlob, wake}) {
+        headers.unset(header);
+      }
+    }
+  };
+
+  struct Route {
+    // Which object a forwarded request is for.
+    kj::String service;
+    kj::String className;
+    kj::String id;
+    kj::Maybe<kj::String> name;
+  };
+
+  class ThreadAddress final: public kj::NetworkAddress {
+    // Connects to another thread's ActorRouter.
+
+  public:
+    ThreadAddress(kj::Own<const ActorPlacement> placement,
+                  kj::LowLevelAsyncIoProvider& lowLevelProvider, uint index)
+        : placement(kj::mv(placement)), lowLevelProvider(lowLevelProvider), index(index) {}
+
+    kj::Promise<kj::Own<kj::AsyncIoStream>> connect() override {
+      return placement->connect(index).then([&lowLevelProvider = lowLevelProvider]
+                                            (kj::AutoCloseFd fd) {
+        return lowLevelProvider.wrapSocketFd(kj::mv(fd));
+      });
+    }
+    kj::Own<kj::ConnectionReceiver> listen() override {
+      KJ_UNIMPLEMENTED("can't listen on another thread");
+    }
+    kj::Own<kj::NetworkAddress> clone() override {
+      return kj::heap<ThreadAddress>(kj::atomicAddRef(*placement), lowLevelProvider, index);
+    }
+    kj::String toString() override {
+      return kj::str("thread ", index);
+    }
+
+  private:
+    kj::Own<const ActorPlacement> placement;
+    kj::LowLevelAsyncIoProvider& lowLevelProvider;
+    uint index;
+  };
+
+  class ThreadClient final: public kj::Refcounted {
+    // Connections to one other thread. Refcounted because channels handed to Workers may outlive
+    // the ActorRouter.
+
+  public:
+    ThreadClient(ActorRouter& router, uint index)
+        : headerIds(router.headerIds),
+          address(kj::atomicAddRef(*router.placement), router.lowLevelProvider, index),
+          client(kj::newHttpClient(router.server.timer, router.headerTable, address, {
+            .entropySource = router.server.entropySource,
+            .webSocketCompressionMode = kj::HttpClientSettings::MANUAL_COMPRESSION
+          })),
+          serviceAdapter(kj::newHttpService(*client)) {}
+
+    HeaderIds headerIds;
+    ThreadAddress address;
+    kj::Own<kj::HttpClient> client;
+    kj::Own<kj::HttpService> serviceAdapter;
+  };
+
+  class RemoteActorChannel final: public IoChannelFactory::ActorChannel {
+  public:
+    RemoteActorChannel(kj::Own<ThreadClient> client, Route route)
+        : client(kj::mv(client)), route(kj::mv(route)) {}
+
+    kj::Own<WorkerInterface> startRequest(
+        IoChannelFactory::SubrequestMetadata metadata) override {
+      return kj::heap<RemoteActorWorkerInterface>(kj::addRef(*client), Route {
+        .service = kj::str(route.service),
+        .className = kj::str(route.className),
+        .id = kj::str(route.id),
+        .name = route.name.map([](kj::StringPtr name) { return kj::str(name); }),
+      }, kj::mv(metadata.cfBlobJson));
+    }
+
+  private:
+    kj::Own<ThreadClient> client;
+    Route route;
+  };
+
+  class RemoteActorWorkerInterface final: public WorkerInterface {
+  public:
+    RemoteActorWorkerInterface(kj::Own<ThreadClient> client, Route route,
+                               kj::Maybe<kj::String> cfBlobJson)
+        : client(kj::mv(client)), route(kj::mv(route)), cfBlobJson(kj::mv(cfBlobJson)) {}
+
+    kj::Promise<void> request(
+        kj::HttpMethod method, kj::StringPtr url, const kj::HttpHeaders& headers,
+        kj::AsyncInputStream& requestBody, kj::HttpService::Response& response) override {
+      auto routed = kj::heap(addRouting(headers));
+      auto promise = client->serviceAdapter->request(method, url, *routed, requestBody, response);
+      return promise.attach(kj::mv(routed));
+    }
+    kj::Promise<void> connect(kj::StringPtr host, const kj::HttpHeaders& headers,
+        kj::AsyncIoStream& connection, kj::HttpService::ConnectResponse& response) override {
+      auto routed = kj::heap(addRouting(headers));
+      auto promise = client->serviceAdapter->connect(host, *routed, connection, response);
+      return promise.attach(kj::mv(routed));
+    }
+
+    void prewarm(kj::StringPtr url) override {}
+    kj::Promise<ScheduledResult> runScheduled(kj::Date scheduledTime,
+                                              kj::StringPtr cron) override {
+      throwUnsupported();
+    }
+    kj::Promise<AlarmResult> runAlarm(kj::Date scheduledTime) override {
+      throwUnsupported();
+    }
+    kj::Promise<CustomEvent::Result> customEvent(kj::Own<CustomEvent> event) override {
+      throwUnsupported();
+    }
+
+  private:
+    kj::Own<ThreadClient> client;
+    Route route;
+    kj::Maybe<kj::String> cfBlobJson;
+
+    kj::HttpHeaders addRouting(const kj::HttpHeaders& headers) {
+      // Adds the routing headers, replacing any the caller sent: those can only be trusted
+      // coming from this ActorRouter.
+      auto& ids = client->headerIds;
+      auto result = headers.cloneShallow();
+      ids.unsetAll(result);
+      result.set(ids.service, kj::encodeUriComponent(route.service));
+      result.set(ids.className, kj::encodeUriComponent(route.className));
+      result.set(ids.id, kj::encodeUriComponent(route.id));
+      KJ_IF_MAYBE(name, route.name) {
+        result.set(ids.name, kj::encodeUriComponent(*name));
+      }
+      KJ_IF_MAYBE(cf, cfBlobJson) {
+        result.set(ids.cfBlob, kj::encodeUriComponent(*cf));
+      }
+      return result;
+    }
+
+    [[noreturn]] void throwUnsupported() {
+      JSG_FAIL_REQUIRE(Error,
+          "Only HTTP requests can be sent to a Durable Object on another thread.");
+    }
+  };
+
+  Server& server;
+  kj::Own<const ActorPlacement> placement;
+  kj::LowLevelAsyncIoProvider& lowLevelProvider;
+  uint threadIndex;
+  kj::HttpHeaderTable& headerTable;
+  HeaderIds headerIds;
+
+  kj::Array<kj::Maybe<kj::Own<ThreadClient>>> threadClients;
+  // Created on first use. This thread's own entry is never used.
+
+  kj::Own<ThreadClient> getThreadClient(uint index) {
+    auto& slot = threadClients[index];
+    if (slot == nullptr) {
+      slot = kj::refcounted<ThreadClient>(*this, index);
+    }
+    return kj::addRef(*KJ_ASSERT_NONNULL(slot));
+  }
+
+  kj::HttpServer httpServer;
+  kj::TaskSet connectionTasks;
+  kj::Own<void> registration;
+  // Declared last, so that no more connections are accepted once destruction begins.
+
+  void taskFailed(kj::Exception&& exception) override {
+    KJ_LOG(ERROR, "connection from another thread failed", exception);
+  }
+};
+
+// =======================================================================================
+
 class Server::WorkerService final: public Service, private kj::TaskSet::ErrorHandler,
                                    private IoChannelFactory, private TimerChannel,
                                    private LimitEnforcer {
@@ -1115,22 +2538,87 @@ public:
     kj::Array<Service*> subrequest;
     kj::Array<kj::Maybe<ActorNamespace&>> actor;  // null = configuration error
     kj::Maybe<Service&> cache;
+    kj::Maybe<const kj::Directory&> actorStorage;  // null = in-memory
+    kj::Array<kj::Maybe<kj::Own<AnalyticsBatcher>>> logfwdr;  // null = configuration error
   };
   using LinkCallback = kj::Function<LinkedIoChannels(WorkerService&)>;
 
-  WorkerService(ThreadContext& threadContext, kj::Own<const Worker> worker,
-                kj::HashSet<kj::String> namedEntrypointsParam,
+  struct IdleGcOptions {
+    // From `config::Worker::GarbageCollection`.
+    kj::Duration delay;
+    kj::Duration budget;
+  };
+
+  struct Instance {
+    // A Worker's isolate pool, plus what was learned about the Worker while creating it.
+    kj::Array<kj::Own<const Worker>> workers;
+    kj::HashSet<kj::String> namedEntrypoints;
+
+    kj::Vector<kj::String> errors;
+    // Validation errors in the Worker's script. These are config errors, but instantiate() may
+    // run on another thread, so it's up to the caller to report them.
+  };
+
+  struct Definition {
+    // Everything needed to instantiate a Worker, computed from its config by makeWorker().
+    // instantiate() touches nothing else, so it's safe to call from any thread. It's called again
+    // each time the Worker is needed after being evicted.
+
+    kj::StringPtr name;
+    config::Worker::Reader conf;
+    jsg::V8System& v8System;
+
+    capnp::MallocMessageBuilder featureFlagsArena;
+    CompatibilityFlags::Reader featureFlags;
+
+    WorkerLimits limits;
+    ActorCacheSharedLruOptions lruOptions;
+    kj::Maybe<CpuWatchdog&> watchdog;
+    kj::Maybe<kj::Duration> logGcPausesOver;
+    kj::Maybe<kj::Duration> logLockHoldsOver;
+    bool traceLocks = false;
+    kj::Maybe<kj::Own<const WorkerMetrics>> metrics;
+    uint isolatePoolSize = 1;
+
+    struct ConcurrencyLimit {
+      // From `config::Worker::ConcurrencyLimit`.
+      ConcurrencyLimiterOptions options;
+      uint retryAfterSeconds;
+      kj::Own<const LockWaitSamples> lockWaits;
+      // Filled in by the Worker's isolates, and read by the service's ConcurrencyLimiter.
+    };
+    kj::Maybe<ConcurrencyLimit> concurrencyLimit;
+    bool coalesceSubrequests = false;
+
+    kj::Maybe<const jsg::CodeCache&> codeCache;
+    bool allowInspector = false;
+    kj::Vector<WorkerdApiIsolate::Global> globals;
+
+    Definition(kj::StringPtr name, config::Worker::Reader conf, jsg::V8System& v8System)
+        : name(name), conf(conf), v8System(v8System) {}
+
+    Instance instantiate() const;
+  };
+
+  WorkerService(ThreadContext& threadContext, kj::Own<const Definition> definition,
                 const kj::HashMap<kj::String, ActorConfig>& actorClasses,
-                LinkCallback linkCallback)
-      : threadContext(threadContext), worker(kj::mv(worker)),
+                LinkCallback linkCallback, kj::Maybe<IdleGcOptions> idleGcOptions,
+                kj::Maybe<kj::Duration> evictAfter, kj::Maybe<InspectorService&> inspector,
+                kj::Maybe<SpanExporter&> spanExporter, kj::Maybe<ActorRouter&> actorRouter)
+      : threadContext(threadContext), definition(kj::mv(definition)),
+        idleGcOptions(idleGcOptions), evictAfter(evictAfter), inspector(inspector),
+        spanExporter(spanExporter), actorRouter(actorRouter),
+        idleStates(kj::heapArray<IdleState>(this->definition->isolatePoolSize)),
         ioChannels(kj::mv(linkCallback)),
         waitUntilTasks(*this) {
-    namedEntrypoints.reserve(namedEntrypointsParam.size());
-    for (auto& ep: namedEntrypointsParam) {
-      kj::StringPtr epPtr = ep;
-      namedEntrypoints.insert(kj::mv(ep), EntrypointService(*this, epPtr));
+    KJ_IF_MAYBE(c, this->definition->concurrencyLimit) {
+      limiter = kj::heap<ConcurrencyLimiter>(
+          threadContext.getUnsafeTimer(), c->options, kj::atomicAddRef(*c->lockWaits));
+    }
+    if (this->definition->coalesceSubrequests) {
+      coalescer = kj::heap<SubrequestCoalescer>(this->definition->metrics.map(
+          [](const kj::Own<const WorkerMetrics>& m) -> const WorkerMetrics& { return *m; }));
     }
-
     actorNamespaces.reserve(actorClasses.size());
     for (auto& entry: actorClasses) {
       ActorNamespace ns(*this, entry.key, entry.value);
@@ -1138,14 +2626,65 @@ public:
     }
   }
 
+  const Definition& getDefinition() { return *definition; }
+
+  bool isInstantiated() { return workers.size() > 0; }
+
+  const Worker::Isolate& getHomeIsolate() { return getHomeWorker().getIsolate(); }
+  // Instantiates the Worker first if it hasn't been yet.
+
+  void setInstance(Instance instance) {
+    // Installs the isolate pool created by `getDefinition().instantiate()`. Errors in `instance`
+    // must have been dealt with already.
+    KJ_REQUIRE(instance.workers.size() == definition->isolatePoolSize);
+    workers = kj::mv(instance.workers);
+
+    for (auto& ep: instance.namedEntrypoints) {
+      if (namedEntrypoints.find(ep) == nullptr) {
+        addEntrypoint(kj::mv(ep));
+      }
+    }
+
+    registerWithInspector();
+  }
+
+  void registerWithInspector() {
+    // If we are using the inspector, we need to register the Worker::Isolate with the inspector
+    // service. Only the home isolate is registered, since the inspector identifies isolates by
+    // service name.
+    KJ_IF_MAYBE(i, inspector) {
+      if (isInstantiated()) {
+        i->registerIsolate(definition->name, workers[0]->getIsolate());
+      }
+    }
+  }
+
   kj::Maybe<Service&> getEntrypoint(kj::StringPtr name) {
-    return namedEntrypoints.find(name);
+    KJ_IF_MAYBE(ep, namedEntrypoints.find(name)) {
+      return **ep;
+    } else if (!isInstantiated()) {
+      // We won't know what the Worker exports until it's instantiated on its first request, so
+      // assume the entrypoint exists. If it doesn't, requests to it will fail.
+      return addEntrypoint(kj::str(name));
+    } else {
+      return nullptr;
+    }
   }
 
   void link() override {
     LinkCallback callback = kj::mv(KJ_REQUIRE_NONNULL(
         ioChannels.tryGet<LinkCallback>(), "already called link()"));
     ioChannels = callback(*this);
+
+    for (auto& ns: actorNamespaces) {
+      ns.value.startAlarmScheduler();
+    }
+  }
+
+  kj::Promise<void> onDrained() {
+    // Resolves once no `waitUntil()` tasks are running. Used when the service has been replaced
+    // by a reload, to keep it around until its background work is done.
+    return waitUntilTasks.onEmpty();
   }
 
   kj::Maybe<ActorNamespace&> getActorNamespace(kj::StringPtr name) {
@@ -1160,35 +2699,141 @@ public:
   kj::Own<WorkerInterface> startRequest(
       IoChannelFactory::SubrequestMetadata metadata, kj::Maybe<kj::StringPtr> entrypointName,
       kj::Maybe<kj::Own<Worker::Actor>> actor = nullptr) {
-    return WorkerEntrypoint::construct(
+    // Actors always run in the isolate they were created in, which is the home isolate.
+    uint index = 0;
+    kj::Own<const Worker> worker;
+    KJ_IF_MAYBE(a, actor) {
+      worker = kj::atomicAddRef((*a)->getWorker());
+    } else {
+      index = pickWorker();
+      worker = kj::atomicAddRef(*workers[index]);
+    }
+    auto& limitWorker = *worker;
+
+    auto& state = idleStates[index];
+    ++state.activeRequests;
+    ++activeRequests;
+    state.idleGcTask = nullptr;
+    evictionTask = nullptr;
+    kj::Own<void> requestDone = kj::heap(kj::defer([this, index]() {
+      if (--idleStates[index].activeRequests == 0 && idleGcOptions != nullptr) {
+        scheduleIdleGc(index);
+      }
+      if (--activeRequests == 0 && evictAfter != nullptr) {
+        scheduleEviction();
+      }
+    }));
+
+    SpanBuilder span = nullptr;
+    KJ_IF_MAYBE(exporter, spanExporter) {
+      // A request from a traced Worker is part of that Worker's trace; others start a new trace.
+      span = metadata.parentSpan.isObserved()
+          ? metadata.parentSpan.newChild("worker")
+          : SpanBuilder(exporter->newTrace(), "worker");
+      span.setTag("worker", kj::str(definition->name));
+      KJ_IF_MAYBE(e, entrypointName) {
+        span.setTag("entrypoint", kj::str(*e));
+      }
+    }
+
+    kj::Own<RequestObserver> observer;
+    if (span.isObserved() || definition->metrics != nullptr) {
+      observer = kj::refcounted<WorkerdRequestObserver>(kj::mv(span),
+          definition->metrics.map([](const kj::Own<const WorkerMetrics>& m) {
+        return m->addRef();
+      }));
+    } else {
+      observer = kj::refcounted<RequestObserver>();  // default observer makes no observations
+    }
+
+    // The Worker only counts as busy until the request's IoContext is gone. The IoContext lives
+    // until the request's waitUntil() tasks are done, so those count as part of the request.
+    // WorkerEntrypoint may go on proxying the response body after that, but that's pure I/O which
+    // no longer needs the isolate, so there's no reason to hold off idle GC or eviction for a long
+    // download. An actor's IoContext outlives any one request, so actor requests are counted
+    // until the WorkerInterface is dropped instead.
+    bool isActor = actor != nullptr;
+    kj::Own<void> ioContextDependency;
+    kj::Maybe<ConcurrencyLimitedWorkerInterface::PermitSlot&> permitSlot;
+    if (!isActor) {
+      ioContextDependency = kj::mv(requestDone);
+      if (limiter != nullptr) {
+        // Durable Objects aren't limited: each object's requests are serialized by its input gate
+        // anyway, and shedding them would only break the object's clients.
+        auto slot = kj::heap<ConcurrencyLimitedWorkerInterface::PermitSlot>();
+        permitSlot = *slot;
+        ioContextDependency = kj::mv(ioContextDependency).attach(kj::mv(slot));
+      }
+    }
+
+    auto result = WorkerEntrypoint::construct(
         threadContext,
-        kj::atomicAddRef(*worker),
+        kj::mv(worker),
         entrypointName,
         kj::mv(actor),
-        kj::Own<LimitEnforcer>(this, kj::NullDisposer::instance),
-        {},                        // ioContextDependency
+        makeLimitEnforcer(limitWorker),
+        kj::mv(ioContextDependency),
         kj::Own<IoChannelFactory>(this, kj::NullDisposer::instance),
-        kj::refcounted<RequestObserver>(),  // default observer makes no observations
+        kj::mv(observer),
         waitUntilTasks,
         true,                      // tunnelExceptions
         nullptr,                   // workerTracer
         kj::mv(metadata.cfBlobJson));
+
+    if (isActor) {
+      result = result.attach(kj::mv(requestDone));
+    } else KJ_IF_MAYBE(slot, permitSlot) {
+      result = kj::heap<ConcurrencyLimitedWorkerInterface>(kj::mv(result),
+          *KJ_ASSERT_NONNULL(limiter), *slot,
+          KJ_ASSERT_NONNULL(definition->concurrencyLimit).retryAfterSeconds,
+          threadContext.getHeaderTable());
+    }
+
+    return result;
   }
 
   class ActorNamespace {
   public:
     ActorNamespace(WorkerService& service, kj::StringPtr className, const ActorConfig& config)
-        : service(service), className(className), config(config) {}
+        : service(service), className(className), config(config) {
+      KJ_IF_MAYBE(durable, config.tryGet<Durable>()) {
+        KJ_IF_MAYBE(cacheConf, durable->cache) {
+          // The namespace has a cache of its own. Everything but its size and flush batching
+          // comes from the Worker's default cache.
+          auto& base = service.definition->lruOptions;
+          actorCacheLru = kj::heap<ActorCache::SharedLru>(
+              makeActorCacheLruOptions(*cacheConf, base.neverFlush, base.budget));
+        }
+      }
+    }
 
     const ActorConfig& getConfig() { return config; }
 
     kj::Own<IoChannelFactory::ActorChannel> getActor(Worker::Actor::Id id) {
+      KJ_IF_MAYBE(router, service.actorRouter) {
+        auto remote = router->getRemoteActor(service.definition->name, className, id);
+        KJ_IF_MAYBE(r, remote) {
+          return kj::mv(*r);
+        }
+      }
+
+      return kj::heap<PromisedActorChannel>(service.waitUntilTasks, openActor(kj::mv(id)));
+    }
+
+    kj::Promise<kj::Own<ActorChannel>> openActor(Worker::Actor::Id id) {
+      // Finds or creates the actor on this thread, which must be its home.
+      //
       // `getActor()` is often called with the calling isolate's lock held. We need to drop that
       // lock and take a lock on the target isolate before constructing the actor. Even if these
       // are the same isolate (as is commonly the case), we really don't want to do this stuff
       // synchronously, so this has the effect of pushing off to a later turn of the event loop.
-      auto promise = service.worker->takeAsyncLockWithoutRequest(nullptr)
-          .then([this, id = kj::mv(id)](Worker::AsyncLock lock) mutable -> kj::Own<ActorChannel> {
+      //
+      // The actor is created in whichever Worker holds the lock we take, even if the Worker is
+      // evicted and instantiated again in the meantime.
+      auto worker = kj::atomicAddRef(service.getHomeWorker());
+      return worker->takeAsyncLockWithoutRequest(nullptr)
+          .then([this, id = kj::mv(id), worker = kj::mv(worker)](Worker::AsyncLock lock) mutable
+                -> kj::Own<ActorChannel> {
         kj::String idStr;
         KJ_SWITCH_ONEOF(id) {
           KJ_CASE_ONEOF(obj, kj::Own<ActorIdFactory::ActorId>) {
@@ -1203,22 +2848,55 @@ public:
 
         auto actor = kj::addRef(*actors.findOrCreate(idStr, [&]() {
           auto persistent = config.tryGet<Durable>().map([&](const Durable& d) {
-            // TODO(someday): Implement some sort of actual durable storage. For now we force
-            //   `ActorCache` into `neverFlush` mode so that all state is kept in-memory.
-            return rpc::ActorStorage::Stage::Client(kj::heap<EmptyReadOnlyActorStorageImpl>());
+            KJ_IF_MAYBE(dir, getStorageDirectory(d)) {
+              LocalActorStorageOptions options;
+              KJ_IF_MAYBE(scheduler, alarmScheduler) {
+                options.alarmListener = **scheduler;
+              }
+              return rpc::ActorStorage::Stage::Client(newLocalActorStorage(*dir, idStr, options));
+            }
+
+            // In-memory storage: we force `ActorCache` into `neverFlush` mode so that all state
+            // is kept in-memory, and back it with empty storage.
+            return rpc::ActorStorage::Stage::Client(kj::heap<EmptyReadOnlyActorStorageImpl>());
           });
 
           auto makeStorage = [](jsg::Lock& js, const Worker::ApiIsolate& apiIsolate,
                                 ActorCache& actorCache)
                             -> jsg::Ref<api::DurableObjectStorage> {
-            return jsg::alloc<api::DurableObjectStorage>(IoContext::current().addObject(actorCache));
+            return jsg::alloc<api::DurableObjectStorage>(
+                IoContext::current().addObject(actorCache));
           };
 
           TimerChannel& timerChannel = service;
+          kj::Maybe<const ActorCache::SharedLru&> lru;
+          KJ_IF_MAYBE(l, actorCacheLru) {
+            lru = **l;
+          }
+
+          kj::Own<ActorObserver> observer;
+          KJ_IF_MAYBE(m, service.getDefinition().metrics) {
+            observer = kj::refcounted<WorkerdActorObserver>((*m)->addRef());
+          } else {
+            observer = kj::refcounted<ActorObserver>();
+          }
+
+          // A hibernated actor's sockets are still held by its manager, which the new instance
+          // picks up. Otherwise, one is only created if the actor accepts a hibernatable socket.
+          kj::Maybe<kj::Own<HibernationManager>> hibernationManager;
+          KJ_IF_MAYBE(m, hibernationManagers.find(idStr)) {
+            hibernationManager = kj::addRef(**m);
+          }
+          Worker::Actor::MakeHibernationManagerFunc makeHibernationManager =
+              [this, managerIdStr = kj::str(idStr), managerId = cloneActorId(id)]() {
+            return kj::addRef(findOrCreateHibernationManager(managerIdStr, managerId));
+          };
+
           auto newActor = kj::refcounted<Worker::Actor>(
-              *service.worker, kj::mv(id), true, kj::mv(persistent),
+              *worker, kj::mv(id), true, kj::mv(persistent),
               className, kj::mv(makeStorage), lock,
-              timerChannel, kj::refcounted<ActorObserver>());
+              timerChannel, kj::mv(observer), lru,
+              kj::mv(hibernationManager), kj::mv(makeHibernationManager));
 
           return kj::HashMap<kj::String, kj::Own<Worker::Actor>>::Entry {
             kj::mv(idStr), kj::mv(newActor)
@@ -1227,15 +2905,247 @@ public:
 
         return kj::heap<ActorChannelImpl>(service, className, kj::mv(actor));
       });
+    }
+
+    Worker::Actor::Id parseActorId(kj::StringPtr idStr, kj::Maybe<kj::StringPtr> name) {
+      // Turns the string form of an ID back into an ID, for a request forwarded from another
+      // thread. `name` is set if the ID was made from a name.
+      KJ_IF_MAYBE(durable, config.tryGet<Durable>()) {
+        if (idFactory == nullptr) {
+          idFactory = newActorIdFactory(durable->uniqueKey);
+        }
+        auto& factory = *KJ_ASSERT_NONNULL(idFactory);
+        KJ_IF_MAYBE(n, name) {
+          return factory.idFromName(kj::str(*n));
+        } else {
+          return factory.idFromString(kj::str(idStr));
+        }
+      } else {
+        return kj::str(idStr);
+      }
+    }
 
-      return kj::heap<PromisedActorChannel>(service.waitUntilTasks, kj::mv(promise));
+    bool hasActors() { return actors.size() > 0; }
+
+    void startAlarmScheduler() {
+      // Starts delivering the alarms of objects with on-disk storage, which may not be running
+      // when their alarms fall due. Called once the service is linked. (In-memory objects are
+      // never evicted, so they run their own alarms; see Worker::Actor::makeAlarmTaskForPreview().)
+      KJ_IF_MAYBE(durable, config.tryGet<Durable>()) {
+        KJ_IF_MAYBE(dir, getStorageDirectory(*durable)) {
+          // Each thread delivers the alarms of the objects homed on it, so has an index of its own.
+          uint threadIndex = 0;
+          uint threadCount = 1;
+          auto indexName = kj::str("alarms.index");
+          KJ_IF_MAYBE(router, service.actorRouter) {
+            threadIndex = router->getThreadIndex();
+            threadCount = router->getThreadCount();
+            indexName = kj::str("alarms-", threadIndex, ".index");
+          }
+
+          auto& scheduler = *alarmScheduler.emplace(kj::heap<AlarmScheduler>(
+              kj::systemPreciseCalendarClock(), service.threadContext.getUnsafeTimer(), *dir,
+              kj::Path({kj::str(indexName)}),
+              [this](kj::StringPtr actorId, kj::Date scheduledTime) {
+            return deliverAlarm(kj::str(actorId), scheduledTime);
+          }));
+
+          // Indexes of threads that don't exist in this run are each adopted by one thread that
+          // does. Their entries for objects homed elsewhere are passed on when they fall due; see
+          // deliverAlarm().
+          for (auto& name: dir->listNames()) {
+            if (name == indexName) continue;
+            bool adopt = false;
+            if (name == "alarms.index") {
+              adopt = threadIndex == 0;
+            } else if (name.startsWith("alarms-") && name.endsWith(".index")) {
+              auto number = kj::heapString(name.slice(7, name.size() - 6));
+              KJ_IF_MAYBE(k, number.tryParseAs<uint>()) {
+                adopt = threadCount == 1 || (*k >= threadCount && *k % threadCount == threadIndex);
+              }
+            }
+            if (adopt) {
+              scheduler.adopt(kj::Path({kj::mv(name)}));
+            }
+          }
+        }
+      }
     }
 
+    static constexpr auto HIBERNATION_CHECK_INTERVAL = 10 * kj::SECONDS;
+    // How often to look for actors that can be hibernated.
+
   private:
     WorkerService& service;
     kj::StringPtr className;
     const ActorConfig& config;
+
+    kj::Maybe<kj::Own<ActorCache::SharedLru>> actorCacheLru;
+    // The namespace's own cache LRU, if it has a `cache` config. Otherwise, actors use the
+    // isolate's. (Declared before `actors` so that it outlives them.)
+
+    kj::HashMap<kj::String, kj::Own<HibernationManager>> hibernationManagers;
+    // Hibernatable WebSockets of each actor ID that has accepted any. These outlive the actor
+    // instances, which are dropped from `actors` while hibernated. A manager is dropped once its
+    // sockets are all closed and no instance of its actor is left. (Declared before `actors` so
+    // that it outlives them.)
+
+    kj::Maybe<kj::Own<AlarmScheduler>> alarmScheduler;
+    // Set if the namespace's storage is on disk. (Declared before `actors` so that it outlives
+    // their storage, which reports alarm changes to it.)
+
     kj::HashMap<kj::String, kj::Own<Worker::Actor>> actors;
+    kj::Maybe<kj::Own<const kj::Directory>> storageDirectory;
+    kj::Maybe<kj::Own<ActorIdFactory>> idFactory;
+    // Only needed for requests forwarded from other threads, so created on first use.
+
+    kj::Maybe<kj::Promise<void>> hibernationTask;
+
+    static Worker::Actor::Id cloneActorId(const Worker::Actor::Id& id) {
+      KJ_SWITCH_ONEOF(id) {
+        KJ_CASE_ONEOF(obj, kj::Own<ActorIdFactory::ActorId>) {
+          return obj->clone();
+        }
+        KJ_CASE_ONEOF(str, kj::String) {
+          return kj::str(str);
+        }
+      }
+      KJ_UNREACHABLE;
+    }
+
+    HibernationManager& findOrCreateHibernationManager(
+        kj::StringPtr idStr, const Worker::Actor::Id& id) {
+      auto& manager = *hibernationManagers.findOrCreate(idStr, [&]() {
+        // The manager outlives instances of the actor, so it recreates the actor through
+        // getActor() rather than holding on to one.
+        auto manager = kj::refcounted<HibernationManager>(
+            [this, managerId = cloneActorId(id)]() -> kj::Own<WorkerInterface> {
+          auto channel = getActor(cloneActorId(managerId));
+          auto request = channel->startRequest({});
+          return request.attach(kj::mv(channel));
+        });
+        return kj::HashMap<kj::String, kj::Own<HibernationManager>>::Entry {
+          kj::str(idStr), kj::mv(manager)
+        };
+      });
+
+      if (hibernationTask == nullptr) {
+        hibernationTask = hibernateIdleActorsLoop().eagerlyEvaluate([](kj::Exception&& e) {
+          KJ_LOG(ERROR, "hibernating idle actors failed", e);
+        });
+      }
+
+      return manager;
+    }
+
+    kj::Promise<void> hibernateIdleActorsLoop() {
+      // Every so often, tears down actors whose only remaining connections are hibernatable
+      // WebSockets. An actor qualifies if nothing but `actors` references it (so no request,
+      // event, or stub is using it), it has no timers, flushes, sends, or events in flight, and it
+      // has at least one hibernatable WebSocket (an actor without any might be about to get a
+      // request, and there's nothing to gain). The next event on one of its sockets creates a new
+      // instance.
+      //
+      // Only actors with on-disk storage are hibernated: an in-memory actor's storage, like an
+      // ephemeral actor's state, would be lost along with the instance.
+      //
+      // Also drops the managers of actor IDs that have neither sockets nor an instance left.
+      bool canHibernate = false;
+      KJ_IF_MAYBE(durable, config.tryGet<Durable>()) {
+        canHibernate = getStorageDirectory(*durable) != nullptr;
+      }
+
+      for (;;) {
+        co_await service.afterLimitTimeout(HIBERNATION_CHECK_INTERVAL);
+
+        if (canHibernate) {
+          kj::Vector<kj::StringPtr> idle;
+          for (auto& entry: actors) {
+            auto& actor = *entry.value;
+            if (actor.isShared()) continue;
+
+            KJ_IF_MAYBE(manager, actor.getHibernationManager()) {
+              if (!manager->hasSockets() || !manager->isIdle()) continue;
+            } else {
+              continue;
+            }
+
+            KJ_IF_MAYBE(context, actor.getIoContext()) {
+              if (context->getTimeoutCount() > 0) continue;
+            }
+            KJ_IF_MAYBE(cache, actor.getPersistent()) {
+              if (cache->onNoPendingFlush() != nullptr) continue;
+            }
+
+            idle.add(entry.key);
+          }
+
+          for (auto id: idle) {
+            KJ_IF_MAYBE(actor, actors.find(id)) {
+              (*actor)->shutdown(0);
+            }
+            actors.erase(id);
+          }
+        }
+
+        // Every instance of an actor holds a reference to its manager, so a manager that isn't
+        // shared has no instance left to give it new sockets.
+        kj::Vector<kj::String> unused;
+        for (auto& entry: hibernationManagers) {
+          auto& manager = *entry.value;
+          if (!manager.isShared() && !manager.hasSockets() && manager.isIdle()) {
+            unused.add(kj::str(entry.key));
+          }
+        }
+        for (auto& id: unused) {
+          hibernationManagers.erase(id);
+        }
+      }
+    }
+
+    kj::Promise<WorkerInterface::AlarmResult> deliverAlarm(
+        kj::String actorId, kj::Date scheduledTime) {
+      KJ_IF_MAYBE(router, service.actorRouter) {
+        if (!router->isHome(actorId)) {
+          // Left in this thread's index by a run with a different number of threads. Opening the
+          // object on its home thread hands the alarm to that thread's scheduler, and this
+          // thread can forget it.
+          co_await router->wakeRemoteActor(service.definition->name, className, actorId);
+          co_return WorkerInterface::AlarmResult {
+            .retry = false,
+            .outcome = EventOutcome::CANCELED,
+          };
+        }
+      }
+
+      auto channel = co_await openActor(parseActorId(actorId, nullptr));
+
+      // Opening the object's storage reported its real alarm, in case the index was out of date.
+      if (!KJ_ASSERT_NONNULL(alarmScheduler)->isScheduled(actorId, scheduledTime)) {
+        co_return WorkerInterface::AlarmResult {
+          .retry = false,
+          .outcome = EventOutcome::CANCELED,
+        };
+      }
+
+      auto worker = channel->startRequest({});
+      co_return co_await worker->runAlarm(scheduledTime);
+    }
+
+    kj::Maybe<const kj::Directory&> getStorageDirectory(const Durable& durable) {
+      // Returns the directory in which this namespace's objects are stored, or null if the
+      // worker's Durable Object storage is in-memory.
+      KJ_IF_MAYBE(dir, storageDirectory) {
+        return **dir;
+      }
+      auto& channels = KJ_REQUIRE_NONNULL(service.ioChannels.tryGet<LinkedIoChannels>(),
+                                          "link() has not been called");
+      KJ_IF_MAYBE(root, channels.actorStorage) {
+        return *storageDirectory.emplace(root->openSubdir(
+            kj::Path({durable.uniqueKey}), kj::WriteMode::CREATE | kj::WriteMode::MODIFY));
+      }
+      return nullptr;
+    }
   };
 
 private:
@@ -1255,12 +3165,137 @@ private:
   };
 
   ThreadContext& threadContext;
-  kj::Own<const Worker> worker;
-  kj::HashMap<kj::String, EntrypointService> namedEntrypoints;
+  kj::Own<const Definition> definition;
+
+  kj::Array<kj::Own<const Worker>> workers;
+  // The Worker's isolate pool: identical copies of the Worker, each in its own isolate, so that
+  // requests don't all have to wait on one isolate lock. Usually there's just one. Actors always
+  // live in the first ("home") isolate, since their state can't be shared between isolates.
+  //
+  // Empty until the Worker is instantiated, and again after it's evicted.
+
+  kj::HashMap<kj::String, kj::Own<EntrypointService>> namedEntrypoints;
   kj::HashMap<kj::StringPtr, ActorNamespace> actorNamespaces;
   kj::OneOf<LinkCallback, LinkedIoChannels> ioChannels;
   kj::TaskSet waitUntilTasks;
 
+  kj::Maybe<IdleGcOptions> idleGcOptions;
+  kj::Maybe<kj::Duration> evictAfter;
+  kj::Maybe<InspectorService&> inspector;
+  kj::Maybe<SpanExporter&> spanExporter;
+  kj::Maybe<ActorRouter&> actorRouter;
+  // Set when the server runs on several threads, each the home of some of the Worker's objects.
+
+  struct IdleState {
+    // Tracks when a Worker in the pool is idle, for idle-time garbage collection.
+    uint activeRequests = 0;
+    kj::Promise<void> idleGcTask = nullptr;
+  };
+  kj::Array<IdleState> idleStates;
+  // One per Worker in the pool.
+
+  uint activeRequests = 0;
+  kj::Promise<void> evictionTask = nullptr;
+  // Requests in flight across the whole pool, and the pending eviction once there are none. Only
+  // used when `evictAfter` is set.
+
+  kj::Maybe<kj::Own<ConcurrencyLimiter>> limiter;
+  // Set when the Worker has a `concurrencyLimit`. Each thread limits its own requests.
+
+  kj::Maybe<kj::Own<SubrequestCoalescer>> coalescer;
+  // Set when the Worker has `coalesceSubrequests`. Each thread merges its own subrequests.
+
+  EntrypointService& addEntrypoint(kj::String name) {
+    kj::StringPtr namePtr = name;
+    return *namedEntrypoints.insert(kj::mv(name), kj::heap<EntrypointService>(*this, namePtr))
+        .value;
+  }
+
+  kj::ArrayPtr<const kj::Own<const Worker>> getWorkers() {
+    // Returns the isolate pool, first instantiating the Worker if it hasn't been yet (because it
+    // starts lazily, or was evicted).
+    if (!isInstantiated()) {
+      auto instance = definition->instantiate();
+      if (instance.errors.size() > 0) {
+        auto errors = kj::strArray(instance.errors, "; ");
+        KJ_LOG(ERROR, "Worker failed to start", definition->name, errors);
+        JSG_FAIL_REQUIRE(Error, "Worker \"", definition->name, "\" failed to start: ", errors);
+      }
+      setInstance(kj::mv(instance));
+    }
+    return workers;
+  }
+
+  const Worker& getHomeWorker() { return *getWorkers()[0]; }
+
+  uint pickWorker() {
+    // Returns the index of the Worker whose isolate has the fewest requests holding or waiting
+    // for its lock. Ties go to the earliest in the pool, so that light traffic stays in the home
+    // isolate. Note the whole pool shares this thread, so this balances lock waits and heaps, not
+    // CPU time.
+    auto pool = getWorkers();
+    uint best = 0;
+    uint bestLoad = pool[0]->getIsolate().getCurrentLoad();
+    for (uint i = 1; i < pool.size() && bestLoad > 0; i++) {
+      uint load = pool[i]->getIsolate().getCurrentLoad();
+      if (load < bestLoad) {
+        best = i;
+        bestLoad = load;
+      }
+    }
+    return best;
+  }
+
+  void scheduleIdleGc(uint index) {
+    // Once the Worker has had no requests for `delay`, gives V8 up to `budget` to get ahead on
+    // garbage collection, so that less of it lands in the middle of later requests. A new request
+    // cancels this.
+    idleStates[index].idleGcTask = idleGcLoop(index).eagerlyEvaluate([](kj::Exception&& e) {
+      KJ_LOG(ERROR, "idle-time garbage collection failed", e);
+    });
+  }
+
+  void scheduleEviction() {
+    // Once no request has come in for `evictAfter`, drops the isolate pool, so that an idle
+    // Worker doesn't stay resident. (Each isolate reports `IsolateObserver::evicted()` as its
+    // script is destroyed.) The next request instantiates the Worker again. A Worker that has
+    // created Durable Objects is never evicted, since they live in its home isolate.
+    evictionTask = threadContext.getUnsafeTimer().afterDelay(KJ_ASSERT_NONNULL(evictAfter))
+        .then([this]() {
+      for (auto& ns: actorNamespaces) {
+        if (ns.value.hasActors()) return;
+      }
+      for (auto& state: idleStates) {
+        state.idleGcTask = nullptr;
+      }
+      workers = nullptr;
+    }).eagerlyEvaluate([](kj::Exception&& e) {
+      KJ_LOG(ERROR, "evicting idle Worker failed", e);
+    });
+  }
+
+  kj::Promise<void> idleGcLoop(uint index) {
+    auto& options = KJ_ASSERT_NONNULL(idleGcOptions);
+    auto& worker = *workers[index];
+    return threadContext.getUnsafeTimer().afterDelay(options.delay).then([&worker]() {
+      return worker.takeAsyncLockWithoutRequest(nullptr);
+    }).then([this, index, &worker, budget = options.budget](Worker::AsyncLock asyncLock)
+            -> kj::Promise<void> {
+      bool done;
+      {
+        Worker::Lock lock(worker, asyncLock);
+        jsg::Lock& js = lock;
+        done = js.runIdleGc(budget);
+      }
+      KJ_IF_MAYBE(m, definition->metrics) (*m)->increment(WorkerMetrics::Counter::IDLE_GCS);
+
+      if (done) return kj::READY_NOW;
+
+      // V8 has more work to do than fit in the budget. Try again after another idle period.
+      return idleGcLoop(index);
+    });
+  }
+
   class ActorChannelImpl final: public IoChannelFactory::ActorChannel {
   public:
     ActorChannelImpl(WorkerService& service, kj::StringPtr className, kj::Own<Worker::Actor> actor)
@@ -1318,6 +3353,14 @@ private:
         "link() has not been called");
 
     KJ_REQUIRE(channel < channels.subrequest.size(), "invalid subrequest channel number");
+    KJ_IF_MAYBE(c, coalescer) {
+      // Requests through different channels, or with different `cf` blobs, are different.
+      kj::StringPtr cf;
+      KJ_IF_MAYBE(json, metadata.cfBlobJson) cf = *json;
+      auto keyPrefix = kj::str(channel, '\n', cf, '\n');
+      return (*c)->wrap(channels.subrequest[channel]->startRequest(kj::mv(metadata)),
+                        kj::mv(keyPrefix));
+    }
     return channels.subrequest[channel]->startRequest(kj::mv(metadata));
   }
 
@@ -1397,7 +3440,17 @@ private:
 
   kj::Promise<void> writeLogfwdr(uint channel,
       kj::FunctionParam<void(capnp::AnyPointer::Builder)> buildMessage) override {
-    KJ_FAIL_REQUIRE("no logging channels");
+    auto& channels = KJ_REQUIRE_NONNULL(ioChannels.tryGet<LinkedIoChannels>(),
+        "link() has not been called");
+
+    KJ_REQUIRE(channel < channels.logfwdr.size(), "invalid logfwdr channel number");
+    auto& batcher = JSG_REQUIRE_NONNULL(channels.logfwdr[channel], Error,
+        "Analytics Engine binding configuration was invalid.");
+
+    // The batcher sends data points on its own schedule, so there's nothing for the request to
+    // wait for.
+    batcher->write(kj::mv(buildMessage));
+    return kj::READY_NOW;
   }
 
   kj::Own<ActorChannel> getGlobalActor(uint channel, const ActorIdFactory::ActorId& id,
@@ -1442,10 +3495,20 @@ private:
     return threadContext.getUnsafeTimer().afterDelay(t);
   }
 
+  kj::Own<LimitEnforcer> makeLimitEnforcer(const Worker& worker) {
+    auto& isolateLimits = kj::downcast<const WorkerdIsolateLimitEnforcer>(
+        worker.getIsolate().getLimitEnforcer());
+    if (isolateLimits.hasLimits()) {
+      return kj::heap<WorkerdRequestLimitEnforcer>(isolateLimits);
+    } else {
+      return kj::Own<LimitEnforcer>(this, kj::NullDisposer::instance);
+    }
+  }
+
   // ---------------------------------------------------------------------------
   // implements LimitEnforcer
   //
-  // No limits are enforced.
+  // Used for Workers that have no `limits` configured, in which case no limits are enforced.
 
   kj::Own<void> enterJs(jsg::Lock& lock) override { return {}; }
   void topUpActor() override {}
@@ -1455,12 +3518,252 @@ private:
   kj::Promise<void> limitDrain() override { return kj::NEVER_DONE; }
   kj::Promise<void> limitScheduled() override { return kj::NEVER_DONE; }
   size_t getBufferingLimit() override { return kj::maxValue; }
+  kj::Maybe<size_t> getTeeBackpressureThreshold() override { return nullptr; }
   kj::Maybe<EventOutcome> getLimitsExceeded() override { return nullptr; }
   kj::Promise<void> onLimitsExceeded() override { return kj::NEVER_DONE; }
   void requireLimitsNotExceeded() override {}
   void reportMetrics(RequestObserver& requestMetrics) override {}
 };
 
+Server::WorkerService::Instance Server::WorkerService::Definition::instantiate() const {
+  Instance instance;
+
+  struct InstanceErrorReporter: public Worker::ValidationErrorReporter {
+    explicit InstanceErrorReporter(Instance& instance): instance(instance) {}
+
+    Instance& instance;
+
+    void addError(kj::String error) override {
+      instance.errors.add(kj::mv(error));
+    }
+
+    void addHandler(kj::Maybe<kj::StringPtr> exportName, kj::StringPtr type) override {
+      KJ_IF_MAYBE(e, exportName) {
+        instance.namedEntrypoints.findOrCreate(*e, [&]() { return kj::str(*e); });
+      }
+    }
+  };
+  InstanceErrorReporter errorReporter(instance);
+
+  struct NullErrorReporter: public Worker::ValidationErrorReporter {
+    void addError(kj::String error) override {}
+    void addHandler(kj::Maybe<kj::StringPtr> exportName, kj::StringPtr type) override {}
+  };
+  NullErrorReporter nullErrorReporter;
+
+  auto newScript = [&](bool isHome) {
+    // Creates a new isolate and compiles the Worker's script in it. Errors are only reported for
+    // the home isolate, the first in the pool, since the rest are identical.
+    Worker::ValidationErrorReporter& scriptErrorReporter =
+        isHome ? static_cast<Worker::ValidationErrorReporter&>(errorReporter) : nullErrorReporter;
+    auto limitEnforcer = kj::heap<WorkerdIsolateLimitEnforcer>(limits, lruOptions, watchdog);
+    auto api = kj::heap<WorkerdApiIsolate>(v8System, featureFlags, *limitEnforcer);
+
+    kj::Own<IsolateObserver> observer;
+    if (logGcPausesOver != nullptr || traceLocks || metrics != nullptr ||
+        concurrencyLimit != nullptr) {
+      observer = kj::atomicRefcounted<WorkerdIsolateObserver>(name, logGcPausesOver, traceLocks,
+          metrics.map([](const kj::Own<const WorkerMetrics>& m) { return m->addRef(); }),
+          concurrencyLimit.map([](const ConcurrencyLimit& c) {
+            return kj::atomicAddRef(*c.lockWaits);
+          }));
+    } else {
+      observer = kj::atomicRefcounted<IsolateObserver>();
+    }
+
+    auto isolate = kj::atomicRefcounted<Worker::Isolate>(
+        kj::mv(api),
+        kj::mv(observer),
+        name,
+        kj::mv(limitEnforcer),
+        allowInspector);
+    KJ_IF_MAYBE(threshold, logLockHoldsOver) {
+      isolate->setLongLockThreshold(*threshold);
+    }
+
+    return isolate->newScript(name,
+                              WorkerdApiIsolate::extractSource(conf, scriptErrorReporter,
+                                                               codeCache),
+                              IsolateObserver::StartType::COLD,
+                              false, scriptErrorReporter);
+  };
+
+  auto compileGlobals = [this](jsg::Lock& lock, const Worker::ApiIsolate& apiIsolate,
+                               v8::Local<v8::Object> target) {
+    return kj::downcast<const WorkerdApiIsolate>(apiIsolate).compileGlobals(
+        lock, globals, target, 1);
+  };
+
+  auto workers = kj::heapArrayBuilder<kj::Own<const Worker>>(isolatePoolSize);
+  workers.add(kj::atomicRefcounted<Worker>(
+      newScript(true),
+      kj::atomicRefcounted<WorkerObserver>(),
+      compileGlobals,
+      IsolateObserver::StartType::COLD,
+      nullptr,          // systemTracer -- TODO(beta): factor out
+      Worker::Lock::TakeSynchronously(nullptr),
+      errorReporter));
+
+  {
+    Worker::Lock lock(*workers[0], Worker::Lock::TakeSynchronously(nullptr));
+    lock.validateHandlers(errorReporter);
+  }
+
+  while (!workers.isFull()) {
+    workers.add(kj::atomicRefcounted<Worker>(
+        newScript(false),
+        kj::atomicRefcounted<WorkerObserver>(),
+        compileGlobals,
+        IsolateObserver::StartType::COLD,
+        nullptr,          // systemTracer -- TODO(beta): factor out
+        Worker::Lock::TakeSynchronously(nullptr),
+        nullErrorReporter));
+  }
+
+  instance.workers = workers.finish();
+  return instance;
+}
+
+// =======================================================================================
+
+class Server::ServiceSlot final: public Service {
+  // Holds the service configured under one name. Sockets and other services refer to the service
+  // through its slot, so that reload() can swap in a new one. Each request keeps the service it
+  // started on alive until it's done, so requests in flight finish on the old service while new
+  // requests go to the new one.
+
+public:
+  explicit ServiceSlot(kj::Own<Service> service)
+      : current(kj::refcounted<Holder>(kj::mv(service))) {}
+
+  Service& get() { return *current->service; }
+
+  void link() override {
+    current->service->link();
+  }
+
+  kj::Own<WorkerInterface> startRequest(
+      IoChannelFactory::SubrequestMetadata metadata) override {
+    return current->service->startRequest(kj::mv(metadata)).attach(kj::addRef(*current));
+  }
+
+  Service& getEntrypoint(kj::StringPtr name) {
+    // Returns a service which sends requests to the named entrypoint of whatever service is
+    // current. The caller must have checked that the current service is a Worker with such an
+    // entrypoint, and reload() checks the same of each replacement.
+    return *entrypoints.findOrCreate(name, [&]() -> decltype(entrypoints)::Entry {
+      auto slot = kj::heap<EntrypointSlot>(*this, kj::str(name));
+      kj::StringPtr key = slot->name;
+      return { key, kj::mv(slot) };
+    });
+  }
+
+  template <typename Func>
+  void forEachEntrypoint(Func&& func) {
+    // Calls `func(kj::StringPtr name)` for each entrypoint that getEntrypoint() was called for.
+    for (auto& entry: entrypoints) {
+      func(entry.key);
+    }
+  }
+
+  kj::Promise<kj::Own<Service>> replace(kj::Own<Service> service) {
+    // Makes `service` the current service. The returned promise resolves to the old service once
+    // all requests started on it are done. (Their `waitUntil()` tasks may still be running.)
+    auto paf = kj::newPromiseAndFulfiller<kj::Own<Service>>();
+    current->released = kj::mv(paf.fulfiller);
+    current = kj::refcounted<Holder>(kj::mv(service));
+    return kj::mv(paf.promise);
+  }
+
+private:
+  struct Holder: public kj::Refcounted {
+    kj::Own<Service> service;
+    kj::Maybe<kj::Own<kj::PromiseFulfiller<kj::Own<Service>>>> released;
+    // Set once the service has been replaced, to hand it off when the last request is done.
+
+    explicit Holder(kj::Own<Service> service): service(kj::mv(service)) {}
+    ~Holder() noexcept(false) {
+      KJ_IF_MAYBE(f, released) {
+        f->get()->fulfill(kj::mv(service));
+      }
+    }
+  };
+  kj::Own<Holder> current;
+
+  class EntrypointSlot final: public Service {
+  public:
+    EntrypointSlot(ServiceSlot& parent, kj::String name)
+        : parent(parent), name(kj::mv(name)) {}
+
+    kj::Own<WorkerInterface> startRequest(
+        IoChannelFactory::SubrequestMetadata metadata) override {
+      auto& worker = kj::downcast<WorkerService>(parent.get());
+      auto& entrypoint = KJ_REQUIRE_NONNULL(worker.getEntrypoint(name),
+          "Worker no longer has the named entrypoint", name);
+      return entrypoint.startRequest(kj::mv(metadata)).attach(kj::addRef(*parent.current));
+    }
+
+    ServiceSlot& parent;
+    kj::String name;
+  };
+  kj::HashMap<kj::StringPtr, kj::Own<EntrypointSlot>> entrypoints;
+};
+
+kj::Promise<void> Server::ActorRouter::request(
+    kj::HttpMethod method, kj::StringPtr url, const kj::HttpHeaders& headers,
+    kj::AsyncInputStream& requestBody, kj::HttpService::Response& response) {
+  auto decode = [&](kj::HttpHeaderId id) -> kj::Maybe<kj::String> {
+    auto value = KJ_UNWRAP_OR_RETURN(headers.get(id), nullptr);
+    auto decoded = kj::decodeUriComponent(value);
+    if (decoded.hadErrors) return nullptr;
+    return kj::String(kj::mv(decoded));
+  };
+
+  kj::Maybe<WorkerService::ActorNamespace&> ns;
+  auto serviceNameHeader = decode(headerIds.service);
+  auto classNameHeader = decode(headerIds.className);
+  KJ_IF_MAYBE(serviceName, serviceNameHeader) {
+    KJ_IF_MAYBE(className, classNameHeader) {
+      KJ_IF_MAYBE(slot, server.services.find(*serviceName)) {
+        auto worker = dynamic_cast<WorkerService*>(&(*slot)->get());
+        if (worker != nullptr) {
+          ns = worker->getActorNamespace(*className);
+        }
+      }
+    }
+  }
+  auto idStr = decode(headerIds.id);
+  if (ns == nullptr || idStr == nullptr) {
+    // Every thread runs the same config, so this can only be a bug.
+    KJ_LOG(ERROR, "request forwarded from another thread is for an unknown object");
+    co_await response.sendError(404, "Not Found", headerTable);
+    co_return;
+  }
+
+  auto name = decode(headerIds.name);
+  auto id = KJ_ASSERT_NONNULL(ns).parseActorId(KJ_ASSERT_NONNULL(idStr),
+      name.map([](kj::String& n) -> kj::StringPtr { return n; }));
+
+  if (headers.get(headerIds.wake) != nullptr) {
+    // Another thread found the object's alarm in its index (see wakeRemoteActor()).
+    co_await KJ_ASSERT_NONNULL(ns).openActor(kj::mv(id));
+    response.send(204, "No Content", kj::HttpHeaders(headerTable), uint64_t(0));
+    co_return;
+  }
+
+  auto channel = KJ_ASSERT_NONNULL(ns).getActor(kj::mv(id));
+
+  IoChannelFactory::SubrequestMetadata metadata;
+  metadata.cfBlobJson = decode(headerIds.cfBlob);
+  auto worker = channel->startRequest(kj::mv(metadata));
+
+  auto forwarded = headers.cloneShallow();
+  headerIds.unsetAll(forwarded);
+  co_await worker->request(method, url, forwarded, requestBody, response);
+}
+
+// =======================================================================================
+
 kj::Own<Server::Service> Server::makeWorker(kj::StringPtr name, config::Worker::Reader conf) {
   auto& localActorConfigs = KJ_ASSERT_NONNULL(actorConfigs.find(name));
 
@@ -1470,27 +3773,21 @@ kj::Own<Server::Service> Server::makeWorker(kj::StringPtr name, config::Worker::
     Server& server;
     kj::StringPtr name;
 
-    kj::HashSet<kj::String> namedEntrypoints;
-    bool hasDefaultEntrypoint = false;
-
     void addError(kj::String error) override {
       server.reportConfigError(kj::str("service ", name, ": ", error));
     }
 
     void addHandler(kj::Maybe<kj::StringPtr> exportName, kj::StringPtr type) override {
-      KJ_IF_MAYBE(e, exportName) {
-        namedEntrypoints.findOrCreate(*e, [&]() { return kj::str(*e); });
-      } else {
-        hasDefaultEntrypoint = true;
-      }
+      // Handlers are discovered when the Worker is instantiated; see Definition::instantiate().
     }
   };
 
   ErrorReporter errorReporter(*this, name);
 
-  capnp::MallocMessageBuilder arena;
+  auto definition = kj::heap<WorkerService::Definition>(name, conf, globalContext->v8System);
+
   // TODO(beta): Factor out FeatureFlags from WorkerBundle.
-  auto featureFlags = arena.initRoot<CompatibilityFlags>();
+  auto featureFlags = definition->featureFlagsArena.initRoot<CompatibilityFlags>();
 
   if (conf.hasCompatibilityDate()) {
     compileCompatibilityFlags(conf.getCompatibilityDate(), conf.getCompatibilityFlags(),
@@ -1499,66 +3796,130 @@ kj::Own<Server::Service> Server::makeWorker(kj::StringPtr name, config::Worker::
   } else {
     errorReporter.addError(kj::str("Worker must specify compatibiltyDate."));
   }
+  definition->featureFlags = featureFlags.asReader();
 
-  class NullIsolateLimitEnforcer final: public IsolateLimitEnforcer {
-    // IsolateLimitEnforcer that enforces no limits.
-  public:
-    v8::Isolate::CreateParams getCreateParams() override { return {}; }
-    void customizeIsolate(v8::Isolate* isolate) override {}
-    ActorCacheSharedLruOptions getActorCacheLruOptions() override {
-      // TODO(someday): Make this configurable?
-      return {
-        .softLimit = 16ull << 20,
-        .hardLimit = 128ull << 20,
-        .staleTimeout = 30 * kj::SECONDS,
-        .dirtyKeySoftLimit = 64,
-        .maxKeysPerRpc = 128,
-
-        // For now, we use `neverFlush` to implement in-memory-only actors.
-        // See WorkerService::getActor().
-        .neverFlush = true
-      };
+  auto& limits = definition->limits;
+  auto limitsConf = conf.getLimits();
+  if (limitsConf.getCpuMillis() > 0) {
+    limits.cpuTime = limitsConf.getCpuMillis() * kj::MILLISECONDS;
+  }
+  if (limitsConf.getStartupCpuMillis() > 0) {
+    limits.startupCpuTime = limitsConf.getStartupCpuMillis() * kj::MILLISECONDS;
+  }
+  if (limitsConf.getHeapMegabytes() > 0) {
+    limits.heapSize = size_t(limitsConf.getHeapMegabytes()) << 20;
+  }
+  if (limitsConf.getTeeBufferKilobytes() > 0) {
+    limits.teeBuffer = size_t(limitsConf.getTeeBufferKilobytes()) << 10;
+  }
+
+  if (limits.cpuTime != nullptr || limits.startupCpuTime != nullptr) {
+    KJ_IF_MAYBE(w, cpuWatchdog) {
+      definition->watchdog = **w;
+    } else {
+      definition->watchdog = *cpuWatchdog.emplace(kj::heap<CpuWatchdog>());
+    }
+  }
+
+  auto validateCacheConfig = [&](config::Worker::DurableObjectCache::Reader cacheConf,
+                                 kj::StringPtr what) {
+    if (cacheConf.getHardLimitMegabytes() < cacheConf.getSoftLimitMegabytes()) {
+      errorReporter.addError(kj::str(
+          what, " has a hardLimitMegabytes smaller than its softLimitMegabytes."));
     }
-    kj::Own<void> enterStartupJs(
-        jsg::Lock& lock, kj::Maybe<kj::Exception>& error) const override {
-      return {};
+    if (cacheConf.getMaxKeysPerRpc() == 0) {
+      errorReporter.addError(kj::str(what, " must have a maxKeysPerRpc of at least one."));
     }
-    kj::Own<void> enterDynamicImportJs(
-        jsg::Lock& lock, kj::Maybe<kj::Exception>& error) const override {
-      return {};
+    if (cacheConf.getMaxKilobytesPerRpc() == 0) {
+      errorReporter.addError(kj::str(what, " must have a maxKilobytesPerRpc of at least one."));
     }
-    kj::Own<void> enterLoggingJs(
-        jsg::Lock& lock, kj::Maybe<kj::Exception>& error) const override {
-      return {};
+    if (cacheConf.getMaxBatchesInFlight() == 0) {
+      errorReporter.addError(kj::str(what, " must have a maxBatchesInFlight of at least one."));
     }
-    kj::Own<void> enterInspectorJs(
-        jsg::Lock& loc, kj::Maybe<kj::Exception>& error) const override {
-      return {};
+    if (cacheConf.getMaxFlushesInFlight() == 0) {
+      errorReporter.addError(kj::str(what, " must have a maxFlushesInFlight of at least one."));
     }
-    void completedRequest(kj::StringPtr id) const override {}
-    bool exitJs(jsg::Lock& lock) const override { return false; }
-    void reportMetrics(IsolateObserver& isolateMetrics) const override {}
   };
+  validateCacheConfig(conf.getDurableObjectCache(), "durableObjectCache");
+  for (auto ns: conf.getDurableObjectNamespaces()) {
+    if (ns.hasCache()) {
+      validateCacheConfig(ns.getCache(),
+          kj::str("The cache of Durable Object namespace \"", ns.getClassName(), "\""));
+    }
+  }
+
+  kj::Maybe<const ActorCacheMemoryBudget&> actorCacheBudgetRef;
+  KJ_IF_MAYBE(b, actorCacheBudget) {
+    actorCacheBudgetRef = **b;
+  }
+
+  // We use `neverFlush` to implement in-memory-only actors.
+  // See WorkerService::getActor().
+  definition->lruOptions = makeActorCacheLruOptions(conf.getDurableObjectCache(),
+      !conf.getDurableObjectStorage().isLocalDisk(), actorCacheBudgetRef);
+
+  auto gcConf = conf.getGarbageCollection();
+  kj::Maybe<WorkerService::IdleGcOptions> idleGcOptions;
+  if (gcConf.getIdleMillis() > 0) {
+    if (gcConf.getIdleBudgetMillis() == 0) {
+      errorReporter.addError(kj::str(
+          "garbageCollection.idleBudgetMillis must be non-zero when idleMillis is set."));
+    }
+    idleGcOptions = WorkerService::IdleGcOptions {
+      .delay = gcConf.getIdleMillis() * kj::MILLISECONDS,
+      .budget = gcConf.getIdleBudgetMillis() * kj::MILLISECONDS,
+    };
+  }
+
+  if (gcConf.getLogPausesOverMillis() > 0) {
+    definition->logGcPausesOver = gcConf.getLogPausesOverMillis() * kj::MILLISECONDS;
+  }
+
+  if (conf.getLogLockHoldsOverMillis() > 0) {
+    definition->logLockHoldsOver = conf.getLogLockHoldsOverMillis() * kj::MILLISECONDS;
+  }
+
+  definition->isolatePoolSize = conf.getIsolatePoolSize();
+  if (definition->isolatePoolSize == 0) {
+    errorReporter.addError(kj::str("isolatePoolSize must be at least one."));
+    definition->isolatePoolSize = 1;
+  }
+
+  if (conf.hasConcurrencyLimit()) {
+    auto limitConf = conf.getConcurrencyLimit();
+    if (limitConf.getTargetLockWaitMillis() == 0) {
+      errorReporter.addError(kj::str("concurrencyLimit.targetLockWaitMillis must be non-zero."));
+    } else if (limitConf.getMinLimit() == 0 ||
+               limitConf.getMinLimit() > limitConf.getMaxLimit()) {
+      errorReporter.addError(kj::str(
+          "concurrencyLimit.minLimit must be at least one, and no more than maxLimit."));
+    } else {
+      definition->concurrencyLimit = WorkerService::Definition::ConcurrencyLimit {
+        .options = {
+          .targetLockWait = limitConf.getTargetLockWaitMillis() * kj::MILLISECONDS,
+          .initialLimit = limitConf.getInitialLimit(),
+          .minLimit = limitConf.getMinLimit(),
+          .maxLimit = limitConf.getMaxLimit(),
+          .maxQueued = limitConf.getMaxQueued(),
+          .maxQueueTime = limitConf.getMaxQueueMillis() * kj::MILLISECONDS,
+        },
+        .retryAfterSeconds = limitConf.getRetryAfterSeconds(),
+        .lockWaits = kj::atomicRefcounted<LockWaitSamples>(),
+      };
+    }
+  }
 
-  auto limitEnforcer = kj::heap<NullIsolateLimitEnforcer>();
-  auto api = kj::heap<WorkerdApiIsolate>(globalContext->v8System,
-      featureFlags.asReader(), *limitEnforcer);
-  auto isolate = kj::atomicRefcounted<Worker::Isolate>(
-      kj::mv(api),
-      kj::atomicRefcounted<IsolateObserver>(),
-      name,
-      kj::mv(limitEnforcer),
-      maybeInspectorService != nullptr);
+  definition->coalesceSubrequests = conf.getCoalesceSubrequests();
 
-  // If we are using the inspector, we need to register the Worker::Isolate
-  // with the inspector service.
-  KJ_IF_MAYBE(inspector, maybeInspectorService) {
-    (*inspector)->registerIsolate(name, isolate.get());
+  KJ_IF_MAYBE(c, codeCache) {
+    definition->codeCache = **c;
   }
 
-  auto script = isolate->newScript(name, WorkerdApiIsolate::extractSource(conf, errorReporter),
-                                   IsolateObserver::StartType::COLD,
-                                   false, errorReporter);
+  definition->allowInspector = maybeInspectorService != nullptr;
+  definition->traceLocks = spanExporter != nullptr;
+  if (metricsEnabled) {
+    definition->metrics = metricsRegistry->addWorker(name);
+  }
 
   struct FutureSubrequestChannel {
     config::ServiceDesignator::Reader designator;
@@ -1572,9 +3933,17 @@ kj::Own<Server::Service> Server::makeWorker(kj::StringPtr name, config::Worker::
   };
   kj::Vector<FutureActorChannel> actorChannels;
 
+  struct FutureLogfwdrChannel {
+    kj::StringPtr bindingName;
+    config::Worker::Binding::AnalyticsEngine::Reader conf;
+    kj::String errorContext;
+  };
+  kj::Vector<FutureLogfwdrChannel> logfwdrChannels;
+
   auto confBindings = conf.getBindings();
   using Global = WorkerdApiIsolate::Global;
-  kj::Vector<Global> globals(confBindings.size());
+  auto& globals = definition->globals;
+  globals.reserve(confBindings.size());
   for (auto binding: confBindings) {
     kj::StringPtr bindingName = binding.getName();
     auto addGlobal = [&](auto&& value) {
@@ -1812,32 +4181,31 @@ kj::Own<Server::Service> Server::makeWorker(kj::StringPtr name, config::Worker::
         });
         continue;
       }
-    }
-    errorReporter.addError(kj::str(
-        errorContext, "has unrecognized type. Was the config compiled with a newer version of "
-        "the schema?"));
-  }
 
-  auto worker = kj::atomicRefcounted<Worker>(
-      kj::mv(script),
-      kj::atomicRefcounted<WorkerObserver>(),
-      [&](jsg::Lock& lock, const Worker::ApiIsolate& apiIsolate, v8::Local<v8::Object> target) {
-        return kj::downcast<const WorkerdApiIsolate>(apiIsolate).compileGlobals(
-            lock, globals, target, 1);
-      },
-      IsolateObserver::StartType::COLD,
-      nullptr,          // systemTracer -- TODO(beta): factor out
-      Worker::Lock::TakeSynchronously(nullptr),
-      errorReporter);
+      case config::Worker::Binding::ANALYTICS_ENGINE: {
+        auto aeConf = binding.getAnalyticsEngine();
+        addGlobal(Global::AnalyticsEngine {
+          .logfwdrChannel = (uint)logfwdrChannels.size(),
+          .dataset = kj::str(aeConf.hasDataset() ? aeConf.getDataset() : bindingName)
+        });
 
-  {
-    Worker::Lock lock(*worker, Worker::Lock::TakeSynchronously(nullptr));
-    lock.validateHandlers(errorReporter);
+        logfwdrChannels.add(FutureLogfwdrChannel {
+          bindingName,
+          aeConf,
+          kj::mv(errorContext)
+        });
+        continue;
+      }
+    }
+    errorReporter.addError(kj::str(
+        errorContext, "has unrecognized type. Was the config compiled with a newer version of "
+        "the schema?"));
   }
 
   auto linkCallback =
       [this, name, conf, subrequestChannels = kj::mv(subrequestChannels),
-       actorChannels = kj::mv(actorChannels)](WorkerService& workerService) mutable {
+       actorChannels = kj::mv(actorChannels), logfwdrChannels = kj::mv(logfwdrChannels)]
+      (WorkerService& workerService) mutable {
     auto services = kj::heapArrayBuilder<Service*>(subrequestChannels.size() +
               IoContext::SPECIAL_SUBREQUEST_CHANNEL_COUNT);
 
@@ -1861,7 +4229,7 @@ kj::Own<Server::Service> Server::makeWorker(kj::StringPtr name, config::Worker::
           // error was reported earlier
           return nullptr;
         });
-        targetService = dynamic_cast<WorkerService*>(svc.get());
+        targetService = dynamic_cast<WorkerService*>(&svc->get());
         if (targetService == nullptr) {
           // error was reported earlier
           return nullptr;
@@ -1872,6 +4240,34 @@ kj::Own<Server::Service> Server::makeWorker(kj::StringPtr name, config::Worker::
       return targetService->getActorNamespace(channel.designator.getClassName());
     };
 
+    auto logfwdr = KJ_MAP(channel, logfwdrChannels) {
+      return makeAnalyticsBatcher(channel.bindingName, channel.conf,
+                                  kj::mv(channel.errorContext));
+    };
+
+    kj::Maybe<const kj::Directory&> actorStorage;
+    if (conf.getDurableObjectStorage().isLocalDisk()) {
+      kj::StringPtr diskName = conf.getDurableObjectStorage().getLocalDisk();
+      KJ_IF_MAYBE(svc, this->services.find(diskName)) {
+        auto disk = dynamic_cast<DiskDirectoryService*>(&(*svc)->get());
+        if (disk == nullptr) {
+          reportConfigError(kj::str(
+              "Worker \"", name, "\"'s durableObjectStorage refers to service \"", diskName,
+              "\", but that service is not a disk directory service."));
+        } else KJ_IF_MAYBE(dir, disk->getWritable()) {
+          actorStorage = *dir;
+        } else {
+          reportConfigError(kj::str(
+              "Worker \"", name, "\"'s durableObjectStorage refers to disk directory service \"",
+              diskName, "\", but that service is not writable."));
+        }
+      } else {
+        reportConfigError(kj::str(
+            "Worker \"", name, "\"'s durableObjectStorage refers to a service \"", diskName,
+            "\", but no such service is defined."));
+      }
+    }
+
     if (conf.hasCacheApiOutbound()) {
       Service& cacheApi = lookupService(conf.getCacheApiOutbound(),
                                         kj::str("Worker \"", name, "\"'s cacheApiOutbound"));
@@ -1879,20 +4275,430 @@ kj::Own<Server::Service> Server::makeWorker(kj::StringPtr name, config::Worker::
       return WorkerService::LinkedIoChannels{
           .subrequest = services.finish(),
           .actor = kj::mv(actors),
-          .cache = &cacheApi
+          .cache = &cacheApi,
+          .actorStorage = actorStorage,
+          .logfwdr = kj::mv(logfwdr)
       };
     } else {
       return WorkerService::LinkedIoChannels{
           .subrequest = services.finish(),
-          .actor = kj::mv(actors)
+          .actor = kj::mv(actors),
+          .actorStorage = actorStorage,
+          .logfwdr = kj::mv(logfwdr)
       };
     }
 
   };
 
-  return kj::heap<WorkerService>(globalContext->threadContext, kj::mv(worker),
-                                 kj::mv(errorReporter.namedEntrypoints), localActorConfigs,
-                                 kj::mv(linkCallback));
+  kj::Maybe<kj::Duration> evictAfter;
+  kj::Maybe<InspectorService&> inspector;
+  KJ_IF_MAYBE(i, maybeInspectorService) {
+    inspector = **i;
+  }
+  if (workerStartup.isLazy()) {
+    auto seconds = workerStartup.getLazy().getEvictAfterIdleSeconds();
+    if (seconds > 0) {
+      evictAfter = seconds * kj::SECONDS;
+    }
+  }
+
+  auto service = kj::heap<WorkerService>(globalContext->threadContext, kj::mv(definition),
+                                         localActorConfigs, kj::mv(linkCallback), idleGcOptions,
+                                         evictAfter, inspector,
+                                         spanExporter.map([](kj::Own<SpanExporter>& e)
+                                             -> SpanExporter& { return *e; }),
+                                         actorRouter.map([](kj::Own<ActorRouter>& r)
+                                             -> ActorRouter& { return *r; }));
+
+  if (workerStartup.isEager()) {
+    auto instance = service->getDefinition().instantiate();
+    for (auto& error: instance.errors) {
+      errorReporter.addError(kj::mv(error));
+    }
+    service->setInstance(kj::mv(instance));
+  }
+  // With `eagerParallel`, run() instantiates all the Workers together once they've all been
+  // defined. With `lazy`, each Worker is instantiated on its first request.
+
+  return service;
+}
+
+void Server::instantiateWorkersInParallel(kj::ArrayPtr<WorkerService* const> pending) {
+  uint threadCount = workerStartup.getEagerParallel();
+  if (threadCount == 0) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    threadCount = cores > 0 ? cores : 1;
+  }
+
+  // Each thread takes the next Worker until there are none left. Definition::instantiate() only
+  // reads its own state, so the threads share nothing else. The results are installed, and their
+  // errors reported, back on this thread, in config order.
+  auto results = kj::heapArray<kj::Maybe<WorkerService::Instance>>(pending.size());
+  auto exceptions = kj::heapArray<kj::Maybe<kj::Exception>>(pending.size());
+  std::atomic<size_t> next = 0;
+  {
+    auto threads = kj::heapArrayBuilder<kj::Own<kj::Thread>>(
+        kj::min(threadCount, pending.size()));
+    while (!threads.isFull()) {
+      threads.add(kj::heap<kj::Thread>([&]() {
+        for (;;) {
+          size_t i = next.fetch_add(1, std::memory_order_relaxed);
+          if (i >= pending.size()) return;
+          exceptions[i] = kj::runCatchingExceptions([&]() {
+            results[i] = pending[i]->getDefinition().instantiate();
+          });
+        }
+      }));
+    }
+    // The threads are joined as `threads` is destroyed.
+  }
+
+  for (auto i: kj::indices(pending)) {
+    auto& service = *pending[i];
+    kj::StringPtr name = service.getDefinition().name;
+    KJ_IF_MAYBE(exception, exceptions[i]) {
+      reportConfigError(kj::str("service ", name, ": ", exception->getDescription()));
+      continue;
+    }
+
+    auto& instance = KJ_ASSERT_NONNULL(results[i]);
+    for (auto& error: instance.errors) {
+      reportConfigError(kj::str("service ", name, ": ", error));
+    }
+    service.setInstance(kj::mv(instance));
+  }
+}
+
+// =======================================================================================
+
+class Server::HttpCacheService final: public Service, private WorkerInterface {
+  // Service used when the service is configured as an in-memory HTTP cache.
+
+public:
+  HttpCacheService(config::HttpCache::Reader conf, kj::Timer& timer,
+                   kj::HttpHeaderTable::Builder& headerTableBuilder)
+      : inner(newHttpCache(timer, headerTableBuilder, {
+          .maxTotalSize = conf.getMaxTotalSize(),
+          .maxEntrySize = conf.getMaxEntrySize(),
+          .defaultTtl = conf.getDefaultTtlSeconds() * kj::SECONDS,
+        })) {}
+
+  kj::Own<WorkerInterface> startRequest(IoChannelFactory::SubrequestMetadata metadata) override {
+    return { this, kj::NullDisposer::instance };
+  }
+
+private:
+  kj::Own<kj::HttpService> inner;
+
+  kj::Promise<void> request(
+      kj::HttpMethod method, kj::StringPtr url, const kj::HttpHeaders& headers,
+      kj::AsyncInputStream& requestBody, kj::HttpService::Response& response) override {
+    return inner->request(method, url, headers, requestBody, response);
+  }
+
+  kj::Promise<void> connect(kj::StringPtr host, const kj::HttpHeaders& headers,
+      kj::AsyncIoStream& connection, kj::HttpService::ConnectResponse& response) override {
+    throwUnsupported();
+  }
+  void prewarm(kj::StringPtr url) override {}
+  kj::Promise<ScheduledResult> runScheduled(kj::Date scheduledTime, kj::StringPtr cron) override {
+    throwUnsupported();
+  }
+  kj::Promise<AlarmResult> runAlarm(kj::Date scheduledTime) override {
+    throwUnsupported();
+  }
+  kj::Promise<CustomEvent::Result> customEvent(kj::Own<CustomEvent> event) override {
+    throwUnsupported();
+  }
+
+  [[noreturn]] void throwUnsupported() {
+    JSG_FAIL_REQUIRE(Error, "HTTP cache services don't support this event type.");
+  }
+};
+
+kj::Own<Server::Service> Server::makeHttpCacheService(
+    config::HttpCache::Reader conf, kj::HttpHeaderTable::Builder& headerTableBuilder) {
+  return kj::heap<HttpCacheService>(conf, timer, headerTableBuilder);
+}
+
+// =======================================================================================
+
+class Server::MetricsService final: public Service, private WorkerInterface {
+  // Service used when the service is configured as `metrics`. Answers GET requests with the
+  // metrics of every Worker in the process, in the Prometheus text exposition format.
+
+public:
+  MetricsService(const MetricsRegistry& registry, kj::HttpHeaderTable& headerTable)
+      : registry(registry), headerTable(headerTable) {}
+
+  kj::Own<WorkerInterface> startRequest(IoChannelFactory::SubrequestMetadata metadata) override {
+    return { this, kj::NullDisposer::instance };
+  }
+
+private:
+  const MetricsRegistry& registry;
+  kj::HttpHeaderTable& headerTable;
+
+  kj::Promise<void> request(
+      kj::HttpMethod method, kj::StringPtr url, const kj::HttpHeaders& headers,
+      kj::AsyncInputStream& requestBody, kj::HttpService::Response& response) override {
+    if (method != kj::HttpMethod::GET && method != kj::HttpMethod::HEAD) {
+      return response.sendError(405, "Method Not Allowed", headerTable);
+    }
+
+    auto body = registry.render();
+    kj::HttpHeaders responseHeaders(headerTable);
+    responseHeaders.set(kj::HttpHeaderId::CONTENT_TYPE, "text/plain; version=0.0.4");
+    auto out = response.send(200, "OK", responseHeaders, body.size());
+    if (method == kj::HttpMethod::HEAD) {
+      return kj::READY_NOW;
+    }
+    auto promise = out->write(body.begin(), body.size());
+    return promise.attach(kj::mv(out), kj::mv(body));
+  }
+
+  kj::Promise<void> connect(kj::StringPtr host, const kj::HttpHeaders& headers,
+      kj::AsyncIoStream& connection, kj::HttpService::ConnectResponse& response) override {
+    throwUnsupported();
+  }
+  void prewarm(kj::StringPtr url) override {}
+  kj::Promise<ScheduledResult> runScheduled(kj::Date scheduledTime, kj::StringPtr cron) override {
+    throwUnsupported();
+  }
+  kj::Promise<AlarmResult> runAlarm(kj::Date scheduledTime) override {
+    throwUnsupported();
+  }
+  kj::Promise<CustomEvent::Result> customEvent(kj::Own<CustomEvent> event) override {
+    throwUnsupported();
+  }
+
+  [[noreturn]] void throwUnsupported() {
+    JSG_FAIL_REQUIRE(Error, "Metrics services don't support this event type.");
+  }
+};
+
+kj::Own<Server::Service> Server::makeMetricsService() {
+  return kj::heap<MetricsService>(*metricsRegistry, globalContext->headerTable);
+}
+
+// =======================================================================================
+
+class Server::ProfilerService final: public Service, private WorkerInterface {
+  // Service used when the service is configured as `profiler`. Profiles this Server's Worker
+  // services on request, as described in workerd.capnp.
+
+public:
+  ProfilerService(Server& server, kj::HttpHeaderTable& headerTable)
+      : server(server), headerTable(headerTable) {}
+
+  kj::Own<WorkerInterface> startRequest(IoChannelFactory::SubrequestMetadata metadata) override {
+    return { this, kj::NullDisposer::instance };
+  }
+
+private:
+  Server& server;
+  kj::HttpHeaderTable& headerTable;
+
+  static constexpr kj::Duration DEFAULT_PROFILE_DURATION = 10 * kj::SECONDS;
+  static constexpr kj::Duration MAX_PROFILE_DURATION = 300 * kj::SECONDS;
+  static constexpr kj::Duration DEFAULT_SAMPLING_INTERVAL = 1 * kj::MILLISECONDS;
+
+  kj::Promise<void> request(
+      kj::HttpMethod method, kj::StringPtr urlStr, const kj::HttpHeaders& headers,
+      kj::AsyncInputStream& requestBody, kj::HttpService::Response& response) override {
+    if (method != kj::HttpMethod::GET) {
+      return response.sendError(405, "Method Not Allowed", headerTable);
+    }
+    auto url = KJ_UNWRAP_OR(kj::Url::tryParse(urlStr, kj::Url::HTTP_PROXY_REQUEST), {
+      return response.sendError(400, "Bad Request", headerTable);
+    });
+    if (url.path.size() != 1) {
+      return response.sendError(404, "Not Found", headerTable);
+    }
+
+    auto& service = KJ_UNWRAP_OR(findWorker(getParam(url, "worker").orDefault(nullptr)), {
+      return response.sendError(404, "No such Worker", headerTable);
+    });
+
+    if (url.path[0] == "cpu-profile") {
+      auto duration = DEFAULT_PROFILE_DURATION;
+      KJ_IF_MAYBE(param, getParam(url, "seconds")) {
+        auto seconds = KJ_UNWRAP_OR(param->tryParseAs<uint>(), {
+          return response.sendError(400, "Bad Request", headerTable);
+        });
+        duration = kj::min(seconds * kj::SECONDS, MAX_PROFILE_DURATION);
+      }
+      auto interval = DEFAULT_SAMPLING_INTERVAL;
+      KJ_IF_MAYBE(param, getParam(url, "interval_us")) {
+        auto micros = KJ_UNWRAP_OR(param->tryParseAs<uint>(), {
+          return response.sendError(400, "Bad Request", headerTable);
+        });
+        interval = kj::max(micros, 1u) * kj::MICROSECONDS;
+      }
+      return sendCpuProfile(service.getHomeIsolate(), duration, interval, response);
+    } else if (url.path[0] == "heap-snapshot") {
+      return sendHeapSnapshot(service.getHomeIsolate(), response);
+    } else {
+      return response.sendError(404, "Not Found", headerTable);
+    }
+  }
+
+  kj::Promise<void> sendCpuProfile(const Worker::Isolate& isolate, kj::Duration duration,
+                                   kj::Duration interval, kj::HttpService::Response& response) {
+    auto profile = co_await isolate.takeCpuProfile(server.timer, duration, interval);
+    kj::HttpHeaders responseHeaders(headerTable);
+    responseHeaders.set(kj::HttpHeaderId::CONTENT_TYPE, "application/json");
+    auto out = response.send(200, "OK", responseHeaders, profile.size());
+    co_await out->write(profile.begin(), profile.size());
+  }
+
+  kj::Promise<void> sendHeapSnapshot(const Worker::Isolate& isolate,
+                                     kj::HttpService::Response& response) {
+    kj::HttpHeaders responseHeaders(headerTable);
+    responseHeaders.set(kj::HttpHeaderId::CONTENT_TYPE, "application/json");
+    auto out = response.send(200, "OK", responseHeaders);
+
+    // The JSON is never assembled in one piece: it's written as it's produced, at the pace the
+    // client reads it.
+    co_await isolate.writeHeapSnapshot(*out);
+  }
+
+  kj::Maybe<WorkerService&> findWorker(kj::StringPtr name) {
+    KJ_IF_MAYBE(slot, server.services.find(name)) {
+      if (auto worker = dynamic_cast<WorkerService*>(&(*slot)->get())) {
+        return *worker;
+      }
+    }
+    return nullptr;
+  }
+
+  static kj::Maybe<kj::StringPtr> getParam(const kj::Url& url, kj::StringPtr name) {
+    for (auto& param: url.query) {
+      if (param.name == name) return param.value.asPtr();
+    }
+    return nullptr;
+  }
+
+  kj::Promise<void> connect(kj::StringPtr host, const kj::HttpHeaders& headers,
+      kj::AsyncIoStream& connection, kj::HttpService::ConnectResponse& response) override {
+    throwUnsupported();
+  }
+  void prewarm(kj::StringPtr url) override {}
+  kj::Promise<ScheduledResult> runScheduled(kj::Date scheduledTime, kj::StringPtr cron) override {
+    throwUnsupported();
+  }
+  kj::Promise<AlarmResult> runAlarm(kj::Date scheduledTime) override {
+    throwUnsupported();
+  }
+  kj::Promise<CustomEvent::Result> customEvent(kj::Own<CustomEvent> event) override {
+    throwUnsupported();
+  }
+
+  [[noreturn]] void throwUnsupported() {
+    JSG_FAIL_REQUIRE(Error, "Profiler services don't support this event type.");
+  }
+};
+
+// =======================================================================================
+
+class Server::LocalStoreService final: public Service, private WorkerInterface {
+  // Service used when the service is configured as a local KV store or R2 bucket. `inner`
+  // implements the protocol the corresponding binding speaks.
+
+public:
+  LocalStoreService(kj::StringPtr kind, kj::Own<kj::HttpService> inner)
+      : kind(kind), inner(kj::mv(inner)) {}
+
+  kj::Own<WorkerInterface> startRequest(IoChannelFactory::SubrequestMetadata metadata) override {
+    return { this, kj::NullDisposer::instance };
+  }
+
+private:
+  kj::StringPtr kind;
+  kj::Own<kj::HttpService> inner;
+
+  kj::Promise<void> request(
+      kj::HttpMethod method, kj::StringPtr url, const kj::HttpHeaders& headers,
+      kj::AsyncInputStream& requestBody, kj::HttpService::Response& response) override {
+    return inner->request(method, url, headers, requestBody, response);
+  }
+
+  kj::Promise<void> connect(kj::StringPtr host, const kj::HttpHeaders& headers,
+      kj::AsyncIoStream& connection, kj::HttpService::ConnectResponse& response) override {
+    throwUnsupported();
+  }
+  void prewarm(kj::StringPtr url) override {}
+  kj::Promise<ScheduledResult> runScheduled(kj::Date scheduledTime, kj::StringPtr cron) override {
+    throwUnsupported();
+  }
+  kj::Promise<AlarmResult> runAlarm(kj::Date scheduledTime) override {
+    throwUnsupported();
+  }
+  kj::Promise<CustomEvent::Result> customEvent(kj::Own<CustomEvent> event) override {
+    throwUnsupported();
+  }
+
+  [[noreturn]] void throwUnsupported() {
+    JSG_FAIL_REQUIRE(Error, kind, " services don't support this event type.");
+  }
+};
+
+kj::Maybe<kj::Own<const kj::Directory>> Server::openLocalStoreDirectory(
+    kj::StringPtr kind, kj::StringPtr name, kj::Maybe<kj::StringPtr> configuredPath) {
+  if (currentConfig.getThreads() != 1) {
+    // Each thread would have its own index and cache of the same directory.
+    reportConfigError(kj::str(
+        kind, " \"", name, "\" is not supported when `threads` is not 1."));
+    return nullptr;
+  }
+
+  kj::StringPtr pathStr = nullptr;
+  kj::String ownPathStr;
+
+  KJ_IF_MAYBE(override, directoryOverrides.findEntry(name)) {
+    pathStr = ownPathStr = kj::mv(override->value);
+    directoryOverrides.erase(*override);
+  } else KJ_IF_MAYBE(p, configuredPath) {
+    pathStr = *p;
+  } else {
+    reportConfigError(kj::str(
+        kind, " \"", name, "\" has no path in the config, so must be specified on the "
+        "command line with `--directory-path`."));
+    return nullptr;
+  }
+
+  auto path = fs.getCurrentPath().evalNative(pathStr);
+  auto openDir = KJ_UNWRAP_OR(fs.getRoot().tryOpenSubdir(kj::mv(path),
+      kj::WriteMode::CREATE | kj::WriteMode::MODIFY | kj::WriteMode::CREATE_PARENT), {
+    reportConfigError(kj::str(
+        kind, " \"", name, "\" could not open directory: ", pathStr));
+    return nullptr;
+  });
+  return kj::Own<const kj::Directory>(kj::mv(openDir));
+}
+
+kj::Own<Server::Service> Server::makeKvStoreService(
+    kj::StringPtr name, config::KvStore::Reader conf,
+    kj::HttpHeaderTable::Builder& headerTableBuilder) {
+  auto directory = KJ_UNWRAP_OR(openLocalStoreDirectory("KV store", name,
+      conf.hasPath() ? kj::Maybe<kj::StringPtr>(conf.getPath()) : nullptr), {
+    return makeInvalidConfigService();
+  });
+  return kj::heap<LocalStoreService>("KV store",
+      newLocalKvStore(kj::mv(directory), kj::systemPreciseCalendarClock(), headerTableBuilder, {
+        .maxCacheSize = conf.getMaxCacheSize(),
+      }));
+}
+
+kj::Own<Server::Service> Server::makeR2StoreService(
+    kj::StringPtr name, config::R2Store::Reader conf,
+    kj::HttpHeaderTable::Builder& headerTableBuilder) {
+  auto directory = KJ_UNWRAP_OR(openLocalStoreDirectory("R2 store", name,
+      conf.hasPath() ? kj::Maybe<kj::StringPtr>(conf.getPath()) : nullptr), {
+    return makeInvalidConfigService();
+  });
+  return kj::heap<LocalStoreService>("R2 store",
+      newLocalR2Bucket(kj::mv(directory), kj::systemPreciseCalendarClock(), headerTableBuilder));
 }
 
 // =======================================================================================
@@ -1919,6 +4725,21 @@ kj::Own<Server::Service> Server::makeService(
 
     case config::Service::DISK:
       return makeDiskDirectoryService(name, conf.getDisk(), headerTableBuilder);
+
+    case config::Service::HTTP_CACHE:
+      return makeHttpCacheService(conf.getHttpCache(), headerTableBuilder);
+
+    case config::Service::KV_STORE:
+      return makeKvStoreService(name, conf.getKvStore(), headerTableBuilder);
+
+    case config::Service::R2_STORE:
+      return makeR2StoreService(name, conf.getR2Store(), headerTableBuilder);
+
+    case config::Service::METRICS:
+      return makeMetricsService();
+
+    case config::Service::PROFILER:
+      return kj::heap<ProfilerService>(*this, globalContext->headerTable);
   }
 
   reportConfigError(kj::str(
@@ -1931,10 +4752,12 @@ void Server::taskFailed(kj::Exception&& exception) {
   fatalFulfiller->reject(kj::mv(exception));
 }
 
+// =======================================================================================
+
 Server::Service& Server::lookupService(
     config::ServiceDesignator::Reader designator, kj::String errorContext) {
   kj::StringPtr targetName = designator.getName();
-  Service* service = KJ_UNWRAP_OR(services.find(targetName), {
+  ServiceSlot& slot = *KJ_UNWRAP_OR(services.find(targetName), {
     reportConfigError(kj::str(
         errorContext, " refers to a service \"", targetName,
         "\", but no such service is defined."));
@@ -1943,9 +4766,16 @@ Server::Service& Server::lookupService(
 
   if (designator.hasEntrypoint()) {
     kj::StringPtr entrypointName = designator.getEntrypoint();
+
+    // During a reload, check the entrypoint against the service that's about to take over.
+    Service* service = &slot.get();
+    KJ_IF_MAYBE(replacement, pendingReplacements.find(targetName)) {
+      service = *replacement;
+    }
+
     if (WorkerService* worker = dynamic_cast<WorkerService*>(service)) {
-      KJ_IF_MAYBE(ep, worker->getEntrypoint(entrypointName)) {
-        return *ep;
+      if (worker->getEntrypoint(entrypointName) != nullptr) {
+        return slot.getEntrypoint(entrypointName);
       } else {
         reportConfigError(kj::str(
             errorContext, " refers to service \"", targetName, "\" with a named entrypoint \"",
@@ -1960,10 +4790,79 @@ Server::Service& Server::lookupService(
       return *invalidConfigServiceSingleton;
     }
   } else {
-    return *service;
+    return slot;
   }
 }
 
+kj::Maybe<kj::Own<AnalyticsBatcher>> Server::makeAnalyticsBatcher(
+    kj::StringPtr bindingName, config::Worker::Binding::AnalyticsEngine::Reader conf,
+    kj::String errorContext) {
+  AnalyticsBatcherOptions options;
+  if (conf.getMaxBatchSize() == 0) {
+    reportConfigError(kj::str(errorContext, " has a maxBatchSize of zero."));
+    return nullptr;
+  }
+  options.maxBatchSize = conf.getMaxBatchSize();
+  options.flushInterval = conf.getFlushIntervalMs() * kj::MILLISECONDS;
+
+  switch (conf.which()) {
+    case config::Worker::Binding::AnalyticsEngine::SERVICE: {
+      Service& service = lookupService(conf.getService(), kj::mv(errorContext));
+      auto url = kj::str("https://fake-host/",
+          kj::encodeUriComponent(conf.hasDataset() ? conf.getDataset() : bindingName));
+
+      return kj::heap<AnalyticsBatcher>(timer,
+          [&service, &headerTable = globalContext->headerTable, url = kj::mv(url)]
+          (kj::String batch) -> kj::Promise<void> {
+        auto client = asHttpClient(service.startRequest({}));
+        kj::HttpHeaders headers(headerTable);
+        headers.set(kj::HttpHeaderId::CONTENT_TYPE, "application/x-ndjson");
+        auto req = client->request(kj::HttpMethod::POST, url, headers, batch.size());
+
+        return req.body->write(batch.begin(), batch.size())
+            .attach(kj::mv(batch), kj::mv(req.body))
+            .then([response = kj::mv(req.response)]() mutable { return kj::mv(response); })
+            .then([](kj::HttpClient::Response&& response) {
+          if (response.statusCode >= 400) {
+            KJ_LOG(WARNING, "Analytics Engine service rejected data points",
+                response.statusCode, response.statusText);
+          }
+          return response.body->readAllBytes().attach(kj::mv(response.body)).ignoreResult();
+        }).attach(kj::mv(client));
+      }, options);
+    }
+
+    case config::Worker::Binding::AnalyticsEngine::FILE: {
+      if (currentConfig.getThreads() != 1) {
+        // Every thread would append to the same file at once.
+        reportConfigError(kj::str(
+            errorContext, " writes to a file, which is not supported when `threads` is not 1."));
+        return nullptr;
+      }
+
+      auto path = fs.getCurrentPath().evalNative(conf.getFile());
+      auto file = KJ_UNWRAP_OR(fs.getRoot().tryOpenFile(kj::mv(path),
+          kj::WriteMode::CREATE | kj::WriteMode::MODIFY | kj::WriteMode::CREATE_PARENT), {
+        reportConfigError(kj::str(
+            errorContext, " could not open file: ", conf.getFile()));
+        return nullptr;
+      });
+
+      return kj::heap<AnalyticsBatcher>(timer,
+          [appender = kj::newFileAppender(kj::mv(file))]
+          (kj::String batch) mutable -> kj::Promise<void> {
+        appender->write(batch.begin(), batch.size());
+        return kj::READY_NOW;
+      }, options);
+    }
+  }
+
+  reportConfigError(kj::str(
+      errorContext, " has an unrecognized destination. Was the config compiled with a newer "
+      "version of the schema?"));
+  return nullptr;
+}
+
 // =======================================================================================
 
 class Server::HttpListener final: private kj::TaskSet::ErrorHandler {
@@ -2050,17 +4949,45 @@ private:
 
     class ResponseWrapper final: public kj::HttpService::Response {
     public:
-      ResponseWrapper(kj::HttpService::Response& inner, HttpRewriter& rewriter)
-          : inner(inner), rewriter(rewriter) {}
+      ResponseWrapper(kj::HttpService::Response& inner, HttpRewriter& rewriter,
+                      bool mayCompress)
+          : inner(inner), rewriter(rewriter), mayCompress(mayCompress) {}
 
       kj::Own<kj::AsyncOutputStream> send(
           uint statusCode, kj::StringPtr statusText, const kj::HttpHeaders& headers,
           kj::Maybe<uint64_t> expectedBodySize = nullptr) override {
         auto rewrite = headers.cloneShallow();
         rewriter.rewriteResponse(rewrite);
+
+        if (mayCompress && rewriter.startCompressedResponse(statusCode, rewrite,
+                                                            expectedBodySize)) {
+          // The Worker's end of the body can't tell us when it's done except by being dropped,
+          // which is too late to flush the gzip stream. So the Worker writes into a pipe instead,
+          // and we pump that through gzip into the real body, finishing the gzip stream once the
+          // pipe is drained. finish() waits for this.
+          auto body = inner.send(statusCode, statusText, rewrite, nullptr);
+          auto gzip = kj::heap<kj::GzipAsyncOutputStream>(*body).attach(kj::mv(body));
+          auto pipe = kj::newOneWayPipe(expectedBodySize);
+          auto& gzipRef = *gzip;
+          compression = pipe.in->pumpTo(gzipRef).ignoreResult()
+              .then([&gzipRef]() { return gzipRef.end(); })
+              .attach(kj::mv(pipe.in), kj::mv(gzip));
+          return kj::mv(pipe.out);
+        }
+
         return inner.send(statusCode, statusText, rewrite, expectedBodySize);
       }
 
+      kj::Promise<void> finish() {
+        // Waits for a compressed body to be written out in full. Call once the request is done.
+        KJ_IF_MAYBE(c, compression) {
+          auto promise = kj::mv(*c);
+          compression = nullptr;
+          return kj::mv(promise);
+        }
+        return kj::READY_NOW;
+      }
+
       kj::Own<kj::WebSocket> acceptWebSocket(const kj::HttpHeaders& headers) override {
         auto rewrite = headers.cloneShallow();
         rewriter.rewriteResponse(rewrite);
@@ -2070,6 +4997,8 @@ private:
     private:
       kj::HttpService::Response& inner;
       HttpRewriter& rewriter;
+      bool mayCompress;
+      kj::Maybe<kj::Promise<void>> compression;
     };
 
     // ---------------------------------------------------------------------------
@@ -2083,10 +5012,20 @@ private:
 
       Response* wrappedResponse = &response;
       kj::Own<ResponseWrapper> ownResponse;
-      if (parent.rewriter->needsRewriteResponse()) {
-        wrappedResponse = ownResponse = kj::heap<ResponseWrapper>(response, *parent.rewriter);
+      bool mayCompress = parent.rewriter->mayCompressResponse(method, headers);
+      if (parent.rewriter->needsRewriteResponse() || mayCompress) {
+        wrappedResponse = ownResponse =
+            kj::heap<ResponseWrapper>(response, *parent.rewriter, mayCompress);
       }
 
+      const auto finish = [&](kj::Promise<void> promise) {
+        if (ownResponse.get() != nullptr) {
+          auto& responseRef = *ownResponse;
+          promise = promise.then([&responseRef]() { return responseRef.finish(); });
+        }
+        return promise;
+      };
+
       if (parent.rewriter->needsRewriteRequest() || cfBlobJson != nullptr) {
         auto rewrite = KJ_UNWRAP_OR(
             parent.rewriter->rewriteIncomingRequest(
@@ -2094,11 +5033,12 @@ private:
           return response.sendError(400, "Bad Request", parent.headerTable);
         });
         auto worker = parent.service.startRequest(kj::mv(metadata));
-        return worker->request(method, url, *rewrite.headers, requestBody, *wrappedResponse)
+        return finish(worker->request(method, url, *rewrite.headers, requestBody,
+                                      *wrappedResponse))
             .attach(kj::mv(rewrite), kj::mv(worker), kj::mv(ownResponse));
       } else {
         auto worker = parent.service.startRequest(kj::mv(metadata));
-        return worker->request(method, url, headers, requestBody, *wrappedResponse)
+        return finish(worker->request(method, url, headers, requestBody, *wrappedResponse))
             .attach(kj::mv(worker), kj::mv(ownResponse));
       }
     }
@@ -2118,6 +5058,98 @@ private:
   };
 };
 
+kj::Maybe<kj::Own<kj::ConnectionReceiver>> Server::listenOnAddress(kj::NetworkAddress& addr) {
+  auto& options = KJ_UNWRAP_OR(reusePort, {
+    return addr.listen();
+  });
+
+  // KJ doesn't give us a way to set socket options before bind(), so we have to create the socket
+  // ourselves. We let KJ do the hard parts (DNS lookup, default ports) and then parse its
+  // canonical numeric representation of the address, which is one of "*:port", "1.2.3.4:port",
+  // "[1234::abcd]:port", or a Unix address.
+  auto text = addr.toString();
+
+  struct sockaddr_storage storage;
+  memset(&storage, 0, sizeof(storage));
+  socklen_t length = 0;
+  bool isWildcard = false;
+
+  auto parsePort = [&](kj::StringPtr portText) -> uint16_t {
+    uint port = KJ_REQUIRE_NONNULL(portText.tryParseAs<uint>(), "invalid port", text);
+    KJ_REQUIRE(port < 65536, "invalid port", text);
+    return htons(port);
+  };
+
+  if (text.startsWith("unix")) {
+    // Unix sockets cannot be shared with SO_REUSEPORT. Only the first thread binds them.
+    if (options.threadIndex == 0) {
+      return addr.listen();
+    } else {
+      return nullptr;
+    }
+  } else if (text.startsWith("*:")) {
+    isWildcard = true;
+    auto& sin6 = reinterpret_cast<struct sockaddr_in6&>(storage);
+    sin6.sin6_family = AF_INET6;
+    sin6.sin6_addr = in6addr_any;
+    sin6.sin6_port = parsePort(text.slice(2));
+    length = sizeof(sin6);
+  } else if (text.startsWith("[")) {
+    size_t close = KJ_REQUIRE_NONNULL(text.findFirst(']'), "invalid address", text);
+    KJ_REQUIRE(text.slice(close).startsWith("]:"), "invalid address", text);
+    auto& sin6 = reinterpret_cast<struct sockaddr_in6&>(storage);
+    sin6.sin6_family = AF_INET6;
+    KJ_REQUIRE(inet_pton(AF_INET6, kj::str(text.slice(1, close)).cStr(), &sin6.sin6_addr) == 1,
+        "invalid address", text);
+    sin6.sin6_port = parsePort(text.slice(close + 2));
+    length = sizeof(sin6);
+  } else {
+    size_t colon = KJ_REQUIRE_NONNULL(text.findLast(':'), "invalid address", text);
+    auto& sin = reinterpret_cast<struct sockaddr_in&>(storage);
+    sin.sin_family = AF_INET;
+    KJ_REQUIRE(inet_pton(AF_INET, kj::str(text.slice(0, colon)).cStr(), &sin.sin_addr) == 1,
+        "invalid address", text);
+    sin.sin_port = parsePort(text.slice(colon + 1));
+    length = sizeof(sin);
+  }
+
+  int fd_;
+  KJ_SYSCALL_HANDLE_ERRORS(fd_ = socket(storage.ss_family, SOCK_STREAM, 0)) {
+    case EAFNOSUPPORT:
+      if (isWildcard) {
+        // No IPv6 on this machine. Fall back to listening on all IPv4 interfaces.
+        auto port = reinterpret_cast<struct sockaddr_in6&>(storage).sin6_port;
+        memset(&storage, 0, sizeof(storage));
+        auto& sin = reinterpret_cast<struct sockaddr_in&>(storage);
+        sin.sin_family = AF_INET;
+        sin.sin_addr.s_addr = htonl(INADDR_ANY);
+        sin.sin_port = port;
+        length = sizeof(sin);
+        isWildcard = false;
+        KJ_SYSCALL(fd_ = socket(AF_INET, SOCK_STREAM, 0));
+        break;
+      }
+      KJ_FAIL_SYSCALL("socket()", error, text);
+    default:
+      KJ_FAIL_SYSCALL("socket()", error, text);
+  }
+  kj::AutoCloseFd fd(fd_);
+
+  int one = 1;
+  int zero = 0;
+  KJ_SYSCALL(setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)));
+  KJ_SYSCALL(setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)));
+  if (isWildcard) {
+    // Like KJ, accept IPv4 connections on the IPv6 wildcard address.
+    KJ_SYSCALL(setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero)));
+  }
+  KJ_SYSCALL(bind(fd, reinterpret_cast<struct sockaddr*>(&storage), length), text);
+  KJ_SYSCALL(::listen(fd, SOMAXCONN), text);
+
+  return options.lowLevelProvider.wrapListenSocketFd(
+      fd.release(), kj::LowLevelAsyncIoProvider::TAKE_OWNERSHIP);
+}
+
 kj::Promise<void> Server::listenHttp(
     kj::Own<kj::ConnectionReceiver> listener, Service& service,
     kj::StringPtr physicalProtocol, kj::Own<HttpRewriter> rewriter) {
@@ -2160,6 +5192,76 @@ kj::Promise<void> Server::run(jsg::V8System& v8System, config::Config::Reader co
     }));
   }
 
+  KJ_IF_MAYBE(p, actorPlacement) {
+    actorRouter = kj::heap<ActorRouter>(*this, *p, headerTableBuilder);
+  }
+
+  // ---------------------------------------------------------------------------
+  // Configure code cache
+
+  KJ_IF_MAYBE(pathStr, codeCacheDirectory) {
+    auto path = fs.getCurrentPath().evalNative(*pathStr);
+    KJ_IF_MAYBE(dir, fs.getRoot().tryOpenSubdir(kj::mv(path),
+        kj::WriteMode::CREATE | kj::WriteMode::MODIFY | kj::WriteMode::CREATE_PARENT)) {
+      codeCache = newDirectoryCodeCache(kj::mv(*dir));
+    } else {
+      reportConfigError(kj::str("Could not open code cache directory: ", *pathStr));
+    }
+  }
+  if (config.hasCodeCache()) {
+    codeCache = newEmbeddedCodeCache(config.getCodeCache(), kj::mv(codeCache));
+  }
+
+  if (config.getDurableObjectCacheBudgetMegabytes() > 0) {
+    actorCacheBudget = kj::heap<ActorCacheMemoryBudget>(
+        size_t(config.getDurableObjectCacheBudgetMegabytes()) << 20);
+  }
+
+  for (auto service: config.getServices()) {
+    if (service.isMetrics()) {
+      metricsEnabled = true;
+      break;
+    }
+  }
+
+  if (config.hasTracing()) {
+    auto tracingConf = config.getTracing();
+    if (tracingConf.getMaxBatchSize() == 0) {
+      reportConfigError(kj::str("Config.tracing has a maxBatchSize of zero."));
+    } else {
+      SpanExporterOptions options {
+        .serviceName = tracingConf.getServiceName(),
+        .maxBatchSize = tracingConf.getMaxBatchSize(),
+        .flushInterval = tracingConf.getFlushIntervalMs() * kj::MILLISECONDS,
+        .maxPendingSpans = tracingConf.getMaxPendingSpans(),
+      };
+
+      // The collector is looked up once the services are linked, below. Spans can't be reported
+      // before then, since no request can have started.
+      spanExporter = kj::heap<SpanExporter>(timer, entropySource,
+          [this, &headerTable = globalContext->headerTable]
+          (kj::String batch) -> kj::Promise<void> {
+        auto& service = KJ_ASSERT_NONNULL(tracingService);
+        auto client = asHttpClient(service.startRequest({}));
+        kj::HttpHeaders headers(headerTable);
+        headers.set(kj::HttpHeaderId::CONTENT_TYPE, "application/json");
+        auto req = client->request(kj::HttpMethod::POST, "https://fake-host/v1/traces", headers,
+                                   batch.size());
+
+        return req.body->write(batch.begin(), batch.size())
+            .attach(kj::mv(batch), kj::mv(req.body))
+            .then([response = kj::mv(req.response)]() mutable { return kj::mv(response); })
+            .then([](kj::HttpClient::Response&& response) {
+          if (response.statusCode >= 400) {
+            KJ_LOG(WARNING, "trace collector rejected spans",
+                response.statusCode, response.statusText);
+          }
+          return response.body->readAllBytes().attach(kj::mv(response.body)).ignoreResult();
+        }).attach(kj::mv(client));
+      }, options);
+    }
+  }
+
   // ---------------------------------------------------------------------------
   // Configure services
 
@@ -2173,11 +5275,15 @@ kj::Promise<void> Server::run(jsg::V8System& v8System, config::Config::Reader co
       bool hadDurable = false;
       for (auto ns: workerConf.getDurableObjectNamespaces()) {
         switch (ns.which()) {
-          case config::Worker::DurableObjectNamespace::UNIQUE_KEY:
+          case config::Worker::DurableObjectNamespace::UNIQUE_KEY: {
             hadDurable = true;
-            serviceActorConfigs.insert(kj::str(ns.getClassName()),
-                Durable { kj::str(ns.getUniqueKey()) });
+            Durable durable { kj::str(ns.getUniqueKey()) };
+            if (ns.hasCache()) {
+              durable.cache = ns.getCache();
+            }
+            serviceActorConfigs.insert(kj::str(ns.getClassName()), kj::mv(durable));
             continue;
+          }
           case config::Worker::DurableObjectNamespace::EPHEMERAL_LOCAL:
             if (!experimental) {
               reportConfigError(kj::str(
@@ -2194,6 +5300,13 @@ kj::Promise<void> Server::run(jsg::V8System& v8System, config::Config::Reader co
             "of the schema?"));
       }
 
+      if (hadDurable && config.getThreads() != 1 && actorPlacement == nullptr) {
+        reportConfigError(kj::str(
+            "Worker service \"", name, "\" implements durable object classes, but Durable "
+            "Objects are not supported when `threads` is not 1 unless the server is set up to "
+            "route requests between threads."));
+      }
+
       switch (workerConf.getDurableObjectStorage().which()) {
         case config::Worker::DurableObjectStorage::NONE:
           if (hadDurable) {
@@ -2204,6 +5317,20 @@ kj::Promise<void> Server::run(jsg::V8System& v8System, config::Config::Reader co
           goto validDurableObjectStorage;
         case config::Worker::DurableObjectStorage::IN_MEMORY:
           goto validDurableObjectStorage;
+        case config::Worker::DurableObjectStorage::LOCAL_DISK:
+          // Each namespace is stored in a subdirectory named after its unique key.
+          for (auto& entry: serviceActorConfigs) {
+            KJ_IF_MAYBE(durable, entry.value.tryGet<Durable>()) {
+              if (kj::runCatchingExceptions([&]() { kj::Path({durable->uniqueKey}); })
+                  != nullptr) {
+                reportConfigError(kj::str(
+                    "Worker service \"", name, "\" stores Durable Objects on local disk, but "
+                    "the uniqueKey of class \"", entry.key, "\" cannot be used as a directory "
+                    "name."));
+              }
+            }
+          }
+          goto validDurableObjectStorage;
       }
       reportConfigError(kj::str(
           "Encountered unknown durableObjectStorage type in service \"", name,
@@ -2223,15 +5350,28 @@ kj::Promise<void> Server::run(jsg::V8System& v8System, config::Config::Reader co
   }
 
   // Second pass: Build services.
+  currentConfig = config;
+  workerStartup = config.getWorkerStartup();
   for (auto serviceConf: config.getServices()) {
     kj::StringPtr name = serviceConf.getName();
     auto service = makeService(serviceConf, headerTableBuilder);
 
-    services.upsert(kj::str(name), kj::mv(service), [&](auto&&...) {
+    services.upsert(kj::str(name), kj::heap<ServiceSlot>(kj::mv(service)), [&](auto&&...) {
       reportConfigError(kj::str("Config defines multiple services named \"", name, "\"."));
     });
   }
 
+  if (workerStartup.isEagerParallel()) {
+    kj::Vector<WorkerService*> pending;
+    for (auto& entry: services) {
+      auto worker = dynamic_cast<WorkerService*>(&entry.value->get());
+      if (worker != nullptr && !worker->isInstantiated()) {
+        pending.add(worker);
+      }
+    }
+    instantiateWorkersInParallel(pending);
+  }
+
   // Make the default "internet" service if it's not there already.
   services.findOrCreate("internet"_kj, [&]() {
     auto publicNetwork = network.restrictPeers({"public"_kj});
@@ -2248,7 +5388,7 @@ kj::Promise<void> Server::run(jsg::V8System& v8System, config::Config::Reader co
 
     return decltype(services)::Entry {
       kj::str("internet"_kj),
-      kj::mv(service)
+      kj::heap<ServiceSlot>(kj::mv(service))
     };
   });
 
@@ -2257,6 +5397,14 @@ kj::Promise<void> Server::run(jsg::V8System& v8System, config::Config::Reader co
     service.value->link();
   }
 
+  if (spanExporter != nullptr) {
+    tracingService = lookupService(config.getTracing().getService(), kj::str("Config.tracing"));
+  }
+
+  KJ_IF_MAYBE(r, actorRouter) {
+    (*r)->startServing();
+  }
+
   // ---------------------------------------------------------------------------
   // Start sockets
 
@@ -2314,19 +5462,24 @@ kj::Promise<void> Server::run(jsg::V8System& v8System, config::Config::Reader co
     continue;
 
   validSocket:
-    kj::Promise<kj::Own<kj::ConnectionReceiver>> listener = nullptr;
+    using PlainListener = kj::Maybe<kj::Own<kj::ConnectionReceiver>>;
+    kj::Promise<PlainListener> listener = nullptr;
     KJ_IF_MAYBE(l, listenerOverride) {
-      listener = kj::mv(*l);
+      listener = PlainListener(kj::mv(*l));
     } else {
       listener = network.parseAddress(addrStr, defaultPort)
-          .then([](kj::Own<kj::NetworkAddress> parsed) {
-        return parsed->listen();
+          .then([this](kj::Own<kj::NetworkAddress> parsed) {
+        return listenOnAddress(*parsed);
       });
     }
 
     KJ_IF_MAYBE(t, tls) {
-      listener = listener.then([tls = kj::mv(*t)](kj::Own<kj::ConnectionReceiver> port) mutable {
-        return tls->wrapPort(kj::mv(port)).attach(kj::mv(tls));
+      listener = listener.then([tls = kj::mv(*t)](PlainListener port) mutable -> PlainListener {
+        KJ_IF_MAYBE(p, port) {
+          return tls->wrapPort(kj::mv(*p)).attach(kj::mv(tls));
+        } else {
+          return nullptr;
+        }
       });
     }
 
@@ -2336,8 +5489,13 @@ kj::Promise<void> Server::run(jsg::V8System& v8System, config::Config::Reader co
 
     tasks.add(listener
         .then([this, &service, rewriter = kj::mv(rewriter), physicalProtocol]
-              (kj::Own<kj::ConnectionReceiver> listener) mutable {
-      return listenHttp(kj::mv(listener), service, physicalProtocol, kj::mv(rewriter));
+              (PlainListener listener) mutable -> kj::Promise<void> {
+      KJ_IF_MAYBE(l, listener) {
+        return listenHttp(kj::mv(*l), service, physicalProtocol, kj::mv(rewriter));
+      } else {
+        // This thread doesn't serve this socket (see enableReusePort()).
+        return kj::READY_NOW;
+      }
     }));
   }
 
@@ -2369,4 +5527,136 @@ kj::Promise<void> Server::run(jsg::V8System& v8System, config::Config::Reader co
   return tasks.onEmpty().exclusiveJoin(kj::mv(fatalPromise)).attach(kj::mv(ownHeaderTable));
 }
 
+// =======================================================================================
+
+namespace {
+
+kj::Array<capnp::word> canonicalizeSettings(config::Config::Reader config) {
+  // Returns the canonical encoding of everything in `config` other than the services, which
+  // reload() compares one by one, and the code cache, which only affects startup time.
+  capnp::MallocMessageBuilder message;
+  message.setRoot(config);
+  auto root = message.getRoot<config::Config>();
+  root.disownServices();
+  root.disownCodeCache();
+  return capnp::canonicalize(root.asReader());
+}
+
+}  // namespace
+
+Server::ReloadResult Server::reload(
+    config::Config::Reader newConfig, kj::Own<void> configOwner) {
+  KJ_REQUIRE(globalContext.get() != nullptr, "run() must be called before reload()");
+
+  ReloadResult result;
+  auto restart = [&](kj::String reason) {
+    result.restartReason = kj::mv(reason);
+    return kj::mv(result);
+  };
+
+  if (canonicalizeSettings(newConfig).asBytes() !=
+      canonicalizeSettings(currentConfig).asBytes()) {
+    return restart(kj::str("settings other than services changed"));
+  }
+
+  kj::HashMap<kj::StringPtr, config::Service::Reader> oldServices;
+  for (auto conf: currentConfig.getServices()) {
+    oldServices.upsert(conf.getName(), conf, [](auto&&...) {});
+  }
+  if (newConfig.getServices().size() != currentConfig.getServices().size()) {
+    return restart(kj::str("services were added or removed"));
+  }
+
+  kj::Vector<config::Service::Reader> changed;
+  for (auto conf: newConfig.getServices()) {
+    kj::StringPtr name = conf.getName();
+    auto oldConf = KJ_UNWRAP_OR(oldServices.find(name), {
+      return restart(kj::str("service \"", name, "\" was added"));
+    });
+    if (capnp::canonicalize(conf).asBytes() == capnp::canonicalize(oldConf).asBytes()) {
+      continue;
+    }
+
+    if (!conf.isWorker() || !oldConf.isWorker()) {
+      return restart(kj::str("service \"", name, "\" changed and is not a Worker"));
+    }
+    if (conf.getWorker().getDurableObjectNamespaces().size() > 0 ||
+        oldConf.getWorker().getDurableObjectNamespaces().size() > 0) {
+      // The objects' state lives in the Worker's isolate, so it can't be handed over.
+      return restart(kj::str("Worker \"", name, "\" changed and implements Durable Objects"));
+    }
+    changed.add(conf);
+  }
+
+  // Build the replacements, collecting config errors rather than reporting them, since on error
+  // we carry on serving the old config.
+  auto originalReporter = kj::mv(reportConfigError);
+  reportConfigError = [&result](kj::String error) {
+    result.errors.add(kj::mv(error));
+  };
+  KJ_DEFER(reportConfigError = kj::mv(originalReporter));
+
+  struct Replacement {
+    ServiceSlot& slot;
+    kj::Own<Service> service;
+  };
+  kj::Vector<Replacement> replacements;
+  KJ_DEFER(pendingReplacements.clear());
+  for (auto conf: changed) {
+    auto service = makeWorker(conf.getName(), conf.getWorker());
+    pendingReplacements.insert(conf.getName(), service.get());
+    replacements.add(Replacement { *KJ_ASSERT_NONNULL(services.find(conf.getName())),
+                                   kj::mv(service) });
+  }
+
+  if (workerStartup.isEagerParallel()) {
+    auto pending = KJ_MAP(replacement, replacements) {
+      return &kj::downcast<WorkerService>(*replacement.service);
+    };
+    instantiateWorkersInParallel(pending);
+  }
+
+  for (auto& replacement: replacements) {
+    replacement.service->link();
+
+    // Anything that points to one of the old Worker's named entrypoints will point to the new
+    // Worker's, so it had better have them.
+    auto& worker = kj::downcast<WorkerService>(*replacement.service);
+    replacement.slot.forEachEntrypoint([&](kj::StringPtr entrypoint) {
+      if (worker.getEntrypoint(entrypoint) == nullptr) {
+        reportConfigError(kj::str(
+            "Worker \"", worker.getDefinition().name, "\" no longer has a named entrypoint \"",
+            entrypoint, "\", but something still refers to it."));
+      }
+    });
+  }
+
+  if (result.errors.size() > 0) {
+    // Building the replacements may have registered their isolates with the inspector.
+    for (auto& replacement: replacements) {
+      kj::downcast<WorkerService>(replacement.slot.get()).registerWithInspector();
+    }
+    return kj::mv(result);
+  }
+
+  // The replacements are built from the new config, so each holds a reference to it, as does the
+  // server while it's current. The config is released once it's no longer current and every
+  // service built from it has been replaced and drained.
+  auto owner = kj::refcounted<ConfigOwner>(kj::mv(configOwner));
+  for (auto& replacement: replacements) {
+    // In-flight requests add their `waitUntil()` tasks to the old Worker as they finish, so it
+    // can't be considered drained until they're all done.
+    auto service = kj::mv(replacement.service).attach(kj::addRef(*owner));
+    tasks.add(replacement.slot.replace(kj::mv(service))
+        .then([](kj::Own<Service> old) {
+      auto& worker = kj::downcast<WorkerService>(*old);
+      return worker.onDrained().attach(kj::mv(old));
+    }));
+  }
+
+  currentConfig = newConfig;
+  currentConfigOwner = kj::mv(owner);
+  return kj::mv(result);
+}
+
 }  // namespace workerd::server
@@ -6,6 +6,7 @@
 
 #include <kj/filesystem.h>
 #include <kj/map.h>
+#include <kj/vector.h>
 #include <kj/one-of.h>
 #include <kj/async-io.h>
 #include <workerd/server/workerd.capnp.h>
@@ -15,6 +16,10 @@ namespace kj {
   class TlsContext;
 }
 
+namespace workerd {
+  class ActorCacheMemoryBudget;
+}
+
 namespace workerd::jsg {
   class V8System;
 }
@@ -23,6 +28,13 @@ namespace workerd::server {
 
 using kj::uint;
 
+class ActorPlacement;
+class AnalyticsBatcher;
+class MetricsRegistry;
+class SpanExporter;
+
+class CpuWatchdog;
+
 class Server: private kj::TaskSet::ErrorHandler {
   // Implements the single-tenant Workers Runtime server / CLI.
   //
@@ -54,9 +66,56 @@ public:
     inspectorOverride = kj::mv(addr);
   }
 
+  void setCodeCacheDirectory(kj::String path) {
+    codeCacheDirectory = kj::mv(path);
+  }
+  // Persist V8 code caches for Worker scripts in the given directory, which will be created if
+  // needed. Caches embedded in the config by `workerd compile` take precedence.
+
+  void shareMetrics(kj::Own<const MetricsRegistry> registry);
+  // Report metrics to `registry` instead of to a registry of this Server's own. Use when this
+  // Server is one of several running on separate threads, so that a `metrics` service on any of
+  // them reports the whole process. Must be called before `run()`.
+
+  void shareActorPlacement(kj::Own<const ActorPlacement> placement,
+                           kj::LowLevelAsyncIoProvider& lowLevelProvider, uint threadIndex);
+  // Use when this Server is one of several running the same config on separate threads, as
+  // thread `threadIndex`. Each Durable Object is homed on the thread `placement` assigns it, and
+  // requests for objects homed on other threads are forwarded to them over Unix socket pairs
+  // wrapped with `lowLevelProvider`. `placement` must be shared by the Servers of all threads.
+  // Must be called before `run()`.
+
+  void enableReusePort(kj::LowLevelAsyncIoProvider& lowLevelProvider, uint threadIndex) {
+    reusePort = ReusePortOptions { lowLevelProvider, threadIndex };
+  }
+  // Use when this Server is one of several running the same config on separate threads (see
+  // `Config.threads`). Sockets will be bound with `SO_REUSEPORT` so that each thread gets its own
+  // listen queue and the kernel balances connections between them. Sockets which cannot be
+  // shared this way (i.e. Unix domain sockets) will only be bound by thread zero.
+
   kj::Promise<void> run(jsg::V8System& v8System, config::Config::Reader conf);
   // Runs the server using the given config.
 
+  struct ReloadResult {
+    kj::Maybe<kj::String> restartReason;
+    // Set if the new config can't be applied to the running server, so the server must be
+    // restarted to apply it. Nothing was changed.
+
+    kj::Vector<kj::String> errors;
+    // Config errors in the new config. If there are any, nothing was changed.
+  };
+
+  ReloadResult reload(config::Config::Reader newConfig, kj::Own<void> configOwner);
+  // Applies a new config to the running server, without interrupting it. Only changes to
+  // Worker services which don't implement Durable Objects are supported; anything else calls for
+  // a restart. Each changed Worker is rebuilt and swapped in: requests that have already started
+  // finish on the old Worker, and its `waitUntil()` tasks are allowed to complete before it is
+  // destroyed. Sockets, and the services they (and other services) point to, stay as they are.
+  //
+  // `run()` must have been called. `configOwner` is whatever keeps `newConfig` valid. The server
+  // holds on to it for as long as the config is the current one or any service built from it is
+  // still running, and drops it otherwise, including when the reload fails.
+
 private:
   kj::Filesystem& fs;
   kj::Timer& timer;
@@ -75,15 +134,65 @@ private:
   // code that parses strings from the config file.
 
   kj::Maybe<kj::String> inspectorOverride;
+  kj::Maybe<kj::String> codeCacheDirectory;
+
+  struct ReusePortOptions {
+    kj::LowLevelAsyncIoProvider& lowLevelProvider;
+    uint threadIndex;
+  };
+  kj::Maybe<ReusePortOptions> reusePort;
 
   struct GlobalContext;
   kj::Own<GlobalContext> globalContext;
   // General context needed to construct workers. Initilaized early in run().
 
+  kj::Maybe<kj::Own<jsg::CodeCache>> codeCache;
+  // Used when compiling Worker scripts. Initialized early in run(), if there's a code cache
+  // embedded in the config or `codeCacheDirectory` was set.
+
+  kj::Maybe<kj::Own<CpuWatchdog>> cpuWatchdog;
+  // Enforces CPU time limits for all Workers that have them. Created by the first such Worker.
+
+  config::Config::Reader currentConfig;
+  // The config last passed to run() or reload().
+
+  class ConfigOwner: public kj::Refcounted {
+    // Keeps a config applied by reload() valid. Shared by the config's services and, while it's
+    // current, by the server.
+  public:
+    explicit ConfigOwner(kj::Own<void> owner): owner(kj::mv(owner)) {}
+  private:
+    kj::Own<void> owner;
+  };
+  kj::Own<ConfigOwner> currentConfigOwner;
+  // Null while `currentConfig` is the one passed to run(), which the caller keeps valid.
+
+  config::Config::WorkerStartup::Reader workerStartup;
+  // When to instantiate Workers. Set early in run().
+
+  kj::Maybe<kj::Own<ActorCacheMemoryBudget>> actorCacheBudget;
+  // Shared by the Durable Object caches of all Workers, if the config sets
+  // `durableObjectCacheBudgetMegabytes`. Initialized early in run().
+
   class Service;
+  class WorkerService;
   kj::Own<Service> invalidConfigServiceSingleton;
 
-  struct Durable { kj::String uniqueKey; };
+  kj::Own<const MetricsRegistry> metricsRegistry;
+  bool metricsEnabled = false;
+  // Workers record metrics only if the config has a `metrics` service to report them. Set early
+  // in run().
+
+  kj::Maybe<kj::Own<SpanExporter>> spanExporter;
+  kj::Maybe<Service&> tracingService;
+  // Exports the spans of traced requests, if the config sets `tracing`. Initialized early in run(),
+  // so that Workers can be given it, but `tracingService` is only looked up once services are
+  // linked. Declared before the services, so that it outlives them and their spans.
+
+  struct Durable {
+    kj::String uniqueKey;
+    kj::Maybe<config::Worker::DurableObjectCache::Reader> cache;
+  };
   struct Ephemeral {};
   using ActorConfig = kj::OneOf<Durable, Ephemeral>;
 
@@ -92,13 +201,33 @@ private:
   // This needs to be populated in advance of constructing any services, in order to be able to
   // correctly construct dependent services.
 
-  kj::HashMap<kj::String, kj::Own<Service>> services;
+  class ServiceSlot;
+  kj::HashMap<kj::String, kj::Own<ServiceSlot>> services;
+  // Everything refers to services through their slots, so that reload() can replace them.
+
+  kj::HashMap<kj::StringPtr, Service*> pendingReplacements;
+  // Services being built by reload(), which lookupService() validates entrypoints against in
+  // place of the ones they are replacing.
 
   kj::Own<kj::PromiseFulfiller<void>> fatalFulfiller;
 
   kj::TaskSet tasks;
   // Especially includes server loop tasks to listen on socokets. Any error is considered fatal.
 
+  struct ActorPlacementOptions {
+    kj::Own<const ActorPlacement> placement;
+    kj::LowLevelAsyncIoProvider& lowLevelProvider;
+    uint threadIndex;
+  };
+  kj::Maybe<ActorPlacementOptions> actorPlacement;
+
+  class ActorRouter;
+  kj::Maybe<kj::Own<ActorRouter>> actorRouter;
+  // Forwards requests for Durable Objects homed on other threads, and serves the requests other
+  // threads forward to this one. Created early in run() if `actorPlacement` is set. Declared
+  // after the services, so that requests from other threads are canceled before the services
+  // they use are destroyed.
+
   void taskFailed(kj::Exception&& exception) override;
   // Reports an exception thrown by a task in `tasks`.
 
@@ -118,6 +247,21 @@ private:
       kj::StringPtr name, config::DiskDirectory::Reader conf,
       kj::HttpHeaderTable::Builder& headerTableBuilder);
   kj::Own<Service> makeWorker(kj::StringPtr name, config::Worker::Reader conf);
+  void instantiateWorkersInParallel(kj::ArrayPtr<WorkerService* const> pending);
+  // Instantiates the given Workers, using as many threads as `workerStartup.eagerParallel` says.
+  kj::Own<Service> makeHttpCacheService(
+      config::HttpCache::Reader conf, kj::HttpHeaderTable::Builder& headerTableBuilder);
+  kj::Maybe<kj::Own<const kj::Directory>> openLocalStoreDirectory(
+      kj::StringPtr kind, kj::StringPtr name, kj::Maybe<kj::StringPtr> configuredPath);
+  // Opens the directory backing a KV store or R2 store service, reporting a config error and
+  // returning null if it can't be used.
+  kj::Own<Service> makeKvStoreService(
+      kj::StringPtr name, config::KvStore::Reader conf,
+      kj::HttpHeaderTable::Builder& headerTableBuilder);
+  kj::Own<Service> makeR2StoreService(
+      kj::StringPtr name, config::R2Store::Reader conf,
+      kj::HttpHeaderTable::Builder& headerTableBuilder);
+  kj::Own<Service> makeMetricsService();
   kj::Own<Service> makeService(
       config::Service::Reader conf,
       kj::HttpHeaderTable::Builder& headerTableBuilder);
@@ -125,6 +269,17 @@ private:
   Service& lookupService(config::ServiceDesignator::Reader designator, kj::String errorContext);
   // Can only be called in the link stage.
 
+  kj::Maybe<kj::Own<AnalyticsBatcher>> makeAnalyticsBatcher(
+      kj::StringPtr bindingName, config::Worker::Binding::AnalyticsEngine::Reader conf,
+      kj::String errorContext);
+  // Creates the batcher delivering an Analytics Engine binding's data points, reporting a config
+  // error and returning null if the destination can't be used. Can only be called in the link
+  // stage.
+
+  kj::Maybe<kj::Own<kj::ConnectionReceiver>> listenOnAddress(kj::NetworkAddress& addr);
+  // Start listening on the given address, honoring `reusePort`. Returns null if this thread
+  // should not listen on the address at all.
+
   kj::Promise<void> listenHttp(kj::Own<kj::ConnectionReceiver> listener, Service& service,
                                kj::StringPtr physicalProtocol, kj::Own<HttpRewriter> rewriter);
 
@@ -132,7 +287,10 @@ private:
   class ExternalHttpService;
   class NetworkService;
   class DiskDirectoryService;
-  class WorkerService;
+  class HttpCacheService;
+  class MetricsService;
+  class ProfilerService;
+  class LocalStoreService;
   class WorkerEntrypointService;
   class HttpListener;
 
@@ -0,0 +1,107 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "span-exporter.h"
+#include <kj/test.h>
+#include <string.h>
+
+namespace workerd::server {
+namespace {
+
+class CountingEntropySource final: public kj::EntropySource {
+  // Fills each ID with one repeated byte, counting up from 1, so that IDs are predictable.
+public:
+  void generate(kj::ArrayPtr<kj::byte> buffer) override {
+    ++counter;
+    for (auto& b: buffer) b = counter;
+  }
+
+private:
+  kj::byte counter = 0;
+};
+
+bool contains(kj::StringPtr haystack, kj::StringPtr needle) {
+  return strstr(haystack.cStr(), needle.cStr()) != nullptr;
+}
+
+struct SpanExporterTest {
+  kj::EventLoop loop;
+  kj::WaitScope ws;
+  kj::TimerImpl timer;
+  CountingEntropySource entropy;
+  kj::Vector<kj::String> batches;
+  SpanExporter exporter;
+
+  explicit SpanExporterTest(SpanExporterOptions options)
+      : ws(loop), timer(kj::origin<kj::TimePoint>()),
+        exporter(timer, entropy, [this](kj::String batch) -> kj::Promise<void> {
+          batches.add(kj::mv(batch));
+          return kj::READY_NOW;
+        }, options) {}
+
+  void advance(kj::Duration duration) {
+    timer.advanceTo(timer.now() + duration);
+    loop.run();
+  }
+};
+
+KJ_TEST("SpanExporter: spans are encoded as OTLP JSON with their parents") {
+  SpanExporterTest test({ .serviceName = "test", .maxBatchSize = 2 });
+
+  {
+    SpanBuilder root(test.exporter.newTrace(), "worker", kj::UNIX_EPOCH + 1 * kj::SECONDS);
+    root.setTag("worker", kj::str("hello"));
+
+    auto child = root.newChild("fetch", kj::UNIX_EPOCH + 2 * kj::SECONDS);
+    child.setTag("status", int64_t(200));
+    child.addLog(kj::UNIX_EPOCH + 3 * kj::SECONDS, "retry", true);
+    child.end();
+    test.loop.run();
+    KJ_EXPECT(test.batches.size() == 0);
+  }
+  test.loop.run();
+
+  KJ_ASSERT(test.batches.size() == 1);
+  auto child = kj::str(
+      "{\"traceId\":\"01010101010101010101010101010101\",\"spanId\":\"0303030303030303\","
+      "\"parentSpanId\":\"0202020202020202\",\"name\":\"fetch\","
+      "\"startTimeUnixNano\":\"2000000000\",\"endTimeUnixNano\":\"");
+  KJ_EXPECT(test.batches[0].startsWith(kj::str(
+      "{\"resourceSpans\":[{\"resource\":{\"attributes\":[{\"key\":\"service.name\","
+      "\"value\":{\"stringValue\":\"test\"}}]},\"scopeSpans\":[{\"scope\":{\"name\":\"workerd\"},"
+      "\"spans\":[", child)), test.batches[0]);
+  KJ_EXPECT(contains(test.batches[0],
+      "\"attributes\":[{\"key\":\"status\",\"value\":{\"intValue\":\"200\"}}],"
+      "\"events\":[{\"timeUnixNano\":\"3000000000\",\"name\":\"retry\",\"attributes\":"
+      "[{\"key\":\"retry\",\"value\":{\"boolValue\":true}}]}]}"), test.batches[0]);
+  KJ_EXPECT(contains(test.batches[0],
+      "{\"traceId\":\"01010101010101010101010101010101\",\"spanId\":\"0202020202020202\","
+      "\"name\":\"worker\",\"startTimeUnixNano\":\"1000000000\""), test.batches[0]);
+  KJ_EXPECT(contains(test.batches[0],
+      "\"attributes\":[{\"key\":\"worker\",\"value\":{\"stringValue\":\"hello\"}}]"),
+      test.batches[0]);
+}
+
+KJ_TEST("SpanExporter: spans are batched, and dropped when too many are pending") {
+  SpanExporterTest test({ .maxBatchSize = 10, .flushInterval = 1 * kj::SECONDS,
+                          .maxPendingSpans = 2 });
+
+  SpanBuilder(test.exporter.newTrace(), "a", kj::UNIX_EPOCH);
+  SpanBuilder(test.exporter.newTrace(), "b", kj::UNIX_EPOCH);
+  {
+    KJ_EXPECT_LOG(WARNING, "dropping spans");
+    SpanBuilder(test.exporter.newTrace(), "c", kj::UNIX_EPOCH);
+  }
+
+  test.advance(999 * kj::MILLISECONDS);
+  KJ_EXPECT(test.batches.size() == 0);
+  test.advance(1 * kj::MILLISECONDS);
+  KJ_ASSERT(test.batches.size() == 1);
+  KJ_EXPECT(contains(test.batches[0], "\"name\":\"a\""));
+  KJ_EXPECT(contains(test.batches[0], "\"name\":\"b\""));
+  KJ_EXPECT(!contains(test.batches[0], "\"name\":\"c\""));
+}
+
+}  // namespace
+}  // namespace workerd::server
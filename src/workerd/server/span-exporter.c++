@@ -0,0 +1,191 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "span-exporter.h"
+#include <capnp/compat/json.h>
+#include <kj/debug.h>
+#include <kj/encoding.h>
+#include <cmath>
+
+namespace workerd::server {
+
+namespace {
+
+using TraceId = kj::FixedArray<kj::byte, 16>;
+using SpanId = kj::FixedArray<kj::byte, 8>;
+
+kj::String jsonString(kj::StringPtr text) {
+  static const capnp::JsonCodec json;
+  return json.encode(capnp::DynamicValue::Reader(capnp::Text::Reader(text)),
+                     capnp::Type(capnp::schema::Type::TEXT));
+}
+
+int64_t unixNanos(kj::Date date) {
+  return (date - kj::UNIX_EPOCH) / kj::NANOSECONDS;
+}
+
+kj::String encodeAttribute(kj::StringPtr key, const Span::TagValue& value) {
+  // OTLP's JSON encoding writes 64-bit integers as strings.
+  kj::String encoded;
+  KJ_SWITCH_ONEOF(value) {
+    KJ_CASE_ONEOF(b, bool) {
+      encoded = kj::str("{\"boolValue\":", b ? "true" : "false", '}');
+    }
+    KJ_CASE_ONEOF(i, int64_t) {
+      encoded = kj::str("{\"intValue\":\"", i, "\"}");
+    }
+    KJ_CASE_ONEOF(d, double) {
+      if (std::isfinite(d)) {
+        encoded = kj::str("{\"doubleValue\":", d, '}');
+      } else {
+        // JSON has no way to write infinities or NaN.
+        encoded = kj::str("{\"stringValue\":", jsonString(kj::str(d)), '}');
+      }
+    }
+    KJ_CASE_ONEOF(s, kj::String) {
+      encoded = kj::str("{\"stringValue\":", jsonString(s), '}');
+    }
+  }
+  return kj::str("{\"key\":", jsonString(key), ",\"value\":", encoded, '}');
+}
+
+kj::String encodeSpan(const Span& span, kj::ArrayPtr<const kj::byte> traceId,
+                      kj::ArrayPtr<const kj::byte> spanId,
+                      kj::Maybe<kj::ArrayPtr<const kj::byte>> parentSpanId) {
+  // Encodes `span` as an OTLP `Span` message. Span logs become span events.
+  kj::Vector<kj::String> fields;
+  fields.add(kj::str("\"traceId\":\"", kj::encodeHex(traceId), '"'));
+  fields.add(kj::str("\"spanId\":\"", kj::encodeHex(spanId), '"'));
+  KJ_IF_MAYBE(p, parentSpanId) {
+    fields.add(kj::str("\"parentSpanId\":\"", kj::encodeHex(*p), '"'));
+  }
+  fields.add(kj::str("\"name\":", jsonString(span.operationName)));
+  fields.add(kj::str("\"startTimeUnixNano\":\"", unixNanos(span.startTime), '"'));
+  fields.add(kj::str("\"endTimeUnixNano\":\"", unixNanos(span.endTime), '"'));
+
+  if (span.tags.size() > 0) {
+    auto attributes = KJ_MAP(tag, span.tags) { return encodeAttribute(tag.key, tag.value); };
+    fields.add(kj::str("\"attributes\":[", kj::strArray(attributes, ","), ']'));
+  }
+
+  if (span.logs.size() > 0) {
+    auto events = KJ_MAP(entry, span.logs) {
+      return kj::str("{\"timeUnixNano\":\"", unixNanos(entry.timestamp), "\",\"name\":",
+          jsonString(entry.tag.key), ",\"attributes\":[",
+          encodeAttribute(entry.tag.key, entry.tag.value), "]}");
+    };
+    fields.add(kj::str("\"events\":[", kj::strArray(events, ","), ']'));
+  }
+  if (span.droppedLogs > 0) {
+    fields.add(kj::str("\"droppedEventsCount\":", span.droppedLogs));
+  }
+
+  return kj::str('{', kj::strArray(fields, ","), '}');
+}
+
+}  // namespace
+
+class SpanExporter::Observer final: public SpanObserver {
+public:
+  Observer(SpanExporter& exporter, TraceId traceId, kj::Maybe<SpanId> parentSpanId)
+      : exporter(exporter), traceId(traceId), parentSpanId(parentSpanId) {
+    exporter.entropySource.generate(kj::arrayPtr(spanId.begin(), spanId.size()));
+  }
+
+  kj::Own<SpanObserver> newChild() override {
+    return kj::refcounted<Observer>(exporter, traceId, spanId);
+  }
+
+  void report(const Span& span) override {
+    exporter.add(encodeSpan(span, kj::arrayPtr(traceId.begin(), traceId.size()),
+        kj::arrayPtr(spanId.begin(), spanId.size()),
+        parentSpanId.map([](SpanId& id) -> kj::ArrayPtr<const kj::byte> {
+      return kj::arrayPtr(id.begin(), id.size());
+    })));
+  }
+
+private:
+  SpanExporter& exporter;
+  TraceId traceId;
+  SpanId spanId;
+  kj::Maybe<SpanId> parentSpanId;
+};
+
+SpanExporter::SpanExporter(kj::Timer& timer, kj::EntropySource& entropySource, Sender send,
+                           SpanExporterOptions options)
+    : timer(timer), entropySource(entropySource), send(kj::mv(send)), options(options),
+      tasks(*this) {
+  KJ_REQUIRE(options.maxBatchSize > 0);
+}
+
+kj::Own<SpanObserver> SpanExporter::newTrace() {
+  TraceId traceId;
+  entropySource.generate(kj::arrayPtr(traceId.begin(), traceId.size()));
+  return kj::refcounted<Observer>(*this, traceId, nullptr);
+}
+
+void SpanExporter::add(kj::String span) {
+  if (spans.size() + sendingSpans >= options.maxPendingSpans) {
+    if (!dropping) {
+      KJ_LOG(WARNING, "trace collector is falling behind; dropping spans",
+          options.maxPendingSpans);
+      dropping = true;
+    }
+    return;
+  }
+  dropping = false;
+
+  if (spans.size() == 0) {
+    oldestSpanTime = timer.now();
+  }
+  spans.add(kj::mv(span));
+  maybeSend();
+}
+
+void SpanExporter::maybeSend() {
+  if (sendingSpans > 0 || spans.size() == 0) return;
+
+  auto deadline = oldestSpanTime + options.flushInterval;
+  if (spans.size() >= options.maxBatchSize || timer.now() >= deadline) {
+    sendBatch();
+  } else if (!timerArmed) {
+    timerArmed = true;
+    tasks.add(timer.atTime(deadline).then([this]() {
+      // The batch this timer was set for may have been sent already, in which case this re-arms
+      // the timer for the current batch.
+      timerArmed = false;
+      maybeSend();
+    }));
+  }
+}
+
+void SpanExporter::sendBatch() {
+  sendingSpans = kj::min(spans.size(), size_t(options.maxBatchSize));
+
+  auto body = kj::str(
+      "{\"resourceSpans\":[{\"resource\":{\"attributes\":[{\"key\":\"service.name\","
+      "\"value\":{\"stringValue\":", jsonString(options.serviceName), "}}]},"
+      "\"scopeSpans\":[{\"scope\":{\"name\":\"workerd\"},\"spans\":[",
+      kj::strArray(spans.asPtr().slice(0, sendingSpans), ","), "]}]}]}");
+  kj::Vector<kj::String> rest(spans.size() - sendingSpans);
+  for (auto& span: spans.asPtr().slice(sendingSpans, spans.size())) {
+    rest.add(kj::mv(span));
+  }
+  spans = kj::mv(rest);
+  oldestSpanTime = timer.now();
+
+  tasks.add(kj::evalNow([&]() { return send(kj::mv(body)); })
+      .catch_([count = sendingSpans](kj::Exception&& e) {
+    KJ_LOG(ERROR, "failed to send trace spans", count, e);
+  }).then([this]() {
+    sendingSpans = 0;
+    maybeSend();
+  }));
+}
+
+void SpanExporter::taskFailed(kj::Exception&& exception) {
+  KJ_LOG(ERROR, exception);
+}
+
+}  // namespace workerd::server
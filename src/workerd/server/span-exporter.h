@@ -0,0 +1,80 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#pragma once
+
+#include <workerd/io/trace.h>
+#include <kj/async.h>
+#include <kj/function.h>
+#include <kj/time.h>
+#include <kj/timer.h>
+#include <kj/vector.h>
+
+namespace workerd::server {
+
+struct SpanExporterOptions {
+  kj::StringPtr serviceName = "workerd"_kj;
+  // Reported as the `service.name` resource attribute of every span.
+
+  uint maxBatchSize = 100;
+  // A batch is sent as soon as it holds this many spans.
+
+  kj::Duration flushInterval = 1 * kj::SECONDS;
+  // A batch that isn't full is sent at most this long after its first span finished.
+
+  uint maxPendingSpans = 10000;
+  // Spans finished while this many are waiting to be sent, or being sent, are dropped, so that a
+  // slow or unreachable collector can't make the exporter grow without bound.
+};
+
+class SpanExporter final: private kj::TaskSet::ErrorHandler {
+  // Records the trace spans reported by the Workers on one thread, and passes them to `send` in
+  // batches, each encoded as an OpenTelemetry `ExportTraceServiceRequest` in the OTLP/HTTP JSON
+  // format.
+  //
+  // Spans belong to the trace started by `newTrace()`, or, through `SpanObserver::newChild()`,
+  // to the same trace as their parent. Trace and span IDs are random. As with AnalyticsBatcher,
+  // one batch is sent at a time; a batch whose `send` fails is logged and dropped, and spans not
+  // yet sent when the exporter is destroyed are lost.
+
+public:
+  using Sender = kj::Function<kj::Promise<void>(kj::String body)>;
+
+  SpanExporter(kj::Timer& timer, kj::EntropySource& entropySource, Sender send,
+               SpanExporterOptions options = {});
+
+  kj::Own<SpanObserver> newTrace();
+  // Returns the observer for the root span of a new trace. The observer, and any children, must
+  // not outlive the exporter.
+
+private:
+  class Observer;
+
+  kj::Timer& timer;
+  kj::EntropySource& entropySource;
+  Sender send;
+  SpanExporterOptions options;
+
+  kj::Vector<kj::String> spans;
+  // Encoded spans not yet sent, oldest first.
+
+  kj::TimePoint oldestSpanTime = kj::origin<kj::TimePoint>();
+  // When the oldest span in `spans` was added, or, for spans left over after sending a full
+  // batch, when that batch was sent.
+
+  uint sendingSpans = 0;
+  // Size of the batch being sent, or zero if none is.
+
+  bool timerArmed = false;
+  bool dropping = false;
+
+  kj::TaskSet tasks;
+
+  void add(kj::String span);
+  void maybeSend();
+  void sendBatch();
+  void taskFailed(kj::Exception&& exception) override;
+};
+
+}  // namespace workerd::server
@@ -0,0 +1,209 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "subrequest-coalescer.h"
+#include <kj/test.h>
+
+namespace workerd::server {
+namespace {
+
+struct TestResponse final: public kj::HttpService::Response {
+  // Collects the response to one request.
+
+  uint statusCode = 0;
+  kj::Vector<char> body;
+
+  kj::Own<kj::AsyncOutputStream> send(
+      uint statusCode, kj::StringPtr statusText, const kj::HttpHeaders& headers,
+      kj::Maybe<uint64_t> expectedBodySize) override {
+    this->statusCode = statusCode;
+    return kj::heap<Collector>(body);
+  }
+
+  kj::Own<kj::WebSocket> acceptWebSocket(const kj::HttpHeaders& headers) override {
+    KJ_UNIMPLEMENTED("no WebSockets");
+  }
+
+  kj::String getBody() {
+    return kj::heapString(body.asPtr());
+  }
+
+  struct Collector final: public kj::AsyncOutputStream {
+    explicit Collector(kj::Vector<char>& body): body(body) {}
+    kj::Vector<char>& body;
+
+    kj::Promise<void> write(const void* buffer, size_t size) override {
+      body.addAll(kj::arrayPtr(reinterpret_cast<const char*>(buffer), size));
+      return kj::READY_NOW;
+    }
+    kj::Promise<void> write(kj::ArrayPtr<const kj::ArrayPtr<const kj::byte>> pieces) override {
+      for (auto piece: pieces) {
+        body.addAll(piece.asChars());
+      }
+      return kj::READY_NOW;
+    }
+    kj::Promise<void> whenWriteDisconnected() override {
+      return kj::NEVER_DONE;
+    }
+  };
+};
+
+struct CoalescerTest {
+  kj::EventLoop loop;
+  kj::WaitScope ws;
+  kj::HttpHeaderTable::Builder tableBuilder;
+  kj::HttpHeaderId accept = tableBuilder.add("Accept");
+  kj::Own<kj::HttpHeaderTable> table = tableBuilder.build();
+  SubrequestCoalescer coalescer;
+
+  uint requests = 0;
+  // Requests that reached the origin.
+  kj::ForkedPromise<void> gate = nullptr;
+  kj::Own<kj::PromiseFulfiller<void>> openGate;
+  // The origin answers once the gate is open.
+
+  CoalescerTest(): ws(loop), coalescer(nullptr) {
+    auto paf = kj::newPromiseAndFulfiller<void>();
+    gate = paf.promise.fork();
+    openGate = kj::mv(paf.fulfiller);
+  }
+
+  class Origin final: public WorkerInterface {
+    // Answers every request with a body naming its URL.
+
+  public:
+    explicit Origin(CoalescerTest& test): test(test) {}
+
+    kj::Promise<void> request(
+        kj::HttpMethod method, kj::StringPtr url, const kj::HttpHeaders& headers,
+        kj::AsyncInputStream& requestBody, kj::HttpService::Response& response) override {
+      ++test.requests;
+      auto body = kj::str("body of ", url);
+      co_await test.gate.addBranch();
+      kj::HttpHeaders responseHeaders(*test.table);
+      auto out = response.send(200, "OK", responseHeaders, body.size());
+      co_await out->write(body.begin(), body.size());
+    }
+    kj::Promise<void> connect(kj::StringPtr host, const kj::HttpHeaders& headers,
+        kj::AsyncIoStream& connection, kj::HttpService::ConnectResponse& response) override {
+      KJ_UNIMPLEMENTED("not used");
+    }
+    void prewarm(kj::StringPtr url) override {}
+    kj::Promise<ScheduledResult> runScheduled(kj::Date scheduledTime,
+                                              kj::StringPtr cron) override {
+      KJ_UNIMPLEMENTED("not used");
+    }
+    kj::Promise<AlarmResult> runAlarm(kj::Date scheduledTime) override {
+      KJ_UNIMPLEMENTED("not used");
+    }
+    kj::Promise<CustomEvent::Result> customEvent(kj::Own<CustomEvent> event) override {
+      KJ_UNIMPLEMENTED("not used");
+    }
+
+  private:
+    CoalescerTest& test;
+  };
+
+  kj::Own<WorkerInterface> newClient(kj::StringPtr keyPrefix = "0\n") {
+    return coalescer.wrap(kj::heap<Origin>(*this), kj::str(keyPrefix));
+  }
+};
+
+KJ_TEST("SubrequestCoalescer sends identical concurrent GETs once") {
+  CoalescerTest test;
+  kj::HttpHeaders headers(*test.table);
+  headers.set(test.accept, "text/html");
+  auto body = kj::newNullInputStream();
+
+  TestResponse responses[3];
+  auto client1 = test.newClient();
+  auto client2 = test.newClient();
+  auto client3 = test.newClient();
+  auto promise1 = client1->request(kj::HttpMethod::GET, "https://example.com/a", headers, *body,
+                                   responses[0]);
+  auto promise2 = client2->request(kj::HttpMethod::GET, "https://example.com/a", headers, *body,
+                                   responses[1]);
+  auto promise3 = client3->request(kj::HttpMethod::GET, "https://example.com/a", headers, *body,
+                                   responses[2]);
+  KJ_EXPECT(test.requests == 1);
+  KJ_EXPECT(test.coalescer.size() == 1);
+
+  // The first caller giving up doesn't affect the others.
+  promise1 = nullptr;
+
+  test.openGate->fulfill();
+  promise2.wait(test.ws);
+  promise3.wait(test.ws);
+  KJ_EXPECT(test.requests == 1);
+  KJ_EXPECT(test.coalescer.size() == 0);
+  for (auto i: {1, 2}) {
+    KJ_EXPECT(responses[i].statusCode == 200);
+    KJ_EXPECT(responses[i].getBody() == "body of https://example.com/a", responses[i].getBody());
+  }
+
+  // Once the response is in, the same request is sent again.
+  TestResponse later;
+  auto client4 = test.newClient();
+  client4->request(kj::HttpMethod::GET, "https://example.com/a", headers, *body, later)
+      .wait(test.ws);
+  KJ_EXPECT(test.requests == 2);
+}
+
+KJ_TEST("SubrequestCoalescer only merges identical GETs") {
+  CoalescerTest test;
+  kj::HttpHeaders html(*test.table);
+  html.set(test.accept, "text/html");
+  kj::HttpHeaders json(*test.table);
+  json.set(test.accept, "application/json");
+  auto body = kj::newNullInputStream();
+
+  kj::Vector<kj::Own<WorkerInterface>> clients;
+  kj::Vector<kj::Promise<void>> promises;
+  TestResponse responses[5];
+  auto send = [&](kj::HttpMethod method, kj::StringPtr url, const kj::HttpHeaders& headers,
+                  kj::StringPtr keyPrefix = "0\n") {
+    auto& client = clients.add(test.newClient(keyPrefix));
+    promises.add(client->request(method, url, headers, *body, responses[promises.size()]));
+  };
+
+  send(kj::HttpMethod::GET, "https://example.com/a", html);
+  send(kj::HttpMethod::GET, "https://example.com/a", json);
+  send(kj::HttpMethod::GET, "https://example.com/b", html);
+  send(kj::HttpMethod::GET, "https://example.com/a", html, "1\n");
+  send(kj::HttpMethod::HEAD, "https://example.com/a", html);
+  KJ_EXPECT(test.requests == 5);
+
+  test.openGate->fulfill();
+  kj::joinPromises(promises.releaseAsArray()).wait(test.ws);
+  KJ_EXPECT(responses[1].getBody() == "body of https://example.com/a");
+  KJ_EXPECT(responses[2].getBody() == "body of https://example.com/b");
+}
+
+KJ_TEST("SubrequestCoalescer cancels the subrequest once every caller is gone") {
+  CoalescerTest test;
+  kj::HttpHeaders headers(*test.table);
+  auto body = kj::newNullInputStream();
+
+  TestResponse responses[2];
+  auto client1 = test.newClient();
+  auto client2 = test.newClient();
+  auto promise1 = client1->request(kj::HttpMethod::GET, "https://example.com/", headers, *body,
+                                   responses[0]);
+  auto promise2 = client2->request(kj::HttpMethod::GET, "https://example.com/", headers, *body,
+                                   responses[1]);
+  KJ_EXPECT(test.coalescer.size() == 1);
+
+  promise1 = nullptr;
+  KJ_EXPECT(test.coalescer.size() == 1);
+  promise2 = nullptr;
+  KJ_EXPECT(test.coalescer.size() == 0);
+
+  test.openGate->fulfill();
+  test.ws.poll();
+  KJ_EXPECT(responses[0].statusCode == 0);
+  KJ_EXPECT(responses[1].statusCode == 0);
+}
+
+}  // namespace
+}  // namespace workerd::server
@@ -0,0 +1,304 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "subrequest-coalescer.h"
+#include <kj/debug.h>
+#include <kj/vector.h>
+
+namespace workerd::server {
+
+class SubrequestCoalescer::Flight final: public kj::Refcounted,
+                                         private kj::HttpService::Response {
+  // One subrequest, and the callers sharing its response. Each caller's promise holds a
+  // reference, so the subrequest is canceled when the last of them goes away.
+
+public:
+  Flight(SubrequestCoalescer& coalescer, kj::String key, kj::Own<WorkerInterface> inner,
+         kj::StringPtr url, const kj::HttpHeaders& headers)
+      : coalescer(coalescer), key(kj::mv(key)), inner(kj::mv(inner)), url(kj::str(url)),
+        headers(kj::heap(headers.clone())) {
+    // A full flight with the same key stays in flight, but can't be joined any more.
+    coalescer.flights.upsert(this->key, this, [](Flight*& existing, Flight*&& replacement) {
+      existing->registered = false;
+      existing = replacement;
+    });
+    registered = true;
+  }
+
+  ~Flight() noexcept(false) {
+    unregister();
+  }
+
+  bool canJoin() {
+    return registered && branches.size() < coalescer.options.maxRequestsPerFlight;
+  }
+
+  kj::Promise<void> join(kj::HttpService::Response& response) {
+    // Adds a caller. The returned promise completes once the whole response has been written to
+    // `response`.
+    auto paf = kj::newPromiseAndFulfiller<void>();
+    auto& branch = *branches.add(kj::heap<Branch>(response, kj::mv(paf.fulfiller)));
+    return paf.promise.attach(kj::defer([self = kj::addRef(*this), &branch]() {
+      self->detach(branch);
+    }));
+  }
+
+  void start() {
+    task = kj::evalNow([&]() {
+      return inner->request(kj::HttpMethod::GET, url, *headers, *body, *this);
+    }).then([this]() {
+      finish(nullptr);
+    }, [this](kj::Exception&& e) {
+      finish(kj::mv(e));
+    }).eagerlyEvaluate(nullptr);
+  }
+
+  void orphan() {
+    // The coalescer is going away before this flight.
+    registered = false;
+  }
+
+private:
+  struct Branch {
+    // One caller.
+
+    Branch(kj::HttpService::Response& response, kj::Own<kj::PromiseFulfiller<void>> done)
+        : response(response), done(kj::mv(done)) {}
+
+    kj::HttpService::Response& response;
+    kj::Own<kj::PromiseFulfiller<void>> done;
+    kj::Maybe<kj::Own<kj::AsyncOutputStream>> out;
+    bool detached = false;
+    // The caller went away. Its branch is removed as soon as no write is using it.
+    bool failed = false;
+    // Sending to the caller failed, and it has been told so. It gets nothing more.
+
+    void fail(kj::Exception&& e) {
+      failed = true;
+      done->reject(kj::mv(e));
+    }
+  };
+
+  class FanOut final: public kj::AsyncOutputStream {
+    // The response body, as written by the subrequest, which writes to every caller.
+
+  public:
+    explicit FanOut(Flight& flight): flight(flight) {}
+
+    kj::Promise<void> write(const void* buffer, size_t size) override {
+      return flight.write([&](kj::AsyncOutputStream& out) { return out.write(buffer, size); });
+    }
+    kj::Promise<void> write(kj::ArrayPtr<const kj::ArrayPtr<const kj::byte>> pieces) override {
+      return flight.write([&](kj::AsyncOutputStream& out) { return out.write(pieces); });
+    }
+    kj::Promise<void> whenWriteDisconnected() override {
+      // Callers disconnecting just drop out, and the last one cancels the subrequest.
+      return kj::NEVER_DONE;
+    }
+
+  private:
+    Flight& flight;
+    // Not a reference count: the subrequest owns the stream, and the flight owns the subrequest.
+  };
+
+  SubrequestCoalescer& coalescer;
+  kj::String key;
+  bool registered = false;
+  // Whether `coalescer.flights` points here.
+
+  kj::Own<WorkerInterface> inner;
+  kj::String url;
+  kj::Own<kj::HttpHeaders> headers;
+  kj::Own<kj::AsyncInputStream> body = kj::newNullInputStream();
+
+  kj::Vector<kj::Own<Branch>> branches;
+  bool responded = false;
+  bool busy = false;
+  // Set while writing to the branches, so none are removed under the write.
+
+  kj::Promise<void> task = nullptr;
+
+  void unregister() {
+    if (registered) {
+      registered = false;
+      coalescer.flights.erase(key);
+    }
+  }
+
+  void detach(Branch& branch) {
+    branch.detached = true;
+    if (!busy) sweep();
+  }
+
+  void sweep() {
+    // Removes the branches of callers that went away, and lets go of the streams of those that
+    // failed. (Their branches stay until they go away too, since their promises point to them.)
+    for (size_t i = 0; i < branches.size();) {
+      auto& branch = *branches[i];
+      if (branch.detached) {
+        branches[i] = kj::mv(branches.back());
+        branches.removeLast();
+        continue;
+      }
+      if (branch.failed) {
+        branch.out = nullptr;
+      }
+      ++i;
+    }
+  }
+
+  kj::Own<kj::AsyncOutputStream> send(
+      uint statusCode, kj::StringPtr statusText, const kj::HttpHeaders& responseHeaders,
+      kj::Maybe<uint64_t> expectedBodySize) override {
+    // Callers that came along now would miss the start of the body, so they send their own.
+    unregister();
+    responded = true;
+
+    busy = true;
+    for (auto& branch: branches) {
+      if (branch->detached) continue;
+      auto exception = kj::runCatchingExceptions([&]() {
+        branch->out = branch->response.send(
+            statusCode, statusText, responseHeaders, expectedBodySize);
+      });
+      KJ_IF_MAYBE(e, exception) {
+        branch->fail(kj::mv(*e));
+      }
+    }
+    busy = false;
+    sweep();
+
+    return kj::heap<FanOut>(*this);
+  }
+
+  kj::Own<kj::WebSocket> acceptWebSocket(const kj::HttpHeaders& headers) override {
+    KJ_FAIL_REQUIRE("coalesced subrequest can't accept a WebSocket");
+  }
+
+  kj::Promise<void> write(
+      kj::FunctionParam<kj::Promise<void>(kj::AsyncOutputStream&)> func) {
+    KJ_REQUIRE(!busy, "can't start a write while another is in progress");
+
+    kj::Vector<kj::Promise<void>> writes(branches.size());
+    for (auto& branch: branches) {
+      if (branch->detached || branch->failed) continue;
+      KJ_IF_MAYBE(out, branch->out) {
+        auto& b = *branch;
+        writes.add(kj::evalNow([&]() { return func(**out); })
+            .catch_([&b](kj::Exception&& e) { b.fail(kj::mv(e)); }));
+      }
+    }
+    if (writes.empty()) {
+      return KJ_EXCEPTION(DISCONNECTED, "every caller sharing this subrequest went away");
+    }
+
+    busy = true;
+    return kj::joinPromises(writes.releaseAsArray()).attach(kj::defer([this]() {
+      busy = false;
+      sweep();
+    }));
+  }
+
+  void finish(kj::Maybe<kj::Exception> error) {
+    unregister();
+    for (auto& branch: branches) {
+      if (branch->detached || branch->failed) continue;
+      KJ_IF_MAYBE(e, error) {
+        branch->fail(kj::cp(*e));
+      } else if (!responded) {
+        branch->fail(KJ_EXCEPTION(FAILED, "subrequest completed without a response"));
+      } else {
+        // Dropping the stream ends the caller's body.
+        branch->out = nullptr;
+        branch->done->fulfill();
+      }
+    }
+    sweep();
+  }
+};
+
+class SubrequestCoalescer::Client final: public WorkerInterface {
+public:
+  Client(SubrequestCoalescer& coalescer, kj::Own<WorkerInterface> inner, kj::String keyPrefix)
+      : coalescer(coalescer), inner(kj::mv(inner)), keyPrefix(kj::mv(keyPrefix)) {}
+
+  kj::Promise<void> request(
+      kj::HttpMethod method, kj::StringPtr url, const kj::HttpHeaders& headers,
+      kj::AsyncInputStream& requestBody, kj::HttpService::Response& response) override {
+    if (method != kj::HttpMethod::GET || requestBody.tryGetLength().orDefault(1) != 0 ||
+        headers.get(kj::HttpHeaderId::UPGRADE) != nullptr) {
+      return getInner().request(method, url, headers, requestBody, response);
+    }
+
+    auto key = kj::str(keyPrefix, headers.serializeRequest(method, url));
+    KJ_IF_MAYBE(flight, coalescer.flights.find(key.asPtr())) {
+      if ((*flight)->canJoin()) {
+        KJ_IF_MAYBE(m, coalescer.metrics) {
+          m->increment(WorkerMetrics::Counter::SUBREQUESTS_COALESCED);
+        }
+        return (*flight)->join(response);
+      }
+    }
+
+    auto flight = kj::refcounted<Flight>(coalescer, kj::mv(key), releaseInner(), url, headers);
+    auto promise = flight->join(response);
+    flight->start();
+    return promise;
+  }
+
+  kj::Promise<void> connect(kj::StringPtr host, const kj::HttpHeaders& headers,
+      kj::AsyncIoStream& connection, kj::HttpService::ConnectResponse& response) override {
+    return getInner().connect(host, headers, connection, response);
+  }
+  void prewarm(kj::StringPtr url) override {
+    getInner().prewarm(url);
+  }
+  kj::Promise<ScheduledResult> runScheduled(kj::Date scheduledTime,
+                                            kj::StringPtr cron) override {
+    return getInner().runScheduled(scheduledTime, cron);
+  }
+  kj::Promise<AlarmResult> runAlarm(kj::Date scheduledTime) override {
+    return getInner().runAlarm(scheduledTime);
+  }
+  kj::Promise<CustomEvent::Result> customEvent(kj::Own<CustomEvent> event) override {
+    return getInner().customEvent(kj::mv(event));
+  }
+
+private:
+  SubrequestCoalescer& coalescer;
+  kj::Maybe<kj::Own<WorkerInterface>> inner;
+  // Null once handed to a Flight.
+  kj::String keyPrefix;
+
+  kj::Own<WorkerInterface>& getInnerOwn() {
+    return KJ_REQUIRE_NONNULL(inner, "WorkerInterface was already used for a request");
+  }
+  WorkerInterface& getInner() { return *getInnerOwn(); }
+
+  kj::Own<WorkerInterface> releaseInner() {
+    auto result = kj::mv(getInnerOwn());
+    inner = nullptr;
+    return result;
+  }
+};
+
+SubrequestCoalescer::SubrequestCoalescer(kj::Maybe<const WorkerMetrics&> metrics,
+                                         SubrequestCoalescerOptions options)
+    : metrics(metrics), options(options) {
+  KJ_REQUIRE(options.maxRequestsPerFlight > 0);
+}
+
+SubrequestCoalescer::~SubrequestCoalescer() noexcept(false) {
+  // Flights live as long as their callers wait for them, which may be longer.
+  for (auto& entry: flights) {
+    entry.value->orphan();
+  }
+}
+
+kj::Own<WorkerInterface> SubrequestCoalescer::wrap(kj::Own<WorkerInterface> inner,
+                                                   kj::String keyPrefix) {
+  return kj::heap<Client>(*this, kj::mv(inner), kj::mv(keyPrefix));
+}
+
+}  // namespace workerd::server
@@ -0,0 +1,62 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#pragma once
+
+#include "metrics.h"
+#include <workerd/io/worker-interface.h>
+#include <kj/map.h>
+
+namespace workerd::server {
+
+using kj::uint;
+
+struct SubrequestCoalescerOptions {
+  uint maxRequestsPerFlight = 1000;
+  // Most callers that may share one subrequest. Once a flight is full, the next identical request
+  // starts a new one.
+};
+
+class SubrequestCoalescer {
+  // Merges identical GET subrequests made at the same time into one, so that when many requests
+  // to a Worker miss a cache together they don't all fetch the same thing from the origin.
+  //
+  // The first request with a given key is sent as usual; the key covers the channel, the
+  // `request.cf` blob, the URL and every header, so anything a response could `Vary` on is the
+  // same. Identical requests made before its response headers arrive wait for that response
+  // instead of being sent, and then each get the same status, headers and body. The body isn't
+  // buffered: it is written to every caller at once, at the pace of the slowest. A caller that
+  // goes away drops out without affecting the others, and the subrequest is canceled only once
+  // none are left.
+  //
+  // Only GETs without a body and without an `Upgrade` are merged, and only when the caller gets a
+  // fresh WorkerInterface for each request, as from IoChannelFactory::startSubrequest(). Each
+  // caller's request still counts as a subrequest of its own.
+
+public:
+  SubrequestCoalescer(kj::Maybe<const WorkerMetrics&> metrics,
+                      SubrequestCoalescerOptions options = {});
+  ~SubrequestCoalescer() noexcept(false);
+  KJ_DISALLOW_COPY_AND_MOVE(SubrequestCoalescer);
+
+  kj::Own<WorkerInterface> wrap(kj::Own<WorkerInterface> inner, kj::String keyPrefix);
+  // Returns a WorkerInterface which sends its request through `inner`, unless it can share an
+  // identical request already in flight. Only requests with the same `keyPrefix` are merged.
+  // After merging, `inner` is unused and the returned interface may not be used again.
+
+  size_t size() const { return flights.size(); }
+  // Number of subrequests that more identical requests may still join.
+
+private:
+  class Client;
+  class Flight;
+
+  kj::Maybe<const WorkerMetrics&> metrics;
+  SubrequestCoalescerOptions options;
+
+  kj::HashMap<kj::StringPtr, Flight*> flights;
+  // Flights which haven't received their response headers yet, keyed by `Flight::key`.
+};
+
+}  // namespace workerd::server
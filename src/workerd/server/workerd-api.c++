@@ -156,7 +156,8 @@ const jsg::TypeHandler<Worker::ApiIsolate::ErrorInterface>&
 }
 
 Worker::Script::Source WorkerdApiIsolate::extractSource(config::Worker::Reader conf,
-    Worker::ValidationErrorReporter& errorReporter) {
+    Worker::ValidationErrorReporter& errorReporter,
+    kj::Maybe<const jsg::CodeCache&> codeCache) {
   switch (conf.which()) {
     case config::Worker::MODULES: {
       auto modules = conf.getModules();
@@ -167,9 +168,9 @@ Worker::Script::Source WorkerdApiIsolate::extractSource(config::Worker::Reader c
 
       return Worker::Script::ModulesSource {
         modules[0].getName(),
-        [conf,&errorReporter](jsg::Lock& lock, const Worker::ApiIsolate& apiIsolate) {
+        [conf,&errorReporter,codeCache](jsg::Lock& lock, const Worker::ApiIsolate& apiIsolate) {
           return kj::downcast<const WorkerdApiIsolate>(apiIsolate)
-              .compileModules(lock, conf, errorReporter);
+              .compileModules(lock, conf, errorReporter, codeCache);
         }
       };
     }
@@ -179,7 +180,8 @@ Worker::Script::Source WorkerdApiIsolate::extractSource(config::Worker::Reader c
         [conf,&errorReporter](jsg::Lock& lock, const Worker::ApiIsolate& apiIsolate) {
           return kj::downcast<const WorkerdApiIsolate>(apiIsolate)
               .compileScriptGlobals(lock, conf, errorReporter);
-        }
+        },
+        codeCache
       };
     case config::Worker::INHERIT:
       // TODO(beta): Support inherit.
@@ -229,81 +231,92 @@ kj::Array<Worker::Script::CompiledGlobal> WorkerdApiIsolate::compileScriptGlobal
 
 kj::Own<jsg::ModuleRegistry> WorkerdApiIsolate::compileModules(
     jsg::Lock& lockParam, config::Worker::Reader conf,
-    Worker::ValidationErrorReporter& errorReporter) const {
+    Worker::ValidationErrorReporter& errorReporter,
+    kj::Maybe<const jsg::CodeCache&> codeCache) const {
   auto& lock = kj::downcast<JsgWorkerdIsolate::Lock>(lockParam);
   v8::HandleScope scope(lock.v8Isolate);
 
   auto modules = kj::heap<jsg::ModuleRegistryImpl<JsgWorkerdIsolate_TypeWrapper>>();
 
+  // Modules are compiled when first resolved rather than here, so that a worker bundle with many
+  // modules (or large Wasm and data modules) only pays for the ones it actually imports. The
+  // factories capture the config reader and code cache, both of which are owned by the Server and
+  // outlive the isolate.
   for (auto module: conf.getModules()) {
     auto path = kj::Path::parse(module.getName());
 
     switch (module.which()) {
       case config::Worker::Module::TEXT: {
-        modules->add(
-            path,
-            jsg::ModuleRegistry::ModuleInfo(
-                lock,
-                module.getName(),
-                nullptr,
-                jsg::ModuleRegistry::TextModuleInfo(lock,
-                    Impl::compileTextGlobal(lock, module.getText()))));
+        modules->add(path, [module](jsg::Lock& js) {
+          auto& lock = kj::downcast<JsgWorkerdIsolate::Lock>(js);
+          return jsg::ModuleRegistry::ModuleInfo(
+              lock,
+              module.getName(),
+              nullptr,
+              jsg::ModuleRegistry::TextModuleInfo(lock,
+                  Impl::compileTextGlobal(lock, module.getText())));
+        });
         break;
       }
       case config::Worker::Module::DATA: {
-        modules->add(
-            path,
-            jsg::ModuleRegistry::ModuleInfo(
-                lock,
-                module.getName(),
-                nullptr,
-                jsg::ModuleRegistry::DataModuleInfo(
-                    lock,
-                    Impl::compileDataGlobal(lock, module.getData()).As<v8::ArrayBuffer>())));
+        modules->add(path, [module](jsg::Lock& js) {
+          auto& lock = kj::downcast<JsgWorkerdIsolate::Lock>(js);
+          return jsg::ModuleRegistry::ModuleInfo(
+              lock,
+              module.getName(),
+              nullptr,
+              jsg::ModuleRegistry::DataModuleInfo(
+                  lock,
+                  Impl::compileDataGlobal(lock, module.getData()).As<v8::ArrayBuffer>()));
+        });
         break;
       }
       case config::Worker::Module::WASM: {
-        modules->add(
-            path,
-            jsg::ModuleRegistry::ModuleInfo(
-                lock,
-                module.getName(),
-                nullptr,
-                jsg::ModuleRegistry::WasmModuleInfo(lock,
-                    Impl::compileWasmGlobal(lock, module.getWasm()))));
+        modules->add(path, [module](jsg::Lock& js) {
+          auto& lock = kj::downcast<JsgWorkerdIsolate::Lock>(js);
+          return jsg::ModuleRegistry::ModuleInfo(
+              lock,
+              module.getName(),
+              nullptr,
+              jsg::ModuleRegistry::WasmModuleInfo(lock,
+                  Impl::compileWasmGlobal(lock, module.getWasm())));
+        });
         break;
       }
       case config::Worker::Module::JSON: {
-        modules->add(
-            path,
-            jsg::ModuleRegistry::ModuleInfo(
-                lock,
-                module.getName(),
-                nullptr,
-                jsg::ModuleRegistry::JsonModuleInfo(lock,
-                    Impl::compileJsonGlobal(lock, module.getJson()))));
+        modules->add(path, [module](jsg::Lock& js) {
+          auto& lock = kj::downcast<JsgWorkerdIsolate::Lock>(js);
+          return jsg::ModuleRegistry::ModuleInfo(
+              lock,
+              module.getName(),
+              nullptr,
+              jsg::ModuleRegistry::JsonModuleInfo(lock,
+                  Impl::compileJsonGlobal(lock, module.getJson())));
+        });
         break;
       }
       case config::Worker::Module::ES_MODULE: {
-        modules->add(
-            path,
-            jsg::ModuleRegistry::ModuleInfo(
-                lock,
-                module.getName(),
-                module.getEsModule()));
+        modules->add(path, [module, codeCache](jsg::Lock& js) {
+          return jsg::ModuleRegistry::ModuleInfo(
+              js,
+              module.getName(),
+              module.getEsModule(),
+              jsg::ModuleRegistry::ModuleInfo::CompileOption::BUNDLE,
+              codeCache);
+        });
         break;
       }
       case config::Worker::Module::COMMON_JS_MODULE: {
-        modules->add(
-            path,
-            jsg::ModuleRegistry::ModuleInfo(
-                lock,
-                module.getName(),
-                nullptr,
-                jsg::ModuleRegistry::CommonJsModuleInfo(
-                    lock,
-                    module.getName(),
-                    module.getCommonJsModule())));
+        modules->add(path, [module](jsg::Lock& js) {
+          return jsg::ModuleRegistry::ModuleInfo(
+              js,
+              module.getName(),
+              nullptr,
+              jsg::ModuleRegistry::CommonJsModuleInfo(
+                  js,
+                  module.getName(),
+                  module.getCommonJsModule()));
+        });
         break;
       }
       default: {
@@ -429,6 +442,10 @@ private:
   }
 };
 
+kj::Own<ActorIdFactory> newActorIdFactory(kj::StringPtr uniqueKey) {
+  return kj::heap<ActorIdFactoryImpl>(uniqueKey);
+}
+
 void WorkerdApiIsolate::compileGlobals(
     jsg::Lock& lockParam, kj::ArrayPtr<const Global> globals,
     v8::Local<v8::Object> target,
@@ -475,30 +492,44 @@ void WorkerdApiIsolate::compileGlobals(
             jsg::alloc<api::public_beta::R2Admin>(featureFlags, r2a.subrequestChannel));
       }
 
+      KJ_CASE_ONEOF(ae, Global::AnalyticsEngine) {
+        // workerd has no dataset schema versions.
+        value = lock.wrap(context, jsg::alloc<api::AnalyticsEngine>(
+            ae.logfwdrChannel, kj::str(ae.dataset), 0, ownerId));
+      }
+
       KJ_CASE_ONEOF(key, Global::CryptoKey) {
-        api::SubtleCrypto::ImportKeyData keyData;
-        KJ_SWITCH_ONEOF(key.keyData) {
-          KJ_CASE_ONEOF(data, kj::Array<byte>) {
-            keyData = kj::heapArray(data.asPtr());
+        auto locked = key.imported->impl.lockExclusive();
+        if (*locked == nullptr) {
+          api::SubtleCrypto::ImportKeyData keyData;
+          KJ_SWITCH_ONEOF(key.keyData) {
+            KJ_CASE_ONEOF(data, kj::Array<byte>) {
+              keyData = kj::heapArray(data.asPtr());
+            }
+            KJ_CASE_ONEOF(json, Global::Json) {
+              v8::Local<v8::String> str = lock.wrap(context, kj::mv(json.text));
+              v8::Local<v8::Value> obj = jsg::check(v8::JSON::Parse(context, str));
+              keyData = lock.unwrap<api::SubtleCrypto::ImportKeyData>(context, obj);
+            }
           }
-          KJ_CASE_ONEOF(json, Global::Json) {
-            v8::Local<v8::String> str = lock.wrap(context, kj::mv(json.text));
-            v8::Local<v8::Value> obj = jsg::check(v8::JSON::Parse(context, str));
-            keyData = lock.unwrap<api::SubtleCrypto::ImportKeyData>(context, obj);
-          }
-        }
 
-        v8::Local<v8::String> algoStr = lock.wrap(context, kj::mv(key.algorithm.text));
-        v8::Local<v8::Value> algo = jsg::check(v8::JSON::Parse(context, algoStr));
-        auto importKeyAlgo = lock.unwrap<
-            kj::OneOf<kj::String, api::SubtleCrypto::ImportKeyAlgorithm>>(context, algo);
+          v8::Local<v8::String> algoStr = lock.wrap(context, kj::mv(key.algorithm.text));
+          v8::Local<v8::Value> algo = jsg::check(v8::JSON::Parse(context, algoStr));
+          auto importKeyAlgo = lock.unwrap<
+              kj::OneOf<kj::String, api::SubtleCrypto::ImportKeyAlgorithm>>(context, algo);
 
-        jsg::Ref<api::CryptoKey> importedKey = api::SubtleCrypto().importKeySync(lock,
-            key.format, kj::mv(keyData),
-            api::interpretAlgorithmParam(kj::mv(importKeyAlgo)),
-            key.extractable, key.usages);
+          *locked = api::SubtleCrypto::importKeyImpl(
+              key.format, kj::mv(keyData),
+              api::interpretAlgorithmParam(kj::mv(importKeyAlgo)),
+              key.extractable, key.usages);
+        }
 
-        value = lock.wrap(context, kj::mv(importedKey));
+        // Each isolate gets its own CryptoKey wrapping the shared implementation, which the
+        // binding keeps alive.
+        auto& impl = *KJ_ASSERT_NONNULL(*locked);
+        auto sharedImpl = kj::Own<api::CryptoKey::Impl>(&impl, kj::NullDisposer::instance)
+            .attach(kj::atomicAddRef(*key.imported));
+        value = lock.wrap(context, jsg::alloc<api::CryptoKey>(kj::mv(sharedImpl)));
       }
 
       KJ_CASE_ONEOF(ns, Global::EphemeralActorNamespace) {
@@ -531,6 +562,8 @@ void WorkerdApiIsolate::compileGlobals(
 
 // =======================================================================================
 
+WorkerdApiIsolate::Global::CryptoKey::Imported::~Imported() noexcept(false) {}
+
 WorkerdApiIsolate::Global WorkerdApiIsolate::Global::clone() const {
   Global result;
   result.name = kj::str(name);
@@ -551,6 +584,9 @@ WorkerdApiIsolate::Global WorkerdApiIsolate::Global::clone() const {
     KJ_CASE_ONEOF(r2Admin, Global::R2Admin) {
       result.value = r2Admin.clone();
     }
+    KJ_CASE_ONEOF(ae, Global::AnalyticsEngine) {
+      result.value = ae.clone();
+    }
     KJ_CASE_ONEOF(key, Global::CryptoKey) {
       result.value = key.clone();
     }
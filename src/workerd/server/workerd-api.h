@@ -6,6 +6,7 @@
 
 #include <workerd/io/worker.h>
 #include <workerd/api/analytics-engine.h>
+#include <workerd/api/crypto.h>
 #include <workerd/server/workerd.capnp.h>
 
 namespace workerd::server {
@@ -27,7 +28,9 @@ public:
       getErrorInterfaceTypeHandler(jsg::Lock& lock) const override;
 
   static Worker::Script::Source extractSource(config::Worker::Reader conf,
-      Worker::ValidationErrorReporter& errorReporter);
+      Worker::ValidationErrorReporter& errorReporter,
+      kj::Maybe<const jsg::CodeCache&> codeCache = nullptr);
+  // `codeCache`, if given, is used when compiling ES modules and service worker scripts.
 
   struct Global {
     // A pipeline-level binding.
@@ -72,6 +75,14 @@ public:
         return *this;
       }
     };
+    struct AnalyticsEngine {
+      uint logfwdrChannel;
+      kj::String dataset;
+
+      AnalyticsEngine clone() const {
+        return AnalyticsEngine { .logfwdrChannel = logfwdrChannel, .dataset = kj::str(dataset) };
+      }
+    };
     struct CryptoKey {
       kj::String format;
       kj::OneOf<kj::Array<byte>, Json> keyData;
@@ -79,6 +90,18 @@ public:
       bool extractable;
       kj::Array<kj::String> usages;
 
+      class Imported final: public kj::AtomicRefcounted {
+        // The key as imported by the first isolate that needed it. Clones of this binding share
+        // it, so the key material is only parsed once per process no matter how many isolates
+        // are created from the same config. A CryptoKey::Impl is immutable once imported, so
+        // the isolates can all use it at once.
+      public:
+        ~Imported() noexcept(false);
+
+        kj::MutexGuarded<kj::Maybe<kj::Own<api::CryptoKey::Impl>>> impl;
+      };
+      kj::Own<const Imported> imported = kj::atomicRefcounted<Imported>();
+
       CryptoKey clone() const {
         decltype(keyData) clonedKeyData;
         KJ_SWITCH_ONEOF(keyData) {
@@ -97,6 +120,7 @@ public:
           .usages = KJ_MAP(s, usages) {
             return kj::str(s);
           },
+          .imported = kj::atomicAddRef(*imported),
         };
       }
     };
@@ -116,8 +140,8 @@ public:
       }
     };
     kj::String name;
-    kj::OneOf<Json, Fetcher, KvNamespace, R2Bucket, R2Admin, CryptoKey, EphemeralActorNamespace,
-              DurableActorNamespace, kj::String, kj::Array<byte>> value;
+    kj::OneOf<Json, Fetcher, KvNamespace, R2Bucket, R2Admin, AnalyticsEngine, CryptoKey,
+              EphemeralActorNamespace, DurableActorNamespace, kj::String, kj::Array<byte>> value;
 
     Global clone() const;
   };
@@ -136,7 +160,12 @@ private:
       Worker::ValidationErrorReporter& errorReporter) const;
   kj::Own<jsg::ModuleRegistry> compileModules(
       jsg::Lock& lock, config::Worker::Reader conf,
-      Worker::ValidationErrorReporter& errorReporter) const;
+      Worker::ValidationErrorReporter& errorReporter,
+      kj::Maybe<const jsg::CodeCache&> codeCache) const;
 };
 
+kj::Own<ActorIdFactory> newActorIdFactory(kj::StringPtr uniqueKey);
+// Creates the ID factory of the Durable Object namespace with the given unique key, which
+// produces the same IDs as the namespace's bindings do.
+
 }  // namespace workerd::server
@@ -5,6 +5,7 @@
 #include <kj/main.h>
 #include <kj/filesystem.h>
 #include <kj/map.h>
+#include <kj/thread.h>
 #include <capnp/message.h>
 #include <capnp/serialize.h>
 #include <capnp/schema-parser.h>
@@ -16,13 +17,16 @@
 #include <sys/stat.h>
 #include <sys/socket.h>
 #include "server.h"
+#include "actor-placement.h"
+#include "code-cache.h"
+#include "metrics.h"
 #include <unistd.h>
 #include <sys/syscall.h>
 #include <workerd/jsg/setup.h>
 #include <kj/async-unix.h>
 #include <sys/ioctl.h>
-#include <openssl/rand.h>
 #include <workerd/io/compatibility-date.h>
+#include <workerd/util/random.h>
 
 #if __linux__
 #include <sys/inotify.h>
@@ -55,7 +59,7 @@ static kj::StringPtr getVersionString() {
 class EntropySourceImpl: public kj::EntropySource {
 public:
   void generate(kj::ArrayPtr<kj::byte> buffer) override {
-    KJ_ASSERT(RAND_bytes(buffer.begin(), buffer.size()) == 1);
+    randomBytes(buffer);
   }
 };
 
@@ -574,10 +578,18 @@ public:
                           "<addr> instead of the address specified in the config file.")
         .addOptionWithArg({'i', "inspector-addr"}, CLI_METHOD(enableInspector), "<addr>",
                           "Enable the inspector protocol to connect to the address <addr>.")
+        .addOptionWithArg({"code-cache-dir"}, CLI_METHOD(setCodeCacheDirectory), "<path>",
+                          "Store V8 code caches for Worker scripts in the directory <path> (which "
+                          "is created if needed), so that later runs can skip compiling them. "
+                          "Caches embedded by \"workerd compile\" take precedence.")
         .addOption({'w', "watch"}, CLI_METHOD(watch),
                    "Watch configuration files (and server binary) and reload if they change. "
                    "Useful for development, but not recommended in production.")
-        .addOption({"experimental"}, [this]() { server.allowExperimental(); return true; },
+        .addOption({"experimental"}, [this]() {
+                     server.allowExperimental();
+                     recordedOverrides.experimental = true;
+                     return true;
+                   },
                    "Permit the use of experimental features which may break backwards "
                    "compatibility in a future release.")
         .callAfterParsing(CLI_METHOD(serve))
@@ -587,7 +599,9 @@ public:
   kj::MainFunc getServe() {
     auto builder = kj::MainBuilder(context, getVersionString(),
           "Serve requests based on a config.",
-          "Serves requests based on the configuration specified in <config-file>.");
+          "Serves requests based on the configuration specified in <config-file>. On SIGHUP, "
+          "the config file is read again and changed Workers are replaced without dropping "
+          "connections; other changes restart the server.");
     return addServeOptionsAndBuild(addConfigParsingOptions(builder));
   }
 
@@ -596,7 +610,8 @@ public:
           "Builds a self-contained binary from a config.",
           "This parses a config file in the same manner as the \"serve\" command, but instead "
           "of then running it, it outputs a new binary to stdout that embeds the config and all "
-          "associated Worker code and data as one self-contained unit. This binary may then "
+          "associated Worker code and data, plus precompiled V8 code caches for the Worker "
+          "scripts, as one self-contained unit. This binary may then "
           "be executed on another system to run the config -- without any other files being "
           "present on that system.");
     return addConfigParsingOptions(builder)
@@ -625,6 +640,7 @@ public:
 
   void overrideSocketAddr(kj::StringPtr param) {
     auto [ name, value ] = parseOverride(param);
+    recordedOverrides.socketAddrs.add(RecordedOverride { kj::str(name), kj::str(value) });
     server.overrideSocket(kj::mv(name), kj::str(value));
   }
 
@@ -658,17 +674,20 @@ public:
     validateSocketFd(fd, name);
 
     inheritedFds.add(fd);
+    recordedOverrides.socketFds.add(RecordedFdOverride { kj::str(name), fd });
     server.overrideSocket(kj::mv(name), io.lowLevelProvider->wrapListenSocketFd(
         fd, kj::LowLevelAsyncIoProvider::TAKE_OWNERSHIP));
   }
 
   void overrideDirectory(kj::StringPtr param) {
     auto [ name, value ] = parseOverride(param);
+    recordedOverrides.directories.add(RecordedOverride { kj::str(name), kj::str(value) });
     server.overrideDirectory(kj::mv(name), kj::str(value));
   }
 
   void overrideExternal(kj::StringPtr param) {
     auto [ name, value ] = parseOverride(param);
+    recordedOverrides.externals.add(RecordedOverride { kj::str(name), kj::str(value) });
     server.overrideExternal(kj::mv(name), kj::str(value));
   }
 
@@ -676,6 +695,11 @@ public:
     server.enableInspector(kj::str(param));
   }
 
+  void setCodeCacheDirectory(kj::StringPtr param) {
+    recordedOverrides.codeCacheDirectory = kj::str(param);
+    server.setCodeCacheDirectory(kj::str(param));
+  }
+
   void watch() {
     auto& w = watcher.emplace(io.unixEventPort);
     if (!w.isSupported()) {
@@ -705,14 +729,11 @@ public:
       // Read file from disk.
       auto path = fs->getCurrentPath().evalNative(pathStr);
       auto file = KJ_UNWRAP_OR(fs->getRoot().tryOpenFile(path), CLI_ERROR("No such file."));
+      configPath = path.clone();
 
       if (binaryConfig) {
         // Interpret as binary config.
-        auto mapping = file->mmap(0, file->stat().size);
-        auto words = kj::arrayPtr(reinterpret_cast<const capnp::word*>(mapping.begin()),
-                                  mapping.size() / sizeof(capnp::word));
-        auto reader = kj::heap<capnp::FlatArrayMessageReader>(words, CONFIG_READER_OPTIONS)
-            .attach(kj::mv(mapping));
+        auto reader = mapBinaryConfig(*file);
         config = reader->getRoot<config::Config>();
         configOwner = kj::mv(reader);
       } else {
@@ -722,50 +743,94 @@ public:
         parsedSchema = schemaParser.parseFile(
             kj::heap<SchemaFileImpl>(fs->getRoot(), fs->getCurrentPath(),
                 kj::mv(path), nullptr, importPath, kj::mv(file), watcher, *this));
-
-        // Construct a list of top-level constants of type `Config`. If there is exactly one,
-        // we can use it by default.
-        for (auto nested: parsedSchema.getAllNested()) {
-          if (nested.getProto().isConst()) {
-            auto constSchema = nested.asConst();
-            auto type = constSchema.getType();
-            if (type.isStruct() &&
-                type.asStruct().getProto().getId() == capnp::typeId<config::Config>()) {
-              topLevelConfigConstants.add(constSchema);
-            }
-          }
-        }
       }
     }
   }
 
-  void setConstName(kj::StringPtr name) {
-    auto parent = parsedSchema;
+  static kj::Own<capnp::MessageReader> mapBinaryConfig(const kj::ReadableFile& file) {
+    // Maps a binary config file into memory. The reader owns the mapping.
+    auto mapping = file.mmap(0, file.stat().size);
+    auto words = kj::arrayPtr(reinterpret_cast<const capnp::word*>(mapping.begin()),
+                              mapping.size() / sizeof(capnp::word));
+    return kj::heap<capnp::FlatArrayMessageReader>(words, CONFIG_READER_OPTIONS)
+        .attach(kj::mv(mapping));
+  }
 
-    for (;;) {
-      auto dotPos = KJ_UNWRAP_OR(name.findFirst('.'), break);
-      auto parentName = name.slice(0, dotPos);
-      parent = KJ_UNWRAP_OR(parent.findNested(kj::str(parentName)),
-          CLI_ERROR("No such constant is defined in the config file (the parent scope '",
-                    parentName, "' does not exist)."));
-      name = name.slice(dotPos + 1);
+  void setConstName(kj::StringPtr name) {
+    constName = kj::str(name);
+    KJ_SWITCH_ONEOF(findConfig(parsedSchema, name)) {
+      KJ_CASE_ONEOF(found, config::Config::Reader) {
+        config = found;
+      }
+      KJ_CASE_ONEOF(error, kj::String) {
+        CLI_ERROR(error);
+      }
     }
+  }
+
+  static kj::OneOf<config::Config::Reader, kj::String> findConfig(
+      capnp::ParsedSchema file, kj::Maybe<kj::StringPtr> constName) {
+    // Picks the config out of a parsed config file: the constant named `constName`, which may be
+    // qualified with the names of its parent scopes, or if that's null, the file's only top-level
+    // constant of type `Config`. Returns an error message if there's no such constant. Used both
+    // at startup and when reloading, so that both pick the same constant.
+
+    KJ_IF_MAYBE(n, constName) {
+      kj::StringPtr name = *n;
+      auto parent = file;
+      for (;;) {
+        auto dotPos = KJ_UNWRAP_OR(name.findFirst('.'), break);
+        auto parentName = name.slice(0, dotPos);
+        parent = KJ_UNWRAP_OR(parent.findNested(kj::str(parentName)), {
+          return kj::str("No such constant is defined in the config file (the parent scope '",
+                         parentName, "' does not exist).");
+        });
+        name = name.slice(dotPos + 1);
+      }
 
-    auto node = KJ_UNWRAP_OR(parsedSchema.findNested(name),
-        CLI_ERROR("No such constant is defined in the config file."));
+      auto node = KJ_UNWRAP_OR(parent.findNested(name), {
+        return kj::str("No such constant is defined in the config file.");
+      });
 
-    if (!node.getProto().isConst()) {
-      CLI_ERROR("Symbol is not a constant.");
+      if (!node.getProto().isConst()) {
+        return kj::str("Symbol is not a constant.");
+      }
+
+      auto constSchema = node.asConst();
+      auto type = constSchema.getType();
+      if (!type.isStruct() ||
+          type.asStruct().getProto().getId() != capnp::typeId<config::Config>()) {
+        return kj::str("Constant is not of type 'Config'.");
+      }
+
+      return constSchema.as<config::Config>();
     }
 
-    auto constSchema = node.asConst();
-    auto type = constSchema.getType();
-    if (!type.isStruct() ||
-        type.asStruct().getProto().getId() != capnp::typeId<config::Config>()) {
-      CLI_ERROR("Constant is not of type 'Config'.");
+    // No `<const-name>` was given, so see if we can infer the correct constant...
+    kj::Vector<capnp::ConstSchema> candidates;
+    for (auto nested: file.getAllNested()) {
+      if (nested.getProto().isConst()) {
+        auto constSchema = nested.asConst();
+        auto type = constSchema.getType();
+        if (type.isStruct() &&
+            type.asStruct().getProto().getId() == capnp::typeId<config::Config>()) {
+          candidates.add(constSchema);
+        }
+      }
     }
 
-    config = constSchema.as<config::Config>();
+    if (candidates.empty()) {
+      return kj::str("The config file does not define any top-level constants of type 'Config'.");
+    } else if (candidates.size() == 1) {
+      return candidates[0].as<config::Config>();
+    } else {
+      auto names = KJ_MAP(cnst, candidates) {
+        return cnst.getShortDisplayName();
+      };
+      return kj::str(
+          "The config file defines multiple top-level constants of type 'Config', so you must "
+          "specify which one to use. The options are: ", kj::strArray(names, ", "));
+    }
   }
 
   void compile() {
@@ -775,13 +840,23 @@ public:
       context.exit();
     }
 
-    config::Config::Reader config = getConfig();
-
     if (isatty(STDOUT_FILENO)) {
       context.exitError(
           "Refusing to write binary to the terminal. Please use `>` to send the output to a file.");
     }
 
+    // Precompile all the Worker scripts, so that the output doesn't have to compile them at
+    // startup.
+    capnp::MallocMessageBuilder configBuilder;
+    {
+      auto original = getConfig();
+      configBuilder.setRoot(original);
+      jsg::V8System v8System(
+          KJ_MAP(flag, original.getV8Flags()) -> kj::StringPtr { return flag; });
+      embedCodeCache(v8System, configBuilder.getRoot<config::Config>());
+    }
+    config::Config::Reader config = configBuilder.getRoot<config::Config>().asReader();
+
     // Grab the inode info before we write anything.
     struct stat stats;
     KJ_SYSCALL(fstat(STDOUT_FILENO, &stats));
@@ -867,20 +942,246 @@ public:
       }
     } else {
       auto config = getConfig();
+
+      // SIGHUP asks us to reload the config. This must be set up before V8 starts any threads,
+      // so that they all inherit the signal mask.
+      kj::UnixEventPort::captureSignal(SIGHUP);
+
+      auto platformConf = config.getV8Platform();
+      auto backgroundThreadCpus = KJ_MAP(cpu, platformConf.getBackgroundThreadCpus()) -> uint {
+        return cpu;
+      };
       jsg::V8System v8System(
+          jsg::PlatformOptions {
+            .backgroundThreadCount = platformConf.getBackgroundThreads(),
+            .idleTasks = platformConf.getIdleTasks(),
+            .backgroundThreadCpus = backgroundThreadCpus,
+          },
           KJ_MAP(flag, config.getV8Flags()) -> kj::StringPtr { return flag; });
+
+      threadCount = config.getThreads();
+      if (threadCount == 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        threadCount = cores > 0 ? cores : 1;
+      }
+      if (threadCount > 1) {
+        server.enableReusePort(*io.lowLevelProvider, 0);
+        server.shareMetrics(kj::atomicAddRef(*metricsRegistry));
+        actorPlacement = kj::atomicRefcounted<ActorPlacement>(threadCount);
+        server.shareActorPlacement(kj::atomicAddRef(*actorPlacement), *io.lowLevelProvider, 0);
+      }
+
       auto promise = server.run(v8System, config);
-      KJ_IF_MAYBE(w, watcher) {
-        promise = promise.exclusiveJoin(waitForChanges(*w).then([this]() {
-          // Watch succeeded.
-          reloadFromConfigChange();
+
+      // Start the remaining threads only after the primary server has loaded the config, so that
+      // any config errors are reported once, by the primary thread.
+      for (uint i = 1; i < threadCount; i++) {
+        // `context` may only be used from this thread, so a thread that fails hands its error back
+        // here to be reported.
+        auto paf = kj::newPromiseAndCrossThreadFulfiller<void>();
+        auto thread = kj::heap<kj::Thread>(
+            [this, &v8System, config, i, fulfiller = kj::mv(paf.fulfiller)]() mutable {
+          KJ_IF_MAYBE(exception, kj::runCatchingExceptions([&]() {
+            runServerThread(v8System, config, i);
+          })) {
+            fulfiller->reject(kj::mv(*exception));
+          } else {
+            fulfiller->fulfill();
+          }
+        });
+        // Threads run until the process exits.
+        thread->detach();
+
+        promise = promise.exclusiveJoin(paf.promise.then([]() -> kj::Promise<void> {
+          return kj::NEVER_DONE;
+        }, [this, i](kj::Exception&& exception) -> kj::Promise<void> {
+          context.exitError(kj::str("server thread ", i, " failed: ", exception));
         }));
       }
+      KJ_IF_MAYBE(e, exeInfo) {
+        exeModified = exeModifiedTime(e->path);
+      }
+      KJ_IF_MAYBE(w, watcher) {
+        promise = promise.exclusiveJoin(reloadOnChanges(*w));
+      }
+      promise = promise.exclusiveJoin(reloadOnSignal());
       promise.wait(io.waitScope);
       context.exit();
     }
   }
 
+  kj::Promise<void> reloadOnChanges(FileWatcher& watcher) {
+    for (;;) {
+      co_await waitForChanges(watcher);
+      reloadConfig();
+    }
+  }
+
+  kj::Promise<void> reloadOnSignal() {
+    for (;;) {
+      co_await io.unixEventPort.onSignal(SIGHUP);
+      context.warning("Received SIGHUP, reloading config...");
+      reloadConfig();
+    }
+  }
+
+  void reloadConfig() {
+    // Applies changes to the config file to the running server, so that connections and requests
+    // in flight aren't interrupted. If the server can't take the change that way -- or the config
+    // didn't come from a file we can read again, or the server binary itself changed -- falls back
+    // to restarting the process, as --watch always used to.
+
+    auto restart = [this](kj::StringPtr reason) {
+      if (exeInfo == nullptr) {
+        context.warning(kj::str(
+            "Can't reload config without restarting (", reason, "), but unable to find our "
+            "own executable to restart it. Carrying on with the old config."));
+      } else {
+        reloadFromConfigChange();
+      }
+    };
+
+    if (configPath == nullptr) {
+      return restart("the config was not read from a file");
+    }
+    if (threadCount != 1) {
+      return restart("`threads` is not 1");
+    }
+    KJ_IF_MAYBE(e, exeInfo) {
+      if (exeModifiedTime(e->path) != exeModified) {
+        return restart("the server binary changed");
+      }
+    }
+
+    auto reparsed = KJ_UNWRAP_OR(reparseConfig(), {
+      context.warning("Config has errors, still serving the previous config.");
+      return;
+    });
+
+    auto result = server.reload(reparsed.config, kj::mv(reparsed.owner));
+    KJ_IF_MAYBE(reason, result.restartReason) {
+      return restart(*reason);
+    }
+
+    if (result.errors.size() > 0) {
+      for (auto& error: result.errors) {
+        context.error(error);
+      }
+      context.warning("Config has errors, still serving the previous config.");
+    } else {
+      // Extra spaces overwrite the "reloading shortly" line written with a CR but no LF.
+      context.warning("Reloaded config.                                                   ");
+    }
+  }
+
+  struct ReparsedConfig {
+    kj::Own<void> owner;
+    config::Config::Reader config;
+  };
+
+  kj::Maybe<ReparsedConfig> reparseConfig() {
+    // Reads the config file again, the same way the command line did. Returns null, having
+    // reported the errors, if it no longer parses.
+
+    auto& path = KJ_ASSERT_NONNULL(configPath);
+    auto file = KJ_UNWRAP_OR(fs->getRoot().tryOpenFile(path), {
+      context.error("Config file no longer exists.");
+      return nullptr;
+    });
+
+    if (binaryConfig) {
+      auto reader = mapBinaryConfig(*file);
+      auto config = reader->getRoot<config::Config>();
+      return ReparsedConfig { kj::mv(reader), config };
+    }
+
+    auto parser = kj::heap<capnp::SchemaParser>();
+    parser->setFileIdsRequired(false);
+    parser->loadCompiledTypeAndDependencies<config::Config>();
+
+    hadErrors = false;
+    capnp::ParsedSchema node;
+    KJ_IF_MAYBE(exception, kj::runCatchingExceptions([&]() {
+      node = parser->parseFile(
+          kj::heap<SchemaFileImpl>(fs->getRoot(), fs->getCurrentPath(),
+              path.clone(), nullptr, importPath, kj::mv(file), watcher, *this));
+    })) {
+      if (!hadErrors) {
+        context.error(exception->getDescription());
+      }
+      hadErrors = false;
+      return nullptr;
+    }
+    if (hadErrors) {
+      hadErrors = false;
+      return nullptr;
+    }
+
+    KJ_SWITCH_ONEOF(findConfig(node, constName)) {
+      KJ_CASE_ONEOF(config, config::Config::Reader) {
+        return ReparsedConfig { kj::mv(parser), config };
+      }
+      KJ_CASE_ONEOF(error, kj::String) {
+        context.error(error);
+        return nullptr;
+      }
+    }
+    KJ_UNREACHABLE;
+  }
+
+  kj::Date exeModifiedTime(kj::StringPtr path) {
+    // Returns the UNIX epoch if the file is missing.
+    KJ_IF_MAYBE(meta, fs->getRoot().tryLstat(fs->getCurrentPath().evalNative(path))) {
+      return meta->lastModified;
+    } else {
+      return kj::UNIX_EPOCH;
+    }
+  }
+
+  void runServerThread(jsg::V8System& v8System, config::Config::Reader config, uint threadIndex) {
+    // Runs an additional copy of the server on the current thread, with its own event loop. Used
+    // when `Config.threads` is greater than 1.
+
+    auto threadIo = kj::setupAsyncIo();
+    auto threadFs = kj::newDiskFilesystem();
+    EntropySourceImpl threadEntropySource;
+
+    Server threadServer(*threadFs, threadIo.provider->getTimer(),
+        threadIo.provider->getNetwork(), threadEntropySource, [](kj::String error) {
+      // The primary thread parsed the same config, so it already reported this error.
+      KJ_LOG(ERROR, error);
+    });
+
+    if (recordedOverrides.experimental) {
+      threadServer.allowExperimental();
+    }
+    for (auto& o: recordedOverrides.socketAddrs) {
+      threadServer.overrideSocket(kj::str(o.name), kj::str(o.value));
+    }
+    for (auto& o: recordedOverrides.socketFds) {
+      // All threads accept on the same inherited socket.
+      int fd;
+      KJ_SYSCALL(fd = dup(o.fd));
+      threadServer.overrideSocket(kj::str(o.name), threadIo.lowLevelProvider->wrapListenSocketFd(
+          fd, kj::LowLevelAsyncIoProvider::TAKE_OWNERSHIP));
+    }
+    for (auto& o: recordedOverrides.directories) {
+      threadServer.overrideDirectory(kj::str(o.name), kj::str(o.value));
+    }
+    for (auto& o: recordedOverrides.externals) {
+      threadServer.overrideExternal(kj::str(o.name), kj::str(o.value));
+    }
+    KJ_IF_MAYBE(path, recordedOverrides.codeCacheDirectory) {
+      threadServer.setCodeCacheDirectory(kj::str(*path));
+    }
+
+    threadServer.enableReusePort(*threadIo.lowLevelProvider, threadIndex);
+    threadServer.shareMetrics(kj::atomicAddRef(*metricsRegistry));
+    threadServer.shareActorPlacement(kj::atomicAddRef(*actorPlacement), *threadIo.lowLevelProvider,
+                                     threadIndex);
+    threadServer.run(v8System, config).wait(threadIo.waitScope);
+  }
+
   [[noreturn]] void reloadFromConfigChange() {
     // Write extra spaces to fully overwrite the line that we wrote earlier with a CR but no LF:
     //     "Noticed configuration change, reloading shortly...\r"
@@ -924,13 +1225,48 @@ private:
   kj::Vector<kj::Path> importPath;
   capnp::SchemaParser schemaParser;
   capnp::ParsedSchema parsedSchema;
-  kj::Vector<capnp::ConstSchema> topLevelConfigConstants;
 
   kj::Own<void> configOwner;  // backing object for `config`, if it's not `schemaParser`.
   kj::Maybe<config::Config::Reader> config;
 
+  kj::Maybe<kj::Path> configPath;
+  kj::Maybe<kj::String> constName;
+  // Where `config` came from, so that reloadConfig() can read it again. `configPath` is null if
+  // the config came from stdin or is compiled into the binary.
+
+  uint threadCount = 1;
+  kj::Date exeModified = kj::UNIX_EPOCH;
+
   kj::Vector<int> inheritedFds;
 
+  struct RecordedOverride {
+    kj::String name;
+    kj::String value;
+  };
+  struct RecordedFdOverride {
+    kj::String name;
+    int fd;
+  };
+  struct {
+    kj::Vector<RecordedOverride> socketAddrs;
+    kj::Vector<RecordedFdOverride> socketFds;
+    kj::Vector<RecordedOverride> directories;
+    kj::Vector<RecordedOverride> externals;
+    kj::Maybe<kj::String> codeCacheDirectory;
+    bool experimental = false;
+  } recordedOverrides;
+  // Command-line settings applied to `server`, recorded so they can be applied again to the
+  // Server instance of each additional thread. (The inspector is only enabled on the primary
+  // thread.)
+
+  kj::Own<const MetricsRegistry> metricsRegistry = kj::atomicRefcounted<MetricsRegistry>();
+  // Shared by the Server instances of all threads, so that a `metrics` service on any of them
+  // reports the whole process.
+
+  kj::Own<const ActorPlacement> actorPlacement;
+  // Shared by the Server instances of all threads, when there's more than one, to decide which
+  // thread each Durable Object lives on.
+
   Server server;
 
   static constexpr uint64_t COMPILED_MAGIC_SUFFIX[2] = {
@@ -995,20 +1331,16 @@ private:
       return *c;
     } else {
       // The optional `<const-name>` parameter must not have been given -- otherwise we would have
-      // a non-null `config` by this point. See if we can infer the correct constant...
-      if (topLevelConfigConstants.empty()) {
-        context.exitError(
-            "The config file does not define any top-level constants of type 'Config'.");
-      } else if (topLevelConfigConstants.size() == 1) {
-        return config.emplace(topLevelConfigConstants[0].as<config::Config>());
-      } else {
-        auto names = KJ_MAP(cnst, topLevelConfigConstants) {
-          return cnst.getShortDisplayName();
-        };
-        context.exitError(kj::str(
-            "The config file defines multiple top-level constants of type 'Config', so you must "
-            "specify which one to use. The options are: ", kj::strArray(names, ", ")));
+      // a non-null `config` by this point.
+      KJ_SWITCH_ONEOF(findConfig(parsedSchema, nullptr)) {
+        KJ_CASE_ONEOF(found, config::Config::Reader) {
+          return config.emplace(found);
+        }
+        KJ_CASE_ONEOF(error, kj::String) {
+          context.exitError(error);
+        }
       }
+      KJ_UNREACHABLE;
     }
   }
 
@@ -0,0 +1,72 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "base64.h"
+#include <kj/encoding.h>
+#include <kj/test.h>
+
+namespace workerd {
+namespace {
+
+kj::String decode(kj::StringPtr input, bool url = false) {
+  KJ_IF_MAYBE(decoded, base64Decode(input, url)) {
+    return kj::heapString(decoded->asChars());
+  }
+  return kj::str("(invalid)");
+}
+
+KJ_TEST("base64Encode() matches kj::encodeBase64()") {
+  kj::byte bytes[256];
+  for (uint i = 0; i < sizeof(bytes); i++) {
+    bytes[i] = i * 7 + 3;
+  }
+  for (size_t size = 0; size <= sizeof(bytes); size++) {
+    auto input = kj::arrayPtr(bytes, size);
+    auto encoded = base64Encode(input);
+    KJ_EXPECT(encoded == kj::encodeBase64(input), size);
+    KJ_EXPECT(encoded.size() == base64EncodedSize(size));
+
+    auto decoded = KJ_ASSERT_NONNULL(base64Decode(encoded));
+    KJ_EXPECT(decoded.asPtr() == input, size);
+  }
+
+  KJ_EXPECT(base64Encode("foobar"_kj.asBytes()) == "Zm9vYmFy");
+  KJ_EXPECT(base64Encode("fooba"_kj.asBytes()) == "Zm9vYmE=");
+  KJ_EXPECT(base64Encode("foob"_kj.asBytes()) == "Zm9vYg==");
+}
+
+KJ_TEST("base64Decode() is forgiving as atob() requires") {
+  KJ_EXPECT(decode("") == "");
+  KJ_EXPECT(decode("Zm9vYmFy") == "foobar");
+  KJ_EXPECT(decode("Zm9vYmE=") == "fooba");
+  KJ_EXPECT(decode("Zm9vYmE") == "fooba");
+  KJ_EXPECT(decode("Zm9vYg==") == "foob");
+  KJ_EXPECT(decode("Zm9vYg") == "foob");
+  KJ_EXPECT(decode(" Zm9v\tYm\nFy\r\f") == "foobar");
+  KJ_EXPECT(decode("Zm9v Yg =\n=") == "foob");
+
+  // Padding that doesn't complete the last group.
+  KJ_EXPECT(decode("Zm9vYg=") == "(invalid)");
+  KJ_EXPECT(decode("Zm9vYmE==") == "(invalid)");
+  KJ_EXPECT(decode("Zm9vY===") == "(invalid)");
+  KJ_EXPECT(decode("====") == "(invalid)");
+  // Data after padding.
+  KJ_EXPECT(decode("Zg==Zg==") == "(invalid)");
+  KJ_EXPECT(decode("Zm9=vYmFy") == "(invalid)");
+  // A single character left over.
+  KJ_EXPECT(decode("Zm9vY") == "(invalid)");
+  // Characters outside the alphabet.
+  KJ_EXPECT(decode("Zm9v\vYmFy") == "(invalid)");
+  KJ_EXPECT(decode("Zm9vYmF*") == "(invalid)");
+  KJ_EXPECT(decode("Zm9-") == "(invalid)");
+}
+
+KJ_TEST("base64Decode() accepts either alphabet for base64url") {
+  KJ_EXPECT(decode("-_-_", true) == decode("+/+/"));
+  KJ_EXPECT(decode("+/+/", true) == decode("+/+/"));
+  KJ_EXPECT(decode("-_8", true) == decode("+/8"));
+}
+
+}  // namespace
+}  // namespace workerd
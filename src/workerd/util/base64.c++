@@ -0,0 +1,166 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "base64.h"
+#include <kj/debug.h>
+#include <string.h>
+
+namespace workerd {
+
+namespace {
+
+constexpr char ALPHABET[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+struct EncodeTable {
+  // The two output characters for each 12-bit value.
+  char pairs[4096][2];
+
+  constexpr EncodeTable(): pairs() {
+    for (uint i = 0; i < 4096; i++) {
+      pairs[i][0] = ALPHABET[i >> 6];
+      pairs[i][1] = ALPHABET[i & 63];
+    }
+  }
+};
+constexpr EncodeTable ENCODE_TABLE;
+
+constexpr kj::byte INVALID = 0xff;
+constexpr kj::byte WHITESPACE = 0xfe;
+constexpr kj::byte PADDING = 0xfd;
+// Entries of DecodeTable other than 6-bit values. All of them have one of the top two bits set, so
+// a group of four characters can be checked at once by OR-ing their entries.
+
+struct DecodeTable {
+  kj::byte values[256];
+
+  constexpr explicit DecodeTable(bool url): values() {
+    for (auto& value: values) value = INVALID;
+    for (uint i = 0; i < 64; i++) {
+      values[kj::byte(ALPHABET[i])] = i;
+    }
+    if (url) {
+      values['-'] = 62;
+      values['_'] = 63;
+    }
+    for (char c: {'\t', '\n', '\f', '\r', ' '}) {
+      values[kj::byte(c)] = WHITESPACE;
+    }
+    values['='] = PADDING;
+  }
+};
+constexpr DecodeTable DECODE_TABLE(false);
+constexpr DecodeTable DECODE_URL_TABLE(true);
+
+}  // namespace
+
+void base64Encode(kj::ArrayPtr<const kj::byte> input, kj::ArrayPtr<char> output) {
+  KJ_REQUIRE(output.size() == base64EncodedSize(input.size()));
+
+  const kj::byte* in = input.begin();
+  char* out = output.begin();
+  size_t remaining = input.size();
+  for (; remaining >= 3; remaining -= 3, in += 3, out += 4) {
+    uint32_t bits = (uint32_t(in[0]) << 16) | (uint32_t(in[1]) << 8) | in[2];
+    memcpy(out, ENCODE_TABLE.pairs[bits >> 12], 2);
+    memcpy(out + 2, ENCODE_TABLE.pairs[bits & 0xfff], 2);
+  }
+
+  if (remaining > 0) {
+    uint32_t bits = uint32_t(in[0]) << 16;
+    if (remaining == 2) bits |= uint32_t(in[1]) << 8;
+    out[0] = ALPHABET[bits >> 18];
+    out[1] = ALPHABET[(bits >> 12) & 63];
+    out[2] = remaining == 2 ? ALPHABET[(bits >> 6) & 63] : '=';
+    out[3] = '=';
+  }
+}
+
+kj::String base64Encode(kj::ArrayPtr<const kj::byte> input) {
+  auto result = kj::heapString(base64EncodedSize(input.size()));
+  base64Encode(input, result.asArray());
+  return result;
+}
+
+kj::Maybe<size_t> base64Decode(kj::ArrayPtr<const char> input, kj::ArrayPtr<kj::byte> output,
+                               bool url) {
+  KJ_REQUIRE(output.size() >= base64DecodedSizeLimit(input.size()));
+
+  auto& table = (url ? DECODE_URL_TABLE : DECODE_TABLE).values;
+  const kj::byte* in = input.asBytes().begin();
+  const kj::byte* end = input.asBytes().end();
+  kj::byte* out = output.begin();
+
+  // Fast path: whole groups of four characters from the alphabet.
+  while (end - in >= 4) {
+    kj::byte a = table[in[0]], b = table[in[1]], c = table[in[2]], d = table[in[3]];
+    if ((a | b | c | d) & 0xc0) break;
+    uint32_t bits = (uint32_t(a) << 18) | (uint32_t(b) << 12) | (uint32_t(c) << 6) | d;
+    out[0] = bits >> 16;
+    out[1] = bits >> 8;
+    out[2] = bits;
+    in += 4;
+    out += 3;
+  }
+
+  // General path, for the rest. `group` counts the characters of the group in progress.
+  uint32_t bits = 0;
+  uint group = 0;
+  uint padding = 0;
+  for (; in < end; ++in) {
+    kj::byte value = table[*in];
+    if (value < 64) {
+      // Padding must come last.
+      if (padding > 0) return nullptr;
+      bits = (bits << 6) | value;
+      if (++group == 4) {
+        out[0] = bits >> 16;
+        out[1] = bits >> 8;
+        out[2] = bits;
+        out += 3;
+        bits = 0;
+        group = 0;
+      }
+    } else if (value == WHITESPACE) {
+      continue;
+    } else if (value == PADDING) {
+      if (++padding > 2) return nullptr;
+    } else {
+      return nullptr;
+    }
+  }
+
+  if (padding > 0 && group + padding != 4) {
+    return nullptr;
+  }
+  switch (group) {
+    case 0:
+      break;
+    case 1:
+      // Six bits don't make a byte.
+      return nullptr;
+    case 2:
+      *out++ = bits >> 4;
+      break;
+    case 3:
+      *out++ = bits >> 10;
+      *out++ = bits >> 2;
+      break;
+  }
+
+  return size_t(out - output.begin());
+}
+
+kj::Maybe<kj::Array<kj::byte>> base64Decode(kj::ArrayPtr<const char> input, bool url) {
+  auto buffer = kj::heapArray<kj::byte>(base64DecodedSizeLimit(input.size()));
+  KJ_IF_MAYBE(size, base64Decode(input, buffer, url)) {
+    if (*size == buffer.size()) {
+      return kj::mv(buffer);
+    }
+    return kj::heapArray(buffer.slice(0, *size));
+  }
+  return nullptr;
+}
+
+}  // namespace workerd
@@ -0,0 +1,39 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#pragma once
+
+#include <kj/array.h>
+#include <kj/string.h>
+
+namespace workerd {
+
+// Base64 codecs for hot paths such as atob() and btoa(). These produce the same results as
+// kj::encodeBase64() and kj::decodeBase64(), but encode through a table of pairs of output
+// characters, 12 bits at a time, and decode whole groups of four characters at a time until
+// they come across whitespace or padding. The slower, general path only runs from there on.
+
+constexpr size_t base64EncodedSize(size_t size) { return (size + 2) / 3 * 4; }
+
+void base64Encode(kj::ArrayPtr<const kj::byte> input, kj::ArrayPtr<char> output);
+// Writes the padded base64 encoding of `input`, using the standard alphabet, into `output`, which
+// must be exactly `base64EncodedSize(input.size())` long.
+
+kj::String base64Encode(kj::ArrayPtr<const kj::byte> input);
+
+constexpr size_t base64DecodedSizeLimit(size_t size) { return size / 4 * 3 + 2; }
+// How much space base64Decode() can need at most for `size` characters.
+
+kj::Maybe<size_t> base64Decode(kj::ArrayPtr<const char> input, kj::ArrayPtr<kj::byte> output,
+                               bool url = false);
+// Decodes `input` into `output`, which must be at least `base64DecodedSizeLimit(input.size())`
+// long, and returns the number of bytes written. Follows the WHATWG "forgiving-base64 decode"
+// algorithm, as atob() requires: ASCII whitespace is ignored, padding is optional but, if
+// present, must bring the length to a multiple of four, and anything else outside the alphabet
+// is an error, in which case this returns null. With `url`, '-' and '_' are accepted as well as
+// '+' and '/'.
+
+kj::Maybe<kj::Array<kj::byte>> base64Decode(kj::ArrayPtr<const char> input, bool url = false);
+
+}  // namespace workerd
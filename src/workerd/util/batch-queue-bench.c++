@@ -0,0 +1,90 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+// Contention benchmarks for BatchQueue wrapped in a kj::MutexGuarded, and for
+// ConcurrentBatchQueue. Several producer threads push as fast as they can while the main thread
+// pops batches, as happens when many threads hand work to one.
+//
+// Run with `bazel run -c opt //src/workerd/util:batch-queue-bench`. Results are written to stdout
+// as JSON lines; see benchmark.h.
+
+#include "batch-queue.h"
+#include "benchmark.h"
+#include <kj/mutex.h>
+#include <kj/thread.h>
+
+namespace workerd {
+namespace {
+
+constexpr uint INITIAL_CAPACITY = 64, MAX_CAPACITY = 4096;
+constexpr uint PUSHES_PER_PRODUCER = 1'000'000;
+
+struct MutexQueue {
+  kj::MutexGuarded<BatchQueue<uint64_t>> queue { INITIAL_CAPACITY, MAX_CAPACITY };
+
+  void push(uint64_t value) { queue.lockExclusive()->push(value); }
+
+  uint64_t drain() {
+    // Pops one batch and returns how many elements it had.
+    auto batch = queue.lockExclusive()->pop();
+    return batch.asArrayPtr().size();
+  }
+};
+
+struct ConcurrentQueue {
+  ConcurrentBatchQueue<uint64_t> queue { INITIAL_CAPACITY, MAX_CAPACITY };
+
+  void push(uint64_t value) { queue.push(value); }
+
+  uint64_t drain() {
+    auto batch = queue.pop();
+    return batch.asArrayPtr().size();
+  }
+};
+
+template <typename Queue>
+void benchmarkContention(kj::StringPtr name, uint producers) {
+  // Total throughput of `producers` threads pushing while one thread pops. The clock stops once
+  // the consumer has seen every element.
+
+  Queue queue;
+  uint64_t total = uint64_t(producers) * PUSHES_PER_PRODUCER;
+  uint64_t batches = 0;
+
+  auto elapsed = timeBenchmark([&]() {
+    kj::Vector<kj::Own<kj::Thread>> threads;
+    for (uint p = 0; p < producers; ++p) {
+      threads.add(kj::heap<kj::Thread>([&queue]() {
+        for (uint i = 0; i < PUSHES_PER_PRODUCER; ++i) {
+          queue.push(i);
+        }
+      }));
+    }
+
+    uint64_t received = 0;
+    while (received < total) {
+      auto n = queue.drain();
+      received += n;
+      batches += n > 0;
+    }
+  });
+
+  reportBenchmark(name, total, elapsed, {
+    {"producers", double(producers)},
+    {"meanBatchSize", batches == 0 ? 0 : double(total) / batches},
+  });
+}
+
+}  // namespace
+}  // namespace workerd
+
+int main() {
+  using namespace workerd;
+
+  for (uint producers: {1, 2, 4, 8}) {
+    benchmarkContention<MutexQueue>("batch-queue/mutex", producers);
+    benchmarkContention<ConcurrentQueue>("batch-queue/concurrent", producers);
+  }
+  return 0;
+}
@@ -4,6 +4,7 @@
 
 #include "batch-queue.h"
 #include <kj/test.h>
+#include <kj/thread.h>
 
 namespace workerd {
 namespace {
@@ -97,5 +98,109 @@ KJ_TEST("BatchQueue reconstructs buffers if they grow above maxCapacity") {
   KJ_EXPECT(buffer1.begin() == buffer3.begin());
 }
 
+// =======================================================================================
+// ConcurrentBatchQueue
+
+KJ_TEST("ConcurrentBatchQueue basic operations") {
+  ConcurrentBatchQueue<int> batchQueue { INITIAL_CAPACITY, MAX_CAPACITY };
+
+  KJ_EXPECT(batchQueue.empty());
+  KJ_EXPECT(batchQueue.size() == 0);
+  KJ_EXPECT(batchQueue.pop().asArrayPtr().size() == 0);
+
+  for (auto i = 1; i <= 3; ++i) {
+    batchQueue.push(i);
+  }
+  KJ_EXPECT(!batchQueue.empty());
+  KJ_EXPECT(batchQueue.size() == 3);
+
+  // Pushes come out in order.
+  int count = 0;
+  for (auto item: batchQueue.pop().asArrayPtr()) {
+    KJ_EXPECT(item == ++count);
+  }
+  KJ_EXPECT(count == 3);
+  KJ_EXPECT(batchQueue.empty());
+  KJ_EXPECT(batchQueue.size() == 0);
+}
+
+KJ_TEST("ConcurrentBatchQueue destroys elements with the Batch, or with the queue") {
+  struct DestructionDetector {
+    DestructionDetector(uint& count): count(count) {}
+    ~DestructionDetector() noexcept(false) { ++count; }
+    KJ_DISALLOW_COPY_AND_MOVE(DestructionDetector);
+    uint& count;
+  };
+
+  uint count = 0;
+  {
+    ConcurrentBatchQueue<kj::Own<DestructionDetector>> batchQueue {
+        INITIAL_CAPACITY, MAX_CAPACITY };
+    batchQueue.push(kj::heap<DestructionDetector>(count));
+    {
+      auto batch = batchQueue.pop();
+      KJ_EXPECT(count == 0);
+
+      // Pushes are allowed while a Batch is held.
+      batchQueue.push(kj::heap<DestructionDetector>(count));
+      KJ_EXPECT_THROW_MESSAGE("pop()'s previous result not yet destroyed", batchQueue.pop());
+    }
+    KJ_EXPECT(count == 1);
+  }
+  KJ_EXPECT(count == 2);
+}
+
+KJ_TEST("ConcurrentBatchQueue reconstructs its pop buffer if it grows above maxCapacity") {
+  ConcurrentBatchQueue<int> batchQueue { INITIAL_CAPACITY, MAX_CAPACITY };
+
+  batchQueue.push(123);
+  auto buffer0 = batchQueue.pop().asArrayPtr();
+  batchQueue.push(123);
+  auto buffer1 = batchQueue.pop().asArrayPtr();
+  KJ_EXPECT(buffer0.begin() == buffer1.begin());
+
+  for (auto i = 0; i < MAX_CAPACITY + 1; ++i) {
+    batchQueue.push(i);
+  }
+  KJ_EXPECT(batchQueue.pop().asArrayPtr().size() == size_t(MAX_CAPACITY + 1));
+  batchQueue.push(123);
+  auto buffer2 = batchQueue.pop().asArrayPtr();
+  KJ_EXPECT(buffer0.begin() != buffer2.begin());
+}
+
+KJ_TEST("ConcurrentBatchQueue takes pushes from many threads") {
+  constexpr uint THREADS = 4, PUSHES_PER_THREAD = 50'000;
+  ConcurrentBatchQueue<uint> batchQueue { INITIAL_CAPACITY, MAX_CAPACITY };
+
+  std::atomic<uint> done = 0;
+  kj::Vector<kj::Own<kj::Thread>> producers;
+  for (uint t = 0; t < THREADS; ++t) {
+    producers.add(kj::heap<kj::Thread>([&batchQueue, &done, t]() {
+      for (uint i = 0; i < PUSHES_PER_THREAD; ++i) {
+        batchQueue.push(t * PUSHES_PER_THREAD + i);
+      }
+      done.fetch_add(1);
+    }));
+  }
+
+  // Each producer's elements must arrive exactly once, and in the order it pushed them.
+  auto next = kj::heapArray<uint>(THREADS);
+  for (auto& n: next) n = 0;
+  uint received = 0;
+  for (;;) {
+    bool finished = done.load() == THREADS;
+    for (auto item: batchQueue.pop().asArrayPtr()) {
+      auto t = item / PUSHES_PER_THREAD;
+      KJ_ASSERT(item % PUSHES_PER_THREAD == next[t]++, item);
+      ++received;
+    }
+    if (finished) break;
+  }
+
+  KJ_EXPECT(received == THREADS * PUSHES_PER_THREAD);
+  KJ_EXPECT(batchQueue.empty());
+  producers.clear();
+}
+
 }  // namespace
 }  // namespace workerd
@@ -6,6 +6,7 @@
 
 #include <kj/debug.h>
 #include <kj/vector.h>
+#include <atomic>
 #include <utility>
 
 namespace workerd {
@@ -25,7 +26,8 @@ class BatchQueue {
   // high and/or when you must be able to gracefully handle bursts of pushes, such as when
   // transferring objects between threads. Note that this class implements no cross-thread
   // synchronization itself, but it can become an effective multiple-producer, single-consumer queue
-  // when wrapped as a `kj::MutexGuarded<BatchQueue<T>>`.
+  // when wrapped as a `kj::MutexGuarded<BatchQueue<T>>`. If many threads push, consider
+  // ConcurrentBatchQueue, below, whose pushes don't take a lock.
 
 public:
   explicit BatchQueue(uint initialCapacity, uint maxCapacity)
@@ -109,6 +111,92 @@ private:
   uint maxCapacity;
 };
 
+template <typename T>
+class ConcurrentBatchQueue {
+  // A multiple-producer, single-consumer version of BatchQueue, whose `push()` is lock-free and
+  // may be called from any thread without synchronization. `pop()` and Batch work as in
+  // BatchQueue, but must only ever be used by one thread at a time (the consumer).
+  //
+  // Pushed elements are linked into an intrusive stack with a compare-and-swap. `pop()` takes the
+  // whole stack with a single atomic exchange and moves it, in push order, into the pop buffer,
+  // which is the only buffer that is reused. Since the consumer always takes every element, never
+  // just one, the stack is immune to the ABA problem, and nodes need no deferred reclamation.
+  //
+  // Each push allocates a node, so for a queue pushed to from only one thread (or rarely
+  // contended) a mutex-guarded BatchQueue, which amortizes allocation, is likely faster.
+
+public:
+  explicit ConcurrentBatchQueue(uint initialCapacity, uint maxCapacity)
+      : popBuffer(initialCapacity),
+        initialCapacity(initialCapacity),
+        maxCapacity(maxCapacity) {}
+  // As for BatchQueue, except that only the pop buffer is preallocated.
+
+  ~ConcurrentBatchQueue() noexcept(false);
+  KJ_DISALLOW_COPY_AND_MOVE(ConcurrentBatchQueue);
+
+  class Batch {
+    // The return type of `pop()`. As BatchQueue::Batch.
+
+  public:
+    Batch() = default;
+    Batch(Batch&&) = default;
+    Batch& operator=(Batch&&) = default;
+    ~Batch() noexcept(false);
+    KJ_DISALLOW_COPY(Batch);
+
+    operator kj::ArrayPtr<T>() {
+      return batchQueue
+          .map([](auto& bq) -> kj::ArrayPtr<T> { return bq.popBuffer; })
+          .orDefault(nullptr);
+    }
+
+    kj::ArrayPtr<T> asArrayPtr() { return *this; }
+
+  private:
+    explicit Batch(ConcurrentBatchQueue& batchQueue): batchQueue(batchQueue) {}
+    friend ConcurrentBatchQueue;
+
+    kj::Maybe<ConcurrentBatchQueue<T>&> batchQueue;
+  };
+
+  Batch pop();
+  // Takes everything pushed so far, in push order, as a Batch. Throws if the previous Batch
+  // hasn't been destroyed yet, as BatchQueue does. Only the consumer may call this.
+
+  template <typename U>
+  void push(U&& value) {
+    // Add an item to the current batch. Safe to call from any thread.
+
+    // Count first, so that pop() never subtracts an element that hasn't been counted yet.
+    count.fetch_add(1, std::memory_order_relaxed);
+    auto node = new Node { T(kj::fwd<U>(value)), head.load(std::memory_order_relaxed) };
+    while (!head.compare_exchange_weak(node->next, node,
+        std::memory_order_release, std::memory_order_relaxed)) {}
+  }
+
+  bool empty() const { return head.load(std::memory_order_relaxed) == nullptr; }
+  size_t size() const { return count.load(std::memory_order_relaxed); }
+  // Number of elements pushed and not yet popped. Only a snapshot when other threads are pushing,
+  // and `size()` may briefly count an element which `empty()` and `pop()` don't see yet.
+
+private:
+  struct Node {
+    T value;
+    Node* next;
+  };
+
+  std::atomic<Node*> head = nullptr;
+  // The most recently pushed element.
+  std::atomic<size_t> count = 0;
+
+  kj::Vector<T> popBuffer;
+  uint initialCapacity;
+  uint maxCapacity;
+
+  static void deleteList(Node* node);
+};
+
 // =======================================================================================
 // Inline implementation details
 
@@ -123,4 +211,62 @@ BatchQueue<T>::Batch::~Batch() noexcept(false) {
   }
 }
 
+template <typename T>
+ConcurrentBatchQueue<T>::~ConcurrentBatchQueue() noexcept(false) {
+  deleteList(head.exchange(nullptr, std::memory_order_acquire));
+}
+
+template <typename T>
+void ConcurrentBatchQueue<T>::deleteList(Node* node) {
+  while (node != nullptr) {
+    auto next = node->next;
+    delete node;
+    node = next;
+  }
+}
+
+template <typename T>
+typename ConcurrentBatchQueue<T>::Batch ConcurrentBatchQueue<T>::pop() {
+  KJ_REQUIRE(popBuffer.empty(), "pop()'s previous result not yet destroyed.");
+
+  Batch batch;
+
+  // The acquire pairs with the release in push(), making the nodes' contents visible.
+  auto list = head.exchange(nullptr, std::memory_order_acquire);
+  if (list != nullptr) {
+    // The stack is newest-first, so reverse it.
+    Node* oldest = nullptr;
+    size_t n = 0;
+    while (list != nullptr) {
+      auto next = list->next;
+      list->next = oldest;
+      oldest = list;
+      list = next;
+      ++n;
+    }
+    count.fetch_sub(n, std::memory_order_relaxed);
+
+    popBuffer.reserve(n);
+    for (auto node = oldest; node != nullptr; node = node->next) {
+      popBuffer.add(kj::mv(node->value));
+    }
+    deleteList(oldest);
+
+    batch = Batch(*this);
+  }
+
+  return batch;
+}
+
+template <typename T>
+ConcurrentBatchQueue<T>::Batch::~Batch() noexcept(false) {
+  KJ_IF_MAYBE(bq, batchQueue) {
+    bq->popBuffer.clear();
+    if (auto capacity = bq->popBuffer.capacity(); capacity > bq->maxCapacity) {
+      // Reset the queue to avoid letting it grow unbounded.
+      bq->popBuffer = kj::Vector<T>(bq->initialCapacity);
+    }
+  }
+}
+
 }  // namespace workerd
@@ -0,0 +1,50 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#pragma once
+
+#include <kj/io.h>
+#include <kj/string.h>
+#include <kj/time.h>
+#include <kj/vector.h>
+#include <unistd.h>
+
+namespace workerd {
+
+struct BenchmarkParam {
+  kj::StringPtr name;
+  double value;
+};
+
+template <typename Func>
+kj::Duration timeBenchmark(Func&& func) {
+  // Returns how long `func()` took to run.
+
+  auto& clock = kj::systemPreciseMonotonicClock();
+  auto start = clock.now();
+  func();
+  return clock.now() - start;
+}
+
+inline void reportBenchmark(kj::StringPtr name, uint64_t ops, kj::Duration elapsed,
+                            kj::ArrayPtr<const BenchmarkParam> params = nullptr) {
+  // Writes one result to stdout as a line of JSON, e.g.:
+  //
+  //     {"benchmark":"actor-cache/get","params":{"hitRatio":0.9},"ops":100000,
+  //      "nanos":51200000,"nanosPerOp":512,"opsPerSecond":1953125}
+  //
+  // (but all on one line), so that results from different builds can be compared by a script.
+  // `name` and the parameter names are not escaped, so they must not contain quotes.
+
+  auto nanos = elapsed / kj::NANOSECONDS;
+  auto paramStrs = KJ_MAP(param, params) { return kj::str('"', param.name, "\":", param.value); };
+  auto line = kj::str(
+      "{\"benchmark\":\"", name, "\",\"params\":{", kj::strArray(paramStrs, ","), "},"
+      "\"ops\":", ops, ",\"nanos\":", nanos,
+      ",\"nanosPerOp\":", ops == 0 ? 0 : double(nanos) / ops,
+      ",\"opsPerSecond\":", nanos == 0 ? 0 : ops * 1e9 / nanos, "}\n");
+  kj::FdOutputStream(STDOUT_FILENO).write(line.begin(), line.size());
+}
+
+}  // namespace workerd
@@ -0,0 +1,63 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "random.h"
+#include <kj/test.h>
+#include <kj/vector.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace workerd {
+namespace {
+
+KJ_TEST("randomBytes doesn't repeat itself") {
+  // Enough small requests to go through several refills of the pool, and some big ones.
+  kj::Vector<kj::Array<kj::byte>> seen;
+  for (size_t size: {16, 16, 7, 1000, 3, 256, 257, 16}) {
+    for (auto i KJ_UNUSED: kj::zeroTo(200)) {
+      auto bytes = kj::heapArray<kj::byte>(size);
+      bytes.asPtr().fill(0);
+      randomBytes(bytes);
+      if (size >= 16) {
+        for (auto& other: seen) {
+          KJ_ASSERT(other.asPtr() != bytes.asPtr());
+        }
+        seen.add(kj::mv(bytes));
+      }
+    }
+  }
+}
+
+KJ_TEST("randomBytes in a forked child differs from the parent") {
+  kj::byte parent[16];
+  randomBytes(parent);
+
+  int fds[2];
+  KJ_SYSCALL(pipe(fds));
+  pid_t pid;
+  KJ_SYSCALL(pid = fork());
+  if (pid == 0) {
+    kj::byte child[16];
+    randomBytes(child);
+    ssize_t n = write(fds[1], child, sizeof(child));
+    _exit(n == sizeof(child) ? 0 : 1);
+  }
+  close(fds[1]);
+
+  kj::byte child[16];
+  ssize_t n;
+  KJ_SYSCALL(n = read(fds[0], child, sizeof(child)));
+  close(fds[0]);
+  int status;
+  KJ_SYSCALL(waitpid(pid, &status, 0));
+  KJ_ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  KJ_ASSERT(n == sizeof(child));
+
+  // Without discarding its pool, the child would hand out exactly what the parent does next.
+  randomBytes(parent);
+  KJ_EXPECT(kj::arrayPtr(parent, sizeof(parent)) != kj::arrayPtr(child, sizeof(child)));
+}
+
+}  // namespace
+}  // namespace workerd
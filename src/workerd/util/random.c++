@@ -0,0 +1,73 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "random.h"
+#include <openssl/mem.h>
+#include <openssl/rand.h>
+#include <kj/debug.h>
+#include <atomic>
+#include <pthread.h>
+#include <string.h>
+
+namespace workerd {
+
+using kj::uint;
+
+namespace {
+
+constexpr size_t POOL_SIZE = 4096;
+constexpr size_t MAX_POOLED_REQUEST = 256;
+// Larger requests go straight to RAND_bytes(), which amortizes its own overhead on them.
+
+std::atomic<uint> forkGeneration = 0;
+// Bumped in the child of every fork(). Pools filled in an earlier generation are stale.
+
+struct Pool {
+  kj::byte bytes[POOL_SIZE];
+  size_t available = 0;
+  // The unused bytes are the last `available` of `bytes`.
+  uint generation = 0;
+
+  ~Pool() noexcept(false) {
+    OPENSSL_cleanse(bytes, sizeof(bytes));
+  }
+
+  void refill() {
+    static const bool registered = []() {
+      KJ_ASSERT(pthread_atfork(nullptr, nullptr, []() {
+        forkGeneration.fetch_add(1, std::memory_order_relaxed);
+      }) == 0);
+      return true;
+    }();
+    (void)registered;
+
+    generation = forkGeneration.load(std::memory_order_relaxed);
+    KJ_ASSERT(RAND_bytes(bytes, sizeof(bytes)) == 1);
+    available = sizeof(bytes);
+  }
+};
+
+thread_local Pool pool;
+
+}  // namespace
+
+void randomBytes(kj::ArrayPtr<kj::byte> buffer) {
+  if (buffer.size() > MAX_POOLED_REQUEST) {
+    KJ_ASSERT(RAND_bytes(buffer.begin(), buffer.size()) == 1);
+    return;
+  }
+
+  auto& p = pool;
+  if (p.available < buffer.size() ||
+      p.generation != forkGeneration.load(std::memory_order_relaxed)) {
+    p.refill();
+  }
+
+  kj::byte* start = p.bytes + (POOL_SIZE - p.available);
+  memcpy(buffer.begin(), start, buffer.size());
+  OPENSSL_cleanse(start, buffer.size());
+  p.available -= buffer.size();
+}
+
+}  // namespace workerd
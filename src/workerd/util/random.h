@@ -0,0 +1,18 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#pragma once
+
+#include <kj/common.h>
+
+namespace workerd {
+
+void randomBytes(kj::ArrayPtr<kj::byte> buffer);
+// Fills `buffer` with cryptographically secure random bytes, like BoringSSL's RAND_bytes(), which
+// produces them. Small requests -- UUIDs, IDs, a getRandomValues() of a few words -- are served
+// from a per-thread pool refilled a few kilobytes at a time, so that each costs a copy rather
+// than a trip through the RNG. Bytes are wiped from the pool once handed out, and a process that
+// forks discards its pools, so the child never repeats the parent's output.
+
+}  // namespace workerd
@@ -0,0 +1,61 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "thread-pool.h"
+#include <kj/test.h>
+
+namespace workerd {
+namespace {
+
+KJ_TEST("ThreadPool runs work off the calling thread") {
+  kj::EventLoop loop;
+  kj::WaitScope waitScope(loop);
+
+  ThreadPool pool(2);
+
+  auto promise = pool.run([]() {
+    // The pool's threads have no event loop of their own.
+    KJ_EXPECT(kj::runCatchingExceptions([]() { kj::getCurrentThreadExecutor(); }) != nullptr);
+    return kj::str("done");
+  });
+  KJ_EXPECT(promise.wait(waitScope) == "done");
+
+  int value = 0;
+  pool.run([&value]() { value = 123; }).wait(waitScope);
+  KJ_EXPECT(value == 123);
+}
+
+KJ_TEST("ThreadPool propagates exceptions") {
+  kj::EventLoop loop;
+  kj::WaitScope waitScope(loop);
+
+  ThreadPool pool(1);
+  KJ_EXPECT_THROW_MESSAGE("oops", pool.run([]() -> int {
+    KJ_FAIL_REQUIRE("oops");
+  }).wait(waitScope));
+}
+
+KJ_TEST("ThreadPool skips work whose promise was canceled") {
+  kj::EventLoop loop;
+  kj::WaitScope waitScope(loop);
+
+  ThreadPool pool(1);
+
+  // Keep the only thread busy until we say so.
+  kj::MutexGuarded<bool> release(false);
+  auto blocker = pool.run([&release]() {
+    release.when([](bool r) { return r; }, [](bool&) {});
+  });
+
+  bool ran = false;
+  pool.run([&ran]() { ran = true; });  // canceled right away
+
+  *release.lockExclusive() = true;
+  blocker.wait(waitScope);
+  pool.run([]() {}).wait(waitScope);
+  KJ_EXPECT(!ran);
+}
+
+}  // namespace
+}  // namespace workerd
@@ -0,0 +1,48 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "thread-pool.h"
+
+namespace workerd {
+
+ThreadPool::ThreadPool(uint threadCount) {
+  KJ_REQUIRE(threadCount > 0);
+  auto builder = kj::heapArrayBuilder<kj::Own<kj::Thread>>(threadCount);
+  for (auto i KJ_UNUSED: kj::zeroTo(threadCount)) {
+    builder.add(kj::heap<kj::Thread>([this]() { threadMain(); }));
+  }
+  threads = builder.finish();
+}
+
+ThreadPool::~ThreadPool() noexcept(false) {
+  // The threads finish whatever work is still queued, then are joined when `threads` is
+  // destroyed, right after this.
+  state.lockExclusive()->shutdown = true;
+}
+
+void ThreadPool::add(kj::Function<void()> task) {
+  auto lock = state.lockExclusive();
+  KJ_REQUIRE(!lock->shutdown, "thread pool is shutting down");
+  lock->queue.push_back(kj::mv(task));
+}
+
+void ThreadPool::threadMain() {
+  for (;;) {
+    kj::Maybe<kj::Function<void()>> task;
+    state.when([](const State& s) { return s.shutdown || !s.queue.empty(); }, [&](State& s) {
+      if (!s.queue.empty()) {
+        task = kj::mv(s.queue.front());
+        s.queue.pop_front();
+      }
+    });
+
+    KJ_IF_MAYBE(t, task) {
+      (*t)();
+    } else {
+      return;
+    }
+  }
+}
+
+}  // namespace workerd
@@ -0,0 +1,74 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#pragma once
+
+#include <kj/async.h>
+#include <kj/function.h>
+#include <kj/mutex.h>
+#include <kj/thread.h>
+#include <deque>
+
+namespace workerd {
+
+using kj::uint;
+
+class ThreadPool {
+  // A fixed set of background threads that run CPU-heavy work handed to them by event loop
+  // threads, so that the handing thread can get on with other things in the meantime. Work runs
+  // in the order it was handed over, as soon as a thread is free.
+
+public:
+  explicit ThreadPool(uint threadCount);
+  ~ThreadPool() noexcept(false);
+  KJ_DISALLOW_COPY_AND_MOVE(ThreadPool);
+
+  template <typename Func>
+  kj::Promise<kj::_::ReturnType<Func, void>> run(Func&& func);
+  // Runs `func()` on one of the pool's threads, returning a promise for its result in the calling
+  // thread, which must have a KJ event loop. `func`, whatever it captures, and its result must all
+  // be safe to hand from one thread to another.
+  //
+  // If the promise is canceled before `func` has started, it doesn't run at all; if it's canceled
+  // while `func` is running, `func` carries on and its result is discarded, on the pool's thread.
+  // Either way `func` is destroyed on the pool's thread, so it should own anything it touches.
+
+private:
+  struct State {
+    std::deque<kj::Function<void()>> queue;
+    bool shutdown = false;
+  };
+  kj::MutexGuarded<State> state;
+
+  kj::Array<kj::Own<kj::Thread>> threads;
+  // Declared last so that everything the threads use is initialized first.
+
+  void add(kj::Function<void()> task);
+  void threadMain();
+};
+
+// =======================================================================================
+// inline implementation details
+
+template <typename Func>
+kj::Promise<kj::_::ReturnType<Func, void>> ThreadPool::run(Func&& func) {
+  using T = kj::_::ReturnType<Func, void>;
+  auto paf = kj::newPromiseAndCrossThreadFulfiller<T>();
+  add([func = kj::fwd<Func>(func), fulfiller = kj::mv(paf.fulfiller)]() mutable {
+    if (!fulfiller->isWaiting()) return;
+    KJ_IF_MAYBE(exception, kj::runCatchingExceptions([&]() {
+      if constexpr (kj::isSameType<T, void>()) {
+        func();
+        fulfiller->fulfill();
+      } else {
+        fulfiller->fulfill(func());
+      }
+    })) {
+      fulfiller->reject(kj::mv(*exception));
+    }
+  });
+  return kj::mv(paf.promise);
+}
+
+}  // namespace workerd
@@ -0,0 +1,143 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+// Benchmarks TimerWheel against the kj::TreeMap keyed on (time, tiebreaker) that
+// IoContext::TimeoutManagerImpl used before it, with the timer counts a busy isolate sees:
+//
+// - schedule-cancel: timers that are cleared before they fire, as most setTimeout()s guarding a
+//   fetch() are.
+// - schedule-fire: timers that all fire, in order.
+//
+// As in TimeoutManagerImpl, each wheel timer is its own heap object.
+//
+// Run with `bazel run -c opt //src/workerd/util:timer-wheel-bench`. Results are written to stdout
+// as JSON lines; see benchmark.h.
+
+#include "timer-wheel.h"
+#include "benchmark.h"
+#include <kj/map.h>
+#include <random>
+
+namespace workerd {
+namespace {
+
+constexpr uint64_t TIMERS_PER_RUN = 1'000'000;
+constexpr uint64_t HORIZON = 60'000;
+// Timers are due up to a minute out, in milliseconds.
+
+struct WheelTimers {
+  using Wheel = TimerWheel<uint>;
+
+  Wheel wheel;
+  kj::Vector<kj::Own<Wheel::Timer>> timers;
+
+  void schedule(uint64_t tick, uint id) {
+    timers.add(kj::heap<Wheel::Timer>(wheel, wheel.getCurrentTick() + tick, id));
+  }
+
+  void cancelAll() {
+    timers.clear();
+  }
+
+  uint64_t fireAll() {
+    uint64_t sum = 0;
+    wheel.advanceTo(wheel.getCurrentTick() + HORIZON, [&](Wheel::Timer& timer) {
+      sum += timer.value;
+    });
+    timers.clear();
+    return sum;
+  }
+};
+
+struct TreeMapTimers {
+  struct TimeoutTime {
+    uint64_t when;
+    uint tiebreaker;
+    inline bool operator<(const TimeoutTime& other) const {
+      if (when < other.when) return true;
+      if (when > other.when) return false;
+      return tiebreaker < other.tiebreaker;
+    }
+    inline bool operator==(const TimeoutTime& other) const {
+      return when == other.when && tiebreaker == other.tiebreaker;
+    }
+  };
+
+  kj::TreeMap<TimeoutTime, uint> timeoutTimes;
+  kj::Vector<TimeoutTime> keys;
+  uint tiebreaker = 0;
+
+  void schedule(uint64_t tick, uint id) {
+    TimeoutTime key { tick, tiebreaker++ };
+    timeoutTimes.insert(key, id);
+    keys.add(key);
+  }
+
+  void cancelAll() {
+    // One erase per timer, as each timer's promise did on destruction.
+    for (auto& key: keys) {
+      timeoutTimes.erase(key);
+    }
+    keys.clear();
+  }
+
+  uint64_t fireAll() {
+    uint64_t sum = 0;
+    while (timeoutTimes.size() > 0) {
+      auto& entry = *timeoutTimes.begin();
+      sum += entry.value;
+      auto key = entry.key;
+      timeoutTimes.erase(key);
+    }
+    keys.clear();
+    return sum;
+  }
+};
+
+template <typename Timers>
+void benchmarkTimers(kj::StringPtr name, uint64_t live, bool fire) {
+  // Schedules `live` timers at random ticks, then cancels or fires them all, repeating until
+  // TIMERS_PER_RUN timers have gone through.
+
+  std::mt19937_64 rng(live);
+  std::uniform_int_distribution<uint64_t> ticks(1, HORIZON);
+  auto rounds = TIMERS_PER_RUN / live;
+  auto schedule = kj::heapArray<uint64_t>(live);
+  for (auto& tick: schedule) tick = ticks(rng);
+
+  Timers timers;
+  uint64_t check = 0;
+  auto elapsed = timeBenchmark([&]() {
+    for (uint64_t round = 0; round < rounds; ++round) {
+      for (uint i = 0; i < live; ++i) {
+        timers.schedule(schedule[i], i);
+      }
+      if (fire) {
+        check += timers.fireAll();
+      } else {
+        timers.cancelAll();
+      }
+    }
+  });
+
+  if (fire) {
+    KJ_ASSERT(check == rounds * (live * (live - 1) / 2));
+  }
+  reportBenchmark(name, rounds * live, elapsed, {{"liveTimers", double(live)}});
+}
+
+}  // namespace
+}  // namespace workerd
+
+int main() {
+  using namespace workerd;
+
+  for (uint64_t live: {10, 1'000, 100'000}) {
+    benchmarkTimers<WheelTimers>("timer-wheel/wheel/schedule-cancel", live, false);
+    benchmarkTimers<TreeMapTimers>("timer-wheel/treemap/schedule-cancel", live, false);
+    benchmarkTimers<WheelTimers>("timer-wheel/wheel/schedule-fire", live, true);
+    benchmarkTimers<TreeMapTimers>("timer-wheel/treemap/schedule-fire", live, true);
+  }
+  return 0;
+}
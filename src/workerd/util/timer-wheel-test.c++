@@ -0,0 +1,99 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "timer-wheel.h"
+#include <kj/test.h>
+#include <kj/vector.h>
+#include <kj/string.h>
+
+namespace workerd {
+namespace {
+
+using Wheel = TimerWheel<kj::StringPtr>;
+
+kj::String fire(Wheel& wheel, uint64_t tick) {
+  kj::Vector<kj::String> fired;
+  wheel.advanceTo(tick, [&](Wheel::Timer& timer) {
+    fired.add(kj::str(timer.value, '@', timer.getTick()));
+  });
+  return kj::strArray(fired, " ");
+}
+
+KJ_TEST("TimerWheel fires timers in order") {
+  Wheel wheel;
+
+  Wheel::Timer a(wheel, 5, "a");
+  Wheel::Timer b(wheel, 3, "b");
+  Wheel::Timer c(wheel, 5, "c");
+  Wheel::Timer d(wheel, 100, "d");
+  Wheel::Timer e(wheel, 70'000, "e");
+  Wheel::Timer f(wheel, 1ull << 40, "f");
+  KJ_EXPECT(wheel.size() == 6);
+  KJ_EXPECT(KJ_ASSERT_NONNULL(wheel.nextTick()) == 3);
+
+  KJ_EXPECT(fire(wheel, 2) == "");
+  KJ_EXPECT(fire(wheel, 5) == "b@3 a@5 c@5");
+  KJ_EXPECT(!a.isScheduled());
+  KJ_EXPECT(KJ_ASSERT_NONNULL(wheel.nextTick()) == 100);
+
+  // Higher-level timers cascade down as the wheel advances, without firing early.
+  KJ_EXPECT(fire(wheel, 69'999) == "d@100");
+  KJ_EXPECT(KJ_ASSERT_NONNULL(wheel.nextTick()) == 70'000);
+  KJ_EXPECT(fire(wheel, 1ull << 41) == "e@70000 f@1099511627776");
+  KJ_EXPECT(wheel.empty());
+  KJ_EXPECT(wheel.nextTick() == nullptr);
+  KJ_EXPECT(wheel.getCurrentTick() == 1ull << 41);
+}
+
+KJ_TEST("TimerWheel cancellation") {
+  Wheel wheel(1000);
+
+  {
+    Wheel::Timer a(wheel, 2000, "a");
+    KJ_EXPECT(KJ_ASSERT_NONNULL(wheel.nextTick()) == 2000);
+  }
+  KJ_EXPECT(wheel.empty());
+
+  Wheel::Timer b(wheel, 1500, "b");
+  kj::Maybe<Wheel::Timer> c;
+  c.emplace(wheel, 1200, "c");
+  KJ_EXPECT(KJ_ASSERT_NONNULL(wheel.nextTick()) == 1200);
+  c = nullptr;
+  KJ_EXPECT(KJ_ASSERT_NONNULL(wheel.nextTick()) == 1500);
+
+  // Timers scheduled in the past are due immediately.
+  Wheel::Timer d(wheel, 10, "d");
+  KJ_EXPECT(d.getTick() == 1000);
+  KJ_EXPECT(fire(wheel, 1000) == "d@1000");
+  KJ_EXPECT(fire(wheel, 2000) == "b@1500");
+}
+
+KJ_TEST("TimerWheel callbacks can schedule and cancel timers") {
+  Wheel wheel;
+
+  kj::Maybe<Wheel::Timer> a, b, c;
+  a.emplace(wheel, 10, "a");
+  b.emplace(wheel, 10, "b");
+
+  kj::Vector<kj::String> fired;
+  wheel.advanceTo(20, [&](Wheel::Timer& timer) {
+    fired.add(kj::str(timer.value, '@', timer.getTick()));
+    if (timer.value == "a") {
+      b = nullptr;
+      c.emplace(wheel, 15, "c");
+    }
+  });
+  KJ_EXPECT(kj::strArray(fired, " ") == "a@10 c@15");
+}
+
+KJ_TEST("TimerWheel can be destroyed before its timers") {
+  kj::Maybe<Wheel> wheel;
+  wheel.emplace();
+  Wheel::Timer a(KJ_ASSERT_NONNULL(wheel), 10, "a");
+  wheel = nullptr;
+  KJ_EXPECT(!a.isScheduled());
+}
+
+}  // namespace
+}  // namespace workerd
@@ -0,0 +1,205 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#pragma once
+
+#include <kj/common.h>
+#include <kj/debug.h>
+#include <kj/list.h>
+#include <inttypes.h>
+
+namespace workerd {
+
+using kj::uint;
+
+template <typename T>
+class TimerWheel {
+  // A hierarchical timer wheel: a set of timers, each due at some integer tick, supporting
+  // constant-time scheduling and cancellation.
+  //
+  // Level 0 has one slot per tick, covering the current run of 64 ticks. Each higher level has
+  // slots 64 times as coarse as the one below it, covering the current run of 64 of those. A timer
+  // lives in the lowest level whose current run includes its tick, and moves down ("cascades") as
+  // the wheel advances into its slot. With 8 levels, ticks range from 0 to 2^48 - 1.
+  //
+  // Timers due at the same tick fire together, in the order they were scheduled.
+  //
+  // The wheel is not thread-safe.
+
+public:
+  static constexpr uint SLOT_BITS = 6;
+  static constexpr uint SLOTS = 1u << SLOT_BITS;
+  static constexpr uint LEVELS = 8;
+  static constexpr uint64_t MAX_TICK = (uint64_t(1) << (SLOT_BITS * LEVELS)) - 1;
+
+  class Timer {
+    // A timer, scheduled on creation and canceled on destruction (if it hasn't fired yet). A Timer
+    // may outlive its wheel, in which case it's canceled when the wheel is destroyed.
+
+  public:
+    Timer(TimerWheel& wheel, uint64_t tick, T value)
+        : value(kj::mv(value)), wheel(wheel), tick(kj::max(tick, wheel.currentTick)) {
+      KJ_REQUIRE(this->tick <= MAX_TICK, "timer is too far in the future");
+      wheel.insert(*this);
+      ++wheel.count;
+    }
+    ~Timer() noexcept(false) {
+      if (link.isLinked()) {
+        wheel.remove(*this);
+      }
+    }
+    KJ_DISALLOW_COPY_AND_MOVE(Timer);
+
+    uint64_t getTick() const { return tick; }
+    // The tick at which the timer is due. If it was scheduled in the past, this is the tick the
+    // wheel was at when it was scheduled.
+
+    bool isScheduled() const { return link.isLinked(); }
+    // False once the timer has fired, or its wheel has been destroyed.
+
+    T value;
+
+  private:
+    TimerWheel& wheel;
+    uint64_t tick;
+    uint level = 0;
+    uint slot = 0;
+    kj::ListLink<Timer> link;
+
+    friend class TimerWheel;
+  };
+
+  explicit TimerWheel(uint64_t startTick = 0): currentTick(startTick) {
+    KJ_REQUIRE(startTick <= MAX_TICK);
+  }
+  ~TimerWheel() noexcept(false) {
+    for (auto& level: slots) {
+      for (auto& list: level) {
+        while (!list.empty()) {
+          list.remove(list.front());
+        }
+      }
+    }
+  }
+  KJ_DISALLOW_COPY_AND_MOVE(TimerWheel);
+
+  uint64_t getCurrentTick() const { return currentTick; }
+
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+
+  kj::Maybe<uint64_t> nextTick() const {
+    // Returns the tick at which the earliest timer is due, or null if there are no timers.
+
+    if (count == 0) return nullptr;
+
+    for (uint level = 0; level < LEVELS; level++) {
+      // Everything in this level falls in a slot after the current one (or, on level 0, in the
+      // current one), within the current run. The first occupied slot holds the earliest timers.
+      uint current = slotIndex(currentTick, level);
+      uint64_t candidates = occupied[level] & (~uint64_t(0) << current);
+      if (level > 0) candidates &= ~(uint64_t(1) << current);
+      if (candidates == 0) continue;
+
+      auto& list = slots[level][__builtin_ctzll(candidates)];
+      if (level == 0) return list.front().tick;
+
+      uint64_t result = kj::maxValue;
+      for (auto& timer: list) {
+        result = kj::min(result, timer.tick);
+      }
+      return result;
+    }
+
+    KJ_FAIL_ASSERT("timer count is non-zero but there are no timers", count);
+  }
+
+  template <typename Func>
+  void advanceTo(uint64_t tick, Func&& func) {
+    // Advances the wheel to `tick`, removing each timer due at or before it and passing it to
+    // `func(Timer&)`, in order. `func` may cancel or schedule timers; any it schedules at or before
+    // `tick` fire during this call, too.
+
+    for (;;) {
+      KJ_IF_MAYBE(next, nextTick()) {
+        if (*next <= tick) {
+          jumpTo(*next);
+          auto& list = slots[0][slotIndex(currentTick, 0)];
+          while (!list.empty()) {
+            auto& timer = list.front();
+            remove(timer);
+            func(timer);
+          }
+          continue;
+        }
+      }
+      break;
+    }
+
+    if (tick > currentTick) {
+      jumpTo(tick);
+    }
+  }
+
+private:
+  uint64_t currentTick;
+  size_t count = 0;
+
+  kj::List<Timer, &Timer::link> slots[LEVELS][SLOTS];
+  uint64_t occupied[LEVELS] = {};
+  // Bit i of occupied[level] is set if slots[level][i] is non-empty.
+
+  static uint slotIndex(uint64_t tick, uint level) {
+    return (tick >> (SLOT_BITS * level)) & (SLOTS - 1);
+  }
+
+  void insert(Timer& timer) {
+    // Place the timer in the lowest level whose current run includes its tick.
+    uint level = 0;
+    while ((timer.tick >> (SLOT_BITS * (level + 1))) !=
+           (currentTick >> (SLOT_BITS * (level + 1)))) {
+      ++level;
+    }
+    timer.level = level;
+    timer.slot = slotIndex(timer.tick, level);
+    slots[level][timer.slot].add(timer);
+    occupied[level] |= uint64_t(1) << timer.slot;
+  }
+
+  void unlink(Timer& timer) {
+    auto& list = slots[timer.level][timer.slot];
+    list.remove(timer);
+    if (list.empty()) {
+      occupied[timer.level] &= ~(uint64_t(1) << timer.slot);
+    }
+  }
+
+  void remove(Timer& timer) {
+    unlink(timer);
+    --count;
+  }
+
+  void jumpTo(uint64_t tick) {
+    // Moves the wheel forward to `tick`, which must not be after any timer's tick. No timers fire,
+    // but those in slots that `tick` lands in cascade down, from the top level down so that
+    // timers cascade as many levels as they need to.
+
+    KJ_ASSERT(tick >= currentTick);
+    uint64_t previous = currentTick;
+    currentTick = tick;
+
+    for (uint level = LEVELS - 1; level > 0; level--) {
+      if ((tick >> (SLOT_BITS * level)) == (previous >> (SLOT_BITS * level))) continue;
+
+      auto& list = slots[level][slotIndex(tick, level)];
+      while (!list.empty()) {
+        auto& timer = list.front();
+        unlink(timer);
+        insert(timer);
+      }
+    }
+  }
+};
+
+}  // namespace workerd
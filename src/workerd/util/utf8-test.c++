@@ -0,0 +1,85 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "utf8.h"
+#include <kj/test.h>
+#include <kj/vector.h>
+#include <string>
+
+namespace workerd {
+namespace {
+
+kj::Maybe<kj::Array<char16_t>> decode(Utf8ToUtf16& decoder,
+                                      std::initializer_list<kj::StringPtr> parts) {
+  kj::Vector<char16_t> result;
+  size_t i = 0;
+  for (auto part: parts) {
+    bool flush = ++i == parts.size();
+    auto output = kj::heapArray<char16_t>(Utf8ToUtf16::maxOutputSize(part.size()));
+    KJ_IF_MAYBE(n, decoder.decode(part.asBytes(), output, flush)) {
+      result.addAll(output.slice(0, *n));
+    } else {
+      return nullptr;
+    }
+  }
+  return result.releaseAsArray();
+}
+
+bool decodesTo(std::initializer_list<kj::StringPtr> parts, const char16_t* expected) {
+  Utf8ToUtf16 decoder(false);
+  auto maybeResult = decode(decoder, parts);
+  auto& result = KJ_ASSERT_NONNULL(maybeResult);
+  return result.asPtr() == kj::arrayPtr(expected, std::char_traits<char16_t>::length(expected));
+}
+
+bool decodesStrictly(std::initializer_list<kj::StringPtr> parts) {
+  Utf8ToUtf16 decoder(true);
+  return decode(decoder, parts) != nullptr;
+}
+
+KJ_TEST("asciiPrefixLength") {
+  KJ_EXPECT(asciiPrefixLength(kj::StringPtr("").asBytes()) == 0);
+  KJ_EXPECT(asciiPrefixLength(kj::StringPtr("abc").asBytes()) == 3);
+  KJ_EXPECT(asciiPrefixLength(kj::StringPtr("abcdefghijklmnopqrstuvwxyz").asBytes()) == 26);
+  KJ_EXPECT(asciiPrefixLength(kj::StringPtr("abcdefghij\xc3\xa9klm").asBytes()) == 10);
+  KJ_EXPECT(asciiPrefixLength(kj::StringPtr("\xff" "abcdefghij").asBytes()) == 0);
+  KJ_EXPECT(isAscii(kj::StringPtr("0123456789abcdef0").asBytes()));
+  KJ_EXPECT(!isAscii(kj::StringPtr("0123456789abcdef\x80").asBytes()));
+}
+
+KJ_TEST("Utf8ToUtf16 decodes valid input") {
+  KJ_EXPECT(decodesTo({"hello, world"}, u"hello, world"));
+  KJ_EXPECT(decodesTo({"\xe2\x82\xac \xf0\x9f\x98\x80"}, u"\u20ac \U0001f600"));
+
+  // Sequences split across calls are carried over.
+  KJ_EXPECT(decodesTo({"\xe2\x82", "\xac\xf0", "\x9f\x98", "\x80"}, u"\u20ac\U0001f600"));
+}
+
+KJ_TEST("Utf8ToUtf16 replaces invalid sequences") {
+  // Each maximal subpart of an invalid sequence becomes one U+FFFD, as in the Encoding Standard.
+  KJ_EXPECT(decodesTo({"a\xffz"}, u"a\ufffdz"));
+  KJ_EXPECT(decodesTo({"\xc0\xafz"}, u"\ufffd\ufffdz"));
+  KJ_EXPECT(decodesTo({"\xf0\x80\x80z"}, u"\ufffd\ufffd\ufffdz"));
+  KJ_EXPECT(decodesTo({"\xed\xa0\x80"}, u"\ufffd\ufffd\ufffd"));
+  KJ_EXPECT(decodesTo({"\xe2\x82z"}, u"\ufffdz"));
+
+  // A sequence still incomplete when flushed is invalid too.
+  KJ_EXPECT(decodesTo({"a\xe2", "\x82"}, u"a\ufffd"));
+}
+
+KJ_TEST("Utf8ToUtf16 fatal mode") {
+  KJ_EXPECT(decodesStrictly({"hello, \xe2\x82", "\xac"}));
+  KJ_EXPECT(!decodesStrictly({"hello\xff"}));
+  KJ_EXPECT(!decodesStrictly({"hello\xe2\x82"}));
+
+  // The decoder is usable again after a failure.
+  Utf8ToUtf16 decoder(true);
+  KJ_EXPECT(decode(decoder, {"\xe2\x82z"}) == nullptr);
+  KJ_EXPECT(decoder.isIdle());
+  auto ok = decode(decoder, {"ok"});
+  KJ_EXPECT(KJ_ASSERT_NONNULL(ok).size() == 2);
+}
+
+}  // namespace
+}  // namespace workerd
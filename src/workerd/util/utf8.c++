@@ -0,0 +1,123 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "utf8.h"
+#include <kj/debug.h>
+#include <string.h>
+
+namespace workerd {
+
+size_t asciiPrefixLength(kj::ArrayPtr<const kj::byte> bytes) {
+  constexpr uint64_t HIGH_BITS = 0x8080808080808080ull;
+
+  const kj::byte* pos = bytes.begin();
+  const kj::byte* end = bytes.end();
+
+  // Check eight bytes at a time until we find a word with a high bit set. memcpy() compiles down
+  // to a single unaligned load.
+  while (end - pos >= 8) {
+    uint64_t word;
+    memcpy(&word, pos, sizeof(word));
+    if (word & HIGH_BITS) break;
+    pos += 8;
+  }
+
+  while (pos < end && *pos <= 0x7f) ++pos;
+  return pos - bytes.begin();
+}
+
+kj::Maybe<size_t> Utf8ToUtf16::decode(kj::ArrayPtr<const kj::byte> input,
+                                      kj::ArrayPtr<char16_t> output, bool flush) {
+  KJ_REQUIRE(output.size() >= maxOutputSize(input.size()));
+
+  // This follows the UTF-8 decoder algorithm from the Encoding Standard, so that replacement
+  // characters land exactly where the spec (and every browser) puts them.
+  char16_t* out = output.begin();
+  bool failed = false;
+  const auto error = [&]() {
+    if (fatal) {
+      failed = true;
+    } else {
+      *out++ = 0xfffd;
+    }
+  };
+
+  const kj::byte* pos = input.begin();
+  const kj::byte* end = input.end();
+  while (pos < end && !failed) {
+    kj::byte byte = *pos;
+
+    if (bytesNeeded == 0) {
+      if (byte <= 0x7f) {
+        size_t run = asciiPrefixLength(kj::arrayPtr(pos, end));
+        for (auto b: kj::arrayPtr(pos, run)) *out++ = b;
+        pos += run;
+        continue;
+      }
+
+      ++pos;
+      if (byte >= 0xc2 && byte <= 0xdf) {
+        bytesNeeded = 1;
+        codePoint = byte & 0x1f;
+      } else if (byte >= 0xe0 && byte <= 0xef) {
+        if (byte == 0xe0) lowerBoundary = 0xa0;
+        if (byte == 0xed) upperBoundary = 0x9f;
+        bytesNeeded = 2;
+        codePoint = byte & 0x0f;
+      } else if (byte >= 0xf0 && byte <= 0xf4) {
+        if (byte == 0xf0) lowerBoundary = 0x90;
+        if (byte == 0xf4) upperBoundary = 0x8f;
+        bytesNeeded = 3;
+        codePoint = byte & 0x07;
+      } else {
+        error();
+      }
+      continue;
+    }
+
+    if (byte < lowerBoundary || byte > upperBoundary) {
+      // The sequence ends early. The byte that ended it is processed again, from scratch.
+      reset();
+      error();
+      continue;
+    }
+
+    ++pos;
+    lowerBoundary = 0x80;
+    upperBoundary = 0xbf;
+    codePoint = (codePoint << 6) | (byte & 0x3f);
+    if (++bytesSeen < bytesNeeded) continue;
+
+    if (codePoint > 0xffff) {
+      codePoint -= 0x10000;
+      *out++ = 0xd800 + (codePoint >> 10);
+      *out++ = 0xdc00 + (codePoint & 0x3ff);
+    } else {
+      *out++ = codePoint;
+    }
+    reset();
+  }
+
+  if (flush && bytesNeeded != 0 && !failed) {
+    reset();
+    error();
+  }
+
+  if (failed) {
+    reset();
+    return nullptr;
+  }
+  if (flush) reset();
+  return out - output.begin();
+}
+
+void Utf8ToUtf16::reset() {
+  codePoint = 0;
+  bytesSeen = 0;
+  bytesNeeded = 0;
+  lowerBoundary = 0x80;
+  upperBoundary = 0xbf;
+}
+
+}  // namespace workerd
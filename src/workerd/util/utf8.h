@@ -0,0 +1,57 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#pragma once
+
+#include <kj/common.h>
+
+namespace workerd {
+
+using kj::uint;
+
+size_t asciiPrefixLength(kj::ArrayPtr<const kj::byte> bytes);
+// Returns the number of leading bytes of `bytes` that are ASCII (<= 0x7f). Scans a machine word
+// at a time.
+
+inline bool isAscii(kj::ArrayPtr<const kj::byte> bytes) {
+  return asciiPrefixLength(bytes) == bytes.size();
+}
+
+class Utf8ToUtf16 {
+  // Incrementally decodes UTF-8 to UTF-16 as specified by the WHATWG Encoding Standard: each
+  // invalid sequence becomes one U+FFFD (or, if `fatal`, fails the decode), and a sequence split
+  // across calls is carried over to the next. Runs of ASCII are converted a word at a time.
+  //
+  // The byte order mark isn't treated specially; that's up to the caller.
+
+public:
+  explicit Utf8ToUtf16(bool fatal): fatal(fatal) {}
+
+  static size_t maxOutputSize(size_t inputSize) { return inputSize + 3; }
+  // Upper bound on the code units one decode() of `inputSize` bytes may write. (The extra units
+  // cover a sequence carried over from the previous call.)
+
+  kj::Maybe<size_t> decode(kj::ArrayPtr<const kj::byte> input, kj::ArrayPtr<char16_t> output,
+                           bool flush);
+  // Decodes `input` into `output`, which must have room for maxOutputSize(input.size()) units,
+  // and returns the number of units written. If `flush`, a sequence left incomplete at the end is
+  // invalid, and the decoder is reset afterwards.
+  //
+  // Returns null if `fatal` and the input is invalid, in which case the decoder is reset.
+
+  bool isIdle() const { return bytesNeeded == 0; }
+  // True if no partial sequence is being carried over.
+
+  void reset();
+
+private:
+  bool fatal;
+  uint32_t codePoint = 0;
+  uint bytesSeen = 0;
+  uint bytesNeeded = 0;
+  kj::byte lowerBoundary = 0x80;
+  kj::byte upperBoundary = 0xbf;
+};
+
+}  // namespace workerd
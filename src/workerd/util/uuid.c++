@@ -3,8 +3,8 @@
 //     https://opensource.org/licenses/Apache-2.0
 
 #include "uuid.h"
+#include "random.h"
 
-#include <openssl/rand.h>
 #include <kj/debug.h>
 
 namespace workerd {
@@ -15,7 +15,7 @@ kj::String randomUUID(kj::Maybe<kj::EntropySource&> optionalEntropySource) {
   KJ_IF_MAYBE(entropySource, optionalEntropySource) {
     entropySource->generate(buffer);
   } else {
-    KJ_ASSERT(RAND_bytes(buffer, sizeof(buffer)) == 1);
+    randomBytes(buffer);
   }
 
   kj::Vector<char> result(37);
@@ -42,14 +42,8 @@ KJ_TEST("CrossThreadWaitList") {
     });
   };
 
-  {
-    CrossThreadWaitList list;
-    doTest(list);
-  }
-  {
-    CrossThreadWaitList list({.useThreadLocalOptimization = true});
-    doTest(list);
-  }
+  CrossThreadWaitList list;
+  doTest(list);
 }
 
 KJ_TEST("CrossThreadWaitList exceptions") {
@@ -89,14 +83,51 @@ KJ_TEST("CrossThreadWaitList exceptions") {
     });
   };
 
-  {
-    CrossThreadWaitList list;
-    doTest(list);
-  }
-  {
-    CrossThreadWaitList list({.useThreadLocalOptimization = true});
-    doTest(list);
-  }
+  CrossThreadWaitList list;
+  doTest(list);
+}
+
+KJ_TEST("CrossThreadWaitList fulfilled in the waiting thread") {
+  kj::EventLoop loop;
+  kj::WaitScope ws(loop);
+
+  CrossThreadWaitList list;
+  auto promise1 = list.addWaiter();
+  auto promise2 = list.addWaiter();
+  KJ_EXPECT(!promise1.poll(ws));
+
+  // Meanwhile, another thread waits too.
+  kj::MutexGuarded<bool> waiting(false);
+  kj::Thread other([&]() noexcept {
+    kj::EventLoop loop;
+    kj::WaitScope ws(loop);
+    auto promise = list.addWaiter();
+    *waiting.lockExclusive() = true;
+    promise.wait(ws);
+  });
+  waiting.when([](bool w) { return w; }, [](bool) {});
+
+  list.fulfill();
+  KJ_EXPECT(promise1.poll(ws));
+  KJ_EXPECT(promise2.poll(ws));
+  promise1.wait(ws);
+  promise2.wait(ws);
+
+  // Once done, new waiters are ready right away.
+  auto promise3 = list.addWaiter();
+  KJ_EXPECT(promise3.poll(ws));
+  promise3.wait(ws);
+}
+
+KJ_TEST("CrossThreadWaitList rejected in the waiting thread") {
+  kj::EventLoop loop;
+  kj::WaitScope ws(loop);
+
+  CrossThreadWaitList list;
+  auto promise = list.addWaiter();
+  list.reject(KJ_EXCEPTION(FAILED, "foo"));
+  KJ_EXPECT_THROW_MESSAGE("foo", promise.wait(ws));
+  KJ_EXPECT_THROW_MESSAGE("foo", list.addWaiter().wait(ws));
 }
 
 }  // namespace
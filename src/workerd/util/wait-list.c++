@@ -9,28 +9,32 @@ namespace workerd {
 
 namespace {
 thread_local CrossThreadWaitList::WaiterMap threadLocalWaiters;
-// Optimization: If the same wait list is waited multiple times in the same thread, we want to
-// share the signal rather than send two cross-thread signals.
+// If the same wait list is waited multiple times in the same thread, we want to share the signal
+// rather than send two cross-thread signals. The map's address also identifies the thread.
 }  // namespace
 
 void END_WAIT_LIST_CANCELER_STACK_START_CANCELEE_STACK() {}
 
-CrossThreadWaitList::CrossThreadWaitList(Options options)
-    : state(kj::atomicRefcounted<State>(options)) {}
+CrossThreadWaitList::CrossThreadWaitList()
+    : state(kj::atomicRefcounted<State>()) {}
 
 void CrossThreadWaitList::destroyed() {
   if (!createdFulfiller) state->lostFulfiller();
 }
 
 CrossThreadWaitList::Waiter::Waiter(const State& state,
-    kj::Own<kj::CrossThreadPromiseFulfiller<void>> fulfillerArg)
-    : state(kj::atomicAddRef(state)), fulfiller(kj::mv(fulfillerArg)) {
+    kj::Own<kj::CrossThreadPromiseFulfiller<void>> crossThreadFulfillerArg,
+    kj::Own<kj::PromiseFulfiller<void>> localFulfillerArg)
+    : state(kj::atomicAddRef(state)),
+      crossThreadFulfiller(kj::mv(crossThreadFulfillerArg)),
+      localFulfiller(kj::mv(localFulfillerArg)),
+      thread(&threadLocalWaiters) {
   auto lock = state.waiters.lockExclusive();
   if (__atomic_load_n(&state.done, __ATOMIC_ACQUIRE)) {
     KJ_IF_MAYBE(e, state.exception) {
-      fulfiller->reject(kj::cp(*e));
+      reject(*e);
     } else {
-      fulfiller->fulfill();
+      fulfill();
     }
   } else {
     lock->add(*this);
@@ -47,10 +51,26 @@ CrossThreadWaitList::Waiter::~Waiter() noexcept(false) {
     }
   }
 
-  if (state->useThreadLocalOptimization) {
-    auto& entry = KJ_ASSERT_NONNULL(threadLocalWaiters.findEntry(state.get()));
-    KJ_ASSERT(entry.value == this);
-    threadLocalWaiters.erase(entry);
+  auto& entry = KJ_ASSERT_NONNULL(threadLocalWaiters.findEntry(state.get()));
+  KJ_ASSERT(entry.value == this);
+  threadLocalWaiters.erase(entry);
+}
+
+void CrossThreadWaitList::Waiter::fulfill() {
+  // The waiter can't be destroyed concurrently in its own thread, since that thread is us, nor in
+  // another, since its destructor takes the list lock, which the caller holds.
+  if (thread == &threadLocalWaiters) {
+    localFulfiller->fulfill();
+  } else {
+    crossThreadFulfiller->fulfill();
+  }
+}
+
+void CrossThreadWaitList::Waiter::reject(const kj::Exception& e) {
+  if (thread == &threadLocalWaiters) {
+    localFulfiller->reject(kj::cp(e));
+  } else {
+    crossThreadFulfiller->reject(kj::cp(e));
   }
 }
 
@@ -63,28 +83,24 @@ kj::Promise<void> CrossThreadWaitList::addWaiter() const {
     }
   }
 
-  if (state->useThreadLocalOptimization) {
-    kj::Own<Waiter> ownWaiter;
-
-    auto& waiter = threadLocalWaiters.findOrCreate(state.get(),
-        [&]() -> decltype(threadLocalWaiters)::Entry {
-      auto paf = kj::newPromiseAndCrossThreadFulfiller<void>();
-      ownWaiter = kj::refcounted<Waiter>(*state, kj::mv(paf.fulfiller));
-      ownWaiter->forkedPromise = paf.promise.fork();
-      return { state.get(), ownWaiter.get() };
-    });
-
-    if (ownWaiter.get() == nullptr) {
-      ownWaiter = kj::addRef(*waiter);
-    }
-
-    return waiter->forkedPromise.addBranch().attach(kj::mv(ownWaiter));
-  } else {
-    // No refcounting, no forked promise.
-    auto paf = kj::newPromiseAndCrossThreadFulfiller<void>();
-    auto waiter = kj::heap<Waiter>(*state, kj::mv(paf.fulfiller));
-    return paf.promise.attach(kj::mv(waiter));
+  kj::Own<Waiter> ownWaiter;
+
+  auto& waiter = threadLocalWaiters.findOrCreate(state.get(),
+      [&]() -> decltype(threadLocalWaiters)::Entry {
+    auto crossThreadPaf = kj::newPromiseAndCrossThreadFulfiller<void>();
+    auto localPaf = kj::newPromiseAndFulfiller<void>();
+    ownWaiter = kj::refcounted<Waiter>(
+        *state, kj::mv(crossThreadPaf.fulfiller), kj::mv(localPaf.fulfiller));
+    ownWaiter->forkedPromise = crossThreadPaf.promise.exclusiveJoin(kj::mv(localPaf.promise))
+        .fork();
+    return { state.get(), ownWaiter.get() };
+  });
+
+  if (ownWaiter.get() == nullptr) {
+    ownWaiter = kj::addRef(*waiter);
   }
+
+  return waiter->forkedPromise.addBranch().attach(kj::mv(ownWaiter));
 }
 
 kj::Own<kj::CrossThreadPromiseFulfiller<void>> CrossThreadWaitList::makeSeparateFulfiller() {
@@ -125,7 +141,7 @@ void CrossThreadWaitList::State::fulfill() const {
 
   for (auto& waiter: *lock) {
     lock->remove(waiter);
-    waiter.fulfiller->fulfill();
+    waiter.fulfill();
     __atomic_store_n(&waiter.unlinked, true, __ATOMIC_RELEASE);
   }
 }
@@ -139,7 +155,7 @@ void CrossThreadWaitList::State::reject(kj::Exception&& e) const {
 
   for (auto& waiter: *lock) {
     lock->remove(waiter);
-    waiter.fulfiller->reject(kj::cp(exceptionRef));
+    waiter.reject(exceptionRef);
     __atomic_store_n(&waiter.unlinked, true, __ATOMIC_RELEASE);
   }
 }
@@ -156,7 +172,7 @@ void CrossThreadWaitList::State::lostFulfiller() const {
   if (!lock->empty()) {
     for (auto& waiter: *lock) {
       lock->remove(waiter);
-      waiter.fulfiller->reject(kj::cp(exceptionRef));
+      waiter.reject(exceptionRef);
       __atomic_store_n(&waiter.unlinked, true, __ATOMIC_RELEASE);
     }
   }
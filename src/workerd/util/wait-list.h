@@ -22,17 +22,15 @@ class CrossThreadWaitList {
   // * CrossThreadWaitList is one object, not a promise/fulfiller pair. In many use cases, this
   //   turns out to be most convenient. But if you want a separate fulfiller, you can call the
   //   `makeSeparateFulfiller()` method.
+  //
+  // Waiting is cheap in the common cases: once the list is done, `addWaiter()` returns a ready (or
+  // rejected) promise after a single atomic load, without locking or allocating. All waiters in
+  // one thread share a single waiter object, so fulfilling the list signals each waiting thread
+  // once, however many waiters it has. Waiters in the fulfilling thread itself are fulfilled
+  // directly, without going through the thread's executor.
 
 public:
-  struct Options {
-    bool useThreadLocalOptimization = false;
-    // Enable this if it is common for there to be multiple waiters in the same thread. This avoids
-    // sending multiple cross-thread signals in this case, instead sending one signal that all
-    // waiters in the thread wait on.
-  };
-
-  CrossThreadWaitList(): CrossThreadWaitList(Options()) {}
-  CrossThreadWaitList(Options options);
+  CrossThreadWaitList();
   CrossThreadWaitList(CrossThreadWaitList&& other) = default;
   ~CrossThreadWaitList() noexcept(false) {
     // Check if moved away.
@@ -74,11 +72,25 @@ public:
 
 private:
   struct Waiter: public kj::Refcounted {
-    Waiter(const State& state, kj::Own<kj::CrossThreadPromiseFulfiller<void>> fulfiller);
+    // All of one thread's waiters on one list.
+
+    Waiter(const State& state,
+           kj::Own<kj::CrossThreadPromiseFulfiller<void>> crossThreadFulfiller,
+           kj::Own<kj::PromiseFulfiller<void>> localFulfiller);
     ~Waiter() noexcept(false);
 
     kj::Own<const State> state;
-    kj::Own<kj::CrossThreadPromiseFulfiller<void>> fulfiller;
+    kj::Own<kj::CrossThreadPromiseFulfiller<void>> crossThreadFulfiller;
+    kj::Own<kj::PromiseFulfiller<void>> localFulfiller;
+    // Only one of these is used: `localFulfiller` if the list is fulfilled (or rejected) in the
+    // waiter's own thread, which saves waking the thread's event loop through its executor.
+
+    const void* thread;
+    // Identifies the thread that created the waiter.
+
+    void fulfill();
+    void reject(const kj::Exception& e);
+    // Called with the list lock held.
 
     kj::ListLink<Waiter> link;
     // Protected by list mutex.
@@ -88,14 +100,12 @@ private:
     // we don't have to redundantly take the lock.
 
     kj::ForkedPromise<void> forkedPromise = nullptr;
-    // Only initialized if useThreadLocalOptimization is enabled.
+    // Every waiter in the thread waits on a branch of this.
   };
 
   struct State: public kj::AtomicRefcounted {
     kj::MutexGuarded<kj::List<Waiter, &Waiter::link>> waiters;
 
-    const bool useThreadLocalOptimization = false;
-
     mutable bool done = false;
     // Atomically set true at the start of fulfill() or reject(). This can be checked before taking
     // the lock, but if false, it must be checked again after taking the lock, to avoid a race.
@@ -108,9 +118,6 @@ private:
     void fulfill() const;
     void reject(kj::Exception&& e) const;
     void lostFulfiller() const;
-
-    explicit State(const Options& options)
-        : useThreadLocalOptimization(options.useThreadLocalOptimization) {}
   };
 
   kj::Own<const State> state;